@@ -233,6 +233,40 @@ void *dp_session_get_private(int id, const struct session *session);
 int dp_session_table_walk(dp_session_walk_t *fn, void *data,
 			  unsigned int types);
 
+/**
+ * Enable or disable tracking of changed sessions.
+ *
+ * While enabled, each forwarding thread logs the sessions whose
+ * protocol state or counters change, so that dp_session_dirty_walk()
+ * need only visit those.  The caller should sync the whole table with
+ * dp_session_table_walk() after enabling.
+ *
+ * @param [in] enable - true to enable tracking.
+ *
+ * @return - 0 on success.
+ *	- -ENOMEM if the per-thread logs could not be allocated.
+ */
+int dp_session_dirty_track(bool enable);
+
+/**
+ * Walk the sessions changed since the previous dirty walk.
+ *
+ * Each changed session is visited once, and is no longer marked as
+ * changed when the callback is called, so a change made while it is
+ * being packed is seen by the next walk.  A changed session not of the
+ * given types is no longer marked either, so a caller should walk all
+ * the types it tracks at once.  Must be called from the main thread.
+ *
+ * @param [in] fn - callback function; if it returns non-zero the walk
+ *			stops and the session remains marked.
+ * @param [in] data - passed to the callback function.
+ * @param [in] types - bitwise or of SESSION_TYPE_* to walk.
+ *
+ * @return - return of callback function.
+ */
+int dp_session_dirty_walk(dp_session_walk_t *fn, void *data,
+			  unsigned int types);
+
 /**
  * Get a session's unique id.
  *
@@ -309,4 +343,48 @@ int dp_session_pack(struct session *session, void *buf, uint32_t size,
  */
 int dp_session_restore(void *buf, uint32_t size, enum session_pack_type *spt);
 
+/**
+ * Serialize a batch of sessions into one buffer.
+ *
+ * The sessions are packed as by dp_session_pack(), behind a single
+ * message header and encoded compactly, for restoring together with
+ * dp_session_restore_bulk().  As with dp_session_pack(), a NAT64 or
+ * NAT46 session is packed along with its peer, which should not be
+ * passed as well.
+ *
+ * Sessions that can't be packed are skipped.  Packing stops at the
+ * first session that doesn't fit in the buffer, and the caller
+ * continues from there with another buffer.
+ *
+ * @param [in] sessions - sessions to be packed
+ * @param [in] count - number of sessions
+ * @param [in, out] buf - buffer pointer
+ * @param [in] size - size of buffer
+ * @param [in] spt - SESSION_PACK_FULL, SESSION_PACK_UPDATE
+ * @param [out] consumed - number of sessions packed or skipped
+ *
+ * @return - packed length on success
+ *   -ENOSPC if not even the first session fits
+ *   -errno on other errors.
+ */
+int dp_session_pack_bulk(struct session *sessions[], uint32_t count,
+			 void *buf, uint32_t size,
+			 enum session_pack_type spt, uint32_t *consumed);
+
+/**
+ * Restore or update all of the sessions of a buffer packed by
+ * dp_session_pack_bulk().  A session that can't be restored doesn't
+ * stop the rest from being restored.
+ *
+ * @param [in] buf - buffer to be restored
+ * @param [in] size - length of buffer
+ * @param [out] spt - pack type
+ * @param [out] restored - number of sessions restored or updated
+ *
+ * @return - 0 if all sessions were restored
+ *   -errno of the first failure otherwise.
+ */
+int dp_session_restore_bulk(void *buf, uint32_t size,
+			    enum session_pack_type *spt, uint32_t *restored);
+
 #endif
@@ -230,6 +230,23 @@ struct pl_packet {
 	 * for this packet.
 	 */
 	int                   max_data_used;
+	/*
+	 * Set when nxt already holds the result of the route lookup for
+	 * the packet, done for the whole burst before the route lookup
+	 * node is run on each packet. Cleared by the route lookup node.
+	 */
+	uint8_t               nxt_looked_up;
+	/*
+	 * Set when acl_in_rule already holds the result of inspecting the
+	 * ingress ACL ruleset for the packet, done for the whole burst
+	 * before the validate node is run on each packet. Cleared by the
+	 * ingress ACL node.
+	 */
+	uint8_t               acl_in_looked_up;
+	/*
+	 * The matching ingress ACL rule, or NULL, if acl_in_looked_up is set.
+	 */
+	struct npf_rule      *acl_in_rule;
 	/*
 	 * An array of pointers to store data. These can be used by nodes
 	 * to store data that is (potentially) needed by a node later in
@@ -22,6 +22,7 @@
 #include <rte_log.h>
 #include <rte_malloc.h>
 #include <rte_mbuf.h>
+#include <rte_memcpy.h>
 #include <rte_ring.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -33,6 +34,7 @@
 #include <zmq.h>
 
 #include "capture.h"
+#include "capture_fmt.h"
 #include "config_internal.h"
 #include "event.h"
 #include "fal.h"
@@ -54,6 +56,7 @@
 #define CAPTURE_RING_SZ		256
 #define CAP_MAX_PER_PORT        4 /* max simultaneous captures on a port */
 #define CAPTURE_TIME_RESYNC_USECS (60 * USEC_PER_SEC)
+#define CAPTURE_DEQ_BURST	32 /* packets handled by the thread at once */
 
 static struct rte_mempool *capture_pool;
 
@@ -107,6 +110,7 @@ static bool capture_stop(struct ifnet *ifp,
 	struct capture_filter *cap_filter;
 
 	cap_info->capture_mask &= ~slot;
+	cap_info->pcapng_mask &= ~slot;
 
 	if (cap_info->capture_mask == 0)
 		return true;
@@ -333,42 +337,69 @@ static int64_t capture_usec_from_tod_base(uint64_t ts, uint64_t base,
 	return ((int64_t)(ts - base) * USEC_PER_SEC) / (int64_t)hz;
 }
 
-/* Read timestamp from packet and convert it to system time of day format */
-static void capture_get_timestamp(struct rte_mbuf *m, struct timeval *tv)
+/*
+ * Read timestamps from a burst of packets and convert them to system
+ * time of day format.
+ */
+static void capture_get_timestamps(struct rte_mbuf *pkts[], unsigned int n,
+				   struct timeval tv[])
 {
-	uint64_t ts = m->udata64;
-	int64_t us;
+	struct timeval tod;
 	uint64_t base;
 	uint64_t hz;
-
-	m->udata64 = 0;
+	unsigned int i;
 
 	/* protect against resync happening in another thread */
 	rte_spinlock_lock(&capture_time_lock);
 
-	us = capture_usec_from_tod_base(ts, capture_base, capture_hz);
-	*tv = capture_tod;
+	tod = capture_tod;
+	base = capture_base;
+	hz = capture_hz;
 
 	rte_spinlock_unlock(&capture_time_lock);
 
-	/* Check if we should resync the time base */
-	if (us >= CAPTURE_TIME_RESYNC_USECS ||
-	    us + CAPTURE_TIME_RESYNC_USECS <= 0) {
-		capture_time_resync(tv, &base, &hz);
+	for (i = 0; i < n; i++) {
+		uint64_t ts = pkts[i]->udata64;
+		int64_t us;
+
+		pkts[i]->udata64 = 0;
 		us = capture_usec_from_tod_base(ts, base, hz);
-	}
 
-	tv->tv_sec += us / USEC_PER_SEC;
-	tv->tv_usec += us % USEC_PER_SEC;
-	if (tv->tv_usec >= USEC_PER_SEC) {
-		++tv->tv_sec;
-		tv->tv_usec -= USEC_PER_SEC;
-	} else if (tv->tv_usec < 0) {
-		--tv->tv_sec;
-		tv->tv_usec += USEC_PER_SEC;
+		/* Check if we should resync the time base */
+		if (us >= CAPTURE_TIME_RESYNC_USECS ||
+		    us + CAPTURE_TIME_RESYNC_USECS <= 0) {
+			capture_time_resync(&tod, &base, &hz);
+			us = capture_usec_from_tod_base(ts, base, hz);
+		}
+
+		tv[i] = tod;
+		tv[i].tv_sec += us / USEC_PER_SEC;
+		tv[i].tv_usec += us % USEC_PER_SEC;
+		if (tv[i].tv_usec >= USEC_PER_SEC) {
+			++tv[i].tv_sec;
+			tv[i].tv_usec -= USEC_PER_SEC;
+		} else if (tv[i].tv_usec < 0) {
+			--tv[i].tv_sec;
+			tv[i].tv_usec += USEC_PER_SEC;
+		}
 	}
 }
 
+/*
+ * The copy of a packet given to the capture thread may be truncated to
+ * the snaplen, so the length of the packet on the wire is kept in the
+ * hash of the copy, which capture doesn't otherwise use.
+ */
+static inline void capture_set_wire_len(struct rte_mbuf *m, uint32_t len)
+{
+	m->hash.usr = len;
+}
+
+static inline uint32_t capture_get_wire_len(const struct rte_mbuf *m)
+{
+	return m->hash.usr;
+}
+
 /* write to event fd to wakeup capture thread */
 static void capture_wakeup(struct capture_info *cap_info)
 {
@@ -380,8 +411,47 @@ static void capture_wakeup(struct capture_info *cap_info)
 			strerror(errno));
 }
 
+/*
+ * Copy as much of a packet as can be captured.  Only the first snaplen
+ * bytes are ever sent, so only those are copied, into one segment, so
+ * that the filters and the capture thread can read them directly.  A
+ * snaplen too big for one segment gets a full copy of the packet.
+ */
+static struct rte_mbuf *capture_mbuf_snap(const struct rte_mbuf *ms,
+					  unsigned int snaplen)
+{
+	uint32_t len = RTE_MIN(rte_pktmbuf_pkt_len(ms), snaplen);
+	struct rte_mbuf *m;
+	const void *src;
+	char *dst;
+
+	m = pktmbuf_alloc(capture_pool, pktmbuf_get_vrf(ms));
+	if (!m)
+		return NULL;
+
+	if (len > rte_pktmbuf_tailroom(m)) {
+		rte_pktmbuf_free(m);
+		m = pktmbuf_copy(ms, capture_pool);
+		if (m)
+			capture_set_wire_len(m, rte_pktmbuf_pkt_len(ms));
+		return m;
+	}
+
+	pktmbuf_copy_meta(m, ms);
+	dst = rte_pktmbuf_mtod(m, char *);
+	src = rte_pktmbuf_read(ms, 0, len, dst);
+	if (src != dst)
+		rte_memcpy(dst, src, len);
+	m->data_len = len;
+	m->pkt_len = len;
+	capture_set_wire_len(m, rte_pktmbuf_pkt_len(ms));
+
+	return m;
+}
+
 /* Make a copy of the packet mbufs */
-static int capture_mbuf_copy(struct rte_mbuf *mbi[], struct rte_mbuf *mbo[],
+static int capture_mbuf_copy(const struct capture_info *cap_info,
+			     struct rte_mbuf *mbi[], struct rte_mbuf *mbo[],
 			     unsigned int n)
 {
 	uint64_t ts = rte_get_timer_cycles();
@@ -389,7 +459,7 @@ static int capture_mbuf_copy(struct rte_mbuf *mbi[], struct rte_mbuf *mbo[],
 	unsigned int i, j;
 
 	for (i = 0; i < n; i++) {
-		m = pktmbuf_copy(mbi[i], capture_pool);
+		m = capture_mbuf_snap(mbi[i], cap_info->snaplen);
 		if (!m)
 			goto nomem;
 
@@ -428,6 +498,7 @@ static int capture_enqueue(struct capture_info *cap_info,
 void capture_hardware(const struct ifnet *ifp, struct rte_mbuf *mbuf)
 {
 	mbuf->udata64 = rte_get_timer_cycles();
+	capture_set_wire_len(mbuf, rte_pktmbuf_pkt_len(mbuf));
 
 	if (unlikely(!ifp->hw_capturing) ||
 	    (unlikely(capture_enqueue(ifp->cap_info, &mbuf, 1) == 0)))
@@ -442,7 +513,7 @@ void capture_burst(const struct ifnet *ifp,
 	struct rte_mbuf *snap[n];
 
 	/* may be called with no packets on transmit with bonding interfaces */
-	if (n == 0 || capture_mbuf_copy(pkts, snap, n) < 0) {
+	if (n == 0 || capture_mbuf_copy(cap_info, pkts, snap, n) < 0) {
 		cap_info->pkt_drops += n;
 		return;
 	}
@@ -451,111 +522,176 @@ void capture_burst(const struct ifnet *ifp,
 		pktmbuf_free_bulk(snap, n);
 }
 
-/* Add to zmq msg if within the snaplen and return the remaining space. */
-static int addmsg_if_space(zmsg_t *msg, const void *ptr,
-			   unsigned int len, unsigned int space)
+/*
+ * Send a packet to the pcap captures whose slots are in filtered_mask.
+ * The captured bytes, including any VLAN header rebuilt from the mbuf,
+ * go in a single frame after the slot mask and the PCAP header.
+ */
+static int capture_write(struct rte_mbuf *m, const struct timeval *ts,
+			 uint8_t filtered_mask, struct ifnet *ifp)
 {
-	unsigned int addlen;
+	struct capture_info *cap_info = ifp->cap_info;
+	unsigned int vlan_len = capture_fmt_vlan_len(m);
+	struct pcap_pkthdr pcap;
+	zframe_t *frame;
+	zmsg_t *msg;
+
+	pcap.ts = *ts;
+	pcap.len = capture_get_wire_len(m) + vlan_len;
+	pcap.caplen = RTE_MIN(rte_pktmbuf_pkt_len(m) + vlan_len,
+			      cap_info->snaplen);
+
+	msg = zmsg_new();
+	if (!msg)
+		return -1;
+
+	frame = zframe_new(NULL, pcap.caplen);
+	if (!frame) {
+		zmsg_destroy(&msg);
+		return -1;
+	}
+	capture_fmt_data(m, if_tpid(ifp), zframe_data(frame), pcap.caplen);
 
-	addlen = len > space ? space : len;
-	zmsg_addmem(msg, ptr, addlen);
-	return space - addlen;
+	/*
+	 * First send filtered mask, ie. the slots that survived filtering,
+	 * then PCAP header, then the packet.
+	 */
+	zmsg_addmem(msg, &filtered_mask, sizeof(filtered_mask));
+	zmsg_addmem(msg, &pcap, sizeof(pcap));
+	zmsg_append(msg, &frame);
+
+	return zmsg_send_and_destroy(&msg, cap_info->cap_pub);
 }
 
-/* Filter packets and send to captures via zmq */
-static int capture_write(struct rte_mbuf *m, struct ifnet *ifp)
+/*
+ * Send the packets of a burst that survived filtering for a pcapng
+ * capture slot in one message: the slot, then a frame holding a whole
+ * pcapng section, so that the frames can be written out back to back
+ * as a pcapng file.
+ */
+static int capture_write_pcapng(struct rte_mbuf *pkts[], unsigned int n,
+				const struct timeval ts[],
+				const uint8_t filtered_mask[],
+				uint8_t slot, struct ifnet *ifp)
 {
 	struct capture_info *cap_info = ifp->cap_info;
-	struct capture_filter *cap_filter;
-	struct pcap_pkthdr pcap;
-	uint8_t filtered_mask = cap_info->capture_mask;
+	uint32_t caplen[CAPTURE_DEQ_BURST];
+	size_t size, off;
+	zframe_t *frame;
+	unsigned int i;
 	zmsg_t *msg;
-	unsigned int space = cap_info->snaplen;
-
-	capture_get_timestamp(m, &pcap.ts);
-	pcap.len = rte_pktmbuf_pkt_len(m);
-	if (pcap.len < cap_info->snaplen)
-		pcap.caplen = pcap.len;
-	else
-		pcap.caplen = cap_info->snaplen;
+	char *data;
 
-	TAILQ_FOREACH(cap_filter, &cap_info->filters, next) {
-		if (!bpf_filter(cap_filter->filter.bf_insns,
-			       (const u_char *) rte_pktmbuf_mtod(m, char *),
-			       pcap.len, pcap.caplen))
-			filtered_mask &= ~cap_filter->mask;
+	size = capture_fmt_pcapng_hdr_len(ifp->if_name);
+	for (i = 0; i < n; i++) {
+		if (!(filtered_mask[i] & slot))
+			continue;
+		caplen[i] = RTE_MIN(rte_pktmbuf_pkt_len(pkts[i]) +
+				    capture_fmt_vlan_len(pkts[i]),
+				    cap_info->snaplen);
+		size += capture_fmt_pcapng_epb_len(caplen[i]);
 	}
 
-	if (!filtered_mask)
-		return 0;
-
 	msg = zmsg_new();
-
 	if (!msg)
 		return -1;
 
-	/*
-	 * First send filtered mask, ie. the slots that survived filtering.
-	 */
-	zmsg_addmem(msg, &filtered_mask, sizeof(filtered_mask));
+	frame = zframe_new(NULL, size);
+	if (!frame) {
+		zmsg_destroy(&msg);
+		return -1;
+	}
+	data = (char *)zframe_data(frame);
 
-	/* ... then PCAP header */
-	if (m->ol_flags & (PKT_TX_VLAN_PKT|PKT_RX_VLAN)) {
-		pcap.caplen += sizeof(struct rte_vlan_hdr);
-		if (pcap.caplen > cap_info->snaplen)
-			pcap.caplen = cap_info->snaplen;
-		pcap.len += sizeof(struct rte_vlan_hdr);
+	off = capture_fmt_pcapng_hdr(data, ifp->if_name, cap_info->snaplen);
+	for (i = 0; i < n; i++) {
+		if (!(filtered_mask[i] & slot))
+			continue;
+		off += capture_fmt_pcapng_epb(
+			data + off, pkts[i], if_tpid(ifp), &ts[i],
+			capture_get_wire_len(pkts[i]) +
+			capture_fmt_vlan_len(pkts[i]),
+			caplen[i]);
 	}
 
-	zmsg_addmem(msg, &pcap, sizeof(pcap));
+	zmsg_addmem(msg, &slot, sizeof(slot));
+	zmsg_append(msg, &frame);
 
-	/* Special case for VLAN.
-	 * copy Ethernet header from original packet
-	 * and rebuild real ethernet and vlan header
-	 * in a temporary buffer.
-	 */
-	if (m->ol_flags & (PKT_TX_VLAN_PKT|PKT_RX_VLAN)) {
-		const struct rte_ether_hdr *eh
-			= rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
-		struct {
-			struct rte_ether_hdr eh;
-			struct rte_vlan_hdr  vh;
-		} vhdr;
-
-		memcpy(&vhdr.eh, eh, 2 * RTE_ETHER_ADDR_LEN);
-		vhdr.eh.ether_type = htons(if_tpid(ifp));
-		vhdr.vh.vlan_tci = htons(m->vlan_tci);
-		vhdr.vh.eth_proto = eh->ether_type;
-
-		space = addmsg_if_space(msg, &vhdr, sizeof(vhdr), space);
-		if (!space)
-			goto msg_send;
-
-		/* hide original ethernet header */
-		space = addmsg_if_space(msg,
-				rte_pktmbuf_mtod(m, char *) +
-							RTE_ETHER_HDR_LEN,
-				(unsigned int)rte_pktmbuf_data_len(m) -
-							RTE_ETHER_HDR_LEN,
-				space);
-		if (!space)
-			goto msg_send;
-
-		m = m->next;
+	return zmsg_send_and_destroy(&msg, cap_info->cap_pub);
+}
+
+/*
+ * Filter a burst of packets and send to captures via zmq.  Each
+ * filter is run over the whole burst in turn, skipping packets no
+ * slot using it still wants.  Packets that can't be sent are counted
+ * as dropped.
+ */
+static int capture_write_burst(struct rte_mbuf *pkts[], unsigned int n,
+			       struct ifnet *ifp)
+{
+	struct capture_info *cap_info = ifp->cap_info;
+	struct capture_filter *cap_filter;
+	struct timeval ts[CAPTURE_DEQ_BURST];
+	uint8_t filtered_mask[CAPTURE_DEQ_BURST];
+	uint8_t pcapng_mask = 0;
+	unsigned int i, j;
+	uint8_t slot;
+
+	capture_get_timestamps(pkts, n, ts);
+
+	for (i = 0; i < n; i++)
+		filtered_mask[i] = cap_info->capture_mask;
+
+	TAILQ_FOREACH(cap_filter, &cap_info->filters, next) {
+		for (i = 0; i < n; i++) {
+			struct rte_mbuf *m = pkts[i];
+			unsigned int caplen;
+
+			if (!(filtered_mask[i] & cap_filter->mask))
+				continue;
+
+			caplen = RTE_MIN(rte_pktmbuf_data_len(m),
+					 cap_info->snaplen);
+			if (!bpf_filter(cap_filter->filter.bf_insns,
+					rte_pktmbuf_mtod(m, const u_char *),
+					capture_get_wire_len(m), caplen))
+				filtered_mask[i] &= ~cap_filter->mask;
+		}
 	}
 
-	while (m) {
-		space = addmsg_if_space(msg, rte_pktmbuf_mtod(m, char *),
-					(unsigned int)rte_pktmbuf_data_len(m),
-					space);
-		if (!space)
-			goto msg_send;
+	for (i = 0; i < n; i++)
+		pcapng_mask |= filtered_mask[i] & cap_info->pcapng_mask;
 
-		m = m->next;
+	/* A failure drops the packets still owed to any slot */
+	for (i = 0; i < CAP_MAX_PER_PORT; i++) {
+		slot = 1 << i;
+		if (!(pcapng_mask & slot))
+			continue;
+		if (capture_write_pcapng(pkts, n, ts, filtered_mask,
+					 slot, ifp) < 0) {
+			pcapng_mask |= ~cap_info->pcapng_mask;
+			for (j = 0; j < n; j++)
+				if (filtered_mask[j] & pcapng_mask)
+					cap_info->pkt_drops++;
+			return -1;
+		}
+		pcapng_mask &= ~slot;
 	}
 
-msg_send:
-	return zmsg_send_and_destroy(&msg, cap_info->cap_pub);
+	for (i = 0; i < n; i++) {
+		uint8_t pcap_mask = filtered_mask[i] & ~cap_info->pcapng_mask;
+
+		if (!pcap_mask)
+			continue;
+		if (capture_write(pkts[i], &ts[i], pcap_mask, ifp) < 0) {
+			for (j = i; j < n; j++)
+				if (filtered_mask[j] & ~cap_info->pcapng_mask)
+					cap_info->pkt_drops++;
+			return -1;
+		}
+	}
+
+	return 0;
 }
 
 static void capture_flush(const struct capture_info *cap_info)
@@ -646,15 +782,16 @@ static void capture_cleanup(void *arg)
 		ifp->if_name);
 }
 
-/* Max numer of loops processing packets without checking for events */
+/* Max number of bursts processed without checking for events */
 #define CAPTURE_MAX_LOOPS 100
 
 /* Main capture loop */
 static void capture_loop(struct ifnet *ifp)
 {
 	struct capture_info *cap_info = ifp->cap_info;
-	struct rte_mbuf *m;
+	struct rte_mbuf *pkts[CAPTURE_DEQ_BURST];
 	struct timespec now;
+	unsigned int n;
 	uint loops;
 	zmq_pollitem_t items[] = {
 		{ .fd = cap_info->cap_wake,
@@ -677,18 +814,18 @@ static void capture_loop(struct ifnet *ifp)
 			return;
 
 		loops = 0;
-		while (rte_ring_sc_dequeue(cap_info->cap_ring,
-					   (void **) &m) == 0) {
+		while ((n = rte_ring_sc_dequeue_burst(cap_info->cap_ring,
+						      (void **)pkts,
+						      CAPTURE_DEQ_BURST,
+						      NULL)) != 0) {
 			int ret;
 
-			ret = capture_write(m, ifp);
+			ret = capture_write_burst(pkts, n, ifp);
 
-			rte_pktmbuf_free(m);
+			pktmbuf_free_bulk(pkts, n);
 
-			if (ret < 0) {
-				cap_info->pkt_drops++;
+			if (ret < 0)
 				return;
-			}
 
 			if (loops++ >= CAPTURE_MAX_LOOPS) {
 				capture_wakeup(cap_info);
@@ -942,7 +1079,7 @@ static struct capture_info *capture_new(FILE *f, const char *addrstr,
  */
 static int capture_start(FILE *f, struct ifnet *ifp,
 			 bool is_promisc, unsigned int snaplen,
-			 bool swonly, unsigned int bandwidth)
+			 bool swonly, unsigned int bandwidth, bool pcapng)
 {
 	struct capture_info *cap_info = ifp->cap_info;
 	char addrstr[INET6_ADDRSTRLEN];
@@ -985,6 +1122,8 @@ static int capture_start(FILE *f, struct ifnet *ifp,
 		if (cap_info->capture_mask & slot)
 			continue;
 		cap_info->capture_mask |= slot;
+		if (pcapng)
+			cap_info->pcapng_mask |= slot;
 		cap_slot = slot;
 		break;
 	}
@@ -1034,7 +1173,7 @@ capture_show(FILE *f, const struct ifnet *ifp)
 /*
  * Handler for capture command.
  *
- * capture start <interface> <is_promisc> <snaplen> <swonly> <bandwidth>
+ * capture start <interface> <is_promisc> <snaplen> <swonly> <bandwidth> [pcapng]
  * capture show  <interface>
  */
 int cmd_capture(FILE *f, int argc, char **argv)
@@ -1045,6 +1184,7 @@ int cmd_capture(FILE *f, int argc, char **argv)
 	unsigned int snaplen;
 	bool swonly = false;
 	unsigned int bandwidth = 0;
+	bool pcapng = false;
 
 	if (argc < 3) {
 		fprintf(f, "capture: invalid arguments (%d)", argc);
@@ -1098,7 +1238,16 @@ int cmd_capture(FILE *f, int argc, char **argv)
 		bandwidth = value;
 	}
 
-	return capture_start(f, ifp, is_promisc, snaplen, swonly, bandwidth);
+	if (argc > 7) {
+		if (!streq(argv[7], "pcapng")) {
+			fprintf(f, "capture: unknown format %s\n", argv[7]);
+			return -1;
+		}
+		pcapng = true;
+	}
+
+	return capture_start(f, ifp, is_promisc, snaplen, swonly, bandwidth,
+			     pcapng);
 }
 
 /*
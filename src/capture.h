@@ -43,6 +43,7 @@ struct capture_info {
 	zsock_t *cap_pcapin;
 	int cap_pcapin_port;
 	uint8_t capture_mask; /* bitmask of current captures */
+	uint8_t pcapng_mask; /* captures sent as pcapng sections */
 	struct capture_filter_list filters;
 	struct timespec last_beat;
 	uint64_t pkt_drops;
@@ -0,0 +1,167 @@
+/*
+ * Formatting of captured packets.
+ *
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#include <arpa/inet.h>
+#include <rte_common.h>
+#include <rte_ether.h>
+#include <rte_mbuf.h>
+#include <rte_memcpy.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "capture_fmt.h"
+#include "util.h"
+
+/* pcapng blocks and options are padded to 32 bits */
+#define PCAPNG_ALIGN(len)	RTE_ALIGN_CEIL((len), sizeof(uint32_t))
+
+unsigned int capture_fmt_vlan_len(const struct rte_mbuf *m)
+{
+	if ((m->ol_flags & (PKT_TX_VLAN_PKT|PKT_RX_VLAN)) &&
+	    rte_pktmbuf_data_len(m) >= RTE_ETHER_HDR_LEN)
+		return sizeof(struct rte_vlan_hdr);
+	return 0;
+}
+
+void capture_fmt_data(const struct rte_mbuf *m, uint16_t tpid,
+		      void *data, unsigned int caplen)
+{
+	unsigned int copied = 0;
+	unsigned int off = 0;
+	char *dst = data;
+	const void *src;
+
+	/* Special case for VLAN.
+	 * copy Ethernet header from original packet
+	 * and rebuild real ethernet and vlan header
+	 * in front of the rest of the packet.
+	 */
+	if (capture_fmt_vlan_len(m)) {
+		const struct rte_ether_hdr *eh
+			= rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+		struct {
+			struct rte_ether_hdr eh;
+			struct rte_vlan_hdr  vh;
+		} vhdr;
+
+		memcpy(&vhdr.eh, eh, 2 * RTE_ETHER_ADDR_LEN);
+		vhdr.eh.ether_type = htons(tpid);
+		vhdr.vh.vlan_tci = htons(m->vlan_tci);
+		vhdr.vh.eth_proto = eh->ether_type;
+
+		copied = RTE_MIN(sizeof(vhdr), caplen);
+		memcpy(dst, &vhdr, copied);
+
+		/* hide original ethernet header */
+		off = RTE_ETHER_HDR_LEN;
+	}
+
+	if (copied < caplen) {
+		src = rte_pktmbuf_read(m, off, caplen - copied, dst + copied);
+		if (src && src != dst + copied)
+			rte_memcpy(dst + copied, src, caplen - copied);
+	}
+}
+
+static size_t capture_fmt_pcapng_opt_len(size_t len)
+{
+	return sizeof(struct pcapng_opt) + PCAPNG_ALIGN(len);
+}
+
+static char *capture_fmt_pcapng_opt(char *buf, uint16_t code,
+				    const void *val, uint16_t len)
+{
+	struct pcapng_opt *opt = (struct pcapng_opt *)buf;
+
+	opt->code = code;
+	opt->len = len;
+	buf += sizeof(*opt);
+	if (len) {
+		memcpy(buf, val, len);
+		memset(buf + len, 0, PCAPNG_ALIGN(len) - len);
+	}
+	return buf + PCAPNG_ALIGN(len);
+}
+
+/* Close a block by repeating its length after its body */
+static size_t capture_fmt_pcapng_end(void *block, char *end)
+{
+	struct pcapng_block_hdr *hdr = block;
+	uint32_t total_len = end - (char *)block + sizeof(uint32_t);
+
+	hdr->total_len = total_len;
+	memcpy(end, &total_len, sizeof(total_len));
+	return total_len;
+}
+
+size_t capture_fmt_pcapng_hdr_len(const char *if_name)
+{
+	return sizeof(struct pcapng_shb) + sizeof(uint32_t) +
+		sizeof(struct pcapng_idb) +
+		capture_fmt_pcapng_opt_len(strlen(if_name)) +
+		capture_fmt_pcapng_opt_len(0) + sizeof(uint32_t);
+}
+
+/*
+ * Each section is complete in itself, so a reader can start from any
+ * of them. Timestamps have the default resolution of microseconds.
+ */
+size_t capture_fmt_pcapng_hdr(void *buf, const char *if_name,
+			      unsigned int snaplen)
+{
+	struct pcapng_shb *shb = buf;
+	struct pcapng_idb *idb;
+	size_t len;
+	char *p;
+
+	shb->hdr.type = PCAPNG_SHB_TYPE;
+	shb->byte_order_magic = PCAPNG_BYTE_ORDER_MAGIC;
+	shb->major = 1;
+	shb->minor = 0;
+	shb->section_len = -1;	/* not given */
+	len = capture_fmt_pcapng_end(shb, (char *)(shb + 1));
+
+	idb = (struct pcapng_idb *)((char *)buf + len);
+	idb->hdr.type = PCAPNG_IDB_TYPE;
+	idb->linktype = PCAPNG_LINKTYPE_ETHERNET;
+	idb->reserved = 0;
+	idb->snaplen = snaplen;
+	p = capture_fmt_pcapng_opt((char *)(idb + 1), PCAPNG_OPT_IF_NAME,
+				   if_name, strlen(if_name));
+	p = capture_fmt_pcapng_opt(p, PCAPNG_OPT_ENDOFOPT, NULL, 0);
+	len += capture_fmt_pcapng_end(idb, p);
+
+	return len;
+}
+
+size_t capture_fmt_pcapng_epb_len(unsigned int caplen)
+{
+	return sizeof(struct pcapng_epb) + PCAPNG_ALIGN(caplen) +
+		sizeof(uint32_t);
+}
+
+size_t capture_fmt_pcapng_epb(void *buf, const struct rte_mbuf *m,
+			      uint16_t tpid, const struct timeval *ts,
+			      uint32_t len, uint32_t caplen)
+{
+	struct pcapng_epb *epb = buf;
+	uint64_t usecs = (uint64_t)ts->tv_sec * USEC_PER_SEC + ts->tv_usec;
+	char *data = (char *)(epb + 1);
+
+	epb->hdr.type = PCAPNG_EPB_TYPE;
+	epb->if_id = 0;
+	epb->ts_high = usecs >> 32;
+	epb->ts_low = (uint32_t)usecs;
+	epb->caplen = caplen;
+	epb->len = len;
+
+	capture_fmt_data(m, tpid, data, caplen);
+	memset(data + caplen, 0, PCAPNG_ALIGN(caplen) - caplen);
+
+	return capture_fmt_pcapng_end(epb, data + PCAPNG_ALIGN(caplen));
+}
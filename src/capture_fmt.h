@@ -0,0 +1,98 @@
+/*
+ * Formatting of captured packets.
+ *
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef	CAPTURE_FMT_H
+#define	CAPTURE_FMT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+struct rte_mbuf;
+
+/*
+ * pcapng block types and the fixed part of each block used
+ * (draft-tuexen-opsawg-pcapng).
+ */
+#define PCAPNG_SHB_TYPE		0x0A0D0D0A
+#define PCAPNG_IDB_TYPE		0x00000001
+#define PCAPNG_EPB_TYPE		0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC	0x1A2B3C4D
+#define PCAPNG_OPT_ENDOFOPT	0
+#define PCAPNG_OPT_IF_NAME	2
+#define PCAPNG_LINKTYPE_ETHERNET 1
+
+struct pcapng_block_hdr {
+	uint32_t type;
+	uint32_t total_len;
+} __attribute__((__packed__));
+
+struct pcapng_shb {
+	struct pcapng_block_hdr hdr;
+	uint32_t byte_order_magic;
+	uint16_t major;
+	uint16_t minor;
+	int64_t section_len;
+} __attribute__((__packed__));
+
+struct pcapng_idb {
+	struct pcapng_block_hdr hdr;
+	uint16_t linktype;
+	uint16_t reserved;
+	uint32_t snaplen;
+} __attribute__((__packed__));
+
+struct pcapng_epb {
+	struct pcapng_block_hdr hdr;
+	uint32_t if_id;
+	uint32_t ts_high;
+	uint32_t ts_low;
+	uint32_t caplen;
+	uint32_t len;
+} __attribute__((__packed__));
+
+struct pcapng_opt {
+	uint16_t code;
+	uint16_t len;
+} __attribute__((__packed__));
+
+/*
+ * Number of bytes a VLAN tag held in the mbuf adds to the captured
+ * frame, where the tag is put back in.
+ */
+unsigned int capture_fmt_vlan_len(const struct rte_mbuf *m);
+
+/*
+ * Copy the first caplen bytes of a packet as captured, with any VLAN
+ * tag held in the mbuf put back in the frame behind a tpid.
+ */
+void capture_fmt_data(const struct rte_mbuf *m, uint16_t tpid,
+		      void *data, unsigned int caplen);
+
+/* Length of the section and interface headers of a pcapng section */
+size_t capture_fmt_pcapng_hdr_len(const char *if_name);
+
+/*
+ * Write the section and interface headers that begin a pcapng
+ * section for one interface, and return their length.
+ */
+size_t capture_fmt_pcapng_hdr(void *buf, const char *if_name,
+			      unsigned int snaplen);
+
+/* Length of an enhanced packet block holding caplen bytes */
+size_t capture_fmt_pcapng_epb_len(unsigned int caplen);
+
+/*
+ * Write an enhanced packet block for the first caplen bytes of a
+ * packet, which was len bytes long, and return its length.
+ */
+size_t capture_fmt_pcapng_epb(void *buf, const struct rte_mbuf *m,
+			      uint16_t tpid, const struct timeval *ts,
+			      uint32_t len, uint32_t caplen);
+
+#endif /* CAPTURE_FMT_H */
@@ -41,6 +41,7 @@
 #include "crypto_policy.h"
 #include "crypto_rte_pmd.h"
 #include "crypto_sadb.h"
+#include "crypto_spd.h"
 #include "dp_event.h"
 #include "esp.h"
 #include "ether.h"
@@ -166,6 +167,8 @@ static const char * const ipsec_counter_names[] = {
 	[CRYPTO_DIGEST_OP_FAILED] = "Failed digest op",
 	[CRYPTO_DIGEST_CB_FAILED] = "Failed digest cb",
 	[CRYPTO_PP_ENQ_FAILED] = "Postprocessing enqueue failed",
+	[ESP_SEQ_EXHAUSTED] = "Outbound sequence number exhausted",
+	[CRYPTO_SPRAY_RET_FAILED] = "Sprayed packet return failed",
 };
 
 unsigned long ipsec_counters[RTE_MAX_LCORE][IPSEC_CNT_MAX] __rte_cache_aligned;
@@ -300,6 +303,7 @@ static inline void crypto_vrf_free(struct rcu_head *head)
 	dp_ht_destroy_deferred(vrf_ctx->sadb_hash_table);
 	dp_ht_destroy_deferred(vrf_ctx->spi_out_hash_table);
 	dp_ht_destroy_deferred(vrf_ctx->s2s_bind_hash_table);
+	crypto_spd_free(vrf_ctx->spd);
 
 	free(vrf_ctx);
 }
@@ -521,10 +525,9 @@ crypto_post_decrypt_handle_packet(struct crypto_pkt_ctx *cctx,
 	}
 }
 
-static inline void
-crypto_process_decrypt_packets(uint16_t count,
-			       struct crypto_pkt_ctx *cctx[],
-			       uint32_t *bytes)
+static inline uint16_t
+crypto_submit_decrypt_packets(uint16_t count,
+			      struct crypto_pkt_ctx *cctx[])
 {
 	struct rte_mbuf *m;
 	uint16_t i;
@@ -557,7 +560,17 @@ crypto_process_decrypt_packets(uint16_t count,
 		crypto_prefetch_ctx_data(cctx, count, i);
 	}
 
-	esp_input(cctx, count);
+	return esp_input_submit(cctx, count);
+}
+
+static inline void
+crypto_complete_decrypt_packets(uint16_t count,
+				struct crypto_pkt_ctx *cctx[],
+				uint32_t *bytes)
+{
+	uint16_t i;
+
+	esp_input_complete(cctx, count);
 
 	for (i = 0; i < count; i++) {
 		if (unlikely(cctx[i]->action == CRYPTO_ACT_DROP))
@@ -576,14 +589,20 @@ crypto_process_decrypt_packets(uint16_t count,
 	}
 }
 
-static void crypto_process_encrypt_packets(uint16_t count,
-					   struct crypto_pkt_ctx *cctx[],
-					   uint32_t *bytes)
+static uint16_t crypto_submit_encrypt_packets(uint16_t count,
+					      struct crypto_pkt_ctx *cctx[])
+{
+	return esp_output_submit(cctx, count);
+}
+
+static void crypto_complete_encrypt_packets(uint16_t count,
+					    struct crypto_pkt_ctx *cctx[],
+					    uint32_t *bytes)
 {
 	uint16_t i;
 	struct crypto_pkt_ctx *tmp_cctx;
 
-	esp_output(cctx, count);
+	esp_output_complete(cctx, count);
 
 	for (i = 0; i < count; i++) {
 
@@ -824,6 +843,8 @@ static int crypto_enqueue_internal(enum crypto_xfrm xfrm,
 	}
 	ctx->in_ifp = NULL;
 	ctx->vti_ifp = NULL;
+	ctx->spray_pmd = CRYPTO_PMD_INVALID_ID;
+	ctx->seq = 0;
 
 	crypto_ctx_save_ifp(ctx, m, in_ifp);
 	ctx->nxt_ifp = nxt_ifp;
@@ -1079,16 +1100,24 @@ void crypto_fwd_processed_packets(void)
 	}
 }
 
+/*
+ * Packets are submitted to the crypto device of their PMD, and
+ * completed once it returns them, or straight away if it never took
+ * them.
+ */
 struct crypto_processing_cb {
-	void (*process)(uint16_t count, struct crypto_pkt_ctx *ctx_arr[],
-			uint32_t *bytes);
+	uint16_t (*submit)(uint16_t count, struct crypto_pkt_ctx *ctx_arr[]);
+	void (*complete)(uint16_t count, struct crypto_pkt_ctx *ctx_arr[],
+			 uint32_t *bytes);
 	void (*post_process)(struct crypto_pkt_ctx **,  uint32_t);
 };
 
 static const struct crypto_processing_cb crypto_cb[MAX_CRYPTO_XFRM] = {
-	{crypto_process_encrypt_packets,
+	{crypto_submit_encrypt_packets,
+	 crypto_complete_encrypt_packets,
 	 crypto_redirect_processed_packets},
-	{crypto_process_decrypt_packets,
+	{crypto_submit_decrypt_packets,
+	 crypto_complete_decrypt_packets,
 	 crypto_redirect_processed_packets} };
 
 void crypto_purge_queue(struct rte_ring *pmd_queue)
@@ -1116,6 +1145,50 @@ void crypto_delete_queue(struct rte_ring *pmd_queue)
 	rte_ring_free(pmd_queue);
 }
 
+/*
+ * How long to wait for a crypto device being removed to return its
+ * ops, and how long to back off between polls that return none.
+ */
+#define CRYPTO_PURGE_TIMEOUT_MS	100
+#define CRYPTO_PURGE_DELAY_US	10
+
+/*
+ * Drop the packets still in flight on a crypto device that is no
+ * longer polled by its engine.
+ */
+void crypto_purge_cryptodev(uint8_t cdev_id)
+{
+	struct crypto_pkt_ctx *contexts[MAX_CRYPTO_PKT_BURST];
+	unsigned int count, i;
+	uint64_t deadline;
+	enum crypto_xfrm q;
+
+	deadline = rte_get_timer_cycles() +
+		rte_get_timer_hz() * CRYPTO_PURGE_TIMEOUT_MS / 1000;
+
+	for (q = MIN_CRYPTO_XFRM; q < MAX_CRYPTO_XFRM; q++) {
+		while (crypto_rte_inflight_count(cdev_id, q)) {
+			count = crypto_rte_dequeue_packets(
+				cdev_id, q, contexts, MAX_CRYPTO_PKT_BURST);
+			for (i = 0; i < count; i++) {
+				rte_pktmbuf_free(contexts[i]->mbuf);
+				release_crypto_packet_ctx(contexts[i]);
+			}
+			if (count)
+				continue;
+
+			if (rte_get_timer_cycles() > deadline) {
+				CRYPTO_ERR("%u %s ops lost on cryptodev %u\n",
+					   crypto_rte_inflight_count(cdev_id,
+								     q),
+					   crypto_xfrm_name(q), cdev_id);
+				break;
+			}
+			rte_delay_us(CRYPTO_PURGE_DELAY_US);
+		}
+	}
+}
+
 static inline struct sadb_sa *
 sadb_lookup_sa(struct rte_mbuf *m __unused, enum crypto_xfrm xfrm,
 	       struct crypto_pkt_ctx *ctx)
@@ -1145,13 +1218,18 @@ sadb_lookup_sa(struct rte_mbuf *m __unused, enum crypto_xfrm xfrm,
 	return sa;
 }
 
+/*
+ * Look up the SAs of a burst of packets and submit them to the crypto
+ * device. Returns the number of packets done with without waiting for
+ * the device, which are completed and moved to the start of the array.
+ */
 static inline unsigned int
-crypto_pmd_process_packets(struct crypto_pkt_ctx *contexts[],
-			   uint16_t count, enum crypto_xfrm xfrm)
+crypto_pmd_submit_packets(struct crypto_pkt_ctx *contexts[],
+			  uint16_t count, enum crypto_xfrm xfrm,
+			  uint8_t rte_cdev_id, uint32_t *bytes)
 {
 	struct rte_mbuf *m;
-	unsigned int total_bytes = 0;
-	uint16_t i, bad_idx[count], bad_count = 0;
+	uint16_t i, bad_idx[count], bad_count = 0, done;
 
 	/*
 	 * Prefetch entire burst of contexts into L2 cache
@@ -1171,6 +1249,7 @@ crypto_pmd_process_packets(struct crypto_pkt_ctx *contexts[],
 		assert(contexts[i]->direction == xfrm);
 
 		contexts[i]->bytes = 0;
+		contexts[i]->rte_cdev_id = rte_cdev_id;
 		contexts[i]->sa = sadb_lookup_sa(m, xfrm, contexts[i]);
 		if (unlikely(!contexts[i]->sa)) {
 			contexts[i]->status = -1;
@@ -1185,37 +1264,349 @@ crypto_pmd_process_packets(struct crypto_pkt_ctx *contexts[],
 	move_bad_mbufs(contexts, count, bad_idx, bad_count);
 	count -= bad_count;
 
-	crypto_cb[xfrm].process(count, contexts, &total_bytes);
+	done = count ? crypto_cb[xfrm].submit(count, contexts) : 0;
+	if (done)
+		crypto_cb[xfrm].complete(done, contexts, bytes);
+
+	/* Packets without an SA are done with as well */
+	for (i = 0; i < bad_count; i++)
+		contexts[done++] = contexts[count + i];
+
+	return done;
+}
+
+/*
+ * Complete the packets the crypto device has finished with.
+ */
+static inline unsigned int
+crypto_pmd_complete_packets(struct crypto_pkt_ctx *contexts[],
+			    enum crypto_xfrm xfrm, uint8_t rte_cdev_id,
+			    uint32_t *bytes)
+{
+	unsigned int count;
+
+	count = crypto_rte_dequeue_packets(rte_cdev_id, xfrm, contexts,
+					   MAX_CRYPTO_PKT_BURST);
+	if (count)
+		crypto_cb[xfrm].complete(count, contexts, bytes);
 
-	return total_bytes;
+	return count;
+}
+
+/*
+ * Stamp a burst dequeued by the home PMD of its SAs, and hand all but
+ * the first share of it to the other PMDs in the spray group. Returns
+ * the number of contexts left to process here, which are moved to the
+ * start of the array.
+ *
+ * Outbound packets take their sequence numbers here, in stamp order,
+ * so that they leave the reorder buffer with ascending sequence
+ * numbers whichever PMD encrypts them.
+ *
+ * Chained mbufs are always processed here. They may go through the
+ * openssl chain, whose cipher and hmac contexts belong to the session
+ * and so can only be used by one core at a time.
+ */
+static unsigned int
+crypto_spray_packets(struct crypto_spray *spray, int pmd_dev_id,
+		     enum crypto_xfrm xfrm,
+		     struct crypto_pkt_ctx *contexts[], unsigned int count)
+{
+	struct crypto_pkt_ctx *out[MAX_CRYPTO_PKT_BURST];
+	struct crypto_reorder *ro = &spray->reorder[xfrm];
+	struct crypto_spray *peer;
+	struct sadb_sa *sa;
+	unsigned int i, n, share, todo, sent, off, local, out_cnt;
+	uint8_t cnt = CMM_LOAD_SHARED(spray->cnt);
+
+	for (i = 0; i < count; i++) {
+		contexts[i]->spray_pmd = pmd_dev_id;
+		contexts[i]->stamp = ro->next_stamp++;
+		if (xfrm != CRYPTO_ENCRYPT)
+			continue;
+		sa = sadb_lookup_sa_outbound(contexts[i]->vrfid,
+					     &contexts[i]->dst,
+					     contexts[i]->family,
+					     contexts[i]->spi);
+		if (!sa)
+			continue;
+		if (likely(!sa->spray))
+			contexts[i]->seq = ++sa->seq;
+		else
+			contexts[i]->seq = uatomic_add_return(&sa->seq, 1);
+	}
+
+	if (!cnt)
+		return count;
+
+	for (i = 0, local = 0, out_cnt = 0; i < count; i++) {
+		if (unlikely(contexts[i]->mbuf->next != NULL))
+			contexts[local++] = contexts[i];
+		else
+			out[out_cnt++] = contexts[i];
+	}
+
+	cmm_smp_rmb();
+	share = (out_cnt + cnt) / (cnt + 1);
+	for (off = 0; off < RTE_MIN(share, out_cnt); off++)
+		contexts[local++] = out[off];
+	for (n = 0; n < cnt && off < out_cnt; n++) {
+		peer = crypto_pmd_get_spray(
+			spray->pmd_ids[(spray->next + n) % cnt]);
+		todo = RTE_MIN(share, out_cnt - off);
+		sent = 0;
+		if (peer)
+			sent = rte_ring_mp_enqueue_burst(
+				peer->in_q[xfrm], (void **)&out[off],
+				todo, NULL);
+		/* Whatever could not be handed out is processed here */
+		for (i = sent; i < todo; i++)
+			contexts[local++] = out[off + i];
+		off += todo;
+	}
+	spray->next = (spray->next + 1) % cnt;
+
+	return local;
+}
+
+/*
+ * Put processed packets into the reorder buffer of the PMD that
+ * stamped them. A packet whose stamp has already been given up on
+ * goes on its way out of order.
+ */
+static void crypto_reorder_add(struct crypto_reorder *ro,
+			       struct crypto_pkt_ctx **contexts,
+			       unsigned int count)
+{
+	struct crypto_pkt_ctx *ctx;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		ctx = contexts[i];
+		if (unlikely(ctx->stamp - ro->head >= CRYPTO_REORDER_SIZE)) {
+			ro->late++;
+			crypto_redirect_processed_packets(&ctx, 1);
+			continue;
+		}
+		ro->slots[ctx->stamp & CRYPTO_REORDER_MASK] = ctx;
+	}
+}
+
+/*
+ * Number of polls to wait for a missing packet, which may have been
+ * lost with a PMD that was removed, before moving on without it.
+ */
+#define CRYPTO_REORDER_STALL (1 << 20)
+
+/*
+ * Collect the packets returned by other PMDs, and forward everything
+ * that is now in order.
+ */
+static void crypto_reorder_drain(struct crypto_reorder *ro)
+{
+	struct crypto_pkt_ctx *contexts[MAX_CRYPTO_PKT_BURST];
+	struct crypto_pkt_ctx **slot;
+	unsigned int count;
+
+	if (!rte_ring_empty(ro->ret_q)) {
+		count = rte_ring_sc_dequeue_burst(ro->ret_q,
+						  (void **)&contexts,
+						  MAX_CRYPTO_PKT_BURST,
+						  NULL);
+		crypto_reorder_add(ro, contexts, count);
+	}
+
+	while (ro->head != ro->next_stamp) {
+		count = 0;
+		while (count < MAX_CRYPTO_PKT_BURST &&
+		       ro->head != ro->next_stamp) {
+			slot = &ro->slots[ro->head & CRYPTO_REORDER_MASK];
+			if (!*slot)
+				break;
+			contexts[count++] = *slot;
+			*slot = NULL;
+			ro->head++;
+		}
+		if (count) {
+			ro->stall = 0;
+			crypto_redirect_processed_packets(contexts, count);
+			continue;
+		}
+
+		if (++ro->stall < CRYPTO_REORDER_STALL)
+			break;
+		ro->stall = 0;
+		ro->head++;
+		ro->skipped++;
+	}
+}
+
+/*
+ * Hand packets sprayed here back to the PMDs that stamped them,
+ * batching runs of packets from the same PMD.
+ */
+static void crypto_spray_return(struct crypto_pkt_ctx **contexts,
+				unsigned int count, enum crypto_xfrm xfrm)
+{
+	struct crypto_spray *owner;
+	unsigned int i, run, sent;
+
+	for (i = 0; i < count; i += run) {
+		for (run = 1; i + run < count; run++)
+			if (contexts[i + run]->spray_pmd !=
+			    contexts[i]->spray_pmd)
+				break;
+
+		owner = crypto_pmd_get_spray(contexts[i]->spray_pmd);
+		sent = 0;
+		if (owner)
+			sent = rte_ring_mp_enqueue_burst(
+				owner->reorder[xfrm].ret_q,
+				(void **)&contexts[i], run, NULL);
+		if (unlikely(sent < run)) {
+			IPSEC_CNT_INC(CRYPTO_SPRAY_RET_FAILED);
+			crypto_redirect_processed_packets(&contexts[i + sent],
+							  run - sent);
+		}
+	}
+}
+
+/*
+ * Pass on the packets a spraying PMD is done with: its own go into its
+ * reorder buffer, those sprayed to it back to the PMDs that stamped
+ * them. Any from before it joined the group are not stamped.
+ */
+static void crypto_spray_done(struct crypto_spray *spray, int pmd_dev_id,
+			      enum crypto_xfrm xfrm,
+			      struct crypto_pkt_ctx **contexts,
+			      unsigned int count)
+{
+	struct crypto_pkt_ctx *own[MAX_CRYPTO_PKT_BURST];
+	struct crypto_pkt_ctx *other[MAX_CRYPTO_PKT_BURST];
+	struct crypto_pkt_ctx *direct[MAX_CRYPTO_PKT_BURST];
+	unsigned int i, own_cnt = 0, other_cnt = 0, direct_cnt = 0;
+
+	for (i = 0; i < count; i++) {
+		if (contexts[i]->spray_pmd == pmd_dev_id)
+			own[own_cnt++] = contexts[i];
+		else if (contexts[i]->spray_pmd == CRYPTO_PMD_INVALID_ID)
+			direct[direct_cnt++] = contexts[i];
+		else
+			other[other_cnt++] = contexts[i];
+	}
+
+	if (own_cnt)
+		crypto_reorder_add(&spray->reorder[xfrm], own, own_cnt);
+	if (other_cnt)
+		crypto_spray_return(other, other_cnt, xfrm);
+	if (direct_cnt)
+		crypto_redirect_processed_packets(direct, direct_cnt);
+}
+
+/*
+ * Walk callback for a PMD that takes part in spraying. Its own
+ * packets are limited by the room left to reorder them. The packets
+ * sprayed to it by others are only limited by the room on its crypto
+ * device, so that PMDs spraying to each other can't wait on each
+ * other.
+ */
+static bool crypto_pmd_spray_walk(int pmd_dev_id, uint8_t rte_cdev_id,
+				  enum crypto_xfrm xfrm,
+				  struct rte_ring *pmd_queue,
+				  struct crypto_spray *spray,
+				  uint64_t *bytes,
+				  uint32_t *packets)
+{
+	struct crypto_pkt_ctx *contexts[MAX_CRYPTO_PKT_BURST];
+	struct crypto_reorder *ro = &spray->reorder[xfrm];
+	unsigned int count, room;
+	uint32_t total_bytes = 0;
+
+	count = crypto_pmd_complete_packets(contexts, xfrm, rte_cdev_id,
+					    &total_bytes);
+	crypto_spray_done(spray, pmd_dev_id, xfrm, contexts, count);
+	*packets += count;
+
+	room = RTE_MIN(CRYPTO_REORDER_SIZE - (ro->next_stamp - ro->head),
+		       crypto_rte_inflight_room(rte_cdev_id, xfrm));
+	if (room && !rte_ring_empty(pmd_queue)) {
+		count = rte_ring_sc_dequeue_burst(pmd_queue,
+						  (void **)&contexts,
+						  RTE_MIN(room,
+							  MAX_CRYPTO_PKT_BURST),
+						  NULL);
+		count = crypto_spray_packets(spray, pmd_dev_id, xfrm,
+					     contexts, count);
+		count = crypto_pmd_submit_packets(contexts, count, xfrm,
+						  rte_cdev_id, &total_bytes);
+		crypto_spray_done(spray, pmd_dev_id, xfrm, contexts, count);
+		*packets += count;
+	}
+
+	room = crypto_rte_inflight_room(rte_cdev_id, xfrm);
+	if (room && !rte_ring_empty(spray->in_q[xfrm])) {
+		count = rte_ring_sc_dequeue_burst(spray->in_q[xfrm],
+						  (void **)&contexts,
+						  RTE_MIN(room,
+							  MAX_CRYPTO_PKT_BURST),
+						  NULL);
+		count = crypto_pmd_submit_packets(contexts, count, xfrm,
+						  rte_cdev_id, &total_bytes);
+		crypto_spray_done(spray, pmd_dev_id, xfrm, contexts, count);
+		*packets += count;
+	}
+
+	crypto_reorder_drain(ro);
+	*bytes += total_bytes;
+
+	return true;
 }
 
 /*
  * PMD walker callback passed together with a PMD listhead, and called
- * back for each xfrm queue within each PMD.
+ * back for each xfrm queue within each PMD. The packets the crypto
+ * device has finished with are collected before more are submitted,
+ * keeping no more than CRYPTO_RTE_MAX_INFLIGHT on it.
  *
  * Returning false terminates the pmd  walk.
  */
-static bool crypto_pmd_walk_cb(int pmd_dev_id __unused, enum crypto_xfrm xfrm,
+static bool crypto_pmd_walk_cb(int pmd_dev_id, uint8_t rte_cdev_id,
+			       enum crypto_xfrm xfrm,
 			       struct rte_ring *pmd_queue,
+			       struct crypto_spray *spray,
 			       uint64_t *bytes,
 			       uint32_t *packets)
 {
 	struct crypto_pkt_ctx *contexts[MAX_CRYPTO_PKT_BURST];
-	unsigned int count, total_bytes = 0;
+	unsigned int count, room;
+	uint32_t total_bytes = 0;
+
+	if (unlikely(spray != NULL))
+		return crypto_pmd_spray_walk(pmd_dev_id, rte_cdev_id, xfrm,
+					     pmd_queue, spray, bytes, packets);
+
+	count = crypto_pmd_complete_packets(contexts, xfrm, rte_cdev_id,
+					    &total_bytes);
+	if (count) {
+		crypto_cb[xfrm].post_process(contexts, count);
+		*packets += count;
+	}
 
-	if (!rte_ring_empty(pmd_queue)) {
+	room = crypto_rte_inflight_room(rte_cdev_id, xfrm);
+	if (room && !rte_ring_empty(pmd_queue)) {
 		count = rte_ring_sc_dequeue_burst(pmd_queue,
 						  (void **)&contexts,
-						  MAX_CRYPTO_PKT_BURST,
+						  RTE_MIN(room,
+							  MAX_CRYPTO_PKT_BURST),
 						  NULL);
 
-		total_bytes = crypto_pmd_process_packets(contexts, count, xfrm);
-
-		crypto_cb[xfrm].post_process(contexts, count);
-		*packets = count;
-		*bytes = total_bytes;
+		count = crypto_pmd_submit_packets(contexts, count, xfrm,
+						  rte_cdev_id, &total_bytes);
+		if (count)
+			crypto_cb[xfrm].post_process(contexts, count);
+		*packets += count;
 	}
+	*bytes = total_bytes;
 
 	return true;
 }
@@ -1276,6 +1667,55 @@ void crypto_create_fwd_queue(unsigned int lcore_id)
 	}
 }
 
+struct crypto_spray *crypto_spray_create(int socket, int dev_id)
+{
+	struct crypto_spray *spray;
+	enum crypto_xfrm q;
+
+	spray = rte_zmalloc_socket("crypto spray", sizeof(*spray),
+				   RTE_CACHE_LINE_SIZE, socket);
+	if (!spray)
+		return NULL;
+
+	for (q = MIN_CRYPTO_XFRM; q < MAX_CRYPTO_XFRM; q++) {
+		spray->in_q[q] = crypto_create_ring("spray-q", PMD_RING_SIZE,
+						    socket, dev_id,
+						    RING_F_SC_DEQ);
+		/* Room for everything the reorder buffer can hold */
+		spray->reorder[q].ret_q =
+			crypto_create_ring("reorder-q",
+					   CRYPTO_REORDER_SIZE * 2,
+					   socket, dev_id, RING_F_SC_DEQ);
+	}
+
+	return spray;
+}
+
+void crypto_spray_destroy(struct crypto_spray *spray)
+{
+	struct crypto_reorder *ro;
+	enum crypto_xfrm q;
+	unsigned int i;
+
+	if (!spray)
+		return;
+
+	for (q = MIN_CRYPTO_XFRM; q < MAX_CRYPTO_XFRM; q++) {
+		ro = &spray->reorder[q];
+		crypto_purge_queue(spray->in_q[q]);
+		crypto_delete_queue(spray->in_q[q]);
+		crypto_purge_queue(ro->ret_q);
+		crypto_delete_queue(ro->ret_q);
+		for (i = 0; i < CRYPTO_REORDER_SIZE; i++) {
+			if (!ro->slots[i])
+				continue;
+			rte_pktmbuf_free(ro->slots[i]->mbuf);
+			release_crypto_packet_ctx(ro->slots[i]);
+		}
+	}
+	rte_free(spray);
+}
+
 void crypto_destroy_fwd_queue(void)
 {
 	if (RTE_PER_LCORE(crypto_fwd)) {
@@ -1318,11 +1758,6 @@ static int dp_crypto_lcore_init(unsigned int lcore_id,
 		for (q = MIN_CRYPTO_XFRM; q < MAX_CRYPTO_XFRM; q++)
 			cpb->pmd_dev_id[q] = CRYPTO_PMD_INVALID_ID;
 
-		err = crypto_rte_op_alloc(cpb->cops, MAX_CRYPTO_PKT_BURST);
-		if (err)
-			rte_panic("no memory for crypto ops on lcore %u",
-				  lcore_id);
-
 		cpbdb[lcore_id] = cpb;
 
 		for (i = 0; i < MAX_CRYPTO_PKT_BURST; i++) {
@@ -1340,9 +1775,6 @@ static int dp_crypto_lcore_init(unsigned int lcore_id,
 static int dp_crypto_lcore_teardown(unsigned int lcore_id,
 				    void *arg __unused)
 {
-	struct crypto_pkt_buffer *cpb = cpbdb[lcore_id];
-
-	crypto_rte_op_free(cpb->cops, MAX_CRYPTO_PKT_BURST);
 	return crypto_flow_cache_teardown_lcore(lcore_id);
 }
 
@@ -33,6 +33,7 @@
 #include "../in_cksum.h"
 #include "compiler.h"
 #include "crypto_internal.h"
+#include "esp.h"
 #include "in6.h"
 #include "json_writer.h"
 #include "util.h"
@@ -531,6 +532,7 @@ void crypto_save_iv(uint16_t idx, const char iv[], uint16_t length)
 void crypto_get_iv(uint16_t idx, char iv[], uint16_t length)
 {
 	struct crypto_pkt_buffer *cpb = cpbdb[dp_lcore_id()];
+	uint16_t i;
 
 	/* should never happen */
 	if (idx >= MAX_CRYPTO_PKT_BURST || length > CRYPTO_MAX_IV_LENGTH) {
@@ -540,6 +542,16 @@ void crypto_get_iv(uint16_t idx, char iv[], uint16_t length)
 	}
 
 	memcpy(iv, cpb->iv_cache[idx], length);
+
+	/*
+	 * The slot is only refreshed from the ciphertext once the packet
+	 * has been encrypted, which with the packets in flight on the
+	 * crypto device may be after the next burst has been built. Step
+	 * it on so that an IV is never handed out twice.
+	 */
+	for (i = length; i > 0; i--)
+		if (++cpb->iv_cache[idx][i - 1])
+			break;
 }
 
 
@@ -885,6 +897,7 @@ int cipher_setup_ctx(const struct xfrm_algo *algo_crypt,
 		     const struct xfrm_algo_auth *algo_auth,
 		     const struct xfrm_usersa_info *sa_info,
 		     const struct xfrm_encap_tmpl *tmpl,
+		     const struct xfrm_replay_state_esn *replay_esn,
 		     struct sadb_sa *sa, uint32_t extra_flags)
 {
 	if (check_algorithmic_requirements(algo_crypt, algo_auth))
@@ -916,11 +929,28 @@ int cipher_setup_ctx(const struct xfrm_algo *algo_crypt,
 	}
 
 	sa->seq = 0;
-	sa->replay_bitmap = 0;
-	sa->replay_window = sa_info->replay_window;
+
+	/*
+	 * The replay window in the SA info is only 8 bits, so larger
+	 * windows, and ESN, come in the replay ESN attribute.
+	 */
+	if (replay_esn)
+		sa->replay_window = RTE_MIN(replay_esn->replay_window,
+					    (uint32_t)ESP_REPLAY_WINDOW_MAX);
+	else
+		sa->replay_window = sa_info->replay_window;
 
 	sa->flags = sa_info->flags;
 	sa->extra_flags = extra_flags;
+	sa->esn = !!(sa->flags & XFRM_STATE_ESN);
+
+	if (sa->dir == CRYPTO_DIR_IN && (sa->replay_window || sa->esn)) {
+		sa->replay = esp_replay_create(sa->replay_window);
+		if (!sa->replay) {
+			ENGINE_ERR("Failed to allocate replay window\n");
+			return -1;
+		}
+	}
 
 	if (sa_info->family == AF_INET) {
 		sa->iphdr = (struct iphdr){
@@ -950,6 +980,8 @@ void cipher_teardown_ctx(struct sadb_sa *sa)
 {
 	crypto_session_destroy(sa->session);
 	sa->session = NULL;
+	esp_replay_destroy(sa->replay);
+	sa->replay = NULL;
 }
 
 uint32_t cipher_get_encryption_overhead(struct sadb_sa *sa,
@@ -22,6 +22,7 @@
 #include <rte_memcpy.h>
 #include <rte_mbuf.h>
 #include <sys/queue.h>
+#include <urcu/uatomic.h>
 
 #include "crypto_defs.h"
 #include "crypto_main.h"
@@ -64,6 +65,9 @@ struct crypto_dp {
 
 struct crypto_session_operations;
 struct crypto_visitor_operations;
+struct esp_replay;
+struct crypto_spd;
+struct crypto_pmd;
 
 enum crypto_dir {
 	CRYPTO_DIR_IN = 0,
@@ -143,9 +147,12 @@ struct sadb_sa {
 	/* --- cacheline 1 boundary (64 bytes) --- */
 	uint16_t udp_sport;
 	uint16_t udp_dport;
-	uint32_t seq;
 	uint32_t flags;
-	uint32_t extra_flags;
+	/*
+	 * Outbound seq, with the ESN high order bits on top. Allocated
+	 * atomically when the SA is sprayed across crypto cores.
+	 */
+	uint64_t seq;
 	uint64_t packet_count;
 	uint64_t packet_limit;
 	uint64_t byte_count;
@@ -160,10 +167,17 @@ struct sadb_sa {
 	uint32_t seq_drop;
 	int del_pmd_dev_id;
 	/* --- cacheline 3 boundary (192 bytes) --- */
-	uint8_t replay_window;
+	uint32_t replay_window;
 	uint8_t pending_del;
 	uint8_t fwd_core;
-	uint64_t replay_bitmap;
+	bool esn;
+	bool spray; /* processed on several crypto cores at once */
+	uint32_t extra_flags;
+	uint32_t inflight; /* packets on a crypto device */
+	/* pmd to destroy the session of a deleted SA with */
+	struct crypto_pmd *del_pmd;
+	/* Inbound anti-replay state, updated by the crypto engine */
+	struct esp_replay *replay;
 	struct ip6_hdr ip6_hdr;
 	struct ifnet *feat_attach_ifp;
 	vrfid_t overlay_vrf_id;
@@ -177,6 +191,18 @@ static_assert(offsetof(struct sadb_sa, peer_links) == 128,
 static_assert(offsetof(struct sadb_sa, replay_window) == 192,
 	      "third cache line exceeded");
 
+/*
+ * Account for packets of an SA handed to, or returned by, a crypto
+ * device. The SA is not freed while any are in flight.
+ */
+static inline void crypto_sa_inflight_add(struct sadb_sa *sa, int cnt)
+{
+	if (likely(!sa->spray))
+		CMM_STORE_SHARED(sa->inflight, sa->inflight + cnt);
+	else
+		uatomic_add(&sa->inflight, cnt);
+}
+
 struct crypto_chain_elem;
 
 struct crypto_session_operations {
@@ -345,6 +371,7 @@ int cipher_setup_ctx(const struct xfrm_algo *,
 		     const struct xfrm_algo_auth *,
 		     const struct xfrm_usersa_info *,
 		     const struct xfrm_encap_tmpl *t,
+		     const struct xfrm_replay_state_esn *replay_esn,
 		     struct sadb_sa *,
 		     uint32_t extra_flags);
 void cipher_teardown_ctx(struct sadb_sa *sa);
@@ -439,6 +466,8 @@ enum ipsec_cnt_types {
 	CRYPTO_DIGEST_OP_FAILED,
 	CRYPTO_DIGEST_CB_FAILED,
 	CRYPTO_PP_ENQ_FAILED,
+	ESP_SEQ_EXHAUSTED,
+	CRYPTO_SPRAY_RET_FAILED,
 	IPSEC_CNT_MAX /* this must be last */
 };
 
@@ -468,6 +497,11 @@ struct crypto_vrf_ctx {
 	unsigned int count_of_sas;
 	unsigned int s2s_bindings;
 	uint32_t count_of_peers;
+	/*
+	 * Policies compiled at the last NPF commit, or NULL if
+	 * not built, in which case the NPF ruleset is used.
+	 */
+	struct crypto_spd *spd;
 	struct rcu_head vrf_ctx_rcu;
 };
 
@@ -519,19 +553,62 @@ struct rte_ring *crypto_create_ring(const char *name,
 const char *crypto_xfrm_name(enum crypto_xfrm xfrm);
 void crypto_purge_queue(struct rte_ring *pmd_queue);
 void crypto_delete_queue(struct rte_ring *pmd_queue);
+void crypto_purge_cryptodev(uint8_t cdev_id);
+
+/*
+ * Spraying of the packets of SAs across crypto cores.
+ *
+ * The PMD an SA is bound to (its home) keeps a share of each burst
+ * it dequeues and hands the rest to the PMDs of the same type on the
+ * other spray cores, through their spray queues. Each packet is
+ * stamped by the home before being handed out, and once processed is
+ * put back into stamp order by the home's reorder buffer before it is
+ * forwarded.
+ */
+#define CRYPTO_SPRAY_MAX	16
+#define CRYPTO_REORDER_SIZE	1024	/* power of 2 */
+#define CRYPTO_REORDER_MASK	(CRYPTO_REORDER_SIZE - 1)
+
+struct crypto_reorder {
+	struct rte_ring *ret_q;	/* processed by other PMDs */
+	uint32_t next_stamp;	/* stamp for the next packet */
+	uint32_t head;		/* stamp of the next packet to release */
+	uint32_t stall;		/* polls the head has been missing */
+	uint64_t skipped;	/* stamps given up on */
+	uint64_t late;		/* returned after being given up on */
+	struct crypto_pkt_ctx *slots[CRYPTO_REORDER_SIZE];
+};
+
+struct crypto_spray {
+	struct rte_ring *in_q[MAX_CRYPTO_XFRM];	/* sprayed by others */
+	uint8_t next;				/* round robin start */
+	uint8_t cnt;				/* PMDs sprayed to */
+	int8_t pmd_ids[CRYPTO_SPRAY_MAX];
+	struct crypto_reorder reorder[MAX_CRYPTO_XFRM];
+};
+
+struct crypto_spray *crypto_spray_create(int socket, int dev_id);
+void crypto_spray_destroy(struct crypto_spray *spray);
+
 /*
  * Prototypes for crypto_pmd.c
  */
-void crypto_remove_sa_from_pmd(int crypto_dev_id, enum crypto_xfrm xfrm,
-			       struct crypto_session *ctx,
-			       bool pending);
+struct crypto_pmd *crypto_remove_sa_from_pmd(int crypto_dev_id,
+					     enum crypto_xfrm xfrm,
+					     bool pending);
+bool crypto_pmd_destroy_session(struct crypto_pmd *pmd,
+				struct crypto_session *ctx, bool inflight);
 int crypto_allocate_pmd(enum crypto_xfrm xfrm,
 			enum rte_crypto_cipher_algorithm cipher_algo,
 			enum rte_crypto_aead_algorithm aead_algo,
 			bool *setup_openssl);
 struct rte_ring *crypto_pmd_get_q(int dev_id, enum crypto_xfrm xfrm);
-typedef bool (*crypto_pmd_walker_cb)(int pmd_dev_id, enum crypto_xfrm,
+struct crypto_spray *crypto_pmd_get_spray(int dev_id);
+bool crypto_pmd_is_spraying(int dev_id);
+typedef bool (*crypto_pmd_walker_cb)(int pmd_dev_id, uint8_t rte_cdev_id,
+				     enum crypto_xfrm,
 				     struct rte_ring *,
+				     struct crypto_spray *,
 				     uint64_t *bytes,
 				     uint32_t *packets);
 unsigned int crypto_pmd_walk_per_xfrm(struct cds_list_head *pmd_head,
@@ -593,8 +670,13 @@ struct crypto_pkt_ctx {
 	char *hdr;
 	char *tail;
 	unsigned int counter_modify;
+	uint32_t seq_hi; /* ESN high order bits of the packet's seq */
 	xfrm_address_t dst; /* Only used for outbound traffic */
 	vrfid_t vrfid;
+	uint32_t stamp; /* order of the packet within its spraying PMD */
+	int8_t spray_pmd; /* spraying PMD, or CRYPTO_PMD_INVALID_ID */
+	uint8_t rte_cdev_id; /* device of the PMD processing the packet */
+	uint64_t seq; /* outbound seq given by the spraying PMD, or 0 */
 };
 
 /*
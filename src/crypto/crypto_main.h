@@ -52,7 +52,7 @@ struct crypto_pkt_buffer {
 	char SPARE[6];
 	struct crypto_pkt_ctx *local_crypto_q[MAX_CRYPTO_XFRM]
 	[MAX_CRYPTO_PKT_BURST];
-	struct rte_crypto_op *cops[MAX_CRYPTO_PKT_BURST];
+	struct rte_crypto_op *cops[MAX_CRYPTO_PKT_BURST]; /* burst submitted */
 	unsigned char iv_cache[MAX_CRYPTO_PKT_BURST][CRYPTO_MAX_IV_LENGTH];
 };
 
@@ -19,6 +19,7 @@
 #include <urcu/list.h>
 #include <urcu/uatomic.h>
 
+#include "bitmask.h"
 #include "compiler.h"
 #include "crypto.h"
 #include "crypto_internal.h"
@@ -75,6 +76,14 @@ struct crypto_pmd {
 	unsigned int pending_remove[MAX_CRYPTO_XFRM];
 	char dev_name[DEV_NAME_LEN];
 	enum cryptodev_type dev_type;
+	/* Set when the pmd takes part in spraying SAs */
+	struct crypto_spray *spray;
+	/* Number of pmds spraying to this one */
+	unsigned int spray_refs;
+	/* Sessions of deleted SAs still to be destroyed */
+	unsigned int sess_pending;
+	/* Set once the device is purged of its ops on removal */
+	bool purged;
 };
 
 static_assert(offsetof(struct crypto_pmd, padding) == 64,
@@ -91,6 +100,12 @@ static unsigned int pmd_alloc, pmd_alloc_fail, pmd_sa_active,
 	pmd_engine_assign_fail, pmd_invalid_id, pmd_not_found,
 	pmd_create_failed, pmd_total_created;
 
+/*
+ * Cores that the SAs of pmds created while this is set are sprayed
+ * across.
+ */
+static bitmask_t crypto_spray_cores;
+
 static struct crypto_pmd *crypto_dev_id_to_pmd(int dev_id,
 					       bool *err)
 {
@@ -106,8 +121,10 @@ static struct crypto_pmd *crypto_dev_id_to_pmd(int dev_id,
 	return rcu_dereference(crypto_pmd_devs[dev_id]);
 }
 
-static bool crypto_pmd_rate_cb(int pmd_dev_id, enum crypto_xfrm xfrm,
+static bool crypto_pmd_rate_cb(int pmd_dev_id, uint8_t rte_cdev_id __unused,
+			       enum crypto_xfrm xfrm,
 			       struct rte_ring *pmd_queue __unused,
+			       struct crypto_spray *spray __unused,
 			       uint64_t *bytes __unused,
 			       uint32_t *packets __unused)
 {
@@ -193,38 +210,17 @@ crypto_pmd_alloc_loadshare(enum crypto_xfrm xfrm)
  */
 static int8_t lcore_dev_ids[RTE_MAX_LCORE][CRYPTODEV_MAX];
 
+/*
+ * Create a PMD of the desired type on a core
+ */
 static struct crypto_pmd *
-crypto_pmd_find_or_create(enum crypto_xfrm xfrm,
-			  enum cryptodev_type dev_type)
+crypto_pmd_create_on(int lcore, enum cryptodev_type dev_type)
 {
 	unsigned int cpu_socket;
 	uint8_t dev_id;
 	struct crypto_pmd *pmd;
 	enum crypto_xfrm q;
 	int err;
-	int lcore;
-
-	if (pmd_alloc == 0)
-		memset(lcore_dev_ids, -1, sizeof(lcore_dev_ids));
-
-	if (xfrm == MAX_CRYPTO_XFRM)
-		return NULL;
-
-	if (pmd_alloc >= max_pmds)
-		return crypto_pmd_alloc_loadshare(xfrm);
-
-	/*
-	 * check if we have an existing PMD of the desired type
-	 * on the next available crypto core
-	 */
-	lcore = next_available_crypto_lcore();
-	if (lcore < 0)
-		return NULL;
-
-	if (lcore_dev_ids[lcore][dev_type] != CRYPTO_PMD_INVALID_ID) {
-		dev_id = lcore_dev_ids[lcore][dev_type];
-		return crypto_pmd_devs[dev_id];
-	}
 
 	/*
 	 * allocate id for device
@@ -289,13 +285,60 @@ crypto_pmd_find_or_create(enum crypto_xfrm xfrm,
 		return NULL;
 	}
 
-	lcore_dev_ids[lcore][dev_type] = pmd->dev_id;
 	pmd_alloc++;
 	pmd_total_created++;
 
 	return pmd;
 }
 
+/*
+ * Return the PMD of the desired type on a core, creating it if there
+ * isn't one yet.
+ */
+static struct crypto_pmd *
+crypto_pmd_find_or_create_on(int lcore, enum cryptodev_type dev_type)
+{
+	struct crypto_pmd *pmd;
+	uint8_t dev_id;
+
+	if (pmd_alloc == 0)
+		memset(lcore_dev_ids, -1, sizeof(lcore_dev_ids));
+
+	if (lcore_dev_ids[lcore][dev_type] != CRYPTO_PMD_INVALID_ID) {
+		dev_id = lcore_dev_ids[lcore][dev_type];
+		return crypto_pmd_devs[dev_id];
+	}
+
+	pmd = crypto_pmd_create_on(lcore, dev_type);
+	if (pmd)
+		lcore_dev_ids[lcore][dev_type] = pmd->dev_id;
+
+	return pmd;
+}
+
+static struct crypto_pmd *
+crypto_pmd_find_or_create(enum crypto_xfrm xfrm,
+			  enum cryptodev_type dev_type)
+{
+	int lcore;
+
+	if (xfrm == MAX_CRYPTO_XFRM)
+		return NULL;
+
+	if (pmd_alloc >= max_pmds)
+		return crypto_pmd_alloc_loadshare(xfrm);
+
+	/*
+	 * check if we have an existing PMD of the desired type
+	 * on the next available crypto core
+	 */
+	lcore = next_available_crypto_lcore();
+	if (lcore < 0)
+		return NULL;
+
+	return crypto_pmd_find_or_create_on(lcore, dev_type);
+}
+
 void crypto_pmd_mod_pending_del(int pmd_dev_id, enum crypto_xfrm xfrm, bool inc)
 {
 	if (pmd_dev_id == CRYPTO_PMD_INVALID_ID)
@@ -368,6 +411,123 @@ int crypto_engine_set(uint8_t *bytes, uint8_t len)
 
 	return 0;
 }
+
+int crypto_set_spray_cores(const uint8_t *bytes, uint8_t len)
+{
+	int rc;
+	char tmp[BITMASK_STRSZ];
+
+	rc = bitmask_parse_bytes(&crypto_spray_cores, bytes, len);
+	if (rc) {
+		RTE_LOG(ERR, DATAPLANE,
+			"Failed to parse cpumask for crypto spraying\n");
+		return rc;
+	}
+
+	bitmask_sprint(&crypto_spray_cores, tmp, sizeof(tmp));
+	DP_DEBUG(INIT, INFO, DATAPLANE,
+		 "Crypto spray cores set: %s\n", tmp);
+
+	return rc;
+}
+
+static void crypto_pmd_remove(int dev_id);
+
+static bool crypto_pmd_spray_join(struct crypto_pmd *pmd)
+{
+	struct crypto_spray *spray;
+
+	if (pmd->spray)
+		return true;
+
+	spray = crypto_spray_create(rte_lcore_to_socket_id(pmd->lcore),
+				    pmd->dev_id);
+	if (!spray)
+		return false;
+
+	rcu_assign_pointer(pmd->spray, spray);
+	return true;
+}
+
+/*
+ * Have a pmd that has no SAs yet spray the packets of the SAs it is
+ * given to the pmds of the same type on the spray cores, creating
+ * them as needed. The pmds sprayed to are held until the SAs are
+ * gone.
+ *
+ * Only pmds whose sessions hold no per packet state can share a
+ * session across cores. The openssl pmd keeps its EVP contexts in
+ * the session, so its SAs are never sprayed.
+ */
+static bool crypto_pmd_can_spray(enum cryptodev_type dev_type)
+{
+	switch (dev_type) {
+	case CRYPTODEV_AESNI_GCM:
+	case CRYPTODEV_AESNI_MB:
+	case CRYPTODEV_NULL:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void crypto_pmd_spray_setup(struct crypto_pmd *pmd)
+{
+	struct crypto_pmd *peer;
+	unsigned int lcore;
+	uint8_t cnt = 0;
+
+	if (bitmask_isempty(&crypto_spray_cores) || pmd->sa_cnt ||
+	    !crypto_pmd_can_spray(pmd->dev_type))
+		return;
+
+	if (!crypto_pmd_spray_join(pmd) || pmd->spray->cnt)
+		return;
+
+	RTE_LCORE_FOREACH_SLAVE(lcore) {
+		if (!bitmask_isset(&crypto_spray_cores, lcore) ||
+		    lcore == pmd->lcore)
+			continue;
+		if (cnt == CRYPTO_SPRAY_MAX)
+			break;
+
+		peer = crypto_pmd_find_or_create_on(lcore, pmd->dev_type);
+		if (!peer)
+			continue;
+		if (!crypto_pmd_spray_join(peer)) {
+			if (!peer->sa_cnt && !peer->spray_refs)
+				crypto_pmd_remove(peer->dev_id);
+			continue;
+		}
+		peer->spray_refs++;
+		pmd->spray->pmd_ids[cnt++] = peer->dev_id;
+	}
+
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(pmd->spray->cnt, cnt);
+}
+
+static void crypto_pmd_spray_release(struct crypto_pmd *pmd)
+{
+	struct crypto_pmd *peer;
+	uint8_t i, cnt;
+	bool err;
+
+	if (!pmd->spray || !pmd->spray->cnt)
+		return;
+
+	cnt = pmd->spray->cnt;
+	CMM_STORE_SHARED(pmd->spray->cnt, 0);
+
+	for (i = 0; i < cnt; i++) {
+		peer = crypto_dev_id_to_pmd(pmd->spray->pmd_ids[i], &err);
+		if (!peer)
+			continue;
+		if (!--peer->spray_refs && !peer->sa_cnt)
+			crypto_pmd_remove(peer->dev_id);
+	}
+}
+
 /*
  * Return a PMD to be used by the caller, either reusing an
  * existing PMD or create a new one. If a new one is created
@@ -406,6 +566,8 @@ int crypto_allocate_pmd(enum crypto_xfrm xfrm,
 		return CRYPTO_PMD_INVALID_ID;
 	}
 
+	crypto_pmd_spray_setup(pmd);
+
 	pmd->sa_cnt++;
 	pmd->sa_cnt_per_type[xfrm]++;
 	pmd_sa_active++;
@@ -417,6 +579,7 @@ static void pmd_purge_and_release_queues(struct crypto_pmd *pmd)
 {
 	unsigned int q;
 
+	crypto_purge_cryptodev(pmd->rte_cdev_id);
 	for (q = MIN_CRYPTO_XFRM; q < MAX_CRYPTO_XFRM; q++) {
 		crypto_purge_queue(pmd->q_pair.q[q]);
 		crypto_delete_queue(pmd->q_pair.q[q]);
@@ -429,7 +592,21 @@ static void pmd_rcu_free(struct rcu_head *head)
 	int err;
 
 	pmd  = caa_container_of(head, struct crypto_pmd, pmd_rcu);
-	pmd_purge_and_release_queues(pmd);
+	if (!pmd->purged) {
+		pmd_purge_and_release_queues(pmd);
+		CMM_STORE_SHARED(pmd->purged, true);
+	}
+
+	/*
+	 * The device must outlive the sessions of SAs deleted from
+	 * it, which are destroyed from the SA RCU callbacks.
+	 */
+	if (uatomic_read(&pmd->sess_pending)) {
+		call_rcu(&pmd->pmd_rcu, pmd_rcu_free);
+		return;
+	}
+
+	crypto_spray_destroy(pmd->spray);
 
 	err = crypto_rte_destroy_pmd(pmd->dev_type, pmd->dev_name,
 				     pmd->dev_id);
@@ -448,7 +625,9 @@ static void crypto_pmd_remove(int dev_id)
 	if (!pmd)
 		return;
 
-	lcore_dev_ids[pmd->lcore][pmd->dev_type] = CRYPTO_PMD_INVALID_ID;
+	if (lcore_dev_ids[pmd->lcore][pmd->dev_type] == dev_id)
+		lcore_dev_ids[pmd->lcore][pmd->dev_type] =
+			CRYPTO_PMD_INVALID_ID;
 
 	rcu_assign_pointer(crypto_pmd_devs[dev_id], NULL);
 	pmd_alloc--;
@@ -469,9 +648,16 @@ void crypto_pmd_remove_all(void)
 			crypto_pmd_remove(i);
 }
 
-void crypto_remove_sa_from_pmd(int dev_id, enum crypto_xfrm xfrm,
-			       struct crypto_session *ctx,
-			       bool pending)
+/*
+ * Detach a deleted SA from its pmd. The crypto device may still have
+ * ops using the SA's session, so the session is left for the SA's
+ * RCU callback to destroy with crypto_pmd_destroy_session(), and the
+ * pmd is returned for that. The pmd is kept until then, even if this
+ * removes it.
+ */
+struct crypto_pmd *crypto_remove_sa_from_pmd(int dev_id,
+					     enum crypto_xfrm xfrm,
+					     bool pending)
 {
 	bool err;
 	struct crypto_pmd *pmd = crypto_dev_id_to_pmd(dev_id,
@@ -480,10 +666,10 @@ void crypto_remove_sa_from_pmd(int dev_id, enum crypto_xfrm xfrm,
 	if (!pmd) {
 		CRYPTO_ERR("No PMD for ID %d\n", dev_id);
 		pmd_not_found++;
-		return;
+		return NULL;
 	}
 
-	crypto_rte_destroy_session(ctx, pmd->rte_cdev_id);
+	uatomic_inc(&pmd->sess_pending);
 
 	pmd->sa_cnt_per_type[xfrm]--;
 	pmd->sa_cnt--;
@@ -491,8 +677,31 @@ void crypto_remove_sa_from_pmd(int dev_id, enum crypto_xfrm xfrm,
 	if (pending)
 		crypto_pmd_dec_pending_del(dev_id, xfrm);
 
-	if (!pmd->sa_cnt)
-		crypto_pmd_remove(dev_id);
+	if (!pmd->sa_cnt) {
+		crypto_pmd_spray_release(pmd);
+		if (!pmd->spray_refs)
+			crypto_pmd_remove(dev_id);
+	}
+
+	return pmd;
+}
+
+/*
+ * Destroy the session of an SA detached from the pmd, once the
+ * device has no ops left using it. Ops not returned by the time a
+ * removed pmd purges its device are lost, so then the session goes
+ * regardless. Returns false if the caller must try again after
+ * another grace period. Called from RCU callbacks only.
+ */
+bool crypto_pmd_destroy_session(struct crypto_pmd *pmd,
+				struct crypto_session *ctx, bool inflight)
+{
+	if (inflight && !CMM_LOAD_SHARED(pmd->purged))
+		return false;
+
+	crypto_rte_destroy_session(ctx, pmd->rte_cdev_id);
+	uatomic_dec(&pmd->sess_pending);
+	return true;
 }
 
 /*
@@ -534,6 +743,29 @@ struct rte_ring *crypto_pmd_get_q(int dev_id, enum crypto_xfrm xfrm)
 	return pmd->q_pair.q[xfrm];
 }
 
+struct crypto_spray *crypto_pmd_get_spray(int dev_id)
+{
+	struct crypto_pmd *pmd;
+	bool err;
+
+	pmd = crypto_dev_id_to_pmd(dev_id, &err);
+	if (!pmd)
+		return NULL;
+
+	return rcu_dereference(pmd->spray);
+}
+
+bool crypto_pmd_is_spraying(int dev_id)
+{
+	struct crypto_spray *spray;
+
+	if (dev_id == CRYPTO_PMD_INVALID_ID)
+		return false;
+
+	spray = crypto_pmd_get_spray(dev_id);
+	return spray && spray->cnt;
+}
+
 /*
  * crypto pmd processing loop.
  */
@@ -559,7 +791,9 @@ unsigned int crypto_pmd_walk_per_xfrm(struct cds_list_head *pmd_head,
 	cds_list_for_each_entry_rcu(pmd, pmd_head, next) {
 		for (q = MIN_CRYPTO_XFRM; q < MAX_CRYPTO_XFRM; q++) {
 			pkts = bytes = 0;
-			rc = (cb)(pmd->dev_id, q, pmd->q_pair.q[q],
+			rc = (cb)(pmd->dev_id, pmd->rte_cdev_id, q,
+				  pmd->q_pair.q[q],
+				  rcu_dereference(pmd->spray),
 				  &bytes, &pkts);
 			pmd->cnt[q].bytes += bytes;
 			pmd->cnt[q].packets += pkts;
@@ -571,6 +805,42 @@ unsigned int crypto_pmd_walk_per_xfrm(struct cds_list_head *pmd_head,
 	return total_pkts;
 }
 
+static void
+crypto_show_pmd_spray(json_writer_t *wr, struct crypto_pmd *pmd)
+{
+	struct crypto_spray *spray = pmd->spray;
+	struct crypto_reorder *ro;
+	enum crypto_xfrm q;
+	uint8_t i, cnt;
+
+	if (!spray)
+		return;
+
+	jsonw_name(wr, "spray");
+	jsonw_start_object(wr);
+	jsonw_uint_field(wr, "refs", pmd->spray_refs);
+	cnt = CMM_LOAD_SHARED(spray->cnt);
+	jsonw_name(wr, "pmds");
+	jsonw_start_array(wr);
+	for (i = 0; i < cnt; i++)
+		jsonw_int(wr, spray->pmd_ids[i]);
+	jsonw_end_array(wr);
+	for (q = MIN_CRYPTO_XFRM; q < MAX_CRYPTO_XFRM; q++) {
+		ro = &spray->reorder[q];
+		jsonw_name(wr, crypto_xfrm_name(q));
+		jsonw_start_object(wr);
+		jsonw_uint_field(wr, "spray_ring_count",
+				 rte_ring_count(spray->in_q[q]));
+		jsonw_uint_field(wr, "reorder_pending",
+				 CMM_ACCESS_ONCE(ro->next_stamp) -
+				 CMM_ACCESS_ONCE(ro->head));
+		jsonw_uint_field(wr, "reorder_skipped", ro->skipped);
+		jsonw_uint_field(wr, "reorder_late", ro->late);
+		jsonw_end_object(wr);
+	}
+	jsonw_end_object(wr);
+}
+
 static void
 crypto_show_pmd_counters(json_writer_t *wr, struct crypto_pmd *pmd)
 {
@@ -625,6 +895,7 @@ crypto_show_pmd_counters(json_writer_t *wr, struct crypto_pmd *pmd)
 		jsonw_end_object(wr);
 	}
 	jsonw_end_array(wr);
+	crypto_show_pmd_spray(wr, pmd);
 	jsonw_end_object(wr);
 }
 
@@ -46,6 +46,7 @@
 #include "crypto/crypto_main.h"
 #include "crypto/crypto_policy.h"
 #include "crypto/crypto_sadb.h"
+#include "crypto/crypto_spd.h"
 #include "crypto/esp.h"
 #include "if_var.h"
 #include "ip_funcs.h"
@@ -149,8 +150,6 @@ struct policy_rule_key {
 	const struct xfrm_mark *mark;
 };
 
-bool flow_cache_disabled;
-
 /*
  * Lock free hash tables for policy rule database.
  */
@@ -303,10 +302,6 @@ crypto_flow_cache_lookup(struct rte_mbuf *m, bool v4)
 	struct flow_cache_entry *entry;
 	int err;
 
-	/* Any host generated packet don't make use of the flow cache table*/
-	if (flow_cache_disabled)
-		return NULL;
-
 	err = flow_cache_lookup(flow_cache, m,
 				v4 ? FLOW_CACHE_IPV4 : FLOW_CACHE_IPV6,
 				&entry);
@@ -325,7 +320,7 @@ static void crypto_flow_cache_add(struct flow_cache *flow_cache,
 	enum flow_cache_ftype af = v4 ? FLOW_CACHE_IPV4 : FLOW_CACHE_IPV6;
 	struct flow_cache_entry *cache_entry;
 
-	if (!flow_cache || flow_cache_disabled)
+	if (!flow_cache)
 		return;
 
 	if (pr) {
@@ -379,9 +374,14 @@ int crypto_flow_cache_teardown_lcore(unsigned int lcore_id)
 	return err;
 }
 
+/*
+ * The cache is keyed on the L4 ports, as well as the addresses and
+ * protocol, so that the result for any policy can be cached.
+ */
 int crypto_flow_cache_init(void)
 {
-	flow_cache = flow_cache_init(CRYPTO_FLOW_CACHE_MAX_COUNT);
+	flow_cache = flow_cache_init_ext(CRYPTO_FLOW_CACHE_MAX_COUNT,
+					 FLOW_CACHE_F_CLASSIFY, NULL);
 	if (!flow_cache)
 		return -ENOMEM;
 
@@ -1145,25 +1145,6 @@ failed_attach_group:
 	return false;
 }
 
-static bool all_other_policies_can_be_cached(const struct policy_rule *pr)
-{
-	const struct policy_rule *check_pr;
-	struct cds_lfht_iter iter;
-	bool result = true;
-
-	cds_lfht_for_each_entry(output_policy_rule_tag_ht,
-				&iter, check_pr, tag_ht_node) {
-		if (check_pr == pr)
-			continue;
-		if ((check_pr->sel.sport > 0) || (check_pr->sel.dport > 0)) {
-			result = false;
-			break;
-		}
-	}
-
-	return result;
-}
-
 static void policy_rule_remove_from_npf(struct policy_rule *pr,
 					bool vti_tunnel_policy,
 					uint32_t rule_index)
@@ -1409,6 +1390,53 @@ static struct rte_timer crypto_npf_cfg_commit_all_timer;
 
 static uint32_t batch_seq[CRYPTO_NPF_CFG_COMMIT_FORCE_COUNT];
 
+/*
+ * Compile the policies of a VRF into a new SPD, to match the NPF
+ * ruleset just committed, and publish it.  VTI policies have no NPF
+ * rule, so are not in the SPD either.  If the build fails then the
+ * NPF ruleset is used until the next commit.
+ */
+static void crypto_policy_spd_rebuild(struct crypto_vrf_ctx *vrf_ctx)
+{
+	struct cds_lfht *hts[] = {
+		vrf_ctx->input_policy_rule_sel_ht,
+		vrf_ctx->output_policy_rule_sel_ht,
+	};
+	struct crypto_spd *spd, *old;
+	struct cds_lfht_iter iter;
+	struct policy_rule *pr;
+	unsigned int i;
+
+	spd = crypto_spd_create(vrf_ctx->vrfid);
+	if (!spd)
+		goto fail;
+
+	for (i = 0; i < ARRAY_SIZE(hts); i++) {
+		cds_lfht_for_each_entry(hts[i], &iter, pr, sel_ht_node) {
+			if (pr->vti_tunnel_policy)
+				continue;
+			if (crypto_spd_add_policy(spd, pr->dir, &pr->sel,
+						  pr->rule_index, pr->tag))
+				goto fail;
+		}
+	}
+
+	if (crypto_spd_build(spd))
+		goto fail;
+
+publish:
+	old = vrf_ctx->spd;
+	rcu_assign_pointer(vrf_ctx->spd, spd);
+	crypto_spd_destroy(old);
+	return;
+
+fail:
+	POLICY_ERR("Failed to build SPD for vrf %d\n", vrf_ctx->vrfid);
+	crypto_spd_free(spd);
+	spd = NULL;
+	goto publish;
+}
+
 void crypto_npf_cfg_commit_flush(void)
 {
 	vrfid_t vrf_id;
@@ -1426,8 +1454,13 @@ void crypto_npf_cfg_commit_flush(void)
 			vrf_ctx->crypto_total_ipv4_policies;
 		vrf_ctx->crypto_live_ipv6_policies =
 			vrf_ctx->crypto_total_ipv6_policies;
+
+		crypto_policy_spd_rebuild(vrf_ctx);
 	}
 
+	/* Results cached from the old policies may have changed */
+	flow_cache_invalidate(flow_cache, false, false);
+
 	/*
 	 * There is an assumption that npf_cfg_commit_all completed
 	 * successfully as there is no return value. Any issues should
@@ -1568,8 +1601,7 @@ policy_rule_update(struct policy_rule *pr,
 		crypto_npf_cfg_commit_all(pr, seq);
 		if ((pr->dir == XFRM_POLICY_OUT) &&
 		    (!was_vti_policy || !pr->vti_tunnel_policy))
-			flow_cache_invalidate(flow_cache, flow_cache_disabled,
-					      false);
+			flow_cache_invalidate(flow_cache, false, false);
 	} else if (changed) {
 		*send_ack = false;
 		policy_rule_update_npf(pr);
@@ -1633,17 +1665,8 @@ int crypto_policy_add(const struct xfrm_userpolicy_info *usr_policy,
 
 	*send_ack = false;
 	crypto_npf_cfg_commit_all(pr, seq);
-	/*
-	 * Any policy rule added, where the port is specified as part of the
-	 * selection criteria, the cache is disabled.
-	 */
 	if (pr->dir == XFRM_POLICY_OUT) {
-		if (!flow_cache_disabled) {
-			flow_cache_disabled = ((pr->sel.sport > 0) ||
-					       (pr->sel.dport > 0));
-			flow_cache_invalidate(flow_cache, flow_cache_disabled,
-					      false);
-		}
+		flow_cache_invalidate(flow_cache, false, false);
 
 		/*
 		 * There may already be a pending binding to a feature
@@ -1716,22 +1739,8 @@ static void crypto_policy_delete_internal(struct policy_rule *pr, vrfid_t vrfid,
 	if (ack)
 		crypto_npf_cfg_commit_all(pr, seq);
 
-	if (pr->dir == XFRM_POLICY_OUT) {
-		/*
-		 * The cache is disabled any time there is a policy that
-		 * specifies a source or destination port. If the policy
-		 * we're deleting is one such, we may be able to enable
-		 * it if it was the only one.
-		 */
-		if (flow_cache_disabled &&
-		    ((pr->sel.sport > 0) || (pr->sel.dport > 0)) &&
-		    all_other_policies_can_be_cached(pr))
-			flow_cache_disabled = false;
-
-		if (!flow_cache_disabled)
-			flow_cache_invalidate(flow_cache, flow_cache_disabled,
-					      false);
-	}
+	if (pr->dir == XFRM_POLICY_OUT)
+		flow_cache_invalidate(flow_cache, false, false);
 
 	policy_rule_remove_from_hash_tables(pr);
 	policy_rule_destroy(pr);
@@ -2392,12 +2401,49 @@ static int crypto_npf_rte_acl_match(int af, npf_match_ctx_t *ctx,
 	return 1;
 }
 
+#define CRYPTO_ACL_BURST_MAX 32
+
+static int crypto_npf_rte_acl_match_burst(int af, npf_match_ctx_t *ctx,
+					  npf_cache_t *npc[] __unused,
+					  struct npf_match_cb_data *data[],
+					  npf_rule_t *rl[], uint32_t num)
+{
+	struct rte_mbuf *m[CRYPTO_ACL_BURST_MAX];
+	uint32_t rule_no[CRYPTO_ACL_BURST_MAX];
+	uint32_t i, n, done;
+	int matched = 0;
+
+	for (done = 0; done < num; done += n) {
+		n = RTE_MIN(num - done, (uint32_t)CRYPTO_ACL_BURST_MAX);
+
+		for (i = 0; i < n; i++)
+			m[i] = data[done + i]->mbuf;
+
+		npf_rte_acl_match_burst(af, ctx, m, n, rule_no);
+
+		for (i = 0; i < n; i++) {
+			npf_rule_t **r = &rl[done + i];
+
+			*r = NULL;
+			if (!rule_no[i])
+				continue;
+			*r = npf_rule_group_find_rule(data[done + i]->rg,
+						      rule_no[i]);
+			if (*r)
+				matched++;
+		}
+	}
+
+	return matched;
+}
+
 static npf_match_cb_tbl crypto_npf_match_cb_tbl = {
 	.npf_match_init_cb     = npf_rte_acl_init,
 	.npf_match_add_rule_cb = npf_rte_acl_add_rule,
 	.npf_match_build_cb    = npf_rte_acl_build,
 	.npf_match_classify_cb = crypto_npf_rte_acl_match,
-	.npf_match_destroy_cb  = npf_rte_acl_destroy
+	.npf_match_destroy_cb  = npf_rte_acl_destroy,
+	.npf_match_classify_burst_cb = crypto_npf_rte_acl_match_burst,
 };
 
 /*
@@ -2500,6 +2546,98 @@ crypto_policy_post_features_outbound(struct ifnet *vfp_ifp,
 	}
 }
 
+/*
+ * Classify a packet against the IPsec policies of its VRF, in the
+ * given PFIL directions.  As in the NPF ruleset, whose input group is
+ * attached first, input policies are checked before output policies.
+ *
+ * The SPD of the VRF is used if there is one and it can classify the
+ * packet, else the NPF ruleset.  Returns false if no policy matched,
+ * otherwise *tag is set to the tag of the matching rule, or 0 if it
+ * has none.
+ */
+static bool
+crypto_policy_classify(struct npf_config *npf_conf, struct ifnet *in_ifp,
+		       struct rte_mbuf **mbuf, uint16_t eth_type, int dir,
+		       uint32_t *tag)
+{
+	struct crypto_vrf_ctx *vrf_ctx;
+	struct crypto_spd *spd = NULL;
+	bool v4 = (eth_type == htons(RTE_ETHER_TYPE_IPV4));
+
+	vrf_ctx = crypto_vrf_find(pktmbuf_get_vrf(*mbuf));
+	if (vrf_ctx)
+		spd = rcu_dereference(vrf_ctx->spd);
+
+	if (likely(spd)) {
+		*tag = 0;
+		if (dir & PFIL_IN)
+			crypto_spd_classify_burst(spd, XFRM_POLICY_IN, v4,
+						  mbuf, tag, 1);
+		if (!*tag && (dir & PFIL_OUT))
+			crypto_spd_classify_burst(spd, XFRM_POLICY_OUT, v4,
+						  mbuf, tag, 1);
+		if (likely(*tag != CRYPTO_SPD_NOT_CLASSIFIED))
+			return *tag != 0;
+	}
+
+	const npf_ruleset_t *rlset = npf_get_ruleset(npf_conf, NPF_RS_IPSEC);
+	npf_result_t result = npf_hook_notrack(rlset, mbuf, in_ifp, dir, 0,
+					       eth_type, NULL);
+
+	if (result.decision == NPF_DECISION_UNMATCHED)
+		return false;
+
+	*tag = result.tag_set ? result.tag : 0;
+	return true;
+}
+
+/*
+ * Return the reqid of the output policy matching a packet, found with
+ * the SPD of its VRF if 'use_spd' is set, else with the NPF ruleset.
+ * Returns 0 if no policy matches, and CRYPTO_SPD_NOT_CLASSIFIED if
+ * there is no SPD or it can't classify the packet.
+ *
+ * Used by unit-tests only.
+ */
+uint32_t crypto_policy_match_reqid(struct rte_mbuf *m, bool v4, bool use_spd)
+{
+	uint16_t eth_type = htons(v4 ? RTE_ETHER_TYPE_IPV4 :
+				  RTE_ETHER_TYPE_IPV6);
+	struct crypto_vrf_ctx *vrf_ctx;
+	struct crypto_spd *spd = NULL;
+	struct policy_rule *pr;
+	uint32_t tag = 0;
+
+	if (use_spd) {
+		vrf_ctx = crypto_vrf_find(pktmbuf_get_vrf(m));
+		if (vrf_ctx)
+			spd = rcu_dereference(vrf_ctx->spd);
+		if (!spd)
+			return CRYPTO_SPD_NOT_CLASSIFIED;
+
+		crypto_spd_classify_burst(spd, XFRM_POLICY_OUT, v4, &m,
+					  &tag, 1);
+		if (tag == CRYPTO_SPD_NOT_CLASSIFIED)
+			return tag;
+	} else {
+		struct npf_config *npf_conf =
+			vrf_get_npf_conf_rcu(pktmbuf_get_vrf(m));
+		const npf_ruleset_t *rlset =
+			npf_get_ruleset(npf_conf, NPF_RS_IPSEC);
+		npf_result_t result = npf_hook_notrack(rlset, &m, NULL,
+						       PFIL_OUT, 0, eth_type,
+						       NULL);
+
+		if (result.decision != NPF_DECISION_UNMATCHED &&
+		    result.tag_set)
+			tag = result.tag;
+	}
+
+	pr = tag ? policy_rule_find_by_tag(tag, XFRM_POLICY_OUT) : NULL;
+	return pr ? pr->reqid : 0;
+}
+
 /*
  * Check for a match on an IPsec policy and if one matches then either
  * drop the packet,  or queue it to the crypto thread as appropriate.
@@ -2548,9 +2686,6 @@ bool crypto_policy_check_outbound(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 				return false;
 		}
 	} else {
-		const npf_ruleset_t *rlset =
-			npf_get_ruleset(npf_conf, NPF_RS_IPSEC);
-
 		/*
 		 * If this packet was received encrypted,  then we don't need to
 		 * check the input policy.  Otherwise check the policy to see if
@@ -2558,6 +2693,7 @@ bool crypto_policy_check_outbound(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 		 * be dropped.
 		 */
 		int dir = PFIL_OUT | (seen_by_crypto ? 0 : PFIL_IN);
+		uint32_t tag;
 
 		/*
 		 * Packets matching an input policy must be dropped if
@@ -2571,25 +2707,24 @@ bool crypto_policy_check_outbound(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 		 *
 		 * Only block rules are currently used in the input policy.
 		 */
-		npf_result_t result =
-			npf_hook_notrack(rlset, mbuf, in_ifp, dir, 0, eth_type,
-					 NULL);
+		bool matched = crypto_policy_classify(npf_conf, in_ifp, mbuf,
+						      eth_type, dir, &tag);
 
 		/*
 		 * No input and no output policy matched,  allow normal
 		 * processing
 		 */
-		if (likely(result.decision == NPF_DECISION_UNMATCHED)) {
+		if (likely(!matched)) {
 			crypto_flow_cache_add(flow_cache, NULL, *mbuf, v4,
 					      seen_by_crypto, XFRM_POLICY_OUT);
 			return false;
 		}
 
-		if (likely(result.tag_set)) {
+		if (likely(tag)) {
 			dir = XFRM_POLICY_OUT;
-			pr = policy_rule_find_by_tag(result.tag, dir);
+			pr = policy_rule_find_by_tag(tag, dir);
 			if (!pr) {
-				pr = policy_rule_find_by_tag(result.tag,
+				pr = policy_rule_find_by_tag(tag,
 							     XFRM_POLICY_IN);
 				if (pr)
 					dir = XFRM_POLICY_IN;
@@ -2733,10 +2868,7 @@ crypto_policy_check_inbound(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 			goto drop;
 
 	} else {
-		const npf_ruleset_t *rlset =
-			npf_get_ruleset(npf_conf, NPF_RS_IPSEC);
-
-		int dir = PFIL_IN;
+		uint32_t tag;
 
 		/*
 		 * Packets matching an input policy must be dropped if
@@ -2750,17 +2882,15 @@ crypto_policy_check_inbound(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 		 *
 		 * Only block rules are currently used in the input policy.
 		 */
-		npf_result_t result =
-			npf_hook_notrack(rlset, mbuf, in_ifp, dir, 0, eth_type,
-					 NULL);
+		bool matched = crypto_policy_classify(npf_conf, in_ifp, mbuf,
+						      eth_type, PFIL_IN, &tag);
 
 		/* No input policy matched */
-		if (likely(result.decision == NPF_DECISION_UNMATCHED))
+		if (likely(!matched))
 			return false;
 
-		if (likely(result.tag_set)) {
-			pr = policy_rule_find_by_tag(result.tag,
-						     XFRM_POLICY_IN);
+		if (likely(tag)) {
+			pr = policy_rule_find_by_tag(tag, XFRM_POLICY_IN);
 			if (pr) {
 				/*
 				 * We found an input policy. If it has a
@@ -57,4 +57,6 @@ void crypto_incmpl_policy_make_complete(void);
 void policy_feat_flush_vrf(struct crypto_vrf_ctx *vrf_ctx);
 
 void crypto_npf_cfg_commit_flush(void);
+
+uint32_t crypto_policy_match_reqid(struct rte_mbuf *m, bool v4, bool use_spd);
 #endif /* CRYPTO_POLICY_H */
@@ -28,6 +28,10 @@
 #define CRYPTO_OP_IV_OFFSET (CRYPTO_OP_CTX_OFFSET + \
 			     sizeof(struct crypto_pkt_ctx **))
 
+/* AAD for ESN: SPI, seq_hi, seq_lo. RFC 4106 section 5 */
+#define CRYPTO_OP_AAD_OFFSET (CRYPTO_OP_IV_OFFSET + CRYPTO_MAX_IV_LENGTH)
+#define CRYPTO_ESN_AAD_LEN 12
+
 /* per session (SA) data structure used to set up operations with PMDs */
 static struct rte_mempool *crypto_session_pool;
 
@@ -39,6 +43,15 @@ static uint8_t dev_cnts[CRYPTODEV_MAX];
 /* per packet crypto op pool. This may eventually subsume crypto_pkt_ctx */
 static struct rte_mempool *crypto_op_pool;
 
+/*
+ * Ops in flight on each queue pair of each device. A device is only
+ * driven by the crypto engine its PMD is attached to.
+ */
+static uint16_t crypto_rte_inflight[RTE_CRYPTO_MAX_DEVS][CRYPTO_RTE_QP_MAX];
+
+/* ESN seq_hi placed ahead of the ICV for cipher+auth SAs */
+#define CRYPTO_ESN_SEQ_HI_LEN 4
+
 int crypto_rte_setup(void)
 {
 	int err = 0;
@@ -57,19 +70,23 @@ int crypto_rte_setup(void)
 
 	uint16_t crypto_op_data_size =
 		sizeof(struct rte_crypto_sym_op) +
-		sizeof(struct crypto_pkt_ctx **) + CRYPTO_MAX_IV_LENGTH;
+		sizeof(struct crypto_pkt_ctx **) + CRYPTO_MAX_IV_LENGTH +
+		CRYPTO_ESN_AAD_LEN;
 
 	/*
-	 * dp_lcore_events_init gets invoked from the main thread as well
-	 * and leads to a UT failure if the pool is not sized to take that
-	 * into account
+	 * An op is held for each packet in flight, and each core may
+	 * drive a queue pair per direction. Allow for the per core
+	 * caches, including the main thread's.
 	 */
-	uint16_t crypto_op_pool_size =
-		MAX_CRYPTO_PKT_BURST * (rte_lcore_count() + 1);
+	unsigned int crypto_op_pool_size =
+		(rte_lcore_count() + 1) *
+		(CRYPTO_RTE_QP_MAX * CRYPTO_RTE_MAX_INFLIGHT +
+		 CRYPTO_OP_POOL_CACHE * 2);
 
 	crypto_op_pool = rte_crypto_op_pool_create("crypto_op_pool",
 						   RTE_CRYPTO_OP_TYPE_SYMMETRIC,
-						   crypto_op_pool_size, 0,
+						   crypto_op_pool_size,
+						   CRYPTO_OP_POOL_CACHE,
 						   crypto_op_data_size,
 						   socket);
 	if (!crypto_op_pool) {
@@ -420,12 +437,13 @@ int crypto_rte_create_pmd(int cpu_socket, uint8_t dev_id,
 	}
 
 	struct rte_cryptodev_qp_conf qp_conf = {
-		.nb_descriptors = 2048,
+		.nb_descriptors = CRYPTO_RTE_QP_DEPTH,
 		.mp_session = crypto_session_pool,
 		.mp_session_private = crypto_priv_sess_pools[dev_type]
 	};
 
 	for (int i = MIN_CRYPTO_XFRM; i < MAX_CRYPTO_XFRM; i++) {
+		crypto_rte_inflight[*rte_dev_id][i] = 0;
 		err = rte_cryptodev_queue_pair_setup(*rte_dev_id, i,
 						     &qp_conf,
 						     cpu_socket);
@@ -502,7 +520,7 @@ int crypto_rte_destroy_pmd(enum cryptodev_type dev_type, char dev_name[],
 }
 
 static void
-crypto_rte_setup_xform_chain(struct crypto_session *session,
+crypto_rte_setup_xform_chain(struct crypto_session *session, bool esn,
 			     struct rte_crypto_sym_xform *cipher_xform,
 			     struct rte_crypto_sym_xform *auth_xform,
 			     struct rte_crypto_sym_xform **xform_chain)
@@ -525,7 +543,7 @@ crypto_rte_setup_xform_chain(struct crypto_session *session,
 		cipher_xform->type = RTE_CRYPTO_SYM_XFORM_AEAD;
 		cipher_xform->aead.op = aead_ops[direction];
 		cipher_xform->aead.algo = session->aead_algo;
-		cipher_xform->aead.aad_length = 8; /* no ESN support yet */
+		cipher_xform->aead.aad_length = esn ? CRYPTO_ESN_AAD_LEN : 8;
 		cipher_xform->aead.iv.offset = CRYPTO_OP_IV_OFFSET;
 		cipher_xform->aead.iv.length =
 			session->iv_len + session->nonce_len;
@@ -568,12 +586,13 @@ crypto_rte_setup_xform_chain(struct crypto_session *session,
 }
 
 int crypto_rte_setup_session(struct crypto_session *session,
-			     enum cryptodev_type dev_type, uint8_t rte_cdev_id)
+			     enum cryptodev_type dev_type, uint8_t rte_cdev_id,
+			     bool esn)
 {
 	struct rte_crypto_sym_xform cipher_xform, auth_xform, *xform_chain;
 	int err = 0;
 
-	crypto_rte_setup_xform_chain(session, &cipher_xform, &auth_xform,
+	crypto_rte_setup_xform_chain(session, esn, &cipher_xform, &auth_xform,
 				     &xform_chain);
 
 	session->rte_session =
@@ -632,12 +651,6 @@ int crypto_rte_op_alloc(struct rte_crypto_op *cops[], uint16_t count)
 	return 0;
 }
 
-void crypto_rte_op_free(struct rte_crypto_op *cops[], uint16_t count)
-{
-	for (uint16_t i = 0; i < count; i++)
-		rte_crypto_op_free(cops[i]);
-}
-
 static inline int
 crypto_rte_op_assoc_session(struct rte_crypto_op *cop,
 			    struct crypto_session *session)
@@ -657,46 +670,41 @@ struct crypto_rte_pkt_batch {
 	struct rte_crypto_op *cop_arr[MAX_CRYPTO_PKT_BURST];
 };
 
+static inline struct crypto_pkt_ctx *
+crypto_rte_op_to_ctx(struct rte_crypto_op *cop)
+{
+	return *(rte_crypto_op_ctod_offset(cop, struct crypto_pkt_ctx **,
+					   CRYPTO_OP_CTX_OFFSET));
+}
+
+/*
+ * Hand a batch of ops to the device. The packets of any ops that it
+ * doesn't take are done with, and failed.
+ */
 static inline
-void crypto_rte_process_op_batch(struct crypto_rte_pkt_batch *batch)
+void crypto_rte_enqueue_op_batch(struct crypto_rte_pkt_batch *batch,
+				 struct crypto_pkt_ctx *done[],
+				 uint16_t *done_cnt)
 {
-	uint8_t enqueued = 0, dequeued = 0, tmp_cnt;
-	struct crypto_pkt_ctx *ctx;
+	uint16_t enqueued, i;
 	struct rte_crypto_op *cop;
 
-	while (dequeued < batch->batch_size) {
-		tmp_cnt = rte_cryptodev_enqueue_burst(
-			batch->cdev_id, batch->qid,
-			&batch->cop_arr[enqueued],
-			batch->batch_size - enqueued);
-		enqueued += tmp_cnt;
-
-		tmp_cnt = rte_cryptodev_dequeue_burst(
-			batch->cdev_id, batch->qid,
-			&batch->cop_arr[dequeued],
-			batch->batch_size - dequeued);
-		dequeued += tmp_cnt;
-
-		if (!tmp_cnt)
-			break;
-	}
-
-	if (unlikely(dequeued < batch->batch_size))
-		IPSEC_CNT_INC_BY(CRYPTO_OP_FAILED,
-				 (batch->batch_size - dequeued));
-
-	for (tmp_cnt = 0; tmp_cnt < dequeued; tmp_cnt++) {
-		cop = batch->cop_arr[tmp_cnt];
-		if (likely(cop->status ==
-			   RTE_CRYPTO_OP_STATUS_SUCCESS)) {
-
-			ctx = *(rte_crypto_op_ctod_offset(
-					cop,
-					struct crypto_pkt_ctx **,
-					CRYPTO_OP_CTX_OFFSET));
-			ctx->status = 0;
-		} else
-			IPSEC_CNT_INC(CRYPTO_OP_FAILED);
+	if (!batch->batch_size)
+		return;
+
+	enqueued = rte_cryptodev_enqueue_burst(batch->cdev_id, batch->qid,
+					       batch->cop_arr,
+					       batch->batch_size);
+	crypto_rte_inflight[batch->cdev_id][batch->qid] += enqueued;
+	for (i = 0; i < enqueued; i++)
+		crypto_sa_inflight_add(crypto_rte_op_to_ctx(
+					       batch->cop_arr[i])->sa, 1);
+
+	for (i = enqueued; i < batch->batch_size; i++) {
+		cop = batch->cop_arr[i];
+		IPSEC_CNT_INC(CRYPTO_OP_FAILED);
+		done[(*done_cnt)++] = crypto_rte_op_to_ctx(cop);
+		rte_crypto_op_free(cop);
 	}
 	batch->batch_size = 0;
 }
@@ -756,6 +764,83 @@ crypto_rte_sop_aead_prepare(struct rte_crypto_sym_op *sop,
 		rte_pktmbuf_iova_offset(last_seg, icv_ofs);
 }
 
+/*
+ * With ESN the AAD is not contiguous in the packet, as seq_hi is not
+ * sent, so build it in the crypto op.
+ */
+static inline void
+crypto_rte_esn_aad_prepare(struct rte_crypto_op *cop, const unsigned char *esp,
+			   uint32_t seq_hi)
+{
+	struct rte_crypto_sym_op *sop = cop->sym;
+	uint32_t *aad;
+
+	aad = rte_crypto_op_ctod_offset(cop, uint32_t *,
+					CRYPTO_OP_AAD_OFFSET);
+	aad[0] = ((const uint32_t *)esp)[0];
+	aad[1] = htonl(seq_hi);
+	aad[2] = ((const uint32_t *)esp)[1];
+
+	sop->aead.aad.data = (uint8_t *)aad;
+	sop->aead.aad.phys_addr =
+		rte_crypto_op_ctophys_offset(cop, CRYPTO_OP_AAD_OFFSET);
+}
+
+/*
+ * With ESN the ICV of a cipher+auth SA covers seq_hi after the
+ * payload, which isn't sent. The PMD can only authenticate contiguous
+ * data, so put seq_hi in front of the ICV while the op is in flight,
+ * and crypto_rte_esn_icv_restore() takes it out again.
+ */
+static inline int
+crypto_rte_esn_icv_prepare(struct rte_crypto_sym_op *sop, uint32_t seq_hi,
+			   uint16_t icv_len, bool encrypt)
+{
+	uint8_t *icv = sop->auth.digest.data;
+	uint32_t seq_hi_n = htonl(seq_hi);
+
+	if (!rte_pktmbuf_append(sop->m_src, CRYPTO_ESN_SEQ_HI_LEN))
+		return -ENOSPC;
+
+	/* The received ICV moves up to make room */
+	if (!encrypt)
+		memmove(icv + CRYPTO_ESN_SEQ_HI_LEN, icv, icv_len);
+	memcpy(icv, &seq_hi_n, CRYPTO_ESN_SEQ_HI_LEN);
+
+	sop->auth.data.length += CRYPTO_ESN_SEQ_HI_LEN;
+	sop->auth.digest.data += CRYPTO_ESN_SEQ_HI_LEN;
+	sop->auth.digest.phys_addr += CRYPTO_ESN_SEQ_HI_LEN;
+	return 0;
+}
+
+/*
+ * Take seq_hi back out of a completed packet. A generated ICV moves
+ * down over it; on input the ICV is trimmed after the op, so only the
+ * length matters.
+ */
+static inline void
+crypto_rte_esn_icv_restore(struct rte_mbuf *m, uint16_t icv_len,
+			   bool encrypt)
+{
+	uint8_t *icv;
+
+	if (encrypt) {
+		icv = rte_pktmbuf_mtod_offset(m, uint8_t *,
+					      rte_pktmbuf_pkt_len(m) -
+					      icv_len);
+		memmove(icv - CRYPTO_ESN_SEQ_HI_LEN, icv, icv_len);
+	}
+	rte_pktmbuf_trim(m, CRYPTO_ESN_SEQ_HI_LEN);
+}
+
+static inline bool
+crypto_rte_esn_icv_needed(const struct sadb_sa *sa)
+{
+	return sa->esn &&
+		sa->session->aead_algo != RTE_CRYPTO_AEAD_AES_GCM &&
+		sa->session->cipher_algo != RTE_CRYPTO_CIPHER_NULL;
+}
+
 /*
  * setup crypto op and crypto sym op for ESP inbound packet.
  */
@@ -870,19 +955,27 @@ crypto_rte_outbound_cop_prepare(struct rte_crypto_op *cop,
 	return err;
 }
 
+/*
+ * Hand a burst of packets to the crypto devices of the PMDs processing
+ * them, without waiting for the result. Packets that are done with
+ * straight away, either having failed or having been processed here
+ * because the device can't take them, are moved to the start of the
+ * array and their number returned. The rest complete asynchronously,
+ * and are returned by crypto_rte_dequeue_packets().
+ */
 inline __attribute__((always_inline)) uint16_t
-crypto_rte_xform_packets(struct crypto_pkt_ctx *cctx_arr[], uint16_t count)
+crypto_rte_enqueue_packets(struct crypto_pkt_ctx *cctx_arr[], uint16_t count)
 {
 	int err;
 	struct crypto_session *session;
 	enum crypto_xfrm qid;
-	uint16_t i, text_len, hdr_len;
+	uint16_t i, text_len, hdr_len, done_cnt = 0;
 	struct crypto_rte_pkt_batch pkt_batch;
 	struct crypto_pkt_ctx *cctx, **ctx_ptr;
+	struct crypto_pkt_ctx *done[MAX_CRYPTO_PKT_BURST];
 	bool encrypt;
 	struct rte_crypto_op *cop;
 	struct crypto_pkt_buffer *cpb = cpbdb[dp_lcore_id()];
-	uint16_t bad_idx[count], bad_cnt = 0;
 
 	pkt_batch.cdev_id = 0;
 	pkt_batch.qid = 0;
@@ -890,6 +983,16 @@ crypto_rte_xform_packets(struct crypto_pkt_ctx *cctx_arr[], uint16_t count)
 
 	assert(count <= MAX_CRYPTO_PKT_BURST);
 
+	if (!count)
+		return 0;
+
+	if (unlikely(crypto_rte_op_alloc(cpb->cops, count) < 0)) {
+		IPSEC_CNT_INC_BY(DROPPED_COP_ALLOC_FAILED, count);
+		for (i = 0; i < count; i++)
+			cctx_arr[i]->status = -1;
+		return count;
+	}
+
 	for (i = 0; i < count; i++) {
 		crypto_prefetch_ctx(cctx_arr, count, i);
 
@@ -898,28 +1001,39 @@ crypto_rte_xform_packets(struct crypto_pkt_ctx *cctx_arr[], uint16_t count)
 		cctx = cctx_arr[i];
 		session = cctx->sa->session;
 		encrypt = (cctx->sa->dir == CRYPTO_DIR_OUT);
+		cop = cpb->cops[i];
 
+		/*
+		 * The PMDs used for authenticated ciphers can't take
+		 * chained mbufs, so those go through the openssl chain.
+		 * The openssl contexts belong to the session, so the
+		 * chained mbufs of a sprayed SA are never sprayed.
+		 */
 		if (unlikely(cctx->mbuf->next && session->cipher_init)) {
-			crypto_rte_process_op_batch(&pkt_batch);
+			rte_crypto_op_free(cop);
 			hdr_len = encrypt ? cctx->out_hdr_len : cctx->iphlen;
 			text_len = encrypt ? cctx->plaintext_size :
 				cctx->ciphertext_len;
 			err = esp_generate_chain(cctx->sa, cctx->mbuf,
 						 hdr_len, cctx->esp, cctx->iv,
 						 text_len + cctx->esp_len,
-						 encrypt);
-			if (err)
-				cctx_arr[i]->status = -1;
+						 encrypt, cctx->seq_hi);
+			cctx->status = err ? -1 : 0;
+			done[done_cnt++] = cctx;
 			continue;
 		}
 
-		cop = cpb->cops[i];
+		/*
+		 * Explicitly set status to failure for each packet
+		 * being handed to the PMD. The status will be set to 0
+		 * again after successful processing.
+		 */
+		cctx->status = -1;
 
 		err = crypto_rte_op_assoc_session(cop, session);
 		if (unlikely(err)) {
-			cctx->status = -1;
 			IPSEC_CNT_INC(CRYPTO_OP_ASSOC_FAILED);
-			continue;
+			goto fail;
 		}
 		cop->sym->m_src = cctx->mbuf;
 		if (encrypt) {
@@ -936,19 +1050,21 @@ crypto_rte_xform_packets(struct crypto_pkt_ctx *cctx_arr[], uint16_t count)
 				(char *)cctx->iv, cctx->ciphertext_len);
 			qid = CRYPTO_DECRYPT;
 		}
+		if (likely(!err) && unlikely(cctx->sa->esn)) {
+			if (session->aead_algo == RTE_CRYPTO_AEAD_AES_GCM)
+				crypto_rte_esn_aad_prepare(cop, cctx->esp,
+							   cctx->seq_hi);
+			else if (crypto_rte_esn_icv_needed(cctx->sa))
+				err = crypto_rte_esn_icv_prepare(
+					cop->sym, cctx->seq_hi,
+					crypto_session_digest_len(session),
+					encrypt);
+		}
 		if (unlikely(err)) {
-			cctx->status = -1;
 			IPSEC_CNT_INC(CRYPTO_OP_PREPARE_FAILED);
-			continue;
+			goto fail;
 		}
 
-		/*
-		 * Explicitly set status to failure for each packet
-		 * being handed to the PMD. The status will be set to 0
-		 * again after successful processing. This allows us to handle
-		 * any cases of mismatch between enqueue and dequeue
-		 */
-		cctx->status = -1;
 		ctx_ptr = rte_crypto_op_ctod_offset(cop,
 						    struct crypto_pkt_ctx **,
 						    CRYPTO_OP_CTX_OFFSET);
@@ -956,19 +1072,77 @@ crypto_rte_xform_packets(struct crypto_pkt_ctx *cctx_arr[], uint16_t count)
 
 		crypto_prefetch_ctx_data(cctx_arr, count, i);
 
-		if (pkt_batch.cdev_id != cctx->sa->rte_cdev_id ||
+		if (pkt_batch.cdev_id != cctx->rte_cdev_id ||
 		    pkt_batch.qid != qid) {
-			crypto_rte_process_op_batch(&pkt_batch);
-			pkt_batch.cdev_id = cctx->sa->rte_cdev_id;
+			crypto_rte_enqueue_op_batch(&pkt_batch, done,
+						    &done_cnt);
+			pkt_batch.cdev_id = cctx->rte_cdev_id;
 			pkt_batch.qid = qid;
 		}
 		pkt_batch.cop_arr[pkt_batch.batch_size] = cop;
 		pkt_batch.batch_size++;
+		continue;
+fail:
+		rte_crypto_op_free(cop);
+		done[done_cnt++] = cctx;
 	}
-	crypto_rte_process_op_batch(&pkt_batch);
-	for (i = 0; i < count; i++)
-		if (cctx_arr[i]->status < 0)
-			bad_idx[bad_cnt++] = i;
-	move_bad_mbufs(cctx_arr, count, bad_idx, bad_cnt);
-	return count - bad_cnt;
+	crypto_rte_enqueue_op_batch(&pkt_batch, done, &done_cnt);
+
+	/* The packets in flight are now held by their ops */
+	for (i = 0; i < done_cnt; i++)
+		cctx_arr[i] = done[i];
+	return done_cnt;
+}
+
+/*
+ * Collect the packets whose ops the device has completed, up to max.
+ */
+uint16_t crypto_rte_dequeue_packets(uint8_t cdev_id, uint16_t qid,
+				    struct crypto_pkt_ctx *cctx_arr[],
+				    uint16_t max)
+{
+	struct rte_crypto_op *cops[MAX_CRYPTO_PKT_BURST];
+	struct crypto_pkt_ctx *cctx;
+	struct rte_crypto_op *cop;
+	uint16_t i, count;
+
+	if (!crypto_rte_inflight[cdev_id][qid])
+		return 0;
+
+	count = rte_cryptodev_dequeue_burst(cdev_id, qid, cops,
+					    RTE_MIN(max,
+						    MAX_CRYPTO_PKT_BURST));
+	crypto_rte_inflight[cdev_id][qid] -= count;
+
+	for (i = 0; i < count; i++) {
+		cop = cops[i];
+		cctx = crypto_rte_op_to_ctx(cop);
+		if (likely(cop->status == RTE_CRYPTO_OP_STATUS_SUCCESS))
+			cctx->status = 0;
+		else
+			IPSEC_CNT_INC(CRYPTO_OP_FAILED);
+
+		if (unlikely(cctx->sa->esn) &&
+		    crypto_rte_esn_icv_needed(cctx->sa))
+			crypto_rte_esn_icv_restore(
+				cctx->mbuf,
+				crypto_session_digest_len(cctx->sa->session),
+				qid == CRYPTO_ENCRYPT);
+
+		crypto_sa_inflight_add(cctx->sa, -1);
+		cctx_arr[i] = cctx;
+		rte_crypto_op_free(cop);
+	}
+
+	return count;
+}
+
+uint16_t crypto_rte_inflight_room(uint8_t cdev_id, uint16_t qid)
+{
+	return CRYPTO_RTE_MAX_INFLIGHT - crypto_rte_inflight[cdev_id][qid];
+}
+
+uint16_t crypto_rte_inflight_count(uint8_t cdev_id, uint16_t qid)
+{
+	return crypto_rte_inflight[cdev_id][qid];
 }
@@ -13,6 +13,16 @@
 
 #define BITS_PER_BYTE     8
 
+/*
+ * Queue pairs per device, one for each direction, and their depth.
+ * The ops in flight on a queue pair are kept well below its depth, as
+ * enough to keep the device busy.
+ */
+#define CRYPTO_RTE_QP_MAX		2
+#define CRYPTO_RTE_QP_DEPTH		2048
+#define CRYPTO_RTE_MAX_INFLIGHT		256
+#define CRYPTO_OP_POOL_CACHE		128
+
 struct crypto_session;
 struct sadb_sa;
 struct crypto_pkt_ctx;
@@ -56,16 +66,22 @@ int crypto_rte_destroy_pmd(enum cryptodev_type dev_type, char dev_name[],
 
 int crypto_rte_setup_session(struct crypto_session *session,
 			     enum cryptodev_type dev_type,
-			     uint8_t rte_cdev_id);
+			     uint8_t rte_cdev_id, bool esn);
 
 int crypto_rte_destroy_session(struct crypto_session *session,
 			       uint8_t rte_cdev_id);
 
 int crypto_rte_op_alloc(struct rte_crypto_op *cops[], uint16_t count);
 
-void crypto_rte_op_free(struct rte_crypto_op *cops[], uint16_t count);
+uint16_t crypto_rte_enqueue_packets(struct crypto_pkt_ctx *ctx_arr[],
+				    uint16_t count);
+
+uint16_t crypto_rte_dequeue_packets(uint8_t cdev_id, uint16_t qid,
+				    struct crypto_pkt_ctx *ctx_arr[],
+				    uint16_t max);
+
+uint16_t crypto_rte_inflight_room(uint8_t cdev_id, uint16_t qid);
 
-uint16_t crypto_rte_xform_packets(struct crypto_pkt_ctx *ctx_arr[],
-				  uint16_t count);
+uint16_t crypto_rte_inflight_count(uint8_t cdev_id, uint16_t qid);
 
 #endif
@@ -19,6 +19,7 @@
 #include <sys/queue.h>
 #include <sys/socket.h>
 #include <urcu/list.h>
+#include <urcu/uatomic.h>
 
 #include "compiler.h"
 #include "crypto.h"
@@ -761,7 +762,7 @@ crypto_session_set_direction(struct sadb_sa *sa, int direction,
 		}
 
 		err = crypto_rte_setup_session(ctx, dev_type,
-					       sa->rte_cdev_id);
+					       sa->rte_cdev_id, sa->esn);
 		if (err) {
 			SADB_ERR("Failed to set up rte session for SA\n");
 			crypto_openssl_session_teardown(ctx);
@@ -783,6 +784,7 @@ void crypto_sadb_new_sa(const struct xfrm_usersa_info *sa_info,
 			const struct xfrm_algo *crypto_algo,
 			const struct xfrm_algo_auth *auth_algo,
 			const struct xfrm_encap_tmpl *tmpl,
+			const struct xfrm_replay_state_esn *replay_esn,
 			uint32_t mark_val, uint32_t extra_flags,
 			vrfid_t vrf_id)
 {
@@ -842,7 +844,7 @@ void crypto_sadb_new_sa(const struct xfrm_usersa_info *sa_info,
 	CDS_INIT_LIST_HEAD(&sa->peer_links);
 
 	if (cipher_setup_ctx(crypto_algo, auth_algo, sa_info, tmpl,
-			     sa, extra_flags))
+			     replay_esn, sa, extra_flags))
 		sa->blocked = true;
 	/*
 	 * Need to allocate the crypto_pmd before inserting the sa as
@@ -872,6 +874,7 @@ void crypto_sadb_new_sa(const struct xfrm_usersa_info *sa_info,
 		pmd_dev_id = CRYPTO_PMD_INVALID_ID;
 
 	sa->del_pmd_dev_id = sa->pmd_dev_id = pmd_dev_id;
+	sa->spray = crypto_pmd_is_spraying(pmd_dev_id);
 
 	if (pmd_dev_id != CRYPTO_PMD_INVALID_ID) {
 		err = crypto_session_set_direction(sa,
@@ -915,13 +918,29 @@ void crypto_sadb_new_sa(const struct xfrm_usersa_info *sa_info,
  * sadb_sa_rcu_free()
  *
  * RCU callback to free an SA that has been removed
- * from a peer's list.
+ * from a peer's list. Packets submitted before the SA
+ * was removed may still be on a crypto device, in which
+ * case wait for another grace period before destroying
+ * the crypto session they use.
  */
 static void sadb_sa_rcu_free(struct rcu_head *head)
 {
 	struct sadb_sa *sa;
+	bool inflight;
 
 	sa = caa_container_of(head, struct sadb_sa, sa_rcu);
+	inflight = uatomic_read(&sa->inflight);
+	if (sa->del_pmd) {
+		if (!crypto_pmd_destroy_session(sa->del_pmd, sa->session,
+						inflight)) {
+			call_rcu(&sa->sa_rcu, sadb_sa_rcu_free);
+			return;
+		}
+		sa->del_pmd = NULL;
+	} else if (inflight) {
+		call_rcu(&sa->sa_rcu, sadb_sa_rcu_free);
+		return;
+	}
 	sadb_sa_destroy(sa);
 }
 
@@ -988,10 +1007,9 @@ static void crypto_sadb_del_sa_internal(const xfrm_address_t *dst,
 	if (resurrect_old_sa && !sa->pending_del)
 		crypto_sadb_resurrect_sa(sa, vrf_ctx->vrfid, sa->reqid);
 
-	crypto_remove_sa_from_pmd(sa->del_pmd_dev_id,
-				  crypto_sa_to_xfrm(sa),
-				  sa->session,
-				  sa->pending_del);
+	sa->del_pmd = crypto_remove_sa_from_pmd(sa->del_pmd_dev_id,
+						crypto_sa_to_xfrm(sa),
+						sa->pending_del);
 	crypto_sa_free_fwd_core(sa->fwd_core);
 	call_rcu(&sa->sa_rcu, sadb_sa_rcu_free);
 	vrf_ctx->count_of_sas--;
@@ -1145,6 +1163,28 @@ static const char *xfrm_addr_to_str(uint16_t family,
 	return addrstr ?: "[bad address]";
 }
 
+/*
+ * For an inbound SA the sequence number is the right hand edge of the
+ * replay window, and the bitmap is that of the block containing it.
+ */
+static void crypto_sadb_show_seq(json_writer_t *wr, const struct sadb_sa *sa)
+{
+	const struct esp_replay *replay = sa->replay;
+	uint64_t seq = CMM_LOAD_SHARED(sa->seq);
+	uint32_t bitmap = 0;
+
+	if (replay) {
+		seq = replay->top;
+		bitmap = replay->slots[(seq >> 5) & replay->slot_mask];
+	}
+
+	jsonw_uint_field(wr, "replay_bitmap", bitmap);
+	jsonw_uint_field(wr, "seq", (uint32_t)seq);
+	jsonw_bool_field(wr, "esn", sa->esn);
+	if (sa->esn)
+		jsonw_uint_field(wr, "seq_hi", seq >> 32);
+}
+
 #define SPI_LEN_IN_HEXCHARS (8+1) /* 32 bit SPI */
 
 void crypto_sadb_show_summary(FILE *f, vrfid_t vrfid)
@@ -1200,9 +1240,7 @@ void crypto_sadb_show_summary(FILE *f, vrfid_t vrfid)
 			crypto_engine_summary(wr, sa);
 			jsonw_uint_field(wr, "replay_window",
 					 sa->replay_window);
-			jsonw_uint_field(wr, "replay_bitmap",
-					 sa->replay_bitmap);
-			jsonw_uint_field(wr, "seq", sa->seq);
+			crypto_sadb_show_seq(wr, sa);
 			jsonw_uint_field(wr, "af", sa->family);
 			jsonw_string_field(wr, "dst",
 					   xfrm_addr_to_str(sa->family,
@@ -1300,8 +1338,13 @@ void crypto_sadb_show_spi_mapping(FILE *f, vrfid_t vrfid)
 void crypto_sadb_increment_counters(struct sadb_sa *sa, uint32_t bytes,
 				    uint32_t packets)
 {
-	sa->packet_count += packets;
-	sa->byte_count   += bytes;
+	if (unlikely(sa->spray)) {
+		uatomic_add(&sa->packet_count, packets);
+		uatomic_add(&sa->byte_count, bytes);
+	} else {
+		sa->packet_count += packets;
+		sa->byte_count   += bytes;
+	}
 
 	if ((sa->packet_count > sa->packet_limit) ||
 	    (sa->byte_count > sa->byte_limit)) {
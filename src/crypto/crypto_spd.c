@@ -0,0 +1,580 @@
+/*-
+ * Copyright (c) 2020, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <rte_acl.h>
+#include <rte_common.h>
+#include <rte_mbuf.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crypto/crypto_internal.h"
+#include "crypto/crypto_spd.h"
+#include "ip_funcs.h"
+#include "netinet6/ip6_funcs.h"
+#include "urcu.h"
+#include "vplane_debug.h"
+
+#define SPD_AF_IPV4	0
+#define SPD_AF_IPV6	1
+#define SPD_AF_MAX	2
+
+#define SPD_DIR_MAX	(XFRM_POLICY_OUT + 1)
+
+/* Max packets passed to rte_acl_classify in one call */
+#define CRYPTO_SPD_BURST	32
+
+/*
+ * The classify input is a key built from the headers of each packet,
+ * rather than the packet itself, so that IPv4 options and non-port
+ * protocols need no special rules.  As for any rte_acl input, the key
+ * is in network byte order and the rules in host byte order.
+ */
+struct crypto_spd_key4 {
+	uint8_t		proto;
+	uint8_t		pad[3];
+	uint32_t	src;
+	uint32_t	dst;
+	uint16_t	sport;
+	uint16_t	dport;
+};
+
+struct crypto_spd_key6 {
+	uint8_t		proto;
+	uint8_t		pad[3];
+	uint32_t	src[4];
+	uint32_t	dst[4];
+	uint16_t	sport;
+	uint16_t	dport;
+};
+
+enum {
+	SPD4_PROTO,
+	SPD4_SRC,
+	SPD4_DST,
+	SPD4_SPORT,
+	SPD4_DPORT,
+	SPD4_NUM_FIELDS
+};
+
+/* rte_acl requires the first field to be 1 byte long */
+static const struct rte_acl_field_def spd4_defs[SPD4_NUM_FIELDS] = {
+	[SPD4_PROTO] = {
+		.type = RTE_ACL_FIELD_TYPE_BITMASK,
+		.size = sizeof(uint8_t),
+		.field_index = SPD4_PROTO,
+		.input_index = 0,
+		.offset = offsetof(struct crypto_spd_key4, proto),
+	},
+	[SPD4_SRC] = {
+		.type = RTE_ACL_FIELD_TYPE_MASK,
+		.size = sizeof(uint32_t),
+		.field_index = SPD4_SRC,
+		.input_index = 1,
+		.offset = offsetof(struct crypto_spd_key4, src),
+	},
+	[SPD4_DST] = {
+		.type = RTE_ACL_FIELD_TYPE_MASK,
+		.size = sizeof(uint32_t),
+		.field_index = SPD4_DST,
+		.input_index = 2,
+		.offset = offsetof(struct crypto_spd_key4, dst),
+	},
+	[SPD4_SPORT] = {
+		.type = RTE_ACL_FIELD_TYPE_RANGE,
+		.size = sizeof(uint16_t),
+		.field_index = SPD4_SPORT,
+		.input_index = 3,
+		.offset = offsetof(struct crypto_spd_key4, sport),
+	},
+	[SPD4_DPORT] = {
+		.type = RTE_ACL_FIELD_TYPE_RANGE,
+		.size = sizeof(uint16_t),
+		.field_index = SPD4_DPORT,
+		.input_index = 3,
+		.offset = offsetof(struct crypto_spd_key4, dport),
+	},
+};
+
+enum {
+	SPD6_PROTO,
+	SPD6_SRC0,
+	SPD6_SRC1,
+	SPD6_SRC2,
+	SPD6_SRC3,
+	SPD6_DST0,
+	SPD6_DST1,
+	SPD6_DST2,
+	SPD6_DST3,
+	SPD6_SPORT,
+	SPD6_DPORT,
+	SPD6_NUM_FIELDS
+};
+
+#define SPD6_ADDR_DEF(_field, _word, _idx)				\
+	{								\
+		.type = RTE_ACL_FIELD_TYPE_MASK,			\
+		.size = sizeof(uint32_t),				\
+		.field_index = (_idx),					\
+		.input_index = (_idx),					\
+		.offset = offsetof(struct crypto_spd_key6, _field) +	\
+			(_word) * sizeof(uint32_t),			\
+	}
+
+static const struct rte_acl_field_def spd6_defs[SPD6_NUM_FIELDS] = {
+	[SPD6_PROTO] = {
+		.type = RTE_ACL_FIELD_TYPE_BITMASK,
+		.size = sizeof(uint8_t),
+		.field_index = SPD6_PROTO,
+		.input_index = SPD6_PROTO,
+		.offset = offsetof(struct crypto_spd_key6, proto),
+	},
+	[SPD6_SRC0] = SPD6_ADDR_DEF(src, 0, SPD6_SRC0),
+	[SPD6_SRC1] = SPD6_ADDR_DEF(src, 1, SPD6_SRC1),
+	[SPD6_SRC2] = SPD6_ADDR_DEF(src, 2, SPD6_SRC2),
+	[SPD6_SRC3] = SPD6_ADDR_DEF(src, 3, SPD6_SRC3),
+	[SPD6_DST0] = SPD6_ADDR_DEF(dst, 0, SPD6_DST0),
+	[SPD6_DST1] = SPD6_ADDR_DEF(dst, 1, SPD6_DST1),
+	[SPD6_DST2] = SPD6_ADDR_DEF(dst, 2, SPD6_DST2),
+	[SPD6_DST3] = SPD6_ADDR_DEF(dst, 3, SPD6_DST3),
+	[SPD6_SPORT] = {
+		.type = RTE_ACL_FIELD_TYPE_RANGE,
+		.size = sizeof(uint16_t),
+		.field_index = SPD6_SPORT,
+		.input_index = SPD6_SPORT,
+		.offset = offsetof(struct crypto_spd_key6, sport),
+	},
+	[SPD6_DPORT] = {
+		.type = RTE_ACL_FIELD_TYPE_RANGE,
+		.size = sizeof(uint16_t),
+		.field_index = SPD6_DPORT,
+		.input_index = SPD6_SPORT,
+		.offset = offsetof(struct crypto_spd_key6, dport),
+	},
+};
+
+RTE_ACL_RULE_DEF(crypto_spd_rule4, SPD4_NUM_FIELDS);
+RTE_ACL_RULE_DEF(crypto_spd_rule6, SPD6_NUM_FIELDS);
+
+/* A policy added since the SPD was created */
+struct crypto_spd_policy {
+	struct xfrm_selector	sel;
+	uint32_t		rule_index;
+	uint32_t		tag;
+	int			dir;
+};
+
+struct crypto_spd {
+	struct rte_acl_ctx	*acl[SPD_DIR_MAX][SPD_AF_MAX];
+	vrfid_t			vrfid;
+	uint32_t		num_pending;
+	uint32_t		max_pending;
+	struct crypto_spd_policy *pending;
+	struct rcu_head		rcu;
+};
+
+struct crypto_spd *crypto_spd_create(vrfid_t vrfid)
+{
+	struct crypto_spd *spd;
+
+	spd = calloc(1, sizeof(*spd));
+	if (!spd)
+		return NULL;
+
+	spd->vrfid = vrfid;
+	return spd;
+}
+
+int crypto_spd_add_policy(struct crypto_spd *spd, int dir,
+			  const struct xfrm_selector *sel,
+			  uint32_t rule_index, uint32_t tag)
+{
+	struct crypto_spd_policy *p;
+
+	if (dir != XFRM_POLICY_IN && dir != XFRM_POLICY_OUT)
+		return -EINVAL;
+
+	if (sel->family != AF_INET && sel->family != AF_INET6)
+		return -EAFNOSUPPORT;
+
+	if (spd->num_pending == spd->max_pending) {
+		uint32_t max = spd->max_pending ? spd->max_pending * 2 : 64;
+
+		p = realloc(spd->pending, max * sizeof(*p));
+		if (!p)
+			return -ENOMEM;
+		spd->pending = p;
+		spd->max_pending = max;
+	}
+
+	p = &spd->pending[spd->num_pending++];
+	p->sel = *sel;
+	p->rule_index = rule_index;
+	p->tag = tag;
+	p->dir = dir;
+
+	return 0;
+}
+
+static uint32_t crypto_spd_prefix_mask(uint8_t plen)
+{
+	return plen ? ~0u << (32 - plen) : 0;
+}
+
+static void crypto_spd_rule_ports(const struct xfrm_selector *sel,
+				  struct rte_acl_field *sport,
+				  struct rte_acl_field *dport)
+{
+	/* As for the NPF rule, a port is either any or exact */
+	sport->value.u16 = sel->sport ? ntohs(sel->sport) : 0;
+	sport->mask_range.u16 = sel->sport ? ntohs(sel->sport) : UINT16_MAX;
+	dport->value.u16 = sel->dport ? ntohs(sel->dport) : 0;
+	dport->mask_range.u16 = sel->dport ? ntohs(sel->dport) : UINT16_MAX;
+}
+
+static void crypto_spd_rule4(const struct crypto_spd_policy *p,
+			     int32_t priority, struct crypto_spd_rule4 *r)
+{
+	const struct xfrm_selector *sel = &p->sel;
+	uint8_t plen_s = RTE_MIN(sel->prefixlen_s, 32);
+	uint8_t plen_d = RTE_MIN(sel->prefixlen_d, 32);
+
+	memset(r, 0, sizeof(*r));
+	r->data.category_mask = 1;
+	r->data.priority = priority;
+	r->data.userdata = p->tag;
+
+	r->field[SPD4_PROTO].value.u8 = sel->proto;
+	r->field[SPD4_PROTO].mask_range.u8 = sel->proto ? UINT8_MAX : 0;
+
+	r->field[SPD4_SRC].value.u32 =
+		ntohl(sel->saddr.a4) & crypto_spd_prefix_mask(plen_s);
+	r->field[SPD4_SRC].mask_range.u32 = plen_s;
+	r->field[SPD4_DST].value.u32 =
+		ntohl(sel->daddr.a4) & crypto_spd_prefix_mask(plen_d);
+	r->field[SPD4_DST].mask_range.u32 = plen_d;
+
+	crypto_spd_rule_ports(sel, &r->field[SPD4_SPORT],
+			      &r->field[SPD4_DPORT]);
+}
+
+/* Split an IPv6 prefix over the four 32 bit fields of an address */
+static void crypto_spd_rule6_addr(const uint32_t *a6, uint8_t plen,
+				  struct rte_acl_field *field)
+{
+	unsigned int i;
+	uint8_t bits;
+
+	for (i = 0; i < 4; i++) {
+		bits = plen > 32 * i ? RTE_MIN(plen - 32 * i, 32) : 0;
+		field[i].value.u32 =
+			ntohl(a6[i]) & crypto_spd_prefix_mask(bits);
+		field[i].mask_range.u32 = bits;
+	}
+}
+
+static void crypto_spd_rule6(const struct crypto_spd_policy *p,
+			     int32_t priority, struct crypto_spd_rule6 *r)
+{
+	const struct xfrm_selector *sel = &p->sel;
+
+	memset(r, 0, sizeof(*r));
+	r->data.category_mask = 1;
+	r->data.priority = priority;
+	r->data.userdata = p->tag;
+
+	r->field[SPD6_PROTO].value.u8 = sel->proto;
+	r->field[SPD6_PROTO].mask_range.u8 = sel->proto ? UINT8_MAX : 0;
+
+	crypto_spd_rule6_addr(sel->saddr.a6, RTE_MIN(sel->prefixlen_s, 128),
+			      &r->field[SPD6_SRC0]);
+	crypto_spd_rule6_addr(sel->daddr.a6, RTE_MIN(sel->prefixlen_d, 128),
+			      &r->field[SPD6_DST0]);
+
+	crypto_spd_rule_ports(sel, &r->field[SPD6_SPORT],
+			      &r->field[SPD6_DPORT]);
+}
+
+static int crypto_spd_policy_cmp(const void *a, const void *b)
+{
+	const struct crypto_spd_policy *pa = a;
+	const struct crypto_spd_policy *pb = b;
+
+	return (pa->rule_index > pb->rule_index) -
+		(pa->rule_index < pb->rule_index);
+}
+
+/*
+ * Build the context for one direction and address family from the
+ * pending policies, which are sorted by rule index.  rte_acl returns
+ * the matching rule of highest priority, so the priority of each rule
+ * falls with its rank.
+ */
+static int crypto_spd_build_acl(struct crypto_spd *spd, int dir, int af)
+{
+	struct rte_acl_param param = {
+		.socket_id = SOCKET_ID_ANY,
+	};
+	struct rte_acl_config cfg = { 0 };
+	char name[RTE_ACL_NAMESIZE];
+	struct crypto_spd_rule4 r4;
+	struct crypto_spd_rule6 r6;
+	const struct rte_acl_rule *rule;
+	struct rte_acl_ctx *acl;
+	static uint32_t ctx_id;
+	uint32_t i, num = 0;
+	int32_t priority;
+	int err;
+
+	for (i = 0; i < spd->num_pending; i++)
+		if (spd->pending[i].dir == dir &&
+		    (spd->pending[i].sel.family == AF_INET) ==
+		    (af == SPD_AF_IPV4))
+			num++;
+	if (!num)
+		return 0;
+
+	/*
+	 * rte_acl_create returns an existing context of the same name,
+	 * so make each name unique.
+	 */
+	snprintf(name, sizeof(name), "%u-spd-%s%s-%u", ctx_id++,
+		 dir == XFRM_POLICY_OUT ? "out" : "in",
+		 af == SPD_AF_IPV4 ? "4" : "6", spd->vrfid);
+	param.name = name;
+	param.max_rule_num = num;
+	param.rule_size = af == SPD_AF_IPV4 ?
+		RTE_ACL_RULE_SZ(SPD4_NUM_FIELDS) :
+		RTE_ACL_RULE_SZ(SPD6_NUM_FIELDS);
+
+	acl = rte_acl_create(&param);
+	if (!acl) {
+		CRYPTO_ERR("Could not allocate SPD context %s\n", name);
+		return -ENOMEM;
+	}
+
+	priority = RTE_ACL_MAX_PRIORITY;
+	for (i = 0; i < spd->num_pending; i++) {
+		const struct crypto_spd_policy *p = &spd->pending[i];
+
+		if (p->dir != dir ||
+		    (p->sel.family == AF_INET) != (af == SPD_AF_IPV4))
+			continue;
+
+		if (af == SPD_AF_IPV4) {
+			crypto_spd_rule4(p, priority--, &r4);
+			rule = (const struct rte_acl_rule *)&r4;
+		} else {
+			crypto_spd_rule6(p, priority--, &r6);
+			rule = (const struct rte_acl_rule *)&r6;
+		}
+
+		err = rte_acl_add_rules(acl, rule, 1);
+		if (err) {
+			CRYPTO_ERR("Could not add SPD rule %u to %s: %d\n",
+				   p->rule_index, name, err);
+			goto error;
+		}
+	}
+
+	cfg.num_categories = 1;
+	if (af == SPD_AF_IPV4) {
+		cfg.num_fields = RTE_DIM(spd4_defs);
+		memcpy(cfg.defs, spd4_defs, sizeof(spd4_defs));
+	} else {
+		cfg.num_fields = RTE_DIM(spd6_defs);
+		memcpy(cfg.defs, spd6_defs, sizeof(spd6_defs));
+	}
+
+	err = rte_acl_build(acl, &cfg);
+	if (err) {
+		CRYPTO_ERR("Could not build SPD context %s: %s\n",
+			   name, strerror(-err));
+		goto error;
+	}
+
+	spd->acl[dir][af] = acl;
+	return 0;
+
+error:
+	rte_acl_free(acl);
+	return err;
+}
+
+int crypto_spd_build(struct crypto_spd *spd)
+{
+	int dir, af, err;
+
+	qsort(spd->pending, spd->num_pending, sizeof(*spd->pending),
+	      crypto_spd_policy_cmp);
+
+	for (dir = 0; dir < SPD_DIR_MAX; dir++)
+		for (af = 0; af < SPD_AF_MAX; af++) {
+			err = crypto_spd_build_acl(spd, dir, af);
+			if (err)
+				return err;
+		}
+
+	free(spd->pending);
+	spd->pending = NULL;
+	spd->num_pending = 0;
+	spd->max_pending = 0;
+
+	return 0;
+}
+
+void crypto_spd_free(struct crypto_spd *spd)
+{
+	int dir, af;
+
+	if (!spd)
+		return;
+
+	for (dir = 0; dir < SPD_DIR_MAX; dir++)
+		for (af = 0; af < SPD_AF_MAX; af++)
+			rte_acl_free(spd->acl[dir][af]);
+	free(spd->pending);
+	free(spd);
+}
+
+static void crypto_spd_rcu_free(struct rcu_head *head)
+{
+	crypto_spd_free(caa_container_of(head, struct crypto_spd, rcu));
+}
+
+void crypto_spd_destroy(struct crypto_spd *spd)
+{
+	if (spd)
+		call_rcu(&spd->rcu, crypto_spd_rcu_free);
+}
+
+/*
+ * Key the ports of the protocols an NPF port match applies to.  Other
+ * protocols, and packets too short to hold the ports, key port 0 and
+ * so only match policies without ports.
+ */
+static inline void
+crypto_spd_parse_l4(const struct rte_mbuf *m, uint8_t proto,
+		    const void *l4, uint16_t *sport, uint16_t *dport)
+{
+	const char *end = rte_pktmbuf_mtod(m, const char *) +
+		rte_pktmbuf_data_len(m);
+	const uint16_t *ports = l4;
+
+	switch (proto) {
+	case IPPROTO_TCP:
+	case IPPROTO_UDP:
+	case IPPROTO_UDPLITE:
+	case IPPROTO_SCTP:
+	case IPPROTO_DCCP:
+		if ((const char *)(ports + 2) > end)
+			return;
+		*sport = ports[0];
+		*dport = ports[1];
+		break;
+	default:
+		break;
+	}
+}
+
+static inline void
+crypto_spd_key4(struct rte_mbuf *m, struct crypto_spd_key4 *k)
+{
+	const struct iphdr *ip = iphdr(m);
+
+	memset(k, 0, sizeof(*k));
+	k->proto = ip->protocol;
+	k->src = ip->saddr;
+	k->dst = ip->daddr;
+
+	/*
+	 * NPF doesn't look at the L4 header of any fragment, the first
+	 * included, so nor does the SPD.
+	 */
+	if (!(ip->frag_off & ~htons(IP_DF | IP_RF)))
+		crypto_spd_parse_l4(m, k->proto,
+				    (const char *)ip + (ip->ihl << 2),
+				    &k->sport, &k->dport);
+}
+
+static inline bool
+crypto_spd_key6(struct rte_mbuf *m, struct crypto_spd_key6 *k)
+{
+	const struct ip6_hdr *ip6 = ip6hdr(m);
+
+	switch (ip6->ip6_nxt) {
+	case IPPROTO_HOPOPTS:
+	case IPPROTO_ROUTING:
+	case IPPROTO_FRAGMENT:
+	case IPPROTO_DSTOPTS:
+	case IPPROTO_AH:
+	case IPPROTO_MH:
+		/* Policies match the final protocol, leave it to NPF */
+		return false;
+	default:
+		break;
+	}
+
+	memset(k, 0, sizeof(*k));
+	k->proto = ip6->ip6_nxt;
+	memcpy(k->src, &ip6->ip6_src, sizeof(k->src));
+	memcpy(k->dst, &ip6->ip6_dst, sizeof(k->dst));
+	crypto_spd_parse_l4(m, k->proto, ip6 + 1, &k->sport, &k->dport);
+
+	return true;
+}
+
+void crypto_spd_classify_burst(const struct crypto_spd *spd, int dir,
+			       bool v4, struct rte_mbuf *m[],
+			       uint32_t tag[], unsigned int num)
+{
+	union {
+		struct crypto_spd_key4 k4;
+		struct crypto_spd_key6 k6;
+	} key[CRYPTO_SPD_BURST];
+	const uint8_t *data[CRYPTO_SPD_BURST];
+	uint32_t results[CRYPTO_SPD_BURST];
+	unsigned int idx[CRYPTO_SPD_BURST];
+	const struct rte_acl_ctx *acl;
+	unsigned int i, j, n, done;
+
+	acl = spd->acl[dir][v4 ? SPD_AF_IPV4 : SPD_AF_IPV6];
+
+	for (done = 0; done < num; done += n) {
+		n = RTE_MIN(num - done, (unsigned int)CRYPTO_SPD_BURST);
+
+		for (i = 0, j = 0; i < n; i++) {
+			if (v4)
+				crypto_spd_key4(m[done + i], &key[j].k4);
+			else if (!crypto_spd_key6(m[done + i], &key[j].k6)) {
+				tag[done + i] = CRYPTO_SPD_NOT_CLASSIFIED;
+				continue;
+			}
+			tag[done + i] = 0;
+			data[j] = (const uint8_t *)&key[j];
+			idx[j++] = done + i;
+		}
+
+		/* No policies of this direction and family */
+		if (!acl || !j)
+			continue;
+
+		if (rte_acl_classify(acl, data, results, j, 1)) {
+			for (i = 0; i < j; i++)
+				tag[idx[i]] = CRYPTO_SPD_NOT_CLASSIFIED;
+			continue;
+		}
+
+		for (i = 0; i < j; i++)
+			tag[idx[i]] = results[i];
+	}
+}
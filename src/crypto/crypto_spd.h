@@ -0,0 +1,65 @@
+/*-
+ * Copyright (c) 2020, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#ifndef CRYPTO_SPD_H
+#define CRYPTO_SPD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <linux/xfrm.h>
+
+#include "util.h"
+
+struct rte_mbuf;
+
+/*
+ * Security policy database classifier.
+ *
+ * The policies of a VRF are compiled, per direction and address
+ * family, into an rte_acl context matching the same fields as the NPF
+ * rule built for each policy: protocol, source and destination prefix,
+ * and source and destination port.  The result of a lookup is the tag
+ * of the matching policy with the lowest rule index.
+ *
+ * An SPD is built on the main thread each time the policy config is
+ * committed, and replaces the previous one under RCU.  It is not
+ * modified once built, so any number of forwarding threads may
+ * classify against it.
+ */
+struct crypto_spd;
+
+/* Returned by a lookup for a packet the SPD can't classify */
+#define CRYPTO_SPD_NOT_CLASSIFIED	UINT32_MAX
+
+struct crypto_spd *crypto_spd_create(vrfid_t vrfid);
+
+/*
+ * Add a policy.  'dir' is XFRM_POLICY_IN or XFRM_POLICY_OUT, and of
+ * overlapping policies, the one with the lowest rule index matches.
+ */
+int crypto_spd_add_policy(struct crypto_spd *spd, int dir,
+			  const struct xfrm_selector *sel,
+			  uint32_t rule_index, uint32_t tag);
+
+int crypto_spd_build(struct crypto_spd *spd);
+
+/* Free an SPD that has never been published. */
+void crypto_spd_free(struct crypto_spd *spd);
+
+/* Free an SPD once any readers have finished with it. */
+void crypto_spd_destroy(struct crypto_spd *spd);
+
+/*
+ * Classify a burst of packets of one address family against the
+ * policies of one direction.  tag[i] is set to the tag of the policy
+ * matching m[i], to 0 if none does, or to CRYPTO_SPD_NOT_CLASSIFIED if
+ * the packet must be looked up in the NPF ruleset instead, as for an
+ * IPv6 packet with extension headers.
+ */
+void crypto_spd_classify_burst(const struct crypto_spd *spd, int dir,
+			       bool v4, struct rte_mbuf *m[],
+			       uint32_t tag[], unsigned int num);
+
+#endif /* CRYPTO_SPD_H */
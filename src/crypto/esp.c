@@ -21,6 +21,8 @@
 #include <rte_log.h>
 #include <rte_memcpy.h>
 #include <rte_mbuf.h>
+#include <stdlib.h>
+#include <urcu/uatomic.h>
 
 #include "compiler.h"
 #include "crypto/crypto_sadb.h"
@@ -90,6 +92,19 @@ struct esp_hdr_ctx {
 #define ESP_SEQ_SA_REKEY_THRESHOLD 0xF3333300u
 #define ESP_SEQ_SA_BLOCK_LIMIT       0xFFFFFFFFu
 
+/*
+ * With ESN the limits apply to the high order bits of the sequence
+ * number, and are only hit as the low order bits wrap.
+ */
+static inline uint32_t esp_seq_limit(uint64_t seq, bool esn)
+{
+	if (likely(!esn))
+		return seq;
+	if ((seq >> 32) == ESP_SEQ_SA_BLOCK_LIMIT)
+		return seq;
+	return (uint32_t)seq ? 0 : seq >> 32;
+}
+
 static struct rte_mbuf *buf_tail_free(struct rte_mbuf *m)
 {
 	struct rte_mbuf *p = NULL, *m2 = m;
@@ -207,37 +222,137 @@ uint16_t esp_payload_padded_len(const struct crypto_overhead *overhead,
  *   not have been previously checked and accepted [by
  *   esp_replay_advance]
  *
- * we detect previously received sequence numbers using a bitmask. The
- * MSB of the bitmask corresponds to the stored highest sequence
- * number so far received. Less significant bits correspond to
- * sequence numbers S in the range:
- *
- * highest_received >= S > (highest_received - replay_window_size)
- *
+ * we detect previously received sequence numbers using a ring of
+ * slots, see struct esp_replay. Each slot holds the bitmap for a
+ * block of 32 sequence numbers, tagged with the block it currently
+ * covers, so that the window can be as large as ESP_REPLAY_WINDOW_MAX
+ * without having to shift it as it moves.
+ */
+#define ESP_REPLAY_BLOCK_SHIFT	5
+#define ESP_REPLAY_BLOCK_MASK	((1u << ESP_REPLAY_BLOCK_SHIFT) - 1)
+
+struct esp_replay *esp_replay_create(uint32_t window)
+{
+	struct esp_replay *replay;
+	uint32_t nslots;
+
+	if (window > ESP_REPLAY_WINDOW_MAX)
+		window = ESP_REPLAY_WINDOW_MAX;
+
+	/* A window may straddle one more block than it covers */
+	nslots = rte_align32pow2((window >> ESP_REPLAY_BLOCK_SHIFT) + 2);
+
+	replay = zmalloc_aligned(sizeof(*replay) +
+				 nslots * sizeof(replay->slots[0]));
+	if (!replay)
+		return NULL;
+
+	replay->window = window;
+	replay->slot_mask = nslots - 1;
+
+	return replay;
+}
+
+void esp_replay_destroy(struct esp_replay *replay)
+{
+	free(replay);
+}
+
+static inline uint32_t
+esp_replay_slot(const struct esp_replay *replay, uint64_t seq)
+{
+	return (seq >> ESP_REPLAY_BLOCK_SHIFT) & replay->slot_mask;
+}
+
+static inline uint32_t esp_replay_tag(uint64_t seq)
+{
+	return seq >> ESP_REPLAY_BLOCK_SHIFT;
+}
+
+static inline uint64_t esp_replay_bit(uint64_t seq)
+{
+	return 1ul << (seq & ESP_REPLAY_BLOCK_MASK);
+}
+
+/*
+ * Work out the full sequence number of a packet. Without ESN this is
+ * just the 32 bits in the packet. With ESN the high order 32 bits are
+ * inferred from the right hand edge of the window, as per RFC 4303
+ * Appendix A2.2. Returns 0, which is never a valid sequence number,
+ * for a packet that would be below the start of the sequence space.
+ */
+static uint64_t esp_replay_seq(const struct esp_replay *replay,
+			       uint32_t seq_lo, bool esn)
+{
+	uint32_t window, top_lo, bottom_lo, seq_hi;
+	uint64_t top;
+
+	if (!esn)
+		return seq_lo;
+
+	top = uatomic_read(&replay->top);
+	window = replay->window ? replay->window : 1;
+	top_lo = top;
+	bottom_lo = top_lo - window + 1;
+	seq_hi = top >> 32;
+
+	if (top_lo >= window - 1) {
+		/* The window is within one subspace */
+		if (seq_lo < bottom_lo)
+			seq_hi++;
+	} else {
+		/* The window spans two subspaces */
+		if (seq_lo >= bottom_lo) {
+			if (!seq_hi)
+				return 0;
+			seq_hi--;
+		}
+	}
+
+	return (uint64_t)seq_hi << 32 | seq_lo;
+}
+
+/*
+ * Check a packet before decrypting it. This does not change the window,
+ * as the packet has yet to be authenticated, but returns the high order
+ * bits of its sequence number for the ICV.
  */
-int esp_replay_check(const uint8_t *esp, const struct sadb_sa *sa)
+int esp_replay_check(const uint8_t *esp, const struct sadb_sa *sa,
+		     uint32_t *seq_hi)
 {
-	const uint32_t replay_window = sa->replay_window;
+	const struct esp_replay *replay = sa->replay;
 	const uint32_t pkt_seq = ntohl(*(const uint32_t *)(esp+4));
-	uint32_t delta;
+	uint64_t seq, slot, top = 0;
 	int ret = 0;
 
-	if (unlikely(!pkt_seq)) {
+	*seq_hi = 0;
+	if (!replay)
+		return 0;
+
+	seq = esp_replay_seq(replay, pkt_seq, sa->esn);
+	if (unlikely(!seq)) {
 		ret = -1; /* Invalid seq in packet. Auditable event? */
 		goto err;
 	}
 
-	if (likely(pkt_seq > sa->seq))
+	*seq_hi = seq >> 32;
+
+	if (!replay->window)
 		return 0;
 
-	delta = sa->seq - pkt_seq;
+	top = uatomic_read(&replay->top);
+	if (likely(seq > top))
+		return 0;
 
-	if (delta >= replay_window) {
+	if (top - seq >= replay->window) {
 		ret = -2; /* Wrap or replay. Auditable event? */
 		goto err;
 	}
 
-	if (sa->replay_bitmap & (1U << delta)) {
+	slot = uatomic_read(&replay->slots[esp_replay_slot(replay, seq)]);
+
+	if ((uint32_t)(slot >> 32) == esp_replay_tag(seq) &&
+	    (slot & esp_replay_bit(seq))) {
 		ret = -3; /* Replay. Auditable event? */
 		goto err;
 	}
@@ -247,41 +362,64 @@ int esp_replay_check(const uint8_t *esp, const struct sadb_sa *sa)
 err:
 	if (net_ratelimit())
 		ESP_INFO("Replay check failed for SPI %#x."
-			" (Packet seq: %#x / SA seq: %#x / Replay Bitmap: %#lx)\n",
-			sa->spi, pkt_seq, sa->seq, sa->replay_bitmap);
+			" (Packet seq: %#x / SA seq: %#lx)\n",
+			sa->spi, pkt_seq, top);
 	return ret;
 }
 
 /*
- * The most significant bit in the mask represents the right hand edge
- * of the sliding window. As the window moves, the bitmask is shifted
- * left. If a packet is received with a sequence number more than
- * replay_window ahead of the current right hand edge, then the
- * bitmask is cleared, and a single bit set to indicate that we've
- * started afresh.
+ * Record a packet that has been authenticated, moving the right hand
+ * edge of the window up to it if it is the highest seen. The check is
+ * repeated here as an atomic test and set on the packet's slot, as
+ * another core may have accepted the same sequence number since it
+ * was checked.
+ *
+ * A slot tagged with an older block has dropped out of the window,
+ * and is taken over. One tagged with a newer block means the packet
+ * has dropped out of the window since it was checked.
  */
-void esp_replay_advance(const uint8_t *esp, struct sadb_sa *sa)
+int esp_replay_advance(const uint8_t *esp, struct sadb_sa *sa,
+		       uint32_t seq_hi)
 {
-	const uint32_t replay_window = sa->replay_window;
-	uint32_t delta;
-
-	if (unlikely(!replay_window))
-		return;
+	struct esp_replay *replay = sa->replay;
+	uint64_t seq, top, old, new, bit;
+	uint32_t tag, old_tag;
+	uint64_t *slot;
 
-	const uint32_t pkt_seq = ntohl(*(const uint32_t *)(esp+4));
+	if (unlikely(!replay))
+		return 0;
 
-	if (pkt_seq > sa->seq) {
-		delta = pkt_seq - sa->seq;
-		if (delta < replay_window)
-			sa->replay_bitmap =
-				((sa->replay_bitmap) << delta) | 1;
-		else
-			sa->replay_bitmap = 1;
-		sa->seq = pkt_seq;
-	} else {
-		delta = sa->seq - pkt_seq;
-		sa->replay_bitmap |= (1U << delta);
+	seq = (uint64_t)seq_hi << 32 | ntohl(*(const uint32_t *)(esp+4));
+
+	if (replay->window) {
+		top = uatomic_read(&replay->top);
+		if (seq <= top && top - seq >= replay->window)
+			return -2;
+
+		slot = &replay->slots[esp_replay_slot(replay, seq)];
+		tag = esp_replay_tag(seq);
+		bit = esp_replay_bit(seq);
+		do {
+			old = uatomic_read(slot);
+			old_tag = old >> 32;
+			if (old_tag == tag) {
+				if (old & bit)
+					return -3;
+				new = old | bit;
+			} else if ((int32_t)(old_tag - tag) < 0)
+				new = (uint64_t)tag << 32 | bit;
+			else
+				return -2;
+		} while (uatomic_cmpxchg(slot, old, new) != old);
 	}
+
+	do {
+		top = uatomic_read(&replay->top);
+		if (seq <= top)
+			break;
+	} while (uatomic_cmpxchg(&replay->top, top, seq) != top);
+
+	return 0;
 }
 
 static struct rte_mbuf *esp_get_next_seg(struct rte_mbuf *current,
@@ -313,7 +451,7 @@ static int esp_process_authdata(struct crypto_chain *chain,
 {
 	unsigned int esp_len = 8;
 
-	/* FIXME: the length of the authdata depends on ESN */
+	/* With ESN the high order seq bits are added by esp_process_digest */
 	crypto_chain_add_element(chain, esp, NULL, esp_len, ENG_DIGEST_BLOCK);
 
 	return crypto_chain_walk(chain);
@@ -496,16 +634,27 @@ static int esp_process_text(struct crypto_chain *chain,
 *               or will be compated with (verify).
 * seg_data_left - Amount of data remaining in segment passed
 */
-static int esp_process_digest(struct crypto_chain *chain)
+static int esp_process_digest(struct crypto_chain *chain, bool esn,
+			      uint32_t seq_hi)
 {
 	uint32_t icv_len = crypto_session_digest_len(chain->ctx);
+	uint32_t seq_hi_n = htonl(seq_hi);
 
 	if (!icv_len)
 		return 0;
 
-	/* FIXME: support for ESN missing */
-
 	chain->index = 0;
+
+	/*
+	 * With ESN the high order bits of the sequence number are not
+	 * sent, but are included in the ICV after the payload, RFC 4303
+	 * section 2.2.1.
+	 */
+	if (esn)
+		crypto_chain_add_element(chain, (unsigned char *)&seq_hi_n,
+					 NULL, sizeof(seq_hi_n),
+					 ENG_DIGEST_BLOCK);
+
 	crypto_chain_add_element(chain, chain->slop_buffer, chain->slop_buffer,
 				 icv_len, ENG_DIGEST_FINALISE);
 
@@ -556,7 +705,8 @@ int esp_generate_chain(struct sadb_sa *sa,
 		       unsigned int l3_hdr_len,
 		       unsigned char *esp,
 		       unsigned char *iv,
-		       uint32_t text_total_len, int8_t encrypt)
+		       uint32_t text_total_len, int8_t encrypt,
+		       uint32_t seq_hi)
 {
 	struct crypto_chain chain;
 	unsigned int esp_len = esp_hdr_len(sa);
@@ -613,7 +763,7 @@ int esp_generate_chain(struct sadb_sa *sa,
 		return -1;
 	}
 
-	if (esp_process_digest(&chain) < 0) {
+	if (esp_process_digest(&chain, sa->esn, seq_hi) < 0) {
 		IPSEC_CNT_INC(CRYPTO_DIGEST_OP_FAILED);
 		return -1;
 	}
@@ -787,8 +937,7 @@ esp_input_pre_decrypt(struct crypto_pkt_ctx *ctx_arr[], uint16_t count)
 		esp =  dp_pktmbuf_mtol4(m, unsigned char *);
 		esp += sa->udp_encap;
 
-		if (unlikely(sa->replay_window &&
-			     esp_replay_check(esp, sa) < 0)) {
+		if (unlikely(esp_replay_check(esp, sa, &ctx->seq_hi) < 0)) {
 			crypto_sadb_seq_drop_inc(sa);
 			ctx->status = -1;
 			bad_idx[bad_cnt++] = i;
@@ -873,7 +1022,13 @@ esp_input_post_decrypt(struct crypto_pkt_ctx *ctx_arr[], uint16_t count)
 		m = ctx->mbuf;
 		sa = ctx->sa;
 
-		esp_replay_advance(ctx->esp, sa);
+		if (unlikely(esp_replay_advance(ctx->esp, sa,
+						ctx->seq_hi) < 0)) {
+			crypto_sadb_seq_drop_inc(sa);
+			ctx->status = -1;
+			bad_idx[bad_cnt++] = i;
+			continue;
+		}
 
 		rc = buf_tail_trim(m, ctx->icv_len, rc);
 		rc = buf_tail_read_char(m, &next_hdr, rc);
@@ -972,11 +1127,54 @@ esp_input_post_decrypt(struct crypto_pkt_ctx *ctx_arr[], uint16_t count)
 	return count - bad_cnt;
 }
 
-void esp_input(struct crypto_pkt_ctx *ctx_arr[], uint16_t count)
+/*
+ * Put the packets that failed before being handed to the crypto
+ * device after those it is done with.
+ */
+static inline uint16_t
+esp_submit_done(struct crypto_pkt_ctx *ctx_arr[], uint16_t count,
+		uint16_t good, uint16_t done)
+{
+	uint16_t i;
+
+	for (i = good; i < count; i++)
+		ctx_arr[done++] = ctx_arr[i];
+
+	return done;
+}
+
+/*
+ * Move the packets that failed in the crypto device beyond those that
+ * succeeded, returning the number that succeeded.
+ */
+static inline uint16_t
+esp_failed_split(struct crypto_pkt_ctx *ctx_arr[], uint16_t count)
+{
+	uint16_t i, bad_idx[count], bad_cnt = 0;
+
+	for (i = 0; i < count; i++)
+		if (unlikely(ctx_arr[i]->status < 0))
+			bad_idx[bad_cnt++] = i;
+
+	move_bad_mbufs(ctx_arr, count, bad_idx, bad_cnt);
+
+	return count - bad_cnt;
+}
+
+uint16_t esp_input_submit(struct crypto_pkt_ctx *ctx_arr[], uint16_t count)
 {
-	count = esp_input_pre_decrypt(ctx_arr, count);
+	uint16_t good, done;
+
+	good = esp_input_pre_decrypt(ctx_arr, count);
+
+	done = crypto_rte_enqueue_packets(ctx_arr, good);
+
+	return esp_submit_done(ctx_arr, count, good, done);
+}
 
-	count = crypto_rte_xform_packets(ctx_arr, count);
+void esp_input_complete(struct crypto_pkt_ctx *ctx_arr[], uint16_t count)
+{
+	count = esp_failed_split(ctx_arr, count);
 
 	count = esp_input_post_decrypt(ctx_arr, count);
 }
@@ -1232,6 +1430,8 @@ esp_output_pre_encrypt(struct crypto_pkt_ctx *ctx_arr[],
 	struct sadb_sa *sa;
 	struct rte_mbuf *m;
 	struct esp_hdr_ctx *h;
+	uint32_t seq_limit;
+	uint64_t seq;
 
 	crypto_prefetch_ivs();
 
@@ -1345,8 +1545,28 @@ esp_output_pre_encrypt(struct crypto_pkt_ctx *ctx_arr[],
 		/* Add Spi, sequence and IV */
 		*(uint32_t *)esp_ptr = (sa->spi);
 		esp_ptr += 4;
-		*(uint32_t *)esp_ptr = htonl(++(sa->seq));
+		/*
+		 * A packet stamped by a spraying PMD already has its
+		 * sequence number, taken in stamp order. Otherwise
+		 * when the SA is sprayed other crypto cores are taking
+		 * sequence numbers from it at the same time.
+		 */
+		if (ctx->seq)
+			seq = ctx->seq;
+		else if (likely(!sa->spray))
+			seq = ++sa->seq;
+		else
+			seq = uatomic_add_return(&sa->seq, 1);
+		if (unlikely(!sa->esn && seq > UINT32_MAX)) {
+			/* Lost the race to the block limit */
+			IPSEC_CNT_INC(ESP_SEQ_EXHAUSTED);
+			ctx->status = -1;
+			bad_idx[bad_cnt++] = j;
+			continue;
+		}
+		*(uint32_t *)esp_ptr = htonl((uint32_t)seq);
 		esp_ptr += 4;
+		ctx->seq_hi = seq >> 32;
 
 		/*
 		 * For the first packet on an SA, use the original
@@ -1361,13 +1581,14 @@ esp_output_pre_encrypt(struct crypto_pkt_ctx *ctx_arr[],
 		crypto_get_iv(j, (char *)esp_ptr,
 			      crypto_session_iv_len(sa->session));
 
-		if (unlikely(sa->seq == ESP_SEQ_SA_REKEY_THRESHOLD)) {
+		seq_limit = esp_seq_limit(seq, sa->esn);
+		if (unlikely(seq_limit == ESP_SEQ_SA_REKEY_THRESHOLD)) {
 			crypto_rekey_requests++;
 			crypto_expire_request(sa->spi,
 					      crypto_sadb_get_reqid(sa),
 					      IPPROTO_ESP, 0 /* hard */);
 		}
-		if (unlikely(sa->seq > (ESP_SEQ_SA_BLOCK_LIMIT - 1)))
+		if (unlikely(seq_limit > (ESP_SEQ_SA_BLOCK_LIMIT - 1)))
 			crypto_sadb_mark_as_blocked(sa);
 
 		/* set up output parameters */
@@ -1415,13 +1636,21 @@ esp_output_post_encrypt(struct crypto_pkt_ctx *ctx_arr[], uint16_t count)
 	}
 }
 
-void esp_output(struct crypto_pkt_ctx *ctx_arr[], uint16_t count)
+uint16_t esp_output_submit(struct crypto_pkt_ctx *ctx_arr[], uint16_t count)
 {
 	struct esp_hdr_ctx h[count];
+	uint16_t good, done;
+
+	good = esp_output_pre_encrypt(ctx_arr, h, count);
 
-	count = esp_output_pre_encrypt(ctx_arr, h, count);
+	done = crypto_rte_enqueue_packets(ctx_arr, good);
 
-	count = crypto_rte_xform_packets(ctx_arr, count);
+	return esp_submit_done(ctx_arr, count, good, done);
+}
+
+void esp_output_complete(struct crypto_pkt_ctx *ctx_arr[], uint16_t count)
+{
+	count = esp_failed_split(ctx_arr, count);
 
 	esp_output_post_encrypt(ctx_arr, count);
 }
@@ -1,5 +1,5 @@
 /*-
- * Copyright (c) 2017-2019, AT&T Intellectual Property.  All rights reserved.
+ * Copyright (c) 2017-2020, AT&T Intellectual Property.  All rights reserved.
  * Copyright (c) 2015-2016 by Brocade Communications Systems, Inc.
  * All rights reserved.
  *
@@ -22,9 +22,19 @@ struct rte_mbuf;
 struct sadb_sa;
 struct udphdr;
 
-void esp_input(struct crypto_pkt_ctx *ctx_arr[], uint16_t count);
+/*
+ * ESP processing is split around the crypto device. Submit prepares a
+ * burst and hands it to the device, returning the number of packets
+ * already done with, which are moved to the start of the array. Those
+ * and the packets later returned by the device are passed to complete.
+ */
+uint16_t esp_input_submit(struct crypto_pkt_ctx *ctx_arr[], uint16_t count);
+
+void esp_input_complete(struct crypto_pkt_ctx *ctx_arr[], uint16_t count);
 
-void esp_output(struct crypto_pkt_ctx *ctx_arr[], uint16_t count);
+uint16_t esp_output_submit(struct crypto_pkt_ctx *ctx_arr[], uint16_t count);
+
+void esp_output_complete(struct crypto_pkt_ctx *ctx_arr[], uint16_t count);
 
 /*
  * RFC 4303 requires the pad length and next header fields to be right aligned
@@ -39,8 +49,34 @@ void esp_output(struct crypto_pkt_ctx *ctx_arr[], uint16_t count);
 uint16_t esp_payload_padded_len(const struct crypto_overhead *overhead,
 				uint16_t tot_len);
 
-int esp_replay_check(const uint8_t *esp, const struct sadb_sa *sa);
-void esp_replay_advance(const uint8_t *esp, struct sadb_sa *sa);
+/*
+ * Anti-replay window of an inbound SA.
+ *
+ * The window is kept in a ring of 64-bit slots, each covering a block
+ * of 32 sequence numbers. The upper half of a slot is a tag, the low
+ * 32 bits of the number of the block the slot last covered, and the
+ * lower half the bitmap of the sequence numbers received in it. A slot
+ * tagged with an older block is stale, so moving the window is just a
+ * matter of raising top, and every update is a single compare and swap
+ * on one slot. This lets the SA be processed on several cores without
+ * a lock.
+ */
+#define ESP_REPLAY_WINDOW_MAX 4096
+
+struct esp_replay {
+	uint64_t top;		/* highest sequence number accepted */
+	uint32_t window;	/* in packets */
+	uint32_t slot_mask;	/* number of slots - 1 */
+	uint64_t slots[];
+};
+
+struct esp_replay *esp_replay_create(uint32_t window);
+void esp_replay_destroy(struct esp_replay *replay);
+
+int esp_replay_check(const uint8_t *esp, const struct sadb_sa *sa,
+		     uint32_t *seq_hi);
+int esp_replay_advance(const uint8_t *esp, struct sadb_sa *sa,
+		       uint32_t seq_hi);
 
 /*
  * Returns true if packet requires crypto processing, false otherwise
@@ -53,6 +89,6 @@ bool udp_esp_dp_interesting(const struct udphdr *udp, uint32_t *spi);
 int esp_generate_chain(struct sadb_sa *sa, struct rte_mbuf *mbuf,
 		       unsigned int l3_hdr_len, unsigned char *esp,
 		       unsigned char *iv, uint32_t text_total_len,
-		       int8_t encrypt);
+		       int8_t encrypt, uint32_t seq_hi);
 
 #endif /* ESP_H */
@@ -33,6 +33,8 @@ ether_input(struct ifnet *ifp, struct rte_mbuf *m)
 	pkt.nxt.v6 = NULL;
 	pkt.in_ifp = ifp;
 	pkt.max_data_used = 0;
+	pkt.nxt_looked_up = 0;
+	pkt.acl_in_looked_up = 0;
 	pipeline_fused_ether_in(&pkt);
 }
 
@@ -51,9 +53,67 @@ ether_input_no_dyn_feats(struct ifnet *ifp, struct rte_mbuf *m)
 	pkt.nxt.v6 = NULL;
 	pkt.in_ifp = ifp;
 	pkt.max_data_used = 0;
+	pkt.nxt_looked_up = 0;
+	pkt.acl_in_looked_up = 0;
 	pipeline_fused_no_dyn_feats_ether_in(&pkt);
 }
 
+static ALWAYS_INLINE void
+ether_input_burst_common(struct ifnet *ifp, struct rte_mbuf *pkts[],
+			 uint16_t nb, bool dyn_feats)
+{
+	struct pl_packet pl_pkts[PL_BURST_MAX];
+	struct pl_packet *pl_pkt_ptrs[PL_BURST_MAX];
+	unsigned int i, n;
+
+	while (nb) {
+		n = RTE_MIN(nb, PL_BURST_MAX);
+		for (i = 0; i < n; i++) {
+			pl_pkts[i].mbuf = pkts[i];
+			/* Init to null, to aid compiler optimisation*/
+			pl_pkts[i].nxt.v6 = NULL;
+			pl_pkts[i].in_ifp = ifp;
+			pl_pkts[i].max_data_used = 0;
+			pl_pkts[i].nxt_looked_up = 0;
+			pl_pkts[i].acl_in_looked_up = 0;
+			pl_pkt_ptrs[i] = &pl_pkts[i];
+		}
+		if (dyn_feats)
+			pipeline_fused_ether_in_burst(pl_pkt_ptrs, n);
+		else
+			pipeline_fused_no_dyn_feats_ether_in_burst(pl_pkt_ptrs,
+								   n);
+		pkts += n;
+		nb -= n;
+	}
+}
+
+/*
+ * Ether switching input for a burst of packets received on the
+ * same interface. The graph is walked a node at a time for the
+ * whole burst.
+ *
+ * Always consumes the mbufs
+ */
+__attribute__((noinline)) void
+ether_input_burst(struct ifnet *ifp, struct rte_mbuf *pkts[], uint16_t nb)
+{
+	ether_input_burst_common(ifp, pkts, nb, true);
+}
+
+/*
+ * Ether switching burst input without support for dynamic pipeline
+ * features
+ *
+ * Always consumes the mbufs
+ */
+__attribute__((noinline)) void
+ether_input_burst_no_dyn_feats(struct ifnet *ifp, struct rte_mbuf *pkts[],
+			       uint16_t nb)
+{
+	ether_input_burst_common(ifp, pkts, nb, false);
+}
+
 int ether_if_set_l2_address(struct ifnet *ifp, uint32_t l2_addr_len,
 			    void *l2_addr)
 {
@@ -40,6 +40,12 @@ void ether_input(struct ifnet *ifp, struct rte_mbuf *m)
 	__hot_func __rte_cache_aligned;
 void ether_input_no_dyn_feats(struct ifnet *ifp, struct rte_mbuf *m)
 	__hot_func __rte_cache_aligned;
+void ether_input_burst(struct ifnet *ifp, struct rte_mbuf *pkts[],
+		       uint16_t nb)
+	__hot_func __rte_cache_aligned;
+void ether_input_burst_no_dyn_feats(struct ifnet *ifp,
+				    struct rte_mbuf *pkts[], uint16_t nb)
+	__hot_func __rte_cache_aligned;
 
 static inline struct rte_ether_hdr *ethhdr(struct rte_mbuf *m)
 {
@@ -215,9 +221,12 @@ static inline bool is_link_local_ether_addr(const struct rte_ether_addr *ea)
 }
 
 typedef void (*packet_input_t)(struct ifnet *ifp, struct rte_mbuf *pkt);
+typedef void (*packet_burst_input_t)(struct ifnet *ifp,
+				     struct rte_mbuf *pkts[], uint16_t nb);
 
 void set_packet_input_func(packet_input_t input_fn);
 extern packet_input_t packet_input_func __hot_data;
+extern packet_burst_input_t packet_burst_input_func __hot_data;
 
 int ether_if_set_l2_address(struct ifnet *ifp, uint32_t l2_addr_len,
 			    void *l2_addr);
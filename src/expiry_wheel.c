@@ -0,0 +1,213 @@
+/*-
+ * Copyright (c) 2020, AT&T Intellectual Property.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <urcu/list.h>
+#include <urcu/uatomic.h>
+#include <urcu/wfcqueue.h>
+
+#include "expiry_wheel.h"
+
+/* ew_qstate */
+#define EW_Q_IDLE	0	/* not on the queue */
+#define EW_Q_KICKED	1	/* on the queue, to be expired */
+#define EW_Q_DEAD	2	/* released, on or heading for the queue */
+
+#define EW_LEVEL_MASK	(EW_LEVEL_SLOTS - 1)
+
+void ew_init(struct expiry_wheel *w, uint64_t now,
+	     ew_expire_fn *expire, ew_release_fn *release)
+{
+	unsigned int l, s;
+
+	w->ew_now = now;
+	w->ew_count = 0;
+	w->ew_expire = expire;
+	w->ew_release = release;
+	cds_wfcq_init(&w->ew_qhead, &w->ew_qtail);
+	CDS_INIT_LIST_HEAD(&w->ew_due);
+	for (l = 0; l < EW_LEVELS; l++)
+		for (s = 0; s < EW_LEVEL_SLOTS; s++)
+			CDS_INIT_LIST_HEAD(&w->ew_slots[l][s]);
+}
+
+void ew_entry_init(struct ew_entry *e)
+{
+	CDS_INIT_LIST_HEAD(&e->ew_node);
+	cds_wfcq_node_init(&e->ew_qnode);
+	e->ew_expiry = 0;
+	e->ew_qstate = EW_Q_IDLE;
+}
+
+/*
+ * Add an entry to the slot for its expiry.  An entry at level 'l' has
+ * at least 64^l ticks to go, so its slot is always ahead of the
+ * current slot at that level, and is cascaded to a lower level when
+ * the current slot reaches it.
+ */
+static void ew_insert(struct expiry_wheel *w, struct ew_entry *e)
+{
+	uint64_t expiry = e->ew_expiry;
+	uint64_t delta;
+	unsigned int l;
+
+	w->ew_count++;
+
+	if (expiry <= w->ew_now) {
+		cds_list_add_tail(&e->ew_node, &w->ew_due);
+		return;
+	}
+
+	delta = expiry - w->ew_now;
+	if (delta >= EW_SPAN) {
+		/* Park in the furthest slot, and re-cascade from there */
+		expiry = w->ew_now + EW_SPAN - 1;
+		delta = EW_SPAN - 1;
+	}
+
+	for (l = 0; l < EW_LEVELS - 1; l++)
+		if (delta < (1ul << (EW_LEVEL_BITS * (l + 1))))
+			break;
+
+	cds_list_add_tail(&e->ew_node,
+			  &w->ew_slots[l][(expiry >> (EW_LEVEL_BITS * l)) &
+					  EW_LEVEL_MASK]);
+}
+
+static void ew_unlink(struct expiry_wheel *w, struct ew_entry *e)
+{
+	if (cds_list_empty(&e->ew_node))
+		return;
+	cds_list_del_init(&e->ew_node);
+	w->ew_count--;
+}
+
+void ew_schedule(struct expiry_wheel *w, struct ew_entry *e,
+		 uint64_t expiry)
+{
+	ew_unlink(w, e);
+	e->ew_expiry = expiry;
+	ew_insert(w, e);
+}
+
+void ew_cancel(struct expiry_wheel *w, struct ew_entry *e)
+{
+	ew_unlink(w, e);
+}
+
+static void ew_enqueue(struct expiry_wheel *w, struct ew_entry *e)
+{
+	/* The node is reused, so clear the link left by the last dequeue */
+	cds_wfcq_node_init(&e->ew_qnode);
+	cds_wfcq_enqueue(&w->ew_qhead, &w->ew_qtail, &e->ew_qnode);
+}
+
+void ew_kick(struct expiry_wheel *w, struct ew_entry *e)
+{
+	if (uatomic_cmpxchg(&e->ew_qstate, EW_Q_IDLE, EW_Q_KICKED) ==
+	    EW_Q_IDLE)
+		ew_enqueue(w, e);
+}
+
+void ew_release(struct expiry_wheel *w, struct ew_entry *e)
+{
+	uint32_t old;
+
+	do {
+		old = uatomic_read(&e->ew_qstate);
+		if (old == EW_Q_DEAD)
+			return;
+	} while (uatomic_cmpxchg(&e->ew_qstate, old, EW_Q_DEAD) != old);
+
+	/* If it was kicked, it is already queued */
+	if (old == EW_Q_IDLE)
+		ew_enqueue(w, e);
+}
+
+/* Handle kicked and released entries.  Owner is the only dequeuer. */
+static void ew_drain(struct expiry_wheel *w)
+{
+	struct cds_wfcq_node *node;
+	struct ew_entry *e;
+
+	while ((node = __cds_wfcq_dequeue_blocking(&w->ew_qhead,
+						   &w->ew_qtail))) {
+		e = caa_container_of(node, struct ew_entry, ew_qnode);
+		ew_unlink(w, e);
+
+		if (uatomic_cmpxchg(&e->ew_qstate, EW_Q_KICKED, EW_Q_IDLE) ==
+		    EW_Q_KICKED) {
+			w->ew_count++;
+			cds_list_add_tail(&e->ew_node, &w->ew_due);
+		} else
+			w->ew_release(w, e);
+	}
+}
+
+/* Re-insert every entry of a slot, relative to the current tick */
+static void ew_cascade(struct expiry_wheel *w, struct cds_list_head *slot)
+{
+	struct ew_entry *e, *tmp;
+	struct cds_list_head list;
+
+	CDS_INIT_LIST_HEAD(&list);
+	cds_list_splice(slot, &list);
+	CDS_INIT_LIST_HEAD(slot);
+
+	cds_list_for_each_entry_safe(e, tmp, &list, ew_node) {
+		cds_list_del_init(&e->ew_node);
+		w->ew_count--;
+		ew_insert(w, e);
+	}
+}
+
+static void ew_advance(struct expiry_wheel *w, uint64_t now)
+{
+	unsigned int l, idx;
+
+	while (w->ew_now < now) {
+		if (w->ew_count == 0) {
+			w->ew_now = now;
+			break;
+		}
+
+		w->ew_now++;
+
+		/* Moving into a new slot at level l cascades level l + 1 */
+		for (l = 1; l < EW_LEVELS; l++) {
+			if ((w->ew_now >> (EW_LEVEL_BITS * (l - 1))) &
+			    EW_LEVEL_MASK)
+				break;
+			idx = (w->ew_now >> (EW_LEVEL_BITS * l)) &
+				EW_LEVEL_MASK;
+			ew_cascade(w, &w->ew_slots[l][idx]);
+		}
+
+		ew_cascade(w, &w->ew_slots[0][w->ew_now & EW_LEVEL_MASK]);
+	}
+}
+
+bool ew_run(struct expiry_wheel *w, uint64_t now, unsigned int budget)
+{
+	struct ew_entry *e;
+
+	ew_drain(w);
+	ew_advance(w, now);
+
+	while (budget && !cds_list_empty(&w->ew_due)) {
+		e = cds_list_entry(w->ew_due.next, struct ew_entry, ew_node);
+		cds_list_del_init(&e->ew_node);
+		w->ew_count--;
+		w->ew_expire(w, e, w->ew_now);
+		budget--;
+	}
+
+	/* Pick up anything released by the expire callbacks */
+	ew_drain(w);
+
+	return !cds_list_empty(&w->ew_due);
+}
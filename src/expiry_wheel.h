@@ -0,0 +1,126 @@
+/*-
+ * Copyright (c) 2020, AT&T Intellectual Property.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#ifndef EXPIRY_WHEEL_H
+#define EXPIRY_WHEEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <urcu/list.h>
+#include <urcu/wfcqueue.h>
+
+/*
+ * Hierarchical timing wheel for expiring table entries.
+ *
+ * Rather than periodically walking a whole table to find the entries
+ * due to expire, each entry is scheduled on a wheel at the tick it
+ * next needs to be looked at, and only the entries that are due are
+ * visited.  The unit of a tick is chosen by the user of the wheel,
+ * e.g. seconds of dataplane uptime.
+ *
+ * A wheel is owned by one thread, typically one lcore, which is the
+ * only one that may schedule or cancel entries or run the wheel.
+ * ew_run() does a bounded amount of expiry work per call, so it can be
+ * called from an lcore's main loop or a timer without stalling it.
+ *
+ * Any thread may kick an entry, to have it expired on the next run, or
+ * release it.  An entry that has been released is handed back to its
+ * owner by the release callback, from the owner thread, once it is off
+ * the wheel; only then may it be freed.
+ */
+
+#define EW_LEVEL_BITS	6
+#define EW_LEVEL_SLOTS	(1u << EW_LEVEL_BITS)
+#define EW_LEVELS	4
+
+/* Ticks covered by the wheel, later expiries are re-cascaded */
+#define EW_SPAN		(1ul << (EW_LEVEL_BITS * EW_LEVELS))
+
+struct ew_entry {
+	struct cds_list_head	ew_node;	/* slot or due list */
+	struct cds_wfcq_node	ew_qnode;	/* kick/release queue */
+	uint64_t		ew_expiry;	/* tick to expire at */
+	uint32_t		ew_qstate;
+};
+
+struct expiry_wheel;
+
+/*
+ * Expire callback.  The entry is off the wheel; the callback may
+ * schedule it again or release it.
+ */
+typedef void (ew_expire_fn)(struct expiry_wheel *w, struct ew_entry *e,
+			    uint64_t now);
+
+/* Release callback.  The entry is off the wheel and may be freed. */
+typedef void (ew_release_fn)(struct expiry_wheel *w, struct ew_entry *e);
+
+struct expiry_wheel {
+	uint64_t		ew_now;		/* current tick */
+	uint64_t		ew_count;	/* entries on the wheel */
+	ew_expire_fn		*ew_expire;
+	ew_release_fn		*ew_release;
+	struct cds_wfcq_head	ew_qhead;
+	struct cds_wfcq_tail	ew_qtail;
+	struct cds_list_head	ew_due;		/* expired, not yet run */
+	struct cds_list_head	ew_slots[EW_LEVELS][EW_LEVEL_SLOTS];
+};
+
+/**
+ * Initialise a wheel.
+ *
+ * @param w
+ *   The wheel.
+ * @param now
+ *   The current tick.
+ * @param expire
+ *   Called for each entry as it expires.
+ * @param release
+ *   Called for each released entry once it is off the wheel.
+ */
+void ew_init(struct expiry_wheel *w, uint64_t now,
+	     ew_expire_fn *expire, ew_release_fn *release);
+
+/**
+ * Initialise an entry, before it is first used with any wheel.
+ */
+void ew_entry_init(struct ew_entry *e);
+
+/**
+ * Schedule, or reschedule, an entry to expire at tick 'expiry'.
+ * An expiry at or before the current tick expires on the next run.
+ * Owner thread only.
+ */
+void ew_schedule(struct expiry_wheel *w, struct ew_entry *e,
+		 uint64_t expiry);
+
+/**
+ * Take an entry off the wheel, if it is on it.  Owner thread only.
+ */
+void ew_cancel(struct expiry_wheel *w, struct ew_entry *e);
+
+/**
+ * Have an entry expire on the next run of the wheel.  Any thread.
+ */
+void ew_kick(struct expiry_wheel *w, struct ew_entry *e);
+
+/**
+ * Release an entry.  It will not be expired again, and is passed to
+ * the release callback on the next run of the wheel.  Any thread.
+ */
+void ew_release(struct expiry_wheel *w, struct ew_entry *e);
+
+/**
+ * Advance the wheel to tick 'now', handle kicked and released entries,
+ * and expire up to 'budget' entries.
+ *
+ * @return
+ *   true if there are expired entries still to be run, in which case
+ *   ew_run() should be called again soon.
+ */
+bool ew_run(struct expiry_wheel *w, uint64_t now, unsigned int budget);
+
+#endif /* EXPIRY_WHEEL_H */
@@ -5,6 +5,9 @@
  * SPDX-License-Identifier: LGPL-2.1-only
  */
 #include <inttypes.h>
+#include <netinet/ip_icmp.h>
+#include <netinet/icmp6.h>
+#include <netinet/tcp.h>
 #include <rte_mbuf.h>
 #include <urcu.h>
 #include <urcu/uatomic.h>
@@ -16,6 +19,7 @@
 #include "ip.h"
 #include "vrf_internal.h"
 #include "ip_funcs.h"
+#include "pktmbuf_internal.h"
 #include "../netinet6/ip6_funcs.h"
 
 #define FLOW_CACHE_DEBUG(args...)			\
@@ -34,12 +38,28 @@
 
 #define FLOW_CACHE_HASH_SEED 0xDEAFCAFE
 
+/*
+ * Further key fields for FLOW_CACHE_F_CLASSIFY caches, zero otherwise.
+ * These are the packet fields a classifier rule may match on besides
+ * addresses and protocol.
+ */
+struct flow_cache_cls_key {
+	uint16_t sport;		/* or ICMP type */
+	uint16_t dport;		/* or ICMP code */
+	uint16_t vlan;		/* Tx vlan id and pcp */
+	uint8_t  dscp;
+	uint8_t  ttl;
+	uint8_t  tcp_flags;
+	uint8_t  pad[3];
+};
+
 struct flow_cache_hash_key {
 	enum flow_cache_ftype af;
 	union addr_u src;
 	union addr_u dst;
 	uint32_t proto;
 	vrfid_t vrfid;
+	struct flow_cache_cls_key cls;
 };
 
 struct flow_cache_entry {
@@ -49,6 +69,8 @@ struct flow_cache_entry {
 	void     *rule;
 	uint16_t context;
 	uint32_t last_hit_count;
+	uint32_t gen;			/* cache gen classified at */
+	flow_cache_release_cb release;	/* of the rule, or NULL */
 	struct rcu_head  flow_cache_rcu;
 };
 
@@ -65,10 +87,14 @@ struct flow_cache_af {
 
 struct flow_cache_lcore {
 	struct flow_cache_af cache_af[FLOW_CACHE_MAX];
+	uint32_t gen;			/* cache gen last emptied at */
 };
 
 struct flow_cache {
 	uint32_t max_lcore_entries;
+	uint32_t flags;			/* FLOW_CACHE_F_xxx */
+	flow_cache_release_cb release;	/* or NULL */
+	uint32_t gen;			/* bumped by lazy invalidate */
 
 	/* array of hash tables indexed by dp_lcore_id */
 	struct flow_cache_lcore *cache_lcore;
@@ -78,8 +104,12 @@ struct flow_cache {
 static inline void
 flow_cache_entry_free(struct rcu_head *head)
 {
-	free(caa_container_of(head, struct flow_cache_entry,
-			      flow_cache_rcu));
+	struct flow_cache_entry *cache_entry =
+		caa_container_of(head, struct flow_cache_entry, flow_cache_rcu);
+
+	if (cache_entry->release)
+		cache_entry->release(cache_entry->rule);
+	free(cache_entry);
 }
 
 static inline void
@@ -130,6 +160,10 @@ flow_cache_match(struct cds_lfht_node *node, const void *key)
 	    (cache_entry->key.vrfid != flow_cache_key->vrfid))
 		return 0;
 
+	if (memcmp(&cache_entry->key.cls, &flow_cache_key->cls,
+		   sizeof(flow_cache_key->cls)))
+		return 0;
+
 	return 1;
 }
 
@@ -155,8 +189,10 @@ flow_cache_entry_remove(struct flow_cache_lcore *cache_lcore,
 	if (rte_atomic32_read(&cache_lcore->cache_af[af].cache_cnt) == 0)
 		return;
 
-	cds_lfht_del(cache_lcore->cache_af[af].cache_tbl,
-		     &cache_entry->fl_node);
+	/* The lcore and the ager may both try to remove an entry */
+	if (cds_lfht_del(cache_lcore->cache_af[af].cache_tbl,
+			 &cache_entry->fl_node) != 0)
+		return;
 	flow_cache_entry_destroy(cache_entry);
 	rte_atomic32_dec(&cache_lcore->cache_af[af].cache_cnt);
 }
@@ -181,12 +217,67 @@ flow_cache_insert(struct cds_lfht *tbl, struct flow_cache_entry *cache_entry,
 	return (ret_node != &cache_entry->fl_node) ? -1 : 0;
 }
 
-static inline void
-flow_cache_parse_hdr(struct rte_mbuf *m, enum flow_cache_ftype af,
-		     struct flow_cache_hash_key *h)
+/*
+ * Key the L4 header for a classifier.  Only protocols whose header
+ * directly follows the IP header, and is in the first segment, can be
+ * keyed.
+ */
+static inline int
+flow_cache_parse_l4(const struct rte_mbuf *m, const void *l4,
+		    struct flow_cache_hash_key *h)
+{
+	const char *end = rte_pktmbuf_mtod(m, const char *) +
+		rte_pktmbuf_data_len(m);
+	const uint16_t *ports = l4;
+	const uint8_t *icmp = l4;
+	const struct tcphdr *th = l4;
+
+	switch (h->proto) {
+	case IPPROTO_TCP:
+		if ((const char *)(th + 1) > end)
+			return -EINVAL;
+		h->cls.sport = th->th_sport;
+		h->cls.dport = th->th_dport;
+		h->cls.tcp_flags = th->th_flags;
+		break;
+	case IPPROTO_UDP:
+	case IPPROTO_UDPLITE:
+	case IPPROTO_SCTP:
+	case IPPROTO_DCCP:
+		if ((const char *)(ports + 2) > end)
+			return -EINVAL;
+		h->cls.sport = ports[0];
+		h->cls.dport = ports[1];
+		break;
+	case IPPROTO_ICMP:
+	case IPPROTO_ICMPV6:
+		if ((const char *)(icmp + 2) > end)
+			return -EINVAL;
+		h->cls.sport = icmp[0];
+		h->cls.dport = icmp[1];
+		break;
+	case IPPROTO_HOPOPTS:
+	case IPPROTO_ROUTING:
+	case IPPROTO_FRAGMENT:
+	case IPPROTO_DSTOPTS:
+	case IPPROTO_AH:
+	case IPPROTO_MH:
+		/* The L4 header is further on */
+		return -EINVAL;
+	default:
+		break;
+	}
+	return 0;
+}
+
+static inline int
+flow_cache_parse_hdr(const struct flow_cache *cache, struct rte_mbuf *m,
+		     enum flow_cache_ftype af, struct flow_cache_hash_key *h)
 {
+	bool cls = cache->flags & FLOW_CACHE_F_CLASSIFY;
 	const struct iphdr *ip;
 	const struct ip6_hdr *ip6;
+	const void *l4 = NULL;
 
 	h->af = af;
 	if (af == FLOW_CACHE_IPV4) {
@@ -194,13 +285,33 @@ flow_cache_parse_hdr(struct rte_mbuf *m, enum flow_cache_ftype af,
 		h->dst.ip_v4.s_addr = ip->daddr;
 		h->src.ip_v4.s_addr = ip->saddr;
 		h->proto = ip->protocol;
+		if (cls) {
+			if (ip_is_fragment(ip))
+				return -EINVAL;
+			h->cls.dscp = ip_dscp_get(ip);
+			h->cls.ttl = ip->ttl;
+			l4 = (const char *)ip + (ip->ihl << 2);
+		}
 	} else if (af == FLOW_CACHE_IPV6) {
 		ip6 = ip6hdr(m);
 		memcpy(&h->dst.ip_v6, &ip6->ip6_dst, sizeof(ip6->ip6_dst));
 		memcpy(&h->src.ip_v6, &ip6->ip6_src, sizeof(ip6->ip6_src));
 		h->proto = ip6->ip6_nxt;
+		if (cls) {
+			h->cls.dscp = ip6_dscp_get(ip6);
+			h->cls.ttl = ip6->ip6_hlim;
+			l4 = ip6 + 1;
+		}
 	}
 	h->vrfid = pktmbuf_get_vrf(m);
+
+	if (!cls)
+		return 0;
+
+	h->cls.vlan = pktmbuf_get_txvlanid(m) |
+		(pktmbuf_get_vlan_pcp(m) << 13);
+
+	return flow_cache_parse_l4(m, l4, h);
 }
 
 int flow_cache_lookup(struct flow_cache *cache, struct rte_mbuf *m,
@@ -210,6 +321,7 @@ int flow_cache_lookup(struct flow_cache *cache, struct rte_mbuf *m,
 	struct cds_lfht_iter iter;
 	struct cds_lfht_node *node;
 	struct flow_cache_hash_key h_key = { 0 };
+	struct flow_cache_entry *cache_entry;
 	struct cds_lfht *table;
 	unsigned int lcore = dp_lcore_id();
 	uint32_t hash;
@@ -222,7 +334,8 @@ int flow_cache_lookup(struct flow_cache *cache, struct rte_mbuf *m,
 	if (!table)
 		return -ENOENT;
 
-	flow_cache_parse_hdr(m, ftype, &h_key);
+	if (flow_cache_parse_hdr(cache, m, ftype, &h_key) < 0)
+		return -ENOENT;
 
 	hash = m->hash.rss;
 	if (!hash)
@@ -234,10 +347,21 @@ int flow_cache_lookup(struct flow_cache *cache, struct rte_mbuf *m,
 	if (!node)
 		return -ENOENT;
 
-	*entry =  caa_container_of(node, struct flow_cache_entry,
-				   fl_node);
+	cache_entry = caa_container_of(node, struct flow_cache_entry,
+				       fl_node);
+
+	/*
+	 * Classified against config that has since been lazily
+	 * invalidated, possibly after this lcore last checked.
+	 */
+	if (unlikely(cache_entry->gen != CMM_LOAD_SHARED(cache->gen))) {
+		flow_cache_entry_remove(&cache->cache_lcore[lcore],
+					cache_entry);
+		return -ENOENT;
+	}
 
-	(*entry)->hit_count++;
+	*entry = cache_entry;
+	cache_entry->hit_count++;
 	return 0;
 }
 
@@ -270,21 +394,30 @@ flow_cache_add(struct flow_cache *flow_cache, void *rule, uint16_t ctx,
 	struct flow_cache_entry *cache_entry;
 	int error;
 	struct flow_cache_hash_key h_key = { 0 };
-	struct flow_cache_af *cache_af =
-		&flow_cache->cache_lcore[dp_lcore_id()].cache_af[ftype];
+	struct flow_cache_lcore *cache_lcore =
+		&flow_cache->cache_lcore[dp_lcore_id()];
+	struct flow_cache_af *cache_af = &cache_lcore->cache_af[ftype];
 	struct cds_lfht *table = rcu_dereference(cache_af->cache_tbl);
 
 	if (!table)
 		return -1;
 
-	flow_cache_parse_hdr(m, ftype, &h_key);
+	if (flow_cache_parse_hdr(flow_cache, m, ftype, &h_key) < 0)
+		return -EINVAL;
 	cache_entry = malloc_aligned(sizeof(struct flow_cache_entry));
 	if (unlikely(cache_entry == NULL))
 		return -1;
 
 	cache_entry->key = h_key;
 	cache_entry->rule = rule;
+	cache_entry->release = NULL;
 	cache_entry->hit_count = cache_entry->last_hit_count = 0;
+	/*
+	 * Tag with the gen this lcore last checked, before it read the
+	 * config the rule came from.  If the cache has been invalidated
+	 * since, lookups treat the entry as a miss.
+	 */
+	cache_entry->gen = cache_lcore->gen;
 
 	error = flow_cache_insert(table, cache_entry, m->hash.rss, &h_key);
 
@@ -293,6 +426,8 @@ flow_cache_add(struct flow_cache *flow_cache, void *rule, uint16_t ctx,
 		return -1;
 	}
 	flow_cache_entry_set_info(cache_entry, rule, ctx);
+	/* The entry now owns the rule, to release when it is freed */
+	cache_entry->release = flow_cache->release;
 	rte_atomic32_inc(&cache_af->cache_cnt);
 	return 0;
 }
@@ -373,7 +508,8 @@ flow_cache_teardown_lcore(struct flow_cache *flow_cache, unsigned int lcore)
 	return 0;
 }
 
-struct flow_cache *flow_cache_init(uint32_t max_entries)
+struct flow_cache *flow_cache_init_ext(uint32_t max_entries, uint32_t flags,
+				       flow_cache_release_cb release)
 {
 	struct flow_cache *cache;
 	unsigned int max_lcores = get_lcore_max() + 1;
@@ -385,6 +521,8 @@ struct flow_cache *flow_cache_init(uint32_t max_entries)
 	}
 
 	cache->max_lcore_entries = max_entries;
+	cache->flags = flags;
+	cache->release = release;
 	cache->cache_lcore = calloc(1, (sizeof(struct flow_cache_lcore) *
 					max_lcores));
 	if (!cache->cache_lcore) {
@@ -397,6 +535,25 @@ struct flow_cache *flow_cache_init(uint32_t max_entries)
 	return cache;
 }
 
+struct flow_cache *flow_cache_init(uint32_t max_entries)
+{
+	return flow_cache_init_ext(max_entries, 0, NULL);
+}
+
+void flow_cache_destroy(struct flow_cache *flow_cache)
+{
+	unsigned int lcore_id, max_lcores = get_lcore_max() + 1;
+
+	if (!flow_cache)
+		return;
+
+	for (lcore_id = 0; lcore_id < max_lcores; lcore_id++)
+		flow_cache_teardown_lcore(flow_cache, lcore_id);
+
+	free(flow_cache->cache_lcore);
+	free(flow_cache);
+}
+
 void flow_cache_age(struct flow_cache *flow_cache)
 {
 	unsigned int lcore_id, max_lcores = get_lcore_max() + 1;
@@ -477,6 +634,30 @@ flow_cache_invalidate(struct flow_cache *flow_cache, bool disable,
 			disable && !clear_only ? "disabled" : "invalidated");
 }
 
+void flow_cache_invalidate_lazy(struct flow_cache *flow_cache)
+{
+	/* Config the entries were derived from is published before */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(flow_cache->gen, flow_cache->gen + 1);
+}
+
+void flow_cache_check_lcore(struct flow_cache *flow_cache)
+{
+	unsigned int lcore = dp_lcore_id();
+	struct flow_cache_lcore *cache_lcore = &flow_cache->cache_lcore[lcore];
+	uint32_t gen = CMM_LOAD_SHARED(flow_cache->gen);
+	enum flow_cache_ftype af;
+
+	if (likely(cache_lcore->gen == gen))
+		return;
+
+	/* Read the new config only after seeing the new gen */
+	cmm_smp_rmb();
+	for (af = FLOW_CACHE_IPV4; af < FLOW_CACHE_MAX; af++)
+		flow_cache_empty_table(flow_cache, lcore, af);
+	cache_lcore->gen = gen;
+}
+
 static const char *af_names[FLOW_CACHE_MAX] = {
 	[FLOW_CACHE_IPV4] = "ipv4",
 	[FLOW_CACHE_IPV6] = "ipv6"
@@ -21,6 +21,22 @@ enum flow_cache_ftype {
 	FLOW_CACHE_MAX
 };
 
+/*
+ * Flow cache flags
+ *
+ * FLOW_CACHE_F_CLASSIFY: as well as the addresses and protocol, key
+ * entries on the fields a packet classifier may match on: L4 ports or
+ * ICMP type and code, TCP flags, DSCP, TTL, and the Tx vlan id and pcp.
+ * Fragments, and packets with IPv6 extension headers, are not cached.
+ */
+#define FLOW_CACHE_F_CLASSIFY	0x1
+
+/*
+ * Called, from an RCU callback, with the rule of each entry that is
+ * freed.  Lets a cache own a reference on the rules of its entries.
+ */
+typedef void (*flow_cache_release_cb)(void *rule);
+
 /**
  * Set up flow cache. The flow cache consists of an array of lock-free
  * hash tables indexed by dp_lcore_id. Each hash table contains entries
@@ -35,6 +51,26 @@ enum flow_cache_ftype {
  */
 struct flow_cache *flow_cache_init(uint32_t max_entries);
 
+/**
+ * Set up flow cache, as flow_cache_init() but with flags and a rule
+ * release callback.
+ *
+ * @param max_entries
+ *   Maximum number of entries in cache
+ *
+ * @param flags
+ *   FLOW_CACHE_F_xxx
+ *
+ * @param release
+ *   Called with the rule of each entry when the entry is freed, or NULL
+ *
+ * @return
+ *   The pointer to the flow cache on success
+ *   NULL if allocation fails
+ */
+struct flow_cache *flow_cache_init_ext(uint32_t max_entries, uint32_t flags,
+				       flow_cache_release_cb release);
+
 /**
  * Initialize table specific to the lcore
  * Invoked when lcore is brought up
@@ -75,8 +111,9 @@ int flow_cache_teardown_lcore(struct flow_cache *cache, unsigned int lcore_id);
  * @param ftype
  *   The type of flow to add to the cache.
  * @return
- *   0 on success
- *   -EINVAL if the address family of the packet does not match
+ *   0 on success, after which the entry owns the rule if the cache has
+ *   a release callback
+ *   -EINVAL if the packet cannot be keyed
  *   -ENOMEM if there is a memory allocation failure
  *   -ENOSPC if the cache is full
  */
@@ -168,6 +205,29 @@ int flow_cache_entry_set_info(struct flow_cache_entry *entry, void *rule,
 void flow_cache_invalidate(struct flow_cache *cache, bool disable,
 			   bool clear_only);
 
+/**
+ * Invalidate the whole cache without waiting for the lcores using it.
+ * Each lcore empties its own table the next time it calls
+ * flow_cache_check_lcore(), so this is cheap enough to call for each
+ * of a batch of config changes.
+ *
+ * @param cache
+ *   Address of the flow cache to be invalidated.
+ */
+void flow_cache_invalidate_lazy(struct flow_cache *cache);
+
+/**
+ * Empty the table of the calling lcore if the cache has been lazily
+ * invalidated since the lcore last checked.  Must be called before
+ * the lcore reads the config that the entries it adds are derived
+ * from.  Entries are tagged with the gen of that check, so one added
+ * after a later invalidation is a miss for flow_cache_lookup().
+ *
+ * @param cache
+ *   Address of the flow cache
+ */
+void flow_cache_check_lcore(struct flow_cache *cache);
+
 /**
  * Walk the entire flow cache and age out entries for which
  * hit count has not changed. The aging interval and timer
@@ -204,6 +264,8 @@ void flow_cache_dump(struct flow_cache *cache, json_writer_t *wr,
 /**
  *
  * Destroy flow cache. Free up all entries
+ * Must not be called from an RCU callback, or while the cache can be
+ * looked up.
  *
  * @param cache
  *   Address of the flow cache to be cleaned up
@@ -1834,6 +1834,7 @@ struct incomplete_route {
 	/* keys */
 	struct ip_addr dest;
 	uint32_t label;
+	uint32_t pathgroup;	/* path group id, for a path group */
 	uint32_t table;
 	uint8_t depth;
 	uint8_t scope;
@@ -1997,24 +1998,47 @@ void incomplete_if_del_ignored(uint32_t ifindex)
 
 /*
  * Call this each time a new ifindex arrives to see if there are any
- * routes that can now be made completed.
+ * routes that can now be made completed.  Path groups are replayed
+ * first, as routes may be waiting for them.  Creating a path group
+ * calls back in here, in which case the replay is run again once the
+ * current one is done.
  */
 void incomplete_routes_make_complete(void)
 {
+	static bool running, rerun;
 	struct cds_lfht_iter iter;
 	struct incomplete_route *route;
 
-	incomplete_stats.if_complete++;
-
-	cds_lfht_for_each_entry(incomplete_routes, &iter,
-				route, hash_node) {
-		/* CONT_SRC_UPLINK does not use the rib broker */
-		if (route->protobuf)
-			ip_route_pb_handler(route->data, route->size,
-					    CONT_SRC_MAIN);
-		else
-			notify_route(route->data, CONT_SRC_MAIN);
+	if (running) {
+		rerun = true;
+		return;
 	}
+	running = true;
+
+	do {
+		rerun = false;
+		incomplete_stats.if_complete++;
+
+		cds_lfht_for_each_entry(incomplete_routes, &iter,
+					route, hash_node)
+			if (route->pathgroup)
+				ip_route_pb_handler(route->data, route->size,
+						    CONT_SRC_MAIN);
+
+		cds_lfht_for_each_entry(incomplete_routes, &iter,
+					route, hash_node) {
+			if (route->pathgroup)
+				continue;
+			/* CONT_SRC_UPLINK does not use the rib broker */
+			if (route->protobuf)
+				ip_route_pb_handler(route->data, route->size,
+						    CONT_SRC_MAIN);
+			else
+				notify_route(route->data, CONT_SRC_MAIN);
+		}
+	} while (rerun);
+
+	running = false;
 }
 
 static uint32_t incomplete_route_hash(struct incomplete_route *route)
@@ -2044,12 +2068,36 @@ static inline int incomplete_route_match_fn(struct cds_lfht_node *node,
 		return 0;
 	if (route->label != route_key->label)
 		return 0;
+	if (route->pathgroup != route_key->pathgroup)
+		return 0;
 	if (memcmp(&route->dest, &route_key->dest, sizeof(struct ip_addr)))
 		return 0;
 
 	return 1;
 }
 
+/* Add an entry, replacing any old entry for the same key */
+static void incomplete_route_insert(struct incomplete_route *route)
+{
+	struct cds_lfht_node *ret_node;
+
+	ret_node = cds_lfht_add_replace(incomplete_routes,
+					incomplete_route_hash(route),
+					incomplete_route_match_fn,
+					route,
+					&route->hash_node);
+	if (ret_node == NULL) {
+		/* added, but was no old entry */
+		incomplete_stats.route_add++;
+	} else if (ret_node != &route->hash_node) {
+		/* replaced, so free old one */
+		incomplete_stats.route_update++;
+		route = caa_container_of(ret_node, struct incomplete_route,
+					 hash_node);
+		call_rcu(&route->rcu, incomplete_route_free);
+	}
+}
+
 /*
  * Add an incomplete route. If we already have an entry for that key
  * then update the message to new one.
@@ -2061,7 +2109,6 @@ incomplete_route_add(const void *dst,
 		      bool protobuf)
 {
 	struct incomplete_route *route;
-	struct cds_lfht_node *ret_node;
 
 	route = calloc(1, sizeof(*route));
 	if (!route) {
@@ -2089,22 +2136,7 @@ incomplete_route_add(const void *dst,
 	route->size = size;
 	route->protobuf = protobuf;
 
-	ret_node = cds_lfht_add_replace(incomplete_routes,
-					incomplete_route_hash(route),
-					incomplete_route_match_fn,
-					route,
-					&route->hash_node);
-	if (ret_node == NULL) {
-		/* added, but was no old entry */
-		incomplete_stats.route_add++;
-	} else if (ret_node != &route->hash_node) {
-		/* replaced, so free old one */
-		incomplete_stats.route_update++;
-		route = caa_container_of(ret_node, struct incomplete_route,
-					 hash_node);
-		call_rcu(&route->rcu, incomplete_route_free);
-	}
-
+	incomplete_route_insert(route);
 	return true;
 }
 
@@ -2151,15 +2183,37 @@ void incomplete_route_add_pb(const void *dst,
 		free(data_cpy);
 }
 
+/* Remove the entry for the key, if any */
+static void incomplete_route_remove(struct incomplete_route *key)
+{
+	struct incomplete_route *found;
+	struct cds_lfht_node *node;
+	struct cds_lfht_iter iter;
+
+	cds_lfht_lookup(incomplete_routes,
+			incomplete_route_hash(key),
+			incomplete_route_match_fn,
+			key,
+			&iter);
+
+	node = cds_lfht_iter_get_node(&iter);
+	if (!node) {
+		incomplete_stats.route_del_missing++;
+		return;
+	}
+
+	cds_lfht_del(incomplete_routes, node);
+	found = caa_container_of(node, struct incomplete_route, hash_node);
+	call_rcu(&found->rcu, incomplete_route_free);
+	incomplete_stats.route_del++;
+}
+
 void incomplete_route_del(const void *dst,
 			  uint8_t family, uint8_t depth,
 			  uint32_t table, uint8_t scope,
 			  uint8_t proto)
 {
 	struct incomplete_route route;
-	struct incomplete_route *found;
-	struct cds_lfht_node *node;
-	struct cds_lfht_iter iter;
 
 	memset(&route, 0, sizeof(route));
 
@@ -2180,22 +2234,49 @@ void incomplete_route_del(const void *dst,
 	route.scope = scope;
 	route.proto = proto;
 
-	cds_lfht_lookup(incomplete_routes,
-			incomplete_route_hash(&route),
-			incomplete_route_match_fn,
-			&route,
-			&iter);
+	incomplete_route_remove(&route);
+}
 
-	node = cds_lfht_iter_get_node(&iter);
-	if (!node) {
-		incomplete_stats.route_del_missing++;
+/*
+ * Add a protobuf path group update that has paths with a missing
+ * interface, to be replayed when the interface arrives.
+ */
+void incomplete_pathgroup_add_pb(uint8_t family, uint32_t id,
+				 void *data, size_t size)
+{
+	struct incomplete_route *route;
+
+	route = calloc(1, sizeof(*route));
+	if (!route) {
+		incomplete_stats.mem_fails++;
 		return;
 	}
 
-	cds_lfht_del(incomplete_routes, node);
-	found = caa_container_of(node, struct incomplete_route, hash_node);
-	call_rcu(&found->rcu, incomplete_route_free);
-	incomplete_stats.route_del++;
+	route->data = malloc(size);
+	if (!route->data) {
+		incomplete_stats.mem_fails++;
+		free(route);
+		return;
+	}
+	memcpy(route->data, data, size);
+
+	route->dest.type = family;
+	route->pathgroup = id;
+	route->size = size;
+	route->protobuf = true;
+
+	incomplete_route_insert(route);
+}
+
+void incomplete_pathgroup_del(uint8_t family, uint32_t id)
+{
+	struct incomplete_route route;
+
+	memset(&route, 0, sizeof(route));
+	route.dest.type = family;
+	route.pathgroup = id;
+
+	incomplete_route_remove(&route);
 }
 
 int cmd_incomplete(FILE *f, int argc __unused, char **argv __unused)
@@ -990,6 +990,9 @@ void incomplete_route_add_pb(const void *dst,
 void incomplete_route_del(const void *dst,
 			  uint8_t family, uint8_t depth, uint32_t table,
 			  uint8_t scope, uint8_t proto);
+void incomplete_pathgroup_add_pb(uint8_t family, uint32_t id,
+				 void *data, size_t size);
+void incomplete_pathgroup_del(uint8_t family, uint32_t id);
 void if_set_cont_src(struct ifnet *ifp, enum cont_src_en cont_src);
 bool if_port_is_uplink(portid_t portid);
 bool if_is_control_channel(struct ifnet *ifp);
@@ -6,6 +6,8 @@
  * Route update protobuf handling for IP & MPLS
  */
 
+#include <rte_jhash.h>
+
 #include "if_var.h"
 #include "ip_rt_protobuf.h"
 #include "mpls/mpls_label_table.h"
@@ -27,8 +29,30 @@
 		(a6)->s6_addr32[3] = (a4);		\
 	}
 
+/*
+ * A batch of route updates being applied.  Routes in a batch often
+ * share their paths, e.g. many BGP prefixes via the same peers, so the
+ * nexthops built for a set of paths are kept for the rest of the batch.
+ */
+struct ip_rt_pb_nh_ent {
+	Route		*route;		/* first route with the paths */
+	enum nh_type	nh_type;
+	struct next_hop	*next;		/* NULL if the paths failed */
+	bool		missing_ifp;
+	uint32_t	hash;
+};
+
+struct ip_rt_pb_batch {
+	uint32_t		mask;
+	struct ip_rt_pb_nh_ent	*nh_tbl;
+};
+
+/*
+ * A path whose interface is missing fails unless keep_missing is set,
+ * in which case it is sent to the slowpath until the interface arrives.
+ */
 static bool nexthop_fill_common(struct next_hop *next, Path *path,
-				bool *missing_ifp)
+				bool keep_missing, bool *missing_ifp)
 {
 	struct ifnet *ifp;
 	bool exp_ifp = true;
@@ -62,7 +86,8 @@ static bool nexthop_fill_common(struct next_hop *next, Path *path,
 	nh_set_ifp(next, ifp);
 	if (!ifp && exp_ifp && !is_ignored_interface(path->ifindex)) {
 		*missing_ifp = true;
-		return false;
+		if (!keep_missing)
+			return false;
 	}
 
 	nh_outlabels_set(&next->outlabels, path->n_mpls_labels,
@@ -85,9 +110,10 @@ static bool nexthop_fill_common(struct next_hop *next, Path *path,
 
 /*
  * Returns true on success, false on failure. Failure includes a
- * missing ifp.
+ * missing ifp, unless keep_missing is set.
  */
-static bool nexthop_fill(struct next_hop *next, Path *path, bool *missing_ifp)
+static bool nexthop_fill(struct next_hop *next, Path *path,
+			 bool keep_missing, bool *missing_ifp)
 {
 	if (path->nexthop) {
 		/* Cannot store IPv4 routes with IPv6 nexthops */
@@ -103,7 +129,7 @@ static bool nexthop_fill(struct next_hop *next, Path *path, bool *missing_ifp)
 		next->flags |= RTF_GATEWAY;
 	}
 
-	if (!nexthop_fill_common(next, path, missing_ifp))
+	if (!nexthop_fill_common(next, path, keep_missing, missing_ifp))
 		return false;
 
 	return true;
@@ -111,10 +137,10 @@ static bool nexthop_fill(struct next_hop *next, Path *path, bool *missing_ifp)
 
 /*
  * Returns true on success, false on failure. Failure includes a
- * missing ifp.
+ * missing ifp, unless keep_missing is set.
  */
 static bool nexthop6_fill(struct next_hop *next, Path *path,
-			  bool *missing_ifp)
+			  bool keep_missing, bool *missing_ifp)
 {
 	if (path->nexthop) {
 		if (path->nexthop->address_oneof_case ==
@@ -141,7 +167,7 @@ static bool nexthop6_fill(struct next_hop *next, Path *path,
 		next->flags |= RTF_GATEWAY;
 	}
 
-	if (!nexthop_fill_common(next, path, missing_ifp))
+	if (!nexthop_fill_common(next, path, keep_missing, missing_ifp))
 		return false;
 
 	if (path->backup)
@@ -151,26 +177,28 @@ static bool nexthop6_fill(struct next_hop *next, Path *path,
 }
 
 static struct next_hop *
-nexthop_list_create(Route *route, enum nh_type nh_type, bool *missing_ifp)
+nexthop_paths_create(Path **paths, size_t n_paths, enum nh_type nh_type,
+		     bool keep_missing, bool *missing_ifp)
 {
 	struct next_hop *next, *n;
 	size_t size;
 	Path *path;
 	size_t i;
 
-	n = next = calloc(sizeof(*next), route->n_paths);
+	n = next = calloc(sizeof(*next), n_paths);
 	if (!next)
 		return NULL;
 
-	for (i = 0; i < route->n_paths; i++) {
-		path = route->paths[i];
+	for (i = 0; i < n_paths; i++) {
+		path = paths[i];
 		n = &next[i];
 
 		if (nh_type == NH_TYPE_V4GW) {
-			if (!nexthop_fill(n, path, missing_ifp))
+			if (!nexthop_fill(n, path, keep_missing, missing_ifp))
 				goto fail;
 		} else {
-			if (!nexthop6_fill(n, path, missing_ifp))
+			if (!nexthop6_fill(n, path, keep_missing,
+					   missing_ifp))
 				goto fail;
 		}
 	}
@@ -185,6 +213,137 @@ fail:
 	return NULL;
 }
 
+static struct next_hop *
+nexthop_list_create(Route *route, enum nh_type nh_type, bool *missing_ifp)
+{
+	return nexthop_paths_create(route->paths, route->n_paths, nh_type,
+				    false, missing_ifp);
+}
+
+static uint32_t ip_rt_pb_paths_hash(const Route *route)
+{
+	uint32_t hash = route->n_paths;
+	const Path *path;
+	size_t i;
+
+	for (i = 0; i < route->n_paths; i++) {
+		path = route->paths[i];
+		hash = rte_jhash_3words(path->type, path->ifindex,
+					path->backup, hash);
+		if (path->nexthop) {
+			if (path->nexthop->address_oneof_case ==
+			    IPADDRESS__ADDRESS_ONEOF_IPV4_ADDR)
+				hash = rte_jhash_1word(
+					path->nexthop->ipv4_addr, hash);
+			else
+				hash = rte_jhash(path->nexthop->ipv6_addr.data,
+						 path->nexthop->ipv6_addr.len,
+						 hash);
+		}
+		if (path->n_mpls_labels)
+			hash = rte_jhash_32b(path->mpls_labels,
+					     path->n_mpls_labels, hash);
+	}
+	return hash;
+}
+
+static bool ip_rt_pb_addr_eq(const IPAddress *a, const IPAddress *b)
+{
+	if (!a || !b)
+		return a == b;
+
+	if (a->address_oneof_case != b->address_oneof_case)
+		return false;
+	if (a->address_oneof_case == IPADDRESS__ADDRESS_ONEOF_IPV4_ADDR)
+		return a->ipv4_addr == b->ipv4_addr;
+	return a->ipv6_addr.len == b->ipv6_addr.len &&
+		!memcmp(a->ipv6_addr.data, b->ipv6_addr.data,
+			a->ipv6_addr.len);
+}
+
+/* Do two routes have the same paths, as far as their nexthops go? */
+static bool ip_rt_pb_paths_eq(const Route *a, const Route *b)
+{
+	const Path *pa, *pb;
+	size_t i;
+
+	if (a->n_paths != b->n_paths)
+		return false;
+
+	for (i = 0; i < a->n_paths; i++) {
+		pa = a->paths[i];
+		pb = b->paths[i];
+		if (pa->type != pb->type || pa->ifindex != pb->ifindex ||
+		    pa->backup != pb->backup ||
+		    pa->n_mpls_labels != pb->n_mpls_labels ||
+		    !ip_rt_pb_addr_eq(pa->nexthop, pb->nexthop) ||
+		    memcmp(pa->mpls_labels, pb->mpls_labels,
+			   pa->n_mpls_labels * sizeof(*pa->mpls_labels)))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Only nexthops with their labels held inline can be copied for
+ * another route.
+ */
+static bool ip_rt_pb_paths_shareable(const Route *route)
+{
+	size_t i;
+
+	if (route->n_paths == 0)
+		return false;
+
+	for (i = 0; i < route->n_paths; i++)
+		if (route->paths[i]->n_mpls_labels > NH_MAX_OUT_ARRAY_LABELS)
+			return false;
+	return true;
+}
+
+/*
+ * Get the nexthops for the paths of a route, reusing those already
+ * built for the same paths in the batch.  The caller owns, and must
+ * free, the returned array.
+ */
+static struct next_hop *
+ip_rt_pb_nexthops(struct ip_rt_pb_batch *batch, Route *route,
+		  enum nh_type nh_type, bool *missing_ifp)
+{
+	struct ip_rt_pb_nh_ent *ent;
+	struct next_hop *next;
+	uint32_t hash, i;
+
+	if (!batch || !ip_rt_pb_paths_shareable(route))
+		return nexthop_list_create(route, nh_type, missing_ifp);
+
+	hash = ip_rt_pb_paths_hash(route);
+	for (i = hash & batch->mask; ; i = (i + 1) & batch->mask) {
+		ent = &batch->nh_tbl[i];
+		if (!ent->route)
+			break;
+		if (ent->hash == hash && ent->nh_type == nh_type &&
+		    ip_rt_pb_paths_eq(ent->route, route))
+			goto found;
+	}
+
+	ent->route = route;
+	ent->nh_type = nh_type;
+	ent->hash = hash;
+	ent->next = nexthop_list_create(route, nh_type, &ent->missing_ifp);
+
+found:
+	if (!ent->next) {
+		*missing_ifp = ent->missing_ifp;
+		return NULL;
+	}
+
+	next = malloc(sizeof(*next) * route->n_paths);
+	if (next)
+		memcpy(next, ent->next, sizeof(*next) * route->n_paths);
+	return next;
+}
+
 static bool ip_rt_pb_table_to_vrf(
 	RibUpdate *rtupdate, enum cont_src_en cont_src,
 	bool *add_incomplete, uint32_t *table, vrfid_t *vrf_id)
@@ -214,6 +373,7 @@ static bool ip_rt_pb_table_to_vrf(
 
 static int ipv4_route_pb_handler(RibUpdate *rtupdate,
 				 enum cont_src_en cont_src,
+				 struct ip_rt_pb_batch *batch,
 				 bool *add_incomplete)
 {
 	Route *route = rtupdate->route;
@@ -248,7 +408,19 @@ static int ipv4_route_pb_handler(RibUpdate *rtupdate,
 		return 0;
 	}
 
-	next = nexthop_list_create(route, NH_TYPE_V4GW, add_incomplete);
+	if (route->pathgroup_id) {
+		/* Route came down before its path group */
+		if (!nh_pathgroup_exists(AF_INET, route->pathgroup_id)) {
+			*add_incomplete = true;
+			return 0;
+		}
+		return rt_insert_pathgroup(vrf_id, route->prefix->ipv4_addr,
+					   route->prefix_length, table,
+					   route->scope, route->pathgroup_id,
+					   true) < 0 ? -1 : 0;
+	}
+
+	next = ip_rt_pb_nexthops(batch, route, NH_TYPE_V4GW, add_incomplete);
 	if (!next && *add_incomplete)
 		return 0;
 	if (!next)
@@ -265,6 +437,7 @@ static int ipv4_route_pb_handler(RibUpdate *rtupdate,
 
 static int ipv6_route_pb_handler(RibUpdate *rtupdate,
 				 enum cont_src_en cont_src,
+				 struct ip_rt_pb_batch *batch,
 				 bool *add_incomplete)
 {
 	Route *route = rtupdate->route;
@@ -306,7 +479,18 @@ static int ipv6_route_pb_handler(RibUpdate *rtupdate,
 		return 0;
 	}
 
-	next = nexthop_list_create(route, NH_TYPE_V6GW, add_incomplete);
+	if (route->pathgroup_id) {
+		/* Route came down before its path group */
+		if (!nh_pathgroup_exists(AF_INET6, route->pathgroup_id)) {
+			*add_incomplete = true;
+			return 0;
+		}
+		return rt6_add_pathgroup(vrf_id, &dst, route->prefix_length,
+					 table, route->scope,
+					 route->pathgroup_id) < 0 ? -1 : 0;
+	}
+
+	next = ip_rt_pb_nexthops(batch, route, NH_TYPE_V6GW, add_incomplete);
 	if (!next && *add_incomplete)
 		return 0;
 	if (!next)
@@ -426,32 +610,119 @@ static int mpls_route_pb_handler(RibUpdate *rtupdate, bool *add_incomplete)
 	return 0;
 }
 
-int ip_route_pb_handler(void *data, size_t len, enum cont_src_en cont_src)
+/* Pack an update again, for keeping when it was given unpacked */
+static void *ip_rt_pb_pack(RibUpdate *rtupdate, size_t *len)
+{
+	void *buf;
+
+	*len = rib_update__get_packed_size(rtupdate);
+	buf = malloc(*len);
+	if (buf)
+		rib_update__pack(rtupdate, buf);
+	return buf;
+}
+
+/*
+ * A path group with a missing interface is installed with those paths
+ * going to the slowpath, and kept to be replayed when the interface
+ * arrives.  Routes that came down before the group are replayed once
+ * it is created.
+ */
+static int pathgroup_pb_handler(RibUpdate *rtupdate, void *data, size_t len)
+{
+	PathGroup *pg = rtupdate->pathgroup;
+	bool missing_ifp = false;
+	struct next_hop *next;
+	void *buf = NULL;
+	bool created;
+	int family;
+	int rc;
+
+	if (!pg->id) {
+		RTE_LOG(NOTICE, DATAPLANE,
+			"missing id in PathGroup protobuf message\n");
+		return -1;
+	}
+
+	family = pg->family == PATH_GROUP__ADDRESS_FAMILY__IPV6 ?
+		AF_INET6 : AF_INET;
+
+	DP_DEBUG(NETLINK_ROUTE, INFO, ROUTE,
+		 "%s IPv%d pathgroup %u num_paths %lu\n",
+		 rtupdate->action == RIB_UPDATE__ACTION__DELETE ?
+		 "delete" : "add/update",
+		 family == AF_INET ? 4 : 6, pg->id, pg->n_paths);
+
+	incomplete_pathgroup_del(family, pg->id);
+
+	if (rtupdate->action == RIB_UPDATE__ACTION__DELETE) {
+		nh_pathgroup_delete(family, pg->id);
+		return 0;
+	}
+
+	next = nexthop_paths_create(pg->paths, pg->n_paths,
+				    family == AF_INET ?
+				    NH_TYPE_V4GW : NH_TYPE_V6GW,
+				    true, &missing_ifp);
+	if (!next) {
+		RTE_LOG(NOTICE, DATAPLANE,
+			"IPv%d pathgroup %u has invalid paths\n",
+			family == AF_INET ? 4 : 6, pg->id);
+		return -1;
+	}
+
+	created = !nh_pathgroup_exists(family, pg->id);
+	rc = nh_pathgroup_update(family, pg->id, next, pg->n_paths,
+				 pg->routing_protocol);
+	free(next);
+	if (rc < 0) {
+		RTE_LOG(ERR, DATAPLANE,
+			"IPv%d pathgroup %u update failed: %s\n",
+			family == AF_INET ? 4 : 6, pg->id, strerror(-rc));
+		return -1;
+	}
+
+	if (missing_ifp) {
+		if (!data)
+			data = buf = ip_rt_pb_pack(rtupdate, &len);
+		if (data)
+			incomplete_pathgroup_add_pb(family, pg->id, data, len);
+		free(buf);
+	}
+
+	if (created)
+		incomplete_routes_make_complete();
+
+	return 0;
+}
+
+/*
+ * Apply an unpacked route update.  The packed update is kept for an
+ * incomplete route; if not given it is packed again.
+ */
+static int ip_route_pb_apply(RibUpdate *rtupdate, void *data, size_t len,
+			     enum cont_src_en cont_src,
+			     struct ip_rt_pb_batch *batch)
 {
 	bool add_incomplete = false;
-	RibUpdate *rtupdate;
 	Route *route;
 	int rc = -1;
 	void *dest;
 	int af;
 
-	rtupdate = rib_update__unpack(NULL, len, data);
-	if (!rtupdate) {
-		RTE_LOG(ERR, DATAPLANE,
-			"failed to read RibUpdate protobuf message\n");
-		return -1;
-	}
+	if (!rtupdate->route && rtupdate->pathgroup)
+		return pathgroup_pb_handler(rtupdate, data, len);
 
 	if (!rtupdate->route) {
 		RTE_LOG(NOTICE, DATAPLANE,
 			"missing route in RibUpdate protobuf message\n");
-		goto free_msg;
+		return -1;
 	}
 
 	if (!rtupdate->route->prefix) {
 		RTE_LOG(NOTICE, DATAPLANE,
 			"missing prefix in RibUpdate protobuf message\n");
-		goto free_msg;
+		return -1;
 	}
 
 	route = rtupdate->route;
@@ -466,8 +737,7 @@ int ip_route_pb_handler(void *data, size_t len, enum cont_src_en cont_src)
 			RTE_LOG(NOTICE, DATAPLANE,
 				"bad prefix address length %lu in RibUpdate protobuf message\n",
 				route->prefix->ipv6_addr.len);
-			rc = -1;
-			goto free_msg;
+			return -1;
 		}
 
 		af = AF_INET6;
@@ -478,8 +748,7 @@ int ip_route_pb_handler(void *data, size_t len, enum cont_src_en cont_src)
 		dest = &rtupdate->route->prefix->mpls_label;
 		break;
 	default:
-		rc = -2;
-		goto free_msg;
+		return -2;
 	}
 
 	incomplete_route_del(dest, af, route->prefix_length,
@@ -488,10 +757,12 @@ int ip_route_pb_handler(void *data, size_t len, enum cont_src_en cont_src)
 
 	switch (rtupdate->route->prefix->address_oneof_case) {
 	case IPADDRESS_OR_LABEL__ADDRESS_ONEOF_IPV4_ADDR:
-		rc = ipv4_route_pb_handler(rtupdate, cont_src, &add_incomplete);
+		rc = ipv4_route_pb_handler(rtupdate, cont_src, batch,
+					   &add_incomplete);
 		break;
 	case IPADDRESS_OR_LABEL__ADDRESS_ONEOF_IPV6_ADDR:
-		rc = ipv6_route_pb_handler(rtupdate, cont_src, &add_incomplete);
+		rc = ipv6_route_pb_handler(rtupdate, cont_src, batch,
+					   &add_incomplete);
 		break;
 	case IPADDRESS_OR_LABEL__ADDRESS_ONEOF_MPLS_LABEL:
 		rc = mpls_route_pb_handler(rtupdate, &add_incomplete);
@@ -500,14 +771,221 @@ int ip_route_pb_handler(void *data, size_t len, enum cont_src_en cont_src)
 		break;
 	}
 
-	if (!rc && add_incomplete)
+	if (!rc && add_incomplete) {
+		void *buf = NULL;
+
+		if (!data) {
+			data = buf = ip_rt_pb_pack(rtupdate, &len);
+			if (!buf)
+				return -1;
+		}
 		incomplete_route_add_pb(dest, af,
 					route->prefix_length,
 					route->table_id, route->scope,
 					route->routing_protocol, data,
 					len);
+		free(buf);
+	}
+
+	return rc;
+}
+
+int ip_route_pb_handler(void *data, size_t len, enum cont_src_en cont_src)
+{
+	RibUpdate *rtupdate;
+	int rc;
+
+	rtupdate = rib_update__unpack(NULL, len, data);
+	if (!rtupdate) {
+		RTE_LOG(ERR, DATAPLANE,
+			"failed to read RibUpdate protobuf message\n");
+		return -1;
+	}
+
+	rc = ip_route_pb_apply(rtupdate, data, len, cont_src, NULL);
 
-free_msg:
 	rib_update__free_unpacked(rtupdate, NULL);
 	return rc;
 }
+
+/* Max RibUpdate messages coalesced together by the bulk handler */
+#define IP_RT_PB_BULK_MAX 64
+
+/*
+ * The route an update is for.  A later update for the same route in a
+ * batch replaces an earlier one.
+ */
+struct ip_rt_pb_route_key {
+	uint32_t	af;
+	uint32_t	table_id;
+	uint32_t	prefix_length;
+	uint32_t	scope;
+	uint8_t		addr[sizeof(struct in6_addr)];
+};
+
+static bool ip_rt_pb_route_key(const RibUpdate *rtupdate,
+			       struct ip_rt_pb_route_key *key)
+{
+	const Route *route = rtupdate->route;
+
+	memset(key, 0, sizeof(*key));
+	if (!route || !route->prefix)
+		return false;
+
+	key->af = route->prefix->address_oneof_case;
+	key->table_id = route->table_id;
+	key->prefix_length = route->prefix_length;
+	key->scope = route->scope;
+
+	switch (route->prefix->address_oneof_case) {
+	case IPADDRESS_OR_LABEL__ADDRESS_ONEOF_IPV4_ADDR:
+		memcpy(key->addr, &route->prefix->ipv4_addr,
+		       sizeof(route->prefix->ipv4_addr));
+		break;
+	case IPADDRESS_OR_LABEL__ADDRESS_ONEOF_IPV6_ADDR:
+		if (route->prefix->ipv6_addr.len != sizeof(key->addr))
+			return false;
+		memcpy(key->addr, route->prefix->ipv6_addr.data,
+		       sizeof(key->addr));
+		break;
+	case IPADDRESS_OR_LABEL__ADDRESS_ONEOF_MPLS_LABEL:
+		/* Labels have no table, length or scope */
+		memset(key, 0, sizeof(*key));
+		key->af = route->prefix->address_oneof_case;
+		memcpy(key->addr, &route->prefix->mpls_label,
+		       sizeof(route->prefix->mpls_label));
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Apply a batch of route updates, in order.  Updates replaced by a
+ * later update for the same route are skipped, so a route that flaps
+ * within the batch is only written once, and nexthops are built once
+ * for each distinct set of paths.
+ *
+ * Returns the number of updates that failed.
+ */
+static unsigned int
+ip_route_pb_apply_batch(RibUpdate **updates, void **data, size_t *len,
+			unsigned int n, enum cont_src_en cont_src)
+{
+	struct ip_rt_pb_route_key *keys;
+	struct ip_rt_pb_batch batch;
+	unsigned int failed = 0;
+	uint32_t *last, size, i, j;
+	bool *skip;
+
+	for (size = 1; size < 2 * n; size <<= 1)
+		;
+
+	batch.mask = size - 1;
+	batch.nh_tbl = calloc(size, sizeof(*batch.nh_tbl));
+	keys = malloc(n * sizeof(*keys));
+	last = malloc(size * sizeof(*last));
+	skip = calloc(n, sizeof(*skip));
+	if (!batch.nh_tbl || !keys || !last || !skip) {
+		/* Fall back to applying each update on its own */
+		for (i = 0; i < n; i++)
+			if (ip_route_pb_apply(updates[i],
+					      data ? data[i] : NULL,
+					      len ? len[i] : 0,
+					      cont_src, NULL) != 0)
+				failed++;
+		goto out;
+	}
+
+	/* Find the updates that are replaced within the batch */
+	memset(last, 0xff, size * sizeof(*last));
+	for (i = 0; i < n; i++) {
+		if (!ip_rt_pb_route_key(updates[i], &keys[i]))
+			continue;
+
+		for (j = rte_jhash(&keys[i], sizeof(keys[i]), 0) & batch.mask;
+		     last[j] != UINT32_MAX; j = (j + 1) & batch.mask)
+			if (!memcmp(&keys[last[j]], &keys[i],
+				    sizeof(keys[i]))) {
+				skip[last[j]] = true;
+				break;
+			}
+		last[j] = i;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (skip[i])
+			continue;
+		if (ip_route_pb_apply(updates[i], data ? data[i] : NULL,
+				      len ? len[i] : 0, cont_src,
+				      &batch) != 0)
+			failed++;
+	}
+
+	for (i = 0; i < size; i++)
+		free(batch.nh_tbl[i].next);
+
+out:
+	free(batch.nh_tbl);
+	free(keys);
+	free(last);
+	free(skip);
+	return failed;
+}
+
+int ip_route_pb_batch_handler(void *data, size_t len,
+			      enum cont_src_en cont_src)
+{
+	RibUpdateBatch *rtbatch;
+	unsigned int failed;
+
+	rtbatch = rib_update_batch__unpack(NULL, len, data);
+	if (!rtbatch) {
+		RTE_LOG(ERR, DATAPLANE,
+			"failed to read RibUpdateBatch protobuf message\n");
+		return -1;
+	}
+
+	failed = ip_route_pb_apply_batch(rtbatch->updates, NULL, NULL,
+					 rtbatch->n_updates, cont_src);
+	if (failed)
+		RTE_LOG(NOTICE, DATAPLANE,
+			"%u of %zu route updates in batch failed\n",
+			failed, rtbatch->n_updates);
+
+	rib_update_batch__free_unpacked(rtbatch, NULL);
+	return failed ? -1 : 0;
+}
+
+int ip_route_pb_handler_bulk(void *data[], size_t len[], unsigned int n,
+			     enum cont_src_en cont_src)
+{
+	RibUpdate *updates[IP_RT_PB_BULK_MAX];
+	unsigned int i = 0, j, m, base, failed = 0;
+
+	/* Coalesce within chunks of at most IP_RT_PB_BULK_MAX messages */
+	while (i < n) {
+		base = i;
+		for (m = 0; i < n && m < IP_RT_PB_BULK_MAX; i++) {
+			updates[m] = rib_update__unpack(NULL, len[i], data[i]);
+			if (!updates[m]) {
+				RTE_LOG(ERR, DATAPLANE,
+					"failed to read RibUpdate protobuf message\n");
+				failed++;
+				continue;
+			}
+			data[base + m] = data[i];
+			len[base + m] = len[i];
+			m++;
+		}
+
+		failed += ip_route_pb_apply_batch(updates, &data[base],
+						  &len[base], m, cont_src);
+
+		for (j = 0; j < m; j++)
+			rib_update__free_unpacked(updates[j], NULL);
+	}
+
+	return failed ? -1 : 0;
+}
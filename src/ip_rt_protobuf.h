@@ -12,4 +12,15 @@
 
 int ip_route_pb_handler(void *data, size_t len, enum cont_src_en cont_src);
 
+/* Handle a RibUpdateBatch message */
+int ip_route_pb_batch_handler(void *data, size_t len,
+			      enum cont_src_en cont_src);
+
+/*
+ * Handle a number of RibUpdate messages together, coalescing updates
+ * for the same route.  The data and len arrays may be reordered.
+ */
+int ip_route_pb_handler_bulk(void *data[], size_t len[], unsigned int n,
+			     enum cont_src_en cont_src);
+
 #endif /* IP_RT_PROTOBUF_H */
@@ -40,17 +40,22 @@
 #include <errno.h>
 #include <rte_branch_prediction.h>
 #include <rte_common.h>
+#include <rte_cpuflags.h>
 #include <rte_debug.h>
 #include <rte_eal.h>
 #include <rte_eal_memconfig.h>
 #include <rte_errno.h>
 #include <rte_jhash.h>
 #include <rte_log.h>
+#include <rte_prefetch.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <urcu/arch.h>
+#if defined RTE_ARCH_I686 || defined RTE_ARCH_X86_64
+#include <immintrin.h>
+#endif
 
 #include "compiler.h"
 #include "pd_show.h"
@@ -1556,6 +1561,138 @@ lpm_lookup(const struct lpm *lpm, uint32_t ip, uint32_t *next_hop)
 	return 0; /* Lookup hit. */
 }
 
+/*
+ * Resolve an already fetched tbl24 entry, reading the tbl8 entry if
+ * the tbl24 entry is extended.
+ */
+static ALWAYS_INLINE uint32_t
+lpm_lookup_resolve(const struct lpm *lpm, struct lpm_tbl24_entry tbl24,
+		   uint32_t ip)
+{
+	struct lpm_tbl8_entry tbl8;
+	uint32_t next_hop;
+
+	if (unlikely(!tbl24.valid))
+		goto dflt;
+
+	if (tbl24.ext_entry == 0)
+		return lpm_tbl24_get_next_hop_idx(&tbl24);
+
+	tbl8 = CMM_ACCESS_ONCE(
+		lpm->tbl8[tbl24.tbl8_gindex * LPM_TBL8_GROUP_NUM_ENTRIES
+			  + (ip & 0xFF)]);
+	if (likely(tbl8.valid))
+		return tbl8.next_hop;
+dflt:
+	if (lpm_lookup_default(lpm, &next_hop) != 0)
+		return LPM_LOOKUP_MISS;
+	return next_hop;
+}
+
+union lpm_tbl24_word {
+	uint32_t u32;
+	struct lpm_tbl24_entry entry;
+};
+
+/*
+ * Fetch the tbl24 entries for 4 addresses.
+ */
+static ALWAYS_INLINE void
+lpm_tbl24_fetchx4(const struct lpm *lpm, const uint32_t *ips,
+		  union lpm_tbl24_word *tbl24)
+{
+	unsigned int i;
+
+	for (i = 0; i < 4; i++)
+		tbl24[i].entry = CMM_ACCESS_ONCE(lpm->tbl24[ips[i] >> 8]);
+}
+
+#if defined RTE_ARCH_X86_64
+/*
+ * Fetch the tbl24 entries for 8 addresses with a single gather.
+ */
+static __attribute__((target("avx2"))) void
+lpm_tbl24_fetchx8_avx2(const struct lpm *lpm, const uint32_t *ips,
+		       union lpm_tbl24_word *tbl24)
+{
+	__m256i ip8 = _mm256_loadu_si256((const __m256i *)ips);
+	__m256i ent = _mm256_i32gather_epi32((const int *)lpm->tbl24,
+					     _mm256_srli_epi32(ip8, 8), 4);
+
+	_mm256_storeu_si256((__m256i *)tbl24, ent);
+}
+#endif
+
+static void
+lpm_tbl24_fetchx8_scalar(const struct lpm *lpm, const uint32_t *ips,
+			 union lpm_tbl24_word *tbl24)
+{
+	lpm_tbl24_fetchx4(lpm, ips, tbl24);
+	lpm_tbl24_fetchx4(lpm, ips + 4, tbl24 + 4);
+}
+
+static void
+lpm_tbl24_fetchx8_select(const struct lpm *lpm, const uint32_t *ips,
+			 union lpm_tbl24_word *tbl24);
+
+static void (*lpm_tbl24_fetchx8)(const struct lpm *lpm, const uint32_t *ips,
+				 union lpm_tbl24_word *tbl24) __hot_data =
+	lpm_tbl24_fetchx8_select;
+
+/*
+ * Pick the best tbl24 gather for the CPU on first use.
+ */
+static void
+lpm_tbl24_fetchx8_select(const struct lpm *lpm, const uint32_t *ips,
+			 union lpm_tbl24_word *tbl24)
+{
+	void (*fn)(const struct lpm *lpm, const uint32_t *ips,
+		   union lpm_tbl24_word *tbl24) = lpm_tbl24_fetchx8_scalar;
+
+#if defined RTE_ARCH_X86_64
+	if (rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX2))
+		fn = lpm_tbl24_fetchx8_avx2;
+#endif
+	CMM_STORE_SHARED(lpm_tbl24_fetchx8, fn);
+	fn(lpm, ips, tbl24);
+}
+
+/*
+ * Look up a burst of addresses.
+ *
+ * The tbl24 entries for all of the addresses are prefetched before
+ * any of them are resolved, so that the cache misses overlap rather
+ * than being taken one after the other.
+ */
+unsigned int
+lpm_lookup_bulk(const struct lpm *lpm, const uint32_t *ips,
+		uint32_t *next_hops, unsigned int n)
+{
+	union lpm_tbl24_word tbl24[8];
+	unsigned int hits = 0;
+	unsigned int i, j;
+
+	for (i = 0; i < n; i++)
+		rte_prefetch0(&lpm->tbl24[ips[i] >> 8]);
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		lpm_tbl24_fetchx8(lpm, &ips[i], tbl24);
+		for (j = 0; j < 8; j++) {
+			next_hops[i + j] = lpm_lookup_resolve(
+				lpm, tbl24[j].entry, ips[i + j]);
+			hits += next_hops[i + j] != LPM_LOOKUP_MISS;
+		}
+	}
+
+	for (; i < n; i++) {
+		next_hops[i] = lpm_lookup_resolve(
+			lpm, CMM_ACCESS_ONCE(lpm->tbl24[ips[i] >> 8]), ips[i]);
+		hits += next_hops[i] != LPM_LOOKUP_MISS;
+	}
+
+	return hits;
+}
+
 /*
  * Do a subtree walk of the given rule.
  *
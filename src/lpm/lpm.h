@@ -293,6 +293,28 @@ lpm_delete_all(struct lpm *lpm, lpm_walk_func_t func, void *arg);
 int
 lpm_lookup(const struct lpm *lpm, uint32_t ip, uint32_t *next_hop);
 
+/** Next hop value returned by bulk lookups on a lookup miss. */
+#define LPM_LOOKUP_MISS UINT32_MAX
+
+/**
+ * Lookup a burst of IPs in the LPM table.
+ *
+ * @param lpm
+ *   LPM object handle
+ * @param ips
+ *   Array of n IPs to be looked up in the LPM table
+ * @param next_hops
+ *   Array of n next hops of the most specific rules found, set to
+ *   LPM_LOOKUP_MISS on lookup miss
+ * @param n
+ *   Number of IPs to look up
+ * @return
+ *   Number of lookup hits
+ */
+unsigned int
+lpm_lookup_bulk(const struct lpm *lpm, const uint32_t *ips,
+		uint32_t *next_hops, unsigned int n);
+
 /*
  * Lookup an IP in the LPM table and return exact match
  * @param lpm
@@ -851,6 +851,85 @@ lpm6_lookup(const struct lpm6 *lpm, const uint8_t *ip,
 	return status;
 }
 
+/*
+ * Looks up a burst of at most LPM6_LOOKUP_BULK_MAX IPs
+ *
+ * Rather than walking each IP down to its result before starting on
+ * the next, the walks are interleaved a level at a time: each round
+ * inspects the current level for every IP still being resolved and
+ * prefetches the entry it needs at the next level. The dependent
+ * memory accesses for the IPs in the burst are therefore overlapped.
+ */
+static unsigned int
+lpm6_lookup_burst(const struct lpm6 *lpm, const uint8_t *ips[],
+		  uint32_t *next_hops, unsigned int n)
+{
+	const struct lpm6_tbl_entry *tbl[LPM6_LOOKUP_BULK_MAX];
+	uint8_t first_byte[LPM6_LOOKUP_BULK_MAX];
+	uint8_t active[LPM6_LOOKUP_BULK_MAX];
+	unsigned int i, j, nactive = 0, hits = 0;
+	uint32_t tbl24_index;
+	int status;
+
+	for (i = 0; i < n; i++) {
+		tbl24_index = (ips[i][0] << BYTES2_SIZE) |
+			(ips[i][1] << BYTE_SIZE) | ips[i][2];
+		tbl[i] = &lpm->tbl24[tbl24_index];
+		first_byte[i] = LOOKUP_FIRST_BYTE;
+		rte_prefetch0(tbl[i]);
+		active[nactive++] = i;
+	}
+
+	while (nactive) {
+		for (i = 0, j = 0; i < nactive; i++) {
+			const struct lpm6_tbl_entry *tbl_next = NULL;
+			unsigned int k = active[i];
+
+			status = lookup_step(lpm, tbl[k], &tbl_next, ips[k],
+					     first_byte[k]++, &next_hops[k]);
+			if (status == 1) {
+				/* Continue with the next level next round */
+				tbl[k] = tbl_next;
+				rte_prefetch0(tbl_next);
+				active[j++] = k;
+				continue;
+			}
+
+			/*
+			 * If a more specific route was not found check
+			 * for a default route.
+			 */
+			if (status == -ENOENT)
+				status = lookup_tbldflt(&lpm->tbldflt,
+							&next_hops[k]);
+			if (status == 0)
+				hits++;
+			else
+				next_hops[k] = LPM_LOOKUP_MISS;
+		}
+		nactive = j;
+	}
+
+	return hits;
+}
+
+/*
+ * Looks up a burst of IPs, LPM6_LOOKUP_BULK_MAX at a time
+ */
+unsigned int
+lpm6_lookup_bulk(const struct lpm6 *lpm, const uint8_t *ips[],
+		 uint32_t *next_hops, unsigned int n)
+{
+	unsigned int i, hits = 0;
+
+	for (i = 0; i < n; i += LPM6_LOOKUP_BULK_MAX)
+		hits += lpm6_lookup_burst(lpm, ips + i, next_hops + i,
+					  RTE_MIN(n - i,
+						  LPM6_LOOKUP_BULK_MAX));
+
+	return hits;
+}
+
 /*
  * Looks up an next-hop
  */
@@ -274,6 +274,29 @@ lpm6_lookup_exact(struct lpm6 *lpm, const uint8_t *ip,
 void
 lpm6_prefetch(struct lpm6 *lpm, const uint8_t *ip);
 
+/* Number of IPs whose level walks are interleaved by lpm6_lookup_bulk() */
+#define LPM6_LOOKUP_BULK_MAX 32
+
+/**
+ * Lookup a burst of IPs in the LPM table, interleaving the level
+ * walks of up to LPM6_LOOKUP_BULK_MAX IPs at a time so that their
+ * memory accesses overlap.
+ * @param lpm
+ *   LPM object handle
+ * @param ips
+ *   Array of n IPs to be looked up in the LPM table
+ * @param next_hops
+ *   Array of n next hops of the most specific rules found, set to
+ *   LPM_LOOKUP_MISS on lookup miss
+ * @param n
+ *   Number of IPs to look up
+ * @return
+ *   Number of lookup hits
+ */
+unsigned int
+lpm6_lookup_bulk(const struct lpm6 *lpm, const uint8_t *ips[],
+		 uint32_t *next_hops, unsigned int n);
+
 bool
 lpm6_is_empty(const struct lpm6 *lpm);
 
@@ -140,6 +140,8 @@
 #include "backplane.h"
 
 packet_input_t packet_input_func __hot_data = ether_input_no_dyn_feats;
+packet_burst_input_t packet_burst_input_func __hot_data =
+	ether_input_burst_no_dyn_feats;
 
 #define MBUF_OVERHEAD RTE_PKTMBUF_HEADROOM
 #define MIN_MBUF_POOL	4096			/* Minimum number of mbufs */
@@ -529,6 +531,49 @@ void dp_pkt_burst_setup(void)
 	pkt_burst_init(lcore_id, lcore_conf[lcore_id]->tx_qid);
 }
 
+/* The transmit ring for a QoS packet, that of its scheduler shard */
+static ALWAYS_INLINE uint8_t
+pkt_qos_ringid(struct ifnet *ifp, struct rte_mbuf *m)
+{
+	struct sched_info *qinfo = qos_handle(ifp);
+
+	return qinfo ? qos_shard_of(qinfo, m) : 0;
+}
+
+/*
+ * Enqueue QoS packets to the rings of their scheduler shards, in runs
+ * of packets for the same shard.  Stops at the first ring that is full,
+ * so as with a single ring the packets not sent are at the end.
+ */
+static ALWAYS_INLINE uint16_t
+pkt_out_qos_rings(struct ifnet *ifp, uint16_t port,
+		  struct rte_mbuf **mbufs, uint16_t nb_pkts)
+{
+	struct sched_info *qinfo = qos_handle(ifp);
+	uint16_t i, j, n, sent = 0;
+	uint8_t rid;
+
+	if (likely(!qinfo || qos_shard_count(qinfo) == 1))
+		return rte_ring_mp_enqueue_burst(port_config[port].pkt_ring[0],
+						 (void **) mbufs, nb_pkts,
+						 NULL);
+
+	for (i = 0; i < nb_pkts; i = j) {
+		rid = qos_shard_of(qinfo, mbufs[i]);
+		for (j = i + 1; j < nb_pkts; j++)
+			if (qos_shard_of(qinfo, mbufs[j]) != rid)
+				break;
+
+		n = rte_ring_mp_enqueue_burst(port_config[port].pkt_ring[rid],
+					      (void **) &mbufs[i], j - i,
+					      NULL);
+		sent += n;
+		if (n < j - i)
+			break;
+	}
+	return sent;
+}
+
 static ALWAYS_INLINE uint16_t
 pkt_out_burst_cmn(struct ifnet *ifp, bool qos_enabled, uint16_t port,
 		  uint16_t queue, struct rte_mbuf **mbufs, uint16_t nb_pkts)
@@ -537,14 +582,12 @@ pkt_out_burst_cmn(struct ifnet *ifp, bool qos_enabled, uint16_t port,
 
 	if (__use_directpath(port, qos_enabled))
 		n = eth_tx_burst(ifp, queue, mbufs, nb_pkts);
+	else if (qos_enabled)
+		n = pkt_out_qos_rings(ifp, port, mbufs, nb_pkts);
 	else {
 		uint8_t rid;
 
-		if (qos_enabled)
-			rid = 0;	/* always use ringid 0 for QoS */
-		else
-			rid = queue % CMM_ACCESS_ONCE(
-				port_config[port].nrings);
+		rid = queue % CMM_ACCESS_ONCE(port_config[port].nrings);
 
 		n = rte_ring_mp_enqueue_burst(
 					port_config[port].pkt_ring[rid],
@@ -662,7 +705,10 @@ void pkt_ring_output(struct ifnet *ifp, struct rte_mbuf *m)
 				goto full_hwq;
 		} else {
 			/* must be lcore 0 */
-			struct rte_ring *ring = port_config[portid].pkt_ring[0];
+			uint8_t rid = ifp->qos_software_fwd ?
+				pkt_qos_ringid(ifp, m) : 0;
+			struct rte_ring *ring =
+				port_config[portid].pkt_ring[rid];
 
 			if (rte_ring_mp_enqueue(ring, m) != 0)
 				goto full_txring;
@@ -699,6 +745,7 @@ process_burst(portid_t portid, struct rte_mbuf *pkts[], uint16_t nb)
 {
 	struct ifnet *ifp = ifport_table[portid];
 	packet_input_t input_func = packet_input_func;
+	packet_burst_input_t burst_input_func = packet_burst_input_func;
 	unsigned int i;
 
 	/* Prefetch first packets */
@@ -715,6 +762,24 @@ process_burst(portid_t portid, struct rte_mbuf *pkts[], uint16_t nb)
 	if (unlikely(ifp->portmonitor))
 		portmonitor_src_phy_rx_output(ifp, pkts, nb);
 
+	/*
+	 * Walk the pipeline a node at a time for the whole burst, if
+	 * the input function has a burst equivalent.
+	 */
+	if (likely(burst_input_func != NULL)) {
+		for (i = 0; i < nb; i++) {
+			if (i + PREFETCH_OFFSET < nb) {
+				rte_prefetch0(
+					pkts[i + PREFETCH_OFFSET]->cacheline1);
+				rte_prefetch0(rte_pktmbuf_mtod(
+					pkts[i + PREFETCH_OFFSET], void *));
+			}
+			pktmbuf_mdata_clear_all(pkts[i]);
+		}
+		burst_input_func(ifp, pkts, nb);
+		return;
+	}
+
 	/* Process already prefetched packets */
 	for (i = 0; i + PREFETCH_OFFSET < nb; i++) {
 		rte_prefetch0(pkts[i + PREFETCH_OFFSET]->cacheline1);
@@ -895,23 +960,38 @@ static void put_transmit(struct ifnet *ifp, uint16_t queue_id,
  * Per Intel developer should always dequeue in smaller chunks
  * than enqueued.
  */
+/*
+ * Each scheduler shard has its own packet ring.  When there are fewer
+ * transmit rings in use than shards, such as after a queue state
+ * change, the lcore of ring r also schedules shards r + nrings,
+ * r + 2 * nrings etc., so each shard is still only scheduled by one
+ * lcore.
+ */
 static unsigned int pkt_transmit_qos(struct ifnet *ifp,
 				 struct sched_info *qinfo,
 				 struct lcore_tx_queue *txq,
 				 portid_t portid,
 				 unsigned int space)
 {
-	struct rte_ring *ring = port_config[portid].pkt_ring[txq->ringid];
+	struct port_conf *port_conf = &port_config[portid];
+	unsigned int nrings = CMM_ACCESS_ONCE(port_conf->nrings);
+	unsigned int n_shards = qos_shard_count(qinfo);
+	struct rte_mbuf **tx_pkts = txq->burst + txq->pending;
 	struct rte_mbuf *q_pkts[QOS_PKT_BURST];
-	unsigned int n;
-
-	n = rte_ring_sc_dequeue_burst(ring, (void **) q_pkts,
-				      QOS_PKT_BURST, NULL);
+	unsigned int shard, n, deq = 0, added = 0;
+
+	for (shard = txq->ringid; shard < n_shards; shard += nrings) {
+		n = rte_ring_sc_dequeue_burst(port_conf->pkt_ring[shard],
+					      (void **) q_pkts,
+					      QOS_PKT_BURST, NULL);
+		deq += n;
+		added += qos_sched(ifp, qinfo, shard, q_pkts, n,
+				   tx_pkts + added, space - added);
+	}
 
-	pm_update(&txq->gov, n);
+	pm_update(&txq->gov, deq);
 
-	struct rte_mbuf **tx_pkts = txq->burst + txq->pending;
-	return qos_sched(ifp, qinfo, q_pkts, n, tx_pkts, space);
+	return added;
 }
 
 /* Fast path, Qos not enabled.
@@ -964,7 +1044,8 @@ poll_transmit_queues(struct lcore_conf *conf)
 		unsigned int space = TX_PKT_BURST - txq->pending;
 
 		struct sched_info *qinfo = qos_handle(ifp);
-		if (qinfo && txq->ringid == 0) /* QoS only uses ringid 0 */
+		/* QoS uses a ring for each of its scheduler shards */
+		if (qinfo && txq->ringid < qos_shard_count(qinfo))
 			added = pkt_transmit_qos(ifp, qinfo, txq, portid,
 						 space);
 		else
@@ -1947,22 +2028,82 @@ exit:
 	return rc;
 }
 
-/* Called from QoS when transmit needs to be activated. */
-int enable_transmit_thread(portid_t portid)
+/* Create any missing packet rings up to 'nrings', like ring 0 */
+static int pkt_ring_add(portid_t portid, uint8_t nrings)
+{
+	struct port_conf *port_conf = &port_config[portid];
+	char ring_name[RTE_RING_NAMESIZE];
+	uint8_t r;
+
+	for (r = port_conf->max_rings; r < nrings; r++) {
+		struct rte_ring **pkt_ring = &port_conf->pkt_ring[r];
+
+		snprintf(ring_name,
+			 sizeof(ring_name), "pkt-ring-%u-%u", portid, r);
+
+		*pkt_ring = rte_ring_create(
+			ring_name, rte_ring_get_size(port_conf->pkt_ring[0]),
+			port_conf->socketid, RING_F_SC_DEQ);
+		if (*pkt_ring == NULL) {
+			RTE_LOG(ERR,
+				DATAPLANE, "Cannot create %s\n", ring_name);
+			return -rte_errno;
+		}
+		port_conf->max_rings = r + 1;
+	}
+	return 0;
+}
+
+/*
+ * Called from QoS when transmit needs to be activated, with 'nrings'
+ * packet rings, one per scheduler shard.  Up to as many rings as the
+ * port has transmit queues are drained by their own transmit lcore,
+ * the rest share those lcores (see pkt_transmit_qos).
+ * Returns the number of rings with their own lcore.
+ */
+int enable_transmit_thread_rings(portid_t portid, unsigned int nrings)
 {
+	struct port_conf *port_conf = &port_config[portid];
+	unsigned int lcore;
 	int ret;
 
 	if (!dpdk_eth_if_port_started(portid))
 		return -1;
 
-	if (transmit_thread_running(portid))
-		return 0;
+	nrings = RTE_MIN(nrings, (unsigned int)MAX_TX_QUEUE_PER_PORT);
+	nrings = RTE_MAX(nrings, 1u);
+	ret = pkt_ring_add(portid, nrings);
+	if (ret < 0)
+		return ret;
+
+	/*
+	 * Without percoreq the transmit threads always run, on all of
+	 * the port's rings.
+	 */
+	if (!port_conf->percoreq)
+		return RTE_MIN(nrings, port_conf->nrings);
+
+	nrings = RTE_MIN(nrings, port_conf->tx_queues);
+
+	if (transmit_thread_running(portid)) {
+		if (port_conf->nrings == nrings)
+			return nrings;
+
+		/* Reassign for the new number of rings */
+		FOREACH_FORWARD_LCORE(lcore)
+			unassign_port_transmit_queues(portid,
+						      lcore_conf[lcore]);
+		synchronize_rcu();
+		pkt_ring_empty(portid);
+	}
+
+	CMM_STORE_SHARED(port_conf->nrings, nrings);
 
 	ret = assign_port_transmit_queues(portid);
 	if (ret == 0)
 		start_cpus();
 
-	return ret;
+	return ret < 0 ? ret : (int)nrings;
 }
 
 /* Called from QoS when transmit needs can be deactivated. */
@@ -1982,6 +2123,7 @@ void disable_transmit_thread(portid_t portid)
 
 	synchronize_rcu();
 	pkt_ring_empty(portid);
+	CMM_STORE_SHARED(port_config[portid].nrings, 1);
 	stop_cpus();
 }
 
@@ -3998,11 +4140,20 @@ void set_port_affinity(portid_t portid, const bitmask_t *rx_mask,
 
 void set_packet_input_func(packet_input_t input_fn)
 {
-	if (input_fn)
+	if (input_fn) {
 		packet_input_func = input_fn;
-	else
+		/*
+		 * Only the ether input functions have a burst
+		 * equivalent, otherwise fall back to processing a
+		 * packet at a time.
+		 */
+		packet_burst_input_func = input_fn == ether_input ?
+			ether_input_burst : NULL;
+	} else {
 		/* set to default */
 		packet_input_func = ether_input_no_dyn_feats;
+		packet_burst_input_func = ether_input_burst_no_dyn_feats;
+	}
 }
 
 void
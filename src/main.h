@@ -89,7 +89,7 @@ uint64_t get_link_modes(struct ifnet *ifp);
 
 int assign_queues(portid_t portid);
 void unassign_queues(portid_t portid);
-int enable_transmit_thread(portid_t portid);
+int enable_transmit_thread_rings(portid_t portid, unsigned int nrings);
 void disable_transmit_thread(portid_t portid);
 void set_port_queue_state(uint16_t port);
 void reset_port_all_queue_state(uint16_t port);
@@ -693,6 +693,44 @@ void rt6_prefetch(const struct rte_mbuf *m, const struct in6_addr *dst)
 	lpm6_prefetch(lpm, dst->s6_addr);
 }
 
+/*
+ * Lookup the nexthops for a burst of destinations in the same table,
+ * as rt6_lookup_fast() does for one.  The table walks are interleaved
+ * so that the burst's dependent cache misses overlap.
+ */
+void rt6_lookup_bulk_fast(struct vrf *vrf, const struct in6_addr *dsts[],
+			  uint32_t tbl_id, struct rte_mbuf *const ms[],
+			  struct next_hop *nhs[], unsigned int n)
+{
+	const uint8_t *ips[LPM6_LOOKUP_BULK_MAX];
+	uint32_t index[LPM6_LOOKUP_BULK_MAX];
+	const struct lpm6 *lpm;
+	unsigned int i, j, nb;
+
+	lpm = rcu_dereference(vrf->v_rt6_head.rt6_table[tbl_id]);
+
+	for (i = 0; i < n; i += nb) {
+		nb = RTE_MIN(n - i, LPM6_LOOKUP_BULK_MAX);
+
+		for (j = 0; j < nb; j++)
+			ips[j] = dsts[i + j]->s6_addr;
+
+		lpm6_lookup_bulk(lpm, ips, index, nb);
+
+		for (j = 0; j < nb; j++) {
+			struct next_hop *nh = NULL;
+
+			if (likely(index[j] != LPM_LOOKUP_MISS))
+				nh = nexthop_select(AF_INET6, index[j],
+						    ms[i + j],
+						    RTE_ETHER_TYPE_IPV6);
+			if (nh && unlikely(nh->flags & RTF_NOROUTE))
+				nh = NULL;
+			nhs[i + j] = nh;
+		}
+	}
+}
+
 int dp_nh6_lookup_by_index(uint32_t nhindex, uint32_t hash,
 			struct in6_addr *nh, uint32_t *ifindex)
 {
@@ -819,7 +857,7 @@ nexthop6_hashfn(const struct nexthop_hash_key *key,
 		unsigned long seed __rte_unused)
 {
 	size_t size = key->size;
-	uint32_t hash_keys[size * IPV6_NH_HASH_KEY_SIZE];
+	uint32_t hash_keys[size * IPV6_NH_HASH_KEY_SIZE + 1];
 	struct ifnet *ifp;
 	uint16_t i, j = 0;
 
@@ -831,7 +869,9 @@ nexthop6_hashfn(const struct nexthop_hash_key *key,
 		hash_keys[j+5] = key->nh[i].flags & NH_FLAGS_CMP_MASK;
 	}
 
-	return rte_jhash_32b(hash_keys, size * IPV6_NH_HASH_KEY_SIZE, 0);
+	hash_keys[size * IPV6_NH_HASH_KEY_SIZE] = key->pathgroup;
+
+	return rte_jhash_32b(hash_keys, size * IPV6_NH_HASH_KEY_SIZE + 1, 0);
 
 }
 
@@ -843,7 +883,8 @@ static int nexthop6_cmpfn(struct cds_lfht_node *node, const void *key)
 	uint16_t i;
 
 	if (h_key->size != nl->nsiblings ||
-	    h_key->use != nl->use)
+	    h_key->use != nl->use ||
+	    h_key->pathgroup != nl->pathgroup)
 		return false;
 
 	for (i = 0; i < h_key->size; i++) {
@@ -908,12 +949,15 @@ route6_get_nh_blackhole(void)
 	return nextl6_blackhole;
 }
 
+static void route6_nhl_replaced(uint32_t nhl_idx, bool fal_upd);
+
 struct nh_common nh6_common = {
 	.nh_hash = nexthop6_hashfn,
 	.nh_compare = nexthop6_cmpfn,
 	.nh_get_hash_tbl = route6_get_nh_hash_table,
 	.nh_get_nh_tbl = route6_get_nh_table,
 	.nh_get_blackhole = route6_get_nh_blackhole,
+	.nh_replaced = route6_nhl_replaced,
 };
 
 void nexthop_v6_tbl_init(void)
@@ -1479,6 +1523,12 @@ int rt6_delete(vrfid_t vrf_id, const struct in6_addr *dst,
 	return err;
 }
 
+static int rt6_insert_nh(struct vrf *vrf, struct lpm6 *lpm,
+			 uint32_t table_id,
+			 const struct in6_addr *dst, uint8_t prefix_len,
+			 int16_t scope, uint32_t idx, size_t size,
+			 bool replace);
+
 /* Add new route entry. */
 static int rt6_insert(struct vrf *vrf, struct lpm6 *lpm,
 		      uint32_t table_id,
@@ -1486,9 +1536,7 @@ static int rt6_insert(struct vrf *vrf, struct lpm6 *lpm,
 		      int16_t scope, struct next_hop hops[],
 		      size_t size, uint32_t *idx, bool replace)
 {
-	char b[INET6_ADDRSTRLEN];
 	int err;
-	uint32_t old_index;
 
 	if (replace)
 		if (unlikely(prefix_len == 128 && !(hops->flags & RTF_LOCAL) &&
@@ -1523,27 +1571,45 @@ static int rt6_insert(struct vrf *vrf, struct lpm6 *lpm,
 		return err;
 	}
 
+	return rt6_insert_nh(vrf, lpm, table_id, dst, prefix_len, scope,
+			     *idx, size, replace);
+}
+
+/*
+ * Add or replace a route using the given nexthop, which the route takes
+ * the caller's reference on.
+ */
+static int rt6_insert_nh(struct vrf *vrf, struct lpm6 *lpm,
+			 uint32_t table_id,
+			 const struct in6_addr *dst, uint8_t prefix_len,
+			 int16_t scope, uint32_t idx, size_t size,
+			 bool replace)
+{
+	char b[INET6_ADDRSTRLEN];
+	uint32_t old_index;
+	int err;
+
 	route_delete_unlink_neigh(vrf, lpm, table_id, dst->s6_addr, prefix_len);
 	if (replace)
 		err = route_lpm6_update(vrf->v_id, lpm, dst, prefix_len,
-					&old_index, *idx, scope, table_id);
+					&old_index, idx, scope, table_id);
 	else
-		err = route_lpm6_add(vrf->v_id, lpm, dst, prefix_len, *idx,
+		err = route_lpm6_add(vrf->v_id, lpm, dst, prefix_len, idx,
 				     scope, table_id);
 	if (err < 0) {
 		RTE_LOG(ERR, ROUTE, "route insert %s/%u scope %u failed (%d)\n",
 			inet_ntop(AF_INET6, dst, b, sizeof(b)),
 			prefix_len, scope, err);
-		nexthop_put(AF_INET6, *idx);
+		nexthop_put(AF_INET6, idx);
 	} else {
 		if (replace)
 			nexthop_put(AF_INET6, old_index);
 		route_change_link_neigh(vrf, lpm, table_id, dst->s6_addr,
-					prefix_len, *idx, scope);
+					prefix_len, idx, scope);
 		DP_DEBUG(ROUTE, INFO, ROUTE,
 			 "route insert %s/%u index %u scope %u paths %lu\n",
 			 inet_ntop(AF_INET6, dst, b, sizeof(b)),
-			 prefix_len, *idx, scope, size);
+			 prefix_len, idx, scope, size);
 	}
 
 	return err;
@@ -1602,6 +1668,55 @@ err:
 	return err_code;
 }
 
+int rt6_add_pathgroup(vrfid_t vrf_id, struct in6_addr *dst,
+		      uint32_t prefix_len, uint32_t table, int16_t scope,
+		      uint32_t pathgroup)
+{
+	const struct next_hop_list *nextl;
+	struct lpm6 *lpm;
+	struct vrf *vrf;
+	uint32_t nhindex;
+	bool replace;
+	int err_code;
+
+	if (table == RT_TABLE_LOCAL)
+		table = RT_TABLE_MAIN;
+	if (table == RT_TABLE_UNSPEC)
+		return -ENOENT;
+
+	vrf = vrf_get_rcu(vrf_id);
+	if (!vrf)
+		return -ENOENT;
+	lpm = rt6_get_lpm(&vrf->v_rt6_head, table);
+	if (lpm == NULL) {
+		lpm = rt6_create_lpm(table, vrf);
+		if (lpm == NULL)
+			return -ENOENT;
+	}
+
+	pthread_mutex_lock(&route6_mutex);
+	replace = lpm6_nexthop_lookup(lpm, dst->s6_addr, prefix_len,
+				      scope, &nhindex) == 0;
+	if (replace && prefix_len == 128 && rt6_is_nh_local(nhindex)) {
+		pthread_mutex_unlock(&route6_mutex);
+		DP_DEBUG(ROUTE, DEBUG, ROUTE,
+			 "Will not supercede local /128 for %s\n",
+			 ip6_sprintf(dst));
+		return 0;
+	}
+
+	err_code = nh_pathgroup_get(AF_INET6, pathgroup, &nhindex);
+	if (err_code == 0) {
+		nextl = rcu_dereference(nh6_tbl.entry[nhindex]);
+		err_code = rt6_insert_nh(vrf, lpm, table, dst, prefix_len,
+					 scope, nhindex, nextl->nsiblings,
+					 replace);
+	}
+	pthread_mutex_unlock(&route6_mutex);
+
+	return err_code < 0 ? err_code : 0;
+}
+
 /* Gleaner for the next hop */
 static void flush6_cleanup(struct lpm6_walk_params *params,
 			   struct pd_obj_state_and_flags *pd_state __rte_unused,
@@ -2825,6 +2940,29 @@ static void route6_fal_upd_for_changed_nhl(
 	params->call_tracker_cbs = true;
 }
 
+/*
+ * The paths of a next_hop_list have been replaced in place, e.g. for a
+ * path group.  Forwarding already uses the new paths; link them to any
+ * resolved neighbours, and move the platform routes over.
+ */
+static void route6_nhl_replaced(uint32_t nhl_idx, bool fal_upd)
+{
+	struct next_hop_list *nhl;
+
+	pthread_mutex_lock(&route6_mutex);
+	nhl = rcu_dereference(nh6_tbl.entry[nhl_idx]);
+	if (nhl)
+		route6_change_process_nh(nhl,
+					 routing_neigh_add_gw_nh_replace_cb);
+	pthread_mutex_unlock(&route6_mutex);
+
+	if (!fal_upd)
+		return;
+
+	rt6_lpm_walk_util(route6_fal_upd_for_changed_nhl, &nhl_idx);
+	mpls_update_all_routes_for_nh_change(AF_INET6, nhl_idx);
+}
+
 static void
 route6_handle_fal_l3_enable_change(struct ifnet *ifp)
 {
@@ -57,6 +57,9 @@ struct next_hop *rt6_lookup_fast(struct vrf *vrf,
 				 const struct rte_mbuf *m);
 
 void rt6_prefetch(const struct rte_mbuf *m, const struct in6_addr *dst);
+void rt6_lookup_bulk_fast(struct vrf *vrf, const struct in6_addr *dsts[],
+			  uint32_t tbl_id, struct rte_mbuf *const ms[],
+			  struct next_hop *nhs[], unsigned int n);
 void rt6_prefetch_fast(const struct rte_mbuf *m, const struct in6_addr *dst)
 	__hot_func;
 bool rt6_valid_tblid(vrfid_t vrfid, uint32_t tbl_id) __hot_func;
@@ -66,6 +69,13 @@ struct rtmsg;
 int rt6_add(vrfid_t vrf_id, struct in6_addr *dst, uint32_t prefix_len,
 	    uint32_t table, int16_t scope, struct next_hop hops[],
 	    size_t size);
+/*
+ * Add or replace a route using the paths of a path group, so that it
+ * follows changes to the group.
+ */
+int rt6_add_pathgroup(vrfid_t vrf_id, struct in6_addr *dst,
+		      uint32_t prefix_len, uint32_t table, int16_t scope,
+		      uint32_t pathgroup);
 int rt6_delete(vrfid_t vrf_id, const struct in6_addr *dst,
 	       uint8_t prefix_len, uint32_t id, uint16_t scope,
 	       bool is_local);
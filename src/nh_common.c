@@ -17,6 +17,7 @@
 #include "vplane_debug.h"
 
 static struct cds_lfht *next_hop_intf_hash;
+static struct cds_lfht *nh_pathgroup_hash;
 
 /*
  * use entry 0 for AF_INET
@@ -109,6 +110,15 @@ static struct next_hop_list *nh_common_get_blackhole(int af_family)
 	return NULL;
 }
 
+static nh_common_nhl_replaced_fn *nh_common_get_replaced_fn(int af_family)
+{
+	int family = af_family_to_family(af_family);
+	if (family < 0)
+		return NULL;
+
+	return nh_common_af[family].nh_replaced;
+}
+
 ALWAYS_INLINE struct ifnet *
 dp_nh_get_ifp(const struct next_hop *next_hop)
 {
@@ -1197,14 +1207,16 @@ static void next_hop_list_setup_back_ptrs(struct next_hop_list *nextl)
 }
 
 /* Lookup (or create) nexthop based on hop information */
-int nexthop_new(int family, const struct next_hop *nh, uint16_t size,
-		uint8_t proto, enum fal_next_hop_group_use use, uint32_t *slot)
+static int __nexthop_new(int family, const struct next_hop *nh, uint16_t size,
+			 uint8_t proto, enum fal_next_hop_group_use use,
+			 uint32_t pathgroup, uint32_t *slot)
 {
 	struct nexthop_hash_key key = {
 		.nh = nh,
 		.size = size,
 		.proto = proto,
 		.use = use,
+		.pathgroup = pathgroup,
 	};
 	struct next_hop_list *nextl;
 	uint32_t rover;
@@ -1241,6 +1253,7 @@ int nexthop_new(int family, const struct next_hop *nh, uint16_t size,
 	nextl->index = rover;
 	nextl->proto = proto;
 	nextl->use = use;
+	nextl->pathgroup = pathgroup;
 	if (size == 1)
 		nextl->hop0 = *nh;
 	else
@@ -1287,6 +1300,12 @@ int nexthop_new(int family, const struct next_hop *nh, uint16_t size,
 	return 0;
 }
 
+int nexthop_new(int family, const struct next_hop *nh, uint16_t size,
+		uint8_t proto, enum fal_next_hop_group_use use, uint32_t *slot)
+{
+	return __nexthop_new(family, nh, size, proto, use, 0, slot);
+}
+
 struct next_hop *
 nexthop_create(struct ifnet *ifp, struct ip_addr *gw, uint32_t flags,
 	       uint16_t num_labels, label_t *labels)
@@ -1417,7 +1436,8 @@ nexthop_hash_del_add(int family,
 		.nh = new_nhl->siblings,
 		.size = new_nhl->nsiblings,
 		.proto = new_nhl->proto,
-		.use = new_nhl->use
+		.use = new_nhl->use,
+		.pathgroup = new_nhl->pathgroup,
 	};
 	struct cds_lfht *hash_tbl = nh_common_get_hash_table(family);
 
@@ -1659,6 +1679,7 @@ next_hop_list_create_copy_start(int family __unused,
 	new_nextl->index = old->index;
 	new_nextl->refcount = old->refcount;
 	new_nextl->use = old->use;
+	new_nextl->pathgroup = old->pathgroup;
 
 	return new_nextl;
 }
@@ -1891,3 +1912,244 @@ next_hop_list_get_fal_nhs(int family, uint32_t nhl_idx,
 	*hops = nextl->siblings;
 	return nextl->nsiblings;
 }
+
+/*
+ * Replace a next_hop_list in the nexthop table with one with different
+ * paths, in the same slot, so that everything referring to the slot
+ * uses the new paths.
+ */
+static int
+next_hop_list_replace(int family, struct next_hop_list *old,
+		      const struct next_hop *nh, uint16_t size, uint8_t proto)
+{
+	struct nexthop_table *nh_table = nh_common_get_nh_table(family);
+	nh_common_nhl_replaced_fn *replaced_fn =
+		nh_common_get_replaced_fn(family);
+	struct next_hop_list *new;
+	bool fal_upd;
+	int ret;
+	int i;
+
+	ASSERT_MAIN();
+
+	new = nexthop_alloc(size);
+	if (!new)
+		return -ENOMEM;
+
+	new->refcount = old->refcount;
+	new->index = old->index;
+	new->proto = proto;
+	new->use = old->use;
+	new->pathgroup = old->pathgroup;
+	if (size == 1)
+		new->hop0 = *nh;
+	else
+		memcpy(new->siblings, nh, size * sizeof(struct next_hop));
+	next_hop_list_setup_back_ptrs(new);
+
+	if (next_hop_list_init_map(new)) {
+		__nexthop_destroy(new);
+		return -ENOMEM;
+	}
+	new->primaries = next_hop_list_primary_count(new);
+
+	ret = nexthop_hash_del_add(family, old, new);
+	if (ret)
+		RTE_LOG(ERR, ROUTE,
+			"IPv%d next hop %u hash replace failed: %d\n",
+			family == AF_INET ? 4 : 6, old->index, ret);
+
+	ret = fal_ip_new_next_hops(new->use, new->nsiblings,
+				   new->siblings, &new->nhg_fal_obj,
+				   new->nh_fal_obj);
+	if (ret < 0 && ret != -EOPNOTSUPP)
+		RTE_LOG(ERR, ROUTE,
+			"FAL IPv%d next-hop-group create failed: %s\n",
+			family == AF_INET ? 4 : 6, strerror(-ret));
+	new->pd_state = fal_state_to_pd_state(ret);
+
+	for (i = 0; i < old->nsiblings; i++) {
+		struct next_hop *next = old->siblings + i;
+
+		if (nh_is_neigh_present(next))
+			nh_table->neigh_present--;
+		if (nh_is_neigh_created(next))
+			nh_table->neigh_created--;
+	}
+
+	next_hop_list_untrack_protected_nh(old);
+
+	/* The switch over, for everything using the slot */
+	assert(nh_table->entry[old->index] == old);
+	rcu_xchg_pointer(&nh_table->entry[old->index], new);
+
+	next_hop_list_track_protected_nh(new);
+
+	fal_upd = fal_state_is_obj_present(old->pd_state) ||
+		fal_state_is_obj_present(new->pd_state);
+	if (replaced_fn)
+		replaced_fn(new->index, fal_upd);
+
+	if (fal_state_is_obj_present(old->pd_state)) {
+		ret = fal_ip_del_next_hops(old->nhg_fal_obj,
+					   old->nsiblings,
+					   old->nh_fal_obj);
+		if (ret < 0)
+			RTE_LOG(ERR, ROUTE,
+				"FAL IPv%d next-hop-group delete failed: %s\n",
+				family == AF_INET ? 4 : 6, strerror(-ret));
+	}
+
+	call_rcu(&old->rcu, nexthop_destroy);
+
+	return 0;
+}
+
+struct nh_pathgroup {
+	struct cds_lfht_node	pg_node;
+	uint32_t		pg_id;
+	int			pg_family;
+	uint32_t		pg_nhl_idx;
+	struct rcu_head		pg_rcu;
+};
+
+struct nh_pathgroup_key {
+	uint32_t	id;
+	int		family;
+};
+
+static unsigned long nh_pathgroup_hash_fn(const struct nh_pathgroup_key *key)
+{
+	return rte_jhash_2words(key->id, key->family, 0);
+}
+
+static int nh_pathgroup_cmp_fn(struct cds_lfht_node *node, const void *key)
+{
+	const struct nh_pathgroup_key *pg_key = key;
+	const struct nh_pathgroup *pg =
+		caa_container_of(node, const struct nh_pathgroup, pg_node);
+
+	return pg->pg_id == pg_key->id && pg->pg_family == pg_key->family;
+}
+
+static struct nh_pathgroup *nh_pathgroup_lookup(int family, uint32_t id)
+{
+	struct nh_pathgroup_key key = {
+		.id = id,
+		.family = family,
+	};
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+
+	if (!nh_pathgroup_hash)
+		return NULL;
+
+	cds_lfht_lookup(nh_pathgroup_hash, nh_pathgroup_hash_fn(&key),
+			nh_pathgroup_cmp_fn, &key, &iter);
+	node = cds_lfht_iter_get_node(&iter);
+	if (node)
+		return caa_container_of(node, struct nh_pathgroup, pg_node);
+	return NULL;
+}
+
+static void nh_pathgroup_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct nh_pathgroup, pg_rcu));
+}
+
+int nh_pathgroup_update(int family, uint32_t id, const struct next_hop *nh,
+			uint16_t size, uint8_t proto)
+{
+	struct nexthop_table *nh_table = nh_common_get_nh_table(family);
+	struct nh_pathgroup_key key = {
+		.id = id,
+		.family = family,
+	};
+	struct next_hop_list *nextl;
+	struct nh_pathgroup *pg;
+	int rc;
+
+	ASSERT_MAIN();
+
+	if (!nh_table || !id || !size)
+		return -EINVAL;
+
+	pg = nh_pathgroup_lookup(family, id);
+	if (pg) {
+		nextl = rcu_dereference(nh_table->entry[pg->pg_nhl_idx]);
+		return next_hop_list_replace(family, nextl, nh, size, proto);
+	}
+
+	if (!nh_pathgroup_hash) {
+		nh_pathgroup_hash = cds_lfht_new(NEXTHOP_HASH_TBL_MIN,
+						 NEXTHOP_HASH_TBL_MIN,
+						 NEXTHOP_HASH_TBL_SIZE,
+						 CDS_LFHT_AUTO_RESIZE,
+						 NULL);
+		if (!nh_pathgroup_hash)
+			return -ENOMEM;
+	}
+
+	pg = calloc(1, sizeof(*pg));
+	if (!pg)
+		return -ENOMEM;
+
+	pg->pg_id = id;
+	pg->pg_family = family;
+
+	/* The group holds a reference on its list until deleted */
+	rc = __nexthop_new(family, nh, size, proto, FAL_NHG_USE_IP, id,
+			   &pg->pg_nhl_idx);
+	if (rc < 0) {
+		free(pg);
+		return rc;
+	}
+
+	cds_lfht_node_init(&pg->pg_node);
+	cds_lfht_add(nh_pathgroup_hash, nh_pathgroup_hash_fn(&key),
+		     &pg->pg_node);
+
+	DP_DEBUG(ROUTE, DEBUG, ROUTE,
+		 "IPv%d pathgroup %u added, nexthop %u\n",
+		 family == AF_INET ? 4 : 6, id, pg->pg_nhl_idx);
+	return 0;
+}
+
+int nh_pathgroup_delete(int family, uint32_t id)
+{
+	struct nh_pathgroup *pg;
+
+	ASSERT_MAIN();
+
+	pg = nh_pathgroup_lookup(family, id);
+	if (!pg)
+		return -ENOENT;
+
+	cds_lfht_del(nh_pathgroup_hash, &pg->pg_node);
+	nexthop_put(family, pg->pg_nhl_idx);
+	call_rcu(&pg->pg_rcu, nh_pathgroup_free);
+
+	return 0;
+}
+
+bool nh_pathgroup_exists(int family, uint32_t id)
+{
+	return nh_pathgroup_lookup(family, id) != NULL;
+}
+
+int nh_pathgroup_get(int family, uint32_t id, uint32_t *slot)
+{
+	struct nexthop_table *nh_table = nh_common_get_nh_table(family);
+	struct next_hop_list *nextl;
+	struct nh_pathgroup *pg;
+
+	pg = nh_pathgroup_lookup(family, id);
+	if (!pg || !nh_table)
+		return -ENOENT;
+
+	nextl = rcu_dereference(nh_table->entry[pg->pg_nhl_idx]);
+	nextl->refcount++;
+	*slot = pg->pg_nhl_idx;
+
+	return 0;
+}
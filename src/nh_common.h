@@ -53,6 +53,7 @@ struct next_hop_list {
 	uint8_t              primaries; /* number of primary next hops */
 	uint8_t              padding;
 	uint32_t             index;
+	uint32_t             pathgroup; /* owning pathgroup id, or 0 */
 	struct nh_map        *nh_map;
 	struct next_hop      hop0;      /* optimization for non-ECMP */
 	uint32_t             refcount;	/* # of LPM's referring */
@@ -73,6 +74,7 @@ struct nexthop_hash_key {
 	size_t		       size;
 	uint8_t		       proto;
 	enum fal_next_hop_group_use use;
+	uint32_t	       pathgroup;
 };
 
 /*
@@ -127,6 +129,56 @@ nexthop_create(struct ifnet *ifp, struct ip_addr *gw, uint32_t flags,
 
 void nexthop_put(int family, uint32_t idx);
 
+/*
+ * Path groups.
+ *
+ * A path group is a next_hop_list, identified by an id chosen by the
+ * RIB, that routes refer to instead of carrying their own paths, e.g.
+ * all the prefixes learnt from a BGP nexthop.  A path group's list is
+ * never shared with routes that carry their own paths.  Changing the
+ * paths of the group replaces the list in its slot of the nexthop
+ * table, so every route using it is rerouted at once without the LPM
+ * being touched.
+ *
+ * Main thread only.
+ */
+
+/*
+ * Create a path group, or replace its paths.
+ *
+ * @param[in] family The address family of the group
+ * @param[in] id The id of the group, non-zero
+ * @param[in] nh An array of next_hops, of size 'size', which are
+ *            shallow copied
+ * @param[in] size The number of next_hops
+ * @param[in] proto The routing protocol
+ *
+ * @return 0 on success
+ *         -ve on failure
+ */
+int nh_pathgroup_update(int family, uint32_t id, const struct next_hop *nh,
+			uint16_t size, uint8_t proto);
+
+/*
+ * Delete a path group.  Routes still using it keep its last paths until
+ * they are deleted or changed.
+ */
+int nh_pathgroup_delete(int family, uint32_t id);
+
+/* Is there a path group with this id? */
+bool nh_pathgroup_exists(int family, uint32_t id);
+
+/*
+ * Take a reference on the next_hop_list of a path group for a route,
+ * to be released with nexthop_put.
+ *
+ * @param[out] slot The index of the list in the nexthop table
+ *
+ * @return 0 on success
+ *         -ENOENT if there is no such group
+ */
+int nh_pathgroup_get(int family, uint32_t id, uint32_t *slot);
+
 /*
  * Copy the contents of the old next hop into the new next hop. It does
  * not copy things like list ptrs and hash entries.
@@ -416,6 +468,14 @@ typedef struct cds_lfht *(nh_common_get_hash_tbl_fn)(void);
  */
 typedef struct nexthop_table *(nh_common_get_nh_tbl_fn)(void);
 
+/*
+ * Called when the next_hop_list in a slot of the nexthop table has been
+ * replaced with one with different paths, to link the new paths to
+ * their neighbours, and if 'fal_upd' is set to update the platform
+ * routes using the slot to the new next-hop-group object.
+ */
+typedef void (nh_common_nhl_replaced_fn)(uint32_t nhl_idx, bool fal_upd);
+
 /*
  * Structure to hold all the function pointers required to do the
  * NH processing that differs between address families.
@@ -426,6 +486,7 @@ struct nh_common {
 	nh_common_get_hash_tbl_fn *nh_get_hash_tbl;
 	nh_common_get_nh_tbl_fn *nh_get_nh_tbl;
 	struct next_hop_list *(*nh_get_blackhole)(void);
+	nh_common_nhl_replaced_fn *nh_replaced;
 };
 
 /*
@@ -28,6 +28,8 @@
  *
  * cgn-cfg events rte_log|protobuf <type> enable|disable
  * cgn-cfg events protobuf <type> hwm <integer>
+ * cgn-cfg events ipfix <type> enable|disable
+ * cgn-cfg events ipfix file <path> [<size-bytes> [<count>]]
  * cgn-cfg events core [<core-num>]
  *
  * -----------------------------------------------
@@ -59,6 +61,7 @@
 #include "npf/cgnat/cgn_session.h"
 #include "npf/cgnat/cgn_cmd_cfg.h"
 #include "npf/cgnat/cgn_log.h"
+#include "npf/cgnat/cgn_log_ipfix.h"
 #include "npf/cgnat/cgn_log_protobuf_zmq.h"
 
 
@@ -338,6 +341,8 @@ static int cgn_events_cfg_rte_log(FILE *f, int argc, char **argv)
 
 /*
  * cgn-cfg events protobuf <type> enable|disable|hwm
+ * cgn-cfg events protobuf <type> endpoint [<url>]
+ * cgn-cfg events protobuf <type> batch [<records-per-message>]
  *
  * <type> is one of session, port-block-allocation, subscriber,
  * or resource-constraint
@@ -397,6 +402,107 @@ static int cgn_events_cfg_protobuf(FILE *f, int argc, char **argv)
 					argc >= 6 ? argv[5] : "default");
 			return -1;
 		}
+	} else if (strcmp(argv[4], "batch") == 0) {
+		uint32_t batch;
+
+		if (argc >= 6)
+			batch = atoi(argv[5]);
+		else
+			batch = 0;	/* default of one record per message */
+
+		rc = cl_zmq_set_batch(ltype, batch);
+		if (rc < 0) {
+			if (f)
+				fprintf(f, "%s: cl_zmq_set_batch failed "
+					"for type %s, batch \"%s\"",
+					__func__, ltype_str,
+					argc >= 6 ? argv[5] : "default");
+			return -1;
+		}
+	} else if (strcmp(argv[4], "endpoint") == 0) {
+		/* No url for the default */
+		rc = cl_zmq_set_endpoint(ltype, argc >= 6 ? argv[5] : NULL);
+		if (rc < 0) {
+			if (f)
+				fprintf(f, "%s: cl_zmq_set_endpoint failed "
+					"for type %s, endpoint \"%s\"",
+					__func__, ltype_str,
+					argc >= 6 ? argv[5] : "default");
+			return -1;
+		}
+	} else {
+		if (f)
+			fprintf(f, "%s: unexpected value %s for type %s",
+				__func__, argv[4], ltype_str);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * cgn-cfg events ipfix <type> enable|disable
+ * cgn-cfg events ipfix file <path> [<size-bytes> [<count>]]
+ *
+ * <type> is session or port-block-allocation
+ */
+static int cgn_events_cfg_ipfix(FILE *f, int argc, char **argv)
+{
+	const char *ltype_str;
+	enum cgn_log_type ltype;
+	int rc;
+
+	if (argc < 5) {
+		if (f)
+			fprintf(f, "%s: need at least 5 fields", __func__);
+		return -1;
+	}
+
+	if (strcmp(argv[3], "file") == 0) {
+		uint64_t size = 0;
+		uint32_t count = 4;
+
+		if (argc >= 6)
+			size = strtoull(argv[5], NULL, 10);
+		if (argc >= 7)
+			count = strtoul(argv[6], NULL, 10);
+
+		rc = cl_ipfix_set_file(argv[4], size, count);
+		if (rc < 0) {
+			if (f)
+				fprintf(f, "%s: cl_ipfix_set_file failed "
+					"for file %s", __func__, argv[4]);
+			return -1;
+		}
+		return 0;
+	}
+
+	ltype_str = argv[3];
+
+	rc = cgn_get_log_type(ltype_str, &ltype);
+	if (rc < 0) {
+		if (f)
+			fprintf(f, "%s: unknown event type %s", __func__,
+				ltype_str);
+		return -1;
+	}
+
+	if (strcmp(argv[4], "enable") == 0) {
+		rc = cgn_log_enable_handler(ltype, "ipfix");
+		if (rc < 0 && rc != -EEXIST) {
+			if (f)
+				fprintf(f, "%s: cgn_log_enable_handler failed "
+					"for type %s", __func__, ltype_str);
+			return -1;
+		}
+	} else if (strcmp(argv[4], "disable") == 0) {
+		rc = cgn_log_disable_handler(ltype, "ipfix");
+		if (rc < 0 && rc != -ENOENT) {
+			if (f)
+				fprintf(f, "%s: cgn_log_disable_handler failed "
+					"for type %s", __func__, ltype_str);
+			return -1;
+		}
 	} else {
 		if (f)
 			fprintf(f, "%s: unexpected value %s for type %s",
@@ -449,7 +555,7 @@ static int cgn_events_cfg_core(FILE *f, int argc, char **argv)
 }
 
 /*
- * cgn-cfg events rte_log|protobuf
+ * cgn-cfg events rte_log|protobuf|ipfix
  */
 static int cgn_events_cfg(FILE *f, int argc, char **argv)
 {
@@ -464,6 +570,9 @@ static int cgn_events_cfg(FILE *f, int argc, char **argv)
 	else if (strcmp(argv[2], "protobuf") == 0)
 		rc = cgn_events_cfg_protobuf(f, argc, argv);
 
+	else if (strcmp(argv[2], "ipfix") == 0)
+		rc = cgn_events_cfg_ipfix(f, argc, argv);
+
 	else if (strcmp(argv[2], "core") == 0)
 		rc = cgn_events_cfg_core(f, argc, argv);
 
@@ -474,8 +583,8 @@ static int cgn_events_cfg(FILE *f, int argc, char **argv)
 
 usage:
 	if (f)
-		fprintf(f, "%s: cgn-cfg events {rte_log|protobuf|core} ... ",
-			__func__);
+		fprintf(f, "%s: cgn-cfg events "
+			"{rte_log|protobuf|ipfix|core} ... ", __func__);
 
 	return -1;
 }
@@ -31,6 +31,7 @@
 #include "npf/cgnat/cgn_policy.h"
 #include "npf/cgnat/cgn_session.h"
 #include "npf/cgnat/cgn_source.h"
+#include "npf/cgnat/cgn_log_ipfix.h"
 #include "npf/cgnat/cgn_log_protobuf_zmq.h"
 
 
@@ -286,6 +287,9 @@ int cmd_cgn_op(FILE *f, int argc, char **argv)
 		else if (!strcmp(argv[2], "zmq"))
 			cgn_show_zmq(f);
 
+		else if (!strcmp(argv[2], "ipfix"))
+			cgn_show_ipfix(f);
+
 		else if (!strcmp(argv[2], "interface"))
 			cgn_show_interface(f, argc, argv);
 
@@ -45,11 +45,13 @@ int cgn_get_log_type(const char *name, enum cgn_log_type *type)
 	return -ENOENT;
 }
 
-extern const struct cgn_log_fns cgn_rte_log_fns, cgn_protobuf_fns;
+extern const struct cgn_log_fns cgn_rte_log_fns, cgn_protobuf_fns,
+	cgn_ipfix_fns;
 
 static const struct cgn_log_fns *cgn_log_fns[] = {
 	&cgn_rte_log_fns,
 	&cgn_protobuf_fns,
+	&cgn_ipfix_fns,
 };
 
 struct cgn_log_active_fns {
@@ -235,6 +237,9 @@ void cgn_log_disable_all_handlers(void)
 		while (*afnsp != NULL) {
 			struct cgn_log_active_fns *old = *afnsp;
 			rcu_assign_pointer(*afnsp, old->cla_next);
+			if (old->cla_fns->cl_fini)
+				old->cla_fns->cl_fini(old->cla_ltype,
+						      old->cla_fns);
 			call_rcu(&old->rcu, cgn_log_handler_reclaim);
 		}
 	}
@@ -100,6 +100,7 @@ int cgn_get_log_type(const char *name, enum cgn_log_type *type);
 enum cgn_log_format {
 	CGN_LOG_FORMAT_RTE_LOG,
 	CGN_LOG_FORMAT_PROTOBUF,
+	CGN_LOG_FORMAT_IPFIX,
 
 	CGN_LOG_FORMAT_COUNT		/* Must be last */
 };
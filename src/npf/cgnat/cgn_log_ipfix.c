@@ -0,0 +1,859 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/**
+ * @file cgn_log_ipfix.c - cgnat logging of fixed layout ipfix records
+ *
+ * Session and port block events are logged as IPFIX (RFC 7011) data
+ * records of a fixed layout, using the NAT information elements of
+ * RFC 8158.  Records are a few tens of bytes each, against a few
+ * hundred for a protobuf or rte_log message, and are built with no
+ * allocation or serialisation.
+ *
+ * Each lcore packs its records into its own MTU sized IPFIX message,
+ * under a lock that is only contended by the flush timer.  Full
+ * messages, and partial ones once a second, are copied to a memory
+ * mapped file.
+ *
+ * The observation domain of a message is the lcore that built it, so
+ * sequence numbers are per lcore.  The first message of each domain
+ * in a file is preceded by a template message for that domain.
+ *
+ * A full file is swapped for a standby file, <file>.next, which the
+ * main thread opens, allocates and maps ahead of time.  The main thread then closes the
+ * full file, renames it and the older files to <file>.1, <file>.2
+ * etc., keeping a configured number, renames the standby to <file>
+ * and opens a new standby.  So the forwarding lcores never wait on
+ * the file system.  Messages are dropped if there is no standby file
+ * when one is needed, and the main thread retries once a second.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <rte_byteorder.h>
+#include <rte_lcore.h>
+#include <rte_spinlock.h>
+#include <rte_timer.h>
+
+#include "compiler.h"
+#include "json_writer.h"
+#include "util.h"
+#include "soft_ticks.h"
+#include "vplane_log.h"
+
+#include "npf/cgnat/cgn.h"
+#include "npf/cgnat/cgn_log.h"
+#include "npf/cgnat/cgn_log_ipfix.h"
+#include "npf/cgnat/cgn_sess_state.h"
+#include "npf/cgnat/cgn_session.h"
+#include "npf/cgnat/cgn_sess2.h"
+
+#define CL_IPFIX_VERSION	10
+#define CL_IPFIX_SET_TEMPLATE	2
+
+/* Leaves room for IP and UDP headers, should they be exported */
+#define CL_IPFIX_MSG_SIZE	1400
+#define CL_IPFIX_FLUSH_SECS	1
+#define CL_IPFIX_SHARED_BUF	RTE_MAX_LCORE
+
+#define CL_IPFIX_FILE_DEFAULT	"/var/log/vyatta/cgnat-events.ipfix"
+#define CL_IPFIX_SIZE_DEFAULT	(64ul << 20)
+#define CL_IPFIX_SIZE_MIN	(64ul << 10)
+#define CL_IPFIX_COUNT_DEFAULT	4
+
+/* Template IDs */
+#define CL_IPFIX_TMPL_SESS_START	256
+#define CL_IPFIX_TMPL_SESS_END		257
+#define CL_IPFIX_TMPL_PB		258
+
+/* natEvent values, RFC 8158 */
+#define CL_IPFIX_NAT44_SESS_CREATE	4
+#define CL_IPFIX_NAT44_SESS_DELETE	5
+#define CL_IPFIX_NAT_PB_ALLOC		13
+#define CL_IPFIX_NAT_PB_DEALLOC		14
+
+struct cl_ipfix_hdr {
+	uint16_t	version;
+	uint16_t	length;
+	uint32_t	export_time;
+	uint32_t	seq;
+	uint32_t	domain;
+} __rte_packed;
+
+struct cl_ipfix_set_hdr {
+	uint16_t	id;
+	uint16_t	length;
+} __rte_packed;
+
+struct cl_ipfix_tmpl_hdr {
+	uint16_t	id;
+	uint16_t	count;
+} __rte_packed;
+
+/*
+ * Data records, in network byte order.  Each must match the template
+ * of the same name below.
+ */
+struct cl_ipfix_sess_rec {
+	uint64_t	time_ms;
+	uint8_t		event;
+	uint8_t		proto;
+	uint32_t	ifindex;
+	uint32_t	saddr;
+	uint16_t	sport;
+	uint32_t	nat_addr;
+	uint16_t	nat_port;
+	uint32_t	daddr;
+	uint16_t	dport;
+} __rte_packed;
+
+struct cl_ipfix_sess_end_rec {
+	struct cl_ipfix_sess_rec sess;
+	uint64_t	start_ms;
+	uint64_t	out_bytes;
+	uint64_t	in_bytes;
+	uint64_t	out_pkts;
+	uint64_t	in_pkts;
+} __rte_packed;
+
+struct cl_ipfix_pb_rec {
+	uint64_t	time_ms;
+	uint8_t		event;
+	uint32_t	saddr;
+	uint32_t	nat_addr;
+	uint16_t	port_start;
+	uint16_t	port_end;
+} __rte_packed;
+
+/* Information element ID and length */
+struct cl_ipfix_field {
+	uint16_t	id;
+	uint16_t	len;
+};
+
+#define CL_IPFIX_SESS_FIELDS				\
+	{ 323, 8 },	/* observationTimeMilliseconds */ \
+	{ 230, 1 },	/* natEvent */			\
+	{ 4, 1 },	/* protocolIdentifier */	\
+	{ 10, 4 },	/* ingressInterface */		\
+	{ 8, 4 },	/* sourceIPv4Address */		\
+	{ 7, 2 },	/* sourceTransportPort */	\
+	{ 225, 4 },	/* postNATSourceIPv4Address */	\
+	{ 227, 2 },	/* postNAPTSourceTransportPort */ \
+	{ 12, 4 },	/* destinationIPv4Address */	\
+	{ 11, 2 }	/* destinationTransportPort */
+
+static const struct cl_ipfix_field cl_ipfix_sess_start_fields[] = {
+	CL_IPFIX_SESS_FIELDS,
+};
+
+static const struct cl_ipfix_field cl_ipfix_sess_end_fields[] = {
+	CL_IPFIX_SESS_FIELDS,
+	{ 152, 8 },	/* flowStartMilliseconds */
+	{ 231, 8 },	/* initiatorOctets */
+	{ 232, 8 },	/* responderOctets */
+	{ 298, 8 },	/* initiatorPackets */
+	{ 299, 8 },	/* responderPackets */
+};
+
+static const struct cl_ipfix_field cl_ipfix_pb_fields[] = {
+	{ 323, 8 },	/* observationTimeMilliseconds */
+	{ 230, 1 },	/* natEvent */
+	{ 8, 4 },	/* sourceIPv4Address */
+	{ 225, 4 },	/* postNATSourceIPv4Address */
+	{ 361, 2 },	/* portRangeStart */
+	{ 362, 2 },	/* portRangeEnd */
+};
+
+static const struct cl_ipfix_tmpl {
+	uint16_t			id;
+	uint16_t			count;
+	const struct cl_ipfix_field	*fields;
+} cl_ipfix_tmpls[] = {
+	{ CL_IPFIX_TMPL_SESS_START, ARRAY_SIZE(cl_ipfix_sess_start_fields),
+	  cl_ipfix_sess_start_fields },
+	{ CL_IPFIX_TMPL_SESS_END, ARRAY_SIZE(cl_ipfix_sess_end_fields),
+	  cl_ipfix_sess_end_fields },
+	{ CL_IPFIX_TMPL_PB, ARRAY_SIZE(cl_ipfix_pb_fields),
+	  cl_ipfix_pb_fields },
+};
+
+/* An IPFIX message being built by one lcore */
+struct cl_ipfix_buf {
+	rte_spinlock_t	lock;
+	uint16_t	len;
+	uint16_t	set_off;	/* current data set */
+	uint16_t	set_id;		/* 0 if none */
+	uint32_t	nrec;		/* records in message */
+	uint32_t	seq;		/* records exported before message */
+	uint64_t	tmpl_file;	/* file template was last written to */
+	uint64_t	records;
+	uint8_t		data[CL_IPFIX_MSG_SIZE];
+} __rte_cache_aligned;
+
+static struct cl_ipfix_buf *cl_ipfix_bufs;
+static unsigned int cl_ipfix_nenabled;	/* log types using ipfix */
+static struct rte_timer cl_ipfix_timer;
+
+/* Template message, less the header which is filled in per domain */
+static uint8_t cl_ipfix_tmpl[CL_IPFIX_MSG_SIZE];
+static uint16_t cl_ipfix_tmpl_len;
+
+/* A memory mapped file */
+struct cl_ipfix_file {
+	int		fd;
+	uint8_t		*base;
+	uint64_t	size;
+	uint64_t	off;
+};
+
+#define CL_IPFIX_FILE_INIT { .fd = -1 }
+
+static struct cl_ipfix_sink {
+	rte_spinlock_t	lock;
+	char		path[PATH_MAX];
+	uint64_t	size;
+	uint32_t	count;		/* old files kept */
+
+	/* Path of the open files, as path may be changed while open */
+	char		file_path[PATH_MAX];
+	char		next_path[PATH_MAX + 8];
+
+	struct cl_ipfix_file cur;	/* being written */
+	struct cl_ipfix_file next;	/* standby */
+	struct cl_ipfix_file full;	/* swapped out, for main to close */
+
+	uint64_t	files;
+	uint64_t	msgs;
+	uint64_t	bytes;
+	uint64_t	write_fails;
+	uint64_t	open_fails;
+} cl_ipfix_sink = {
+	.lock = RTE_SPINLOCK_INITIALIZER,
+	.path = CL_IPFIX_FILE_DEFAULT,
+	.size = CL_IPFIX_SIZE_DEFAULT,
+	.count = CL_IPFIX_COUNT_DEFAULT,
+	.cur = CL_IPFIX_FILE_INIT,
+	.next = CL_IPFIX_FILE_INIT,
+	.full = CL_IPFIX_FILE_INIT,
+};
+
+static void cl_ipfix_hdr_fill(void *msg, uint16_t len, uint32_t seq,
+			      uint32_t domain)
+{
+	struct cl_ipfix_hdr *hdr = msg;
+
+	hdr->version = htons(CL_IPFIX_VERSION);
+	hdr->length = htons(len);
+	hdr->export_time = htonl(time(NULL));
+	hdr->seq = htonl(seq);
+	hdr->domain = htonl(domain);
+}
+
+/*
+ * Build the template message, that precedes the first message of each
+ * observation domain in a file.
+ */
+static uint16_t cl_ipfix_tmpl_msg(uint8_t *msg)
+{
+	struct cl_ipfix_set_hdr *set;
+	struct cl_ipfix_tmpl_hdr *th;
+	struct cl_ipfix_field *f;
+	uint16_t len = sizeof(struct cl_ipfix_hdr);
+	unsigned int i, j;
+
+	set = (struct cl_ipfix_set_hdr *)(msg + len);
+	len += sizeof(*set);
+
+	for (i = 0; i < ARRAY_SIZE(cl_ipfix_tmpls); i++) {
+		th = (struct cl_ipfix_tmpl_hdr *)(msg + len);
+		th->id = htons(cl_ipfix_tmpls[i].id);
+		th->count = htons(cl_ipfix_tmpls[i].count);
+		len += sizeof(*th);
+
+		for (j = 0; j < cl_ipfix_tmpls[i].count; j++) {
+			f = (struct cl_ipfix_field *)(msg + len);
+			f->id = htons(cl_ipfix_tmpls[i].fields[j].id);
+			f->len = htons(cl_ipfix_tmpls[i].fields[j].len);
+			len += sizeof(*f);
+		}
+	}
+
+	set->id = htons(CL_IPFIX_SET_TEMPLATE);
+	set->length = htons(len - sizeof(struct cl_ipfix_hdr));
+
+	return len;
+}
+
+/*
+ * Open and map a new file.  Main thread, sink lock not held.  The
+ * blocks of the file are allocated and its pages faulted in here, so
+ * that the lcores copying to it later don't fault into the file
+ * system.
+ */
+static int cl_ipfix_file_open(struct cl_ipfix_file *cf, const char *path,
+			      uint64_t size)
+{
+	void *base;
+	int fd, rc;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+	if (fd < 0)
+		return -errno;
+
+	rc = posix_fallocate(fd, 0, size);
+	if (rc) {
+		close(fd);
+		return -rc;
+	}
+
+	base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, fd, 0);
+	if (base == MAP_FAILED) {
+		close(fd);
+		return -errno;
+	}
+
+	cf->fd = fd;
+	cf->base = base;
+	cf->size = size;
+	cf->off = 0;
+
+	return 0;
+}
+
+/*
+ * Unmap and close a file, trimmed to what was written.  Main thread,
+ * the file no longer being in the sink.
+ */
+static void cl_ipfix_file_close(struct cl_ipfix_file *cf)
+{
+	if (cf->fd < 0)
+		return;
+
+	munmap(cf->base, cf->size);
+	if (ftruncate(cf->fd, cf->off) < 0)
+		RTE_LOG(ERR, CGNAT, "%s: truncate of ipfix file failed (%s)\n",
+			__func__, strerror(errno));
+	close(cf->fd);
+
+	*cf = (struct cl_ipfix_file)CL_IPFIX_FILE_INIT;
+}
+
+/*
+ * Close the file an lcore swapped out, and shift it and the old files
+ * up by one.  The current file, the old standby, becomes <file>.
+ * Main thread.
+ */
+static void cl_ipfix_file_retire(struct cl_ipfix_sink *sk)
+{
+	char from[PATH_MAX + 12], to[PATH_MAX + 12];
+	struct cl_ipfix_file full;
+	uint32_t i;
+
+	rte_spinlock_lock(&sk->lock);
+	full = sk->full;
+	sk->full = (struct cl_ipfix_file)CL_IPFIX_FILE_INIT;
+	rte_spinlock_unlock(&sk->lock);
+
+	if (full.fd < 0)
+		return;
+
+	cl_ipfix_file_close(&full);
+
+	for (i = sk->count; i > 1; i--) {
+		snprintf(from, sizeof(from), "%s.%u", sk->file_path, i - 1);
+		snprintf(to, sizeof(to), "%s.%u", sk->file_path, i);
+		rename(from, to);
+	}
+	if (sk->count > 0) {
+		snprintf(to, sizeof(to), "%s.1", sk->file_path);
+		rename(sk->file_path, to);
+	}
+	rename(sk->next_path, sk->file_path);
+}
+
+/*
+ * Open a standby file if there is none.  Main thread.  A failure is
+ * retried the next time the flush timer runs.
+ */
+static void cl_ipfix_file_standby(struct cl_ipfix_sink *sk)
+{
+	struct cl_ipfix_file next = CL_IPFIX_FILE_INIT;
+	int rc;
+
+	/* Only the main thread sets the standby */
+	if (sk->next.fd >= 0)
+		return;
+
+	rc = cl_ipfix_file_open(&next, sk->next_path, sk->size);
+	if (rc < 0) {
+		sk->open_fails++;
+		if (net_ratelimit())
+			RTE_LOG(ERR, CGNAT, "%s: open of %s failed (%s)\n",
+				__func__, sk->next_path, strerror(-rc));
+		return;
+	}
+
+	rte_spinlock_lock(&sk->lock);
+	sk->next = next;
+	rte_spinlock_unlock(&sk->lock);
+}
+
+/*
+ * Swap a full current file for the standby file, leaving the full
+ * file for the main thread to close.  Sink lock held.
+ */
+static bool cl_ipfix_file_swap(struct cl_ipfix_sink *sk)
+{
+	if (sk->next.fd < 0 || sk->full.fd >= 0)
+		return false;
+
+	sk->full = sk->cur;
+	sk->cur = sk->next;
+	sk->next = (struct cl_ipfix_file)CL_IPFIX_FILE_INIT;
+	sk->files++;
+
+	return true;
+}
+
+static void cl_ipfix_file_copy(struct cl_ipfix_sink *sk, const void *msg,
+			       uint16_t len)
+{
+	struct cl_ipfix_file *cf = &sk->cur;
+
+	memcpy(cf->base + cf->off, msg, len);
+	cf->off += len;
+	sk->msgs++;
+	sk->bytes += len;
+}
+
+/*
+ * Copy the message of an lcore to the file, preceded by the template
+ * message if it is the first message of its domain in the file.
+ */
+static void cl_ipfix_file_write(struct cl_ipfix_buf *b, uint32_t domain)
+{
+	struct cl_ipfix_sink *sk = &cl_ipfix_sink;
+	uint8_t *tmpl;
+	uint32_t need;
+
+	rte_spinlock_lock(&sk->lock);
+
+	need = b->len;
+	if (b->tmpl_file != sk->files)
+		need += cl_ipfix_tmpl_len;
+
+	if (sk->cur.off + need > sk->cur.size && cl_ipfix_file_swap(sk))
+		need = b->len + cl_ipfix_tmpl_len;
+
+	if (unlikely(sk->cur.fd < 0 || sk->cur.off + need > sk->cur.size)) {
+		sk->write_fails++;
+		rte_spinlock_unlock(&sk->lock);
+		return;
+	}
+
+	if (b->tmpl_file != sk->files) {
+		tmpl = sk->cur.base + sk->cur.off;
+		cl_ipfix_file_copy(sk, cl_ipfix_tmpl, cl_ipfix_tmpl_len);
+		cl_ipfix_hdr_fill(tmpl, cl_ipfix_tmpl_len, b->seq, domain);
+		b->tmpl_file = sk->files;
+	}
+	cl_ipfix_file_copy(sk, b->data, b->len);
+
+	rte_spinlock_unlock(&sk->lock);
+}
+
+static void cl_ipfix_buf_reset(struct cl_ipfix_buf *b)
+{
+	b->len = sizeof(struct cl_ipfix_hdr);
+	b->set_off = 0;
+	b->set_id = 0;
+	b->nrec = 0;
+}
+
+/* Write out the message of an lcore.  Buffer lock held. */
+static void cl_ipfix_buf_flush(struct cl_ipfix_buf *b, uint32_t domain)
+{
+	if (b->nrec == 0)
+		return;
+
+	cl_ipfix_hdr_fill(b->data, b->len, b->seq, domain);
+	cl_ipfix_file_write(b, domain);
+	b->seq += b->nrec;
+	cl_ipfix_buf_reset(b);
+}
+
+/*
+ * Add a data record to the message of this lcore, in a data set of
+ * its template.
+ */
+static void cl_ipfix_log(uint16_t tmpl, const void *rec, uint16_t len)
+{
+	struct cl_ipfix_buf *bufs = rcu_dereference(cl_ipfix_bufs);
+	unsigned int idx = rte_lcore_id();
+	struct cl_ipfix_set_hdr *set;
+	struct cl_ipfix_buf *b;
+
+	if (unlikely(!bufs))
+		return;
+
+	if (idx >= RTE_MAX_LCORE)
+		idx = CL_IPFIX_SHARED_BUF;
+	b = &bufs[idx];
+
+	rte_spinlock_lock(&b->lock);
+
+	if (b->set_id != tmpl || b->len + len > CL_IPFIX_MSG_SIZE) {
+		if (b->len + sizeof(*set) + len > CL_IPFIX_MSG_SIZE)
+			cl_ipfix_buf_flush(b, idx);
+
+		set = (struct cl_ipfix_set_hdr *)(b->data + b->len);
+		set->id = htons(tmpl);
+		b->set_off = b->len;
+		b->set_id = tmpl;
+		b->len += sizeof(*set);
+	}
+
+	memcpy(b->data + b->len, rec, len);
+	b->len += len;
+
+	set = (struct cl_ipfix_set_hdr *)(b->data + b->set_off);
+	set->length = htons(b->len - b->set_off);
+	b->nrec++;
+	b->records++;
+
+	rte_spinlock_unlock(&b->lock);
+}
+
+/*
+ * Write out the messages of all lcores, so records are not held back.
+ * Main thread.
+ */
+static void cl_ipfix_flush_all(struct cl_ipfix_buf *bufs)
+{
+	struct cl_ipfix_sink *sk = &cl_ipfix_sink;
+	struct cl_ipfix_file cur;
+	unsigned int i;
+
+	for (i = 0; i <= CL_IPFIX_SHARED_BUF; i++) {
+		rte_spinlock_lock(&bufs[i].lock);
+		cl_ipfix_buf_flush(&bufs[i], i);
+		rte_spinlock_unlock(&bufs[i].lock);
+	}
+
+	/* Files are only unmapped by the main thread */
+	rte_spinlock_lock(&sk->lock);
+	cur = sk->cur;
+	rte_spinlock_unlock(&sk->lock);
+
+	if (cur.fd >= 0)
+		msync(cur.base, cur.off, MS_ASYNC);
+}
+
+static void cl_ipfix_flush_timer(struct rte_timer *timer __unused,
+				 void *arg __unused)
+{
+	struct cl_ipfix_buf *bufs = rcu_dereference(cl_ipfix_bufs);
+
+	if (!bufs)
+		return;
+
+	cl_ipfix_flush_all(bufs);
+	cl_ipfix_file_retire(&cl_ipfix_sink);
+	cl_ipfix_file_standby(&cl_ipfix_sink);
+}
+
+static inline uint64_t cl_ipfix_ticks2ms(uint64_t ticks)
+{
+	return rte_cpu_to_be_64(cgn_ticks2timestamp(ticks) / 1000);
+}
+
+static void cl_ipfix_sess_fill(struct cgn_sess2 *s2, uint8_t event,
+			       uint64_t time_us, struct cl_ipfix_sess_rec *rec)
+{
+	struct cgn_session *cse = cgn_sess2_session(s2);
+
+	/* Addresses and ports are already in network byte order */
+	rec->time_ms = rte_cpu_to_be_64(time_us / 1000);
+	rec->event = event;
+	rec->proto = cgn_sess2_ipproto(s2);
+	rec->ifindex = htonl(cgn_session_ifindex(cse));
+	rec->saddr = cgn_session_forw_addr(cse);
+	rec->sport = cgn_session_forw_id(cse);
+	rec->nat_addr = cgn_session_back_addr(cse);
+	rec->nat_port = cgn_session_back_id(cse);
+	rec->daddr = cgn_sess2_addr(s2);
+	rec->dport = cgn_sess2_port(s2);
+}
+
+/*
+ * Log session creation
+ */
+static void cl_ipfix_sess_start(struct cgn_sess2 *s2)
+{
+	struct cl_ipfix_sess_rec rec;
+
+	cl_ipfix_sess_fill(s2, CL_IPFIX_NAT44_SESS_CREATE,
+			   cgn_ticks2timestamp(soft_ticks), &rec);
+	cl_ipfix_log(CL_IPFIX_TMPL_SESS_START, &rec, sizeof(rec));
+}
+
+/*
+ * Log session end
+ */
+static void cl_ipfix_sess_end(struct cgn_sess2 *s2, uint64_t end_time)
+{
+	struct cl_ipfix_sess_end_rec rec;
+
+	cl_ipfix_sess_fill(s2, CL_IPFIX_NAT44_SESS_DELETE, end_time,
+			   &rec.sess);
+
+	/* Session start time is in microseconds */
+	rec.start_ms = rte_cpu_to_be_64(cgn_sess2_start_time(s2) / 1000);
+	rec.out_bytes = rte_cpu_to_be_64(cgn_sess2_bytes_out_tot(s2));
+	rec.in_bytes = rte_cpu_to_be_64(cgn_sess2_bytes_in_tot(s2));
+	rec.out_pkts = rte_cpu_to_be_64(cgn_sess2_pkts_out_tot(s2));
+	rec.in_pkts = rte_cpu_to_be_64(cgn_sess2_pkts_in_tot(s2));
+
+	cl_ipfix_log(CL_IPFIX_TMPL_SESS_END, &rec, sizeof(rec));
+}
+
+static void cl_ipfix_pb_log(uint8_t event, uint64_t time, uint32_t pvt_addr,
+			    uint32_t pub_addr, uint16_t port_start,
+			    uint16_t port_end)
+{
+	struct cl_ipfix_pb_rec rec;
+
+	rec.time_ms = cl_ipfix_ticks2ms(time);
+	rec.event = event;
+	rec.saddr = htonl(pvt_addr);
+	rec.nat_addr = htonl(pub_addr);
+	rec.port_start = htons(port_start);
+	rec.port_end = htons(port_end);
+
+	cl_ipfix_log(CL_IPFIX_TMPL_PB, &rec, sizeof(rec));
+}
+
+/*
+ * Log port block allocation
+ */
+static void cl_ipfix_pb_alloc(uint32_t pvt_addr, uint32_t pub_addr,
+			      uint16_t port_start, uint16_t port_end,
+			      uint64_t start_time,
+			      const char *policy_name __unused,
+			      const char *pool_name __unused)
+{
+	cl_ipfix_pb_log(CL_IPFIX_NAT_PB_ALLOC, start_time, pvt_addr, pub_addr,
+			port_start, port_end);
+}
+
+/*
+ * Log port block release
+ */
+static void cl_ipfix_pb_release(uint32_t pvt_addr, uint32_t pub_addr,
+				uint16_t port_start, uint16_t port_end,
+				uint64_t start_time __unused,
+				uint64_t end_time,
+				const char *policy_name __unused,
+				const char *pool_name __unused)
+{
+	cl_ipfix_pb_log(CL_IPFIX_NAT_PB_DEALLOC, end_time, pvt_addr, pub_addr,
+			port_start, port_end);
+}
+
+/*
+ * Function called when ipfix logging is enabled for a log type.  The
+ * file is opened when the first log type is enabled.
+ */
+static int cl_ipfix_init(enum cgn_log_type ltype,
+			 const struct cgn_log_fns *fns __unused)
+{
+	struct cl_ipfix_file cur = CL_IPFIX_FILE_INIT;
+	struct cl_ipfix_sink *sk = &cl_ipfix_sink;
+	struct cl_ipfix_buf *bufs;
+	unsigned int i;
+	int rc;
+
+	if (ltype != CGN_LOG_TYPE_SESSION &&
+	    ltype != CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION)
+		return -EOPNOTSUPP;
+
+	if (cl_ipfix_nenabled > 0) {
+		cl_ipfix_nenabled++;
+		return 0;
+	}
+
+	bufs = zmalloc_aligned(sizeof(*bufs) * (CL_IPFIX_SHARED_BUF + 1));
+	if (!bufs)
+		return -ENOMEM;
+
+	for (i = 0; i <= CL_IPFIX_SHARED_BUF; i++) {
+		rte_spinlock_init(&bufs[i].lock);
+		cl_ipfix_buf_reset(&bufs[i]);
+	}
+
+	cl_ipfix_tmpl_len = cl_ipfix_tmpl_msg(cl_ipfix_tmpl);
+
+	strcpy(sk->file_path, sk->path);
+	snprintf(sk->next_path, sizeof(sk->next_path), "%s.next", sk->path);
+
+	rc = cl_ipfix_file_open(&cur, sk->file_path, sk->size);
+	if (rc < 0) {
+		RTE_LOG(ERR, CGNAT, "%s: open of %s failed (%s)\n",
+			__func__, sk->file_path, strerror(-rc));
+		free(bufs);
+		return rc;
+	}
+
+	rte_spinlock_lock(&sk->lock);
+	sk->cur = cur;
+	sk->files++;
+	rte_spinlock_unlock(&sk->lock);
+
+	cl_ipfix_file_standby(sk);
+
+	rcu_assign_pointer(cl_ipfix_bufs, bufs);
+	cl_ipfix_nenabled++;
+
+	rte_timer_init(&cl_ipfix_timer);
+	rte_timer_reset(&cl_ipfix_timer,
+			CL_IPFIX_FLUSH_SECS * rte_get_timer_hz(), PERIODICAL,
+			rte_get_master_lcore(), cl_ipfix_flush_timer, NULL);
+
+	return 0;
+}
+
+/*
+ * Function called when ipfix logging is disabled for a log type.  The
+ * file is closed when the last log type is disabled.
+ */
+static void cl_ipfix_fini(enum cgn_log_type ltype __unused,
+			  const struct cgn_log_fns *fns __unused)
+{
+	struct cl_ipfix_sink *sk = &cl_ipfix_sink;
+	struct cl_ipfix_buf *bufs = cl_ipfix_bufs;
+	struct cl_ipfix_file cur, next;
+
+	if (cl_ipfix_nenabled == 0 || --cl_ipfix_nenabled > 0)
+		return;
+
+	rte_timer_stop(&cl_ipfix_timer);
+	rcu_assign_pointer(cl_ipfix_bufs, NULL);
+
+	/* Wait for any lcore still adding records */
+	synchronize_rcu();
+	cl_ipfix_flush_all(bufs);
+	free(bufs);
+
+	/* Leaves the current file as <file> */
+	cl_ipfix_file_retire(sk);
+
+	rte_spinlock_lock(&sk->lock);
+	cur = sk->cur;
+	next = sk->next;
+	sk->cur = (struct cl_ipfix_file)CL_IPFIX_FILE_INIT;
+	sk->next = (struct cl_ipfix_file)CL_IPFIX_FILE_INIT;
+	rte_spinlock_unlock(&sk->lock);
+
+	cl_ipfix_file_close(&cur);
+	if (next.fd >= 0) {
+		cl_ipfix_file_close(&next);
+		unlink(sk->next_path);
+	}
+}
+
+int cl_ipfix_set_file(const char *path, uint64_t size, uint32_t count)
+{
+	struct cl_ipfix_sink *sk = &cl_ipfix_sink;
+
+	if (!path || strlen(path) >= sizeof(sk->path))
+		return -EINVAL;
+
+	if (size == 0)
+		size = CL_IPFIX_SIZE_DEFAULT;
+	else if (size < CL_IPFIX_SIZE_MIN)
+		return -EINVAL;
+
+	rte_spinlock_lock(&sk->lock);
+	strcpy(sk->path, path);
+	sk->size = size;
+	sk->count = count;
+	rte_spinlock_unlock(&sk->lock);
+
+	return 0;
+}
+
+void cgn_show_ipfix(FILE *f)
+{
+	struct cl_ipfix_sink *sk = &cl_ipfix_sink;
+	struct cl_ipfix_buf *bufs;
+	uint64_t records = 0;
+	json_writer_t *json;
+	unsigned int i;
+
+	json = jsonw_new(f);
+	if (!json)
+		return;
+
+	bufs = rcu_dereference(cl_ipfix_bufs);
+	if (bufs)
+		for (i = 0; i <= CL_IPFIX_SHARED_BUF; i++)
+			records += bufs[i].records;
+
+	jsonw_name(json, "ipfix");
+	jsonw_start_object(json);
+
+	jsonw_name(json, "config");
+	jsonw_start_object(json);
+	jsonw_string_field(json, "file", sk->path);
+	jsonw_uint_field(json, "size", sk->size);
+	jsonw_uint_field(json, "count", sk->count);
+	jsonw_end_object(json);
+
+	jsonw_name(json, "statistics");
+	jsonw_start_object(json);
+	jsonw_bool_field(json, "open", sk->cur.fd >= 0);
+	jsonw_bool_field(json, "standby", sk->next.fd >= 0);
+	jsonw_uint_field(json, "records", records);
+	jsonw_uint_field(json, "msgs", sk->msgs);
+	jsonw_uint_field(json, "bytes", sk->bytes);
+	jsonw_uint_field(json, "files", sk->files);
+	jsonw_uint_field(json, "write_fails", sk->write_fails);
+	jsonw_uint_field(json, "open_fails", sk->open_fails);
+	jsonw_end_object(json);
+
+	jsonw_end_object(json);
+	jsonw_destroy(&json);
+}
+
+const struct cgn_session_log_fns cgn_session_ipfix_fns = {
+	.cl_sess_start = cl_ipfix_sess_start,
+	.cl_sess_end = cl_ipfix_sess_end,
+};
+
+const struct cgn_port_block_alloc_log_fns cgn_port_block_alloc_ipfix_fns = {
+	.cl_pb_alloc = cl_ipfix_pb_alloc,
+	.cl_pb_release = cl_ipfix_pb_release,
+};
+
+const struct cgn_log_fns cgn_ipfix_fns = {
+	.cl_name = "ipfix",
+	.cl_init = cl_ipfix_init,
+	.cl_fini = cl_ipfix_fini,
+	.logfn[CGN_LOG_TYPE_SESSION].session =
+		&cgn_session_ipfix_fns,
+	.logfn[CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION].port_block_alloc =
+		&cgn_port_block_alloc_ipfix_fns,
+};
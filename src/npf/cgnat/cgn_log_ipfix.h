@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef _CGN_LOG_IPFIX_H_
+#define _CGN_LOG_IPFIX_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "npf/cgnat/cgn_log.h"
+
+/*
+ * Set the file the ipfix handler writes to, its size in bytes, and
+ * the number of rotated files to keep.  Takes effect the next time
+ * the handler is enabled.
+ */
+int cl_ipfix_set_file(const char *path, uint64_t size, uint32_t count);
+
+void cgn_show_ipfix(FILE *f);
+
+#endif /* _CGN_LOG_IPFIX_H_ */
@@ -11,6 +11,9 @@
 #include <errno.h>
 #include <netinet/in.h>
 #include <linux/if.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <rte_lcore.h>
 
 #include "compiler.h"
 #include "if_var.h"
@@ -36,12 +39,82 @@ struct cgn_zmq {
 	struct rcu_head rcu;
 };
 
+/*
+ * Log records are packed on the forwarding threads into per-lcore
+ * single-producer single-consumer rings, so the forwarding path never
+ * takes a lock or blocks in zmq.  A logger thread drains the rings and
+ * sends the records of each log type in batches, under one take of the
+ * socket lock.  By default each record is sent as a zmq message of its
+ * own, as consumers expect.  A log type can be configured to send up
+ * to CL_ZMQ_BATCH records per multi-part message instead, one record
+ * per frame, for consumers that read whole messages.  If a ring is
+ * full the record is dropped and counted.
+ *
+ * A record too big for a ring slot is packed into an allocated buffer,
+ * which the slot points to and the logger frees once it is sent.
+ *
+ * Threads other than lcores share one ring, under a lock.
+ */
+#define CL_ZMQ_RING_SIZE	1024	/* records, power of 2 */
+#define CL_ZMQ_RING_MASK	(CL_ZMQ_RING_SIZE - 1)
+#define CL_ZMQ_REC_SIZE		512
+#define CL_ZMQ_BATCH		64	/* records per socket lock */
+#define CL_ZMQ_IDLE_USECS	1000
+#define CL_ZMQ_SHARED_RING	RTE_MAX_LCORE
+
+struct cl_zmq_rec {
+	uint8_t		*data;		/* buf, or allocated if too big */
+	uint16_t	len;
+	uint8_t		ltype;
+	uint8_t		pad[5];
+	uint8_t		buf[CL_ZMQ_REC_SIZE - 16];
+};
+
+struct cl_zmq_ring {
+	/* Producer */
+	uint32_t		head __rte_cache_aligned;
+	uint64_t		full[CGN_LOG_TYPE_COUNT];
+	uint64_t		no_mem[CGN_LOG_TYPE_COUNT]; /* big records */
+	rte_spinlock_t		lock;		/* shared ring only */
+
+	/* Consumer */
+	uint32_t		tail __rte_cache_aligned;
+	struct rcu_head		rcu;
+
+	struct cl_zmq_rec	rec[CL_ZMQ_RING_SIZE] __rte_cache_aligned;
+};
+
+static struct cl_zmq_ring *cl_zmq_rings[RTE_MAX_LCORE + 1];
+
+/* Records of one log type, waiting to be sent */
+struct cl_zmq_batch {
+	unsigned int	n;
+	uint16_t	len[CL_ZMQ_BATCH];
+	uint8_t		*data[CL_ZMQ_BATCH];	/* buf, or allocated */
+	uint8_t		buf[CL_ZMQ_BATCH][CL_ZMQ_REC_SIZE];
+};
+
+static struct cl_zmq_logger {
+	pthread_t		thread;
+	bool			running;
+	bool			stop;
+	unsigned int		nenabled;	/* log types using zmq */
+	struct cl_zmq_batch	batch[CGN_LOG_TYPE_COUNT];
+} cl_zmq_logger;
+
+/*
+ * The lock serialises use of the zmq socket between config and the
+ * logger thread, the only one that sends.
+ */
 struct cgnat_zmq_ctx {
 	const char *endpoint;
+	char *cfg_endpoint;	/* replaces endpoint if set */
 	rte_spinlock_t lock;
 	rte_atomic32_t hwm;
+	rte_atomic32_t batch;	/* records per message, 0 for one */
 	struct cgn_zmq *sender;
 	rte_atomic64_t msgs_sent;
+	rte_atomic64_t batches_sent;
 	rte_atomic64_t init_fails;
 	rte_atomic64_t send_fails;
 	rte_atomic64_t no_channel;
@@ -68,6 +141,22 @@ struct cgnat_zmq_ctx cgnat_zmq_ctx[CGN_LOG_TYPE_COUNT] = {
 	},
 };
 
+/* Sum a ring counter over all rings */
+static uint64_t cl_zmq_ring_count(enum cgn_log_type ltype, bool full)
+{
+	struct cl_zmq_ring *ring;
+	uint64_t count = 0;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(cl_zmq_rings); i++) {
+		ring = rcu_dereference(cl_zmq_rings[i]);
+		if (ring)
+			count += full ? ring->full[ltype] :
+				ring->no_mem[ltype];
+	}
+	return count;
+}
+
 void cgn_show_zmq(FILE *f)
 {
 	enum cgn_log_type ltype;
@@ -100,6 +189,9 @@ void cgn_show_zmq(FILE *f)
 		count = rte_atomic64_read(&cgnat_zmq_ctx[ltype].msgs_sent);
 		jsonw_uint_field(json, "msgs_sent", count);
 
+		count = rte_atomic64_read(&cgnat_zmq_ctx[ltype].batches_sent);
+		jsonw_uint_field(json, "batches_sent", count);
+
 		count = rte_atomic64_read(&cgnat_zmq_ctx[ltype].init_fails);
 		jsonw_uint_field(json, "init_fails", count);
 
@@ -109,6 +201,12 @@ void cgn_show_zmq(FILE *f)
 		count = rte_atomic64_read(&cgnat_zmq_ctx[ltype].no_channel);
 		jsonw_uint_field(json, "no_channel", count);
 
+		count = cl_zmq_ring_count(ltype, true);
+		jsonw_uint_field(json, "ring_full", count);
+
+		count = cl_zmq_ring_count(ltype, false);
+		jsonw_uint_field(json, "no_mem", count);
+
 		jsonw_end_object(json);
 	}
 
@@ -130,6 +228,9 @@ void cgn_show_zmq(FILE *f)
 		count32 = rte_atomic32_read(&zmqctx->hwm);
 		jsonw_uint_field(json, "configured_hwm", count32);
 
+		count32 = rte_atomic32_read(&zmqctx->batch) ? : 1;
+		jsonw_uint_field(json, "configured_batch", count32);
+
 		sender = rcu_dereference(zmqctx->sender);
 		if (sender != NULL && sender->sock != NULL) {
 			int act_snd_hwm = zsock_sndhwm(sender->sock);
@@ -155,14 +256,238 @@ static void cl_reclaim_zmqctx(struct rcu_head *rp)
 	free(cgn_zmq);
 }
 
+/*
+ * Free a ring once no producer can be using it, along with the
+ * allocated buffers of any records the logger didn't take.
+ */
+static void cl_zmq_ring_free_rcu(struct rcu_head *rp)
+{
+	struct cl_zmq_ring *ring = caa_container_of(rp, struct cl_zmq_ring,
+						    rcu);
+	struct cl_zmq_rec *rec;
+	uint32_t tail;
+
+	for (tail = ring->tail; tail != ring->head; tail++) {
+		rec = &ring->rec[tail & CL_ZMQ_RING_MASK];
+		if (rec->data != rec->buf)
+			free(rec->data);
+	}
+	free(ring);
+}
+
+/*
+ * Send records as one zmq message, one record per frame.  zmq queues
+ * all the parts of a message if it accepts the first.
+ */
+static int cl_zmq_msg_send(void *sock, uint8_t **data, uint16_t *len,
+			   unsigned int n)
+{
+	unsigned int i;
+	int flags;
+
+	for (i = 0; i < n; i++) {
+		flags = ZMQ_DONTWAIT;
+		if (i + 1 < n)
+			flags |= ZMQ_SNDMORE;
+
+		if (zmq_send(sock, data[i], len[i], flags) < 0)
+			return -errno;
+	}
+	return 0;
+}
+
+/*
+ * Send the batched records of a log type, in messages of as many
+ * records as the log type is configured for.
+ */
+static void cl_zmq_batch_send(enum cgn_log_type ltype,
+			      struct cl_zmq_batch *batch)
+{
+	struct cgnat_zmq_ctx *zmqctx = &cgnat_zmq_ctx[ltype];
+	struct cgn_zmq *sender;
+	unsigned int i, n, per_msg;
+	int rc;
+
+	if (batch->n == 0)
+		return;
+
+	rte_spinlock_lock(&zmqctx->lock);
+
+	sender = zmqctx->sender;
+	if (sender == NULL) {
+		rte_atomic64_add(&zmqctx->no_channel, batch->n);
+		goto end;
+	}
+
+	per_msg = rte_atomic32_read(&zmqctx->batch) ? : 1;
+
+	for (i = 0; i < batch->n; i += n) {
+		n = RTE_MIN(per_msg, batch->n - i);
+
+		rc = cl_zmq_msg_send(sender->ul_sock, &batch->data[i],
+				     &batch->len[i], n);
+		if (unlikely(rc < 0)) {
+			rte_atomic64_add(&zmqctx->send_fails, n);
+			if (net_ratelimit())
+				RTE_LOG(DEBUG, CGNAT,
+					"%s: zmq_send failure (%s)\n",
+					__func__, strerror(-rc));
+			continue;
+		}
+		rte_atomic64_add(&zmqctx->msgs_sent, n);
+		rte_atomic64_inc(&zmqctx->batches_sent);
+	}
+
+end:
+	rte_spinlock_unlock(&zmqctx->lock);
+
+	for (i = 0; i < batch->n; i++)
+		if (batch->data[i] != batch->buf[i])
+			free(batch->data[i]);
+	batch->n = 0;
+}
+
+/*
+ * Move the records in a ring to the batches for their log types,
+ * sending any batch that fills.  Returns the number of records.
+ */
+static unsigned int cl_zmq_ring_drain(struct cl_zmq_ring *ring)
+{
+	struct cl_zmq_batch *batch;
+	struct cl_zmq_rec *rec;
+	uint32_t head, tail;
+	unsigned int count = 0;
+
+	head = CMM_LOAD_SHARED(ring->head);
+	cmm_smp_rmb();
+
+	for (tail = ring->tail; tail != head; tail++, count++) {
+		rec = &ring->rec[tail & CL_ZMQ_RING_MASK];
+		batch = &cl_zmq_logger.batch[rec->ltype];
+
+		batch->len[batch->n] = rec->len;
+		if (rec->data == rec->buf) {
+			batch->data[batch->n] = batch->buf[batch->n];
+			memcpy(batch->buf[batch->n], rec->buf, rec->len);
+		} else {
+			/* The batch takes over the allocated buffer */
+			batch->data[batch->n] = rec->data;
+		}
+		if (++batch->n == CL_ZMQ_BATCH)
+			cl_zmq_batch_send(rec->ltype, batch);
+	}
+
+	/* Finish with the records before the producer reuses them */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(ring->tail, tail);
+
+	return count;
+}
+
+static void *cl_zmq_logger_fn(void *arg __unused)
+{
+	enum cgn_log_type ltype;
+	unsigned int i, count;
+
+	pthread_setname_np(pthread_self(), "dataplane/cgnlog");
+
+	while (!CMM_LOAD_SHARED(cl_zmq_logger.stop)) {
+		count = 0;
+		for (i = 0; i < ARRAY_SIZE(cl_zmq_rings); i++)
+			if (cl_zmq_rings[i])
+				count += cl_zmq_ring_drain(cl_zmq_rings[i]);
+
+		for (ltype = 0; ltype < CGN_LOG_TYPE_COUNT; ltype++)
+			cl_zmq_batch_send(ltype, &cl_zmq_logger.batch[ltype]);
+
+		if (count == 0)
+			usleep(CL_ZMQ_IDLE_USECS);
+	}
+	return NULL;
+}
+
+/*
+ * Create the rings and start the logger thread when the first log type
+ * is enabled.
+ */
+static int cl_zmq_logger_start(void)
+{
+	struct cl_zmq_ring *ring;
+	unsigned int i;
+
+	if (cl_zmq_logger.nenabled++ > 0)
+		return 0;
+
+	for (i = 0; i < ARRAY_SIZE(cl_zmq_rings); i++) {
+		if (i != CL_ZMQ_SHARED_RING && !rte_lcore_is_enabled(i))
+			continue;
+
+		ring = zmalloc_aligned(sizeof(*ring));
+		if (!ring)
+			goto fail;
+		rte_spinlock_init(&ring->lock);
+		rcu_assign_pointer(cl_zmq_rings[i], ring);
+	}
+
+	cl_zmq_logger.stop = false;
+	if (pthread_create(&cl_zmq_logger.thread, NULL,
+			   cl_zmq_logger_fn, NULL) != 0) {
+		RTE_LOG(ERR, CGNAT, "%s: logger thread creation failed\n",
+			__func__);
+		goto fail;
+	}
+	cl_zmq_logger.running = true;
+	return 0;
+
+fail:
+	for (i = 0; i < ARRAY_SIZE(cl_zmq_rings); i++) {
+		ring = cl_zmq_rings[i];
+		rcu_assign_pointer(cl_zmq_rings[i], NULL);
+		if (ring)
+			call_rcu(&ring->rcu, cl_zmq_ring_free_rcu);
+	}
+	cl_zmq_logger.nenabled--;
+	return -ENOMEM;
+}
+
+/*
+ * Stop the logger thread and free the rings when the last log type is
+ * disabled.  Records still in the rings are dropped.
+ */
+static void cl_zmq_logger_stop(void)
+{
+	struct cl_zmq_ring *ring;
+	unsigned int i;
+
+	if (cl_zmq_logger.nenabled == 0 || --cl_zmq_logger.nenabled > 0)
+		return;
+
+	if (cl_zmq_logger.running) {
+		CMM_STORE_SHARED(cl_zmq_logger.stop, true);
+		pthread_join(cl_zmq_logger.thread, NULL);
+		cl_zmq_logger.running = false;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(cl_zmq_rings); i++) {
+		ring = cl_zmq_rings[i];
+		rcu_assign_pointer(cl_zmq_rings[i], NULL);
+		if (ring)
+			call_rcu(&ring->rcu, cl_zmq_ring_free_rcu);
+	}
+}
+
+static void cl_zmq_fini(enum cgn_log_type ltype,
+			const struct cgn_log_fns *fns __unused);
+
 /*
  * Function called when zmq protobuf logging is enabled for a log type
  */
 static int cl_zmq_init(enum cgn_log_type ltype,
-		       const struct cgn_log_fns *fns __unused)
+		       const struct cgn_log_fns *fns)
 {
 	struct cgnat_zmq_ctx *zmqctx;
 	struct cgn_zmq *sender;
+	const char *endpoint;
 	int ret;
 
 	if (ltype >= CGN_LOG_TYPE_COUNT)
@@ -194,11 +519,12 @@ static int cl_zmq_init(enum cgn_log_type ltype,
 	zsock_set_sndhwm(sender->sock, rte_atomic32_read(&zmqctx->hwm));
 	zsock_set_rcvhwm(sender->sock, rte_atomic32_read(&zmqctx->hwm));
 
-	ret = zsock_bind(sender->sock, "%s", zmqctx->endpoint);
+	endpoint = zmqctx->cfg_endpoint ? : zmqctx->endpoint;
+	ret = zsock_bind(sender->sock, "%s", endpoint);
 
 	if (ret < 0) {
 		RTE_LOG(ERR, CGNAT, "%s: zsock_bind(%s) failed (%s)\n",
-			__func__, zmqctx->endpoint, strerror(errno));
+			__func__, endpoint, strerror(errno));
 		zsock_destroy(&(sender->sock));
 		free(sender);
 		rte_spinlock_unlock(&zmqctx->lock);
@@ -209,7 +535,7 @@ static int cl_zmq_init(enum cgn_log_type ltype,
 
 	if (sender->ul_sock == NULL) {
 		RTE_LOG(ERR, CGNAT, "%s: zsock_resolve failed for %s (%s)\n",
-			__func__, zmqctx->endpoint, strerror(errno));
+			__func__, endpoint, strerror(errno));
 		zsock_destroy(&(sender->sock));
 		free(sender);
 		rte_spinlock_unlock(&zmqctx->lock);
@@ -219,6 +545,12 @@ static int cl_zmq_init(enum cgn_log_type ltype,
 	rcu_assign_pointer(zmqctx->sender, sender);
 
 	rte_spinlock_unlock(&zmqctx->lock);
+
+	ret = cl_zmq_logger_start();
+	if (ret < 0) {
+		cl_zmq_fini(ltype, fns);
+		return ret;
+	}
 	return 0;
 }
 
@@ -247,6 +579,9 @@ static void cl_zmq_fini(enum cgn_log_type ltype,
 	}
 
 	rte_spinlock_unlock(&zmqctx->lock);
+
+	if (old_sender != NULL)
+		cl_zmq_logger_stop();
 }
 
 int cl_zmq_set_hwm(enum cgn_log_type ltype, int32_t hwm)
@@ -264,69 +599,120 @@ int cl_zmq_set_hwm(enum cgn_log_type ltype, int32_t hwm)
 }
 
 /*
- * Function back-called by czmq library to free the allocated buffer
- * that has just been sent out.
+ * Set the number of records a log type sends per zmq message, or go
+ * back to the default of one if batch is 0.
  */
-static void cl_protobuf_msg_free(void *data, void *hint __unused)
+int cl_zmq_set_batch(enum cgn_log_type ltype, uint32_t batch)
 {
-	free(data);
+	if (ltype >= CGN_LOG_TYPE_COUNT || batch > CL_ZMQ_BATCH)
+		return -EINVAL;
+
+	rte_atomic32_set(&cgnat_zmq_ctx[ltype].batch, batch);
+
+	return 0;
 }
 
 /*
- * Send a serialised protobuf message down the ZMQ channel associated with
- * the log type.
- *
- * Note: on return the buffer passed in will be freed, even if there is
- * an error.
+ * Set the endpoint a log type binds to, or go back to the default if
+ * endpoint is NULL.  Not allowed while the log type is enabled.
+ */
+int cl_zmq_set_endpoint(enum cgn_log_type ltype, const char *endpoint)
+{
+	struct cgnat_zmq_ctx *zmqctx;
+	char *copy = NULL;
+
+	if (ltype >= CGN_LOG_TYPE_COUNT)
+		return -EINVAL;
+
+	zmqctx = &cgnat_zmq_ctx[ltype];
+
+	if (endpoint) {
+		copy = strdup(endpoint);
+		if (!copy)
+			return -ENOMEM;
+	}
+
+	rte_spinlock_lock(&zmqctx->lock);
+
+	if (zmqctx->sender != NULL) {
+		rte_spinlock_unlock(&zmqctx->lock);
+		free(copy);
+		return -EBUSY;
+	}
+
+	free(zmqctx->cfg_endpoint);
+	zmqctx->cfg_endpoint = copy;
+
+	rte_spinlock_unlock(&zmqctx->lock);
+	return 0;
+}
+
+/*
+ * Reserve a ring record for a packed log message of a log type.  On
+ * success the record must be handed to the logger with
+ * cl_zmq_rec_put().
  */
-static int cl_protobuf_zmq_send(enum cgn_log_type ltype, void *buf,
-				unsigned int buflen)
+static struct cl_zmq_rec *
+cl_zmq_rec_get(enum cgn_log_type ltype, unsigned int len,
+	       struct cl_zmq_ring **ringp)
 {
-	int rv;
-	zmq_msg_t zpb;
 	struct cgnat_zmq_ctx *zmqctx = &cgnat_zmq_ctx[ltype];
-	struct cgn_zmq *sender = rcu_dereference(zmqctx->sender);
+	unsigned int lcore = rte_lcore_id();
+	struct cl_zmq_ring *ring;
+	struct cl_zmq_rec *rec;
+	uint32_t head;
+
+	if (lcore >= RTE_MAX_LCORE)
+		lcore = CL_ZMQ_SHARED_RING;
+
+	ring = rcu_dereference(cl_zmq_rings[lcore]);
 
-	if (sender == NULL) {	/* using protobufs not currently enabled */
+	/* using protobufs not currently enabled */
+	if (ring == NULL || rcu_dereference(zmqctx->sender) == NULL) {
 		rte_atomic64_inc(&zmqctx->no_channel);
-		cl_protobuf_msg_free(buf, NULL);
 		if (net_ratelimit())
 			RTE_LOG(DEBUG, CGNAT, "%s: channel no set-up",
 				 __func__);
-		return 0;
+		return NULL;
 	}
 
-	rte_spinlock_lock(&zmqctx->lock);
-
-	/* send the protobuf (without copying) */
+	if (lcore == CL_ZMQ_SHARED_RING)
+		rte_spinlock_lock(&ring->lock);
 
-	rv = zmq_msg_init_data(&zpb, buf, buflen, cl_protobuf_msg_free, NULL);
-	if (unlikely(rv < 0)) {
-		rte_atomic64_inc(&zmqctx->init_fails);
-		cl_protobuf_msg_free(buf, NULL);
-		if (net_ratelimit())
-			RTE_LOG(DEBUG, CGNAT, "%s: zmq_msg_init_data failure "
-				"(%s)\n", __func__, strerror(errno));
-		rte_spinlock_unlock(&zmqctx->lock);
-		return -errno;
+	head = ring->head;
+	if (unlikely(head - CMM_LOAD_SHARED(ring->tail) >= CL_ZMQ_RING_SIZE)) {
+		ring->full[ltype]++;
+		goto drop;
 	}
 
-	rv = zmq_msg_send(&zpb, sender->ul_sock, ZMQ_DONTWAIT);
-	if (unlikely(rv < 0)) {
-		rte_atomic64_inc(&zmqctx->send_fails);
-		zmq_msg_close(&zpb);
-		if (net_ratelimit())
-			RTE_LOG(DEBUG, CGNAT, "%s: zmq_send failure (%s)\n",
-				__func__, strerror(errno));
-		rte_spinlock_unlock(&zmqctx->lock);
-		return -errno;
+	rec = &ring->rec[head & CL_ZMQ_RING_MASK];
+	rec->data = rec->buf;
+	if (unlikely(len > sizeof(rec->buf))) {
+		rec->data = malloc(len);
+		if (rec->data == NULL) {
+			ring->no_mem[ltype]++;
+			goto drop;
+		}
 	}
+	rec->ltype = ltype;
+	rec->len = len;
+	*ringp = ring;
+	return rec;
+
+drop:
+	if (lcore == CL_ZMQ_SHARED_RING)
+		rte_spinlock_unlock(&ring->lock);
+	return NULL;
+}
 
-	rte_atomic64_inc(&zmqctx->msgs_sent);
-	zmq_msg_close(&zpb);
+static void cl_zmq_rec_put(struct cl_zmq_ring *ring)
+{
+	/* Write the record before it is seen by the logger */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(ring->head, ring->head + 1);
 
-	rte_spinlock_unlock(&zmqctx->lock);
-	return 0;
+	if (rte_lcore_id() >= RTE_MAX_LCORE)
+		rte_spinlock_unlock(&ring->lock);
 }
 
 static inline void microsecs_to_timestamp(uint64_t micro_secs, Timestamp *ts)
@@ -339,23 +725,21 @@ static inline void microsecs_to_timestamp(uint64_t micro_secs, Timestamp *ts)
 }
 
 /*
- * Send a protobuf structure down the subscriber ZMQ channel
+ * Queue a protobuf structure for the subscriber ZMQ channel
  */
 static int cl_protobuf_log_send_subscriber(SubscriberLog *msg)
 {
 	unsigned int buflen = subscriber_log__get_packed_size(msg);
-	void *buf = malloc(buflen);
-
-	if (unlikely(buf == NULL)) {
-		if (net_ratelimit())
-			RTE_LOG(ERR, CGNAT, "%s: buffer allocation\n",
-				__func__);
-		return -ENOMEM;
-	}
+	struct cl_zmq_ring *ring;
+	struct cl_zmq_rec *rec;
 
-	subscriber_log__pack(msg, buf);
+	rec = cl_zmq_rec_get(CGN_LOG_TYPE_SUBSCRIBER, buflen, &ring);
+	if (unlikely(rec == NULL))
+		return -ENOBUFS;
 
-	return cl_protobuf_zmq_send(CGN_LOG_TYPE_SUBSCRIBER, buf, buflen);
+	subscriber_log__pack(msg, rec->data);
+	cl_zmq_rec_put(ring);
+	return 0;
 }
 
 /*
@@ -417,24 +801,22 @@ static void cl_protobuf_subscriber_end(uint32_t addr, uint64_t start_time,
 }
 
 /*
- * Send a protobuf structure down the port-block-allocation ZMQ channel
+ * Queue a protobuf structure for the port-block-allocation ZMQ channel
  */
 static int cl_protobuf_log_send_pba(PortAllocationLog *msg)
 {
 	unsigned int buflen = port_allocation_log__get_packed_size(msg);
-	void *buf = malloc(buflen);
+	struct cl_zmq_ring *ring;
+	struct cl_zmq_rec *rec;
 
-	if (unlikely(buf == NULL)) {
-		if (net_ratelimit())
-			RTE_LOG(ERR, CGNAT, "%s: buffer allocation\n",
-				__func__);
-		return -ENOMEM;
-	}
+	rec = cl_zmq_rec_get(CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION, buflen,
+			     &ring);
+	if (unlikely(rec == NULL))
+		return -ENOBUFS;
 
-	port_allocation_log__pack(msg, buf);
-
-	return cl_protobuf_zmq_send(CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION, buf,
-				    buflen);
+	port_allocation_log__pack(msg, rec->data);
+	cl_zmq_rec_put(ring);
+	return 0;
 }
 
 /*
@@ -603,23 +985,21 @@ static void cl_protobuf_sess_common(struct cgn_sess2 *s2, SessionLog *msg)
 }
 
 /*
- * Send a protobuf structure down the session ZMQ channel
+ * Queue a protobuf structure for the session ZMQ channel
  */
 static int cl_protobuf_log_send_session(SessionLog *msg)
 {
 	unsigned int buflen = session_log__get_packed_size(msg);
-	void *buf = malloc(buflen);
+	struct cl_zmq_ring *ring;
+	struct cl_zmq_rec *rec;
 
-	if (unlikely(buf == NULL)) {
-		if (net_ratelimit())
-			RTE_LOG(ERR, CGNAT, "%s: buffer allocation\n",
-				__func__);
-		return -ENOMEM;
-	}
+	rec = cl_zmq_rec_get(CGN_LOG_TYPE_SESSION, buflen, &ring);
+	if (unlikely(rec == NULL))
+		return -ENOBUFS;
 
-	session_log__pack(msg, buf);
-
-	return cl_protobuf_zmq_send(CGN_LOG_TYPE_SESSION, buf, buflen);
+	session_log__pack(msg, rec->data);
+	cl_zmq_rec_put(ring);
+	return 0;
 }
 
 /*
@@ -724,23 +1104,21 @@ static void cl_protobuf_resource_common(enum cgn_resource_type type,
 }
 
 /*
- * Send a protobuf structure down the resource constraint ZMQ channel
+ * Queue a protobuf structure for the resource constraint ZMQ channel
  */
 static int cl_protobuf_log_send_res_constraint(ConstraintLog *msg)
 {
 	unsigned int buflen = constraint_log__get_packed_size(msg);
-	void *buf = malloc(buflen);
+	struct cl_zmq_ring *ring;
+	struct cl_zmq_rec *rec;
 
-	if (unlikely(buf == NULL)) {
-		if (net_ratelimit())
-			RTE_LOG(ERR, CGNAT, "%s: buffer allocation\n",
-				__func__);
-		return -ENOMEM;
-	}
+	rec = cl_zmq_rec_get(CGN_LOG_TYPE_RES_CONSTRAINT, buflen, &ring);
+	if (unlikely(rec == NULL))
+		return -ENOBUFS;
 
-	constraint_log__pack(msg, buf);
-
-	return cl_protobuf_zmq_send(CGN_LOG_TYPE_RES_CONSTRAINT, buf, buflen);
+	constraint_log__pack(msg, rec->data);
+	cl_zmq_rec_put(ring);
+	return 0;
 }
 
 static void cl_protobuf_resource_common_count_and_max(
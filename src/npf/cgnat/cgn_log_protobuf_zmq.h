@@ -10,6 +10,8 @@
 #include "npf/cgnat/cgn_log.h"
 
 int cl_zmq_set_hwm(enum cgn_log_type ltype, int32_t hwm);
+int cl_zmq_set_batch(enum cgn_log_type ltype, uint32_t batch);
+int cl_zmq_set_endpoint(enum cgn_log_type ltype, const char *endpoint);
 void cgn_show_zmq(FILE *f);
 
 #endif /* _CGN_LOG_PROTOBUF_ZMQ_H_ */
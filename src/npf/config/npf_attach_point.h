@@ -208,6 +208,7 @@ enum npf_attpt_ev_type {
 	/* The following pass a pointer to a ruleset type */
 	NPF_ATTPT_EV_RLSET_ADD_COMMIT,
 	NPF_ATTPT_EV_RLSET_DEL_COMMIT,
+	NPF_ATTPT_EV_RLSET_UPDATE_COMMIT, /* any commit replacing a ruleset */
 };
 
 /**
@@ -208,6 +208,10 @@ static void npf_cfg_commit(struct npf_attpt_item *ap, enum npf_commit_type type)
 		}
 
 		npf_replace_ruleset(nc_rulesets, new_ruleset);
+
+		/* Let users caching ruleset results know they are stale */
+		npf_attpt_ev_notify(NPF_ATTPT_EV_RLSET_UPDATE_COMMIT, ap,
+				    &ruleset_type);
 	}
 
 	/* Mark all the rulesets as clean. */
@@ -7,6 +7,8 @@
  */
 
 #include <rte_branch_prediction.h>
+#include <rte_common.h>
+#include <rte_cpuflags.h>
 #include <rte_log.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -19,6 +21,12 @@
 #include "npf/npf_ruleset.h"
 #include "vplane_log.h"
 
+#if defined RTE_ARCH_X86_64
+#include <immintrin.h>
+#elif defined RTE_ARCH_ARM64
+#include <arm_neon.h>
+#endif
+
 /*
  * The goal of this module is to provide a quick match of the basic
  * address/port addresses against an arbritrary sized ruleset with near
@@ -83,13 +91,26 @@ static const uint32_t g_size_alloc[] = {
 #define PATTERN_PER_TABLE	(1u << (BYTES_PER_TABLE * 8))
 
 
-#define  RULE_MATCH(x) {						\
-		rule_match &= conf->_match_table[x][packet[x]][j];      \
-		if (!rule_match)					\
-			continue;					\
-	}
+/* Tables evaluated for each address family */
+#define G2_TABLES_V4		13
+#define G2_TABLES_V6		37
+
+/* Widest block of 64-bit words AND-ed at once (AVX-512) */
+#define G2_BLOCK_MAX_WORDS	8
 
+/* Packets evaluated together by the burst functions */
+#define G2_BURST_MAX		32
 
+struct g2_config;
+
+/*
+ * AND together the bit patterns selected by the packet in each table,
+ * for the block of words starting at 'word'.  Returns false as soon as
+ * the block is all zero, else stores the block in 'out'.
+ */
+typedef bool (*g2_and_block_fn)(const struct g2_config *conf,
+				const uint8_t *packet, uint ntables,
+				uint word, uint64_t *out);
 
 typedef bool (*g2_fp_eval_rule)(const uint8_t *, uint32_t, const void *);
 
@@ -130,10 +151,140 @@ struct g2_config {
 	/* Shared "match all" table */
 	uint64_t **_match_all;
 
+	/* Words AND-ed per block by _and_block */
+	unsigned int _block_words;
+	g2_and_block_fn _and_block;
+
 	/* match table -- MUST be last */
 	uint64_t **_match_table[];
 };
 
+static inline const uint64_t *
+g2_bit_pattern(const g2_config_t *conf, const uint8_t *packet, uint table,
+	       uint word)
+{
+	return &conf->_match_table[table][packet[table]][word];
+}
+
+static inline uint64_t
+g2_and_word(const g2_config_t *conf, const uint8_t *packet, uint ntables,
+	    uint word)
+{
+	uint64_t rule_match = UINT64_MAX;
+	uint i;
+
+	/* As fast as the old hand unrolled loop when ntables is constant */
+#pragma GCC unroll 40
+	for (i = 0; i < ntables; i++) {
+		rule_match &= *g2_bit_pattern(conf, packet, i, word);
+		if (!rule_match)
+			break;
+	}
+	return rule_match;
+}
+
+static bool
+g2_and_block_1(const g2_config_t *conf, const uint8_t *packet,
+	       uint ntables, uint word, uint64_t *out)
+{
+	*out = g2_and_word(conf, packet, ntables, word);
+	return *out != 0;
+}
+
+#if defined RTE_ARCH_X86_64
+static __attribute__((target("avx2"))) bool
+g2_and_block_avx2(const g2_config_t *conf, const uint8_t *packet,
+		  uint ntables, uint word, uint64_t *out)
+{
+	__m256i acc = _mm256_set1_epi64x(-1);
+	uint i;
+
+	for (i = 0; i < ntables; i++) {
+		acc = _mm256_and_si256(acc, _mm256_loadu_si256(
+			(const __m256i *)g2_bit_pattern(conf, packet, i, word)));
+		if (_mm256_testz_si256(acc, acc))
+			return false;
+	}
+	_mm256_storeu_si256((__m256i *)out, acc);
+	return true;
+}
+
+static __attribute__((target("avx512f"))) bool
+g2_and_block_avx512(const g2_config_t *conf, const uint8_t *packet,
+		    uint ntables, uint word, uint64_t *out)
+{
+	__m512i acc = _mm512_set1_epi64(-1);
+	uint i;
+
+	for (i = 0; i < ntables; i++) {
+		acc = _mm512_and_si512(acc, _mm512_loadu_si512(
+			g2_bit_pattern(conf, packet, i, word)));
+		if (!_mm512_test_epi64_mask(acc, acc))
+			return false;
+	}
+	_mm512_storeu_si512(out, acc);
+	return true;
+}
+#elif defined RTE_ARCH_ARM64
+static bool
+g2_and_block_neon(const g2_config_t *conf, const uint8_t *packet,
+		  uint ntables, uint word, uint64_t *out)
+{
+	uint64x2_t acc = vdupq_n_u64(UINT64_MAX);
+	uint i;
+
+	for (i = 0; i < ntables; i++) {
+		acc = vandq_u64(acc, vld1q_u64(
+			g2_bit_pattern(conf, packet, i, word)));
+		if (!(vgetq_lane_u64(acc, 0) | vgetq_lane_u64(acc, 1)))
+			return false;
+	}
+	vst1q_u64(out, acc);
+	return true;
+}
+#endif
+
+/* Whether groupers built from now on may use a vector AND */
+static bool g2_simd_enabled = true;
+
+void g2_set_simd_enabled(bool enable)
+{
+	g2_simd_enabled = enable;
+}
+
+/*
+ * Pick the widest block AND that the CPU supports and that fits within
+ * the bit patterns allocated for the ruleset, so that each block load
+ * stays inside its own bit pattern.
+ */
+static void
+g2_select_and_block(g2_config_t *conf)
+{
+	uint words __rte_unused =
+		g_size_alloc[conf->_rs_size_idx] / STRIDE_BITS;
+
+	conf->_block_words = 1;
+	conf->_and_block = g2_and_block_1;
+
+	if (!g2_simd_enabled)
+		return;
+
+#if defined RTE_ARCH_X86_64
+	if (words >= 8 && rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX512F)) {
+		conf->_block_words = 8;
+		conf->_and_block = g2_and_block_avx512;
+	} else if (words >= 4 && rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX2)) {
+		conf->_block_words = 4;
+		conf->_and_block = g2_and_block_avx2;
+	}
+#elif defined RTE_ARCH_ARM64
+	if (words >= 2) {
+		conf->_block_words = 2;
+		conf->_and_block = g2_and_block_neon;
+	}
+#endif
+}
+
 /*
  * Allocate or reallocate match_table
  *
@@ -251,6 +402,8 @@ g2_config_t *g2_init(uint num_tables)
 	conf->_num_rules = 0;
 	conf->_num_tables = num_tables;
 	conf->_rs_size_idx = 0;
+	conf->_block_words = 1;
+	conf->_and_block = g2_and_block_1;
 
 	for (i = 0; i < num_tables; ++i) {
 		if (!g2_alloc_match_table(conf, i))
@@ -548,6 +701,8 @@ g2_optimize(g2_config_t **confp)
 	uint j;
 	g2_config_t *conf = *confp;
 
+	g2_select_and_block(conf);
+
 	if (!conf->_mask)
 		return;
 
@@ -586,141 +741,190 @@ g2_optimize(g2_config_t **confp)
 }
 
 /*
- * g2_eval4()
- * conf:     ptr to configuration structure
- * packet:   n byte packet to compare
- *
- * returns:  first rule matched.
+ * Verify the candidate rules in one word of the AND-ed bit patterns,
+ * in rule order.  Returns the first rule whose bytecode also matches.
  */
-inline
-void *g2_eval4(const g2_config_t *conf, const uint8_t *packet,
-	       const void *data)
+static inline void *
+g2_eval_word(const g2_config_t *conf, uint64_t rule_match, uint32_t word,
+	     const void *data)
 {
-	uint32_t j;
+	/* iterate over all possible matches in 64 rules */
+	while (rule_match) {
+		uint32_t loc;
+		uint32_t idx_match;
+
+		/* find next match in chunk */
+		loc = ffsl(rule_match);
+		idx_match = loc + (word * STRIDE_BITS);
+
+		if (unlikely(idx_match > conf->_num_rules))
+			return NULL;
+
+		void *r = conf->_md[idx_match - 1];
+
+		/* Process the bytecode to verify the match */
+		if (npf_rule_proc(data, r))
+			return r;
+
+		/* exclusive OR w/ loc to allow further search */
+		rule_match ^= (1ull << (loc - 1ull));
+	}
+	return NULL;
+}
+
+/*
+ * AND one block of words.  Rulesets of 64 rules or fewer always use
+ * single words, so that path is inlined rather than called.
+ */
+static inline bool
+g2_and_block(const g2_config_t *conf, const uint8_t *packet, uint ntables,
+	     uint word, uint64_t *out)
+{
+	if (conf->_block_words == 1) {
+		*out = g2_and_word(conf, packet, ntables, word);
+		return *out != 0;
+	}
+
+	return conf->_and_block(conf, packet, ntables, word, out);
+}
+
+static inline void *
+g2_eval(const g2_config_t *conf, const uint8_t *packet, uint ntables,
+	const void *data)
+{
+	uint64_t block[G2_BLOCK_MAX_WORDS];
+	uint32_t j, w;
+	void *r;
 
 	/*
 	 * for each chunk of rules, i.e. 64 at a time
 	 */
-	for (j = 0; j < conf->_num_chunks; ++j) {
-		uint64_t rule_match = UINT64_MAX;
-
-		/* For each table */
-		RULE_MATCH(0);
-		RULE_MATCH(1);
-		RULE_MATCH(2);
-		RULE_MATCH(3);
-		RULE_MATCH(4);
-		RULE_MATCH(5);
-		RULE_MATCH(6);
-		RULE_MATCH(7);
-		RULE_MATCH(8);
-		RULE_MATCH(9);
-		RULE_MATCH(10);
-		RULE_MATCH(11);
-		RULE_MATCH(12);
-
-		/* iterate over all possible matches in 64 rules */
-
-		while (rule_match) {
-			uint32_t loc;
-			uint32_t idx_match;
-
-			/* find next match in chunk */
-			loc = ffsl(rule_match);
-			idx_match = loc + (j * STRIDE_BITS);
-
-			if (unlikely(idx_match > conf->_num_rules))
-				return NULL;
-
-			void *r = conf->_md[idx_match - 1];
-
-			/* Process the bytecode to verify the match */
-			if (npf_rule_proc(data, r))
+	if (conf->_block_words == 1) {
+		for (j = 0; j < conf->_num_chunks; ++j) {
+			uint64_t rule_match;
+
+			rule_match = g2_and_word(conf, packet, ntables, j);
+			if (!rule_match)
+				continue;
+
+			r = g2_eval_word(conf, rule_match, j, data);
+			if (r)
 				return r;
+		}
+		return NULL;
+	}
+
+	/*
+	 * else for each block of chunks
+	 */
+	for (j = 0; j < conf->_num_chunks; j += conf->_block_words) {
+		if (!g2_and_block(conf, packet, ntables, j, block))
+			continue;
 
-			/* exclusive OR w/ loc to allow further search */
-			rule_match ^= (1ull << (loc - 1ull));
+		for (w = 0; w < conf->_block_words; w++) {
+			if (!block[w])
+				continue;
+
+			r = g2_eval_word(conf, block[w], j + w, data);
+			if (r)
+				return r;
 		}
 	}
 	/* 0 is no match */
 	return NULL;
 }
 
+/*
+ * Evaluate up to G2_BURST_MAX packets against the same ruleset.  Each
+ * block of bit patterns is evaluated for every packet still without a
+ * match before moving on to the next block, so each packet still
+ * returns its first matching rule.
+ */
+static inline void
+g2_eval_burst(const g2_config_t *conf, const uint8_t *packets[],
+	      const void *data[], void *rules[], uint32_t num,
+	      uint ntables)
+{
+	uint64_t block[G2_BLOCK_MAX_WORDS];
+	uint32_t pending;
+	uint32_t i, j, w;
+
+	pending = num < G2_BURST_MAX ? (1u << num) - 1 : UINT32_MAX;
+	for (i = 0; i < num; i++)
+		rules[i] = NULL;
+
+	for (j = 0; j < conf->_num_chunks && pending;
+	     j += conf->_block_words) {
+		for (i = 0; i < num; i++) {
+			if (!(pending & (1u << i)))
+				continue;
+
+			if (!g2_and_block(conf, packets[i], ntables, j, block))
+				continue;
+
+			for (w = 0; w < conf->_block_words; w++) {
+				if (!block[w])
+					continue;
+
+				rules[i] = g2_eval_word(conf, block[w], j + w,
+							data[i]);
+				if (rules[i]) {
+					pending &= ~(1u << i);
+					break;
+				}
+			}
+		}
+	}
+}
+
+/*
+ * g2_eval4()
+ * conf:     ptr to configuration structure
+ * packet:   n byte packet to compare
+ *
+ * returns:  first rule matched.
+ */
+void *g2_eval4(const g2_config_t *conf, const uint8_t *packet,
+	       const void *data)
+{
+	return g2_eval(conf, packet, G2_TABLES_V4, data);
+}
+
 void *g2_eval6(const g2_config_t *conf, const uint8_t *packet,
 	       const void *data)
 {
-	uint32_t j;
+	return g2_eval(conf, packet, G2_TABLES_V6, data);
+}
 
-	/*
-	 * for each chunk of rules, i.e. 64 at a time
-	 */
-	for (j = 0; j < conf->_num_chunks; ++j) {
-		uint64_t rule_match = UINT64_MAX;
-
-		/* For each table */
-		RULE_MATCH(0);
-		RULE_MATCH(1);
-		RULE_MATCH(2);
-		RULE_MATCH(3);
-		RULE_MATCH(4);
-		RULE_MATCH(5);
-		RULE_MATCH(6);
-		RULE_MATCH(7);
-		RULE_MATCH(8);
-		RULE_MATCH(9);
-		RULE_MATCH(10);
-		RULE_MATCH(11);
-		RULE_MATCH(12);
-		RULE_MATCH(13);
-		RULE_MATCH(14);
-		RULE_MATCH(15);
-		RULE_MATCH(16);
-		RULE_MATCH(17);
-		RULE_MATCH(18);
-		RULE_MATCH(19);
-		RULE_MATCH(20);
-		RULE_MATCH(21);
-		RULE_MATCH(22);
-		RULE_MATCH(23);
-		RULE_MATCH(24);
-		RULE_MATCH(25);
-		RULE_MATCH(26);
-		RULE_MATCH(27);
-		RULE_MATCH(28);
-		RULE_MATCH(29);
-		RULE_MATCH(30);
-		RULE_MATCH(31);
-		RULE_MATCH(32);
-		RULE_MATCH(33);
-		RULE_MATCH(34);
-		RULE_MATCH(35);
-		RULE_MATCH(36);
-
-		/* iterate over all possible matches in 64 rules */
-
-		while (rule_match) {
-			uint32_t loc;
-			uint32_t idx_match;
-
-			/* find next match in chunk */
-			loc = ffsl(rule_match);
-			idx_match = loc + (j * STRIDE_BITS);
-
-			if (unlikely(idx_match > conf->_num_rules))
-				return NULL;
-
-			void *r = conf->_md[idx_match - 1];
-
-			/* Process the bytecode to verify the match */
-			if (npf_rule_proc(data, r))
-				return r;
+/*
+ * g2_eval4_burst()
+ * conf:     ptr to configuration structure
+ * packets:  num packets to compare
+ * data:     per packet data for the bytecode
+ * rules:    set to the first rule matched by each packet, or NULL
+ */
+void g2_eval4_burst(const g2_config_t *conf, const uint8_t *packets[],
+		    const void *data[], void *rules[], uint32_t num)
+{
+	uint32_t i, n;
 
-			/* exclusive OR w/ loc to allow further search */
-			rule_match ^= (1ull << (loc - 1ull));
-		}
+	for (i = 0; i < num; i += n) {
+		n = RTE_MIN(num - i, (uint32_t)G2_BURST_MAX);
+		g2_eval_burst(conf, &packets[i], &data[i], &rules[i], n,
+			      G2_TABLES_V4);
+	}
+}
+
+void g2_eval6_burst(const g2_config_t *conf, const uint8_t *packets[],
+		    const void *data[], void *rules[], uint32_t num)
+{
+	uint32_t i, n;
+
+	for (i = 0; i < num; i += n) {
+		n = RTE_MIN(num - i, (uint32_t)G2_BURST_MAX);
+		g2_eval_burst(conf, &packets[i], &data[i], &rules[i], n,
+			      G2_TABLES_V6);
 	}
-	/* 0 is no match */
-	return NULL;
 }
 
 /*
@@ -20,6 +20,12 @@ typedef struct g2_config g2_config_t;
 typedef void *g2_handle_t;
 typedef	bool (*process_callback)(void *, void *);
 
+/*
+ * Allow or prevent vector instructions being used to AND the bit
+ * patterns.  Applies to groupers built from now on.
+ */
+void g2_set_simd_enabled(bool enable);
+
 g2_config_t *g2_init(uint num_tables);
 bool g2_create_rule(g2_config_t *conf, rule_no_t rule_no, void *match_data);
 bool g2_add(g2_config_t *conf, uint table, uint ntables,
@@ -29,6 +35,10 @@ void *g2_eval4(const g2_config_t *conf, const uint8_t *packet,
 	       const void *data);
 void *g2_eval6(const g2_config_t *conf, const uint8_t *packet,
 	       const void *data);
+void g2_eval4_burst(const g2_config_t *conf, const uint8_t *packets[],
+		    const void *data[], void *rules[], uint32_t num);
+void g2_eval6_burst(const g2_config_t *conf, const uint8_t *packets[],
+		    const void *data[], void *rules[], uint32_t num);
 void g2_destroy(g2_config_t **confp);
 
 #endif /* GROUPER2_H */
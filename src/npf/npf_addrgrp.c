@@ -10,6 +10,7 @@
 #include <errno.h>
 #include <netinet/in.h>
 #include <rte_branch_prediction.h>
+#include <rte_log.h>
 #include <rte_rwlock.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -22,11 +23,13 @@
 #include "json_writer.h"
 #include "npf/npf.h"
 #include "npf_addrgrp.h"
+#include "npf_addrgrp_compiled.h"
 #include "npf_cidr_util.h"
 #include "npf_ptree.h"
 #include "npf_tblset.h"
 #include "urcu.h"
 #include "util.h"
+#include "vplane_log.h"
 
 struct ptree_node;
 struct ptree_table;
@@ -74,6 +77,19 @@ struct ptree_table;
  * There is one 'writer' (main thread) and multiple 'readers' (forwarding
  * threads).  The readers are only blocked when the writer holds the lock.
  *
+ * Large address-groups, such as threat lists, may be compiled.  A compiled
+ * address-group also has a table per address family of merged address
+ * intervals (npf_addrgrp_compiled.c), which the forwarding threads use
+ * instead of the ptree.  The table is rebuilt from the list after each
+ * change and swapped in under RCU, so lookups take no lock.  The ptree is
+ * still maintained, and is used if a table can't be built.
+ *
+ * Entries added between the start and end of a bulk load are staged
+ * rather than added one at a time.  At the end of the load they are
+ * sorted, checked for overlaps against each other and the list in one
+ * pass, and added to the list and ptree, and the tables are rebuilt
+ * once.
+ *
  *
  * g_addrgrp_table[]
  *      |
@@ -212,8 +228,11 @@ struct npf_addrgrp {
 	uint32_t            ag_tid;  /* Index of ag in tableset */
 	rte_rwlock_t        ag_lock;
 	bool                ag_any[AG_MAX];  /* 0.0.0.0/0 or ::/0 */
+	bool                ag_compile;      /* use compiled tables */
 	zlist_t            *ag_list[AG_MAX];
 	struct ptree_table *ag_tree[AG_MAX];
+	struct agc_table   *ag_compiled[AG_MAX];
+	struct ag_bulk     *ag_bulk;         /* bulk load in progress */
 };
 
 #define AG_KLEN_IPv4 4
@@ -223,8 +242,44 @@ struct npf_addrgrp {
 #define AG_AF2ALEN(_af)   ((_af) == AG_IPv4 ? AG_KLEN_IPv4 : AG_KLEN_IPv6)
 #define AG_AF2INET(_af)   ((_af) == AG_IPv4 ? AF_INET : AF_INET6)
 
+/*
+ * An entry staged by a bulk load.  Prefixes are also stored as the
+ * range of addresses they cover.
+ */
+struct ag_bulk_entry {
+	uint8_t                   be_start[AG_KLEN_IPv6];
+	uint8_t                   be_end[AG_KLEN_IPv6];
+	uint8_t                   be_mask;
+	bool                      be_range;
+	bool                      be_reject;
+	/* existing prefix entry with the same address */
+	struct npf_addrgrp_entry *be_ae;
+};
+
+struct ag_bulk {
+	struct ag_bulk_entry *ab_entries[AG_MAX];
+	uint32_t              ab_count[AG_MAX];
+	uint32_t              ab_size[AG_MAX];
+};
+
+/* Initial number of entries a bulk load may stage per address family */
+#define NPF_ADDRGRP_BULK_INIT 1024
+
+/* Listeners for changes to the entries of address-groups */
+struct npf_addrgrp_evh {
+	struct npf_addrgrp_evh *evh_next;
+	npf_addrgrp_ev_cb      *evh_fn;
+};
+
+static struct npf_addrgrp_evh *npf_addrgrp_evh;
+
 /* Forward reference */
 static void npf_tbl_entry_free_cb(void *data);
+static void npf_addrgrp_changed(struct npf_addrgrp *ag);
+static void npf_addrgrp_bulk_free(struct ag_bulk *ab);
+static int npf_addrgrp_bulk_stage(struct npf_addrgrp *ag, const uint8_t *start,
+				  const uint8_t *end, uint8_t alen,
+				  uint8_t mask);
 
 /*
  * We store NPF_NO_NETMASK (255) in the prefix list to allow for the user to
@@ -291,6 +346,7 @@ npf_addrgrp_lookup(enum npf_addrgrp_af af, uint32_t tid, npf_addr_t *addr)
 {
 	struct npf_addrgrp *ag;
 	struct ptree_node *pn;
+	struct agc_table *agc;
 
 	if (unlikely(!npf_tbl_id_is_valid(tid)))
 		return -EINVAL;
@@ -305,6 +361,14 @@ npf_addrgrp_lookup(enum npf_addrgrp_af af, uint32_t tid, npf_addr_t *addr)
 	if (ag->ag_any[af])
 		return 0;
 
+	agc = rcu_dereference(ag->ag_compiled[af]);
+	if (agc) {
+		if (af == AG_IPv4)
+			return agc_lookup_v4(agc, addr->s6_addr32[0]) ?
+				0 : -ENOENT;
+		return agc_lookup_v6(agc, addr->s6_addr) ? 0 : -ENOENT;
+	}
+
 	rte_rwlock_read_lock(&ag->ag_lock);
 
 	pn = ptree_shortest_match(ag->ag_tree[af], addr->s6_addr);
@@ -320,6 +384,7 @@ npf_addrgrp_lookup(enum npf_addrgrp_af af, uint32_t tid, npf_addr_t *addr)
 static ALWAYS_INLINE int ag_lookup_v4(struct npf_addrgrp *ag, uint32_t addr)
 {
 	struct ptree_node *pn;
+	struct agc_table *agc;
 
 	if (unlikely(!ag))
 		return -EINVAL;
@@ -328,6 +393,10 @@ static ALWAYS_INLINE int ag_lookup_v4(struct npf_addrgrp *ag, uint32_t addr)
 	if (ag->ag_any[AG_IPv4])
 		return 0;
 
+	agc = rcu_dereference(ag->ag_compiled[AG_IPv4]);
+	if (agc)
+		return agc_lookup_v4(agc, addr) ? 0 : -ENOENT;
+
 	rte_rwlock_read_lock(&ag->ag_lock);
 
 	pn = ptree_shortest_match(ag->ag_tree[AG_IPv4], (uint8_t *)&addr);
@@ -366,6 +435,7 @@ int npf_addrgrp_lookup_v4_by_handle(struct npf_addrgrp *ag, uint32_t addr)
 static ALWAYS_INLINE int ag_lookup_v6(struct npf_addrgrp *ag, uint8_t *addr)
 {
 	struct ptree_node *pn;
+	struct agc_table *agc;
 
 	if (unlikely(!ag))
 		return -EINVAL;
@@ -374,6 +444,10 @@ static ALWAYS_INLINE int ag_lookup_v6(struct npf_addrgrp *ag, uint8_t *addr)
 	if (ag->ag_any[AG_IPv6])
 		return 0;
 
+	agc = rcu_dereference(ag->ag_compiled[AG_IPv6]);
+	if (agc)
+		return agc_lookup_v6(agc, addr) ? 0 : -ENOENT;
+
 	rte_rwlock_read_lock(&ag->ag_lock);
 
 	pn = ptree_shortest_match(ag->ag_tree[AG_IPv6], addr);
@@ -655,6 +729,17 @@ error:
  */
 static void npf_addrgrp_destroy(struct npf_addrgrp *ag)
 {
+	int af;
+
+	npf_addrgrp_bulk_free(ag->ag_bulk);
+	ag->ag_bulk = NULL;
+
+	/* Readers finished with the address-group before this callback */
+	for (af = AG_IPv4; af <= AG_IPv6; af++) {
+		agc_table_free(ag->ag_compiled[af]);
+		ag->ag_compiled[af] = NULL;
+	}
+
 	/*
 	 * The zlist free function callbacks will take care of removing
 	 * corresponding ptree table entries.
@@ -1203,10 +1288,12 @@ npf_addrgrp_useable_addrs(uint8_t masklen, uint8_t alen, bool count_all)
 /*
  * Prefix entries can exist in two different lists. Either in the main
  * access-group list, or in a range entries derived prefix list.
+ *
+ * Append a prefix entry without re-sorting the list.
  */
 static struct npf_addrgrp_entry *
-npf_addrgrp_prefix_insert_list(zlist_t *list, zlist_free_fn free_fn,
-			       uint8_t *addr, uint8_t alen,
+npf_addrgrp_prefix_append_list(zlist_t *list, zlist_free_fn free_fn,
+			       const uint8_t *addr, uint8_t alen,
 			       uint8_t mask, struct npf_addrgrp *ag)
 {
 	struct npf_addrgrp_entry *ae;
@@ -1234,8 +1321,22 @@ npf_addrgrp_prefix_insert_list(zlist_t *list, zlist_free_fn free_fn,
 	if (free_fn)
 		zlist_freefn(list, ae, free_fn, true);
 
+	return ae;
+}
+
+static struct npf_addrgrp_entry *
+npf_addrgrp_prefix_insert_list(zlist_t *list, zlist_free_fn free_fn,
+			       uint8_t *addr, uint8_t alen,
+			       uint8_t mask, struct npf_addrgrp *ag)
+{
+	struct npf_addrgrp_entry *ae;
+
+	ae = npf_addrgrp_prefix_append_list(list, free_fn, addr, alen,
+					    mask, ag);
+
 	/* Maintain the list in order */
-	zlist_sort(list, npf_addrgrp_cmp);
+	if (ae)
+		zlist_sort(list, npf_addrgrp_cmp);
 
 	return ae;
 }
@@ -1343,6 +1444,11 @@ int npf_addrgrp_prefix_insert(const char *name, npf_addr_t *addr,
 	if (mask == 0 && ag->ag_any[af])
 		return -EEXIST;
 
+	/* Checked and added at the end of a bulk load */
+	if (ag->ag_bulk && mask != 0)
+		return npf_addrgrp_bulk_stage(ag, addr->s6_addr, NULL,
+					      alen, mask);
+
 	/*
 	 * Does the new prefix match/overlap with an existing prefix list
 	 * entry or list range entry?  This examines the address-group *list*.
@@ -1358,7 +1464,10 @@ int npf_addrgrp_prefix_insert(const char *name, npf_addr_t *addr,
 			return -EEXIST;
 
 		/* Add mask to existing entry */
-		return npf_addrgrp_prefix_mask_insert(ae, mask);
+		rc = npf_addrgrp_prefix_mask_insert(ae, mask);
+		if (rc == 0)
+			npf_addrgrp_changed(ag);
+		return rc;
 	}
 
 
@@ -1375,6 +1484,7 @@ int npf_addrgrp_prefix_insert(const char *name, npf_addr_t *addr,
 	 */
 	if (mask == 0) {
 		ag->ag_any[af] = true;
+		npf_addrgrp_changed(ag);
 		return 0;
 	}
 
@@ -1392,6 +1502,8 @@ int npf_addrgrp_prefix_insert(const char *name, npf_addr_t *addr,
 
 	assert(rc == 0);
 
+	npf_addrgrp_changed(ag);
+
 	return rc;
 }
 
@@ -1467,8 +1579,8 @@ npf_addrgrp_range_pfx_list_ptree_insert(struct npf_addrgrp *ag,
 }
 
 static struct npf_addrgrp_entry *
-npf_addrgrp_range_insert_list(zlist_t *list, uint8_t *start,
-			      uint8_t *end, uint8_t alen,
+npf_addrgrp_range_append_list(zlist_t *list, const uint8_t *start,
+			      const uint8_t *end, uint8_t alen,
 			      struct npf_addrgrp *ag)
 {
 	struct npf_addrgrp_entry *ae;
@@ -1501,8 +1613,47 @@ npf_addrgrp_range_insert_list(zlist_t *list, uint8_t *start,
 	}
 	zlist_freefn(list, ae, npf_addrgrp_entry_free, true);
 
+	return ae;
+}
+
+/*
+ * Derive the prefix list of an address range entry
+ */
+static void
+npf_addrgrp_range_pfx_list_create(struct npf_addrgrp *ag,
+				  struct npf_addrgrp_entry *ae, uint8_t alen)
+{
+	struct cidr_tree cidr;
+	uint8_t a1[alen], a2[alen];
+
+	npf_cidr_tree_init(&cidr, alen);
+
+	reverse_addr(a1, ar_start(ae), alen);
+	reverse_addr(a2, ar_end(ae), alen);
+	npf_cidr_save_range(&cidr, a1, a2);
+
+	struct npf_addgrp_cidr_walk_ctx ctx = {
+		.ag      = ag,
+		.list    = ae->ar_list,
+		.free_fn = npf_addrgrp_entry_free,
+	};
+
+	npf_cidr_tree_walk(&cidr, alen, npf_addrgrp_range_pfx_insert, &ctx);
+	npf_cidr_tree_free(&cidr);
+}
+
+static struct npf_addrgrp_entry *
+npf_addrgrp_range_insert_list(zlist_t *list, uint8_t *start,
+			      uint8_t *end, uint8_t alen,
+			      struct npf_addrgrp *ag)
+{
+	struct npf_addrgrp_entry *ae;
+
+	ae = npf_addrgrp_range_append_list(list, start, end, alen, ag);
+
 	/* Maintain the list in order */
-	zlist_sort(list, npf_addrgrp_cmp);
+	if (ae)
+		zlist_sort(list, npf_addrgrp_cmp);
 
 	return ae;
 }
@@ -1650,6 +1801,11 @@ int npf_addrgrp_range_insert(const char *name, npf_addr_t *start,
 	if (!ag)
 		return -ENOENT;
 
+	/* Checked and added at the end of a bulk load */
+	if (ag->ag_bulk)
+		return npf_addrgrp_bulk_stage(ag, start->s6_addr, end->s6_addr,
+					      alen, 0);
+
 	/*
 	 * Does the new range overlap with an existing prefix entry or range
 	 * entry?
@@ -1694,24 +1850,7 @@ int npf_addrgrp_range_insert(const char *name, npf_addr_t *start,
 	 * Convert range to minimal set of CIDR notation blocks, and add to
 	 * ptree
 	 */
-	struct cidr_tree cidr;
-	uint8_t a1[alen], a2[alen];
-
-	npf_cidr_tree_init(&cidr, alen);
-
-	reverse_addr(a1, ar_start(ae), alen);
-	reverse_addr(a2, ar_end(ae), alen);
-	npf_cidr_save_range(&cidr, a1, a2);
-
-	struct npf_addgrp_cidr_walk_ctx ctx = {
-		.ag      = ag,
-		.list    = ae->ar_list,
-		.free_fn = npf_addrgrp_entry_free,
-	};
-
-	/* Derive prefix list from address range */
-	npf_cidr_tree_walk(&cidr, alen, npf_addrgrp_range_pfx_insert, &ctx);
-	npf_cidr_tree_free(&cidr);
+	npf_addrgrp_range_pfx_list_create(ag, ae, alen);
 
 	if (!cur_ae)
 		/*
@@ -1721,6 +1860,8 @@ int npf_addrgrp_range_insert(const char *name, npf_addr_t *start,
 	else
 		npf_addrgrp_range_update(ag, cur_ae, ae, alen);
 
+	npf_addrgrp_changed(ag);
+
 	return 0;
 }
 
@@ -1773,8 +1914,10 @@ int npf_addrgrp_prefix_remove(const char *name, npf_addr_t *addr,
 	if (rc < 0)
 		return rc;
 
-	if (ae->ap_nmasks > 0)
+	if (ae->ap_nmasks > 0) {
+		npf_addrgrp_changed(ag);
 		return 0;
+	}
 
 	if (mask == 0)
 		ag->ag_any[AG_ALEN2AF(alen)] = false;
@@ -1785,6 +1928,8 @@ int npf_addrgrp_prefix_remove(const char *name, npf_addr_t *addr,
 	 */
 	zlist_remove(ag->ag_list[AG_ALEN2AF(alen)], ae);
 
+	npf_addrgrp_changed(ag);
+
 	return 0;
 }
 
@@ -1818,6 +1963,527 @@ int npf_addrgrp_range_remove(const char *name, npf_addr_t *start,
 	 */
 	zlist_remove(ag->ag_list[AG_ALEN2AF(alen)], ae);
 
+	npf_addrgrp_changed(ag);
+
+	return 0;
+}
+
+/********************************************************************
+ * Compiled address-group tables
+ *******************************************************************/
+
+/*
+ * Build a compiled table from an address-group list.  Prefix entries
+ * contribute their shortest mask, as they do to the ptree.
+ */
+static struct agc_table *
+npf_addrgrp_compile_af(struct npf_addrgrp *ag, enum npf_addrgrp_af af)
+{
+	uint8_t alen = AG_AF2ALEN(af);
+	zlist_t *list = ag->ag_list[af];
+	struct npf_addrgrp_entry *ae;
+	uint8_t start[alen], end[alen];
+	struct agc_table *t = NULL;
+	struct agc_builder *b;
+	int rc = 0;
+
+	b = agc_builder_create(alen);
+	if (!b)
+		return NULL;
+
+	for (ae = zlist_first(list); ae != NULL && rc == 0;
+	     ae = zlist_next(list)) {
+		if (ae->ae_type == NPF_ADDRGRP_TYPE_PREFIX) {
+			npf_addrgrp_prefix_to_range(ap_prefix(ae),
+						    ae->ap_mask[0], alen,
+						    start, end);
+			rc = agc_builder_add(b, start, end);
+		} else
+			rc = agc_builder_add(b, ar_start(ae), ar_end(ae));
+	}
+
+	if (rc == 0)
+		t = agc_build(b);
+
+	agc_builder_free(b);
+	return t;
+}
+
+/*
+ * Rebuild the compiled tables of an address-group and swap them in, or
+ * remove them if it is no longer compiled.  If a table can't be built
+ * then the forwarding threads use the ptree.
+ */
+static void npf_addrgrp_compile(struct npf_addrgrp *ag)
+{
+	struct agc_table *new, *old;
+	int af;
+
+	for (af = AG_IPv4; af <= AG_IPv6; af++) {
+		new = NULL;
+		if (ag->ag_compile) {
+			new = npf_addrgrp_compile_af(ag, af);
+			if (!new)
+				RTE_LOG(ERR, FIREWALL,
+					"Failed to compile address-group %s\n",
+					ag->ag_name);
+		}
+
+		old = ag->ag_compiled[af];
+		rcu_assign_pointer(ag->ag_compiled[af], new);
+		agc_table_destroy(old);
+	}
+}
+
+int npf_addrgrp_ev_listen(npf_addrgrp_ev_cb *fn)
+{
+	struct npf_addrgrp_evh *evh = malloc(sizeof(*evh));
+
+	if (!evh)
+		return -ENOMEM;
+
+	evh->evh_fn = fn;
+	evh->evh_next = npf_addrgrp_evh;
+	npf_addrgrp_evh = evh;
+
+	return 0;
+}
+
+/*
+ * Called after the entries of an address-group change.  During a bulk
+ * load the tables are rebuilt, and listeners told, once at the end.
+ */
+static void npf_addrgrp_changed(struct npf_addrgrp *ag)
+{
+	struct npf_addrgrp_evh *evh;
+
+	if (ag->ag_bulk)
+		return;
+
+	if (ag->ag_compile)
+		npf_addrgrp_compile(ag);
+
+	for (evh = npf_addrgrp_evh; evh; evh = evh->evh_next)
+		evh->evh_fn(ag);
+}
+
+/*
+ * Enable or disable the compiled tables of an address-group
+ */
+int npf_addrgrp_set_compiled(const char *name, bool compile)
+{
+	struct npf_addrgrp *ag;
+
+	ag = npf_addrgrp_lookup_name(name);
+	if (!ag)
+		return -ENOENT;
+
+	ag->ag_compile = compile;
+	npf_addrgrp_compile(ag);
+
+	return 0;
+}
+
+/********************************************************************
+ * Address group bulk load
+ *******************************************************************/
+
+static void npf_addrgrp_bulk_free(struct ag_bulk *ab)
+{
+	int af;
+
+	if (!ab)
+		return;
+
+	for (af = AG_IPv4; af <= AG_IPv6; af++)
+		free(ab->ab_entries[af]);
+	free(ab);
+}
+
+/*
+ * Stage a prefix (end is NULL) or range entry.  Addresses are in network
+ * byte order, and have already been validated as for a single entry.
+ */
+static int
+npf_addrgrp_bulk_stage(struct npf_addrgrp *ag, const uint8_t *start,
+		       const uint8_t *end, uint8_t alen, uint8_t mask)
+{
+	enum npf_addrgrp_af af = AG_ALEN2AF(alen);
+	struct ag_bulk *ab = ag->ag_bulk;
+	struct ag_bulk_entry *be;
+
+	if (ab->ab_count[af] == ab->ab_size[af]) {
+		uint32_t size = ab->ab_size[af] ?
+			2 * ab->ab_size[af] : NPF_ADDRGRP_BULK_INIT;
+
+		if (size <= ab->ab_size[af])
+			return -ENOSPC;
+
+		be = realloc(ab->ab_entries[af], size * sizeof(*be));
+		if (!be)
+			return -ENOMEM;
+
+		ab->ab_entries[af] = be;
+		ab->ab_size[af] = size;
+	}
+
+	be = &ab->ab_entries[af][ab->ab_count[af]++];
+	memset(be, 0, sizeof(*be));
+
+	memcpy(be->be_start, start, alen);
+	if (end) {
+		memcpy(be->be_end, end, alen);
+		be->be_range = true;
+	} else {
+		memcpy(be->be_end, start, alen);
+		set_host_bits(be->be_end, alen, mask);
+		be->be_mask = mask;
+	}
+	return 0;
+}
+
+/*
+ * Order staged entries by start address.  Prefixes with the same address
+ * are ordered shortest mask first, so that the shortest is the one added
+ * to the ptree.
+ */
+static int
+npf_addrgrp_bulk_cmp(const struct ag_bulk_entry *b1,
+		     const struct ag_bulk_entry *b2, uint8_t alen)
+{
+	int rc;
+
+	rc = npf_addrgrp_addr_cmp(b1->be_start, b2->be_start, alen);
+	if (rc != 0)
+		return rc;
+
+	if (b1->be_range != b2->be_range)
+		return b1->be_range ? 1 : -1;
+
+	return (int)b1->be_mask - (int)b2->be_mask;
+}
+
+static int npf_addrgrp_bulk_cmp_v4(const void *a, const void *b)
+{
+	return npf_addrgrp_bulk_cmp(a, b, AG_KLEN_IPv4);
+}
+
+static int npf_addrgrp_bulk_cmp_v6(const void *a, const void *b)
+{
+	return npf_addrgrp_bulk_cmp(a, b, AG_KLEN_IPv6);
+}
+
+/*
+ * An entry of an address-group list, with the highest end address of
+ * it and all entries before it, and of all range entries before it.
+ */
+struct ag_bulk_exist {
+	struct npf_addrgrp_entry *ex_ae;
+	const uint8_t            *ex_start;
+	uint8_t                   ex_max_end[AG_KLEN_IPv6];
+	uint8_t                   ex_max_rend[AG_KLEN_IPv6];
+	bool                      ex_rend;	/* ex_max_rend is set */
+};
+
+static void ag_addr_max(uint8_t *max, const uint8_t *addr, uint8_t alen)
+{
+	if (npf_addrgrp_addr_cmp(addr, max, alen) > 0)
+		memcpy(max, addr, alen);
+}
+
+/*
+ * Summarise the (sorted) list of an address-group for the overlap
+ * checks.  Returns the number of entries, or < 0 on error.
+ */
+static int
+npf_addrgrp_bulk_exist(zlist_t *list, uint8_t alen,
+		       struct ag_bulk_exist **exp)
+{
+	struct ag_bulk_exist *ex, *prev = NULL;
+	struct npf_addrgrp_entry *ae;
+	uint8_t start[alen], end[alen];
+	size_t n = zlist_size(list);
+	int i = 0;
+
+	*exp = NULL;
+	if (n == 0)
+		return 0;
+
+	ex = calloc(n, sizeof(*ex));
+	if (!ex)
+		return -ENOMEM;
+
+	for (ae = zlist_first(list); ae != NULL; ae = zlist_next(list), i++) {
+		if (ae->ae_type == NPF_ADDRGRP_TYPE_PREFIX)
+			npf_addrgrp_prefix_to_range(ap_prefix(ae),
+						    ae->ap_mask[0], alen,
+						    start, end);
+		else {
+			memcpy(start, ar_start(ae), alen);
+			memcpy(end, ar_end(ae), alen);
+		}
+
+		ex[i].ex_ae = ae;
+		ex[i].ex_start = (ae->ae_type == NPF_ADDRGRP_TYPE_PREFIX) ?
+			ap_prefix(ae) : ar_start(ae);
+
+		if (prev) {
+			memcpy(ex[i].ex_max_end, prev->ex_max_end, alen);
+			memcpy(ex[i].ex_max_rend, prev->ex_max_rend, alen);
+			ex[i].ex_rend = prev->ex_rend;
+		}
+		ag_addr_max(ex[i].ex_max_end, end, alen);
+
+		if (ae->ae_type == NPF_ADDRGRP_TYPE_RANGE) {
+			ag_addr_max(ex[i].ex_max_rend, end, alen);
+			ex[i].ex_rend = true;
+		}
+		prev = &ex[i];
+	}
+
+	*exp = ex;
+	return i;
+}
+
+/*
+ * Find the last list entry starting at or before an address, or -1
+ */
+static int
+npf_addrgrp_bulk_exist_find(struct ag_bulk_exist *ex, int n,
+			    const uint8_t *addr, uint8_t alen)
+{
+	int lo = 0, hi = n - 1, mid, found = -1;
+
+	while (lo <= hi) {
+		mid = lo + (hi - lo) / 2;
+		if (npf_addrgrp_addr_cmp(ex[mid].ex_start, addr, alen) <= 0) {
+			found = mid;
+			lo = mid + 1;
+		} else
+			hi = mid - 1;
+	}
+	return found;
+}
+
+/*
+ * Mark the staged entries of one address family that would be refused
+ * if added singly: a range may not overlap anything, and a prefix may not
+ * overlap a range.  Where two staged entries overlap, the later one is
+ * refused.  Returns the number refused.
+ */
+static uint32_t
+npf_addrgrp_bulk_check(struct ag_bulk_entry *bulk, uint32_t count,
+		       struct ag_bulk_exist *ex, int nex, uint8_t alen)
+{
+	uint8_t max_end[alen], max_rend[alen];
+	bool have_end = false, have_rend = false;
+	struct ag_bulk_entry *be;
+	uint32_t i, nrejected = 0;
+	int k;
+
+	for (i = 0; i < count; i++) {
+		be = &bulk[i];
+
+		/* Against the list */
+		k = npf_addrgrp_bulk_exist_find(ex, nex, be->be_end, alen);
+		if (k >= 0) {
+			if (be->be_range)
+				be->be_reject =
+					npf_addrgrp_addr_cmp(
+						ex[k].ex_max_end,
+						be->be_start, alen) >= 0;
+			else
+				be->be_reject = ex[k].ex_rend &&
+					npf_addrgrp_addr_cmp(
+						ex[k].ex_max_rend,
+						be->be_start, alen) >= 0;
+		}
+
+		/* Against earlier staged entries */
+		if (!be->be_reject) {
+			if (be->be_range)
+				be->be_reject = have_end &&
+					npf_addrgrp_addr_cmp(
+						max_end, be->be_start,
+						alen) >= 0;
+			else
+				be->be_reject = have_rend &&
+					npf_addrgrp_addr_cmp(
+						max_rend, be->be_start,
+						alen) >= 0;
+		}
+
+		if (be->be_reject) {
+			nrejected++;
+			continue;
+		}
+
+		/* A prefix already in the list gets another mask */
+		if (!be->be_range) {
+			k = npf_addrgrp_bulk_exist_find(ex, nex, be->be_start,
+							alen);
+			if (k >= 0 &&
+			    ex[k].ex_ae->ae_type == NPF_ADDRGRP_TYPE_PREFIX &&
+			    npf_addrgrp_addr_cmp(ex[k].ex_start, be->be_start,
+						 alen) == 0)
+				be->be_ae = ex[k].ex_ae;
+		}
+
+		if (!have_end)
+			memcpy(max_end, be->be_end, alen);
+		else
+			ag_addr_max(max_end, be->be_end, alen);
+		have_end = true;
+
+		if (be->be_range) {
+			if (!have_rend)
+				memcpy(max_rend, be->be_end, alen);
+			else
+				ag_addr_max(max_rend, be->be_end, alen);
+			have_rend = true;
+		}
+	}
+	return nrejected;
+}
+
+/*
+ * Add the staged entries of one address family to the list and ptree.
+ * Returns the number that could not be added.
+ */
+static uint32_t
+npf_addrgrp_bulk_apply(struct npf_addrgrp *ag, enum npf_addrgrp_af af)
+{
+	struct ag_bulk_entry *bulk = ag->ag_bulk->ab_entries[af];
+	uint32_t count = ag->ag_bulk->ab_count[af];
+	struct npf_addrgrp_entry *ae, *last = NULL;
+	struct ptree_table *tree = ag->ag_tree[af];
+	zlist_t *list = ag->ag_list[af];
+	uint8_t alen = AG_AF2ALEN(af);
+	struct ag_bulk_exist *ex;
+	uint32_t i, nrejected;
+	int nex, rc;
+
+	if (count == 0)
+		return 0;
+
+	qsort(bulk, count, sizeof(*bulk), af == AG_IPv4 ?
+	      npf_addrgrp_bulk_cmp_v4 : npf_addrgrp_bulk_cmp_v6);
+
+	nex = npf_addrgrp_bulk_exist(list, alen, &ex);
+	if (nex < 0)
+		return count;
+
+	nrejected = npf_addrgrp_bulk_check(bulk, count, ex, nex, alen);
+	free(ex);
+
+	for (i = 0; i < count; i++) {
+		struct ag_bulk_entry *be = &bulk[i];
+
+		if (be->be_reject)
+			continue;
+
+		if (be->be_range) {
+			ae = npf_addrgrp_range_append_list(list, be->be_start,
+							   be->be_end, alen,
+							   ag);
+			if (!ae) {
+				nrejected++;
+				continue;
+			}
+			npf_addrgrp_range_pfx_list_create(ag, ae, alen);
+			npf_addrgrp_range_pfx_list_ptree_insert(ag, ae);
+			last = NULL;
+			continue;
+		}
+
+		if (be->be_ae) {
+			if (npf_addrgrp_prefix_mask_insert(be->be_ae,
+							   be->be_mask) < 0)
+				nrejected++;
+			continue;
+		}
+
+		if (last && npf_addrgrp_addr_cmp(ap_prefix(last),
+						 be->be_start, alen) == 0) {
+			if (npf_addrgrp_prefix_mask_insert(last,
+							   be->be_mask) < 0)
+				nrejected++;
+			continue;
+		}
+
+		ae = npf_addrgrp_prefix_append_list(list,
+						    npf_addrgrp_entry_free,
+						    be->be_start, alen,
+						    be->be_mask, ag);
+		if (!ae) {
+			nrejected++;
+			continue;
+		}
+
+		rte_rwlock_write_lock(&ag->ag_lock);
+
+		rc = ptree_insert(tree, ap_prefix(ae),
+				  ag_ptree_mask(af, be->be_mask));
+		if (rc == 0)
+			ae->ae_ptree = 1;
+
+		rte_rwlock_write_unlock(&ag->ag_lock);
+
+		last = ae;
+	}
+
+	/* Maintain the list in order */
+	zlist_sort(list, npf_addrgrp_cmp);
+
+	return nrejected;
+}
+
+/*
+ * Start a bulk load of an address-group
+ */
+int npf_addrgrp_bulk_start(const char *name)
+{
+	struct npf_addrgrp *ag;
+
+	ag = npf_addrgrp_lookup_name(name);
+	if (!ag)
+		return -ENOENT;
+
+	if (ag->ag_bulk)
+		return -EALREADY;
+
+	ag->ag_bulk = calloc(1, sizeof(*ag->ag_bulk));
+	if (!ag->ag_bulk)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/*
+ * End a bulk load of an address-group, adding the staged entries
+ */
+int npf_addrgrp_bulk_end(const char *name, uint32_t *nrejected)
+{
+	struct npf_addrgrp *ag;
+	int af;
+
+	*nrejected = 0;
+
+	ag = npf_addrgrp_lookup_name(name);
+	if (!ag)
+		return -ENOENT;
+
+	if (!ag->ag_bulk)
+		return -EINVAL;
+
+	for (af = AG_IPv4; af <= AG_IPv6; af++)
+		*nrejected += npf_addrgrp_bulk_apply(ag, af);
+
+	npf_addrgrp_bulk_free(ag->ag_bulk);
+	ag->ag_bulk = NULL;
+
+	npf_addrgrp_changed(ag);
+
 	return 0;
 }
 
@@ -2147,6 +2813,9 @@ npf_addrgrp_jsonw_one(json_writer_t *json, struct npf_addrgrp *ag,
 	jsonw_string_field(json, "name", ag->ag_name);
 	jsonw_uint_field(json, "id", ag->ag_tid);
 
+	if (ag->ag_compile)
+		jsonw_bool_field(json, "compiled", true);
+
 	if (ctl->brief)
 		goto end;
 
@@ -2160,6 +2829,11 @@ npf_addrgrp_jsonw_one(json_writer_t *json, struct npf_addrgrp *ag,
 		jsonw_name(json, af == AG_IPv4 ? "ipv4" : "ipv6");
 		jsonw_start_object(json);
 
+		if (ag->ag_compiled[af])
+			jsonw_uint_field(json, "compiled-intervals",
+					 agc_table_nintervals(
+						 ag->ag_compiled[af]));
+
 		if (ctl->optimal)
 			npf_addrgrp_jsonw_optimal(json, ag, af);
 		else if (ctl->tree)
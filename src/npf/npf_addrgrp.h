@@ -271,6 +271,59 @@ int npf_addrgrp_prefix_remove(const char *name, npf_addr_t *addr,
 int npf_addrgrp_range_remove(const char *name, npf_addr_t *start,
 			     npf_addr_t *end, uint8_t alen);
 
+/**
+ * @brief Enable or disable the compiled tables of an address-group
+ *
+ * A compiled address-group is looked up in a table of merged address
+ * intervals rather than the ptree.  The table is rebuilt after each change
+ * to the group, so large groups should be loaded with a bulk load.
+ *
+ * @param name Address group name
+ * @param compile True to compile the address-group
+ *
+ * @return 0 if successful, else < 0.
+ */
+int npf_addrgrp_set_compiled(const char *name, bool compile);
+
+/**
+ * @brief Start a bulk load of an address-group
+ *
+ * Prefixes and ranges inserted until npf_addrgrp_bulk_end are staged, and
+ * are not matched until the end of the load.
+ *
+ * @param name Address group name
+ *
+ * @return 0 if successful, -EALREADY if a load is in progress, else < 0.
+ */
+int npf_addrgrp_bulk_start(const char *name);
+
+/**
+ * @brief End a bulk load of an address-group
+ *
+ * Adds the staged entries.  Entries that would have been refused if
+ * inserted singly, such as overlapping ranges, are counted and dropped.
+ *
+ * @param name Address group name
+ * @param nrejected Set to the number of staged entries not added
+ *
+ * @return 0 if successful, else < 0.
+ */
+int npf_addrgrp_bulk_end(const char *name, uint32_t *nrejected);
+
+/**
+ * @brief Listen for changes to the entries of any address-group
+ *
+ * The callback is run on the main thread after each change to the
+ * entries of an address-group, or once at the end of a bulk load.  For
+ * users caching the results of rules that match on address-groups.
+ *
+ * @param fn Callback, passed the changed address-group
+ *
+ * @return 0 if successful, else < 0.
+ */
+typedef void (npf_addrgrp_ev_cb)(struct npf_addrgrp *ag);
+int npf_addrgrp_ev_listen(npf_addrgrp_ev_cb *fn);
+
 
 /********************************************************************
  * Address group walks
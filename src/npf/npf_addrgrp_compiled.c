@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#include <arpa/inet.h>
+#include <endian.h>
+#include <errno.h>
+#include <rte_common.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compiler.h"
+#include "npf_addrgrp_compiled.h"
+#include "urcu.h"
+#include "util.h"
+
+#define AGC_INDEX_BITS	16
+#define AGC_INDEX_SIZE	(1u << AGC_INDEX_BITS)
+
+/* Initial number of intervals of a builder */
+#define AGC_BUILDER_INIT 1024
+
+/* IPv6 address as two host order words */
+struct agc_addr6 {
+	uint64_t	hi;
+	uint64_t	lo;
+};
+
+struct agc_ival4 {
+	uint32_t	start;
+	uint32_t	end;
+};
+
+struct agc_ival6 {
+	struct agc_addr6 start;
+	struct agc_addr6 end;
+};
+
+struct agc_builder {
+	uint8_t		ab_alen;
+	uint32_t	ab_count;
+	uint32_t	ab_size;
+	union {
+		struct agc_ival4 *v4;
+		struct agc_ival6 *v6;
+		void		 *ptr;
+	} ab_ivals;
+};
+
+/*
+ * The start and end addresses are kept in separate arrays so that the
+ * search only touches the start addresses.  at_index[b] is the first
+ * interval that ends in or after bucket b.
+ */
+struct agc_table {
+	struct rcu_head	at_rcu;
+	uint8_t		at_alen;
+	uint32_t	at_count;
+	union {
+		uint32_t	 *v4;
+		struct agc_addr6 *v6;
+	} at_start, at_end;
+	uint32_t	at_index[AGC_INDEX_SIZE + 1];
+};
+
+static inline struct agc_addr6 agc_addr6_get(const uint8_t *addr)
+{
+	struct agc_addr6 a;
+	uint64_t w[2];
+
+	memcpy(w, addr, sizeof(w));
+	a.hi = be64toh(w[0]);
+	a.lo = be64toh(w[1]);
+	return a;
+}
+
+static inline bool agc_addr6_le(struct agc_addr6 a, struct agc_addr6 b)
+{
+	return a.hi < b.hi || (a.hi == b.hi && a.lo <= b.lo);
+}
+
+static inline bool agc_addr6_lt(struct agc_addr6 a, struct agc_addr6 b)
+{
+	return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+struct agc_builder *agc_builder_create(uint8_t alen)
+{
+	struct agc_builder *b;
+
+	if (alen != 4 && alen != 16)
+		return NULL;
+
+	b = calloc(1, sizeof(*b));
+	if (!b)
+		return NULL;
+
+	b->ab_alen = alen;
+	return b;
+}
+
+void agc_builder_free(struct agc_builder *b)
+{
+	if (b) {
+		free(b->ab_ivals.ptr);
+		free(b);
+	}
+}
+
+int agc_builder_add(struct agc_builder *b, const uint8_t *start,
+		    const uint8_t *end)
+{
+	size_t isz = b->ab_alen == 4 ? sizeof(struct agc_ival4) :
+		sizeof(struct agc_ival6);
+
+	if (b->ab_count == b->ab_size) {
+		uint32_t size = b->ab_size ? 2 * b->ab_size : AGC_BUILDER_INIT;
+		void *p;
+
+		if (size <= b->ab_size)
+			return -ENOSPC;
+
+		p = realloc(b->ab_ivals.ptr, size * isz);
+		if (!p)
+			return -ENOMEM;
+		b->ab_ivals.ptr = p;
+		b->ab_size = size;
+	}
+
+	if (b->ab_alen == 4) {
+		struct agc_ival4 *iv = &b->ab_ivals.v4[b->ab_count];
+		uint32_t a;
+
+		memcpy(&a, start, sizeof(a));
+		iv->start = ntohl(a);
+		memcpy(&a, end, sizeof(a));
+		iv->end = ntohl(a);
+	} else {
+		struct agc_ival6 *iv = &b->ab_ivals.v6[b->ab_count];
+
+		iv->start = agc_addr6_get(start);
+		iv->end = agc_addr6_get(end);
+	}
+	b->ab_count++;
+	return 0;
+}
+
+static int agc_ival4_cmp(const void *a, const void *b)
+{
+	const struct agc_ival4 *x = a, *y = b;
+
+	if (x->start != y->start)
+		return x->start < y->start ? -1 : 1;
+	return 0;
+}
+
+static int agc_ival6_cmp(const void *a, const void *b)
+{
+	const struct agc_ival6 *x = a, *y = b;
+
+	if (agc_addr6_lt(x->start, y->start))
+		return -1;
+	if (agc_addr6_lt(y->start, x->start))
+		return 1;
+	return 0;
+}
+
+/*
+ * Sort the intervals, and merge those that overlap or are adjacent.
+ * Returns the number of intervals left.
+ */
+static uint32_t agc_merge_v4(struct agc_ival4 *iv, uint32_t n)
+{
+	uint32_t i, j;
+
+	if (n == 0)
+		return 0;
+
+	qsort(iv, n, sizeof(*iv), agc_ival4_cmp);
+
+	for (i = 0, j = 1; j < n; j++) {
+		if (iv[i].end == UINT32_MAX || iv[j].start <= iv[i].end + 1) {
+			if (iv[j].end > iv[i].end)
+				iv[i].end = iv[j].end;
+			continue;
+		}
+		iv[++i] = iv[j];
+	}
+	return i + 1;
+}
+
+static uint32_t agc_merge_v6(struct agc_ival6 *iv, uint32_t n)
+{
+	struct agc_addr6 next;
+	uint32_t i, j;
+
+	if (n == 0)
+		return 0;
+
+	qsort(iv, n, sizeof(*iv), agc_ival6_cmp);
+
+	for (i = 0, j = 1; j < n; j++) {
+		if (iv[i].end.hi == UINT64_MAX && iv[i].end.lo == UINT64_MAX)
+			continue;
+
+		/* First address after interval i */
+		next = iv[i].end;
+		if (++next.lo == 0)
+			next.hi++;
+
+		if (agc_addr6_le(iv[j].start, next)) {
+			if (agc_addr6_lt(iv[i].end, iv[j].end))
+				iv[i].end = iv[j].end;
+			continue;
+		}
+		iv[++i] = iv[j];
+	}
+	return i + 1;
+}
+
+static struct agc_table *agc_table_alloc(uint8_t alen, uint32_t count)
+{
+	size_t asz = alen == 4 ? sizeof(uint32_t) : sizeof(struct agc_addr6);
+	struct agc_table *t;
+
+	t = zmalloc_aligned(sizeof(*t));
+	if (!t)
+		return NULL;
+
+	t->at_alen = alen;
+	t->at_count = count;
+
+	/* Allocate at least one entry so that a lookup never sees NULL */
+	t->at_start.v4 = malloc(RTE_MAX(count, 1u) * asz);
+	t->at_end.v4 = malloc(RTE_MAX(count, 1u) * asz);
+	if (!t->at_start.v4 || !t->at_end.v4) {
+		agc_table_free(t);
+		return NULL;
+	}
+	return t;
+}
+
+struct agc_table *agc_build(struct agc_builder *b)
+{
+	struct agc_table *t;
+	uint32_t n, i, bkt;
+
+	if (b->ab_alen == 4)
+		n = agc_merge_v4(b->ab_ivals.v4, b->ab_count);
+	else
+		n = agc_merge_v6(b->ab_ivals.v6, b->ab_count);
+	b->ab_count = n;
+
+	t = agc_table_alloc(b->ab_alen, n);
+	if (!t)
+		return NULL;
+
+	if (b->ab_alen == 4) {
+		const struct agc_ival4 *iv = b->ab_ivals.v4;
+
+		for (i = 0; i < n; i++) {
+			t->at_start.v4[i] = iv[i].start;
+			t->at_end.v4[i] = iv[i].end;
+		}
+
+		for (i = 0, bkt = 0; bkt < AGC_INDEX_SIZE; bkt++) {
+			uint32_t base = bkt << (32 - AGC_INDEX_BITS);
+
+			while (i < n && iv[i].end < base)
+				i++;
+			t->at_index[bkt] = i;
+		}
+	} else {
+		const struct agc_ival6 *iv = b->ab_ivals.v6;
+
+		for (i = 0; i < n; i++) {
+			t->at_start.v6[i] = iv[i].start;
+			t->at_end.v6[i] = iv[i].end;
+		}
+
+		for (i = 0, bkt = 0; bkt < AGC_INDEX_SIZE; bkt++) {
+			uint64_t base = (uint64_t)bkt << (64 - AGC_INDEX_BITS);
+
+			while (i < n && iv[i].end.hi < base)
+				i++;
+			t->at_index[bkt] = i;
+		}
+	}
+	t->at_index[AGC_INDEX_SIZE] = n;
+
+	return t;
+}
+
+void agc_table_free(struct agc_table *t)
+{
+	if (t) {
+		free(t->at_start.v4);
+		free(t->at_end.v4);
+		free(t);
+	}
+}
+
+static void agc_table_rcu_free(struct rcu_head *head)
+{
+	agc_table_free(caa_container_of(head, struct agc_table, at_rcu));
+}
+
+void agc_table_destroy(struct agc_table *t)
+{
+	if (t)
+		call_rcu(&t->at_rcu, agc_table_rcu_free);
+}
+
+uint32_t agc_table_nintervals(const struct agc_table *t)
+{
+	return t->at_count;
+}
+
+size_t agc_table_size(const struct agc_table *t)
+{
+	size_t asz = t->at_alen == 4 ? sizeof(uint32_t) :
+		sizeof(struct agc_addr6);
+
+	return sizeof(*t) + 2 * t->at_count * asz;
+}
+
+/*
+ * An interval containing an address in bucket b is at or after
+ * at_index[b], and is no later than at_index[b + 1], which is the
+ * first interval to end after the bucket.  The search finds the last
+ * of these that starts at or before the address.
+ */
+bool agc_lookup_v4(const struct agc_table *t, uint32_t addr)
+{
+	uint32_t a = ntohl(addr);
+	uint32_t bkt = a >> (32 - AGC_INDEX_BITS);
+	uint32_t lo = t->at_index[bkt];
+	uint32_t n = RTE_MIN(t->at_index[bkt + 1] + 1, t->at_count) - lo;
+	const uint32_t *base = &t->at_start.v4[lo];
+	uint32_t half;
+
+	if (n == 0)
+		return false;
+
+	while (n > 1) {
+		half = n / 2;
+		base = (base[half] <= a) ? base + half : base;
+		n -= half;
+	}
+
+	return *base <= a && a <= t->at_end.v4[base - t->at_start.v4];
+}
+
+bool agc_lookup_v6(const struct agc_table *t, const uint8_t *addr)
+{
+	struct agc_addr6 a = agc_addr6_get(addr);
+	uint32_t bkt = a.hi >> (64 - AGC_INDEX_BITS);
+	uint32_t lo = t->at_index[bkt];
+	uint32_t n = RTE_MIN(t->at_index[bkt + 1] + 1, t->at_count) - lo;
+	const struct agc_addr6 *base = &t->at_start.v6[lo];
+	uint32_t half;
+
+	if (n == 0)
+		return false;
+
+	while (n > 1) {
+		half = n / 2;
+		base = agc_addr6_le(base[half], a) ? base + half : base;
+		n -= half;
+	}
+
+	return agc_addr6_le(*base, a) &&
+		agc_addr6_le(a, t->at_end.v6[base - t->at_start.v6]);
+}
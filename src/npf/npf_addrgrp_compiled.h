@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef NPF_ADDRGRP_COMPILED_H
+#define NPF_ADDRGRP_COMPILED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Compiled address-group table.
+ *
+ * The addresses of an address-group are merged into a sorted array of
+ * disjoint intervals, with a direct index on the top 16 address bits
+ * giving the intervals that may contain an address of each /16.  A
+ * lookup is one index load and a short binary search within the
+ * bucket, and the table takes 8 (IPv4) or 32 (IPv6) bytes per interval
+ * however the intervals were configured.
+ *
+ * A table is built on the main thread from an agc_builder and is not
+ * modified once built, so it may be swapped in under RCU.
+ */
+struct agc_table;
+struct agc_builder;
+
+struct agc_builder *agc_builder_create(uint8_t alen);
+void agc_builder_free(struct agc_builder *b);
+
+/* Add an interval.  Addresses in network byte order, start <= end. */
+int agc_builder_add(struct agc_builder *b, const uint8_t *start,
+		    const uint8_t *end);
+
+/* Build a table from the intervals added so far */
+struct agc_table *agc_build(struct agc_builder *b);
+
+/* Free a table that has never been published */
+void agc_table_free(struct agc_table *t);
+
+/* Free a table once any readers have finished with it */
+void agc_table_destroy(struct agc_table *t);
+
+/* Number of intervals, and memory used */
+uint32_t agc_table_nintervals(const struct agc_table *t);
+size_t agc_table_size(const struct agc_table *t);
+
+/* Lookups.  Addresses in network byte order. */
+bool agc_lookup_v4(const struct agc_table *t, uint32_t addr);
+bool agc_lookup_v6(const struct agc_table *t, const uint8_t *addr);
+
+#endif /* NPF_ADDRGRP_COMPILED_H */
@@ -34,9 +34,11 @@
 #include "npf/config/npf_rule_group.h"
 #include "npf/config/npf_ruleset_type.h"
 #include "npf/config/pmf_att_rlgrp.h"
+#include "npf/grouper2.h"
 #include "npf/npf_addrgrp.h"
 #include "npf/npf_cache.h"
 #include "npf/npf_cmd.h"
+#include "npf/npf_jit.h"
 #include "npf/npf_rule_gen.h"
 #include "npf/npf_session.h"
 #include "npf/npf_state.h"
@@ -308,6 +310,87 @@ cmd_npf_addrgrp_entry_del(FILE *f, int argc, char **argv)
 	return rc;
 }
 
+/*
+ * Enable or disable the compiled tables of an address-group
+ *
+ * npf fw table compile <name> <enable|disable>
+ */
+static int
+cmd_npf_addrgrp_compile(FILE *f, int argc, char **argv)
+{
+	bool compile;
+	int rc;
+
+	if (argc < 2) {
+		npf_cmd_err(f, "%s", npf_cmd_str_missing);
+		return -EINVAL;
+	}
+
+	if (!strcmp(argv[1], "enable"))
+		compile = true;
+	else if (!strcmp(argv[1], "disable"))
+		compile = false;
+	else {
+		npf_cmd_err(f, "invalid compile option %s", argv[1]);
+		return -EINVAL;
+	}
+
+	rc = npf_addrgrp_set_compiled(argv[0], compile);
+	if (rc < 0)
+		npf_cmd_err(f, "npf address-group %s not found", argv[0]);
+	return rc;
+}
+
+/*
+ * Stage the entries added to an address-group until the end of a bulk
+ * load, then add them all at once.
+ *
+ * npf fw table bulk start <name>
+ * npf fw table bulk end <name>
+ */
+static int
+cmd_npf_addrgrp_bulk_start(FILE *f, int argc, char **argv)
+{
+	int rc;
+
+	if (argc < 1) {
+		npf_cmd_err(f, "%s", npf_cmd_str_missing);
+		return -EINVAL;
+	}
+
+	rc = npf_addrgrp_bulk_start(argv[0]);
+	if (rc < 0)
+		npf_cmd_err(f, "failed to start bulk load of %s (errno %d)",
+			    argv[0], -rc);
+	return rc;
+}
+
+static int
+cmd_npf_addrgrp_bulk_end(FILE *f, int argc, char **argv)
+{
+	uint32_t nrejected;
+	int rc;
+
+	if (argc < 1) {
+		npf_cmd_err(f, "%s", npf_cmd_str_missing);
+		return -EINVAL;
+	}
+
+	rc = npf_addrgrp_bulk_end(argv[0], &nrejected);
+	if (rc < 0) {
+		npf_cmd_err(f, "failed to end bulk load of %s (errno %d)",
+			    argv[0], -rc);
+		return rc;
+	}
+
+	if (nrejected) {
+		npf_cmd_err(f, "%u table items not added to %s",
+			    nrejected, argv[0]);
+		return -EEXIST;
+	}
+	return 0;
+}
+
 static int
 cmd_npf_global_icmp_strict_enable(FILE *f __unused, int argc __unused,
 				 char **argv __unused)
@@ -342,6 +425,38 @@ cmd_npf_global_tcp_strict_disable(FILE *f __unused,
 	return 0;
 }
 
+static int
+cmd_npf_global_jit_enable(FILE *f __unused, int argc __unused,
+			  char **argv __unused)
+{
+	npf_jit_set_enabled(true);
+	return 0;
+}
+
+static int
+cmd_npf_global_jit_disable(FILE *f __unused, int argc __unused,
+			   char **argv __unused)
+{
+	npf_jit_set_enabled(false);
+	return 0;
+}
+
+static int
+cmd_npf_global_grouper_simd_enable(FILE *f __unused, int argc __unused,
+				   char **argv __unused)
+{
+	g2_set_simd_enabled(true);
+	return 0;
+}
+
+static int
+cmd_npf_global_grouper_simd_disable(FILE *f __unused, int argc __unused,
+				    char **argv __unused)
+{
+	g2_set_simd_enabled(false);
+	return 0;
+}
+
 static int
 cmd_npf_global_timeout(FILE *f, int argc, char **argv)
 {
@@ -786,6 +901,9 @@ enum {
 	FW_TABLE_DELETE,
 	FW_TABLE_ADD,
 	FW_TABLE_REMOVE,
+	FW_TABLE_COMPILE,
+	FW_TABLE_BULK_START,
+	FW_TABLE_BULK_END,
 	FW_SESSION_LIMIT_PARAM_ADD,
 	FW_SESSION_LIMIT_PARAM_DELETE,
 	FW_SESSIONLOG_ADD,
@@ -794,6 +912,10 @@ enum {
 	FW_GLOBAL_ICMPSTRICT_DISABLE,
 	FW_GLOBAL_TCPSTRICT_ENABLE,
 	FW_GLOBAL_TCPSTRICT_DISABLE,
+	FW_GLOBAL_JIT_ENABLE,
+	FW_GLOBAL_JIT_DISABLE,
+	FW_GLOBAL_GROUPER_SIMD_ENABLE,
+	FW_GLOBAL_GROUPER_SIMD_DISABLE,
 	FW_GLOBAL_TIMEOUT,
 	FW_ZONE_ADD,
 	FW_ZONE_REMOVE,
@@ -845,6 +967,18 @@ static const struct npf_command npf_cmd_cfg[] = {
 		.tokens = "fw table remove",
 		.handler = cmd_npf_addrgrp_entry_del,
 	},
+	[FW_TABLE_COMPILE] = {
+		.tokens = "fw table compile",
+		.handler = cmd_npf_addrgrp_compile,
+	},
+	[FW_TABLE_BULK_START] = {
+		.tokens = "fw table bulk start",
+		.handler = cmd_npf_addrgrp_bulk_start,
+	},
+	[FW_TABLE_BULK_END] = {
+		.tokens = "fw table bulk end",
+		.handler = cmd_npf_addrgrp_bulk_end,
+	},
 	[FW_SESSION_LIMIT_PARAM_ADD] = {
 		.tokens = "fw session-limit param add",
 		.handler = cmd_npf_sess_limit_param_add,
@@ -877,6 +1011,22 @@ static const struct npf_command npf_cmd_cfg[] = {
 		.tokens = "fw global tcp-strict disable",
 		.handler = cmd_npf_global_tcp_strict_disable,
 	},
+	[FW_GLOBAL_JIT_ENABLE] = {
+		.tokens = "fw global jit enable",
+		.handler = cmd_npf_global_jit_enable,
+	},
+	[FW_GLOBAL_JIT_DISABLE] = {
+		.tokens = "fw global jit disable",
+		.handler = cmd_npf_global_jit_disable,
+	},
+	[FW_GLOBAL_GROUPER_SIMD_ENABLE] = {
+		.tokens = "fw global grouper-simd enable",
+		.handler = cmd_npf_global_grouper_simd_enable,
+	},
+	[FW_GLOBAL_GROUPER_SIMD_DISABLE] = {
+		.tokens = "fw global grouper-simd disable",
+		.handler = cmd_npf_global_grouper_simd_disable,
+	},
 	[FW_GLOBAL_TIMEOUT] = {
 		.tokens = "fw global timeout",
 		.handler = cmd_npf_global_timeout,
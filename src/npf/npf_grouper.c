@@ -66,6 +66,48 @@ int npf_grouper_match(int af, g2_config_t *g_ctx, npf_cache_t *npc,
 	return 0;
 }
 
+/*
+ * Classify a burst of packets of one address family.  rl[i] is set to
+ * the matching rule for packet i, or NULL.  Returns the number of
+ * packets that matched.
+ */
+int npf_grouper_match_burst(int af, g2_config_t *g_ctx, npf_cache_t *npc[],
+			    struct npf_match_cb_data *data[],
+			    npf_rule_t *rl[], uint32_t num)
+{
+	const uint8_t *pkts[NPF_GROUPER_BURST_MAX];
+	const void *pkt_data[NPF_GROUPER_BURST_MAX];
+	void *rules[NPF_GROUPER_BURST_MAX];
+	uint32_t idx[NPF_GROUPER_BURST_MAX];
+	uint32_t i, j, n;
+	int matched = 0;
+
+	for (i = 0; i < num; ) {
+		/* Gather packets with a cache, the others cannot match */
+		for (n = 0; i < num && n < NPF_GROUPER_BURST_MAX; i++) {
+			rl[i] = NULL;
+			if (unlikely(!npc[i]))
+				continue;
+			pkts[n] = (const uint8_t *)npc[i]->npc_grouper;
+			pkt_data[n] = data[i];
+			idx[n++] = i;
+		}
+
+		if (af == AF_INET)
+			g2_eval4_burst(g_ctx, pkts, pkt_data, rules, n);
+		else
+			g2_eval6_burst(g_ctx, pkts, pkt_data, rules, n);
+
+		for (j = 0; j < n; j++) {
+			rl[idx[j]] = rules[j];
+			if (rules[j])
+				matched++;
+		}
+	}
+
+	return matched;
+}
+
 int npf_grouper_destroy(g2_config_t **g_ctx)
 {
 	/* Release groupers */
@@ -9,6 +9,7 @@
 
 /* Forward declarations */
 typedef struct npf_rule npf_rule_t;
+struct npf_match_cb_data;
 
 #include <rte_mbuf.h>
 #include "grouper2.h"
@@ -24,6 +25,12 @@ int npf_grouper_build(g2_config_t **g_ctx);
 int npf_grouper_match(int af, g2_config_t *g_ctx, npf_cache_t *npc,
 		      void *data, npf_rule_t **rl);
 
+#define NPF_GROUPER_BURST_MAX	32
+
+int npf_grouper_match_burst(int af, g2_config_t *g_ctx, npf_cache_t *npc[],
+			    struct npf_match_cb_data *data[],
+			    npf_rule_t *rl[], uint32_t num);
+
 int npf_grouper_destroy(g2_config_t **g_ctx);
 
 #endif
@@ -0,0 +1,687 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * NPF n-code JIT for x86-64.
+ *
+ * The generated code is a straight translation of the n-code.  Each
+ * rule gets a function with the same signature as npf_ncode_process().
+ * The arguments are kept in callee-saved registers, and eax always
+ * holds the interpreter's cmpval:
+ *
+ *   r12 = npc, r13 = rl, r14 = ifp, r15d = dir, rbp = se, rbx = nbuf
+ *
+ * The most common match instructions for stateless ACLs (address
+ * family, protocol, IPv4 prefix and port range) are emitted inline.
+ * Everything else becomes a direct call to the same npf_match_*
+ * helper the interpreter uses, with the operands already decoded.
+ * Branches become native conditional jumps.
+ *
+ * Only forward branches to instruction boundaries are accepted, with
+ * no more branches than NPF_LOOP_LIMIT, so the interpreter's loop
+ * detection can never trigger for compiled n-code.  Anything else is
+ * left to the interpreter.
+ */
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <rte_atomic.h>
+#include <rte_common.h>
+#include <rte_config.h>
+#include <rte_debug.h>
+#include <rte_log.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <urcu/system.h>
+
+#include "npf/npf.h"
+#include "npf/npf_addr.h"
+#include "npf/npf_cache.h"
+#include "npf/npf_instr.h"
+#include "npf/npf_jit.h"
+#include "npf/npf_ncode.h"
+#include "vplane_log.h"
+
+struct npf_jit_image {
+	rte_atomic32_t	ji_refcnt;
+	void		*ji_base;
+	size_t		ji_size;
+};
+
+#if defined RTE_ARCH_X86_64
+
+bool npf_jit_enabled = true;
+
+void npf_jit_set_enabled(bool enable)
+{
+	CMM_STORE_SHARED(npf_jit_enabled, enable);
+}
+
+/* Sanity check on programs, to bound the per-program offset table */
+#define NPF_JIT_MAX_WORDS	(64 * 1024)
+
+/* Offset of an n-code word that does not start an instruction */
+#define NPF_JIT_NOT_INSN	UINT32_MAX
+
+struct npf_jit_buf {
+	uint8_t		*jb_code;	/* NULL when only sizing */
+	size_t		jb_len;
+};
+
+static inline void
+jit_emit(struct npf_jit_buf *jb, const void *bytes, size_t len)
+{
+	if (jb->jb_code)
+		memcpy(jb->jb_code + jb->jb_len, bytes, len);
+	jb->jb_len += len;
+}
+
+static inline void
+jit_emit1(struct npf_jit_buf *jb, uint8_t b)
+{
+	jit_emit(jb, &b, 1);
+}
+
+static inline void
+jit_emit4(struct npf_jit_buf *jb, uint32_t v)
+{
+	jit_emit(jb, &v, sizeof(v));
+}
+
+static inline void
+jit_emit8(struct npf_jit_buf *jb, uint64_t v)
+{
+	jit_emit(jb, &v, sizeof(v));
+}
+
+#define JIT_EMIT(jb, ...)						\
+	do {								\
+		const uint8_t __b[] = { __VA_ARGS__ };			\
+		jit_emit(jb, __b, sizeof(__b));				\
+	} while (0)
+
+/* Patch a rel8 placeholder emitted at 'pos' to jump to the current end */
+static inline void
+jit_patch_rel8(struct npf_jit_buf *jb, size_t pos)
+{
+	size_t rel = jb->jb_len - (pos + 1);
+
+	RTE_ASSERT(rel <= INT8_MAX);
+	if (jb->jb_code)
+		jb->jb_code[pos] = (uint8_t)rel;
+}
+
+static void
+jit_prologue(struct npf_jit_buf *jb)
+{
+	JIT_EMIT(jb, 0x53);			/* push rbx */
+	JIT_EMIT(jb, 0x55);			/* push rbp */
+	JIT_EMIT(jb, 0x41, 0x54);		/* push r12 */
+	JIT_EMIT(jb, 0x41, 0x55);		/* push r13 */
+	JIT_EMIT(jb, 0x41, 0x56);		/* push r14 */
+	JIT_EMIT(jb, 0x41, 0x57);		/* push r15 */
+	JIT_EMIT(jb, 0x48, 0x83, 0xec, 0x08);	/* sub rsp, 8 (align) */
+	JIT_EMIT(jb, 0x49, 0x89, 0xfc);		/* mov r12, rdi */
+	JIT_EMIT(jb, 0x49, 0x89, 0xf5);		/* mov r13, rsi */
+	JIT_EMIT(jb, 0x49, 0x89, 0xd6);		/* mov r14, rdx */
+	JIT_EMIT(jb, 0x41, 0x89, 0xcf);		/* mov r15d, ecx */
+	JIT_EMIT(jb, 0x4c, 0x89, 0xc5);		/* mov rbp, r8 */
+	JIT_EMIT(jb, 0x4c, 0x89, 0xcb);		/* mov rbx, r9 */
+	JIT_EMIT(jb, 0x31, 0xc0);		/* xor eax, eax */
+}
+
+/* Return the value in eax */
+static void
+jit_epilogue(struct npf_jit_buf *jb)
+{
+	JIT_EMIT(jb, 0x48, 0x83, 0xc4, 0x08);	/* add rsp, 8 */
+	JIT_EMIT(jb, 0x41, 0x5f);		/* pop r15 */
+	JIT_EMIT(jb, 0x41, 0x5e);		/* pop r14 */
+	JIT_EMIT(jb, 0x41, 0x5d);		/* pop r13 */
+	JIT_EMIT(jb, 0x41, 0x5c);		/* pop r12 */
+	JIT_EMIT(jb, 0x5d);			/* pop rbp */
+	JIT_EMIT(jb, 0x5b);			/* pop rbx */
+	JIT_EMIT(jb, 0xc3);			/* ret */
+}
+
+static void
+jit_mov_eax_imm(struct npf_jit_buf *jb, uint32_t imm)
+{
+	jit_emit1(jb, 0xb8);
+	jit_emit4(jb, imm);
+}
+
+static void
+jit_mov_esi_imm(struct npf_jit_buf *jb, uint32_t imm)
+{
+	jit_emit1(jb, 0xbe);
+	jit_emit4(jb, imm);
+}
+
+static void
+jit_mov_edx_imm(struct npf_jit_buf *jb, uint32_t imm)
+{
+	jit_emit1(jb, 0xba);
+	jit_emit4(jb, imm);
+}
+
+static void
+jit_mov_ecx_imm(struct npf_jit_buf *jb, uint32_t imm)
+{
+	jit_emit1(jb, 0xb9);
+	jit_emit4(jb, imm);
+}
+
+static void
+jit_mov_rsi_imm64(struct npf_jit_buf *jb, uint64_t imm)
+{
+	JIT_EMIT(jb, 0x48, 0xbe);
+	jit_emit8(jb, imm);
+}
+
+static void
+jit_mov_rdx_imm64(struct npf_jit_buf *jb, uint64_t imm)
+{
+	JIT_EMIT(jb, 0x48, 0xba);
+	jit_emit8(jb, imm);
+}
+
+/* First argument is npc */
+static void
+jit_arg_npc(struct npf_jit_buf *jb)
+{
+	JIT_EMIT(jb, 0x4c, 0x89, 0xe7);		/* mov rdi, r12 */
+}
+
+/* First argument is nbuf */
+static void
+jit_arg_nbuf(struct npf_jit_buf *jb)
+{
+	JIT_EMIT(jb, 0x48, 0x89, 0xdf);		/* mov rdi, rbx */
+}
+
+/* Call a helper.  Its int result lands in eax, i.e. cmpval */
+static void
+jit_call(struct npf_jit_buf *jb, const void *fn)
+{
+	JIT_EMIT(jb, 0x48, 0xb8);		/* mov rax, imm64 */
+	jit_emit8(jb, (uintptr_t)fn);
+	JIT_EMIT(jb, 0xff, 0xd0);		/* call rax */
+}
+
+/* test dword [r12 + disp32], imm32 */
+static void
+jit_test_npc_info(struct npf_jit_buf *jb, uint32_t flags)
+{
+	JIT_EMIT(jb, 0x41, 0xf7, 0x84, 0x24);
+	jit_emit4(jb, offsetof(npf_cache_t, npc_info));
+	jit_emit4(jb, flags);
+}
+
+/* eax = al ? -1 : 0 */
+static void
+jit_al_to_cmpval(struct npf_jit_buf *jb)
+{
+	JIT_EMIT(jb, 0x0f, 0xb6, 0xc0);		/* movzx eax, al */
+	JIT_EMIT(jb, 0xf7, 0xd8);		/* neg eax */
+}
+
+/*
+ * eax = 0 if any of the npc_info flags are set, else -1.  Used for
+ * NPF_OPCODE_ADDRFAM and NPF_OPCODE_FRAGMENT.
+ */
+static void
+jit_match_info(struct npf_jit_buf *jb, uint32_t flags)
+{
+	jit_test_npc_info(jb, flags);
+	JIT_EMIT(jb, 0x0f, 0x94, 0xc0);		/* setz al */
+	jit_al_to_cmpval(jb);
+}
+
+/* Inline npf_match_proto_final() */
+static void
+jit_match_proto_final(struct npf_jit_buf *jb, uint32_t ap)
+{
+	jit_test_npc_info(jb, NPC_IP46);
+	JIT_EMIT(jb, 0x0f, 0x94, 0xc0);		/* setz al */
+	JIT_EMIT(jb, 0x41, 0x80, 0xbc, 0x24);	/* cmp byte [r12+disp32], imm8 */
+	jit_emit4(jb, offsetof(npf_cache_t, npc_proto_final));
+	jit_emit1(jb, ap & 0xff);
+	JIT_EMIT(jb, 0x0f, 0x95, 0xc1);		/* setne cl */
+	JIT_EMIT(jb, 0x08, 0xc8);		/* or al, cl */
+	jit_al_to_cmpval(jb);
+}
+
+/* Inline npf_match_ip4mask() */
+static void
+jit_match_ip4mask(struct npf_jit_buf *jb, uint32_t opts, uint32_t maddr,
+		  uint32_t mask_len)
+{
+	uint32_t mask = htonl(npf_prefix_to_net_mask4(mask_len));
+	uint8_t disp = (opts & NC_MATCH_SRC) ? 0 : sizeof(struct in_addr);
+	size_t skip;
+
+	jit_mov_eax_imm(jb, UINT32_MAX);
+	jit_test_npc_info(jb, NPC_IP4);
+	JIT_EMIT(jb, 0x74, 0x00);		/* jz done */
+	skip = jb->jb_len - 1;
+
+	JIT_EMIT(jb, 0x49, 0x8b, 0x8c, 0x24);	/* mov rcx, [r12+disp32] */
+	jit_emit4(jb, offsetof(npf_cache_t, npc_srcdst));
+	JIT_EMIT(jb, 0x8b, 0x49, disp);		/* mov ecx, [rcx+disp8] */
+	JIT_EMIT(jb, 0x81, 0xe1);		/* and ecx, imm32 */
+	jit_emit4(jb, mask);
+	JIT_EMIT(jb, 0x81, 0xf9);		/* cmp ecx, imm32 */
+	jit_emit4(jb, maddr & mask);
+	if (NCODE_IS_INVERTED(opts))
+		JIT_EMIT(jb, 0x0f, 0x94, 0xc0);	/* sete al */
+	else
+		JIT_EMIT(jb, 0x0f, 0x95, 0xc0);	/* setne al */
+	jit_al_to_cmpval(jb);
+
+	jit_patch_rel8(jb, skip);
+}
+
+/* Inline npf_match_ports() */
+static void
+jit_match_ports(struct npf_jit_buf *jb, uint32_t opts, uint32_t prange)
+{
+	uint32_t lo = prange >> 16;
+	uint32_t hi = prange & 0xffff;
+	size_t off = (opts & NC_MATCH_SRC) ?
+		offsetof(npf_cache_t, npc_l4.ports.s_port) :
+		offsetof(npf_cache_t, npc_l4.ports.d_port);
+	size_t skip;
+
+	jit_mov_eax_imm(jb, UINT32_MAX);
+	jit_test_npc_info(jb, NPC_L4PORTS);
+	JIT_EMIT(jb, 0x74, 0x00);		/* jz done */
+	skip = jb->jb_len - 1;
+
+	/* movzx ecx, word [r12+disp32] */
+	JIT_EMIT(jb, 0x41, 0x0f, 0xb7, 0x8c, 0x24);
+	jit_emit4(jb, off);
+	JIT_EMIT(jb, 0x66, 0xc1, 0xc1, 0x08);	/* rol cx, 8 (ntohs) */
+
+	/* lo <= port <= hi  <=>  (port - lo) <= (hi - lo), unsigned */
+	JIT_EMIT(jb, 0x81, 0xe9);		/* sub ecx, imm32 */
+	jit_emit4(jb, lo);
+	JIT_EMIT(jb, 0x81, 0xf9);		/* cmp ecx, imm32 */
+	jit_emit4(jb, hi - lo);
+	if (NCODE_IS_INVERTED(opts))
+		JIT_EMIT(jb, 0x0f, 0x96, 0xc0);	/* setbe al */
+	else
+		JIT_EMIT(jb, 0x0f, 0x97, 0xc0);	/* seta al */
+	jit_al_to_cmpval(jb);
+
+	jit_patch_rel8(jb, skip);
+}
+
+/* Conditional branch on cmpval to the native offset 'target' */
+static void
+jit_branch(struct npf_jit_buf *jb, bool if_zero, size_t target)
+{
+	JIT_EMIT(jb, 0x85, 0xc0);		/* test eax, eax */
+	JIT_EMIT(jb, 0x0f, if_zero ? 0x84 : 0x85); /* jz/jnz rel32 */
+	jit_emit4(jb, (uint32_t)(target - (jb->jb_len + 4)));
+}
+
+/* Length in words of the instruction at 'pc', or 0 if invalid */
+static uint32_t
+jit_insn_words(const uint32_t *code, uint32_t pc)
+{
+	switch (code[pc]) {
+	case NPF_OPCODE_FRAGMENT:
+		return 1;
+	case NPF_OPCODE_RET:
+	case NPF_OPCODE_BEQ:
+	case NPF_OPCODE_BNE:
+	case NPF_OPCODE_TTL:
+	case NPF_OPCODE_TCP_FLAGS:
+	case NPF_OPCODE_ICMP4:
+	case NPF_OPCODE_ICMP6:
+	case NPF_OPCODE_IP6_RT:
+	case NPF_OPCODE_PROTO_FINAL:
+	case NPF_OPCODE_PROTO_BASE:
+	case NPF_OPCODE_ETHERPCP:
+	case NPF_OPCODE_ADDRFAM:
+	case NPF_OPCODE_ETHERTYPE:
+	case NPF_OPCODE_RPROC:
+		return 2;
+	case NPF_OPCODE_TABLE:
+	case NPF_OPCODE_PORTS:
+	case NPF_OPCODE_MATCHDSCP:
+		return 3;
+	case NPF_OPCODE_IP4MASK:
+	case NPF_OPCODE_ETHERADDR:
+		return 4;
+	case NPF_OPCODE_IP6MASK:
+		return 7;
+	}
+	return 0;
+}
+
+/*
+ * Check the program only has instructions and branches the JIT
+ * supports, and mark the instruction boundaries in 'offs'.
+ */
+static int
+jit_validate(const uint32_t *code, uint32_t nwords, uint32_t *offs)
+{
+	uint32_t pc, len, branches = 0;
+
+	for (pc = 0; pc < nwords; pc++)
+		offs[pc] = NPF_JIT_NOT_INSN;
+
+	for (pc = 0; pc < nwords; pc += len) {
+		len = jit_insn_words(code, pc);
+		if (len == 0 || len > nwords - pc)
+			return -EINVAL;
+		offs[pc] = 0;
+		if (code[pc] == NPF_OPCODE_BEQ || code[pc] == NPF_OPCODE_BNE)
+			branches++;
+	}
+	if (branches > NPF_LOOP_LIMIT)
+		return -E2BIG;
+
+	for (pc = 0; pc < nwords; pc += len) {
+		len = jit_insn_words(code, pc);
+		if (code[pc] != NPF_OPCODE_BEQ && code[pc] != NPF_OPCODE_BNE)
+			continue;
+
+		/* The interpreter jumps to 'n' words from the branch */
+		uint32_t n = code[pc + 1];
+
+		if (n == 0 || n >= nwords - pc ||
+		    offs[pc + n] == NPF_JIT_NOT_INSN)
+			return -EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * Emit one program.  Called twice: first with 'offs' holding the
+ * instruction boundaries and the buffer only sizing, which records the
+ * native offset of each instruction; then again for real, when branch
+ * targets are known.  Instruction lengths do not depend on targets.
+ */
+static void
+jit_emit_prog(struct npf_jit_buf *jb, const uint32_t *code, uint32_t nwords,
+	      uint32_t *offs)
+{
+	uint32_t pc, len;
+
+	jit_prologue(jb);
+
+	for (pc = 0; pc < nwords; pc += len) {
+		const uint32_t *op = &code[pc + 1];
+
+		len = jit_insn_words(code, pc);
+		offs[pc] = jb->jb_len;
+
+		switch (code[pc]) {
+		case NPF_OPCODE_BEQ:
+			jit_branch(jb, true, offs[pc + op[0]]);
+			break;
+		case NPF_OPCODE_BNE:
+			jit_branch(jb, false, offs[pc + op[0]]);
+			break;
+		case NPF_OPCODE_RET:
+			jit_mov_eax_imm(jb, op[0]);
+			jit_epilogue(jb);
+			break;
+		case NPF_OPCODE_IP4MASK:
+			jit_match_ip4mask(jb, op[0], op[1], op[2]);
+			break;
+		case NPF_OPCODE_IP6MASK:
+			jit_arg_npc(jb);
+			jit_mov_esi_imm(jb, op[0]);
+			jit_mov_rdx_imm64(jb, (uintptr_t)&op[1]);
+			jit_mov_ecx_imm(jb, op[5]);
+			jit_call(jb, npf_match_ip6mask);
+			break;
+		case NPF_OPCODE_TABLE:
+			jit_arg_npc(jb);
+			jit_mov_esi_imm(jb, op[0]);
+			jit_mov_edx_imm(jb, op[1]);
+			jit_call(jb, npf_match_table);
+			break;
+		case NPF_OPCODE_PORTS:
+			if ((op[1] >> 16) <= (op[1] & 0xffff)) {
+				jit_match_ports(jb, op[0], op[1]);
+				break;
+			}
+			/* Empty range, leave it to the helper */
+			jit_arg_npc(jb);
+			jit_mov_esi_imm(jb, op[0]);
+			jit_mov_edx_imm(jb, op[1]);
+			jit_call(jb, npf_match_ports);
+			break;
+		case NPF_OPCODE_TTL:
+			jit_arg_npc(jb);
+			jit_mov_esi_imm(jb, op[0]);
+			jit_call(jb, npf_match_ttl);
+			break;
+		case NPF_OPCODE_TCP_FLAGS:
+			jit_arg_npc(jb);
+			jit_mov_esi_imm(jb, op[0]);
+			jit_call(jb, npf_match_tcpfl);
+			break;
+		case NPF_OPCODE_ICMP4:
+			jit_arg_npc(jb);
+			jit_mov_esi_imm(jb, op[0]);
+			jit_call(jb, npf_match_icmp4);
+			break;
+		case NPF_OPCODE_ICMP6:
+			jit_arg_npc(jb);
+			jit_mov_esi_imm(jb, op[0]);
+			jit_call(jb, npf_match_icmp6);
+			break;
+		case NPF_OPCODE_IP6_RT:
+			jit_arg_npc(jb);
+			jit_mov_esi_imm(jb, op[0]);
+			jit_call(jb, npf_match_ip6_rt);
+			break;
+		case NPF_OPCODE_PROTO_FINAL:
+			jit_match_proto_final(jb, op[0]);
+			break;
+		case NPF_OPCODE_PROTO_BASE:
+			jit_arg_npc(jb);
+			jit_mov_esi_imm(jb, op[0]);
+			jit_call(jb, npf_match_proto_base);
+			break;
+		case NPF_OPCODE_ETHERPCP:
+			jit_arg_nbuf(jb);
+			jit_mov_esi_imm(jb, op[0]);
+			jit_call(jb, npf_match_pcp);
+			break;
+		case NPF_OPCODE_ETHERADDR:
+			jit_arg_nbuf(jb);
+			jit_mov_esi_imm(jb, op[0]);
+			jit_mov_rdx_imm64(jb, (uintptr_t)&op[1]);
+			jit_call(jb, npf_match_mac);
+			break;
+		case NPF_OPCODE_ADDRFAM:
+			if (op[0] == AF_INET)
+				jit_match_info(jb, NPC_IP4);
+			else if (op[0] == AF_INET6)
+				jit_match_info(jb, NPC_IP6);
+			else
+				jit_mov_eax_imm(jb, UINT32_MAX);
+			break;
+		case NPF_OPCODE_FRAGMENT:
+			jit_match_info(jb, NPC_IPFRAG);
+			break;
+		case NPF_OPCODE_MATCHDSCP:
+			jit_arg_npc(jb);
+			jit_mov_rsi_imm64(jb, ((uint64_t)op[1]) << 32 | op[0]);
+			jit_call(jb, npf_match_dscp);
+			break;
+		case NPF_OPCODE_ETHERTYPE:
+			jit_arg_nbuf(jb);
+			jit_mov_esi_imm(jb, op[0]);
+			jit_call(jb, npf_match_etype);
+			break;
+		case NPF_OPCODE_RPROC:
+			jit_arg_npc(jb);
+			JIT_EMIT(jb, 0x48, 0x89, 0xde);	/* mov rsi, rbx */
+			JIT_EMIT(jb, 0x4c, 0x89, 0xea);	/* mov rdx, r13 */
+			JIT_EMIT(jb, 0x4c, 0x89, 0xf1);	/* mov rcx, r14 */
+			JIT_EMIT(jb, 0x45, 0x89, 0xf8);	/* mov r8d, r15d */
+			JIT_EMIT(jb, 0x49, 0x89, 0xe9);	/* mov r9, rbp */
+			jit_call(jb, npf_match_rproc);
+			break;
+		}
+	}
+
+	/* Running off the end is a failure, as for an invalid instruction */
+	jit_mov_eax_imm(jb, UINT32_MAX);
+	jit_epilogue(jb);
+}
+
+struct npf_jit_image *
+npf_jit_compile(struct npf_jit_prog *progs, unsigned int count)
+{
+	struct npf_jit_buf jb = { .jb_code = NULL, .jb_len = 0 };
+	struct npf_jit_image *img;
+	uint32_t *offs, *starts;
+	uint32_t max_words = 0;
+	unsigned int i, ncompiled = 0;
+	void *base;
+	size_t size;
+
+	if (!npf_jit_enabled || count == 0)
+		return NULL;
+
+	for (i = 0; i < count; i++) {
+		uint32_t nwords = progs[i].jp_nc_size / sizeof(uint32_t);
+
+		progs[i].jp_func = NULL;
+		if (nwords > max_words)
+			max_words = nwords;
+	}
+	if (max_words == 0 || max_words > NPF_JIT_MAX_WORDS)
+		return NULL;
+
+	offs = malloc(max_words * sizeof(*offs));
+	starts = calloc(count, sizeof(*starts));
+	if (!offs || !starts)
+		goto error;
+
+	/* Size the image, and note which programs can be compiled */
+	for (i = 0; i < count; i++) {
+		const uint32_t *code = progs[i].jp_ncode;
+		uint32_t nwords = progs[i].jp_nc_size / sizeof(uint32_t);
+
+		starts[i] = NPF_JIT_NOT_INSN;
+		if (!code || nwords == 0 ||
+		    jit_validate(code, nwords, offs) < 0)
+			continue;
+
+		starts[i] = jb.jb_len;
+		jit_emit_prog(&jb, code, nwords, offs);
+		ncompiled++;
+	}
+	if (ncompiled == 0)
+		goto error;
+
+	size = RTE_ALIGN_CEIL(jb.jb_len, (size_t)getpagesize());
+	base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+		goto error;
+
+	/*
+	 * Second pass: every program is re-validated to recover its
+	 * instruction boundaries, sized again to recover the native
+	 * offsets for its branches, and then emitted.
+	 */
+	jb.jb_code = base;
+	for (i = 0; i < count; i++) {
+		struct npf_jit_buf sizing;
+		const uint32_t *code = progs[i].jp_ncode;
+		uint32_t nwords = progs[i].jp_nc_size / sizeof(uint32_t);
+
+		if (starts[i] == NPF_JIT_NOT_INSN)
+			continue;
+
+		(void)jit_validate(code, nwords, offs);
+		sizing.jb_code = NULL;
+		sizing.jb_len = starts[i];
+		jit_emit_prog(&sizing, code, nwords, offs);
+
+		jb.jb_len = starts[i];
+		jit_emit_prog(&jb, code, nwords, offs);
+	}
+
+	if (mprotect(base, size, PROT_READ | PROT_EXEC) < 0)
+		goto error_unmap;
+
+	img = malloc(sizeof(*img));
+	if (!img)
+		goto error_unmap;
+
+	rte_atomic32_set(&img->ji_refcnt, 1);
+	img->ji_base = base;
+	img->ji_size = size;
+
+	for (i = 0; i < count; i++)
+		if (starts[i] != NPF_JIT_NOT_INSN)
+			progs[i].jp_func = (npf_jit_func_t *)
+				((uint8_t *)base + starts[i]);
+
+	free(offs);
+	free(starts);
+	return img;
+
+error_unmap:
+	munmap(base, size);
+error:
+	free(offs);
+	free(starts);
+	return NULL;
+}
+
+#else /* RTE_ARCH_X86_64 */
+
+/* No code generator for this architecture; always interpret. */
+bool npf_jit_enabled;
+
+void npf_jit_set_enabled(bool enable __rte_unused)
+{
+}
+
+struct npf_jit_image *
+npf_jit_compile(struct npf_jit_prog *progs, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		progs[i].jp_func = NULL;
+	return NULL;
+}
+
+#endif /* RTE_ARCH_X86_64 */
+
+void npf_jit_image_get(struct npf_jit_image *img)
+{
+	if (img)
+		rte_atomic32_inc(&img->ji_refcnt);
+}
+
+void npf_jit_image_put(struct npf_jit_image *img)
+{
+	if (img && rte_atomic32_dec_and_test(&img->ji_refcnt)) {
+		munmap(img->ji_base, img->ji_size);
+		free(img);
+	}
+}
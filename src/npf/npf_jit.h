@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * NPF n-code JIT.
+ *
+ * Compiles the n-code of all rules in a rule group into a single
+ * executable image of native functions, one per rule.  Each function
+ * has the same signature and return value as npf_ncode_process(),
+ * which remains the fallback for any n-code the JIT declines, and
+ * the reference implementation for testing.
+ */
+
+#ifndef NPF_JIT_H
+#define NPF_JIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "npf/npf_ncode.h"
+
+struct ifnet;
+struct rte_mbuf;
+struct npf_jit_image;
+
+typedef int (npf_jit_func_t)(npf_cache_t *npc, const npf_rule_t *rl,
+			     const struct ifnet *ifp, int dir,
+			     npf_session_t *se, struct rte_mbuf *nbuf);
+
+struct npf_jit_prog {
+	const void	*jp_ncode;	/* in: n-code */
+	uint32_t	jp_nc_size;	/* in: n-code size in bytes */
+	npf_jit_func_t	*jp_func;	/* out: compiled code, or NULL */
+};
+
+/* Set to false to have all subsequent builds use the interpreter */
+extern bool npf_jit_enabled;
+
+/*
+ * Enable or disable the JIT.  Disabling takes effect at once, as rules
+ * already compiled go back to the interpreter; enabling only applies
+ * to rule groups built afterwards.
+ */
+void npf_jit_set_enabled(bool enable);
+
+/*
+ * Compile 'count' n-code programs into one image.  On return each
+ * program's jp_func is either its entry point within the image or
+ * NULL if that program could not be compiled.  Returns NULL if
+ * nothing was compiled, otherwise the image with one reference held
+ * for the caller.
+ */
+struct npf_jit_image *
+npf_jit_compile(struct npf_jit_prog *progs, unsigned int count);
+
+void npf_jit_image_get(struct npf_jit_image *img);
+void npf_jit_image_put(struct npf_jit_image *img);
+
+#endif /* NPF_JIT_H */
@@ -83,6 +83,41 @@ int npf_match_classify(enum npf_ruleset_type rs_type,
 	return npf_grouper_match(af, (g2_config_t *)ctx, npc, data, rl);
 }
 
+/*
+ * Classify a burst of packets of the same address family against one
+ * match context.  rl[i] is set to the matching rule for packet i, or
+ * NULL.  Returns the number of packets that matched.
+ */
+int npf_match_classify_burst(enum npf_ruleset_type rs_type,
+			     int af, npf_match_ctx_t *ctx,
+			     npf_cache_t *npc[],
+			     struct npf_match_cb_data *data[],
+			     npf_rule_t *rl[], uint32_t num)
+{
+	npf_match_cb_tbl *tbl;
+	uint32_t i;
+	int matched = 0;
+
+	tbl = npf_match_cbs[rs_type];
+	if (!tbl)
+		return npf_grouper_match_burst(af, (g2_config_t *)ctx, npc,
+					       data, rl, num);
+
+	if (tbl->npf_match_classify_burst_cb)
+		return tbl->npf_match_classify_burst_cb(af, ctx, npc, data,
+							rl, num);
+
+	for (i = 0; i < num; i++) {
+		if (npf_match_classify(rs_type, af, ctx, npc[i], data[i],
+				       &rl[i]))
+			matched++;
+		else
+			rl[i] = NULL;
+	}
+
+	return matched;
+}
+
 int npf_match_destroy(enum npf_ruleset_type rs_type,
 		      int af, npf_match_ctx_t **ctx)
 {
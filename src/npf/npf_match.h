@@ -40,6 +40,10 @@ typedef	int (*npf_match_classify_cb_t)(int af, npf_match_ctx_t *ctx,
 				       struct npf_match_cb_data *data,
 				       npf_rule_t **rl);
 typedef int (*npf_match_destroy_cb_t)(int af, npf_match_ctx_t **ctx);
+typedef	int (*npf_match_classify_burst_cb_t)(int af, npf_match_ctx_t *ctx,
+					     npf_cache_t *npc[],
+					     struct npf_match_cb_data *data[],
+					     npf_rule_t *rl[], uint32_t num);
 
 
 typedef struct npf_match_cb_tbl {
@@ -48,6 +52,8 @@ typedef struct npf_match_cb_tbl {
 	npf_match_build_cb_t     npf_match_build_cb;
 	npf_match_classify_cb_t  npf_match_classify_cb;
 	npf_match_destroy_cb_t   npf_match_destroy_cb;
+	/* Optional, else packets are classified one at a time */
+	npf_match_classify_burst_cb_t npf_match_classify_burst_cb;
 } npf_match_cb_tbl;
 
 int npf_match_register_cb_tbl(enum npf_ruleset_type rs_type,
@@ -70,6 +76,12 @@ int npf_match_classify(enum npf_ruleset_type rs_type,
 		       npf_cache_t *npc, struct npf_match_cb_data *data,
 		       npf_rule_t **rl);
 
+int npf_match_classify_burst(enum npf_ruleset_type rs_type,
+			     int af, npf_match_ctx_t *ctx,
+			     npf_cache_t *npc[],
+			     struct npf_match_cb_data *data[],
+			     npf_rule_t *rl[], uint32_t num);
+
 int npf_match_destroy(enum npf_ruleset_type rs_type,
 		      int af, npf_match_ctx_t **ctx);
 
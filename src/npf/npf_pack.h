@@ -35,6 +35,12 @@
 
 #define SESSION_PACK_VERSION	      (0x0102)
 
+/* pmh_flags */
+#define NPF_PACK_MSG_F_BULK	      0x01
+
+/* Interface names remembered by a bulk message */
+#define NPF_PACK_BULK_IFNAMES	      32
+
 enum pack_session_new {
 	NPF_PACK_SESSION_NEW_FW = 1,
 	NPF_PACK_SESSION_NEW_NAT,
@@ -205,6 +211,20 @@ struct npf_pack_message {
 	} data;
 } __attribute__ ((__packed__));
 
+/*
+ * A bulk message carries pbm_count sessions of one pack type, encoded
+ * as described in npf_pack_bulk.c, behind a single message header.
+ */
+struct npf_pack_bulk_message {
+	struct npf_pack_message_hdr	hdr;
+	uint32_t			pbm_count;
+	uint8_t				pbm_pad[4];
+	char				pbm_data[];
+} __attribute__ ((__packed__));
+
+static_assert(sizeof(struct npf_pack_bulk_message) == 16,
+	      "sizeof npf_pack_bulk_message");
+
 bool npf_pack_validate_msg(struct npf_pack_message *msg, uint32_t size);
 uint8_t npf_pack_get_msg_type(struct npf_pack_message *msg);
 uint64_t npf_pack_get_session_id(struct npf_pack_message *msg);
@@ -0,0 +1,585 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * Bulk session pack and restore.
+ *
+ * Many sessions are packed into one message behind a single header.
+ * Each is first packed as by dp_session_pack(), then re-encoded more
+ * compactly:
+ *
+ *  - the interface name is sent once per message, and after that
+ *    referred to by its index in a table of names built up as the
+ *    message is read;
+ *  - the address words of the forward sentry are sent as zigzag
+ *    varints of the difference from the same word of the previous
+ *    sentry of the same address family, so sessions from one subnet
+ *    cost a byte or two per word;
+ *  - the backward sentry is omitted when it is the reverse of the
+ *    forward one, as it is for any session without NAT;
+ *  - the stats, and the session id of an update, are sent as varints.
+ *
+ * The remaining state is sent as packed by dp_session_pack().  On
+ * restore each session is decoded back into a single session message,
+ * and restored by dp_session_restore().
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <rte_log.h>
+
+#include "dp_session.h"
+#include "npf/npf_pack.h"
+#include "session/session.h"
+#include "util.h"
+#include "vplane_log.h"
+
+/* Set in the backward sentry byte when the full sentry follows */
+#define NPF_PACK_BULK_BACK_SENT		0x01
+
+struct npf_pack_bulk_ctx {
+	char		*pos;
+	char		*end;
+	/* Previous address words, by address family */
+	uint32_t	prev[2][SENTRY_LEN_IPV6];
+	unsigned int	ifcount;
+	char		ifnames[NPF_PACK_BULK_IFNAMES][IFNAMSIZ];
+};
+
+static void bulk_ctx_init(struct npf_pack_bulk_ctx *ctx, char *start,
+			  char *end)
+{
+	ctx->pos = start;
+	ctx->end = end;
+	memset(ctx->prev, 0, sizeof(ctx->prev));
+	ctx->ifcount = 0;
+}
+
+static bool bulk_put(struct npf_pack_bulk_ctx *ctx, const void *p,
+		     uint32_t len)
+{
+	if ((uint32_t)(ctx->end - ctx->pos) < len)
+		return false;
+	memcpy(ctx->pos, p, len);
+	ctx->pos += len;
+	return true;
+}
+
+static bool bulk_get(struct npf_pack_bulk_ctx *ctx, void *p, uint32_t len)
+{
+	if ((uint32_t)(ctx->end - ctx->pos) < len)
+		return false;
+	memcpy(p, ctx->pos, len);
+	ctx->pos += len;
+	return true;
+}
+
+static bool bulk_put_varint(struct npf_pack_bulk_ctx *ctx, uint64_t val)
+{
+	uint8_t b[10];
+	unsigned int n = 0;
+
+	while (val >= 0x80) {
+		b[n++] = val | 0x80;
+		val >>= 7;
+	}
+	b[n++] = val;
+
+	return bulk_put(ctx, b, n);
+}
+
+static bool bulk_get_varint(struct npf_pack_bulk_ctx *ctx, uint64_t *val)
+{
+	unsigned int shift;
+	uint64_t v = 0;
+	uint8_t b;
+
+	for (shift = 0; shift < 64; shift += 7) {
+		if (ctx->pos == ctx->end)
+			return false;
+		b = *ctx->pos++;
+		v |= (uint64_t)(b & 0x7f) << shift;
+		if (!(b & 0x80)) {
+			*val = v;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool bulk_get_varint32(struct npf_pack_bulk_ctx *ctx, uint32_t *val)
+{
+	uint64_t v;
+
+	if (!bulk_get_varint(ctx, &v) || v > UINT32_MAX)
+		return false;
+	*val = v;
+	return true;
+}
+
+static inline uint32_t zigzag32(uint32_t delta)
+{
+	return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+}
+
+static inline uint32_t unzigzag32(uint32_t val)
+{
+	return (val >> 1) ^ -(val & 1);
+}
+
+static bool bulk_put_ifname(struct npf_pack_bulk_ctx *ctx, const char *name)
+{
+	unsigned int i;
+	uint8_t len;
+
+	for (i = 0; i < ctx->ifcount; i++)
+		if (!strncmp(ctx->ifnames[i], name, IFNAMSIZ))
+			return bulk_put_varint(ctx, i);
+
+	/* A new name, sent in full and remembered if there is room */
+	len = strnlen(name, IFNAMSIZ - 1);
+	if (!bulk_put_varint(ctx, ctx->ifcount) ||
+	    !bulk_put(ctx, &len, sizeof(len)) ||
+	    !bulk_put(ctx, name, len))
+		return false;
+
+	if (ctx->ifcount < NPF_PACK_BULK_IFNAMES) {
+		memcpy(ctx->ifnames[ctx->ifcount], name, len);
+		ctx->ifnames[ctx->ifcount][len] = '\0';
+		ctx->ifcount++;
+	}
+	return true;
+}
+
+static bool bulk_get_ifname(struct npf_pack_bulk_ctx *ctx, char *name)
+{
+	uint32_t idx;
+	uint8_t len;
+
+	if (!bulk_get_varint32(ctx, &idx) || idx > ctx->ifcount)
+		return false;
+
+	if (idx < ctx->ifcount) {
+		memcpy(name, ctx->ifnames[idx], IFNAMSIZ);
+		return true;
+	}
+
+	if (!bulk_get(ctx, &len, sizeof(len)) || len >= IFNAMSIZ)
+		return false;
+	memset(name, 0, IFNAMSIZ);
+	if (!bulk_get(ctx, name, len))
+		return false;
+
+	if (ctx->ifcount < NPF_PACK_BULK_IFNAMES)
+		memcpy(ctx->ifnames[ctx->ifcount++], name, IFNAMSIZ);
+	return true;
+}
+
+static bool bulk_put_sentry(struct npf_pack_bulk_ctx *ctx,
+			    const struct sentry_packet *sp)
+{
+	uint32_t *prev = ctx->prev[!!(sp->sp_sentry_flags & SENTRY_IPv6)];
+	uint32_t word;
+	unsigned int i;
+
+	if (!bulk_put_varint(ctx, sp->sp_sentry_flags) ||
+	    !bulk_put(ctx, &sp->sp_protocol, sizeof(sp->sp_protocol)) ||
+	    !bulk_put(ctx, &sp->sp_len, sizeof(sp->sp_len)))
+		return false;
+
+	/* The ids are ports, which don't delta encode usefully */
+	if (!bulk_put(ctx, &sp->sp_addrids[0], sizeof(sp->sp_addrids[0])))
+		return false;
+
+	for (i = 1; i < sp->sp_len; i++) {
+		word = ntohl(sp->sp_addrids[i]);
+		if (!bulk_put_varint(ctx, zigzag32(word - prev[i])))
+			return false;
+		prev[i] = word;
+	}
+	return true;
+}
+
+static bool bulk_get_sentry(struct npf_pack_bulk_ctx *ctx,
+			    struct sentry_packet *sp)
+{
+	uint32_t flags, *prev;
+	uint32_t delta;
+	unsigned int i;
+
+	memset(sp, 0, sizeof(*sp));
+	if (!bulk_get_varint32(ctx, &flags) || flags > UINT16_MAX)
+		return false;
+	sp->sp_sentry_flags = flags;
+	prev = ctx->prev[!!(sp->sp_sentry_flags & SENTRY_IPv6)];
+
+	if (!bulk_get(ctx, &sp->sp_protocol, sizeof(sp->sp_protocol)) ||
+	    !bulk_get(ctx, &sp->sp_len, sizeof(sp->sp_len)) ||
+	    sp->sp_len == 0 || sp->sp_len > SENTRY_LEN_IPV6)
+		return false;
+
+	if (!bulk_get(ctx, &sp->sp_addrids[0], sizeof(sp->sp_addrids[0])))
+		return false;
+
+	for (i = 1; i < sp->sp_len; i++) {
+		if (!bulk_get_varint32(ctx, &delta))
+			return false;
+		prev[i] += unzigzag32(delta);
+		sp->sp_addrids[i] = htonl(prev[i]);
+	}
+	return true;
+}
+
+static bool bulk_sentry_equal(const struct sentry_packet *a,
+			      const struct sentry_packet *b)
+{
+	return a->sp_sentry_flags == b->sp_sentry_flags &&
+		a->sp_protocol == b->sp_protocol &&
+		a->sp_len == b->sp_len &&
+		!memcmp(a->sp_addrids, b->sp_addrids,
+			a->sp_len * sizeof(a->sp_addrids[0]));
+}
+
+static bool bulk_put_psp(struct npf_pack_bulk_ctx *ctx,
+			 const struct npf_pack_sentry_packet *psp)
+{
+	struct sentry_packet forw = psp->psp_forw;
+	struct sentry_packet back_sp = psp->psp_back;
+	struct sentry_packet rev;
+	uint8_t back = 0;
+
+	if (!bulk_put_ifname(ctx, psp->psp_ifname) ||
+	    !bulk_put_sentry(ctx, &forw))
+		return false;
+
+	memset(&rev, 0, sizeof(rev));
+	sentry_packet_reverse(&forw, &rev);
+	if (!bulk_sentry_equal(&rev, &back_sp))
+		back = NPF_PACK_BULK_BACK_SENT;
+
+	if (!bulk_put(ctx, &back, sizeof(back)))
+		return false;
+	if (back & NPF_PACK_BULK_BACK_SENT)
+		return bulk_put_sentry(ctx, &back_sp);
+	return true;
+}
+
+static bool bulk_get_psp(struct npf_pack_bulk_ctx *ctx,
+			 struct npf_pack_sentry_packet *psp)
+{
+	struct sentry_packet forw, back_sp;
+	uint8_t back;
+
+	if (!bulk_get_ifname(ctx, psp->psp_ifname) ||
+	    !bulk_get_sentry(ctx, &forw) ||
+	    !bulk_get(ctx, &back, sizeof(back)))
+		return false;
+
+	if (back & NPF_PACK_BULK_BACK_SENT) {
+		if (!bulk_get_sentry(ctx, &back_sp))
+			return false;
+	} else {
+		memset(&back_sp, 0, sizeof(back_sp));
+		sentry_packet_reverse(&forw, &back_sp);
+	}
+
+	psp->psp_forw = forw;
+	psp->psp_back = back_sp;
+	return true;
+}
+
+static bool bulk_put_stats(struct npf_pack_bulk_ctx *ctx,
+			   const struct npf_pack_dp_sess_stats *stats)
+{
+	return bulk_put_varint(ctx, stats->pdss_pkts_in) &&
+		bulk_put_varint(ctx, stats->pdss_bytes_in) &&
+		bulk_put_varint(ctx, stats->pdss_pkts_out) &&
+		bulk_put_varint(ctx, stats->pdss_bytes_out);
+}
+
+static bool bulk_get_stats(struct npf_pack_bulk_ctx *ctx,
+			   struct npf_pack_dp_sess_stats *stats)
+{
+	uint64_t v[4];
+
+	if (!bulk_get_varint(ctx, &v[0]) || !bulk_get_varint(ctx, &v[1]) ||
+	    !bulk_get_varint(ctx, &v[2]) || !bulk_get_varint(ctx, &v[3]))
+		return false;
+
+	stats->pdss_pkts_in = v[0];
+	stats->pdss_bytes_in = v[1];
+	stats->pdss_pkts_out = v[2];
+	stats->pdss_bytes_out = v[3];
+	return true;
+}
+
+static uint32_t bulk_new_session_size(uint8_t type)
+{
+	switch (type) {
+	case NPF_PACK_SESSION_NEW_FW:
+		return NPF_PACK_NEW_FW_SESSION_SIZE;
+	case NPF_PACK_SESSION_NEW_NAT:
+		return NPF_PACK_NEW_NAT_SESSION_SIZE;
+	case NPF_PACK_SESSION_NEW_NAT64:
+		return NPF_PACK_NEW_NAT64_SESSION_SIZE;
+	case NPF_PACK_SESSION_NEW_NAT_NAT64:
+		return NPF_PACK_NEW_NAT_NAT64_SESSION_SIZE;
+	}
+	return 0;
+}
+
+/*
+ * A new session is sent as its type, then the fields common to all
+ * types, then whatever the type has after the stats (NAT and NAT64
+ * state) as packed.
+ */
+static bool bulk_put_session_new(struct npf_pack_bulk_ctx *ctx,
+				 const struct npf_pack_session_new *csn)
+{
+	const struct npf_pack_session_fw *cs =
+		(const struct npf_pack_session_fw *)&csn->cs;
+	uint32_t tail = csn->hdr.psh_len - NPF_PACK_NEW_FW_SESSION_SIZE;
+	uint8_t type = csn->hdr.psh_type;
+
+	return bulk_put(ctx, &type, sizeof(type)) &&
+		bulk_put(ctx, &cs->pds, sizeof(cs->pds)) &&
+		bulk_put_psp(ctx, &cs->psp) &&
+		bulk_put(ctx, &cs->pns, sizeof(cs->pns)) &&
+		bulk_put(ctx, &cs->pst, sizeof(cs->pst)) &&
+		bulk_put_stats(ctx, &cs->stats) &&
+		bulk_put(ctx, cs + 1, tail);
+}
+
+static bool bulk_get_session_new(struct npf_pack_bulk_ctx *ctx,
+				 struct npf_pack_session_new *csn)
+{
+	struct npf_pack_session_fw *cs = (struct npf_pack_session_fw *)&csn->cs;
+	uint8_t type;
+	uint32_t len;
+
+	if (!bulk_get(ctx, &type, sizeof(type)))
+		return false;
+	len = bulk_new_session_size(type);
+	if (!len)
+		return false;
+
+	memset(csn, 0, len);
+	csn->hdr.psh_len = len;
+	csn->hdr.psh_type = type;
+
+	return bulk_get(ctx, &cs->pds, sizeof(cs->pds)) &&
+		bulk_get_psp(ctx, &cs->psp) &&
+		bulk_get(ctx, &cs->pns, sizeof(cs->pns)) &&
+		bulk_get(ctx, &cs->pst, sizeof(cs->pst)) &&
+		bulk_get_stats(ctx, &cs->stats) &&
+		bulk_get(ctx, cs + 1, len - NPF_PACK_NEW_FW_SESSION_SIZE);
+}
+
+static bool bulk_put_full(struct npf_pack_bulk_ctx *ctx,
+			  const struct npf_pack_message *msg)
+{
+	const struct npf_pack_session_new *csn =
+		(const struct npf_pack_session_new *)&msg->data.cs_new;
+	const struct npf_pack_session_fw *cs =
+		(const struct npf_pack_session_fw *)&csn->cs;
+
+	if (!bulk_put_session_new(ctx, csn))
+		return false;
+
+	/* A NAT64 session is followed by its peer */
+	if (!cs->pds.pds_nat64 && !cs->pds.pds_nat46)
+		return true;
+
+	return bulk_put_session_new(
+		ctx, (const struct npf_pack_session_new *)
+		((const char *)csn + csn->hdr.psh_len));
+}
+
+static bool bulk_get_full(struct npf_pack_bulk_ctx *ctx,
+			  struct npf_pack_message *msg)
+{
+	struct npf_pack_session_new *csn =
+		(struct npf_pack_session_new *)&msg->data.cs_new;
+	struct npf_pack_session_fw *cs = (struct npf_pack_session_fw *)&csn->cs;
+	uint32_t len;
+
+	if (!bulk_get_session_new(ctx, csn))
+		return false;
+	len = csn->hdr.psh_len;
+
+	if (cs->pds.pds_nat64 || cs->pds.pds_nat46) {
+		if (!bulk_get_session_new(
+			    ctx, (struct npf_pack_session_new *)
+			    ((char *)csn + csn->hdr.psh_len)))
+			return false;
+		len += ((struct npf_pack_session_new *)
+			((char *)csn + csn->hdr.psh_len))->hdr.psh_len;
+	}
+
+	msg->hdr.pmh_len = sizeof(msg->hdr) + len;
+	return true;
+}
+
+static bool bulk_put_update(struct npf_pack_bulk_ctx *ctx,
+			    const struct npf_pack_message *msg)
+{
+	const struct npf_pack_session_update *csu = &msg->data.cs_update;
+
+	return bulk_put_varint(ctx, csu->se_id) &&
+		bulk_put_psp(ctx, &csu->psp) &&
+		bulk_put(ctx, &csu->pst, sizeof(csu->pst)) &&
+		bulk_put_stats(ctx, &csu->stats) &&
+		bulk_put_varint(ctx, csu->se_feature_count);
+}
+
+static bool bulk_get_update(struct npf_pack_bulk_ctx *ctx,
+			    struct npf_pack_message *msg)
+{
+	struct npf_pack_session_update *csu = &msg->data.cs_update;
+	uint64_t se_id;
+	uint32_t count;
+
+	memset(csu, 0, sizeof(*csu));
+	if (!bulk_get_varint(ctx, &se_id) ||
+	    !bulk_get_psp(ctx, &csu->psp) ||
+	    !bulk_get(ctx, &csu->pst, sizeof(csu->pst)) ||
+	    !bulk_get_stats(ctx, &csu->stats) ||
+	    !bulk_get_varint32(ctx, &count) || count > UINT16_MAX)
+		return false;
+	csu->se_id = se_id;
+	csu->se_feature_count = count;
+
+	msg->hdr.pmh_len = sizeof(msg->hdr) + sizeof(*csu);
+	return true;
+}
+
+int dp_session_pack_bulk(struct session *sessions[], uint32_t count,
+			 void *buf, uint32_t size,
+			 enum session_pack_type spt, uint32_t *consumed)
+{
+	struct npf_pack_bulk_message *bmsg = buf;
+	struct npf_pack_bulk_ctx ctx;
+	struct npf_pack_message msg;
+	struct session *peer;
+	uint32_t i, packed = 0;
+	char *mark;
+	bool ok;
+
+	*consumed = 0;
+
+	if (!sessions || !buf || size < sizeof(*bmsg) ||
+	    (spt != SESSION_PACK_FULL && spt != SESSION_PACK_UPDATE))
+		return -EINVAL;
+
+	bulk_ctx_init(&ctx, bmsg->pbm_data, (char *)buf + size);
+
+	for (i = 0; i < count; i++) {
+		/* Sessions that can't be packed are skipped */
+		if (dp_session_pack(sessions[i], &msg, sizeof(msg), spt,
+				    &peer) < 0)
+			continue;
+
+		mark = ctx.pos;
+		if (spt == SESSION_PACK_FULL)
+			ok = bulk_put_full(&ctx, &msg);
+		else
+			ok = bulk_put_update(&ctx, &msg);
+
+		/*
+		 * Stop at the first session that doesn't fit.  Anything
+		 * it added to the context is never referred to, as no
+		 * further sessions are packed.
+		 */
+		if (!ok) {
+			ctx.pos = mark;
+			if (!packed) {
+				RTE_LOG(ERR, DATAPLANE,
+					"SESSION_PACK: Buffer too small for "
+					"bulk message: given %u\n", size);
+				return -ENOSPC;
+			}
+			break;
+		}
+		packed++;
+	}
+
+	*consumed = i;
+
+	bmsg->hdr.pmh_len = ctx.pos - (char *)buf;
+	bmsg->hdr.pmh_version = SESSION_PACK_VERSION;
+	bmsg->hdr.pmh_flags = NPF_PACK_MSG_F_BULK;
+	bmsg->hdr.pmh_type = spt;
+	bmsg->pbm_count = packed;
+	memset(bmsg->pbm_pad, 0, sizeof(bmsg->pbm_pad));
+
+	return (int)bmsg->hdr.pmh_len;
+}
+
+int dp_session_restore_bulk(void *buf, uint32_t size,
+			    enum session_pack_type *spt, uint32_t *restored)
+{
+	struct npf_pack_bulk_message *bmsg = buf;
+	struct npf_pack_bulk_ctx ctx;
+	struct npf_pack_message msg;
+	enum session_pack_type one_spt;
+	uint32_t i;
+	int rc = 0;
+	int ret;
+	bool ok;
+
+	*spt = SESSION_PACK_NONE;
+	*restored = 0;
+
+	if (!buf || size < sizeof(*bmsg))
+		return -EINVAL;
+
+	if (bmsg->hdr.pmh_len != size ||
+	    bmsg->hdr.pmh_version != SESSION_PACK_VERSION ||
+	    !(bmsg->hdr.pmh_flags & NPF_PACK_MSG_F_BULK) ||
+	    (bmsg->hdr.pmh_type != SESSION_PACK_FULL &&
+	     bmsg->hdr.pmh_type != SESSION_PACK_UPDATE)) {
+		RTE_LOG(ERR, DATAPLANE,
+			"npf_pack unpack: Invalid bulk message\n");
+		return -EINVAL;
+	}
+	*spt = bmsg->hdr.pmh_type;
+
+	/* Grow the tables once for the lot, rather than as they fill */
+	if (*spt == SESSION_PACK_FULL)
+		session_table_reserve(bmsg->pbm_count);
+
+	bulk_ctx_init(&ctx, bmsg->pbm_data, (char *)buf + size);
+
+	for (i = 0; i < bmsg->pbm_count; i++) {
+		memset(&msg.hdr, 0, sizeof(msg.hdr));
+		msg.hdr.pmh_version = SESSION_PACK_VERSION;
+		msg.hdr.pmh_type = *spt;
+
+		if (*spt == SESSION_PACK_FULL)
+			ok = bulk_get_full(&ctx, &msg);
+		else
+			ok = bulk_get_update(&ctx, &msg);
+
+		if (!ok) {
+			RTE_LOG(ERR, DATAPLANE,
+				"npf_pack unpack: Truncated bulk message, "
+				"session %u of %u\n", i, bmsg->pbm_count);
+			return -EINVAL;
+		}
+
+		/* Carry on past a session that can't be restored */
+		ret = dp_session_restore(&msg, msg.hdr.pmh_len, &one_spt);
+		if (ret == 0)
+			(*restored)++;
+		else if (!rc)
+			rc = ret;
+	}
+
+	return rc;
+}
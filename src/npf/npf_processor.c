@@ -119,7 +119,8 @@ nc_jump(const void *iptr, int n, u_int *lcount)
 }
 
 /*
- * npf_ncode_process: process n-code using data of the specified packet.
+ * npf_ncode_run: process the given n-code using data of the specified
+ * packet.  The rule is only used by the rproc instruction.
  *
  * => Argument nbuf (network buffer) is opaque to this function.
  * => Chain of nbufs (and their data) should be protected from any change.
@@ -128,12 +129,12 @@ nc_jump(const void *iptr, int n, u_int *lcount)
  * => Routine prevents from infinite loop.
  */
 int
-npf_ncode_process(npf_cache_t *npc, const npf_rule_t *rl,
-		  const struct ifnet *ifp, int dir,
-		  npf_session_t *se, struct rte_mbuf *nbuf)
+npf_ncode_run(const void *ncode, npf_cache_t *npc, const npf_rule_t *rl,
+	      const struct ifnet *ifp, int dir,
+	      npf_session_t *se, struct rte_mbuf *nbuf)
 {
 	/* N-code instruction pointer. */
-	const void *i_ptr = npf_get_ncode(rl);
+	const void *i_ptr = ncode;
 
 	/* Local, state variables. */
 	uint32_t d, i, n;
@@ -277,3 +278,14 @@ fail:
 	/* Failure case. */
 	return -1;
 }
+
+/*
+ * npf_ncode_process: process the n-code of a rule.
+ */
+int
+npf_ncode_process(npf_cache_t *npc, const npf_rule_t *rl,
+		  const struct ifnet *ifp, int dir,
+		  npf_session_t *se, struct rte_mbuf *nbuf)
+{
+	return npf_ncode_run(npf_get_ncode(rl), npc, rl, ifp, dir, se, nbuf);
+}
@@ -4,18 +4,58 @@
  * SPDX-License-Identifier: LGPL-2.1-only
  */
 
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include <rte_acl.h>
 #include <rte_ip.h>
+#include <rte_jhash.h>
+#include <urcu/list.h>
 #include "vplane_log.h"
 #include "npf_rte_acl.h"
 #include <rte_log.h>
 #include "../ip_funcs.h"
 #include "../netinet6/ip6_funcs.h"
 
+/*
+ * The rules of a match context are partitioned into bands by rule
+ * number, each built into its own rte_acl context.  A rebuild of the
+ * ruleset only builds the bands whose rules have changed; a band
+ * whose rules are identical to one already built is shared with it.
+ * Each built band is reference counted by the match contexts using it,
+ * so the old ruleset keeps its bands until it is freed after the new
+ * one has been published.
+ *
+ * A packet is classified against every band, so a ruleset whose rule
+ * numbers are spread out has its bands doubled in width until there
+ * are no more than NPF_RTE_ACL_MAX_BANDS.  Widths stay powers of two,
+ * so the bands of the next rebuild still line up with these.
+ */
+#define NPF_RTE_ACL_BAND_SHIFT	13	/* 8192 rule numbers per band */
+#define NPF_RTE_ACL_MAX_BANDS	8
+
+struct npf_rte_acl_band {
+	struct cds_list_head	b_entry;	/* npf_rte_acl_bands */
+	struct rte_acl_ctx	*b_acl_ctx;
+	void			*b_rules;	/* copy, for comparison */
+	uint32_t		b_num_rules;
+	uint32_t		b_rule_size;
+	uint32_t		b_hash;
+	uint32_t		b_refcnt;
+	int			b_af;
+};
+
+/* All built bands.  Only used from the main thread. */
+static CDS_LIST_HEAD(npf_rte_acl_bands);
+
 struct npf_match_ctx {
-	struct rte_acl_ctx *acl_ctx;
 	char *name;
-	uint16_t num_rules;
+	uint32_t num_rules;
+	uint32_t max_rules;
+	uint32_t rule_size;
+	void *pending;			/* rules added since init */
+	uint32_t num_bands;
+	struct npf_rte_acl_band **bands;
 };
 
 /* rte acl stuff */
@@ -234,6 +274,20 @@ enum {
 RTE_ACL_RULE_DEF(acl4_rules, RTE_DIM(ipv4_defs));
 RTE_ACL_RULE_DEF(acl6_rules, RTE_DIM(ipv6_defs));
 
+static const struct rte_acl_field_def *
+npf_rte_acl_defs(int af, uint32_t *num_fields)
+{
+	if (af == AF_INET) {
+		*num_fields = RTE_DIM(ipv4_defs);
+		return ipv4_defs;
+	}
+	*num_fields = RTE_DIM(ipv6_defs);
+	return ipv6_defs;
+}
+
+/* Max packets passed to rte_acl_classify in one call */
+#define NPF_RTE_ACL_BURST_MAX	64
+
 /*
  * Packet matching callback functions which use the rte_acl API
  */
@@ -241,13 +295,7 @@ RTE_ACL_RULE_DEF(acl6_rules, RTE_DIM(ipv6_defs));
 int npf_rte_acl_init(int af, const char *name, uint32_t max_rules,
 		     npf_match_ctx_t **m_ctx)
 {
-	struct rte_acl_param acl_param = {
-		.socket_id = SOCKET_ID_ANY,
-		.max_rule_num = max_rules,
-	};
-	char acl_name[RTE_ACL_NAMESIZE];
 	npf_match_ctx_t *tmp_ctx;
-	static uint32_t ctx_id;
 
 	tmp_ctx = calloc(1, sizeof(npf_match_ctx_t));
 	if (!tmp_ctx) {
@@ -256,35 +304,25 @@ int npf_rte_acl_init(int af, const char *name, uint32_t max_rules,
 		return -ENOMEM;
 	}
 
-	/*
-	 * rte_acl_create returns a pointer to an existing context if
-	 * there is one of the same name. The NPF call flow involves
-	 * re-creating an entire ruleset when there are changes to the
-	 * configuration. In order to ensure that a new context is created
-	 * each time, a unique number is suffixed to the name
-	 */
-	snprintf(acl_name, RTE_ACL_NAMESIZE, "%s-%s-%d", name,
-		 af == AF_INET ? "ipv4" : "ipv6", ctx_id++);
-	acl_param.name = acl_name;
-
-	tmp_ctx->name = strdup(acl_name);
+	tmp_ctx->name = strdup(name);
 	if (!tmp_ctx->name) {
 		RTE_LOG(ERR, DATAPLANE,
-			"Could not allocate name %s for ACL ctx\n",
-			acl_name);
+			"Could not allocate name %s for ACL ctx\n", name);
 		free(tmp_ctx);
 		return -ENOMEM;
 	}
 	if (af == AF_INET)
-		acl_param.rule_size = RTE_ACL_RULE_SZ(RTE_DIM(ipv4_defs));
+		tmp_ctx->rule_size = RTE_ACL_RULE_SZ(RTE_DIM(ipv4_defs));
 	else
-		acl_param.rule_size = RTE_ACL_RULE_SZ(RTE_DIM(ipv6_defs));
+		tmp_ctx->rule_size = RTE_ACL_RULE_SZ(RTE_DIM(ipv6_defs));
 
-	tmp_ctx->acl_ctx = rte_acl_create(&acl_param);
-	if (tmp_ctx->acl_ctx == NULL) {
+	tmp_ctx->max_rules = max_rules;
+	tmp_ctx->pending = calloc(max_rules ? max_rules : 1,
+				  tmp_ctx->rule_size);
+	if (!tmp_ctx->pending) {
 		RTE_LOG(ERR, DATAPLANE,
-			"Could not allocate ACL context for %s\n",
-			(af == AF_INET ? "ipv4" : "ipv6"));
+			"Could not allocate %u ACL rules for %s\n",
+			max_rules, name);
 		free(tmp_ctx->name);
 		free(tmp_ctx);
 		return -ENOMEM;
@@ -295,6 +333,200 @@ int npf_rte_acl_init(int af, const char *name, uint32_t max_rules,
 	return 0;
 }
 
+static void npf_rte_acl_band_put(struct npf_rte_acl_band *band)
+{
+	if (--band->b_refcnt)
+		return;
+
+	cds_list_del(&band->b_entry);
+	rte_acl_free(band->b_acl_ctx);
+	free(band->b_rules);
+	free(band);
+}
+
+/*
+ * Build an rte_acl context for one band of rules, sorted by rule
+ * number.
+ */
+static struct npf_rte_acl_band *
+npf_rte_acl_band_create(int af, const char *name, const void *rules,
+			uint32_t num, uint32_t rule_size, uint32_t hash)
+{
+	struct rte_acl_param acl_param = {
+		.socket_id = SOCKET_ID_ANY,
+		.max_rule_num = num,
+		.rule_size = rule_size,
+	};
+	struct rte_acl_config cfg = { 0 };
+	const struct rte_acl_field_def *defs;
+	char acl_name[RTE_ACL_NAMESIZE];
+	struct npf_rte_acl_band *band;
+	static uint32_t ctx_id;
+	int err;
+
+	band = calloc(1, sizeof(*band));
+	if (!band)
+		return NULL;
+
+	band->b_rules = malloc(num * rule_size);
+	if (!band->b_rules) {
+		free(band);
+		return NULL;
+	}
+	memcpy(band->b_rules, rules, num * rule_size);
+	band->b_num_rules = num;
+	band->b_rule_size = rule_size;
+	band->b_hash = hash;
+	band->b_af = af;
+	band->b_refcnt = 1;
+
+	/*
+	 * rte_acl_create returns a pointer to an existing context if
+	 * there is one of the same name. In order to ensure that a new
+	 * context is created each time, a unique number is prefixed to
+	 * the name, so it survives truncation.
+	 */
+	snprintf(acl_name, RTE_ACL_NAMESIZE, "%u-%s-%s", ctx_id++,
+		 af == AF_INET ? "ipv4" : "ipv6", name);
+	acl_param.name = acl_name;
+
+	band->b_acl_ctx = rte_acl_create(&acl_param);
+	if (band->b_acl_ctx == NULL) {
+		RTE_LOG(ERR, DATAPLANE,
+			"Could not allocate ACL context for %s\n",
+			(af == AF_INET ? "ipv4" : "ipv6"));
+		goto error;
+	}
+
+	err = rte_acl_add_rules(band->b_acl_ctx, rules, num);
+	if (err) {
+		RTE_LOG(ERR, DATAPLANE, "Could not add rules for af %d : %d\n",
+			af, err);
+		goto error;
+	}
+
+	cfg.num_categories = 1;
+	defs = npf_rte_acl_defs(af, &cfg.num_fields);
+	memcpy(cfg.defs, defs, cfg.num_fields * sizeof(*defs));
+
+	err = rte_acl_build(band->b_acl_ctx, &cfg);
+	if (err != 0) {
+		RTE_LOG(ERR, DATAPLANE,
+			"Could not build ACL rules for %s : %s\n",
+			(af == AF_INET ? "ipv4" : "ipv6"), strerror(-err));
+		goto error;
+	}
+
+	cds_list_add(&band->b_entry, &npf_rte_acl_bands);
+	return band;
+
+error:
+	rte_acl_free(band->b_acl_ctx);
+	free(band->b_rules);
+	free(band);
+	return NULL;
+}
+
+/* Only the bytes of a field's size are set, so ignore the rest */
+static inline uint32_t
+npf_rte_acl_field_val(const union rte_acl_field_types *v, uint8_t size)
+{
+	switch (size) {
+	case sizeof(uint8_t):
+		return v->u8;
+	case sizeof(uint16_t):
+		return v->u16;
+	default:
+		return v->u32;
+	}
+}
+
+/*
+ * Rules are hashed and compared field by field, so that padding and
+ * the unused bytes of each field never stop a band being shared.
+ */
+static uint32_t npf_rte_acl_rules_hash(int af, const void *rules,
+				       uint32_t num, uint32_t rule_size)
+{
+	const struct rte_acl_field_def *defs;
+	const struct rte_acl_rule *rule;
+	uint32_t i, f, num_fields;
+	uint32_t hash = af;
+
+	defs = npf_rte_acl_defs(af, &num_fields);
+
+	for (i = 0; i < num; i++) {
+		rule = RTE_PTR_ADD(rules, i * rule_size);
+		hash = rte_jhash_3words(rule->data.category_mask,
+					rule->data.priority,
+					rule->data.userdata, hash);
+		for (f = 0; f < num_fields; f++)
+			hash = rte_jhash_2words(
+				npf_rte_acl_field_val(&rule->field[f].value,
+						      defs[f].size),
+				npf_rte_acl_field_val(
+					&rule->field[f].mask_range,
+					defs[f].size), hash);
+	}
+	return hash;
+}
+
+static bool npf_rte_acl_rules_equal(int af, const void *a, const void *b,
+				    uint32_t num, uint32_t rule_size)
+{
+	const struct rte_acl_field_def *defs;
+	const struct rte_acl_rule *ra, *rb;
+	uint32_t i, f, num_fields;
+
+	defs = npf_rte_acl_defs(af, &num_fields);
+
+	for (i = 0; i < num; i++) {
+		ra = RTE_PTR_ADD(a, i * rule_size);
+		rb = RTE_PTR_ADD(b, i * rule_size);
+
+		if (ra->data.category_mask != rb->data.category_mask ||
+		    ra->data.priority != rb->data.priority ||
+		    ra->data.userdata != rb->data.userdata)
+			return false;
+
+		for (f = 0; f < num_fields; f++) {
+			if (npf_rte_acl_field_val(&ra->field[f].value,
+						  defs[f].size) !=
+			    npf_rte_acl_field_val(&rb->field[f].value,
+						  defs[f].size) ||
+			    npf_rte_acl_field_val(&ra->field[f].mask_range,
+						  defs[f].size) !=
+			    npf_rte_acl_field_val(&rb->field[f].mask_range,
+						  defs[f].size))
+				return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Find a built band with exactly these rules, else build one.
+ */
+static struct npf_rte_acl_band *
+npf_rte_acl_band_get(int af, const char *name, const void *rules,
+		     uint32_t num, uint32_t rule_size)
+{
+	struct npf_rte_acl_band *band;
+	uint32_t hash = npf_rte_acl_rules_hash(af, rules, num, rule_size);
+
+	cds_list_for_each_entry(band, &npf_rte_acl_bands, b_entry) {
+		if (band->b_hash == hash && band->b_af == af &&
+		    band->b_num_rules == num &&
+		    band->b_rule_size == rule_size &&
+		    npf_rte_acl_rules_equal(af, band->b_rules, rules, num,
+					    rule_size)) {
+			band->b_refcnt++;
+			return band;
+		}
+	}
+
+	return npf_rte_acl_band_create(af, name, rules, num, rule_size, hash);
+}
 
 /*
  * convert big-endian wildcard mask to mask
@@ -482,66 +714,124 @@ int npf_rte_acl_add_rule(int af, npf_match_ctx_t *m_ctx, uint32_t rule_no,
 		acl_rule = (const struct rte_acl_rule *)&v6_rules;
 	}
 
-	err = rte_acl_add_rules(m_ctx->acl_ctx, acl_rule, 1);
-	if (err) {
+	if (!m_ctx->pending || m_ctx->num_rules >= m_ctx->max_rules) {
 		RTE_LOG(ERR, DATAPLANE, "Could not add rule for af %d : %d\n",
-			af, err);
-		return err;
+			af, -ENOSPC);
+		return -ENOSPC;
 	}
 
+	memcpy(RTE_PTR_ADD(m_ctx->pending,
+			   m_ctx->num_rules * m_ctx->rule_size),
+	       acl_rule, m_ctx->rule_size);
 	m_ctx->num_rules++;
 
 	return 0;
 }
 
+static int npf_rte_acl_rule_cmp(const void *a, const void *b)
+{
+	const struct rte_acl_rule *ra = a;
+	const struct rte_acl_rule *rb = b;
+
+	return (ra->data.priority > rb->data.priority) -
+		(ra->data.priority < rb->data.priority);
+}
+
+static inline uint32_t
+npf_rte_acl_rule_band(const npf_match_ctx_t *ctx, uint32_t i,
+		      uint32_t shift)
+{
+	const struct rte_acl_rule *rule =
+		RTE_PTR_ADD(ctx->pending, i * ctx->rule_size);
+
+	return (uint64_t)rule->data.userdata >> shift;
+}
+
+static uint32_t
+npf_rte_acl_count_bands(const npf_match_ctx_t *ctx, uint32_t shift)
+{
+	uint32_t i, num_bands = 1;
+
+	for (i = 1; i < ctx->num_rules; i++)
+		if (npf_rte_acl_rule_band(ctx, i, shift) !=
+		    npf_rte_acl_rule_band(ctx, i - 1, shift))
+			num_bands++;
+	return num_bands;
+}
+
+static void npf_rte_acl_release_bands(npf_match_ctx_t *ctx)
+{
+	uint32_t b;
+
+	for (b = 0; b < ctx->num_bands; b++)
+		npf_rte_acl_band_put(ctx->bands[b]);
+	free(ctx->bands);
+	ctx->bands = NULL;
+	ctx->num_bands = 0;
+}
+
+/*
+ * Split the rules into bands by rule number, and find or build a
+ * context for each.  A band whose rules are identical to one already
+ * built, typically by the ruleset this one is replacing, shares that
+ * context, so only the bands touched by a config change are rebuilt.
+ */
 int npf_rte_acl_build(int af, npf_match_ctx_t **m_ctx)
 {
-	struct rte_acl_config cfg = { 0 };
-	int err;
 	npf_match_ctx_t *ctx = *m_ctx;
+	uint32_t i, start, num_bands, shift;
 
 	if (!ctx)
 		return -EINVAL;
 
-	if (!ctx->num_rules)
+	/* Nothing to do if empty or already built */
+	if (!ctx->num_rules || !ctx->pending)
 		return 0;
 
-	cfg.num_categories = 1;
-	if (af == AF_INET) {
-		cfg.num_fields = RTE_DIM(ipv4_defs);
-		memcpy(cfg.defs, ipv4_defs, sizeof(ipv4_defs));
-	} else {
-		cfg.num_fields = RTE_DIM(ipv6_defs);
-		memcpy(cfg.defs, ipv6_defs, sizeof(ipv6_defs));
-	}
+	qsort(ctx->pending, ctx->num_rules, ctx->rule_size,
+	      npf_rte_acl_rule_cmp);
 
-	/* build the runtime structures for added rules, with 2 categories. */
-	err = rte_acl_build(ctx->acl_ctx, &cfg);
-	if (err != 0) {
-		/* handle error at build runtime structures for ACL context. */
-		RTE_LOG(ERR, DATAPLANE,
-			"Could not build ACL rules for %s : %s\n",
-			(af == AF_INET ? "ipv4" : "ipv6"), strerror(-err));
-		return err;
+	shift = NPF_RTE_ACL_BAND_SHIFT;
+	while ((num_bands = npf_rte_acl_count_bands(ctx, shift)) >
+	       NPF_RTE_ACL_MAX_BANDS)
+		shift++;
+
+	ctx->bands = calloc(num_bands, sizeof(*ctx->bands));
+	if (!ctx->bands)
+		return -ENOMEM;
+
+	for (start = 0, i = 1; i <= ctx->num_rules; i++) {
+		struct npf_rte_acl_band *band;
+
+		if (i < ctx->num_rules &&
+		    npf_rte_acl_rule_band(ctx, i, shift) ==
+		    npf_rte_acl_rule_band(ctx, start, shift))
+			continue;
+
+		band = npf_rte_acl_band_get(
+			af, ctx->name,
+			RTE_PTR_ADD(ctx->pending, start * ctx->rule_size),
+			i - start, ctx->rule_size);
+		if (!band) {
+			npf_rte_acl_release_bands(ctx);
+			return -ENOMEM;
+		}
+		ctx->bands[ctx->num_bands++] = band;
+		start = i;
 	}
 
+	free(ctx->pending);
+	ctx->pending = NULL;
+
 	return 0;
 }
 
-int npf_rte_acl_match(int af, npf_match_ctx_t *m_ctx,
-		      npf_cache_t *npc __rte_unused,
-		      struct npf_match_cb_data *data,
-		      uint32_t *rule_no)
+/* Start of the classify input, which is the protocol field */
+static inline const uint8_t *
+npf_rte_acl_pkt_data(int af, struct rte_mbuf *m)
 {
-	int ret;
-	uint32_t results = UINT32_MAX;
-	const uint8_t *pkt_data[1];
-	struct rte_mbuf *m = data->mbuf;
 	uint8_t *nlp;
 
-	if (!m_ctx->num_rules)
-		return 0;
-
 	if (af == AF_INET) {
 		nlp = (uint8_t *)iphdr(m);
 		nlp = RTE_PTR_ADD(nlp, offsetof(struct ip, ip_p));
@@ -549,23 +839,143 @@ int npf_rte_acl_match(int af, npf_match_ctx_t *m_ctx,
 		nlp = (uint8_t *)ip6hdr(m);
 		nlp = RTE_PTR_ADD(nlp, offsetof(struct rte_ipv6_hdr, proto));
 	}
-	pkt_data[0] = nlp;
+	return nlp;
+}
+
+/*
+ * Each band returns its highest priority match, and the priority is
+ * the rule number, so the highest result over all bands is the rule a
+ * single context holding every rule would have returned.
+ */
+int npf_rte_acl_match(int af, npf_match_ctx_t *m_ctx,
+		      npf_cache_t *npc __rte_unused,
+		      struct npf_match_cb_data *data,
+		      uint32_t *rule_no)
+{
+	uint32_t b, results, best = 0;
+	const uint8_t *pkt_data[1];
+
+	if (!m_ctx->num_bands)
+		return 0;
+
+	pkt_data[0] = npf_rte_acl_pkt_data(af, data->mbuf);
+
+	for (b = 0; b < m_ctx->num_bands; b++) {
+		results = 0;
+		if (rte_acl_classify(m_ctx->bands[b]->b_acl_ctx, pkt_data,
+				     &results, 1, 1))
+			continue;
+		if (results > best)
+			best = results;
+	}
 
-	ret = rte_acl_classify(m_ctx->acl_ctx, pkt_data, &results, 1, 1);
-	if (ret)
+	if (!best)
 		return 0;
 
-	*rule_no = results;
+	*rule_no = best;
 	return 1;
 }
 
+/*
+ * Classify a burst of packets of the same address family with one
+ * rte_acl_classify call per band, so that the vector classify methods
+ * can work on several packets at once.  rule_no[i] is set to the
+ * matching rule number for m[i], or 0 if there is no match.
+ */
+int npf_rte_acl_match_burst(int af, npf_match_ctx_t *m_ctx,
+			    struct rte_mbuf *m[], uint32_t num,
+			    uint32_t *rule_no)
+{
+	const uint8_t *pkt_data[NPF_RTE_ACL_BURST_MAX];
+	uint32_t results[NPF_RTE_ACL_BURST_MAX];
+	uint32_t b, i, n, done;
+	int ret;
+
+	memset(rule_no, 0, num * sizeof(*rule_no));
+
+	for (done = 0; done < num; done += n) {
+		n = RTE_MIN(num - done, (uint32_t)NPF_RTE_ACL_BURST_MAX);
+
+		for (i = 0; i < n; i++)
+			pkt_data[i] = npf_rte_acl_pkt_data(af, m[done + i]);
+
+		for (b = 0; b < m_ctx->num_bands; b++) {
+			ret = rte_acl_classify(m_ctx->bands[b]->b_acl_ctx,
+					       pkt_data, results, n, 1);
+			if (ret) {
+				memset(rule_no, 0, num * sizeof(*rule_no));
+				return ret;
+			}
+			for (i = 0; i < n; i++)
+				if (results[i] > rule_no[done + i])
+					rule_no[done + i] = results[i];
+		}
+	}
+
+	return 0;
+}
+
+static inline uint32_t
+npf_rte_acl_band_rule_no(const struct npf_rte_acl_band *band, uint32_t i)
+{
+	const struct rte_acl_rule *rule =
+		RTE_PTR_ADD(band->b_rules, i * band->b_rule_size);
+
+	return rule->data.userdata;
+}
+
+static bool
+npf_rte_acl_band_has_rule(const struct npf_rte_acl_band *band,
+			  uint32_t rule_no)
+{
+	uint32_t lo = 0, hi = band->b_num_rules, mid, mid_no;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		mid_no = npf_rte_acl_band_rule_no(band, mid);
+		if (mid_no == rule_no)
+			return true;
+		if (mid_no < rule_no)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return false;
+}
+
+/*
+ * The bands, and the rules within each, are in rule number order, so
+ * both are binary searched.
+ */
+const struct rte_acl_ctx *
+npf_rte_acl_rule_ctx(const npf_match_ctx_t *m_ctx, uint32_t rule_no)
+{
+	const struct npf_rte_acl_band *band;
+	uint32_t lo = 0, hi = m_ctx->num_bands, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		band = m_ctx->bands[mid];
+		if (rule_no < npf_rte_acl_band_rule_no(band, 0))
+			hi = mid;
+		else if (rule_no > npf_rte_acl_band_rule_no(
+				 band, band->b_num_rules - 1))
+			lo = mid + 1;
+		else if (npf_rte_acl_band_has_rule(band, rule_no))
+			return band->b_acl_ctx;
+		else
+			return NULL;
+	}
+	return NULL;
+}
+
 int npf_rte_acl_destroy(int af __rte_unused, npf_match_ctx_t **m_ctx)
 {
 	npf_match_ctx_t *ctx = *m_ctx;
 
 	if (ctx) {
-		rte_acl_reset(ctx->acl_ctx);
-		rte_acl_free(ctx->acl_ctx);
+		npf_rte_acl_release_bands(ctx);
+		free(ctx->pending);
 		free(ctx->name);
 		free(ctx);
 		*m_ctx = NULL;
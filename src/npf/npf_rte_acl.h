@@ -24,6 +24,17 @@ int npf_rte_acl_build(int af, npf_match_ctx_t **m_ctx);
 int npf_rte_acl_match(int af, npf_match_ctx_t *m_ctx, npf_cache_t *npc,
 		      struct npf_match_cb_data *data, uint32_t *rule_no);
 
+int npf_rte_acl_match_burst(int af, npf_match_ctx_t *m_ctx,
+			    struct rte_mbuf *m[], uint32_t num,
+			    uint32_t *rule_no);
+
+/*
+ * The rte_acl context holding a rule once built.  Contexts are shared
+ * between match contexts with identical bands of rules.
+ */
+const struct rte_acl_ctx *
+npf_rte_acl_rule_ctx(const npf_match_ctx_t *m_ctx, uint32_t rule_no);
+
 int npf_rte_acl_destroy(int af, npf_match_ctx_t **m_ctx);
 
 #endif
@@ -69,6 +69,7 @@
 #include "npf/config/npf_config.h"
 #include "npf/grouper2.h"
 #include "npf/npf_disassemble.h"
+#include "npf/npf_jit.h"
 #include "npf/npf_nat.h"
 #include "npf/npf_ncode.h"
 #include "npf/npf_rule_gen.h"
@@ -162,9 +163,11 @@ struct npf_rule {
 	struct cds_list_head		r_entry;
 	struct cds_lfht_node		r_entry_ht;
 	void				*r_ncode;	/* pointer to ncode */
+	npf_jit_func_t			*r_jit;		/* compiled ncode */
 	npf_natpolicy_t			*r_natp;	/* nat policy */
 	struct npf_rule_stats		*r_stats;	/* rule stats */
 	struct npf_rule_state		*r_state;	/* generation state */
+	struct npf_jit_image		*r_jit_image;	/* holds r_jit */
 	uint32_t			r_nc_size;	/* ncode size */
 	rte_atomic32_t			r_refcnt;	/* Reference counter */
 	uint8_t				r_pass:1;	/* rule bits */
@@ -283,6 +286,7 @@ static void rule_free(npf_rule_t *rl)
 	free(rl->r_state);
 	if (rl->r_stats)
 		npf_rule_stats_put(rl->r_stats);
+	npf_jit_image_put(rl->r_jit_image);
 	free(rl->r_ncode);
 	free(rl);
 }
@@ -1678,6 +1682,12 @@ npf_rule_has_rproc_logger(npf_rule_t *rl)
 	return rl && rl->r_rproc_logger;
 }
 
+bool
+npf_rule_has_rproc_match(npf_rule_t *rl)
+{
+	return rl->r_rproc_match != 0;
+}
+
 /*
  * Run the rule action procedures by executing each extension call.
  *
@@ -1771,6 +1781,64 @@ npf_match_setup(npf_rule_group_t *rg, uint32_t max_rules)
 	return 0;
 }
 
+/*
+ * Compile the ncode of all rules in the group into native code.  Each
+ * compiled rule holds a reference on the image, so it lives as long
+ * as the longest lived rule.  Rules that cannot be compiled, or all
+ * rules if the JIT is disabled, keep using the interpreter.
+ */
+static void
+npf_rule_group_jit(npf_rule_group_t *rg)
+{
+	struct npf_jit_prog *progs;
+	struct npf_jit_image *img;
+	unsigned int i, count = 0;
+	npf_rule_t *rl;
+
+	if (!npf_jit_enabled)
+		return;
+
+	cds_list_for_each_entry(rl, &rg->rg_rules, r_entry)
+		if (rl->r_ncode && !rl->r_jit)
+			count++;
+	if (count == 0)
+		return;
+
+	progs = calloc(count, sizeof(*progs));
+	if (!progs)
+		return;
+
+	i = 0;
+	cds_list_for_each_entry(rl, &rg->rg_rules, r_entry) {
+		if (!rl->r_ncode || rl->r_jit)
+			continue;
+		progs[i].jp_ncode = rl->r_ncode;
+		progs[i].jp_nc_size = rl->r_nc_size;
+		i++;
+	}
+
+	img = npf_jit_compile(progs, count);
+	if (!img) {
+		free(progs);
+		return;
+	}
+
+	i = 0;
+	cds_list_for_each_entry(rl, &rg->rg_rules, r_entry) {
+		if (!rl->r_ncode || rl->r_jit)
+			continue;
+		if (progs[i].jp_func) {
+			npf_jit_image_get(img);
+			rl->r_jit_image = img;
+			rl->r_jit = progs[i].jp_func;
+		}
+		i++;
+	}
+
+	npf_jit_image_put(img);
+	free(progs);
+}
+
 void
 npf_match_optimize(npf_rule_group_t *rg)
 {
@@ -1784,6 +1852,8 @@ npf_match_optimize(npf_rule_group_t *rg)
 	err = npf_match_build(rs_type, AF_INET6, &rg->match_ctx_v6);
 	if (err)
 		RTE_LOG(ERR, DATAPLANE, "Could not rebuild IPv6 grouper\n");
+
+	npf_rule_group_jit(rg);
 }
 
 static ALWAYS_INLINE
@@ -1795,8 +1865,16 @@ bool npf_rule_match(npf_cache_t *npc, struct rte_mbuf *nbuf,
 	 * Process the n-code, if any
 	 * NB: 'match all' generates no ncode
 	 */
-	if (rl->r_ncode && npf_ncode_process(npc, rl, ifp, dir, se, nbuf))
-		return false;
+	if (rl->r_ncode) {
+		int ret;
+
+		if (rl->r_jit && CMM_LOAD_SHARED(npf_jit_enabled))
+			ret = rl->r_jit(npc, rl, ifp, dir, se, nbuf);
+		else
+			ret = npf_ncode_process(npc, rl, ifp, dir, se, nbuf);
+		if (ret)
+			return false;
+	}
 
 	return true;
 }
@@ -1904,6 +1982,131 @@ npf_ruleset_inspect(npf_cache_t *npc, struct rte_mbuf *nbuf,
 	return NULL;
 }
 
+/*
+ * Inspect a burst of cached packets, giving each packet the rule that
+ * npf_ruleset_inspect() would give it.  Each rule group classifies all
+ * of the packets still unmatched, of one address family, with a
+ * single call, so that the match backend can work on the whole burst
+ * at once.  rl[i] is set to the matching rule for packet i, or NULL.
+ */
+void
+npf_ruleset_inspect_burst(npf_cache_t *npc[], struct rte_mbuf *nbuf[],
+			  const npf_ruleset_t *ruleset,
+			  const struct ifnet *ifp, const int dir,
+			  npf_rule_t *rl[], uint32_t num)
+{
+	struct npf_match_cb_data pd[NPF_RULESET_BURST_MAX];
+	struct npf_match_cb_data *sel_pd[2][NPF_RULESET_BURST_MAX];
+	npf_cache_t *sel_npc[2][NPF_RULESET_BURST_MAX];
+	npf_rule_t *sel_rl[NPF_RULESET_BURST_MAX];
+	uint32_t sel[2][NPF_RULESET_BURST_MAX];
+	uint32_t nsel[2];
+	uint32_t i, j, left;
+	npf_rule_group_t *rg;
+	npf_rule_t *r;
+
+	while (num > NPF_RULESET_BURST_MAX) {
+		npf_ruleset_inspect_burst(npc, nbuf, ruleset, ifp, dir, rl,
+					  NPF_RULESET_BURST_MAX);
+		npc += NPF_RULESET_BURST_MAX;
+		nbuf += NPF_RULESET_BURST_MAX;
+		rl += NPF_RULESET_BURST_MAX;
+		num -= NPF_RULESET_BURST_MAX;
+	}
+
+	for (i = 0; i < num; i++) {
+		rl[i] = NULL;
+		pd[i] = (struct npf_match_cb_data) {
+			.npc = npc[i],
+			.mbuf = nbuf[i],
+			.ifp = ifp,
+			.dir = dir,
+		};
+	}
+
+	if (unlikely(ruleset == NULL))
+		return;
+
+	left = num;
+	cds_list_for_each_entry_rcu(rg, &ruleset->rs_groups, rg_entry) {
+		enum npf_ruleset_type rs_type = rg->rg_ruleset->rs_type;
+
+		/* Match the direction. */
+		if ((rg->rg_dir & dir) == 0)
+			continue;
+
+		nsel[0] = nsel[1] = 0;
+
+		for (i = 0; i < num; i++) {
+			void *match_ctx;
+			int af, k;
+
+			if (rl[i])
+				continue;
+
+			if (likely(npf_iscached(npc[i], NPC_IP4))) {
+				af = AF_INET;
+				match_ctx = rg->match_ctx_v4;
+				k = 0;
+			} else if (npf_iscached(npc[i], NPC_IP6)) {
+				af = AF_INET6;
+				match_ctx = rg->match_ctx_v6;
+				k = 1;
+			} else {
+				af = 0;
+				match_ctx = NULL;
+				k = 0;
+			}
+
+			/* Match the address-family if set. */
+			if (rg->rg_af && rg->rg_af != af)
+				continue;
+
+			pd[i].rg = rg;
+
+			if (likely(match_ctx &&
+				   npf_iscached(npc[i], NPC_GROUPER))) {
+				sel[k][nsel[k]] = i;
+				sel_npc[k][nsel[k]] = npc[i];
+				sel_pd[k][nsel[k]] = &pd[i];
+				nsel[k]++;
+				continue;
+			}
+
+			/* Slow search, as in npf_ruleset_inspect() */
+			cds_list_for_each_entry_rcu(r, &rg->rg_rules, r_entry) {
+				if (npf_rule_match(npc[i], nbuf[i], ifp, dir,
+						   NULL, r)) {
+					rl[i] = r;
+					left--;
+					break;
+				}
+			}
+		}
+
+		for (j = 0; j < 2; j++) {
+			if (!nsel[j])
+				continue;
+
+			if (!npf_match_classify_burst(
+				    rs_type, j ? AF_INET6 : AF_INET,
+				    j ? rg->match_ctx_v6 : rg->match_ctx_v4,
+				    sel_npc[j], sel_pd[j], sel_rl, nsel[j]))
+				continue;
+
+			for (i = 0; i < nsel[j]; i++) {
+				if (sel_rl[i]) {
+					rl[sel[j][i]] = sel_rl[i];
+					left--;
+				}
+			}
+		}
+
+		if (!left)
+			break;
+	}
+}
+
 npf_decision_t
 npf_rule_decision(npf_rule_t *rl)
 {
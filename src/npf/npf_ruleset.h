@@ -157,6 +157,7 @@ int npf_make_rule(npf_rule_group_t *rg, uint32_t rule_no,
 void *npf_rule_rproc_handle_for_logger(npf_rule_t *rl);
 bool npf_rule_has_rproc_actions(npf_rule_t *rl);
 bool npf_rule_has_rproc_logger(npf_rule_t *rl);
+bool npf_rule_has_rproc_match(npf_rule_t *rl);
 bool npf_rproc_action(npf_cache_t *npc, struct rte_mbuf **nbuf,
 		      int dir, npf_rule_t *rl,
 		      npf_session_t *se, npf_rproc_result_t *result);
@@ -169,6 +170,12 @@ npf_rule_t *npf_ruleset_inspect(npf_cache_t *npc, struct rte_mbuf *nbuf,
 				const npf_ruleset_t *ruleset,
 				npf_session_t *se, const struct ifnet *ifp,
 				const int dir);
+/* Max packets npf_ruleset_inspect_burst() inspects in one pass */
+#define NPF_RULESET_BURST_MAX 32
+void npf_ruleset_inspect_burst(npf_cache_t *npc[], struct rte_mbuf *nbuf[],
+			       const npf_ruleset_t *ruleset,
+			       const struct ifnet *ifp, const int dir,
+			       npf_rule_t *rl[], uint32_t num);
 npf_decision_t npf_rule_decision(npf_rule_t *rl);
 npf_ruleset_t *npf_ruleset(const npf_rule_t *rl);
 void npf_ruleset_set_stateful(npf_rule_group_t *rg, bool value);
@@ -1955,8 +1955,8 @@ int npf_session_pack_state_update_gen(struct npf_session *se,
 
 	s = se->s_session;
 	if (s)
-		s->se_etime = get_dp_uptime() +
-				  session_get_npf_pack_timeout(s);
+		session_set_etime(s, get_dp_uptime() +
+				  session_get_npf_pack_timeout(s));
 
 	return 0;
 }
@@ -1986,8 +1986,8 @@ int npf_session_pack_state_update_tcp(struct npf_session *se,
 
 	s = se->s_session;
 	if (s)
-		s->se_etime = get_dp_uptime() +
-				  session_get_npf_pack_timeout(s);
+		session_set_etime(s, get_dp_uptime() +
+				  session_get_npf_pack_timeout(s));
 
 	return 0;
 }
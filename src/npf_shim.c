@@ -59,11 +59,13 @@ struct npf_config *npf_global_config __hot_data;
 
 /*
  * Optimized version of npf_hook_track() which does not do session tracking.
+ * Also returns the rule matched, if any, in *rlp.  No reference is taken
+ * on the rule, it is only valid until the next quiescent state.
  */
 npf_result_t
-npf_hook_notrack(const npf_ruleset_t *rlset, struct rte_mbuf **m,
-		 struct ifnet *ifp, int dir, uint16_t npf_flags,
-		 uint16_t eth_type, int *rcp)
+npf_hook_notrack_rule(const npf_ruleset_t *rlset, struct rte_mbuf **m,
+		      struct ifnet *ifp, int dir, uint16_t npf_flags,
+		      uint16_t eth_type, int *rcp, npf_rule_t **rlp)
 {
 	npf_cache_t npc, *n = NULL;
 	uint32_t tag_val = 0;
@@ -73,6 +75,7 @@ npf_hook_notrack(const npf_ruleset_t *rlset, struct rte_mbuf **m,
 		.decision = NPF_DECISION_UNMATCHED,
 	};
 
+	*rlp = NULL;
 	if (npf_ruleset_uses_cache(rlset)) {
 		int rc = 0;
 
@@ -105,6 +108,7 @@ npf_hook_notrack(const npf_ruleset_t *rlset, struct rte_mbuf **m,
 	}
 
 	rl = npf_ruleset_inspect(n, *m, rlset, NULL, ifp, dir);
+	*rlp = rl;
 
 	rproc_result.decision = npf_rule_decision(rl);
 
@@ -141,6 +145,17 @@ result:
 	};
 }
 
+npf_result_t
+npf_hook_notrack(const npf_ruleset_t *rlset, struct rte_mbuf **m,
+		 struct ifnet *ifp, int dir, uint16_t npf_flags,
+		 uint16_t eth_type, int *rcp)
+{
+	npf_rule_t *rl;
+
+	return npf_hook_notrack_rule(rlset, m, ifp, dir, npf_flags, eth_type,
+				     rcp, &rl);
+}
+
 /*
  * Search firewall ruleset and return a decision for this packet.
  */
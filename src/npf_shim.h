@@ -37,6 +37,11 @@ npf_result_t npf_hook_track(struct ifnet *in_ifp, struct rte_mbuf **m,
 npf_result_t npf_hook_notrack(const npf_ruleset_t *rlset, struct rte_mbuf **m,
 			      struct ifnet *ifp, int dir, uint16_t npf_flags,
 			      uint16_t eth_type, int *rcp);
+npf_result_t npf_hook_notrack_rule(const npf_ruleset_t *rlset,
+				   struct rte_mbuf **m, struct ifnet *ifp,
+				   int dir, uint16_t npf_flags,
+				   uint16_t eth_type, int *rcp,
+				   struct npf_rule **rlp);
 
 
 void npf_vrf_create(struct vrf *vrf);
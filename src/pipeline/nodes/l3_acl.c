@@ -77,18 +77,34 @@ ip_acl_process_common(struct pl_packet *pkt, bool v4, int dir)
 	/* As this sees fragments, it never shares with others */
 	npf_cache_t npc;
 	struct rte_mbuf *m = pkt->mbuf;
+	npf_rule_t *rl;
 
 	uint16_t const ethertype =
 		v4 ? htons(RTE_ETHER_TYPE_IPV4) : htons(RTE_ETHER_TYPE_IPV6);
 
+	/* Already inspected along with the rest of its burst? */
+	if (dir == PFIL_IN && pkt->acl_in_looked_up) {
+		pkt->acl_in_looked_up = 0;
+		rl = pkt->acl_in_rule;
+		decision = npf_rule_decision(rl);
+		if (likely(decision == NPF_DECISION_UNMATCHED))
+			goto accept;
+
+		/* The rprocs need the cache */
+		npf_cache_init(&npc);
+		rc = npf_cache_all(&npc, m, ethertype);
+		if (unlikely(rc < 0))
+			goto drop;
+		goto matched;
+	}
+
 	npf_cache_init(&npc);
 	rc = npf_cache_all(&npc, m, ethertype);
 	if (unlikely(rc < 0))
 		goto drop;
 
 	/* Run the ruleset, get the decision */
-	npf_rule_t *rl =
-		npf_ruleset_inspect(&npc, m, npf_ruleset, NULL, ifp, dir);
+	rl = npf_ruleset_inspect(&npc, m, npf_ruleset, NULL, ifp, dir);
 	decision = npf_rule_decision(rl);
 
 	/* Optimise for specific drops, and implicit accept */
@@ -104,6 +120,7 @@ accept:
 		return v4 ? IPV4_ACL_OUT_ACCEPT : IPV6_ACL_OUT_ACCEPT;
 	}
 
+matched:
 	/* Log any matched rule immediately */
 	if (unlikely(npf_rule_has_rproc_logger(rl)))
 		npf_log_pkt(&npc, m, rl, dir);
@@ -136,6 +153,78 @@ drop:
 	return v4 ? IPV4_ACL_OUT_DROP : IPV6_ACL_OUT_DROP;
 }
 
+/*
+ * Inspect the ingress ACL rulesets for a burst of packets before the
+ * validate node, and so the ingress ACL feature, is run on each of
+ * them.  Each run of packets from the same interface is inspected in
+ * one pass, so the match backend classifies the run together.  This
+ * relies on no earlier feature at the validate feature point changing
+ * the packet.  Packets that cannot be cached are left for the ACL
+ * node to inspect, and drop, on its own.
+ */
+static ALWAYS_INLINE void
+ip_acl_in_burst_prepare(struct pl_packet *pkts[], unsigned int nb, bool v4)
+{
+	npf_cache_t npcs[PL_BURST_MAX];
+	npf_cache_t *npc[PL_BURST_MAX];
+	struct rte_mbuf *m[PL_BURST_MAX];
+	npf_rule_t *rl[PL_BURST_MAX];
+	struct pl_packet *sel[PL_BURST_MAX];
+	const npf_ruleset_t *npf_ruleset = NULL;
+	struct ifnet *ifp = NULL;
+	unsigned int i, j, n = 0;
+
+	uint16_t const ethertype =
+		v4 ? htons(RTE_ETHER_TYPE_IPV4) : htons(RTE_ETHER_TYPE_IPV6);
+
+	for (i = 0; i <= nb; i++) {
+		if (i == nb || pkts[i]->in_ifp != ifp) {
+			if (n) {
+				npf_ruleset_inspect_burst(npc, m, npf_ruleset,
+							  ifp, PFIL_IN, rl, n);
+				for (j = 0; j < n; j++) {
+					sel[j]->acl_in_rule = rl[j];
+					sel[j]->acl_in_looked_up = 1;
+				}
+				n = 0;
+			}
+			if (i == nb)
+				break;
+
+			ifp = pkts[i]->in_ifp;
+			struct npf_config *nif_conf =
+				npf_if_conf(rcu_dereference(ifp->if_npf));
+			npf_ruleset = NULL;
+			if (npf_active(nif_conf, NPF_ACL_IN))
+				npf_ruleset = npf_get_ruleset(nif_conf,
+							      NPF_RS_ACL_IN);
+		}
+
+		if (!npf_ruleset)
+			continue;
+
+		npc[n] = &npcs[i];
+		npf_cache_init(npc[n]);
+		if (unlikely(npf_cache_all(npc[n], pkts[i]->mbuf,
+					   ethertype) < 0))
+			continue;
+		m[n] = pkts[i]->mbuf;
+		sel[n++] = pkts[i];
+	}
+}
+
+void
+ipv4_acl_in_burst_prepare(struct pl_packet *pkts[], unsigned int nb)
+{
+	ip_acl_in_burst_prepare(pkts, nb, V4_PKT);
+}
+
+void
+ipv6_acl_in_burst_prepare(struct pl_packet *pkts[], unsigned int nb)
+{
+	ip_acl_in_burst_prepare(pkts, nb, V6_PKT);
+}
+
 ALWAYS_INLINE unsigned int
 ipv4_acl_process_in(struct pl_packet *pkt, void *context __unused)
 {
@@ -57,9 +57,13 @@ _ipv4_route_lookup_process_common(struct pl_packet *pkt, void *context __unused,
 				  enum ipv4_route_lookup_mode lkup_mode)
 {
 	struct ifnet *ifp = pkt->in_ifp;
+	bool looked_up = pkt->nxt_looked_up;
+	struct next_hop *nxt;
 	struct vrf *vrf;
 	struct iphdr *ip = pkt->l3_hdr;
 
+	pkt->nxt_looked_up = 0;
+
 	/* Is it a broadcast? */
 	if (unlikely(pkt->l2_pkt_type == L2_PKT_BROADCAST)) {
 		if (IN_LBCAST(ntohl(ip->daddr)) ||
@@ -79,8 +83,10 @@ _ipv4_route_lookup_process_common(struct pl_packet *pkt, void *context __unused,
 	}
 
 	vrf = vrf_get_rcu_fast(pktmbuf_get_vrf(pkt->mbuf));
-	struct next_hop *nxt = rt_lookup_fast(vrf, ip->daddr,
-					      pkt->tblid, pkt->mbuf);
+	if (looked_up)
+		nxt = pkt->nxt.v4;
+	else
+		nxt = rt_lookup_fast(vrf, ip->daddr, pkt->tblid, pkt->mbuf);
 
 	pkt->nxt.v4 = nxt;
 
@@ -169,6 +175,74 @@ ipv4_route_lookup_host_process(struct pl_packet *pkt, void *context)
 						 IPV4_LKUP_MODE_HOST);
 }
 
+/*
+ * When walking the graph a burst at a time, look up the routes for the
+ * whole burst with the table fetches overlapped, and hand each
+ * packet's result on to the handler.  Consecutive packets for the same
+ * table are looked up together.
+ */
+static void
+ipv4_route_lookup_bulk(struct vrf *vrf, uint32_t tblid,
+		       struct pl_packet *pkts[], unsigned int n)
+{
+	in_addr_t dsts[PL_BURST_MAX];
+	struct rte_mbuf *ms[PL_BURST_MAX];
+	struct next_hop *nhs[PL_BURST_MAX];
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		struct iphdr *ip = pkts[i]->l3_hdr;
+
+		dsts[i] = ip->daddr;
+		ms[i] = pkts[i]->mbuf;
+	}
+
+	rt_lookup_bulk_fast(vrf, dsts, tblid, ms, nhs, n);
+
+	for (i = 0; i < n; i++) {
+		pkts[i]->nxt.v4 = nhs[i];
+		pkts[i]->nxt_looked_up = 1;
+	}
+}
+
+/*
+ * Broadcast and multicast packets are dealt with by the handler
+ * without a route lookup, so are left out.
+ */
+void
+ipv4_route_lookup_burst_prepare(struct pl_packet *burst[], unsigned int n)
+{
+	struct pl_packet *pkts[PL_BURST_MAX];
+	struct vrf *vrf = NULL;
+	uint32_t tblid = 0;
+	unsigned int i, nb = 0, first = 0;
+
+	for (i = 0; i < n; i++) {
+		struct iphdr *ip = burst[i]->l3_hdr;
+
+		if (unlikely(burst[i]->l2_pkt_type == L2_PKT_BROADCAST ||
+			     IN_MULTICAST(ntohl(ip->daddr))))
+			continue;
+		pkts[nb++] = burst[i];
+	}
+
+	for (i = 0; i < nb; i++) {
+		struct vrf *pkt_vrf = vrf_get_rcu_fast(
+			pktmbuf_get_vrf(pkts[i]->mbuf));
+
+		if (i > first && (pkt_vrf != vrf || pkts[i]->tblid != tblid)) {
+			ipv4_route_lookup_bulk(vrf, tblid, &pkts[first],
+					       i - first);
+			first = i;
+		}
+		vrf = pkt_vrf;
+		tblid = pkts[i]->tblid;
+	}
+
+	if (nb > first)
+		ipv4_route_lookup_bulk(vrf, tblid, &pkts[first], nb - first);
+}
+
 static int
 ipv4_route_lookup_feat_change(struct pl_node *node,
 				   struct pl_feature_registration *feat,
@@ -199,6 +273,7 @@ PL_REGISTER_NODE(ipv4_route_lookup_node) = {
 	.name = "vyatta:ipv4-route-lookup",
 	.type = PL_PROC,
 	.handler = ipv4_route_lookup_process,
+	.burst_prepare = ipv4_route_lookup_burst_prepare,
 	.feat_change = ipv4_route_lookup_feat_change,
 	.feat_iterate = ipv4_route_lookup_feat_iterate,
 	.num_next = IPV4_ROUTE_LOOKUP_NUM,
@@ -143,6 +143,7 @@ PL_REGISTER_NODE(ipv4_validate_node) = {
 	.name = "vyatta:ipv4-validate",
 	.type = PL_PROC,
 	.handler = ipv4_validate_process,
+	.burst_prepare = ipv4_acl_in_burst_prepare,
 	.feat_change = ipv4_validate_feat_change,
 	.feat_change_all = ipv4_validate_feat_change_all,
 	.feat_iterate = ipv4_validate_feat_iterate,
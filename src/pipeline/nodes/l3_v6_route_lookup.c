@@ -57,9 +57,12 @@ _ipv6_route_lookup_process_common(struct pl_packet *pkt, void *context __unused,
 {
 	struct ip6_hdr *ip6 = pkt->l3_hdr;
 	struct ifnet *ifp = pkt->in_ifp;
+	bool looked_up = pkt->nxt_looked_up;
 	struct next_hop *nxt;
 	struct vrf *vrf;
 
+	pkt->nxt_looked_up = 0;
+
 	if (unlikely(ip6->ip6_nxt == IPPROTO_HOPOPTS)) {
 		uint32_t rtalert = ~0u;
 
@@ -71,7 +74,11 @@ _ipv6_route_lookup_process_common(struct pl_packet *pkt, void *context __unused,
 	}
 
 	vrf = vrf_get_rcu_fast(pktmbuf_get_vrf(pkt->mbuf));
-	nxt = rt6_lookup_fast(vrf, &ip6->ip6_dst, pkt->tblid, pkt->mbuf);
+	if (looked_up)
+		nxt = pkt->nxt.v6;
+	else
+		nxt = rt6_lookup_fast(vrf, &ip6->ip6_dst, pkt->tblid,
+				      pkt->mbuf);
 
 	pkt->nxt.v6 = nxt;
 
@@ -162,6 +169,60 @@ ipv6_route_lookup_host_process(struct pl_packet *pkt, void *context)
 						 IPV6_LKUP_MODE_HOST);
 }
 
+/*
+ * When walking the graph a burst at a time, look up the routes for the
+ * whole burst with the levels of the table walks interleaved, and
+ * hand each packet's result on to the handler.  Consecutive packets
+ * for the same table are looked up together.
+ */
+static void
+ipv6_route_lookup_bulk(struct vrf *vrf, uint32_t tblid,
+		       struct pl_packet *pkts[], unsigned int n)
+{
+	const struct in6_addr *dsts[PL_BURST_MAX];
+	struct rte_mbuf *ms[PL_BURST_MAX];
+	struct next_hop *nhs[PL_BURST_MAX];
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		struct ip6_hdr *ip6 = pkts[i]->l3_hdr;
+
+		dsts[i] = &ip6->ip6_dst;
+		ms[i] = pkts[i]->mbuf;
+	}
+
+	rt6_lookup_bulk_fast(vrf, dsts, tblid, ms, nhs, n);
+
+	for (i = 0; i < n; i++) {
+		pkts[i]->nxt.v6 = nhs[i];
+		pkts[i]->nxt_looked_up = 1;
+	}
+}
+
+void
+ipv6_route_lookup_burst_prepare(struct pl_packet *pkts[], unsigned int nb)
+{
+	struct vrf *vrf = NULL;
+	uint32_t tblid = 0;
+	unsigned int i, first = 0;
+
+	for (i = 0; i < nb; i++) {
+		struct vrf *pkt_vrf = vrf_get_rcu_fast(
+			pktmbuf_get_vrf(pkts[i]->mbuf));
+
+		if (i > first && (pkt_vrf != vrf || pkts[i]->tblid != tblid)) {
+			ipv6_route_lookup_bulk(vrf, tblid, &pkts[first],
+					       i - first);
+			first = i;
+		}
+		vrf = pkt_vrf;
+		tblid = pkts[i]->tblid;
+	}
+
+	if (nb > first)
+		ipv6_route_lookup_bulk(vrf, tblid, &pkts[first], nb - first);
+}
+
 static int
 ipv6_route_lookup_feat_change(struct pl_node *node,
 			      struct pl_feature_registration *feat,
@@ -193,6 +254,7 @@ PL_REGISTER_NODE(ipv6_route_lookup_node) = {
 	.name = "vyatta:ipv6-route-lookup",
 	.type = PL_PROC,
 	.handler = ipv6_route_lookup_process,
+	.burst_prepare = ipv6_route_lookup_burst_prepare,
 	.feat_change = ipv6_route_lookup_feat_change,
 	.feat_iterate = ipv6_route_lookup_feat_iterate,
 	.num_next = IPV6_ROUTE_LOOKUP_NUM,
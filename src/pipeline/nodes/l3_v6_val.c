@@ -142,6 +142,7 @@ PL_REGISTER_NODE(ipv6_validate_node) = {
 	.name = "vyatta:ipv6-validate",
 	.type = PL_PROC,
 	.handler = ipv6_validate_process,
+	.burst_prepare = ipv6_acl_in_burst_prepare,
 	.feat_change = ipv6_validate_feat_change,
 	.feat_change_all = ipv6_validate_feat_change_all,
 	.feat_iterate = ipv6_validate_feat_iterate,
@@ -28,6 +28,8 @@ struct pl_node_registration;
 
 #define PL_NODE_INPUT_MAX 16
 #define PL_NODE_COLL_MAX 128
+/* Maximum number of packets walked through a burst entry point */
+#define PL_BURST_MAX 32
 
 enum pl_mode {
 	/*
@@ -65,6 +67,14 @@ enum pl_node_feat_action {
 typedef void
 (pl_init_node) (const struct pl_node *);
 
+/*
+ * Optional per-node callback invoked with a whole burst before the
+ * node's handler is run on each packet, when the graph is walked a
+ * burst at a time.
+ */
+typedef void
+(pl_burst_prepare) (struct pl_packet *pkts[], unsigned int nb);
+
 /* command structure */
 struct pl_command {
 	/* input */
@@ -145,6 +155,7 @@ struct pl_node_registration {
 	pl_node_unregister_context *feat_unreg_context;
 	pl_node_get_context *feat_get_context;
 	pl_node_setup_cleanup_cb *feat_setup_cleanup_cb;
+	pl_burst_prepare  *burst_prepare;
 	enum pl_node_type  type;
 	uint16_t           num_next;
 
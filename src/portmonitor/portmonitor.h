@@ -28,6 +28,8 @@
 #define ERSPAN_ORIG_FRAME_OVERSIZED		0x02
 #define ERSPAN_ORIG_FRAME_CRC_OR_ALIGN_ERR	0x03
 
+#define ERSPAN_ORIG_FRAME_TRUNCATED		(1 << 10)
+
 #define ERSPAN_ORIG_FRAME_TYPE_ETH		0x0
 #define ERSPAN_ORIG_FRAME_TYPE_IP		0x02
 
@@ -132,6 +134,7 @@ struct portmonitor_session {
 	uint16_t		erspan_id;		/* erspan id */
 	uint8_t			erspan_hdr_type;	/* erspan hdr type */
 	uint16_t		gre_proto;		/* GRE protocol */
+	uint16_t		snaplen;		/* mirror len, 0 = all */
 	struct ifnet		*dest_ifp;		/* destination ifp */
 	char			dest_ifname[IFNAMSIZ];	/* destination ifname */
 	zlist_t			*filter_list;		/* in and out filters */
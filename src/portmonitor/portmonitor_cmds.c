@@ -12,6 +12,7 @@
 #include <errno.h>
 #include <linux/if.h>
 #include <rte_config.h>
+#include <rte_ether.h>
 #include <rte_log.h>
 #include <rte_malloc.h>
 #include <stdbool.h>
@@ -866,6 +867,8 @@ static void show_one_session(struct portmonitor_session *s, json_writer_t *wr)
 		jsonw_int_field(wr, "erspanhdr", ERSPAN_TYPE_II);
 	else if (s->erspan_hdr_type == ERSPAN_TYPE_III)
 		jsonw_int_field(wr, "erspanhdr", ERSPAN_TYPE_III);
+	if (s->snaplen)
+		jsonw_uint_field(wr, "snaplen", s->snaplen);
 	jsonw_name(wr, "source_interfaces");
 	jsonw_start_array(wr);
 	cds_list_for_each_entry_rcu(pmsrcif, &pmsrcif_list, srcif_list) {
@@ -1125,6 +1128,7 @@ int cmd_portmonitor(FILE *f, int argc, char **argv)
 	uint32_t direction;
 	uint32_t erspan_id;
 	uint32_t erspan_hdr_type;
+	uint32_t snaplen;
 	struct portmonitor_session *pmsess;
 	int rc;
 	unsigned int num;
@@ -1203,6 +1207,8 @@ int cmd_portmonitor(FILE *f, int argc, char **argv)
 					"PM : Set session state failed(%d)\n",
 					rc);
 
+			} else if (strcmp(argv[4], "snaplen") == 0) {
+				pmsess->snaplen = 0;
 			} else if (strcmp(argv[4], "filter-in") == 0) {
 				if (portmonitor_session_config_filter(
 					pmsess, argv[5], PORTMONITOR_IN_FILTER,
@@ -1378,6 +1384,14 @@ int cmd_portmonitor(FILE *f, int argc, char **argv)
 			}
 			portmonitor_session_set_erspan_hdr_type(pmsess,
 								erspan_hdr_type);
+		} else if (strcmp(argv[4], "snaplen") == 0) {
+			if (!get_value(argv[5], &snaplen) ||
+			    snaplen < RTE_ETHER_HDR_LEN || snaplen > UINT16_MAX) {
+				fprintf(f, "Invalid snap length %s\n",
+						argv[5]);
+				return -1;
+			}
+			pmsess->snaplen = snaplen;
 		} else if (strcmp(argv[4], "disable") == 0) {
 			pmsess->disabled = true;
 			struct fal_attribute_t attr[] = {
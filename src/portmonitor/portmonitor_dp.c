@@ -13,6 +13,7 @@
 #include <rte_branch_prediction.h>
 #include <rte_ether.h>
 #include <rte_mbuf.h>
+#include <rte_memcpy.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
@@ -124,14 +125,29 @@ drop:
 	return 1;
 }
 
+/*
+ * Number of packets mirrored at a time, bounding the per burst state
+ * kept on the stack.
+ */
+#define PORTMONITOR_BURST		32U
+
+/*
+ * Bytes copied into the head segment of a mirrored packet whose payload
+ * is cloned: enough that the headers of the original are private to the
+ * mirror, and that encapsulation headers are prepended in its own
+ * headroom rather than in the buffer shared with the original.
+ */
+#define PORTMONITOR_HDR_COPY_LEN	128
+
 static int portmonitor_encap_erspan_hdr(struct ifnet *ifp,
 					struct portmonitor_session *pmsess,
-					struct rte_mbuf *m, uint8_t direction)
+					struct rte_mbuf *m, uint8_t direction,
+					const struct timespec *ts,
+					uint32_t frame_size, bool truncated)
 {
 	struct erspan_v2_hdr *v2_hdr;
 	struct erspan_v3_hdr *v3_hdr;
-	struct timespec ts;
-	uint16_t frame_size;
+	uint16_t t_bit = truncated ? ERSPAN_ORIG_FRAME_TRUNCATED : 0;
 	bool has_vlan = false;
 	uint16_t en;
 
@@ -161,12 +177,10 @@ static int portmonitor_encap_erspan_hdr(struct ifnet *ifp,
 			en = ERSPAN_ORIG_FRAME_NO_VLAN;
 		}
 		v2_hdr->cos_en_t_id = htons((pktmbuf_get_vlan_pcp(m) << 13) |
-					    (en << 11) | pmsess->erspan_id);
+					    (en << 11) | t_bit |
+					    pmsess->erspan_id);
 		v2_hdr->index = htonl((ifp->if_port << 4) | direction);
 	} else if (pmsess->erspan_hdr_type == ERSPAN_TYPE_III) {
-		if (clock_gettime(CLOCK_REALTIME, &ts))
-			return 0;
-
 		v3_hdr = (struct erspan_v3_hdr *)
 			rte_pktmbuf_prepend(m, sizeof(struct erspan_v3_hdr));
 		if (v3_hdr == NULL)
@@ -183,45 +197,225 @@ static int portmonitor_encap_erspan_hdr(struct ifnet *ifp,
 				      pktmbuf_get_txvlanid(m));
 			pktmbuf_clear_tx_vlan(m);
 		}
-		frame_size = rte_pktmbuf_pkt_len(m);
+		/* Classify the frame as it was, not as it was truncated */
 		if (frame_size < RTE_ETHER_MIN_LEN) {
 			v3_hdr->cos_bso_t_id =
 				htons((pktmbuf_get_vlan_pcp(m) << 13) |
 				      (ERSPAN_ORIG_FRAME_SHORT << 11) |
-				      pmsess->erspan_id);
+				      t_bit | pmsess->erspan_id);
 		} else if (frame_size > RTE_ETHER_MAX_LEN) {
 			v3_hdr->cos_bso_t_id =
 				htons((pktmbuf_get_vlan_pcp(m) << 13) |
 				      (ERSPAN_ORIG_FRAME_OVERSIZED << 11) |
-				      pmsess->erspan_id);
+				      t_bit | pmsess->erspan_id);
 		} else {
 			v3_hdr->cos_bso_t_id =
 				htons((pktmbuf_get_vlan_pcp(m) << 13) |
-				      pmsess->erspan_id);
+				      t_bit | pmsess->erspan_id);
 		}
 		v3_hdr->p_ft_hwid_d_gra_o = htons((1 << 15) |
 						(ERSPAN_HARDWARE_ID << 4) |
 						(direction << 3) |
 						(ERSPAN_TIMESTAMP_GRA_IEEE_1588 << 1) | 1);
-		v3_hdr->timestamp = htonl(ts.tv_nsec);
-		v3_hdr->subhdr3.timestamp = htonl(ts.tv_sec);
+		v3_hdr->timestamp = htonl(ts->tv_nsec);
+		v3_hdr->subhdr3.timestamp = htonl(ts->tv_sec);
 		v3_hdr->subhdr3.platid_portid = htonl((ERSPAN_SUBHDR_PLATFORM_ID << 26) |
 						ifp->if_port);
 	}
 	return 1;
 }
 
+/* Cut a packet chain down to its first len bytes */
+static void portmonitor_mirror_trim(struct rte_mbuf *m, uint32_t len)
+{
+	struct rte_mbuf *seg = m;
+	uint32_t left = len;
+	uint16_t nb_segs = 1;
+
+	while (seg->data_len < left) {
+		left -= seg->data_len;
+		seg = seg->next;
+		nb_segs++;
+	}
+	seg->data_len = left;
+	if (seg->next) {
+		rte_pktmbuf_free(seg->next);
+		seg->next = NULL;
+	}
+	m->nb_segs = nb_segs;
+	m->pkt_len = len;
+}
+
+/*
+ * Build the mirror of the first len bytes of a packet.
+ *
+ * The head of the packet is always copied into a new mbuf, so whatever
+ * is prepended to the mirror lands in a segment it owns.  Transmitted
+ * packets are no longer modified in place, and anything that does so
+ * (such as software VLAN insertion) copes with shared mbufs, so the
+ * remainder of one of those is attached as a clone.  A received packet
+ * is still to be forwarded, and may be rewritten anywhere on the way,
+ * so it is copied, though never past len.
+ */
+static struct rte_mbuf *
+portmonitor_mirror_pkt(struct rte_mbuf *m, uint32_t len, uint8_t direction)
+{
+	uint32_t hlen = RTE_MIN(len, (uint32_t)PORTMONITOR_HDR_COPY_LEN);
+	struct rte_mbuf *mirror_pkt, *tail;
+	const void *data;
+	void *dst;
+
+	mirror_pkt = pktmbuf_alloc(m->pool, pktmbuf_get_vrf(m));
+	if (unlikely(!mirror_pkt))
+		return NULL;
+
+	if (direction == PORTMONITOR_DIRECTION_TX && len > hlen &&
+	    rte_pktmbuf_is_contiguous(m)) {
+		tail = pktmbuf_clone(m, m->pool);
+		if (unlikely(!tail))
+			goto fail;
+
+		rte_pktmbuf_adj(tail, hlen);
+		tail->data_len = len - hlen;
+		tail->pkt_len = len - hlen;
+	} else if (len <= rte_pktmbuf_tailroom(mirror_pkt)) {
+		hlen = len;
+		tail = NULL;
+	} else {
+		/* Too big for one segment, so copy it all and cut it down */
+		rte_pktmbuf_free(mirror_pkt);
+		mirror_pkt = pktmbuf_copy(m, m->pool);
+		if (unlikely(!mirror_pkt))
+			return NULL;
+		if (len < rte_pktmbuf_pkt_len(m))
+			portmonitor_mirror_trim(mirror_pkt, len);
+		return mirror_pkt;
+	}
+
+	pktmbuf_copy_meta(mirror_pkt, m);
+	dst = rte_pktmbuf_mtod(mirror_pkt, void *);
+	data = rte_pktmbuf_read(m, 0, hlen, dst);
+	if (data != dst)
+		rte_memcpy(dst, data, hlen);
+	mirror_pkt->data_len = hlen;
+	mirror_pkt->pkt_len = hlen;
+
+	if (tail && unlikely(rte_pktmbuf_chain(mirror_pkt, tail) != 0)) {
+		rte_pktmbuf_free(tail);
+		goto fail;
+	}
+	return mirror_pkt;
+
+fail:
+	rte_pktmbuf_free(mirror_pkt);
+	return NULL;
+}
+
+/*
+ * Mirror a burst of at most PORTMONITOR_BURST packets: run the filter
+ * over all of them first, then build, capture and send the mirrors of
+ * those that pass.
+ */
+static void
+portmonitor_mirror_burst(struct ifnet *ifp, struct portmonitor_session *pmsess,
+			 struct ifnet *dest_ifp, const npf_ruleset_t *rlset,
+			 int filter_dir, struct rte_mbuf *mbi[],
+			 unsigned int n, uint8_t direction,
+			 const struct timespec *ts)
+{
+	struct rte_mbuf *mirror[PORTMONITOR_BURST];
+	struct ifnet *mirror_ifp[PORTMONITOR_BURST];
+	uint32_t frame_size[PORTMONITOR_BURST];
+	bool truncated[PORTMONITOR_BURST];
+	unsigned int i, nb = 0;
+	npf_result_t result;
+	uint32_t len;
+
+	for (i = 0; i < n; i++)
+		dp_pktmbuf_l2_len(mbi[i]) = RTE_ETHER_HDR_LEN;
+
+	for (i = 0; i < n; i++) {
+		struct rte_mbuf *m;
+
+		if (rlset) {
+			result = npf_hook_notrack(rlset, &mbi[i], ifp,
+						  filter_dir, 0,
+						  htons(RTE_ETHER_TYPE_IPV4),
+						  NULL);
+			if (result.decision != NPF_DECISION_PASS)
+				continue;
+		}
+
+		m = mbi[i];
+		frame_size[nb] = rte_pktmbuf_pkt_len(m);
+		len = frame_size[nb];
+		if (pmsess->snaplen && pmsess->snaplen < len)
+			len = pmsess->snaplen;
+		truncated[nb] = len < frame_size[nb];
+
+		mirror[nb] = portmonitor_mirror_pkt(m, len, direction);
+		if (!mirror[nb])
+			continue;
+
+		mirror_ifp[nb] = ifp;
+		if ((m->ol_flags & PKT_RX_VLAN) && ifp->qinq_inner) {
+			if (unlikely(vid_encap(ifp->if_vlan, &mirror[nb],
+					RTE_ETHER_TYPE_VLAN) == NULL)) {
+				rte_pktmbuf_free(mirror[nb]);
+				continue;
+			}
+			mirror_ifp[nb] = ifp->if_parent;
+		}
+		nb++;
+	}
+
+	switch (pmsess->session_type) {
+	case PORTMONITOR_SPAN:
+	case PORTMONITOR_RSPAN_SOURCE:
+		for (i = 0; i < nb; i++) {
+			if (pmsess->session_type == PORTMONITOR_SPAN &&
+			    (mirror[i]->ol_flags & PKT_RX_VLAN))
+				pktmbuf_convert_rx_to_tx_vlan(mirror[i]);
+			if_output(dest_ifp, mirror[i], mirror_ifp[i],
+				  ETH_P_TEB);
+		}
+		break;
+	case PORTMONITOR_ERSPAN_SOURCE:
+		/* capture mirrored packets on erspan tunnel */
+		if (unlikely(dest_ifp->capturing) && nb)
+			capture_burst(dest_ifp, mirror, nb);
+		for (i = 0; i < nb; i++) {
+			if (!portmonitor_encap_erspan_hdr(
+				    mirror_ifp[i], pmsess, mirror[i],
+				    direction, ts, frame_size[i],
+				    truncated[i])) {
+				rte_pktmbuf_free(mirror[i]);
+				continue;
+			}
+			if_output(dest_ifp, mirror[i], mirror_ifp[i],
+				  pmsess->gre_proto);
+		}
+		break;
+	default:
+		for (i = 0; i < nb; i++)
+			rte_pktmbuf_free(mirror[i]);
+		break;
+	}
+}
+
 static void portmonitor_source_output(struct ifnet *ifp,
 					const struct portmonitor_info *pminfo,
-					struct rte_mbuf **m, uint8_t direction)
+					struct rte_mbuf *mbi[], unsigned int n,
+					uint8_t direction)
 {
+	const npf_ruleset_t *rlset = NULL;
 	enum npf_ruleset_type ruleset_type;
 	bool filter_active = false;
 	int filter_dir;
-	npf_result_t result;
-	struct rte_mbuf *mirror_pkt;
+	struct timespec ts = { 0 };
 	struct ifnet *dest_ifp;
 	struct portmonitor_session *pmsess;
+	unsigned int i;
 
 	if (!pminfo || pminfo->hw_mirroring)
 		return;
@@ -234,8 +428,6 @@ static void portmonitor_source_output(struct ifnet *ifp,
 	if (!dest_ifp)
 		return;
 
-	dp_pktmbuf_l2_len(*m) = RTE_ETHER_HDR_LEN;
-
 	struct npf_if *nif = rcu_dereference(ifp->if_npf);
 	if (direction == PORTMONITOR_DIRECTION_RX) {
 		filter_active = npf_if_active(nif, NPF_PORTMONITOR_IN);
@@ -248,50 +440,21 @@ static void portmonitor_source_output(struct ifnet *ifp,
 	}
 	if (filter_active) {
 		struct npf_config *npf_config = npf_if_conf(nif);
-		result = npf_hook_notrack(
-				npf_get_ruleset(npf_config, ruleset_type),
-				m, ifp, filter_dir, 0,
-				htons(RTE_ETHER_TYPE_IPV4), NULL);
-		if (result.decision != NPF_DECISION_PASS)
-			return;
+
+		rlset = npf_get_ruleset(npf_config, ruleset_type);
 	}
 
-	mirror_pkt = pktmbuf_copy(*m, (*m)->pool);
-	if (!mirror_pkt)
+	/* One timestamp serves the whole burst */
+	if (pmsess->session_type == PORTMONITOR_ERSPAN_SOURCE &&
+	    pmsess->erspan_hdr_type == ERSPAN_TYPE_III &&
+	    clock_gettime(CLOCK_REALTIME, &ts))
 		return;
 
-	if (((*m)->ol_flags & PKT_RX_VLAN) && ifp->qinq_inner) {
-		if (unlikely(vid_encap(ifp->if_vlan, &mirror_pkt,
-				RTE_ETHER_TYPE_VLAN) == NULL)) {
-			rte_pktmbuf_free(mirror_pkt);
-			return;
-		}
-		ifp = ifp->if_parent;
-	}
-
-	switch (pmsess->session_type) {
-	case PORTMONITOR_SPAN:
-		if ((*m)->ol_flags & PKT_RX_VLAN)
-			pktmbuf_convert_rx_to_tx_vlan(mirror_pkt);
-		/* fall through */
-	case PORTMONITOR_RSPAN_SOURCE:
-		if_output(dest_ifp, mirror_pkt, ifp, ETH_P_TEB);
-		break;
-	case PORTMONITOR_ERSPAN_SOURCE:
-		/* capture mirrored packet on erspan tunnel */
-		if (unlikely(dest_ifp->capturing))
-			capture_burst(dest_ifp, &mirror_pkt, 1);
-		if (!portmonitor_encap_erspan_hdr(ifp, pmsess, mirror_pkt,
-							direction)) {
-			rte_pktmbuf_free(mirror_pkt);
-			return;
-		}
-		if_output(dest_ifp, mirror_pkt, ifp, pmsess->gre_proto);
-		break;
-	default:
-		rte_pktmbuf_free(mirror_pkt);
-		break;
-	}
+	for (i = 0; i < n; i += PORTMONITOR_BURST)
+		portmonitor_mirror_burst(ifp, pmsess, dest_ifp, rlset,
+					 filter_dir, &mbi[i],
+					 RTE_MIN(n - i, PORTMONITOR_BURST),
+					 direction, &ts);
 }
 
 void portmonitor_src_vif_rx_output(struct ifnet *ifp, struct rte_mbuf **m)
@@ -309,7 +472,7 @@ void portmonitor_src_vif_rx_output(struct ifnet *ifp, struct rte_mbuf **m)
 		pminfo->pm_iftype != PM_SRC_SESSION_SRC_IF)
 		return;
 
-	portmonitor_source_output(ifp, pminfo, m, PORTMONITOR_DIRECTION_RX);
+	portmonitor_source_output(ifp, pminfo, m, 1, PORTMONITOR_DIRECTION_RX);
 }
 
 void portmonitor_src_vif_tx_output(struct ifnet *ifp, struct rte_mbuf **m)
@@ -327,14 +490,13 @@ void portmonitor_src_vif_tx_output(struct ifnet *ifp, struct rte_mbuf **m)
 		pminfo->pm_iftype != PM_SRC_SESSION_SRC_IF)
 		return;
 
-	portmonitor_source_output(ifp, pminfo, m, PORTMONITOR_DIRECTION_TX);
+	portmonitor_source_output(ifp, pminfo, m, 1, PORTMONITOR_DIRECTION_TX);
 }
 
 void portmonitor_src_phy_rx_output(struct ifnet *ifp, struct rte_mbuf *mbi[],
 					unsigned int n)
 {
 	struct portmonitor_info *pminfo;
-	unsigned int i;
 
 	pminfo = rcu_dereference(ifp->pminfo);
 	if (!pminfo)
@@ -344,16 +506,14 @@ void portmonitor_src_phy_rx_output(struct ifnet *ifp, struct rte_mbuf *mbi[],
 		pminfo->pm_iftype != PM_SRC_SESSION_SRC_IF)
 		return;
 
-	for (i = 0; i < n; i++)
-		portmonitor_source_output(ifp, pminfo, &(mbi[i]),
-						PORTMONITOR_DIRECTION_RX);
+	portmonitor_source_output(ifp, pminfo, mbi, n,
+				  PORTMONITOR_DIRECTION_RX);
 }
 
 void portmonitor_src_phy_tx_output(struct ifnet *ifp, struct rte_mbuf *mbi[],
 					unsigned int n)
 {
 	struct portmonitor_info *pminfo;
-	unsigned int i;
 
 	if (ifp->if_type == IFT_L2VLAN)
 		return;
@@ -366,9 +526,8 @@ void portmonitor_src_phy_tx_output(struct ifnet *ifp, struct rte_mbuf *mbi[],
 		pminfo->pm_iftype != PM_SRC_SESSION_SRC_IF)
 		return;
 
-	for (i = 0; i < n; i++)
-		portmonitor_source_output(ifp, pminfo, &(mbi[i]),
-						PORTMONITOR_DIRECTION_TX);
+	portmonitor_source_output(ifp, pminfo, mbi, n,
+				  PORTMONITOR_DIRECTION_TX);
 }
 
 /* Forward packet to SPAN port.
@@ -10,13 +10,18 @@
 #define QOS_H
 
 
+#include <rte_atomic.h>
 #include <rte_sched.h>
+#include <rte_spinlock.h>
+#include <rte_timer.h>
 
 #include "if_var.h"
 #include "npf/npf_ruleset.h"
+#include "pktmbuf_internal.h"
 #include "fal_plugin.h"
 #include "json_writer.h"
 
+struct flow_cache;
 struct rte_sched_port;
 
 #define DEFAULT_QSIZE	64	/* 64 packets */
@@ -26,6 +31,12 @@ struct rte_sched_port;
 #define DEFAULT_Q	3	/* class 3: queue 0 */
 #define MAX_PIPES       256
 
+/*
+ * Maximum scheduler shards per port.  Each shard has its own transmit
+ * ring, so this is bounded by MAX_TX_QUEUE_PER_PORT.
+ */
+#define QOS_MAX_SHARDS	4
+
 #define MAX_RED_QUEUE_LENGTH 8192   /* 8192 packets */
 
 #define	QOS_DPDK_ID	0
@@ -269,6 +280,39 @@ struct qos_port_params {
 	uint16_t	qsize[RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE];
 };
 
+/*
+ * Port-level token bucket shared by the shards of a scaled-out
+ * scheduler, so their combined output stays within the port rate.
+ * Shards take credits in chunks, and refills are done by whichever
+ * shard gets the lock.
+ */
+struct qos_shared_tb {
+	rte_atomic64_t	tb_credits;	/* bytes */
+	int64_t		tb_size;	/* bucket depth in bytes */
+	uint64_t	tb_rate;	/* bytes/sec */
+	uint64_t	tb_time;	/* tsc of the last refill */
+	rte_spinlock_t	tb_lock;	/* serialises refills */
+} __rte_cache_aligned;
+
+/* One scheduler of a scaled-out port, only used by its transmit lcore */
+struct qos_dpdk_shard {
+	struct rte_sched_port *port;
+	int64_t credits;		/* taken from the shared bucket */
+} __rte_cache_aligned;
+
+/*
+ * Scaled-out scheduling.  Subports, with all their pipes, are
+ * partitioned across the shards, each dequeued from its own transmit
+ * ring by its own lcore.  Each shard is configured with every subport,
+ * but only the subports it owns get full-size queues.
+ */
+struct qos_dpdk_shards {
+	unsigned int		n_shards;
+	int32_t			frame_overhead;
+	struct qos_shared_tb	tb;
+	struct qos_dpdk_shard	shard[QOS_MAX_SHARDS];
+};
+
 /* Qos Scheduler handles (one per physical port) */
 struct sched_info {
 	int dev_id;			/* Device ID - DPDK or FAL */
@@ -282,6 +326,7 @@ struct sched_info {
 			uint32_t hw_port_id;              /* FAL id */
 		} fal;
 	} dev_info;
+	struct qos_dpdk_shards *shards;	/* DPDK scale-out, or NULL */
 	struct subport_info *subport;	/* Subport's */
 	struct qos_port_params port_params;
 	struct qos_rate_info *profile_rates;
@@ -294,12 +339,17 @@ struct sched_info {
 	/* subports and pipes as configured, actual size is in port_params */
 	uint32_t n_subports;		/* Original values */
 	uint32_t n_pipes;
+	uint32_t n_shards;		/* Scheduler shards requested */
 
 	uint16_t vlan_map[VLAN_N_VID];	/* Vlan vid to sub-port policy */
 	struct queue_map *queue_map;
 	struct queue_stats *queue_stats;
 	rte_spinlock_t stats_lock;      /* To control access to queue-stats */
 	SLIST_ENTRY(sched_info) list;
+
+	/* Per-flow class cache, DPDK only */
+	struct flow_cache *class_cache;
+	struct rte_timer class_cache_timer;
 };
 
 struct mark_reqs {
@@ -387,6 +437,35 @@ static inline struct sched_info *qos_handle(const struct ifnet *ifp)
 	return rcu_dereference(ifp->if_qos);
 }
 
+/* Number of scheduler shards, and so transmit rings, QoS is using */
+static inline unsigned int qos_shard_count(const struct sched_info *qinfo)
+{
+	const struct qos_dpdk_shards *shards =
+		rcu_dereference(qinfo->shards);
+
+	return shards ? shards->n_shards : 1;
+}
+
+static inline unsigned int
+qos_subport_shard(const struct qos_dpdk_shards *shards, uint32_t subport)
+{
+	return subport % shards->n_shards;
+}
+
+/* The shard, and so the transmit ring, to schedule a packet on */
+static inline unsigned int qos_shard_of(const struct sched_info *qinfo,
+					const struct rte_mbuf *m)
+{
+	const struct qos_dpdk_shards *shards =
+		rcu_dereference(qinfo->shards);
+
+	if (likely(!shards))
+		return 0;
+
+	return qos_subport_shard(shards,
+				 qinfo->vlan_map[pktmbuf_get_txvlanid(m)]);
+}
+
 /*
  * The bottom RTE_SCHED_TC_BITS bits is the TC.
  * The next RTE_SCHED_WRR_BITS is the q index.
@@ -554,7 +633,7 @@ uint32_t qos_sched_calc_qindex(struct sched_info *qinfo, unsigned int subport,
 			       unsigned int q);
 struct sched_info;
 int qos_sched(struct ifnet *ifp, struct sched_info *qinfo,
-	      struct rte_mbuf *enq_pkts[], uint32_t n_pkts,
+	      unsigned int shard, struct rte_mbuf *enq_pkts[], uint32_t n_pkts,
 	      struct rte_mbuf *deq_pkts[], uint32_t space);
 struct subport_info *qos_get_subport(const char *name, struct ifnet **ifp);
 struct npf_act_grp *qos_ag_get_head(struct subport_info *subport);
@@ -605,9 +684,12 @@ int qos_dpdk_queue_clear_stats(struct sched_info *qinfo,
 			       uint32_t subport, uint32_t pipe,
 			       uint32_t tc, uint32_t q);
 void qos_dpdk_free(struct sched_info *qinfo);
+int qos_dpdk_init(void);
+void qos_class_cache_flush(struct sched_info *qinfo);
 int qos_dpdk_port(struct ifnet *ifp,
 		  unsigned int subports, unsigned int pipes,
-		  unsigned int profiles, unsigned int overhead);
+		  unsigned int profiles, unsigned int overhead,
+		  unsigned int shards);
 int qos_dpdk_disable(struct ifnet *ifp, struct sched_info *qinfo);
 int qos_dpdk_enable(struct ifnet *ifp,
 		    struct sched_info *qinfo);
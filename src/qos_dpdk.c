@@ -12,14 +12,60 @@
 #include <rte_mbuf.h>
 #include <rte_red.h>
 #include <rte_sched.h>
+#include <rte_timer.h>
+#include <assert.h>
+#include <stdlib.h>
 #include "qos.h"
+#include "flow_cache.h"
 #include "json_writer.h"
+#include "main.h"
 #include "netinet6/ip6_funcs.h"
+#include "npf/config/npf_attach_point.h"
 #include "npf/config/npf_config.h"
+#include "npf/npf_ruleset.h"
 #include "npf_shim.h"
 #include "vplane_debug.h"
 #include "vplane_log.h"
 #include "ether.h"
+#include "util.h"
+
+static_assert(QOS_MAX_SHARDS <= MAX_TX_QUEUE_PER_PORT,
+	      "each scheduler shard needs its own packet ring");
+
+/*
+ * Sizing of the shared port token bucket of a scaled-out port.  The
+ * bucket holds about 1ms at the port rate, and a shard takes its share
+ * of the bucket at a time so the shared cache line is touched rarely.
+ */
+#define QOS_SHARED_TB_PERIODS	1000	/* bucket is 1/1000th of a sec */
+#define QOS_SHARED_TB_MIN_MTUS	4
+#define QOS_SHARED_TB_MAX_IDLE	100	/* cap refill at 1/100th of a sec */
+
+/* Queue size of a subport in a shard that does not own it */
+#define QOS_IDLE_QSIZE		2
+
+/*
+ * Per-flow classification cache.  Entries are aged out if not hit
+ * between two ageing passes.
+ */
+#define QOS_CLASS_CACHE_MAX	8192	/* per lcore */
+#define QOS_CLASS_CACHE_AGE	10	/* seconds */
+#define QOS_CLASS_BURST		32	/* packets classified together */
+#define QOS_CLASS_PREFETCH	4
+
+/* A cached class is the pipe and the queue map entry */
+#define QOS_CLASS_CTX(pipe, q)	((uint16_t)((pipe) << 8 | (q)))
+#define QOS_CLASS_PIPE(ctx)	((ctx) >> 8)
+#define QOS_CLASS_Q(ctx)	((ctx) & 0xff)
+
+/* The result of classifying a packet */
+struct qos_class {
+	uint32_t subport;
+	uint32_t pipe;
+	uint8_t  q;
+	uint8_t  dscp;
+	bool     block;
+};
 
 /*
  * Only allow a child shaper to use 99.6% of the parent bandwidth so when we
@@ -53,18 +99,31 @@ uint64_t qos_dpdk_check_rate(uint64_t rate, uint64_t parent_bw)
 	return rate;
 }
 
+/* The scheduler with the queues of a subport, for reading stats and config */
+static struct rte_sched_port *
+qos_dpdk_subport_port(struct sched_info *qinfo, uint32_t subport)
+{
+	struct qos_dpdk_shards *shards = qinfo->shards;
+
+	if (shards)
+		return shards->shard[qos_subport_shard(shards, subport)].port;
+
+	return qinfo->dev_info.dpdk.port;
+}
+
 /*
  * Return the DSCP wred resource group name associated with a map entry
  * in a queue index.
  */
-static char *qos_get_dscp_grp(struct sched_info *qinfo, uint32_t qid, int i)
+static char *qos_get_dscp_grp(struct sched_info *qinfo, uint32_t subport,
+			      uint32_t qid, int i)
 {
 	struct qos_pipe_params *pp;
 	struct qos_red_pipe_params *wred_params;
 	int profile;
 
-	profile = rte_sched_get_profile_for_pipe(qinfo->dev_info.dpdk.port,
-						 qid);
+	profile = rte_sched_get_profile_for_pipe(
+			qos_dpdk_subport_port(qinfo, subport), qid);
 	if (profile < 0)
 		return NULL;
 
@@ -85,14 +144,15 @@ void qos_dpdk_dscp_resgrp_json(struct sched_info *qinfo, uint32_t subport,
 
 	qid = qos_sched_calc_qindex(qinfo, subport, pipe, tc, q);
 
-	num_maps = rte_red_queue_num_maps(qinfo->dev_info.dpdk.port, qid);
+	num_maps = rte_red_queue_num_maps(qos_dpdk_subport_port(qinfo, subport),
+					  qid);
 	if (num_maps) {
 		char *grp_name;
 
 		jsonw_name(wr, "wred_map");
 		jsonw_start_array(wr);
 		for (i = 0; i < num_maps; i++) {
-			grp_name = qos_get_dscp_grp(qinfo, qid, i);
+			grp_name = qos_get_dscp_grp(qinfo, subport, qid, i);
 			if (grp_name == NULL)
 				break;
 			jsonw_start_object(wr);
@@ -110,7 +170,7 @@ int qos_dpdk_subport_read_stats(struct sched_info *qinfo,
 				struct rte_sched_subport_stats64 *queue_stats)
 {
 	uint32_t over[RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE];
-	struct rte_sched_port *port = qinfo->dev_info.dpdk.port;
+	struct rte_sched_port *port = qos_dpdk_subport_port(qinfo, subport);
 	struct rte_sched_subport_stats64 stats;
 	int ret, i;
 
@@ -175,7 +235,7 @@ int qos_dpdk_queue_read_stats(struct sched_info *qinfo,
 			      uint64_t *qlen, bool *qlen_in_pkts)
 {
 	struct rte_sched_queue_stats64 stats;
-	struct rte_sched_port *port = qinfo->dev_info.dpdk.port;
+	struct rte_sched_port *port = qos_dpdk_subport_port(qinfo, subport);
 	uint32_t qid = qos_sched_calc_qindex(qinfo, subport, pipe, tc, q);
 	uint16_t qlen_16;
 	int ret, i;
@@ -233,15 +293,126 @@ int qos_dpdk_queue_clear_stats(struct sched_info *qinfo,
 	return rv;
 }
 
+static void qos_dpdk_shards_free(struct qos_dpdk_shards *shards)
+{
+	unsigned int i;
+
+	for (i = 0; i < shards->n_shards; i++)
+		rte_sched_port_free(shards->shard[i].port);
+	free(shards);
+}
+
+static void qos_class_rule_release(void *rule)
+{
+	npf_rule_put(rule);
+}
+
+static void qos_class_cache_age(struct rte_timer *tmr __rte_unused,
+				void *arg)
+{
+	flow_cache_age(arg);
+}
+
+/* Create the class cache of a port, if it doesn't have one */
+static int qos_class_cache_create(struct sched_info *qinfo)
+{
+	struct flow_cache *cache;
+	unsigned int lcore;
+
+	if (qinfo->class_cache)
+		return 0;
+
+	cache = flow_cache_init_ext(QOS_CLASS_CACHE_MAX,
+				    FLOW_CACHE_F_CLASSIFY,
+				    qos_class_rule_release);
+	if (!cache)
+		return -ENOMEM;
+
+	RTE_LCORE_FOREACH(lcore) {
+		if (flow_cache_init_lcore(cache, lcore) < 0) {
+			flow_cache_destroy(cache);
+			return -ENOMEM;
+		}
+	}
+
+	rte_timer_init(&qinfo->class_cache_timer);
+	rte_timer_reset(&qinfo->class_cache_timer,
+			QOS_CLASS_CACHE_AGE * rte_get_timer_hz(), PERIODICAL,
+			rte_get_master_lcore(), qos_class_cache_age, cache);
+
+	rcu_assign_pointer(qinfo->class_cache, cache);
+	return 0;
+}
+
+/*
+ * Flush the class cache after a change to the config it caches.  Each
+ * lcore empties its own table before it next classifies, so this
+ * doesn't wait for the lcores and a batch of changes, such as a commit
+ * of the rules of many subports, costs each lcore one flush.
+ */
+void qos_class_cache_flush(struct sched_info *qinfo)
+{
+	struct flow_cache *cache = qinfo->class_cache;
+
+	if (cache)
+		flow_cache_invalidate_lazy(cache);
+}
+
+static void qos_class_cache_destroy(struct sched_info *qinfo)
+{
+	struct flow_cache *cache = qinfo->class_cache;
+
+	if (!cache)
+		return;
+
+	rte_timer_stop(&qinfo->class_cache_timer);
+	rcu_assign_pointer(qinfo->class_cache, NULL);
+	synchronize_rcu();
+	flow_cache_destroy(cache);
+}
+
+/*
+ * A change to the QoS rules of a subport may change the class of the
+ * flows cached for its port.
+ */
+static npf_attpt_ev_cb qos_dpdk_rlset_update;
+static void qos_dpdk_rlset_update(enum npf_attpt_ev_type event __unused,
+				  struct npf_attpt_item *ap, void *data)
+{
+	const struct npf_attpt_key *apk = npf_attpt_item_key(ap);
+	enum npf_ruleset_type *rs_type = data;
+	struct ifnet *ifp = NULL;
+
+	if (*rs_type != NPF_RS_QOS)
+		return;
+
+	if (!qos_get_subport(apk->apk_point, &ifp) ||
+	    ifp->if_qos->dev_id != QOS_DPDK_ID)
+		return;
+
+	qos_class_cache_flush(ifp->if_qos);
+}
+
+int qos_dpdk_init(void)
+{
+	return npf_attpt_ev_listen(NPF_ATTACH_TYPE_QOS,
+				   1 << NPF_ATTPT_EV_RLSET_UPDATE_COMMIT,
+				   qos_dpdk_rlset_update);
+}
+
 void qos_dpdk_free(struct sched_info *qinfo)
 {
-	if (qinfo->dev_info.dpdk.port)
+	/* The first shard's scheduler is also the port's */
+	if (qinfo->shards)
+		qos_dpdk_shards_free(qinfo->shards);
+	else if (qinfo->dev_info.dpdk.port)
 		rte_sched_port_free(qinfo->dev_info.dpdk.port);
 }
 
 int qos_dpdk_port(struct ifnet *ifp,
 		  unsigned int subports, unsigned int pipes,
-		  unsigned int profiles, unsigned int overhead)
+		  unsigned int profiles, unsigned int overhead,
+		  unsigned int shards)
 {
 	unsigned int n_subports, n_pipes;
 
@@ -262,6 +433,12 @@ int qos_dpdk_port(struct ifnet *ifp,
 		return -EINVAL;
 	}
 
+	if (shards > QOS_MAX_SHARDS) {
+		DP_DEBUG(QOS_DP, ERR, DATAPLANE, "bad shards value: %u\n",
+			 shards);
+		return -EINVAL;
+	}
+
 	/* Intel code has silent requirement that:
 	 * queues_per_pipe * n_pipes_per_subport * n_subports % 512 == 0
 	 * See RTE_BITMAP_CL_BIT_SIZE
@@ -281,6 +458,7 @@ int qos_dpdk_port(struct ifnet *ifp,
 	if (qinfo) {
 		qos_subport_npf_free(qinfo);
 		rcu_assign_pointer(ifp->if_qos, NULL);
+		qos_class_cache_destroy(qinfo);
 		call_rcu(&qinfo->rcu, qos_sched_free_rcu);
 	}
 
@@ -293,6 +471,7 @@ int qos_dpdk_port(struct ifnet *ifp,
 
 	qinfo->n_subports = n_subports;
 	qinfo->n_pipes = n_pipes;
+	qinfo->n_shards = shards ? shards : 1;
 	qinfo->dev_id = QOS_DPDK_ID;
 
 	rcu_assign_pointer(ifp->if_qos, qinfo);
@@ -344,6 +523,99 @@ static void qos_dpdk_port_free_rcu(void *arg)
 	rte_sched_port_free(arg);
 }
 
+static void qos_dpdk_shards_free_rcu(void *arg)
+{
+	qos_dpdk_shards_free(arg);
+}
+
+static void qos_shared_tb_init(struct qos_shared_tb *tb, uint64_t rate,
+			       uint32_t mtu)
+{
+	tb->tb_rate = rate;
+	tb->tb_size = RTE_MAX(rate / QOS_SHARED_TB_PERIODS,
+			      (uint64_t)mtu * QOS_SHARED_TB_MIN_MTUS);
+	rte_atomic64_set(&tb->tb_credits, tb->tb_size);
+	tb->tb_time = rte_get_tsc_cycles();
+	rte_spinlock_init(&tb->tb_lock);
+}
+
+/* Add the credits earned since the last refill, if no one else is */
+static void qos_shared_tb_refill(struct qos_shared_tb *tb)
+{
+	uint64_t hz = rte_get_tsc_hz();
+	uint64_t now, cycles, add;
+	int64_t old, new;
+
+	if (!rte_spinlock_trylock(&tb->tb_lock))
+		return;
+
+	now = rte_get_tsc_cycles();
+	cycles = now - tb->tb_time;
+	if (cycles > hz / QOS_SHARED_TB_MAX_IDLE) {
+		/* Long enough to fill the bucket, keep the maths in range */
+		cycles = hz / QOS_SHARED_TB_MAX_IDLE;
+		tb->tb_time = now;
+		add = cycles * tb->tb_rate / hz;
+	} else {
+		add = cycles * tb->tb_rate / hz;
+		/* Carry the remainder over to the next refill */
+		tb->tb_time += add * hz / tb->tb_rate;
+	}
+
+	do {
+		old = rte_atomic64_read(&tb->tb_credits);
+		new = RTE_MIN(old + (int64_t)add, tb->tb_size);
+	} while (!rte_atomic64_cmpset((volatile uint64_t *)&tb->tb_credits.cnt,
+				      old, new));
+
+	rte_spinlock_unlock(&tb->tb_lock);
+}
+
+/* Take up to 'want' bytes of credit from the shared bucket */
+static int64_t qos_shared_tb_take(struct qos_shared_tb *tb, int64_t want)
+{
+	int64_t avail, grant;
+
+	if (rte_atomic64_read(&tb->tb_credits) < want)
+		qos_shared_tb_refill(tb);
+
+	do {
+		avail = rte_atomic64_read(&tb->tb_credits);
+		if (avail <= 0)
+			return 0;
+		grant = RTE_MIN(want, avail);
+	} while (!rte_atomic64_cmpset((volatile uint64_t *)&tb->tb_credits.cnt,
+				      avail, avail - grant));
+
+	return grant;
+}
+
+/*
+ * Dequeue from a shard, within the credit it holds for the port.  A
+ * shard in credit may overrun by up to a burst, which it pays back
+ * before dequeuing again.
+ */
+static int qos_shard_dequeue(struct qos_dpdk_shards *shards,
+			     struct qos_dpdk_shard *sh,
+			     struct rte_mbuf *deq_pkts[], uint32_t space)
+{
+	int64_t share = shards->tb.tb_size / shards->n_shards;
+	int i, n;
+
+	if (sh->credits <= 0) {
+		sh->credits += qos_shared_tb_take(&shards->tb,
+						  share - sh->credits);
+		if (sh->credits <= 0)
+			return 0;
+	}
+
+	n = rte_sched_port_dequeue(sh->port, deq_pkts, space);
+	for (i = 0; i < n; i++)
+		sh->credits -= deq_pkts[i]->pkt_len + shards->frame_overhead;
+
+	return n;
+}
+
 /* Return the total queue-array length for the subport.
  * If the subport doesn't have its TC queue-limits explicitly defined inherit
  * the port's queue-limits.
@@ -365,6 +637,14 @@ static uint32_t qos_sched_subport_qsize(struct qos_port_params *pp,
 		pp->n_pipes_per_subport * sizeof(struct rte_mbuf *));
 }
 
+/* Queue-array length of a subport in a shard that doesn't own it */
+static uint32_t qos_sched_subport_idle_qsize(struct qos_port_params *pp)
+{
+	return (QOS_IDLE_QSIZE * RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE *
+		RTE_SCHED_QUEUES_PER_TRAFFIC_CLASS *
+		pp->n_pipes_per_subport * sizeof(struct rte_mbuf *));
+}
+
 static void qos_copy_red_params(struct rte_red_params
 						dpdk[][RTE_COLORS],
 				struct subport_info *sinfo)
@@ -470,6 +750,96 @@ static void qos_dpdk_free_params(struct rte_sched_port_params *dpdk_port_params)
 	free(dpdk_port_params->pipe_profiles);
 }
 
+/*
+ * Create the scheduler for one shard of a port, with all subports and
+ * pipes configured.  Subports owned by other shards never see any
+ * packets, so only get minimal queues and no RED.  An unsharded port
+ * is shard 0 of 1.
+ */
+static struct rte_sched_port *
+qos_dpdk_shard_config(struct sched_info *qinfo,
+		      struct rte_sched_port_params *dpdk_port_params,
+		      unsigned int shard, unsigned int n_shards)
+{
+	struct rte_sched_port *port;
+	unsigned int subport, pipe;
+	uint32_t q_array_size = 0;
+	int ret;
+
+	for (subport = 0; subport < qinfo->n_subports; subport++) {
+		if (subport % n_shards == shard)
+			q_array_size += qos_sched_subport_qsize(
+				&qinfo->port_params,
+				qinfo->subport[subport].qsize);
+		else
+			q_array_size += qos_sched_subport_idle_qsize(
+				&qinfo->port_params);
+	}
+
+	port = rte_sched_port_config_v2(dpdk_port_params, q_array_size);
+	if (port == NULL) {
+		DP_DEBUG(QOS_DP, ERR, DATAPLANE,
+			 "QoS config port failed\n");
+		return NULL;
+	}
+
+	for (subport = 0; subport < qinfo->n_subports; subport++) {
+		struct subport_info *sinfo = &qinfo->subport[subport];
+		struct qos_shaper_conf *qos_params = &sinfo->params;
+		struct rte_sched_subport_params dpdk_params;
+		uint16_t qsize[RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE];
+		struct rte_red_params
+			dpdk_red_params[RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE]
+				       [RTE_COLORS];
+		bool owned = subport % n_shards == shard;
+		int i;
+
+		for (i = 0; i < RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE; i++)
+			qsize[i] = owned ? (uint16_t)sinfo->qsize[i] :
+				QOS_IDLE_QSIZE;
+
+		memcpy(&dpdk_params, qos_params, sizeof(*qos_params));
+		if (owned)
+			qos_copy_red_params(dpdk_red_params, sinfo);
+		else
+			memset(dpdk_red_params, 0, sizeof(dpdk_red_params));
+
+		ret = rte_sched_subport_config_v2(port, subport, &dpdk_params,
+						  &qsize[0], dpdk_red_params);
+		if (ret != 0) {
+			DP_DEBUG(QOS_DP, ERR, DATAPLANE,
+				 "Qos config subport %u failed: %d\n",
+				 subport, ret);
+			goto out_free_sched;
+		}
+
+		for (pipe = 0; pipe < qinfo->n_pipes; pipe++) {
+			uint8_t profile = sinfo->profile_map[pipe];
+
+			ret = rte_sched_pipe_config_v2(port, subport,
+						       pipe, profile,
+						       dpdk_port_params);
+			if  (ret != 0) {
+				DP_DEBUG(QOS_DP, ERR, DATAPLANE,
+					 "Qos config pipe subport %u pipe %u"
+					 " profile %u failed: %d\n",
+					 subport, pipe, profile, ret);
+				goto out_free_sched;
+			}
+		}
+	}
+
+	/* Update NPF rules */
+	if (shard == 0)
+		npf_cfg_commit_all();
+
+	return port;
+
+ out_free_sched:
+	rte_sched_port_free(port);
+	return NULL;
+}
+
 /* Allocate and initialize a handle to QoS scheduler.
  * Only called by main thread.
  */
@@ -477,13 +847,21 @@ int qos_dpdk_start(struct ifnet *ifp, struct sched_info *qinfo,
 		   uint64_t bps, uint16_t max_pkt_len)
 {
 	struct rte_sched_port *port, *old_port = NULL;
-	unsigned int subport, pipe;
-	int ret;
-	uint32_t q_array_size;
+	struct qos_dpdk_shards *shards = NULL, *old_shards;
+	unsigned int subport, n_shards, i;
 	struct rte_sched_port_params dpdk_port_params = {0};
 	const uint32_t max_burst_size = QOS_MAX_BURST_SIZE_DPDK;
+	int ret;
 
-	if (enable_transmit_thread(ifp->if_port) < 0) {
+	/*
+	 * A scaled-out port needs a packet ring per shard, and ideally
+	 * a transmit lcore per shard, though shards share the lcores if
+	 * the port has too few transmit queues.  There is no point
+	 * having more shards than subports.
+	 */
+	n_shards = RTE_MAX(1u, RTE_MIN(qinfo->n_shards, qinfo->n_subports));
+	ret = enable_transmit_thread_rings(ifp->if_port, n_shards);
+	if (ret < 0) {
 		DP_DEBUG(QOS_DP, ERR, DATAPLANE,
 			 "Transmit thread setup failed on %s, portid %u\n",
 			 ifp->if_name, ifp->if_port);
@@ -494,15 +872,12 @@ int qos_dpdk_start(struct ifnet *ifp, struct sched_info *qinfo,
 	ifp->qos_software_fwd = 1;
 
 	/*
-	 * Allow subports to inherit their queue sizes from the port, and
-	 * calculate the total size of queue array this port will need.
+	 * Allow subports to inherit their queue sizes from the port.
 	 */
-	q_array_size = 0;
 	for (subport = 0; subport < qinfo->n_subports; subport++) {
 		struct subport_info *sinfo = &qinfo->subport[subport];
 
-		q_array_size += qos_sched_subport_qsize(&qinfo->port_params,
-							sinfo->qsize);
+		qos_sched_subport_qsize(&qinfo->port_params, sinfo->qsize);
 
 		/*
 		 * If we've received a rate auto we use the reported
@@ -530,71 +905,60 @@ int qos_dpdk_start(struct ifnet *ifp, struct sched_info *qinfo,
 		goto out_disable_tx;
 	}
 
-	port = rte_sched_port_config_v2(&dpdk_port_params, q_array_size);
-	if (port == NULL) {
-		DP_DEBUG(QOS_DP, ERR, DATAPLANE,
-			 "QoS config port failed\n");
-		qos_dpdk_free_params(&dpdk_port_params);
-		goto out_disable_tx;
-	}
-
-	for (subport = 0; subport < qinfo->n_subports; subport++) {
-		struct subport_info *sinfo = &qinfo->subport[subport];
-		struct qos_shaper_conf *qos_params = &sinfo->params;
-		struct rte_sched_subport_params dpdk_params;
-		uint16_t qsize[RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE];
-		struct rte_red_params
-			dpdk_red_params[RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE]
-				       [RTE_COLORS];
-		int i;
-
-		for (i = 0; i < RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE; i++)
-			qsize[i] = (uint16_t)sinfo->qsize[i];
-
-		memcpy(&dpdk_params, qos_params, sizeof(*qos_params));
-		qos_copy_red_params(dpdk_red_params, sinfo);
-
-		ret = rte_sched_subport_config_v2(port, subport, &dpdk_params,
-						  &qsize[0], dpdk_red_params);
-		if (ret != 0) {
-			DP_DEBUG(QOS_DP, ERR, DATAPLANE,
-				 "Qos config subport %u failed: %d\n",
-				 subport, ret);
-			goto out_free_sched;
+	if (n_shards > 1) {
+		shards = zmalloc_aligned(sizeof(*shards));
+		if (!shards) {
+			qos_dpdk_free_params(&dpdk_port_params);
+			goto out_disable_tx;
 		}
-
-		for (pipe = 0; pipe < qinfo->n_pipes; pipe++) {
-			uint8_t profile = sinfo->profile_map[pipe];
-
-			ret = rte_sched_pipe_config_v2(port, subport,
-						       pipe, profile,
-						       &dpdk_port_params);
-			if  (ret != 0) {
-				DP_DEBUG(QOS_DP, ERR, DATAPLANE,
-					 "Qos config pipe subport %u pipe %u"
-					 " profile %u failed: %d\n",
-					 subport, pipe, profile, ret);
+		shards->frame_overhead = qinfo->port_params.frame_overhead;
+		qos_shared_tb_init(&shards->tb, qinfo->port_params.rate,
+				   qinfo->port_params.mtu);
+
+		/* Every shard may use the full port rate, if it can get it */
+		for (i = 0; i < n_shards; i++) {
+			port = qos_dpdk_shard_config(qinfo, &dpdk_port_params,
+						     i, n_shards);
+			if (port == NULL)
 				goto out_free_sched;
-			}
+			shards->shard[i].port = port;
+			shards->n_shards++;
+		}
+		port = shards->shard[0].port;
+	} else {
+		port = qos_dpdk_shard_config(qinfo, &dpdk_port_params, 0, 1);
+		if (port == NULL) {
+			qos_dpdk_free_params(&dpdk_port_params);
+			goto out_disable_tx;
 		}
-
-		/* Update NPF rules */
-		npf_cfg_commit_all();
 	}
 
 	/* Use RCU to set the pointer because changed by main thread
 	 * but referenced by Tx thread
 	 */
-	DP_DEBUG(QOS_DP, DEBUG, DATAPLANE,  "QoS on port %s enabled\n",
-		 ifp->if_name);
+	DP_DEBUG(QOS_DP, DEBUG, DATAPLANE,
+		 "QoS on port %s enabled, shards %u\n",
+		 ifp->if_name, n_shards);
 	old_port = qinfo->dev_info.dpdk.port;
+	old_shards = qinfo->shards;
 	rcu_assign_pointer(qinfo->dev_info.dpdk.port, port);
-	defer_rcu(qos_dpdk_port_free_rcu, old_port);
+	rcu_assign_pointer(qinfo->shards, shards);
+	if (old_shards)
+		defer_rcu(qos_dpdk_shards_free_rcu, old_shards);
+	else
+		defer_rcu(qos_dpdk_port_free_rcu, old_port);
 	qos_dpdk_free_params(&dpdk_port_params);
+
+	/* Classes cached under the old config may no longer be right */
+	if (qinfo->class_cache)
+		qos_class_cache_flush(qinfo);
+	else if (qos_class_cache_create(qinfo) < 0)
+		DP_DEBUG(QOS_DP, ERR, DATAPLANE,
+			 "QoS class cache failed on %s\n", ifp->if_name);
 	return 0;
 
  out_free_sched:
-	rte_sched_port_free(port);
+	qos_dpdk_shards_free(shards);
 	qos_dpdk_free_params(&dpdk_port_params);
  out_disable_tx:
 	ifp->qos_software_fwd = 0;
@@ -605,12 +969,18 @@ int qos_dpdk_start(struct ifnet *ifp, struct sched_info *qinfo,
 int qos_dpdk_stop(struct ifnet *ifp, struct sched_info *qinfo)
 {
 	struct rte_sched_port *port = qinfo->dev_info.dpdk.port;
+	struct qos_dpdk_shards *shards = qinfo->shards;
 
 	if (port == NULL)
 		return 0; /* qos not started */
 
 	rcu_assign_pointer(qinfo->dev_info.dpdk.port, NULL);
-	defer_rcu(qos_dpdk_port_free_rcu, port);
+	rcu_assign_pointer(qinfo->shards, NULL);
+	if (shards)
+		defer_rcu(qos_dpdk_shards_free_rcu, shards);
+	else
+		defer_rcu(qos_dpdk_port_free_rcu, port);
+	qos_class_cache_destroy(qinfo);
 
 	ifp->qos_software_fwd = 0;
 	disable_transmit_thread(ifp->if_port);
@@ -618,6 +988,77 @@ int qos_dpdk_stop(struct ifnet *ifp, struct sched_info *qinfo)
 	return 0;
 }
 
+/*
+ * Look up the class of a packet of a flow classified before.  Only IP
+ * packets to subports with QoS rules are cached, and not from-us
+ * packets, whose queue may also depend on the local priority queue.
+ */
+static bool
+qos_class_cache_lookup(struct flow_cache *cache, struct rte_mbuf *m,
+		       uint16_t ether_type, struct qos_class *cls)
+{
+	struct flow_cache_entry *entry;
+	enum flow_cache_ftype af;
+	uint16_t ctx;
+	void *rule;
+
+	if (ether_type == htons(RTE_ETHER_TYPE_IPV4))
+		af = FLOW_CACHE_IPV4;
+	else if (ether_type == htons(RTE_ETHER_TYPE_IPV6))
+		af = FLOW_CACHE_IPV6;
+	else
+		return false;
+
+	if (pktmbuf_mdata_exists(m, PKT_MDATA_FROM_US))
+		return false;
+
+	if (flow_cache_lookup(cache, m, af, &entry) < 0)
+		return false;
+
+	flow_cache_entry_get_info(entry, &rule, &ctx);
+	cls->pipe = QOS_CLASS_PIPE(ctx);
+	cls->q = QOS_CLASS_Q(ctx);
+
+	/* Account the packet to the rule, as NPF would */
+	if (rule)
+		npf_add_pkt(rule, rte_pktmbuf_pkt_len(m));
+
+	return true;
+}
+
+/*
+ * Cache the class of a packet, if the rule it matched only gives a
+ * pipe.  Rules with actions or logging must see every packet.
+ */
+static void
+qos_class_cache_add(struct flow_cache *cache, struct rte_mbuf *m,
+		    uint16_t ether_type, npf_rule_t *rl,
+		    const struct qos_class *cls)
+{
+	enum flow_cache_ftype af;
+
+	if (ether_type == htons(RTE_ETHER_TYPE_IPV4))
+		af = FLOW_CACHE_IPV4;
+	else if (ether_type == htons(RTE_ETHER_TYPE_IPV6))
+		af = FLOW_CACHE_IPV6;
+	else
+		return;
+
+	if (cls->pipe > UINT8_MAX ||
+	    pktmbuf_mdata_exists(m, PKT_MDATA_FROM_US))
+		return;
+
+	if (rl && (npf_rule_has_rproc_actions(rl) ||
+		   npf_rule_has_rproc_logger(rl) ||
+		   npf_rule_has_rproc_match(rl)))
+		return;
+
+	/* On success the entry owns the reference */
+	if (flow_cache_add(cache, npf_rule_get(rl),
+			   QOS_CLASS_CTX(cls->pipe, cls->q), m, af) != 0)
+		npf_rule_put(rl);
+}
+
 /* Classify packet for QoS
  * Fixed mapping based on:
  *    VLAN  => subport
@@ -627,23 +1068,18 @@ int qos_dpdk_stop(struct ifnet *ifp, struct sched_info *qinfo)
  * Non IP traffic, default to best effort and no flow
  */
 static
-int qos_npf_classify(struct ifnet *ifp, const struct sched_info *qinfo,
-		     struct rte_mbuf **m)
+void qos_npf_classify(struct ifnet *ifp, const struct sched_info *qinfo,
+		      struct flow_cache *cache, struct rte_mbuf **m,
+		      uint16_t ether_type, struct qos_class *cls)
 {
-	uint16_t ether_type = ethtype(*m, RTE_ETHER_TYPE_VLAN);
 	uint32_t subport, pipe = 0, q = DEFAULT_Q;
 	npf_result_t result = { .decision = NPF_DECISION_PASS };
+	npf_rule_t *rl = NULL;
+	bool cacheable = false;
+	int rc = 0;
 
 	uint16_t vlan = pktmbuf_get_txvlanid(*m);
 
-	if (vlan) {
-		struct ifnet *vlan_ifp;
-
-		vlan_ifp = if_vlan_lookup(ifp, vlan);
-		if (vlan_ifp)
-			ifp = vlan_ifp;
-	}
-
 	subport = qinfo->vlan_map[vlan];
 	struct subport_info *sinfo = &qinfo->subport[subport];
 
@@ -651,20 +1087,55 @@ int qos_npf_classify(struct ifnet *ifp, const struct sched_info *qinfo,
 	const struct npf_config *npf_config =
 				rcu_dereference(sinfo->npf_config);
 
+	cls->subport = subport;
+	cls->block = false;
+
 	if (npf_active(npf_config, NPF_QOS)) {
-		result = npf_hook_notrack(npf_get_ruleset(npf_config,
-					  NPF_RS_QOS), m, ifp, PFIL_OUT, 0,
-					  ether_type, NULL);
+		if (cache && qos_class_cache_lookup(cache, *m, ether_type,
+						    cls)) {
+			const struct queue_map *qmap =
+				&qinfo->queue_map[sinfo->profile_map[cls->pipe]];
+
+			/* As below, DSCP isn't marked if the PCP map is used */
+			if (vlan != 0 && !qmap->dscp_enabled &&
+			    qmap->pcp_enabled)
+				cls->dscp = MAX_DSCP;
+			else if (ether_type == htons(RTE_ETHER_TYPE_IPV4))
+				cls->dscp = ip_dscp_get(iphdr(*m));
+			else
+				cls->dscp = ip6_dscp_get(ip6hdr(*m));
+			return;
+		}
+
+		if (vlan) {
+			struct ifnet *vlan_ifp;
+
+			vlan_ifp = if_vlan_lookup(ifp, vlan);
+			if (vlan_ifp)
+				ifp = vlan_ifp;
+		}
+
+		result = npf_hook_notrack_rule(npf_get_ruleset(npf_config,
+					       NPF_RS_QOS), m, ifp, PFIL_OUT, 0,
+					       ether_type, &rc, &rl);
 		if (result.tag_set)
 			pipe = result.tag;
+		cacheable = cache && rc == 0 &&
+			result.decision != NPF_DECISION_BLOCK;
 	}
 
 	if (pipe >= qinfo->n_pipes) {
 		DP_DEBUG(QOS_DP, ERR, DATAPLANE,
 			 "NPF returned invalid tag %u, max-pipe:%u\n",
 			 pipe, qinfo->n_pipes);
-		return NPF_DECISION_BLOCK;
+		cls->block = true;
+		return;
 	}
+	if (result.decision == NPF_DECISION_BLOCK) {
+		cls->block = true;
+		return;
+	}
+
 	uint8_t profile = sinfo->profile_map[pipe];
 	const struct queue_map *qmap = &qinfo->queue_map[profile];
 	uint8_t pcp = pktmbuf_get_vlan_pcp(*m);
@@ -701,48 +1172,95 @@ int qos_npf_classify(struct ifnet *ifp, const struct sched_info *qinfo,
 		}
 	}
 
-	rte_sched_port_pkt_write_v2(*m, subport, pipe,
-				 qmap_to_tc(q), qmap_to_wrr(q),
-				 RTE_COLOR_GREEN, dscp);
-	return result.decision;
+	cls->pipe = pipe;
+	cls->q = q;
+	cls->dscp = dscp;
+
+	if (cacheable)
+		qos_class_cache_add(cache, *m, ether_type, rl, cls);
 }
 
-static int qos_classify(struct ifnet *ifp, struct sched_info *qinfo,
-			struct rte_mbuf *enq_pkts[], uint32_t n_pkts)
+/*
+ * Classify a burst of packets to the Qos queues, then mark them all.
+ * NPF is run for classification to the pipe level, unless the flow's
+ * class is cached, so we need to check whether a packet has been
+ * dropped via policing and repack the array.
+ */
+static int qos_classify_burst(struct ifnet *ifp, struct sched_info *qinfo,
+			      struct flow_cache *cache,
+			      struct rte_mbuf *enq_pkts[], uint32_t n_pkts,
+			      struct rte_mbuf *out_pkts[])
 {
+	struct qos_class cls[QOS_CLASS_BURST];
 	uint32_t i, j;
 
-	/*
-	 * Classify the packets to the Qos queues.
-	 * NPF is run for classification to the pipe level
-	 * so we need to check whether a packet has been
-	 * dropped via policing and repack the array.
-	 */
+	for (i = 0; i < QOS_CLASS_PREFETCH && i < n_pkts; i++)
+		rte_prefetch0(rte_pktmbuf_mtod(enq_pkts[i], void *));
+
+	for (i = 0; i < n_pkts; i++) {
+		if (i + QOS_CLASS_PREFETCH < n_pkts)
+			rte_prefetch0(rte_pktmbuf_mtod(
+				enq_pkts[i + QOS_CLASS_PREFETCH], void *));
+
+		qos_npf_classify(ifp, qinfo, cache, &enq_pkts[i],
+				 ethtype(enq_pkts[i], RTE_ETHER_TYPE_VLAN),
+				 &cls[i]);
+	}
+
 	for (i = j = 0; i < n_pkts; i++) {
-		if (qos_npf_classify(ifp, qinfo,
-				     &(enq_pkts[i])) == NPF_DECISION_BLOCK) {
-			rte_pktmbuf_free(enq_pkts[i]);
+		struct rte_mbuf *m = enq_pkts[i];
+
+		if (cls[i].block) {
+			rte_pktmbuf_free(m);
 			continue;
 		}
 
 		/*
 		 * Ensure session is cleared from pkts.
 		 */
-		pktmbuf_mdata_clear(enq_pkts[i], PKT_MDATA_SESSION_SENTRY);
-		if (i != j)
-			enq_pkts[j] = enq_pkts[i];
-		j++;
+		pktmbuf_mdata_clear(m, PKT_MDATA_SESSION_SENTRY);
+		rte_sched_port_pkt_write_v2(m, cls[i].subport, cls[i].pipe,
+					    qmap_to_tc(cls[i].q),
+					    qmap_to_wrr(cls[i].q),
+					    RTE_COLOR_GREEN, cls[i].dscp);
+		out_pkts[j++] = m;
+	}
+	return j;
+}
+
+static int qos_classify(struct ifnet *ifp, struct sched_info *qinfo,
+			struct rte_mbuf *enq_pkts[], uint32_t n_pkts)
+{
+	struct flow_cache *cache = rcu_dereference(qinfo->class_cache);
+	uint32_t i, n, j = 0;
+
+	if (cache)
+		flow_cache_check_lcore(cache);
+
+	for (i = 0; i < n_pkts; i += n) {
+		n = RTE_MIN(n_pkts - i, (uint32_t)QOS_CLASS_BURST);
+		j += qos_classify_burst(ifp, qinfo, cache, &enq_pkts[i], n,
+					&enq_pkts[j]);
 	}
 	return j;
 }
 
-/* Put/get packets currently ready to send from DPDK */
+/*
+ * Put/get packets currently ready to send from DPDK, on the scheduler
+ * of the given shard.
+ */
 int qos_sched(struct ifnet *ifp, struct sched_info *qinfo,
-	      struct rte_mbuf *enq_pkts[], uint32_t n_pkts,
+	      unsigned int shard, struct rte_mbuf *enq_pkts[], uint32_t n_pkts,
 	      struct rte_mbuf *deq_pkts[], uint32_t space)
 {
-	struct rte_sched_port *port =
-		rcu_dereference(qinfo->dev_info.dpdk.port);
+	struct qos_dpdk_shards *shards = rcu_dereference(qinfo->shards);
+	struct rte_sched_port *port;
+
+	if (shards)
+		port = shard < shards->n_shards ?
+			shards->shard[shard].port : NULL;
+	else
+		port = rcu_dereference(qinfo->dev_info.dpdk.port);
 
 	if (unlikely(port == NULL)) {
 		/* qos not started, because link down or race */
@@ -761,7 +1279,10 @@ int qos_sched(struct ifnet *ifp, struct sched_info *qinfo,
 	}
 
 	/* Get what is available to send */
-	if (space > 0)
-		return rte_sched_port_dequeue(port, deq_pkts, space);
-	return 0;
+	if (space == 0)
+		return 0;
+	if (shards)
+		return qos_shard_dequeue(shards, &shards->shard[shard],
+					 deq_pkts, space);
+	return rte_sched_port_dequeue(port, deq_pkts, space);
 }
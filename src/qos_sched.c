@@ -47,6 +47,7 @@
 #include "npf/config/npf_config.h"
 #include "npf/config/npf_rule_group.h"
 #include "npf/config/npf_ruleset_type.h"
+#include "npf/npf_addrgrp.h"
 #include "npf/npf_ruleset.h"
 #include "npf/rproc/npf_ext_action_group.h"
 #include "npf/rproc/npf_rproc.h"
@@ -74,7 +75,7 @@ struct qos_qinfo_list {
 static struct qos_qinfo_list qos_qinfos;
 
 struct qos_dev qos_devices[NUM_DEVS] = {
-	{ NULL,
+	{ qos_dpdk_init,
 	  qos_dpdk_disable,
 	  qos_dpdk_enable,
 	  qos_dpdk_start,
@@ -332,6 +333,18 @@ qos_sched_res_grp_update(char *grp)
 	}
 }
 
+/*
+ * A change to an address-group may change the pipe of flows matching
+ * QoS rules on it, so forget the cached classes.
+ */
+static void qos_addrgrp_changed(struct npf_addrgrp *ag __unused)
+{
+	struct sched_info *qinfo;
+
+	SLIST_FOREACH(qinfo, &qos_qinfos.qinfo_head, list)
+		qos_class_cache_flush(qinfo);
+}
+
 /*
  * Carry out any one-time initialisation that required when the
  * vyatta-dataplane starts up.
@@ -347,6 +360,9 @@ qos_init(void)
 	qos_external_buf_monitor_init();
 	SLIST_INIT(&qos_qinfos.qinfo_head);
 
+	if (npf_addrgrp_ev_listen(qos_addrgrp_changed) < 0)
+		rte_panic("Failed to listen for address-group changes\n");
+
 	for (i = 0; i < NUM_DEVS; i++) {
 		if (qos_devices[i].qos_init) {
 			ret = (qos_devices[i].qos_init)();
@@ -2345,7 +2361,7 @@ static int cmd_qos_obj_db(FILE *f)
 
 static int cmd_qos_port(struct ifnet *ifp, int argc, char **argv)
 {
-	unsigned int subports = 0, pipes = 0, profiles = 1;
+	unsigned int subports = 0, pipes = 0, profiles = 1, shards = 1;
 	int32_t overhead = RTE_SCHED_FRAME_OVERHEAD_DEFAULT;
 	bool hw_config = false;
 	int ret;
@@ -2353,7 +2369,8 @@ static int cmd_qos_port(struct ifnet *ifp, int argc, char **argv)
 	/*
 	 * Expected command format:
 	 *
-	 * "port <a> subports <b> pipes <c> profiles <d> [overhead <e>] <f>"
+	 * "port <a> subports <b> pipes <c> profiles <d> [overhead <e>]
+	 *  [shards <g>] <f>"
 	 *
 	 * <a> - port-id
 	 * <b> - number of configured subports
@@ -2361,6 +2378,7 @@ static int cmd_qos_port(struct ifnet *ifp, int argc, char **argv)
 	 * <d> - number of configured profiles
 	 * <e> - frame-overhead
 	 * <f> - queue limit type, "ql_packets" or "ql_bytes"
+	 * <g> - number of software schedulers to spread the subports over
 	 *
 	 * Note that we can currently only support queue limits in
 	 * bytes in hardware and only support queue limits in packets
@@ -2408,6 +2426,8 @@ static int cmd_qos_port(struct ifnet *ifp, int argc, char **argv)
 				pipes = value;
 			else if (strcmp(argv[0], "profiles") == 0)
 				profiles = value;
+			else if (strcmp(argv[0], "shards") == 0)
+				shards = value;
 			else {
 				DP_DEBUG(QOS, ERR, DATAPLANE,
 					 "unknown port parameter: '%s'\n",
@@ -2427,7 +2447,8 @@ static int cmd_qos_port(struct ifnet *ifp, int argc, char **argv)
 	if (hw_config)
 		ret = qos_hw_port(ifp, subports, pipes, profiles, overhead);
 	else
-		ret = qos_dpdk_port(ifp, subports, pipes, profiles, overhead);
+		ret = qos_dpdk_port(ifp, subports, pipes, profiles, overhead,
+				    shards);
 
 	return ret;
 }
@@ -3243,6 +3264,8 @@ static int cmd_qos_vlan(struct ifnet *ifp, int argc, char **argv)
 	else {
 		qinfo->vlan_map[tci] = subport;
 		qinfo->subport[subport].vlan_id = tci;
+		/* Cached classes came from the old subport's rules */
+		qos_class_cache_flush(qinfo);
 		return 0;
 	}
 	return -EINVAL;
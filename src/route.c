@@ -697,6 +697,52 @@ struct next_hop *rt_lookup_fast(struct vrf *vrf, in_addr_t dst,
 	return nh;
 }
 
+/* Destinations looked up at once by rt_lookup_bulk_fast() */
+#define RT_LOOKUP_BULK_MAX 32
+
+/*
+ * Lookup the nexthops for a burst of destinations in the same table,
+ * as rt_lookup_fast() does for one.  The tbl24 entries for the burst
+ * are fetched together so that their cache misses overlap.
+ */
+void rt_lookup_bulk_fast(struct vrf *vrf, const in_addr_t dsts[],
+			 uint32_t tblid, struct rte_mbuf *const ms[],
+			 struct next_hop *nhs[], unsigned int n)
+{
+	uint32_t ips[RT_LOOKUP_BULK_MAX];
+	uint32_t index[RT_LOOKUP_BULK_MAX];
+	const struct lpm *lpm;
+	unsigned int i, j, nb;
+
+	lpm = rcu_dereference(vrf->v_rt4_head.rt_table[tblid]);
+	if (unlikely(!lpm)) {
+		for (i = 0; i < n; i++)
+			nhs[i] = NULL;
+		return;
+	}
+
+	for (i = 0; i < n; i += nb) {
+		nb = RTE_MIN(n - i, RT_LOOKUP_BULK_MAX);
+
+		for (j = 0; j < nb; j++)
+			ips[j] = ntohl(dsts[i + j]);
+
+		lpm_lookup_bulk(lpm, ips, index, nb);
+
+		for (j = 0; j < nb; j++) {
+			struct next_hop *nh = NULL;
+
+			if (likely(index[j] != LPM_LOOKUP_MISS))
+				nh = nexthop_select(AF_INET, index[j],
+						    ms[i + j],
+						    RTE_ETHER_TYPE_IPV4);
+			if (nh && unlikely(nh->flags & RTF_NOROUTE))
+				nh = NULL;
+			nhs[i + j] = nh;
+		}
+	}
+}
+
 inline bool is_local_ipv4(vrfid_t vrf_id, in_addr_t dst)
 {
 	struct vrf *vrf = vrf_get_rcu(vrf_id);
@@ -729,7 +775,7 @@ nexthop_hashfn(const struct nexthop_hash_key *key,
 	       unsigned long seed __rte_unused)
 {
 	size_t size = key->size;
-	uint32_t hash_keys[size * 3 + 1];
+	uint32_t hash_keys[size * 3 + 2];
 	struct ifnet *ifp;
 	uint16_t i, j = 0;
 
@@ -741,8 +787,9 @@ nexthop_hashfn(const struct nexthop_hash_key *key,
 	}
 
 	hash_keys[size * 3] = key->use;
+	hash_keys[size * 3 + 1] = key->pathgroup;
 
-	return rte_jhash_32b(hash_keys, size * 3 + 1, 0);
+	return rte_jhash_32b(hash_keys, size * 3 + 2, 0);
 }
 
 static int nexthop_cmpfn(struct cds_lfht_node *node, const void *key)
@@ -753,7 +800,8 @@ static int nexthop_cmpfn(struct cds_lfht_node *node, const void *key)
 	uint16_t i;
 
 	if (h_key->size != nl->nsiblings ||
-	    h_key->use != nl->use || h_key->proto != nl->proto)
+	    h_key->use != nl->use || h_key->proto != nl->proto ||
+	    h_key->pathgroup != nl->pathgroup)
 		return false;
 
 	for (i = 0; i < h_key->size; i++) {
@@ -1228,11 +1276,14 @@ route_delete_relink_arp(struct lpm *lpm, uint32_t ip, uint8_t depth)
 /*
  * Add new route entry.
  */
+static int rt_insert_nh(struct vrf *vrf, struct lpm *lpm, in_addr_t dst,
+			uint8_t depth, uint32_t tableid, uint8_t scope,
+			uint32_t idx, size_t size, bool replace);
+
 int rt_insert(vrfid_t vrf_id, in_addr_t dst, uint8_t depth, uint32_t tableid,
 	      uint8_t scope, uint8_t proto, struct next_hop hops[],
 	      size_t size, bool replace)
 {
-	uint32_t old_idx;
 	uint32_t idx = 0;
 	int err_code;
 	char b[INET_ADDRSTRLEN];
@@ -1292,6 +1343,26 @@ int rt_insert(vrfid_t vrf_id, in_addr_t dst, uint8_t depth, uint32_t tableid,
 		goto err;
 	}
 
+	return rt_insert_nh(vrf, lpm, dst, depth, tableid, scope, idx,
+			    size, replace);
+
+err:
+	return err_code;
+}
+
+/*
+ * Add or replace a route using the given nexthop, which the route takes
+ * the caller's reference on.
+ */
+static int rt_insert_nh(struct vrf *vrf, struct lpm *lpm, in_addr_t dst,
+			uint8_t depth, uint32_t tableid, uint8_t scope,
+			uint32_t idx, size_t size, bool replace)
+{
+	vrfid_t vrf_id = vrf->v_id;
+	char b[INET_ADDRSTRLEN];
+	uint32_t old_idx;
+	int err_code;
+
 	pthread_mutex_lock(&route_mutex);
 
 	route_delete_unlink_arp(vrf, lpm, ntohl(dst), depth);
@@ -1321,7 +1392,7 @@ int rt_insert(vrfid_t vrf_id, in_addr_t dst, uint8_t depth, uint32_t tableid,
 			     inet_ntop(AF_INET, &dst, b, sizeof(b)),
 			     depth, idx, err_code);
 		nexthop_put(AF_INET, idx);
-		goto err;
+		return err_code;
 	}
 
 	DP_DEBUG_W_VRF(ROUTE, INFO, ROUTE, vrf_id,
@@ -1330,9 +1401,79 @@ int rt_insert(vrfid_t vrf_id, in_addr_t dst, uint8_t depth, uint32_t tableid,
 		       inet_ntop(AF_INET, &dst, b, sizeof(b)),
 		       depth, idx, tableid, scope, size);
 	return 0;
+}
 
-err:
-	return err_code;
+int rt_insert_pathgroup(vrfid_t vrf_id, in_addr_t dst, uint8_t depth,
+			uint32_t tableid, uint8_t scope, uint32_t pathgroup,
+			bool replace)
+{
+	struct next_hop_list *nextl;
+	unsigned int i, size;
+	struct lpm *lpm;
+	struct vrf *vrf;
+	uint32_t idx;
+	int err_code;
+
+	if (tableid == RT_TABLE_LOCAL)
+		tableid = RT_TABLE_MAIN;
+	if (tableid == RT_TABLE_UNSPEC)
+		return -ENOENT;
+
+	vrf = vrf_get_rcu(vrf_id);
+	if (!vrf)
+		return -ENOENT;
+	lpm = rt_get_lpm(&vrf->v_rt4_head, tableid);
+	if (lpm == NULL) {
+		lpm = rt_create_lpm(tableid, vrf);
+		if (lpm == NULL)
+			return -ENOENT;
+	}
+
+	err_code = nh_pathgroup_get(AF_INET, pathgroup, &idx);
+	if (err_code < 0)
+		return err_code;
+
+	nextl = rcu_dereference(nh_tbl.entry[idx]);
+	size = nextl->nsiblings;
+
+	/*
+	 * As in rt_insert, a /32 with a non GW path must not share
+	 * its nexthop, so that the arp entries are linked to its own
+	 * copy of the paths rather than to the group. Such a route
+	 * takes the current paths of the group and does not follow
+	 * later changes to it.
+	 */
+	for (i = 0; depth == 32 && i < size; i++)
+		if (!(nextl->siblings[i].flags & RTF_GATEWAY))
+			break;
+
+	if (depth == 32 && i < size) {
+		uint8_t proto = nextl->proto;
+		struct next_hop *hops;
+		int n;
+
+		hops = next_hop_list_copy_next_hops(nextl, &n);
+		nexthop_put(AF_INET, idx);
+		if (!hops)
+			return -ENOMEM;
+
+		for (i = 0; i < size; i++) {
+			if (hops[i].flags & RTF_GATEWAY)
+				continue;
+
+			assert(hops[i].gateway.address.ip_v4.s_addr == 0);
+			hops[i].gateway.address.ip_v4.s_addr = dst;
+			hops[i].gateway.type = AF_INET;
+		}
+
+		err_code = route_nexthop_new(hops, size, proto, &idx);
+		free(hops);
+		if (err_code < 0)
+			return err_code;
+	}
+
+	return rt_insert_nh(vrf, lpm, dst, depth, tableid, scope, idx,
+			    size, replace);
 }
 
 int rt_delete(vrfid_t vrf_id, in_addr_t dst, uint8_t depth,
@@ -1469,12 +1610,15 @@ route_get_nh_blackhole(void)
 	return nextl_blackhole;
 }
 
+static void route_nhl_replaced(uint32_t nhl_idx, bool fal_upd);
+
 struct nh_common nh4_common = {
 	.nh_hash = nexthop_hashfn,
 	.nh_compare = nexthop_cmpfn,
 	.nh_get_hash_tbl = route_get_nh_hash_table,
 	.nh_get_nh_tbl = route_get_nh_table,
 	.nh_get_blackhole = route_get_nh_blackhole,
+	.nh_replaced = route_nhl_replaced,
 };
 
 void nexthop_tbl_init(void)
@@ -2624,6 +2768,29 @@ static void route_fal_upd_for_changed_nhl(
 	params->call_tracker_cbs = true;
 }
 
+/*
+ * The paths of a next_hop_list have been replaced in place, e.g. for a
+ * path group.  Forwarding already uses the new paths; link them to any
+ * resolved neighbours, and move the platform routes over.
+ */
+static void route_nhl_replaced(uint32_t nhl_idx, bool fal_upd)
+{
+	struct next_hop_list *nhl;
+
+	pthread_mutex_lock(&route_mutex);
+	nhl = rcu_dereference(nh_tbl.entry[nhl_idx]);
+	if (nhl)
+		route_change_process_nh(nhl,
+					routing_arp_add_gw_nh_replace_cb);
+	pthread_mutex_unlock(&route_mutex);
+
+	if (!fal_upd)
+		return;
+
+	rt_lpm_walk_util(route_fal_upd_for_changed_nhl, &nhl_idx);
+	mpls_update_all_routes_for_nh_change(AF_INET, nhl_idx);
+}
+
 static void
 route_handle_fal_l3_enable_change(struct ifnet *ifp)
 {
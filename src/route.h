@@ -59,10 +59,20 @@ void route_uninit(struct vrf *vrf, struct route_head *rt_head);
 struct next_hop *rt_lookup_fast(struct vrf *vrf, in_addr_t dst,
 				uint32_t tblid,
 				const struct rte_mbuf *m);
+void rt_lookup_bulk_fast(struct vrf *vrf, const in_addr_t dsts[],
+			 uint32_t tblid, struct rte_mbuf *const ms[],
+			 struct next_hop *nhs[], unsigned int n);
 
 int rt_insert(vrfid_t vrf_id, in_addr_t dst, uint8_t depth, uint32_t id,
 	      uint8_t scope, uint8_t proto, struct next_hop hops[],
 	      size_t size, bool replace);
+/*
+ * Add or replace a route using the paths of a path group, so that it
+ * follows changes to the group.
+ */
+int rt_insert_pathgroup(vrfid_t vrf_id, in_addr_t dst, uint8_t depth,
+			uint32_t id, uint8_t scope, uint32_t pathgroup,
+			bool replace);
 int rt_delete(vrfid_t vrf_id, in_addr_t dst, uint8_t depth,
 	      uint32_t id, uint8_t scope);
 void rt_flush_all(enum cont_src_en cont_src);
@@ -29,6 +29,11 @@
 #define ROUTE_BROKER_FORMAT_NL 0x0
 /* protobuf format */
 #define ROUTE_BROKER_FORMAT_PB 0x1
+/* protobuf format, each message a batch of updates */
+#define ROUTE_BROKER_FORMAT_PB_BATCH 0x2
+
+/* Max protobuf messages read and applied together */
+#define ROUTE_BROKER_PB_BULK 64
 
 #define BROKER_KEEPALIVE_TIMER_SEC 10
 static struct rte_timer broker_keepalive_timer[CONT_SRC_COUNT];
@@ -39,11 +44,11 @@ static struct rte_timer broker_keepalive_timer[CONT_SRC_COUNT];
  * dpmsg must be already allocated, and caller is responsible for destroying it.
  * Return 0 on success, -1 on error.
  */
-static int dp_rt_msg_recv(zsock_t *sock, zmq_msg_t *route_msg)
+static int dp_rt_msg_recv(zsock_t *sock, zmq_msg_t *route_msg, int flags)
 {
 	zmq_msg_init(route_msg);
 
-	if (zmq_msg_recv(route_msg, zsock_resolve(sock), 0) <= 0)
+	if (zmq_msg_recv(route_msg, zsock_resolve(sock), flags) <= 0)
 		goto error;
 
 	int more = zmq_msg_get(route_msg, ZMQ_MORE);
@@ -67,7 +72,7 @@ static int route_netlink_recv(void *arg)
 	zsock_t *sock = arg;
 
 	errno = 0;
-	int rc = dp_rt_msg_recv(sock, &route_msg);
+	int rc = dp_rt_msg_recv(sock, &route_msg, 0);
 	if (rc != 0) {
 		if (errno == 0)
 			return 0;
@@ -87,22 +92,62 @@ static int route_netlink_recv(void *arg)
 	return 0;
 }
 
+/*
+ * Read the protobuf messages already queued, up to a limit, and apply
+ * them together so that repeated updates for a route are coalesced.
+ */
 static int route_pb_recv(void *arg)
+{
+	zmq_msg_t route_msg[ROUTE_BROKER_PB_BULK];
+	void *data[ROUTE_BROKER_PB_BULK];
+	size_t len[ROUTE_BROKER_PB_BULK];
+	zsock_t *sock = arg;
+	unsigned int i, n;
+
+	errno = 0;
+	int rc = dp_rt_msg_recv(sock, &route_msg[0], 0);
+	if (rc != 0) {
+		if (errno == 0)
+			return 0;
+		return -1;
+	}
+
+	for (n = 1; n < ROUTE_BROKER_PB_BULK; n++)
+		if (dp_rt_msg_recv(sock, &route_msg[n], ZMQ_DONTWAIT) != 0)
+			break;
+
+	for (i = 0; i < n; i++) {
+		data[i] = zmq_msg_data(&route_msg[i]);
+		len[i] = zmq_msg_size(&route_msg[i]);
+	}
+
+	rc = ip_route_pb_handler_bulk(data, len, n, CONT_SRC_MAIN);
+	if (rc)
+		DP_DEBUG(ROUTE, NOTICE, DATAPLANE,
+			 "route message not handled\n");
+
+	for (i = 0; i < n; i++)
+		zmq_msg_close(&route_msg[i]);
+
+	return 0;
+}
+
+static int route_pb_batch_recv(void *arg)
 {
 	zmq_msg_t route_msg;
 	zsock_t *sock = arg;
 
 	errno = 0;
-	int rc = dp_rt_msg_recv(sock, &route_msg);
+	int rc = dp_rt_msg_recv(sock, &route_msg, 0);
 	if (rc != 0) {
 		if (errno == 0)
 			return 0;
 		return -1;
 	}
 
-	rc = ip_route_pb_handler(zmq_msg_data(&route_msg),
-				 zmq_msg_size(&route_msg),
-				 CONT_SRC_MAIN);
+	rc = ip_route_pb_batch_handler(zmq_msg_data(&route_msg),
+				       zmq_msg_size(&route_msg),
+				       CONT_SRC_MAIN);
 	if (rc)
 		DP_DEBUG(ROUTE, NOTICE, DATAPLANE,
 			 "route message not handled\n");
@@ -117,9 +162,22 @@ static int route_pb_recv(void *arg)
  */
 static int
 open_route_broker_data_sock(enum cont_src_en cont_src,
-			    const char *data_url, bool protobuf_fmt)
+			    const char *data_url, uint32_t data_format)
 {
 	zsock_t *data_sock;
+	int (*recv_fn)(void *arg);
+
+	switch (data_format) {
+	case ROUTE_BROKER_FORMAT_PB:
+		recv_fn = route_pb_recv;
+		break;
+	case ROUTE_BROKER_FORMAT_PB_BATCH:
+		recv_fn = route_pb_batch_recv;
+		break;
+	default:
+		recv_fn = route_netlink_recv;
+		break;
+	}
 
 	data_sock = zsock_new(ZMQ_PULL);
 	if (!data_sock)
@@ -130,10 +188,7 @@ open_route_broker_data_sock(enum cont_src_en cont_src,
 
 	cont_src_set_broker_data(cont_src, data_sock);
 
-	dp_register_event_socket(
-		zsock_resolve(data_sock),
-		protobuf_fmt ? route_pb_recv : route_netlink_recv,
-		data_sock);
+	dp_register_event_socket(zsock_resolve(data_sock), recv_fn, data_sock);
 	return 0;
 }
 
@@ -309,8 +364,7 @@ static int broker_ctrl_recv(void *src)
 	}
 	zmsg_popu32(msg, &data_format);
 
-	open_route_broker_data_sock(cont_src, data_url,
-				    data_format == ROUTE_BROKER_FORMAT_PB);
+	open_route_broker_data_sock(cont_src, data_url, data_format);
 	start_route_broker_keepalives(cont_src);
 out:
 	free(str);
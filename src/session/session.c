@@ -7,6 +7,7 @@
  */
 
 #include <errno.h>
+#include <limits.h>
 #include <netinet/icmp6.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
@@ -19,6 +20,7 @@
 #include <rte_jhash.h>
 #include <rte_lcore.h>
 #include <rte_log.h>
+#include <rte_malloc.h>
 #include <rte_mbuf.h>
 #include <rte_spinlock.h>
 #include <rte_timer.h>
@@ -39,6 +41,7 @@
 #include "pktmbuf_internal.h"
 #include "session.h"
 #include "session_feature.h"
+#include "session_private.h"
 #include "urcu.h"
 #include "vplane_log.h"
 #include "npf_pack.h"
@@ -118,11 +121,21 @@
  *
  * There are two reference counts associated with a session - a sentry count
  * and a link count.  As mentioned above, the link count must be cleared
- * for a session to timeout and/or be reclaimed by the sentry table GC.
+ * for a session to timeout and/or be reclaimed by the session GC.
  *
- * Once all sentry and link counts go to zero, the sentry table GC will
+ * Once all sentry and link counts go to zero, the session GC will
  * reclaim the session.
  *
+ * The session GC does not walk the tables.  Each inserted session is on
+ * an expiry wheel, owned by the master lcore, scheduled for the next
+ * time it needs to be looked at: when it may have timed out, or its
+ * next periodic log is due.  Events that need the GC sooner, such as
+ * an explicit expiry or a feature requesting expiry, kick the session
+ * onto the next run.  Each run of the GC only visits the sessions that
+ * are due, up to a budget, so its cost follows the expiry rate rather
+ * than the table size.  A reclaimed session is released from the wheel
+ * and only then handed to call_rcu.
+ *
  * We use two hash tables for managing sessions, one for the sentries
  * themselves and another for sessions.  The session table is
  * used for displaying sessions for the op mode command.
@@ -133,6 +146,17 @@
  * All session and feature data are always freed asynchronously in a
  * call_rcu context.  At the point of feature datum free, the feature
  * is guaranteed that no inflight access can occur.
+ *
+ * Optionally, for RSS-affine deployments where both directions of a
+ * flow arrive on the same forwarding core, each lcore may also have a
+ * private shard of the sentry table.  A shard is a cache-line
+ * bucketed, open-addressed cache of sentries recently found by that
+ * lcore.  A sentry is cached in at most one shard, recorded by its
+ * sen_shard_slot, so flows arriving on another core simply miss in
+ * their shard and fall back to the shared sentry table.  The sentry
+ * table remains the only authority; a sentry is removed from its shard
+ * before it is freed, and shards are never written by anything other
+ * than their own lcore and the sentry delete path.
  */
 
 /* Session id */
@@ -167,6 +191,24 @@ struct ports {
 /* GC Interval (seconds) */
 #define SENTRY_GC_INTERVAL	5
 
+/*
+ * Session GC wheel.  The wheel ticks in seconds of uptime, and is run
+ * once a tick.  Each run expires up to a budget of sessions, and if
+ * more are due the next run follows shortly.
+ */
+#define SESSION_WHEEL_TICK	1	/* seconds */
+#define SESSION_WHEEL_BUDGET	4096
+#define SESSION_WHEEL_RERUN_MS	1
+
+/*
+ * The GC looks at an active session this many times per timeout, so
+ * that it expires no more than this fraction of its timeout late.  It
+ * never looks more often than the old GC walk, every
+ * SENTRY_GC_INTERVAL seconds, so a session with a short timeout may
+ * expire up to that late instead.
+ */
+#define SESSION_IDLE_CHECKS	8
+
 /* Sentry and session hash tables */
 struct cds_lfht *sentry_ht;
 struct cds_lfht *session_ht;
@@ -174,6 +216,68 @@ struct cds_lfht *session_ht;
 /* GC Timer */
 struct rte_timer session_gc_timer;
 
+/*
+ * The wheel is run by the GC timer on the master lcore, and by the UT
+ * helpers, so the lock serialises its owner operations.
+ */
+static struct expiry_wheel session_wheel;
+static rte_spinlock_t session_wheel_lock = RTE_SPINLOCK_INITIALIZER;
+
+/*
+ * Per-lcore sentry shards.  Each bucket is one cache line.  A lookup
+ * probes the hashed bucket and the one after it.
+ */
+#define SENTRY_SHARD_BUCKETS	65536	/* per lcore, power of 2 */
+#define SENTRY_SHARD_ENTRIES	6	/* per bucket */
+#define SENTRY_SHARD_PROBE	2	/* buckets probed */
+
+struct sentry_shard_bucket {
+	uint16_t	sb_sig[SENTRY_SHARD_ENTRIES];
+	uint16_t	sb_next;	/* next entry to evict */
+	struct sentry	*sb_sen[SENTRY_SHARD_ENTRIES];
+} __rte_cache_aligned;
+
+struct sentry_shard {
+	uint64_t	ss_hits;
+	uint64_t	ss_misses;
+	struct sentry_shard_bucket ss_buckets[SENTRY_SHARD_BUCKETS]
+		__rte_cache_aligned;
+};
+
+static struct sentry_shard *sentry_shards[RTE_MAX_LCORE];
+static bool sentry_shard_enabled;
+
+/* sen_shard_slot of a sentry that has been deleted */
+static struct sentry *sentry_shard_dead;
+
+/*
+ * Per-lcore log of the sessions changed since the last dirty walk.
+ * Each log has one producer, its lcore, and one consumer, the main
+ * thread in session_dirty_walk().  Ids are logged rather than pointers
+ * as a session may be freed before its entry is consumed.
+ *
+ * A session is only logged once between walks, so the logs are sized
+ * from the session limit, shared out between the lcores.
+ */
+#define SESSION_DIRTY_LOG_MIN	4096	/* Must be a power of 2 */
+
+struct session_dirty_log {
+	uint32_t	sdl_head;	/* Written by the owning lcore */
+	uint32_t	sdl_mask;	/* Number of ids less one */
+	struct rcu_head	sdl_rcu;
+	uint32_t	sdl_tail __rte_cache_aligned;	/* by the consumer */
+	uint64_t	sdl_ids[] __rte_cache_aligned;
+};
+
+static struct session_dirty_log *session_dirty_logs[RTE_MAX_LCORE];
+bool session_dirty_enabled;
+
+/*
+ * Set when a dirty session could not be logged, so that the next walk
+ * looks at every session.
+ */
+static bool session_dirty_overflow;
+
 /* For GC... */
 static inline int time_after(time_t t0, time_t t1)
 {
@@ -216,6 +320,22 @@ static void session_rcu_free(struct rcu_head *h)
 	free(s);
 }
 
+/* Wheel release callback, the session is now only referenced by RCU */
+static void session_gc_release(struct expiry_wheel *w __unused,
+			       struct ew_entry *e)
+{
+	struct session *s = caa_container_of(e, struct session, se_ew);
+
+	call_rcu(&s->se_rcu_head, session_rcu_free);
+}
+
+/* Have the GC inspect an inserted session on its next run */
+void session_gc_kick(struct session *s)
+{
+	if (s->se_flags & SESSION_INSERTED)
+		ew_kick(&session_wheel, &s->se_ew);
+}
+
 /* Walk function for counting features */
 static int se_feature_count(struct session *s,
 		struct session_feature *sf, void *data)
@@ -344,8 +464,10 @@ void se_expire(struct session *s)
 {
 	uint16_t exp = s->se_flags & ~SESSION_EXPIRED;
 
-	if (rte_atomic16_cmpset(&s->se_flags, exp, (exp | SESSION_EXPIRED)))
+	if (rte_atomic16_cmpset(&s->se_flags, exp, (exp | SESSION_EXPIRED))) {
 		session_feature_session_expire(s);
+		session_gc_kick(s);
+	}
 }
 
 static inline void sl_unlink(struct session_link *sl)
@@ -377,8 +499,11 @@ static void expire_kids(struct session *s)
 	rte_spinlock_unlock(&sl->sl_lock);
 }
 
-/* Reclaim session once all sentries are gone */
-static void session_reclaim(struct session *s)
+/*
+ * Reclaim session once all sentries are gone.  Returns true if the
+ * session was reclaimed.
+ */
+static bool session_reclaim(struct session *s)
 {
 	/*
 	 * N.B. This routine is called from both the GC as well
@@ -394,28 +519,74 @@ static void session_reclaim(struct session *s)
 	 */
 	if (rte_atomic16_test_and_set(&s->se_sen_cnt)) {
 		slot_put();
-		if (s->se_flags & SESSION_INSERTED)
-			cds_lfht_del(session_ht, &s->se_node);
 		rte_atomic32_inc(&session_rcu_counter);
-		call_rcu(&s->se_rcu_head, session_rcu_free);
+		if (s->se_flags & SESSION_INSERTED) {
+			/* Freed once off the wheel */
+			cds_lfht_del(session_ht, &s->se_node);
+			ew_release(&session_wheel, &s->se_ew);
+		} else
+			call_rcu(&s->se_rcu_head, session_rcu_free);
+		return true;
 	}
+	return false;
+}
+
+/*
+ * Remove a deleted sentry from any shard caching it.  Once marked
+ * dead, the sentry can no longer be claimed by a shard.
+ */
+static void sentry_shard_remove(struct sentry *sen)
+{
+	struct sentry **slot;
+
+	slot = uatomic_xchg(&sen->sen_shard_slot, &sentry_shard_dead);
+	if (slot && slot != &sentry_shard_dead)
+		uatomic_cmpxchg(slot, sen, NULL);
 }
 
 /* Unlink a sentry from the hash tables and reclaim. */
 static ALWAYS_INLINE
 void sentry_delete(struct sentry *sen)
 {
-	if (!cds_lfht_del(sentry_ht, &sen->sen_node)) {
-		if (sen->sen_session->se_sen == sen) {
+	struct session *s = sen->sen_session;
+	bool deleted;
+
+	rte_spinlock_lock(&s->se_sen_lock);
+	deleted = !cds_lfht_del(sentry_ht, &sen->sen_node);
+	if (deleted)
+		cds_list_del_init(&sen->sen_list);
+	rte_spinlock_unlock(&s->se_sen_lock);
+
+	if (deleted) {
+		sentry_shard_remove(sen);
+		if (s->se_sen == sen) {
 			/* Clear INIT sentry cache */
-			sen->sen_session->se_sen = NULL;
+			s->se_sen = NULL;
 		}
-		rte_atomic16_dec(&sen->sen_session->se_sen_cnt);
+		rte_atomic16_dec(&s->se_sen_cnt);
 		rte_atomic32_inc(&session_rcu_counter);
 		call_rcu(&sen->sen_rcu_head, sentry_rcu_free);
 	}
 }
 
+/* Delete all sentries of a session */
+static void session_sentries_delete(struct session *s)
+{
+	struct sentry *sen;
+
+	for (;;) {
+		rte_spinlock_lock(&s->se_sen_lock);
+		sen = cds_list_empty(&s->se_sentries) ? NULL :
+			cds_list_entry(s->se_sentries.next, struct sentry,
+				       sen_list);
+		rte_spinlock_unlock(&s->se_sen_lock);
+
+		if (!sen)
+			break;
+		sentry_delete(sen);
+	}
+}
+
 /*
  * Determine a sessions time-to-expire.  Note that this can go negative due
  * the periodic nature of the garbage collection.  Used by show command.
@@ -469,10 +640,14 @@ int reclaim_session(struct session *s, uint64_t uptime)
 	return rc;
 }
 
-/* GC worker routine, Reclaim expired/timedout sessions */
-static void sentry_gc_inspect(struct sentry *sen, uint64_t uptime)
+/*
+ * GC worker routine, Reclaim expired/timedout sessions.  Called with the
+ * session off the wheel; reschedules it for the next time it needs
+ * looking at, unless it is reclaimed.
+ */
+static void session_gc_inspect(struct session *s, uint64_t uptime)
 {
-	struct session *s = sen->sen_session;
+	uint64_t next, step;
 
 	if (s->se_log_creation) {
 		s->se_log_creation = 0;
@@ -494,8 +669,11 @@ static void sentry_gc_inspect(struct sentry *sen, uint64_t uptime)
 	 * If we have children then do nothing, a parent session
 	 * must exist until children are removed.
 	 */
-	if (rte_atomic16_read(&s->se_link_cnt))
+	if (rte_atomic16_read(&s->se_link_cnt)) {
+		ew_schedule(&session_wheel, &s->se_ew,
+			    uptime + SENTRY_GC_INTERVAL);
 		return;
+	}
 
 	/*
 	 * Session reclaimed after all children are unlinked,
@@ -503,23 +681,47 @@ static void sentry_gc_inspect(struct sentry *sen, uint64_t uptime)
 	 */
 	if (reclaim_session(s, uptime)) {
 		s->se_log_periodic = 0;
-		sentry_delete(sen);
-		session_reclaim(s);
+		session_sentries_delete(s);
+
+		/* A sentry was added meanwhile, try again shortly */
+		if (!session_reclaim(s))
+			ew_schedule(&session_wheel, &s->se_ew, uptime + 1);
+		return;
 	}
+
+	/*
+	 * time_after() above is strict, so look again the tick after.
+	 * The session may be used again meanwhile, which only pushes its
+	 * etime out when it is next looked at, so look at it a few times
+	 * per timeout.  Otherwise a session used just after being looked
+	 * at would live for up to twice its timeout.
+	 */
+	next = s->se_etime + 1;
+	step = uptime + RTE_MAX(se_timeout(s) / SESSION_IDLE_CHECKS,
+				(uint32_t)SENTRY_GC_INTERVAL);
+	if (step < next)
+		next = step;
+	if (s->se_log_periodic && s->se_ltime + 1 < next)
+		next = s->se_ltime + 1;
+	ew_schedule(&session_wheel, &s->se_ew, next);
 }
 
-static void sentry_gc_walk(uint64_t uptime)
+static void session_gc_expire(struct expiry_wheel *w __unused,
+			      struct ew_entry *e, uint64_t uptime)
 {
-	struct cds_lfht_iter iter;
-	struct sentry *sen;
+	session_gc_inspect(caa_container_of(e, struct session, se_ew),
+			   uptime);
+}
 
-	/* No point */
-	if (!rte_atomic32_read(&sessions_used))
-		return;
+static void
+sentry_gc(struct rte_timer *timer __rte_unused, void *arg __rte_unused)
+{
+	uint64_t ticks = SESSION_WHEEL_TICK * rte_get_timer_hz();
+	bool more;
 
-	/* Clean the sentry table */
-	cds_lfht_for_each_entry(sentry_ht, &iter, sen, sen_node)
-		sentry_gc_inspect(sen, uptime);
+	rte_spinlock_lock(&session_wheel_lock);
+	more = ew_run(&session_wheel, get_dp_uptime(), SESSION_WHEEL_BUDGET);
+	rte_spinlock_unlock(&session_wheel_lock);
 
 	/*
 	 * Reduce msg flood on a full session table.
@@ -528,20 +730,13 @@ static void sentry_gc_walk(uint64_t uptime)
 	 */
 	if (rte_atomic32_read(&sessions_used) < sessions_max)
 		session_gc_run = true;
-}
-
-static void
-sentry_gc(struct rte_timer *timer __rte_unused, void *arg __rte_unused)
-{
-	uint64_t uptime = get_dp_uptime();
 
-	/* Walk the sentry table */
-	sentry_gc_walk(uptime);
+	if (more)
+		ticks = (SESSION_WHEEL_RERUN_MS * rte_get_timer_hz()) / 1000;
 
 	/* Do it again, as long as we are running */
 	if (running)
-		rte_timer_reset(&session_gc_timer,
-				SENTRY_GC_INTERVAL * rte_get_timer_hz(),
+		rte_timer_reset(&session_gc_timer, ticks,
 				SINGLE, rte_get_master_lcore(),
 				sentry_gc, NULL);
 }
@@ -587,6 +782,98 @@ unsigned long sentry_hash(const struct sentry_packet *sp)
 	return rte_jhash_32b(sp->sp_addrids, sp->sp_len, hash);
 }
 
+/* The shard of the calling lcore, if any */
+static ALWAYS_INLINE struct sentry_shard *sentry_shard_get(void)
+{
+	unsigned int lcore = rte_lcore_id();
+
+	if (!CMM_LOAD_SHARED(sentry_shard_enabled) || lcore >= RTE_MAX_LCORE)
+		return NULL;
+
+	return rcu_dereference(sentry_shards[lcore]);
+}
+
+static ALWAYS_INLINE uint16_t sentry_shard_sig(unsigned long hash)
+{
+	return (hash >> 16) ^ hash;
+}
+
+static ALWAYS_INLINE struct sentry_shard_bucket *
+sentry_shard_bucket(struct sentry_shard *shard, unsigned long hash,
+		    unsigned int probe)
+{
+	return &shard->ss_buckets[(hash + probe) & (SENTRY_SHARD_BUCKETS - 1)];
+}
+
+static ALWAYS_INLINE struct sentry *
+sentry_shard_lookup(struct sentry_shard *shard, unsigned long hash,
+		    const struct sentry_packet *sp)
+{
+	const uint16_t sig = sentry_shard_sig(hash);
+	struct sentry_shard_bucket *b;
+	struct sentry *sen;
+	unsigned int p, i;
+
+	for (p = 0; p < SENTRY_SHARD_PROBE; p++) {
+		b = sentry_shard_bucket(shard, hash, p);
+		for (i = 0; i < SENTRY_SHARD_ENTRIES; i++) {
+			if (b->sb_sig[i] != sig)
+				continue;
+			sen = CMM_LOAD_SHARED(b->sb_sen[i]);
+			if (sen && sentry_match(&sen->sen_node, sp))
+				return sen;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Cache a sentry found in the sentry table in this lcore's shard,
+ * unless it is already in a shard.  Only called by the owning lcore.
+ *
+ * The sentry is stored in the slot before being claimed, so that a
+ * concurrent sentry_shard_remove() either sees the claim and clears
+ * the slot, or has already marked the sentry dead and the claim fails.
+ */
+static void sentry_shard_insert(struct sentry_shard *shard,
+				unsigned long hash, struct sentry *sen)
+{
+	struct sentry_shard_bucket *b = NULL;
+	struct sentry **slot;
+	struct sentry *old;
+	unsigned int p, i = 0;
+
+	if (CMM_LOAD_SHARED(sen->sen_shard_slot))
+		return;
+
+	/* Prefer an empty entry in either bucket, else evict */
+	for (p = 0; p < SENTRY_SHARD_PROBE && !b; p++) {
+		struct sentry_shard_bucket *pb;
+
+		pb = sentry_shard_bucket(shard, hash, p);
+		for (i = 0; i < SENTRY_SHARD_ENTRIES; i++)
+			if (!CMM_LOAD_SHARED(pb->sb_sen[i])) {
+				b = pb;
+				break;
+			}
+	}
+	if (!b) {
+		b = sentry_shard_bucket(shard, hash, 0);
+		i = b->sb_next++ % SENTRY_SHARD_ENTRIES;
+	}
+	slot = &b->sb_sen[i];
+
+	/* Release the evicted sentry so another shard may claim it */
+	old = CMM_LOAD_SHARED(*slot);
+	if (old)
+		uatomic_cmpxchg(&old->sen_shard_slot, slot, NULL);
+
+	b->sb_sig[i] = sentry_shard_sig(hash);
+	uatomic_set(slot, sen);
+	if (uatomic_cmpxchg(&sen->sen_shard_slot, NULL, slot) != NULL)
+		uatomic_cmpxchg(slot, sen, NULL);
+}
+
 /*
  * sentry_table_lookup - Lookup a session based on a
  * packet decomp.
@@ -597,18 +884,34 @@ static int sentry_table_lookup(const struct sentry_packet *sp,
 	unsigned long hash;
 	struct cds_lfht_node *snode;
 	struct cds_lfht_iter iter;
+	struct sentry_shard *shard;
 
 	/* Any? */
 	if (!rte_atomic32_read(&sessions_used))
 		return -ENOENT;
 
 	hash = sentry_hash(sp);
+
+	/* This lcore's own flows first */
+	shard = sentry_shard_get();
+	if (shard) {
+		*sen = sentry_shard_lookup(shard, hash, sp);
+		if (*sen) {
+			shard->ss_hits++;
+			return 0;
+		}
+		shard->ss_misses++;
+	}
+
 	cds_lfht_lookup(sentry_ht, hash, sentry_match, sp, &iter);
 	snode = cds_lfht_iter_get_node(&iter);
 	if (!snode)
 		return -ENOENT;
 
 	*sen = caa_container_of(snode, struct sentry, sen_node);
+
+	if (shard)
+		sentry_shard_insert(shard, hash, *sen);
 	return 0;
 }
 
@@ -629,6 +932,10 @@ static int sentry_insert(const struct sentry_packet *sp, struct sentry *sen,
 	/* session sentry count */
 	rte_atomic16_inc(&s->se_sen_cnt);
 
+	rte_spinlock_lock(&s->se_sen_lock);
+	cds_list_add_tail(&sen->sen_list, &s->se_sentries);
+	rte_spinlock_unlock(&s->se_sen_lock);
+
 	return 0;
 }
 
@@ -722,7 +1029,7 @@ int session_table_destroy_all(void)
 	long dummy;
 	unsigned long count;
 	struct cds_lfht_iter iter;
-	struct sentry *sen;
+	struct session *s;
 
 	/*
 	 * Forcibly delete all existing sessions by
@@ -732,11 +1039,17 @@ int session_table_destroy_all(void)
 	 * perform cleanup correctly.
 	 */
 	if (rte_atomic32_read(&sessions_used)) {
-		cds_lfht_for_each_entry(sentry_ht, &iter, sen, sen_node) {
-			se_expire(sen->sen_session);
-			sentry_gc_inspect(sen, 0);
+		rte_spinlock_lock(&session_wheel_lock);
+		cds_lfht_for_each_entry(session_ht, &iter, s, se_node) {
+			se_expire(s);
+			ew_cancel(&session_wheel, &s->se_ew);
+			session_gc_inspect(s, 0);
 		}
 
+		/* Hand the reclaimed sessions to call_rcu */
+		ew_run(&session_wheel, get_dp_uptime(), 0);
+		rte_spinlock_unlock(&session_wheel_lock);
+
 		/*
 		 * Poll the rcu counter to ensure that all
 		 * call_rcu items have been cleaned up.
@@ -760,15 +1073,284 @@ void session_table_counts(unsigned long *sen_cnt, unsigned long *sess_cnt)
 	cds_lfht_count_nodes(session_ht, &dummy, sess_cnt, &dummy);
 }
 
+/*
+ * Size the tables for count more sessions, each with a forward and a
+ * backward sentry, so a bulk restore doesn't have them resized over
+ * and over as they fill.  Called on the main thread.
+ */
+void session_table_reserve(uint32_t count)
+{
+	unsigned long used = rte_atomic32_read(&sessions_used);
+	unsigned long size;
+
+	if (count < SENTRY_HT_MIN)
+		return;
+
+	size = RTE_MIN(rte_align64pow2(used + count),
+		       (unsigned long)SENTRY_HT_MAX);
+	cds_lfht_resize(session_ht, size);
+
+	size = RTE_MIN(rte_align64pow2(2 * (used + count)),
+		       (unsigned long)SENTRY_HT_MAX);
+	cds_lfht_resize(sentry_ht, size);
+}
+
 /*
  * Get various counts of the sessions and features
  */
 void session_counts(uint32_t *used, uint32_t *max, struct session_counts *sc)
 {
+	unsigned int lcore;
+
 	*used = rte_atomic32_read(&sessions_used);
 	*max = sessions_max;
 
 	session_table_walk(se_counts, sc);
+
+	for (lcore = 0; lcore < RTE_MAX_LCORE; lcore++) {
+		struct sentry_shard *shard = sentry_shards[lcore];
+
+		if (shard) {
+			sc->sc_shard_hits += shard->ss_hits;
+			sc->sc_shard_misses += shard->ss_misses;
+		}
+	}
+}
+
+/*
+ * Enable or disable the per-lcore sentry shards.  Shards are allocated
+ * on first enable, on each lcore's socket, and kept when disabled;
+ * their entries are still removed as sentries are deleted, so they
+ * remain valid for a later enable.
+ */
+int session_set_shard_mode(bool enable)
+{
+	struct sentry_shard *shard;
+	unsigned int lcore;
+
+	if (enable) {
+		RTE_LCORE_FOREACH(lcore) {
+			if (sentry_shards[lcore])
+				continue;
+
+			shard = rte_zmalloc_socket("sentry_shard",
+						   sizeof(*shard),
+						   RTE_CACHE_LINE_SIZE,
+						   rte_lcore_to_socket_id(lcore));
+			if (!shard) {
+				RTE_LOG(ERR, DATAPLANE,
+					"Failed to allocate sentry shard for lcore %u\n",
+					lcore);
+				return -ENOMEM;
+			}
+			rcu_assign_pointer(sentry_shards[lcore], shard);
+		}
+	}
+
+	CMM_STORE_SHARED(sentry_shard_enabled, enable);
+	return 0;
+}
+
+/*
+ * Log a session that has just become dirty on this lcore's log.  If
+ * there is no room, the session is left marked so that the next walk
+ * finds it in the table.
+ */
+void session_dirty_log(struct session *s)
+{
+	unsigned int lcore = rte_lcore_id();
+	struct session_dirty_log *log = NULL;
+	uint32_t head;
+
+	s->se_dirty = 1;
+
+	if (lcore < RTE_MAX_LCORE)
+		log = rcu_dereference(session_dirty_logs[lcore]);
+
+	if (log) {
+		head = log->sdl_head;
+		if (head - CMM_LOAD_SHARED(log->sdl_tail) <= log->sdl_mask) {
+			log->sdl_ids[head & log->sdl_mask] = s->se_id;
+			cmm_smp_wmb();
+			CMM_STORE_SHARED(log->sdl_head, head + 1);
+			return;
+		}
+	}
+
+	CMM_STORE_SHARED(session_dirty_overflow, true);
+}
+
+static void session_dirty_log_rcu_free(struct rcu_head *head)
+{
+	rte_free(caa_container_of(head, struct session_dirty_log, sdl_rcu));
+}
+
+/* Number of ids each lcore's log holds for the current session limit */
+static uint32_t session_dirty_log_size(void)
+{
+	return rte_align32pow2(RTE_MAX((uint32_t)sessions_max /
+				       rte_lcore_count(),
+				       (uint32_t)SESSION_DIRTY_LOG_MIN));
+}
+
+/*
+ * Enable or disable dirty session tracking.  The logs are allocated on
+ * first enable, on each lcore's socket, and kept when disabled.  They
+ * are replaced on a later enable if the session limit has grown.  Marks
+ * left from an earlier enable are not on any log, so the first walk
+ * after enabling looks at the whole table.
+ */
+int session_set_dirty_tracking(bool enable)
+{
+	struct session_dirty_log *log, *old;
+	uint32_t size = session_dirty_log_size();
+	unsigned int lcore;
+
+	if (enable) {
+		RTE_LCORE_FOREACH(lcore) {
+			old = session_dirty_logs[lcore];
+			if (old && old->sdl_mask + 1 >= size)
+				continue;
+
+			log = rte_zmalloc_socket("session_dirty_log",
+						 sizeof(*log) +
+						 size * sizeof(log->sdl_ids[0]),
+						 RTE_CACHE_LINE_SIZE,
+						 rte_lcore_to_socket_id(lcore));
+			if (!log) {
+				RTE_LOG(ERR, DATAPLANE,
+					"Failed to allocate session dirty log for lcore %u\n",
+					lcore);
+				return -ENOMEM;
+			}
+			log->sdl_mask = size - 1;
+			rcu_assign_pointer(session_dirty_logs[lcore], log);
+			if (old)
+				call_rcu(&old->sdl_rcu,
+					 session_dirty_log_rcu_free);
+		}
+		CMM_STORE_SHARED(session_dirty_overflow, true);
+	}
+
+	CMM_STORE_SHARED(session_dirty_enabled, enable);
+	return 0;
+}
+
+static int session_id_match(struct cds_lfht_node *node, const void *key)
+{
+	const struct session *s = caa_container_of(node, struct session,
+						   se_node);
+
+	return s->se_id == *(const uint64_t *)key;
+}
+
+static struct session *session_lookup_by_id(uint64_t id)
+{
+	struct cds_lfht_node *node;
+	struct cds_lfht_iter iter;
+
+	cds_lfht_lookup(session_ht, id, session_id_match, &id, &iter);
+	node = cds_lfht_iter_get_node(&iter);
+	return node ? caa_container_of(node, struct session, se_node) : NULL;
+}
+
+struct session_dirty_walk_data {
+	session_match_t	match;
+	session_walk_t	cb;
+	void		*data;
+};
+
+/*
+ * Clear the mark before issuing the callback, so that a change made
+ * while the callback runs marks the session again.  A session the
+ * walker does not want is cleared too, so that sessions nobody walks
+ * don't pile up on the logs.
+ */
+static int se_dirty_walk(struct session *s, void *data)
+{
+	struct session_dirty_walk_data *dw = data;
+	int rc;
+
+	if (!s->se_dirty)
+		return 0;
+
+	s->se_dirty = 0;
+	cmm_smp_mb();
+
+	if (s->se_flags & SESSION_EXPIRED)
+		return 0;
+
+	if (dw->match && !dw->match(s, dw->data))
+		return 0;
+
+	rc = dw->cb(s, dw->data);
+	if (rc)
+		session_dirty_log(s);
+	return rc;
+}
+
+static int session_dirty_log_walk(struct session_dirty_log *log,
+				  struct session_dirty_walk_data *dw)
+{
+	uint32_t head = CMM_LOAD_SHARED(log->sdl_head);
+	uint32_t tail = log->sdl_tail;
+	struct session *s;
+	int rc = 0;
+
+	cmm_smp_rmb();
+
+	while (tail != head && !rc) {
+		s = session_lookup_by_id(
+			log->sdl_ids[tail & log->sdl_mask]);
+		tail++;
+		if (s)
+			rc = se_dirty_walk(s, dw);
+	}
+
+	cmm_smp_mb();
+	CMM_STORE_SHARED(log->sdl_tail, tail);
+	return rc;
+}
+
+/* Walk the sessions changed since the last walk, and issue the callback */
+int session_dirty_walk(session_match_t match, session_walk_t cb, void *data)
+{
+	struct session_dirty_walk_data dw = {
+		.match = match,
+		.cb = cb,
+		.data = data,
+	};
+	struct session_dirty_log *log;
+	unsigned int lcore;
+	int rc = 0;
+
+	if (!cb)
+		return -ENOENT;
+
+	if (CMM_LOAD_SHARED(session_dirty_overflow)) {
+		CMM_STORE_SHARED(session_dirty_overflow, false);
+		cmm_smp_mb();
+
+		/* The table walk finds every session on the logs */
+		for (lcore = 0; lcore < RTE_MAX_LCORE; lcore++) {
+			log = session_dirty_logs[lcore];
+			if (log)
+				CMM_STORE_SHARED(log->sdl_tail,
+						 CMM_LOAD_SHARED(log->sdl_head));
+		}
+
+		rc = session_table_walk(se_dirty_walk, &dw);
+		if (rc)
+			CMM_STORE_SHARED(session_dirty_overflow, true);
+		return rc;
+	}
+
+	for (lcore = 0; lcore < RTE_MAX_LCORE && !rc; lcore++) {
+		log = session_dirty_logs[lcore];
+		if (log)
+			rc = session_dirty_log_walk(log, &dw);
+	}
+	return rc;
 }
 
 /* Set the max session limit */
@@ -788,9 +1370,12 @@ static void init_tables(void)
 	sentry_ht = cds_lfht_new(SENTRY_HT_INIT, SENTRY_HT_MIN, SENTRY_HT_MAX,
 			CDS_LFHT_AUTO_RESIZE | CDS_LFHT_ACCOUNTING, NULL);
 
+	ew_init(&session_wheel, get_dp_uptime(), session_gc_expire,
+		session_gc_release);
+
 	rte_timer_init(&session_gc_timer);
 	rte_timer_reset(&session_gc_timer,
-			SENTRY_GC_INTERVAL * rte_get_timer_hz(),
+			SESSION_WHEEL_TICK * rte_get_timer_hz(),
 			SINGLE, rte_get_master_lcore(), sentry_gc, NULL);
 
 	session_ht = cds_lfht_new(SENTRY_HT_INIT, SENTRY_HT_MIN, SENTRY_HT_MAX,
@@ -1083,6 +1668,8 @@ static struct sentry *sentry_create(struct session *s,
 
 	cds_lfht_node_init(&sen->sen_node);
 	sen->sen_session = s;
+	sen->sen_shard_slot = NULL;
+	CDS_INIT_LIST_HEAD(&sen->sen_list);
 	sen->sen_ifindex = sp->sp_ifindex;
 	sen->sen_flags = flag | sp->sp_sentry_flags;
 	sen->sen_len = sp->sp_len;
@@ -1217,6 +1804,9 @@ static struct session *se_alloc(void)
 	if (s) {
 		cds_lfht_node_init(&s->se_node);
 		s->se_id = rte_atomic64_add_return(&session_id, 1);
+		ew_entry_init(&s->se_ew);
+		CDS_INIT_LIST_HEAD(&s->se_sentries);
+		rte_spinlock_init(&s->se_sen_lock);
 	}
 
 	return s;
@@ -1279,20 +1869,55 @@ int session_establish(struct rte_mbuf *m, const struct ifnet *ifp,
 			ifp, timeout, se, created);
 }
 
+/*
+ * The timeout of a session has changed.  If it is now shorter, the GC
+ * may not be due to look at the session until after it should expire,
+ * so have the GC restart its idle timer on its next run.
+ */
+static void se_timeout_changed(struct session *s, uint32_t old)
+{
+	if (se_timeout(s) >= old)
+		return;
+
+	if (s->se_idle)
+		s->se_idle = 0;
+	session_gc_kick(s);
+}
+
 /* Set the protocol timeout, and current protocol state */
 void session_set_protocol_state_timeout(struct session *s, uint8_t state,
 					enum dp_session_state gen_state,
 					uint32_t timeout)
 {
+	uint32_t old = se_timeout(s);
+
 	s->se_timeout = timeout;
-	s->se_protocol_state = state;
-	s->se_gen_state = gen_state;
+	se_timeout_changed(s, old);
+
+	if (s->se_protocol_state != state || s->se_gen_state != gen_state) {
+		s->se_protocol_state = state;
+		s->se_gen_state = gen_state;
+		session_mark_dirty(s);
+	}
 }
 
 /* Set the custom timeout */
 void session_set_custom_timeout(struct session *s, uint32_t timeout)
 {
+	uint32_t old = se_timeout(s);
+
 	s->se_custom_timeout = timeout;
+	se_timeout_changed(s, old);
+}
+
+/* Set the expiry time of a session, as updated by a peer */
+void session_set_etime(struct session *s, uint64_t etime)
+{
+	bool sooner = !s->se_etime || time_after(s->se_etime, etime);
+
+	s->se_etime = etime;
+	if (sooner)
+		session_gc_kick(s);
 }
 
 /* Insert forw/back sentries based on packet. */
@@ -1666,6 +2291,7 @@ int session_create_from_sentry_packets(struct rte_mbuf *m,
 	/* Add the session to the session hash table.  */
 	cds_lfht_add(session_ht, s->se_id, &s->se_node);
 	s->se_flags = SESSION_INSERTED;
+	session_gc_kick(s);
 
 	cache_sentry(m, sen_forw);
 
@@ -1689,16 +2315,42 @@ int session_lookup_by_sentry_packet(const struct sentry_packet *sp,
 	return rc;
 }
 
+/* Inspect every session now, as if each was due at 'uptime' */
+static void session_gc_inspect_all(uint64_t uptime)
+{
+	struct cds_lfht_iter iter;
+	struct session *s;
+
+	cds_lfht_for_each_entry(session_ht, &iter, s, se_node) {
+		ew_cancel(&session_wheel, &s->se_ew);
+		session_gc_inspect(s, uptime);
+	}
+}
+
+/* Used by session UTs to run the GC wheel as the GC timer would */
+void session_gc_run(void)
+{
+	rte_spinlock_lock(&session_wheel_lock);
+	ew_run(&session_wheel, get_dp_uptime(), UINT_MAX);
+	rte_spinlock_unlock(&session_wheel_lock);
+}
+
 /* Used by session UTs to simulate the GC clearing out idle sessions */
 void session_gc(void)
 {
 	uint64_t uptime = get_dp_uptime();
 
-	/* Sets the idle flag on each session */
-	sentry_gc_walk(uptime);
+	rte_spinlock_lock(&session_wheel_lock);
+
+	/* Pick up new sessions, and set the idle flag on each session */
+	ew_run(&session_wheel, uptime, UINT_MAX);
+	session_gc_inspect_all(uptime);
 
 	/* Simulate time into the future */
-	sentry_gc_walk(uptime + (10 * SENTRY_GC_INTERVAL));
+	session_gc_inspect_all(uptime + (10 * SENTRY_GC_INTERVAL));
+	ew_run(&session_wheel, uptime, 0);
+
+	rte_spinlock_unlock(&session_wheel_lock);
 }
 
 /* Allocate/init a session struct (for session syncing) */
@@ -1937,6 +2589,7 @@ int session_npf_pack_restore(struct npf_pack_dp_session *pds,
 	if (rc) 
 		goto error;
 
+	session_gc_kick(s);
 	*session = s;
 	return 0;
 
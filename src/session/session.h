@@ -16,6 +16,7 @@
 #include <stdint.h>
 #include <urcu/list.h>
 
+#include "expiry_wheel.h"
 #include "if_var.h"
 #include "urcu.h"
 #include "util.h"
@@ -130,6 +131,8 @@ struct sentry {
 	struct cds_lfht_node	sen_node;
 	struct rcu_head		sen_rcu_head;
 	struct session		*sen_session;
+	struct sentry		**sen_shard_slot; /* per-lcore shard slot */
+	struct cds_list_head	sen_list;	/* on session se_sentries */
 	uint32_t		sen_ifindex;
 	uint16_t		sen_flags;
 	uint8_t			sen_len;
@@ -176,7 +179,7 @@ struct session {
 	rte_atomic16_t		se_sen_cnt;	/* Sentry count */
 	uint16_t		se_flags;
 	uint8_t			se_protocol;
-	uint8_t			pad1;
+	uint8_t			se_dirty;	/* changed since dirty walk */
 	struct session_link	*se_link;	/* For linking of sessions */
 	struct sentry		*se_sen;	/* Cached INIT sentry */
 	uint64_t		se_id;		/* id of this session */
@@ -212,6 +215,9 @@ struct session {
 	rte_atomic64_t		se_pkts_out;
 	rte_atomic64_t		se_bytes_out;
 	void			*se_private;
+	struct ew_entry		se_ew;		/* on the session GC wheel */
+	struct cds_list_head	se_sentries;	/* sentries of this session */
+	rte_spinlock_t		se_sen_lock;	/* for se_sentries */
 };
 
 static_assert(offsetof(struct session, se_rcu_head) == 64,
@@ -229,6 +235,8 @@ struct session_counts {
 	uint32_t	sc_icmp;	/* icmp sessions */
 	uint32_t	sc_icmp6;	/* icmp-v6 sessions */
 	uint32_t	sc_other;	/* All else */
+	uint64_t	sc_shard_hits;	/* lookups hit in a per-lcore shard */
+	uint64_t	sc_shard_misses; /* lookups from a shard to the table */
 	/* Counts of various feature types */
 	uint32_t	sc_feature_counts[SESSION_FEATURE_END+1];
 };
@@ -557,6 +565,35 @@ int session_sentry_insert(struct session *se, uint32_t if_index, uint16_t flags,
  */
 void session_set_max_sessions(uint32_t max);
 
+/**
+ * Per-lcore sentry shards
+ *
+ * Called by CLI only.  Enables or disables the per-lcore sentry shards
+ * used to look up flows that stay on one forwarding core.
+ *
+ * @param enable
+ * True to enable the shards.
+ *
+ * @return
+ * 0 on success, -ENOMEM if the shards could not be allocated.
+ */
+int session_set_shard_mode(bool enable);
+
+/**
+ * Dirty session tracking
+ *
+ * Enables or disables the per-lcore logs of the sessions whose state or
+ * counters have changed since the last session_dirty_walk().  The first
+ * walk after enabling visits every session already marked dirty.
+ *
+ * @param enable
+ * True to enable tracking.
+ *
+ * @return
+ * 0 on success, -ENOMEM if the logs could not be allocated.
+ */
+int session_set_dirty_tracking(bool enable);
+
 /**
  * Set global logging configuration
  *
@@ -596,6 +633,16 @@ void session_counts(uint32_t *used, uint32_t *max, struct session_counts *sc);
  */
 void session_table_counts(unsigned long *sen_cnt, unsigned long *sess_cnt);
 
+/**
+ * Reserve space in the session and sentry hash tables.
+ *
+ * Used before restoring a batch of sessions.
+ *
+ * @param count
+ * Number of sessions about to be added.
+ */
+void session_table_reserve(uint32_t count);
+
 /**
  * Base parent
  *
@@ -648,6 +695,17 @@ void session_set_protocol_state_timeout(struct session *s, uint8_t state,
  */
 void session_set_custom_timeout(struct session *s, uint32_t timeout);
 
+/**
+ * Set the expiry time of a session, as updated by a peer
+ *
+ * @param s
+ * The session.
+ *
+ * @param etime
+ * The expiry time, in seconds of dataplane uptime.
+ */
+void session_set_etime(struct session *s, uint64_t etime);
+
 /**
  * Init
  *
@@ -836,10 +894,35 @@ void session_unlink_all(struct session *s);
  */
 typedef int (*sentry_walk_t)(struct sentry *sen, void *data);
 typedef int (*session_walk_t)(struct session *s, void *data);
+typedef bool (*session_match_t)(struct session *s, void *data);
 
 int sentry_table_walk(sentry_walk_t cb, void *data);
 int session_table_walk(session_walk_t cb, void *data);
 
+/**
+ * Walk the dirty sessions
+ *
+ * Issue the callback for each session changed since the last walk,
+ * clearing its dirty mark first.  Falls back to a walk of the whole
+ * table, skipping clean sessions, if any log overflowed.  Main thread
+ * only.
+ *
+ * @param match
+ * If not NULL, selects the sessions to walk.  Any other dirty session
+ * is no longer dirty after the walk.
+ *
+ * @param cb
+ * The callback.  If it returns non-zero the walk stops, and the session
+ * stays dirty.
+ *
+ * @param data
+ * Passed to match and the callback.
+ *
+ * @return
+ * The return of the last callback, or -ENOENT if cb is NULL.
+ */
+int session_dirty_walk(session_match_t match, session_walk_t cb, void *data);
+
 
 /**
  * Walk linked sessions.
@@ -920,6 +1003,12 @@ void session_sentry_extract_addrs(const struct sentry *sen, int *af,
  */
 void session_gc(void);
 
+/**
+ * Run the session GC wheel once, as the GC timer would.  Only used by
+ * the Unit tests.
+ */
+void session_gc_run(void);
+
 /**
  * Session alloc
  *
@@ -952,6 +1041,21 @@ static inline uint64_t session_get_id(struct session *s)
 	return 0;
 }
 
+extern bool session_dirty_enabled;
+
+void session_dirty_log(struct session *s);
+
+/*
+ * Mark a session as changed since the last dirty walk.  Only the first
+ * change is logged, so this is a load and a branch for a session that
+ * is already dirty.
+ */
+static inline void session_mark_dirty(struct session *s)
+{
+	if (unlikely(CMM_LOAD_SHARED(session_dirty_enabled)) && !s->se_dirty)
+		session_dirty_log(s);
+}
+
 /**
  * Save session stats.
  *
@@ -975,6 +1079,7 @@ static inline void se_save_stats(struct session *s,
 		rte_atomic64_inc(&s->se_pkts_out);
 		rte_atomic64_add(&s->se_bytes_out, bytes);
 	}
+	session_mark_dirty(s);
 }
 
 #endif /* _SESSION_H_ */
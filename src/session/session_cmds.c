@@ -341,6 +341,8 @@ static void cmd_session_show_summary(FILE *fp)
 	jsonw_uint_field(json, "nat", sc.sc_nat);
 	jsonw_uint_field(json, "nat64", sc.sc_nat64);
 	jsonw_uint_field(json, "nat46", sc.sc_nat46);
+	jsonw_uint_field(json, "shard_hits", sc.sc_shard_hits);
+	jsonw_uint_field(json, "shard_misses", sc.sc_shard_misses);
 
 	npf_print_state_stats(json);
 
@@ -982,6 +984,27 @@ static int cmd_cfg_max_sessions(FILE *f, int argc, char **argv)
 	return 0;
 }
 
+static int cmd_cfg_shard_sessions(FILE *f, int argc, char **argv)
+{
+	bool enable;
+
+	if (!argc) {
+		cmd_err(f, "missing sessions-shard on|off");
+		return -EINVAL;
+	}
+
+	if (!strcmp(argv[0], "on"))
+		enable = true;
+	else if (!strcmp(argv[0], "off"))
+		enable = false;
+	else {
+		cmd_err(f, "invalid sessions-shard value: %s", argv[0]);
+		return -EINVAL;
+	}
+
+	return session_set_shard_mode(enable);
+}
+
 /*
  * Parse a session log item with optional value. Currently supported are:
  * "creation=on|off", "deletion=on|off", "periodic=<time-in-seconds>".
@@ -1085,6 +1108,7 @@ enum cmd_op {
 enum cmd_cfg {
 	CFG_MAX_SESSIONS,
 	CFG_LOGGING,
+	CFG_SHARD,
 };
 
 static const struct session_command session_cmd_op[] = {
@@ -1138,7 +1162,11 @@ static const struct session_command session_cmd_cfg[] = {
 	[CFG_LOGGING] = {
 		.tokens = "logging",
 		.handler = cmd_cfg_session_logging,
-	}
+	},
+	[CFG_SHARD] = {
+		.tokens = "sessions-shard",
+		.handler = cmd_cfg_shard_sessions,
+	},
 };
 
 static __attribute__((constructor)) void
@@ -16,4 +16,7 @@
 
 extern const struct session_feature_ops *feature_operations[];
 
+/* Have the GC inspect a session on its next run */
+void session_gc_kick(struct session *s);
+
 #endif /* SESSION_PRIVATE_H */
@@ -98,6 +98,13 @@ struct dp_session_walk_data {
 	void *data;
 };
 
+static bool session_walk_match(struct session *session, void *data)
+{
+	struct dp_session_walk_data *wd = (struct dp_session_walk_data *)data;
+
+	return check_session_type(session, wd->types);
+}
+
 static int session_walk_cb(struct session *session, void *data)
 {
 	struct dp_session_walk_data *wd = (struct dp_session_walk_data *)data;
@@ -116,3 +123,17 @@ int dp_session_table_walk(dp_session_walk_t *fn, void *data, unsigned int types)
 	return session_table_walk(session_walk_cb,  &wd);
 }
 
+
+int dp_session_dirty_track(bool enable)
+{
+	return session_set_dirty_tracking(enable);
+}
+
+int dp_session_dirty_walk(dp_session_walk_t *fn, void *data, unsigned int types)
+{
+	struct dp_session_walk_data wd = { .types = types,
+					   .fn = fn,
+					   .data = data,
+					  };
+	return session_dirty_walk(session_walk_match, session_walk_cb, &wd);
+}
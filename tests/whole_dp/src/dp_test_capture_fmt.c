@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Test formatting of captured packets
+ */
+
+#include <string.h>
+#include <rte_ether.h>
+#include <rte_mbuf.h>
+
+#include "capture_fmt.h"
+
+#include "dp_test_controller.h"
+#include "dp_test_pktmbuf_lib_internal.h"
+#include "dp_test/dp_test_macros.h"
+
+#define CAP_FMT_TPID	0x88a8
+#define CAP_FMT_TCI	0x2064
+
+DP_DECL_TEST_SUITE(capture_fmt);
+
+static struct rte_mbuf *cap_fmt_pak(int n, const int *len)
+{
+	struct rte_mbuf *m;
+
+	m = dp_test_create_ipv4_pak("10.0.0.1", "10.0.0.2", n, len);
+	dp_test_fail_unless(m, "Failed to create packet");
+	(void)dp_test_pktmbuf_eth_init(m, "aa:bb:cc:dd:ee:ff",
+				       "aa:bb:cc:dd:ee:01",
+				       RTE_ETHER_TYPE_IPV4);
+	return m;
+}
+
+static void cap_fmt_check_block(const char *block, uint32_t type,
+				size_t len)
+{
+	const struct pcapng_block_hdr *hdr =
+		(const struct pcapng_block_hdr *)block;
+	uint32_t trailer;
+
+	memcpy(&trailer, block + len - sizeof(trailer), sizeof(trailer));
+	dp_test_fail_unless(hdr->type == type,
+			    "Block type %#x, expected %#x", hdr->type, type);
+	dp_test_fail_unless(hdr->total_len == len && trailer == len,
+			    "Block lengths %u and %u, expected %zu",
+			    hdr->total_len, trailer, len);
+	dp_test_fail_unless(len % sizeof(uint32_t) == 0,
+			    "Block length %zu not padded", len);
+}
+
+DP_DECL_TEST_CASE(capture_fmt, pcapng, NULL, NULL);
+
+/*
+ * A section starts with a section header and a description of the
+ * interface, giving its name and the snaplen.
+ */
+DP_START_TEST(pcapng, header)
+{
+	char buf[256];
+	const struct pcapng_shb *shb = (const struct pcapng_shb *)buf;
+	const struct pcapng_idb *idb;
+	const struct pcapng_opt *opt;
+	size_t len, shb_len;
+
+	memset(buf, 0xff, sizeof(buf));
+	len = capture_fmt_pcapng_hdr(buf, "dp1T1", 96);
+	dp_test_fail_unless(len == capture_fmt_pcapng_hdr_len("dp1T1"),
+			    "Header length %zu, expected %zu", len,
+			    capture_fmt_pcapng_hdr_len("dp1T1"));
+
+	shb_len = sizeof(*shb) + sizeof(uint32_t);
+	cap_fmt_check_block(buf, PCAPNG_SHB_TYPE, shb_len);
+	dp_test_fail_unless(shb->byte_order_magic == PCAPNG_BYTE_ORDER_MAGIC &&
+			    shb->major == 1 && shb->minor == 0 &&
+			    shb->section_len == -1,
+			    "Bad section header");
+
+	idb = (const struct pcapng_idb *)(buf + shb_len);
+	cap_fmt_check_block((const char *)idb, PCAPNG_IDB_TYPE,
+			    len - shb_len);
+	dp_test_fail_unless(idb->linktype == PCAPNG_LINKTYPE_ETHERNET &&
+			    idb->snaplen == 96,
+			    "Bad interface description");
+
+	opt = (const struct pcapng_opt *)(idb + 1);
+	dp_test_fail_unless(opt->code == PCAPNG_OPT_IF_NAME &&
+			    opt->len == strlen("dp1T1") &&
+			    !memcmp(opt + 1, "dp1T1", opt->len),
+			    "Bad interface name option");
+	dp_test_fail_unless(((const char *)(opt + 1))[opt->len] == 0,
+			    "Interface name option not padded with zeros");
+
+	opt = (const struct pcapng_opt *)((const char *)(opt + 1) + 8);
+	dp_test_fail_unless(opt->code == PCAPNG_OPT_ENDOFOPT && opt->len == 0,
+			    "Options not ended");
+} DP_END_TEST;
+
+/*
+ * A packet block holds the first caplen bytes of the packet, padded,
+ * with the length on the wire and the time in microseconds.
+ */
+DP_START_TEST(pcapng, packet)
+{
+	int plen[] = { 40, 60 };
+	struct timeval ts = { .tv_sec = 1600000000, .tv_usec = 123456 };
+	uint64_t usecs = 1600000000ull * 1000000 + 123456;
+	char buf[256], data[256];
+	const struct pcapng_epb *epb = (const struct pcapng_epb *)buf;
+	const void *src;
+	struct rte_mbuf *m;
+	uint32_t caplen;
+	size_t len;
+
+	/* Two segments, so that the copy has to cross from one to the next */
+	m = cap_fmt_pak(2, plen);
+	caplen = rte_pktmbuf_pkt_len(m) - 11;
+
+	memset(buf, 0xff, sizeof(buf));
+	len = capture_fmt_pcapng_epb(buf, m, CAP_FMT_TPID, &ts,
+				     rte_pktmbuf_pkt_len(m), caplen);
+	dp_test_fail_unless(len == capture_fmt_pcapng_epb_len(caplen),
+			    "Packet block length %zu, expected %zu", len,
+			    capture_fmt_pcapng_epb_len(caplen));
+	cap_fmt_check_block(buf, PCAPNG_EPB_TYPE, len);
+
+	dp_test_fail_unless(epb->if_id == 0, "Bad interface id %u",
+			    epb->if_id);
+	dp_test_fail_unless(epb->ts_high == usecs >> 32 &&
+			    epb->ts_low == (uint32_t)usecs,
+			    "Bad timestamp %u:%u", epb->ts_high, epb->ts_low);
+	dp_test_fail_unless(epb->caplen == caplen &&
+			    epb->len == rte_pktmbuf_pkt_len(m),
+			    "Captured %u of %u, expected %u of %u",
+			    epb->caplen, epb->len, caplen,
+			    rte_pktmbuf_pkt_len(m));
+
+	src = rte_pktmbuf_read(m, 0, caplen, data);
+	dp_test_fail_unless(src, "Failed to read packet");
+	dp_test_fail_unless(!memcmp(epb + 1, src, caplen),
+			    "Captured bytes differ from the packet");
+	dp_test_fail_unless(((const char *)(epb + 1))[caplen] == 0,
+			    "Packet data not padded with zeros");
+
+	rte_pktmbuf_free(m);
+} DP_END_TEST;
+
+DP_DECL_TEST_CASE(capture_fmt, vlan, NULL, NULL);
+
+/*
+ * A VLAN tag held in the mbuf is put back in the frame, behind the
+ * interface's TPID, and adds to the captured length.
+ */
+DP_START_TEST(vlan, vlan_rebuilt)
+{
+	int plen[] = { 60 };
+	char orig[128], data[128];
+	struct rte_mbuf *m;
+	unsigned int len;
+
+	m = cap_fmt_pak(1, plen);
+	len = rte_pktmbuf_pkt_len(m);
+	memcpy(orig, rte_pktmbuf_mtod(m, char *), len);
+
+	dp_test_fail_unless(capture_fmt_vlan_len(m) == 0,
+			    "Untagged packet has a VLAN header");
+	capture_fmt_data(m, CAP_FMT_TPID, data, len);
+	dp_test_fail_unless(!memcmp(data, orig, len),
+			    "Untagged packet changed");
+
+	m->ol_flags |= PKT_RX_VLAN;
+	m->vlan_tci = CAP_FMT_TCI;
+	dp_test_fail_unless(capture_fmt_vlan_len(m) == 4,
+			    "Tagged packet has no VLAN header");
+
+	capture_fmt_data(m, CAP_FMT_TPID, data, len + 4);
+	dp_test_fail_unless(!memcmp(data, orig, 2 * RTE_ETHER_ADDR_LEN),
+			    "Addresses changed");
+	dp_test_fail_unless(data[12] == (char)(CAP_FMT_TPID >> 8) &&
+			    data[13] == (char)(CAP_FMT_TPID & 0xff),
+			    "TPID not rebuilt");
+	dp_test_fail_unless(data[14] == (char)(CAP_FMT_TCI >> 8) &&
+			    data[15] == (char)(CAP_FMT_TCI & 0xff),
+			    "TCI not rebuilt");
+	dp_test_fail_unless(!memcmp(data + 16, orig + 12, len - 12),
+			    "Ether type and payload not after the tag");
+
+	/* Truncated within the tag */
+	memset(data, 0, sizeof(data));
+	capture_fmt_data(m, CAP_FMT_TPID, data, 14);
+	dp_test_fail_unless(data[12] == (char)(CAP_FMT_TPID >> 8) &&
+			    data[14] == 0,
+			    "Copy not truncated within the tag");
+
+	rte_pktmbuf_free(m);
+} DP_END_TEST;
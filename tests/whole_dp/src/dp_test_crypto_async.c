@@ -0,0 +1,592 @@
+/*-
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Whole dataplane tests of ESP through the asynchronous crypto PMDs
+ */
+#include <stdbool.h>
+
+#include <arpa/inet.h>
+#include <linux/xfrm.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <rte_ether.h>
+
+#include "if_var.h"
+#include "ip_funcs.h"
+
+#include "dp_test.h"
+#include "dp_test_lib_internal.h"
+#include "dp_test_lib_exp.h"
+#include "dp_test_lib_intf_internal.h"
+#include "dp_test_pktmbuf_lib_internal.h"
+#include "dp_test_crypto_lib.h"
+#include "dp_test_crypto_utils.h"
+#include "dp_test_netlink_state_internal.h"
+#include "dp_test/dp_test_macros.h"
+
+/*
+ * The tests in this module send packets through AES-CBC/HMAC-SHA1
+ * SAs with extended sequence numbers (ESN), which are handed to the
+ * crypto device of their PMD and completed on a later poll. The ESP
+ * packets are built and checked here with openssl rather than against
+ * captured ciphertext, so that the ICV can be shown to cover seq_hi.
+ *
+ *           10.10.1.0/24                             10.10.3.0/24
+ *           (WEST net)                                (EAST net)
+ *
+ * +----------+        +---------+          +--------+
+ * |          |.1    .2|         | .2    .3 |        |
+ * |  Source  +--------+  LOCAL  +----------+  PEER  +---- EAST net
+ * |          |  dp1T1 |         | dp2T2    |        |
+ * +----------+        +---------+          +--------+
+ *                         10.10.2.0/24
+ */
+
+#define WEST_PREFIX          "10.10.1.0/24"
+#define SOURCE_ADDRESS       "10.10.1.1"
+#define SOURCE_MAC_ADDRESS   "aa:bb:cc:dd:1:1"
+#define LOCAL_PREFIX_WEST    "10.10.1.2/24"
+#define LOCAL_ADDRESS_TRANSIT "10.10.2.2"
+#define LOCAL_PREFIX_TRANSIT LOCAL_ADDRESS_TRANSIT "/24"
+#define PEER_ADDRESS         "10.10.2.3"
+#define PEER_MAC_ADDRESS     "aa:bb:cc:dd:2:3"
+#define EAST_PREFIX          "10.10.3.0/24"
+#define DESTINATION_ADDRESS  "10.10.3.4"
+
+#define ESN_SPI_OUT	0x1001
+#define ESN_SPI_IN	0x1002
+#define ESN_REQID	1234
+
+#define ESN_ESP_HDR_LEN	8
+#define ESN_IV_LEN	16
+#define ESN_ICV_LEN	12
+#define ESN_BLOCK_LEN	16
+#define ESN_MAX_CT_LEN	256
+
+/* Packets checked one by one against what they should be */
+#define ESN_PKTS	4
+
+/* Packets queued without waiting, so some are on the crypto device */
+#define INFLIGHT_PKTS	64
+
+static const unsigned char esn_cipher_key[] = {
+	0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+	0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+	0x60, 0x3d, 0xeb, 0x10, 0x15, 0xca, 0x71, 0xbe,
+	0x2b, 0x73, 0xae, 0xf0, 0x85, 0x7d, 0x77, 0x81
+};
+
+static const unsigned char esn_auth_key[] = {
+	0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b,
+	0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b,
+	0x0b, 0x0b, 0x0b, 0x0b
+};
+
+static struct dp_test_crypto_policy output_policy = {
+	.d_prefix = EAST_PREFIX,
+	.s_prefix = WEST_PREFIX,
+	.proto = 0,
+	.dst = PEER_ADDRESS,
+	.dst_family = AF_INET,
+	.dir = XFRM_POLICY_OUT,
+	.family = AF_INET,
+	.reqid = ESN_REQID,
+	.priority = 0,
+	.mark = 0,
+	.vrfid = VRF_DEFAULT_ID
+};
+
+static struct dp_test_crypto_policy input_policy = {
+	.d_prefix = WEST_PREFIX,
+	.s_prefix = EAST_PREFIX,
+	.proto = 0,
+	.dst = LOCAL_ADDRESS_TRANSIT,
+	.dst_family = AF_INET,
+	.dir = XFRM_POLICY_IN,
+	.family = AF_INET,
+	.reqid = ESN_REQID,
+	.priority = 0,
+	.mark = 0,
+	.vrfid = VRF_DEFAULT_ID
+};
+
+static struct dp_test_crypto_sa output_sa = {
+	.cipher_algo = CRYPTO_CIPHER_AES_CBC,
+	.cipher_key = esn_cipher_key,
+	.cipher_key_len = sizeof(esn_cipher_key) * 8,
+	.auth_algo = CRYPTO_AUTH_HMAC_SHA1,
+	.auth_key = esn_auth_key,
+	.auth_key_len = sizeof(esn_auth_key) * 8,
+	.auth_trunc_key = esn_auth_key,
+	.auth_trunc_key_len = sizeof(esn_auth_key) * 8,
+	.spi = ESN_SPI_OUT,
+	.d_addr = PEER_ADDRESS,
+	.s_addr = LOCAL_ADDRESS_TRANSIT,
+	.family = AF_INET,
+	.mode = XFRM_MODE_TUNNEL,
+	.reqid = ESN_REQID,
+	.mark = 0,
+	.vrfid = VRF_DEFAULT_ID,
+	.flags = XFRM_STATE_ESN
+};
+
+static struct dp_test_crypto_sa input_sa = {
+	.cipher_algo = CRYPTO_CIPHER_AES_CBC,
+	.cipher_key = esn_cipher_key,
+	.cipher_key_len = sizeof(esn_cipher_key) * 8,
+	.auth_algo = CRYPTO_AUTH_HMAC_SHA1,
+	.auth_key = esn_auth_key,
+	.auth_key_len = sizeof(esn_auth_key) * 8,
+	.auth_trunc_key = esn_auth_key,
+	.auth_trunc_key_len = sizeof(esn_auth_key) * 8,
+	.spi = ESN_SPI_IN,
+	.d_addr = LOCAL_ADDRESS_TRANSIT,
+	.s_addr = PEER_ADDRESS,
+	.family = AF_INET,
+	.mode = XFRM_MODE_TUNNEL,
+	.reqid = ESN_REQID,
+	.mark = 0,
+	.vrfid = VRF_DEFAULT_ID,
+	.flags = XFRM_STATE_ESN
+};
+
+DP_DECL_TEST_SUITE(crypto_async);
+
+/*
+ * HMAC-SHA1-96 ICV over an ESP packet from its header to the end of
+ * the ciphertext. With ESN the high order 32 bits of the sequence
+ * number are authenticated after the ciphertext, though not sent
+ * (RFC 4303 section 2.2.1).
+ */
+static void
+esn_icv(const uint8_t *esp, unsigned int len, bool esn, uint32_t seq_hi,
+	uint8_t icv[ESN_ICV_LEN])
+{
+	uint32_t seq_hi_n = htonl(seq_hi);
+	uint8_t md[EVP_MAX_MD_SIZE];
+	unsigned int md_len;
+	HMAC_CTX *ctx;
+	bool ok;
+
+	ctx = HMAC_CTX_new();
+	dp_test_fail_unless(ctx, "Failed to allocate HMAC context");
+
+	ok = HMAC_Init_ex(ctx, esn_auth_key, sizeof(esn_auth_key),
+			  EVP_sha1(), NULL) &&
+		HMAC_Update(ctx, esp, len);
+	if (ok && esn)
+		ok = HMAC_Update(ctx, (uint8_t *)&seq_hi_n,
+				 sizeof(seq_hi_n));
+	if (ok)
+		ok = HMAC_Final(ctx, md, &md_len);
+	HMAC_CTX_free(ctx);
+
+	dp_test_fail_unless(ok, "Failed to compute ICV");
+	memcpy(icv, md, ESN_ICV_LEN);
+}
+
+static void
+esn_cbc(const uint8_t *iv, const uint8_t *in, uint8_t *out, int len,
+	bool encrypt)
+{
+	EVP_CIPHER_CTX *ctx;
+	int out_len = 0;
+	bool ok;
+
+	ctx = EVP_CIPHER_CTX_new();
+	dp_test_fail_unless(ctx, "Failed to allocate cipher context");
+
+	ok = EVP_CipherInit_ex(ctx, EVP_aes_256_cbc(), NULL,
+			       esn_cipher_key, iv, encrypt) == 1 &&
+		EVP_CIPHER_CTX_set_padding(ctx, 0) == 1 &&
+		EVP_CipherUpdate(ctx, out, &out_len, in, len) == 1;
+	EVP_CIPHER_CTX_free(ctx);
+
+	dp_test_fail_unless(ok && out_len == len, "AES-CBC failed");
+}
+
+/*
+ * What an encrypted packet leaving on dp2T2 should hold, and the IV
+ * of the one before it.
+ */
+struct esn_out_ctx {
+	uint8_t inner[ESN_MAX_CT_LEN];
+	uint16_t inner_len;
+	uint32_t seq;
+	uint8_t last_iv[ESN_IV_LEN];
+	const char *file;
+	int line;
+};
+
+static void
+esn_out_ctx_init(struct esn_out_ctx *ctx, struct rte_mbuf *inner,
+		 const char *file, int line)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->inner_len = ntohs(iphdr(inner)->tot_len);
+	dp_test_assert_internal(ctx->inner_len <= sizeof(ctx->inner));
+	memcpy(ctx->inner, iphdr(inner), ctx->inner_len);
+	ctx->seq = 1;
+	ctx->file = file;
+	ctx->line = line;
+}
+
+/*
+ * Check an encrypted packet: the next sequence number, a fresh IV, an
+ * ICV covering seq_hi, and the inner packet with RFC 4303 padding.
+ */
+static void
+esn_check_encrypted(struct rte_mbuf *m, struct esn_out_ctx *ctx)
+{
+	uint16_t ct_len = RTE_ALIGN_CEIL(ctx->inner_len + 2, ESN_BLOCK_LEN);
+	uint8_t icv[ESN_ICV_LEN], plain[ESN_MAX_CT_LEN];
+	const uint8_t *esp, *iv, *ct;
+	unsigned int i, pad_len;
+	struct iphdr *ip;
+	uint16_t esp_len;
+
+	ip = rte_pktmbuf_mtod_offset(m, struct iphdr *,
+				     sizeof(struct rte_ether_hdr));
+	_dp_test_fail_unless(ip->protocol == IPPROTO_ESP,
+			     ctx->file, ctx->line,
+			     "Expected ESP, got protocol %u", ip->protocol);
+
+	esp = (const uint8_t *)ip + ip->ihl * 4;
+	esp_len = ntohs(ip->tot_len) - ip->ihl * 4;
+	_dp_test_fail_unless(esp_len == ESN_ESP_HDR_LEN + ESN_IV_LEN +
+			     ct_len + ESN_ICV_LEN,
+			     ctx->file, ctx->line,
+			     "Unexpected ESP length %u", esp_len);
+	_dp_test_fail_unless(ntohl(*(const uint32_t *)(esp + 4)) == ctx->seq,
+			     ctx->file, ctx->line,
+			     "Expected sequence number %u, got %u", ctx->seq,
+			     ntohl(*(const uint32_t *)(esp + 4)));
+
+	iv = esp + ESN_ESP_HDR_LEN;
+	ct = iv + ESN_IV_LEN;
+	_dp_test_fail_unless(ctx->seq == 1 ||
+			     memcmp(iv, ctx->last_iv, ESN_IV_LEN) != 0,
+			     ctx->file, ctx->line,
+			     "IV of packet %u repeated", ctx->seq);
+	memcpy(ctx->last_iv, iv, ESN_IV_LEN);
+
+	esn_icv(esp, esp_len - ESN_ICV_LEN, true, 0, icv);
+	_dp_test_fail_unless(memcmp(icv, ct + ct_len, ESN_ICV_LEN) == 0,
+			     ctx->file, ctx->line,
+			     "ICV of packet %u does not cover seq_hi",
+			     ctx->seq);
+
+	esn_cbc(iv, ct, plain, ct_len, false);
+	_dp_test_fail_unless(memcmp(plain, ctx->inner, ctx->inner_len) == 0,
+			     ctx->file, ctx->line,
+			     "Inner packet %u differs", ctx->seq);
+
+	pad_len = plain[ct_len - 2];
+	_dp_test_fail_unless(pad_len == ct_len - 2U - ctx->inner_len &&
+			     plain[ct_len - 1] == IPPROTO_IPIP,
+			     ctx->file, ctx->line,
+			     "Bad ESP trailer on packet %u", ctx->seq);
+	for (i = 0; i < pad_len; i++)
+		_dp_test_fail_unless(plain[ctx->inner_len + i] == i + 1,
+				     ctx->file, ctx->line,
+				     "Bad padding on packet %u", ctx->seq);
+
+	ctx->seq++;
+}
+
+static void
+esn_encrypt_validate_cb(struct rte_mbuf *m, struct ifnet *ifp,
+			struct dp_test_expected *exp,
+			enum dp_test_fwd_result_e fwd_result)
+{
+	struct esn_out_ctx *ctx = dp_test_exp_get_validate_ctx(exp);
+
+	_dp_test_fail_unless(fwd_result == DP_TEST_FWD_FORWARDED &&
+			     !strcmp(ifp->if_name,
+				     exp->oif_name[exp->last_checked]),
+			     ctx->file, ctx->line,
+			     "Encrypted packet sent on %s", ifp->if_name);
+	esn_check_encrypted(m, ctx);
+	dp_test_exp_validate_cb_pak_done(exp, true);
+}
+
+static struct rte_mbuf *
+esn_plain_pak(const char *src, const char *dst, const char *rx_intf)
+{
+	struct rte_mbuf *m;
+
+	m = build_input_packet(src, dst);
+	dp_test_fail_unless(m, "Failed to build packet");
+	(void)dp_test_pktmbuf_eth_init(m, dp_test_intf_name2mac_str(rx_intf),
+				       NULL, RTE_ETHER_TYPE_IPV4);
+	return m;
+}
+
+/*
+ * Encrypt a packet from EAST for the input SA, as PEER would. With
+ * esn false the ICV leaves out seq_hi, as a peer without ESN would.
+ */
+static struct rte_mbuf *
+esn_encrypted_pak(uint32_t seq, bool esn)
+{
+	uint8_t payload[ESN_IV_LEN + ESN_MAX_CT_LEN + ESN_ICV_LEN];
+	uint8_t plain[ESN_MAX_CT_LEN];
+	uint16_t inner_len, ct_len;
+	struct rte_mbuf *inner, *m;
+	unsigned int i, pad_len;
+	uint8_t *esp;
+	int len;
+
+	inner = build_input_packet(DESTINATION_ADDRESS, SOURCE_ADDRESS);
+	dp_test_fail_unless(inner, "Failed to build inner packet");
+	inner_len = ntohs(iphdr(inner)->tot_len);
+	ct_len = RTE_ALIGN_CEIL(inner_len + 2, ESN_BLOCK_LEN);
+	dp_test_assert_internal(ct_len <= sizeof(plain));
+
+	memcpy(plain, iphdr(inner), inner_len);
+	rte_pktmbuf_free(inner);
+	pad_len = ct_len - 2 - inner_len;
+	for (i = 0; i < pad_len; i++)
+		plain[inner_len + i] = i + 1;
+	plain[ct_len - 2] = pad_len;
+	plain[ct_len - 1] = IPPROTO_IPIP;
+
+	for (i = 0; i < ESN_IV_LEN; i++)
+		payload[i] = seq + i;
+	esn_cbc(payload, plain, payload + ESN_IV_LEN, ct_len, true);
+	memset(payload + ESN_IV_LEN + ct_len, 0, ESN_ICV_LEN);
+
+	len = ESN_IV_LEN + ct_len + ESN_ICV_LEN;
+	m = dp_test_create_esp_ipv4_pak(PEER_ADDRESS, LOCAL_ADDRESS_TRANSIT,
+					1, &len, (const char *)payload,
+					ESN_SPI_IN, seq,
+					0 /* ip ID */,
+					255 /* ttl */,
+					NULL /* udp/esp */,
+					NULL /* transport_hdr*/);
+	dp_test_fail_unless(m, "Failed to build ESP packet");
+
+	esp = (uint8_t *)iphdr(m) + sizeof(struct iphdr);
+	esn_icv(esp, ESN_ESP_HDR_LEN + ESN_IV_LEN + ct_len, esn, 0,
+		esp + ESN_ESP_HDR_LEN + ESN_IV_LEN + ct_len);
+
+	(void)dp_test_pktmbuf_eth_init(m, dp_test_intf_name2mac_str("dp2T2"),
+				       PEER_MAC_ADDRESS, RTE_ETHER_TYPE_IPV4);
+	return m;
+}
+
+/* The inner packet of esn_encrypted_pak(), forwarded to Source */
+static struct dp_test_expected *
+esn_decrypted_exp(void)
+{
+	struct dp_test_expected *exp;
+	struct rte_mbuf *m;
+
+	m = build_input_packet(DESTINATION_ADDRESS, SOURCE_ADDRESS);
+	dp_test_fail_unless(m, "Failed to build packet");
+	dp_test_set_pak_ip_field(iphdr(m), DP_TEST_SET_TTL, 0x3f);
+	(void)dp_test_pktmbuf_eth_init(m, SOURCE_MAC_ADDRESS,
+				       dp_test_intf_name2mac_str("dp1T1"),
+				       RTE_ETHER_TYPE_IPV4);
+
+	exp = dp_test_exp_create(m);
+	rte_pktmbuf_free(m);
+	dp_test_exp_set_oif_name(exp, "dp1T1");
+	return exp;
+}
+
+/* Free anything left on an interface's transmit ring */
+static unsigned int esn_drain_tx(const char *if_name,
+				 struct esn_out_ctx *ctx)
+{
+	struct rte_mbuf *bufs[64];
+	unsigned int total = 0;
+	int count, i;
+
+	while ((count = dp_test_pak_get_from_ring(if_name, bufs,
+						  ARRAY_SIZE(bufs))) > 0) {
+		for (i = 0; i < count; i++) {
+			if (ctx)
+				esn_check_encrypted(bufs[i], ctx);
+			rte_pktmbuf_free(bufs[i]);
+		}
+		total += count;
+	}
+	return total;
+}
+
+static void setup(void)
+{
+	dp_test_nl_add_ip_addr_and_connected("dp1T1", LOCAL_PREFIX_WEST);
+	dp_test_netlink_add_neigh("dp1T1", SOURCE_ADDRESS, SOURCE_MAC_ADDRESS);
+
+	dp_test_nl_add_ip_addr_and_connected("dp2T2", LOCAL_PREFIX_TRANSIT);
+	dp_test_netlink_add_neigh("dp2T2", PEER_ADDRESS, PEER_MAC_ADDRESS);
+
+	dp_test_netlink_add_route(EAST_PREFIX " nh " PEER_ADDRESS " int:dp2T2");
+
+	dp_test_crypto_create_policy(&input_policy);
+	dp_test_crypto_create_policy(&output_policy);
+	dp_test_crypto_create_sa(&input_sa);
+	dp_test_crypto_create_sa(&output_sa);
+}
+
+static void teardown(void)
+{
+	dp_test_crypto_delete_policy(&input_policy);
+	dp_test_crypto_delete_policy(&output_policy);
+
+	dp_test_netlink_del_route(EAST_PREFIX " nh " PEER_ADDRESS " int:dp2T2");
+	dp_test_netlink_del_neigh("dp2T2", PEER_ADDRESS, PEER_MAC_ADDRESS);
+	dp_test_nl_del_ip_addr_and_connected("dp2T2", LOCAL_PREFIX_TRANSIT);
+	dp_test_netlink_del_neigh("dp1T1", SOURCE_ADDRESS, SOURCE_MAC_ADDRESS);
+	dp_test_nl_del_ip_addr_and_connected("dp1T1", LOCAL_PREFIX_WEST);
+}
+
+DP_DECL_TEST_CASE(crypto_async, esn_cbc_hmac, setup, teardown);
+
+/*
+ * A burst encrypted through the PMD gets consecutive sequence
+ * numbers, a fresh IV each, and an ICV that covers seq_hi.
+ */
+DP_START_TEST(esn_cbc_hmac, esn_encrypt)
+{
+	struct rte_mbuf *ping_pkt[ESN_PKTS];
+	struct dp_test_expected *exp;
+	struct esn_out_ctx ctx;
+	unsigned int i;
+
+	exp = dp_test_exp_create_m(NULL, ESN_PKTS);
+	for (i = 0; i < ESN_PKTS; i++) {
+		ping_pkt[i] = esn_plain_pak(SOURCE_ADDRESS,
+					    DESTINATION_ADDRESS, "dp1T1");
+		dp_test_exp_set_oif_name_m(exp, i, "dp2T2");
+		dp_test_exp_set_fwd_status_m(exp, i, DP_TEST_FWD_FORWARDED);
+	}
+	esn_out_ctx_init(&ctx, ping_pkt[0], __FILE__, __LINE__);
+	dp_test_exp_set_validate_ctx(exp, &ctx, false);
+	dp_test_exp_set_validate_cb(exp, esn_encrypt_validate_cb);
+
+	dp_test_pak_receive_n(ping_pkt, ESN_PKTS, "dp1T1", exp);
+	dp_test_crypto_check_sad_packets(VRF_DEFAULT_ID, ESN_PKTS,
+					 84 * ESN_PKTS);
+
+	dp_test_crypto_delete_sa(&input_sa);
+	dp_test_crypto_delete_sa(&output_sa);
+} DP_END_TEST;
+
+/*
+ * Packets whose ICV covers seq_hi are decrypted through the PMD and
+ * forwarded. One whose ICV leaves seq_hi out fails authentication,
+ * without upsetting the SA for the packets after it.
+ */
+DP_START_TEST(esn_cbc_hmac, esn_decrypt)
+{
+	struct dp_test_expected *exp;
+	struct rte_mbuf *m;
+
+	m = esn_encrypted_pak(1, true);
+	exp = esn_decrypted_exp();
+	dp_test_pak_receive(m, "dp2T2", exp);
+
+	m = esn_encrypted_pak(2, false);
+	exp = esn_decrypted_exp();
+	dp_test_exp_set_fwd_status(exp, DP_TEST_FWD_DROPPED);
+	dp_test_pak_receive(m, "dp2T2", exp);
+
+	m = esn_encrypted_pak(3, true);
+	exp = esn_decrypted_exp();
+	dp_test_pak_receive(m, "dp2T2", exp);
+
+	dp_test_crypto_delete_sa(&input_sa);
+	dp_test_crypto_delete_sa(&output_sa);
+} DP_END_TEST;
+
+/*
+ * Delete the output SA while a burst for it is being encrypted. Those
+ * encrypted before the delete are sent intact and the rest dropped,
+ * and a new SA on the same PMD starts again from sequence number 1.
+ */
+DP_START_TEST(esn_cbc_hmac, sa_delete_inflight)
+{
+	struct dp_test_expected *exp;
+	struct rte_mbuf *m;
+	struct esn_out_ctx ctx;
+	unsigned int i, sent;
+
+	m = esn_plain_pak(SOURCE_ADDRESS, DESTINATION_ADDRESS, "dp1T1");
+	esn_out_ctx_init(&ctx, m, __FILE__, __LINE__);
+	rte_pktmbuf_free(m);
+
+	for (i = 0; i < INFLIGHT_PKTS; i++) {
+		m = esn_plain_pak(SOURCE_ADDRESS, DESTINATION_ADDRESS,
+				  "dp1T1");
+		dp_test_pak_add_to_ring("dp1T1", &m, 1, false);
+	}
+	dp_test_crypto_delete_sa(&output_sa);
+
+	/* Finds no SA, but waits for those ahead of it to be processed */
+	m = esn_plain_pak(SOURCE_ADDRESS, DESTINATION_ADDRESS, "dp1T1");
+	dp_test_pak_add_to_ring("dp1T1", &m, 1, true);
+
+	sent = esn_drain_tx("dp2T2", &ctx);
+	(void)esn_drain_tx("dp1T1", NULL);
+	dp_test_fail_unless(sent <= INFLIGHT_PKTS,
+			    "%u packets sent for %u", sent, INFLIGHT_PKTS);
+
+	/* The input SA keeps the PMD */
+	dp_test_crypto_check_sa_count(VRF_DEFAULT_ID, 1);
+	dp_test_check_state_show("ipsec pmd", "\"sas_bound\": 1", false);
+
+	dp_test_crypto_create_sa(&output_sa);
+
+	m = esn_plain_pak(SOURCE_ADDRESS, DESTINATION_ADDRESS, "dp1T1");
+	esn_out_ctx_init(&ctx, m, __FILE__, __LINE__);
+	exp = dp_test_exp_create_m(NULL, 1);
+	dp_test_exp_set_oif_name(exp, "dp2T2");
+	dp_test_exp_set_validate_ctx(exp, &ctx, false);
+	dp_test_exp_set_validate_cb(exp, esn_encrypt_validate_cb);
+	dp_test_pak_receive(m, "dp1T1", exp);
+
+	dp_test_crypto_delete_sa(&input_sa);
+	dp_test_crypto_delete_sa(&output_sa);
+} DP_END_TEST;
+
+/*
+ * Delete both SAs while bursts in each direction are on the crypto
+ * device, so that the PMD is torn down with ops still in flight. The
+ * purge must hand back every one of their mbufs, which the end of
+ * test check for leaked mbufs confirms.
+ */
+DP_START_TEST(esn_cbc_hmac, pmd_teardown_inflight)
+{
+	struct rte_mbuf *m;
+	unsigned int i;
+
+	for (i = 0; i < INFLIGHT_PKTS; i++) {
+		m = esn_plain_pak(SOURCE_ADDRESS, DESTINATION_ADDRESS,
+				  "dp1T1");
+		dp_test_pak_add_to_ring("dp1T1", &m, 1, false);
+
+		m = esn_encrypted_pak(i + 1, true);
+		dp_test_pak_add_to_ring("dp2T2", &m, 1, false);
+	}
+	dp_test_crypto_delete_sa(&input_sa);
+	dp_test_crypto_delete_sa(&output_sa);
+
+	m = esn_plain_pak(SOURCE_ADDRESS, DESTINATION_ADDRESS, "dp1T1");
+	dp_test_pak_add_to_ring("dp1T1", &m, 1, true);
+	m = esn_encrypted_pak(INFLIGHT_PKTS + 1, true);
+	dp_test_pak_add_to_ring("dp2T2", &m, 1, true);
+
+	/* The PMD is freed, and its device purged, after a grace period */
+	dp_test_check_state_show("ipsec pmd", "\"alloc\": 0", false);
+
+	(void)esn_drain_tx("dp1T1", NULL);
+	(void)esn_drain_tx("dp2T2", NULL);
+	dp_test_crypto_check_sa_count(VRF_DEFAULT_ID, 0);
+} DP_END_TEST;
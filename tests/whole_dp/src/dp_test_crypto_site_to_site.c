@@ -1703,6 +1703,74 @@ static void null_encrypt_main(vrfid_t vrfid, enum vfp_presence with_vfp)
 			    with_vfp, VRF_XFRM_IN_ORDER);
 }
 
+/*
+ * Number of packets sent through an SA with spraying enabled.
+ */
+#define SPRAY_PKTS 8
+
+static void null_encrypt_spray_main(vrfid_t vrfid)
+{
+	struct rte_mbuf *ping_pkt[SPRAY_PKTS];
+	struct rte_mbuf *encrypted_pkt;
+	struct dp_test_expected *exp;
+	const uint8_t all_cores = 0xff;
+	const uint8_t no_cores = 0;
+	int payload_len, i;
+
+	/*
+	 * The unit tests run a single forwarding thread, so there are
+	 * no other cores to spray to and the home PMD must carry on
+	 * alone.
+	 */
+	dp_test_fail_unless(crypto_set_spray_cores(&all_cores, 1) == 0,
+			    "Failed to set spray cores");
+
+	s2s_common_setup(vrfid, CRYPTO_CIPHER_NULL, CRYPTO_AUTH_NULL,
+			 NULL, NULL, 0, 0,
+			 XFRM_MODE_TUNNEL, VFP_FALSE, VRF_XFRM_IN_ORDER);
+
+	/*
+	 * The packets must leave in the order they were received, with
+	 * consecutive sequence numbers.
+	 */
+	exp = dp_test_exp_create_m(NULL, SPRAY_PKTS);
+	for (i = 0; i < SPRAY_PKTS; i++) {
+		ping_pkt[i] = build_input_packet(CLIENT_LOCAL, CLIENT_REMOTE);
+		(void)dp_test_pktmbuf_eth_init(
+			ping_pkt[i], dp_test_intf_name2mac_str("dp1T1"),
+			NULL, RTE_ETHER_TYPE_IPV4);
+
+		payload_len = sizeof(payload_v4_icmp_null_enc);
+		encrypted_pkt = dp_test_create_esp_ipv4_pak(
+			PORT_EAST, PEER, 1, &payload_len,
+			payload_v4_icmp_null_enc,
+			SPI_OUTBOUND,
+			i + 1 /* seq no */,
+			0 /* ip ID */,
+			255 /* ttl */,
+			NULL /* udp/esp */,
+			NULL /* transport_hdr*/);
+		dp_test_set_pak_ip_field(iphdr(encrypted_pkt),
+					 DP_TEST_SET_DF, 1);
+		(void)dp_test_pktmbuf_eth_init(
+			encrypted_pkt, PEER_MAC_ADDR,
+			dp_test_intf_name2mac_str("dp2T2"),
+			RTE_ETHER_TYPE_IPV4);
+
+		dp_test_exp_set_pak_m(exp, i, encrypted_pkt);
+		dp_test_exp_set_oif_name_m(exp, i, "dp2T2");
+		dp_test_exp_set_fwd_status_m(exp, i, DP_TEST_FWD_FORWARDED);
+	}
+
+	dp_test_pak_receive_n(ping_pkt, SPRAY_PKTS, "dp1T1", exp);
+	dp_test_crypto_check_sad_packets(vrfid, SPRAY_PKTS, 84 * SPRAY_PKTS);
+
+	s2s_common_teardown(vrfid, NULL, NULL, 0, 0,
+			    VFP_FALSE, VRF_XFRM_IN_ORDER);
+
+	crypto_set_spray_cores(&no_cores, 1);
+}
+
 static void null_encrypt6_transport_main(vrfid_t vrfid)
 {
 	/*
@@ -2733,6 +2801,17 @@ DP_START_TEST_FULL_RUN(encryption, null_encrypt_vrf)
 	null_encrypt_main(TEST_VRF, VFP_FALSE);
 }  DP_END_TEST;
 
+/*
+ * TEST: null_encrypt_spray
+ *
+ * "encrypt" a burst of packets with an SA set up while spraying is
+ * enabled.
+ */
+DP_START_TEST_FULL_RUN(encryption, null_encrypt_spray)
+{
+	null_encrypt_spray_main(VRF_DEFAULT_ID);
+}  DP_END_TEST;
+
 DP_START_TEST_FULL_RUN(encryption, null_encrypt6_transport)
 {
 	null_encrypt6_transport_main(VRF_DEFAULT_ID);
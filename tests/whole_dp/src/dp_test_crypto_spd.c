@@ -0,0 +1,395 @@
+/*-
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Whole dataplane tests of the IPsec security policy database (SPD)
+ */
+#include <stdbool.h>
+
+#include <netinet/in.h>
+#include <netinet/ip_icmp.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
+#include <linux/xfrm.h>
+#include <arpa/inet.h>
+#include <netinet/udp.h>
+
+#include "ip_funcs.h"
+#include "pktmbuf_internal.h"
+#include "crypto/crypto_policy.h"
+#include "crypto/crypto_spd.h"
+
+#include "dp_test.h"
+#include "dp_test_lib_internal.h"
+#include "dp_test_lib_exp.h"
+#include "dp_test_lib_intf_internal.h"
+#include "dp_test_lib_pkt.h"
+#include "dp_test_pktmbuf_lib_internal.h"
+#include "dp_test_crypto_utils.h"
+#include "dp_test_json_utils.h"
+#include "dp_test_netlink_state_internal.h"
+#include "dp_test/dp_test_macros.h"
+
+/*
+ * The tests in this module check that the SPD classifies packets
+ * against the output IPsec policies as the NPF ruleset built from the
+ * same policies does, and that the flow cache can hold the result for
+ * policies with ports.
+ *
+ *           10.10.1.0/24                             10.10.3.0/24
+ *           (WEST net)                                (EAST net)
+ *
+ * +----------+        +---------+          +--------+
+ * |          |.1    .2|         | .2    .3 |        |
+ * |  Source  +--------+  LOCAL  +----------+  PEER  +---- EAST net
+ * |          |  dp1T1 |         | dp2T2    |        |
+ * +----------+        +---------+          +--------+
+ *                         10.10.2.0/24
+ */
+
+#define WEST_PREFIX          "10.10.1.0/24"
+#define SOURCE_ADDRESS       "10.10.1.1"
+#define SOURCE_MAC_ADDRESS   "aa:bb:cc:dd:1:1"
+#define LOCAL_ADDRESS_WEST   "10.10.1.2"
+#define LOCAL_PREFIX_WEST    LOCAL_ADDRESS_WEST "/24"
+#define LOCAL_PREFIX_TRANSIT "10.10.2.2/24"
+#define PEER_ADDRESS         "10.10.2.3"
+#define PEER_MAC_ADDRESS     "aa:bb:cc:dd:2:3"
+#define EAST_PREFIX          "10.10.3.0/24"
+#define DESTINATION_ADDRESS  "10.10.3.4"
+#define OTHER_ADDRESS        "10.10.9.1"
+
+#define WEST_PREFIX6         "2001:1:1::/64"
+#define SOURCE_ADDRESS6      "2001:1:1::1"
+#define EAST_PREFIX6         "2001:1:3::/64"
+#define DESTINATION_ADDRESS6 "2001:1:3::4"
+#define PEER_ADDRESS6        "2001:1:2::3"
+
+DP_DECL_TEST_SUITE(crypto_spd);
+
+static struct dp_test_crypto_policy
+spd_policy(const char *s_prefix, const char *d_prefix, int family,
+	   int proto, uint16_t sport, uint16_t dport, uint32_t priority,
+	   uint32_t reqid)
+{
+	struct dp_test_crypto_policy policy = {
+		.d_prefix = d_prefix,
+		.s_prefix = s_prefix,
+		.proto = proto,
+		.sport = sport,
+		.dport = dport,
+		.dst = family == AF_INET ? PEER_ADDRESS : PEER_ADDRESS6,
+		.dst_family = family,
+		.dir = XFRM_POLICY_OUT,
+		.family = family,
+		.reqid = reqid,
+		.priority = priority,
+		.mark = 0,
+		.action = XFRM_POLICY_ALLOW,
+		.vrfid = VRF_DEFAULT_ID
+	};
+
+	return policy;
+}
+
+static struct rte_mbuf *
+spd_test_pak(bool v4, uint8_t proto, const char *src, const char *dst,
+	     uint16_t sport, uint16_t dport)
+{
+	struct dp_test_pkt_desc_t desc = {
+		.len        = 20,
+		.ether_type = v4 ? RTE_ETHER_TYPE_IPV4 : RTE_ETHER_TYPE_IPV6,
+		.l3_src     = src,
+		.l2_src     = SOURCE_MAC_ADDRESS,
+		.l3_dst     = dst,
+		.l2_dst     = PEER_MAC_ADDRESS,
+		.proto      = proto,
+		.rx_intf    = "dp1T1",
+		.tx_intf    = "dp2T2"
+	};
+	struct rte_mbuf *m;
+
+	switch (proto) {
+	case IPPROTO_TCP:
+		desc.l4.tcp.sport = sport;
+		desc.l4.tcp.dport = dport;
+		desc.l4.tcp.flags = TH_SYN;
+		break;
+	case IPPROTO_UDP:
+		desc.l4.udp.sport = sport;
+		desc.l4.udp.dport = dport;
+		break;
+	default:
+		desc.l4.icmp.type = ICMP_ECHO;
+		break;
+	}
+
+	m = dp_test_rt_pkt_from_desc(&desc);
+	pktmbuf_set_vrf(m, VRF_DEFAULT_ID);
+	return m;
+}
+
+/*
+ * Check that the SPD and the NPF ruleset both find the policy with
+ * the expected reqid for a packet, or no policy if exp_reqid is 0.
+ * The packet is freed.
+ */
+static void
+_spd_check_match(struct rte_mbuf *m, bool v4, uint32_t exp_reqid,
+		 const char *desc, const char *file, int line)
+{
+	uint32_t spd_reqid = crypto_policy_match_reqid(m, v4, true);
+	uint32_t npf_reqid = crypto_policy_match_reqid(m, v4, false);
+
+	rte_pktmbuf_free(m);
+
+	_dp_test_fail_unless(npf_reqid == exp_reqid, file, line,
+			     "%s: NPF matched reqid %u, expected %u\n",
+			     desc, npf_reqid, exp_reqid);
+	_dp_test_fail_unless(spd_reqid == exp_reqid, file, line,
+			     "%s: SPD matched reqid %u, expected %u\n",
+			     desc, spd_reqid, exp_reqid);
+}
+
+#define spd_check_match(m, v4, exp_reqid, desc)			\
+	_spd_check_match(m, v4, exp_reqid, desc, __FILE__, __LINE__)
+
+static int spd_flow_cache_hits(void)
+{
+	json_object *jresp, *jstats;
+	int hits = 0;
+
+	jresp = dp_test_json_do_show_cmd("ipsec counters", NULL, false);
+	dp_test_fail_unless(jresp, "Failed to get ipsec counters");
+
+	if (json_object_object_get_ex(jresp, "IPsec-statistics", &jstats))
+		(void)dp_test_json_int_field_from_obj(jstats,
+						      "hit flow cache",
+						      &hits);
+	json_object_put(jresp);
+	return hits;
+}
+
+static void setup(void)
+{
+	dp_test_nl_add_ip_addr_and_connected("dp1T1", LOCAL_PREFIX_WEST);
+	dp_test_netlink_add_neigh("dp1T1", SOURCE_ADDRESS, SOURCE_MAC_ADDRESS);
+
+	dp_test_nl_add_ip_addr_and_connected("dp2T2", LOCAL_PREFIX_TRANSIT);
+	dp_test_netlink_add_neigh("dp2T2", PEER_ADDRESS, PEER_MAC_ADDRESS);
+
+	dp_test_netlink_add_route(EAST_PREFIX " nh " PEER_ADDRESS " int:dp2T2");
+}
+
+static void teardown(void)
+{
+	dp_test_netlink_del_route(EAST_PREFIX " nh " PEER_ADDRESS " int:dp2T2");
+	dp_test_netlink_del_neigh("dp2T2", PEER_ADDRESS, PEER_MAC_ADDRESS);
+	dp_test_nl_del_ip_addr_and_connected("dp2T2", LOCAL_PREFIX_TRANSIT);
+	dp_test_netlink_del_neigh("dp1T1", SOURCE_ADDRESS, SOURCE_MAC_ADDRESS);
+	dp_test_nl_del_ip_addr_and_connected("dp1T1", LOCAL_PREFIX_WEST);
+}
+
+DP_DECL_TEST_CASE(crypto_spd, spd_classify, setup, teardown);
+
+/*
+ * Overlapping IPv4 policies, matching on protocol and ports.  Of the
+ * policies matching a packet the one with the lowest priority value
+ * wins, in the SPD as in NPF.
+ */
+DP_START_TEST(spd_classify, spd_npf_agree)
+{
+	struct dp_test_crypto_policy policies[] = {
+		spd_policy(WEST_PREFIX, EAST_PREFIX, AF_INET,
+			   IPPROTO_UDP, 0, 2000, 10, 1),
+		spd_policy(WEST_PREFIX, EAST_PREFIX, AF_INET,
+			   IPPROTO_UDP, 1000, 0, 20, 2),
+		spd_policy(WEST_PREFIX, EAST_PREFIX, AF_INET,
+			   IPPROTO_TCP, 0, 0, 30, 3),
+		spd_policy(WEST_PREFIX, EAST_PREFIX, AF_INET,
+			   0, 0, 0, 40, 4),
+	};
+	struct rte_mbuf *m;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(policies); i++)
+		dp_test_crypto_create_policy(&policies[i]);
+
+	/* The policies are acked once the SPD and NPF rules are built */
+	dp_test_crypto_check_xfrm_acks();
+
+	m = spd_test_pak(true, IPPROTO_UDP, SOURCE_ADDRESS,
+			 DESTINATION_ADDRESS, 1000, 2000);
+	spd_check_match(m, true, 1, "UDP 1000 -> 2000");
+
+	m = spd_test_pak(true, IPPROTO_UDP, SOURCE_ADDRESS,
+			 DESTINATION_ADDRESS, 1000, 3000);
+	spd_check_match(m, true, 2, "UDP 1000 -> 3000");
+
+	m = spd_test_pak(true, IPPROTO_UDP, SOURCE_ADDRESS,
+			 DESTINATION_ADDRESS, 1001, 2000);
+	spd_check_match(m, true, 1, "UDP 1001 -> 2000");
+
+	m = spd_test_pak(true, IPPROTO_UDP, SOURCE_ADDRESS,
+			 DESTINATION_ADDRESS, 1001, 3000);
+	spd_check_match(m, true, 4, "UDP 1001 -> 3000");
+
+	/* The port policies are for UDP only */
+	m = spd_test_pak(true, IPPROTO_TCP, SOURCE_ADDRESS,
+			 DESTINATION_ADDRESS, 1000, 2000);
+	spd_check_match(m, true, 3, "TCP 1000 -> 2000");
+
+	m = spd_test_pak(true, IPPROTO_ICMP, SOURCE_ADDRESS,
+			 DESTINATION_ADDRESS, 0, 0);
+	spd_check_match(m, true, 4, "ICMP");
+
+	m = spd_test_pak(true, IPPROTO_UDP, OTHER_ADDRESS,
+			 DESTINATION_ADDRESS, 1000, 2000);
+	spd_check_match(m, true, 0, "UDP from outside WEST");
+
+	/*
+	 * Fragments, the first included, don't match on ports in NPF,
+	 * so only match the policies without ports.
+	 */
+	m = spd_test_pak(true, IPPROTO_UDP, SOURCE_ADDRESS,
+			 DESTINATION_ADDRESS, 1000, 2000);
+	dp_test_set_pak_ip_field(iphdr(m), DP_TEST_SET_FRAG_MORE, 1);
+	spd_check_match(m, true, 4, "UDP first fragment");
+
+	m = spd_test_pak(true, IPPROTO_UDP, SOURCE_ADDRESS,
+			 DESTINATION_ADDRESS, 1000, 2000);
+	dp_test_set_pak_ip_field(iphdr(m), DP_TEST_SET_FRAG_OFFSET, 100);
+	spd_check_match(m, true, 4, "UDP later fragment");
+
+	/* Move the source port policy ahead of the destination port one */
+	policies[1].priority = 5;
+	dp_test_crypto_update_policy(&policies[1]);
+	dp_test_crypto_check_xfrm_acks();
+
+	m = spd_test_pak(true, IPPROTO_UDP, SOURCE_ADDRESS,
+			 DESTINATION_ADDRESS, 1000, 2000);
+	spd_check_match(m, true, 2, "UDP 1000 -> 2000 after update");
+
+	m = spd_test_pak(true, IPPROTO_UDP, SOURCE_ADDRESS,
+			 DESTINATION_ADDRESS, 1001, 2000);
+	spd_check_match(m, true, 1, "UDP 1001 -> 2000 after update");
+
+	for (i = 0; i < ARRAY_SIZE(policies); i++)
+		dp_test_crypto_delete_policy_verify(&policies[i], false);
+	dp_test_crypto_check_policy_count(VRF_DEFAULT_ID, 0, AF_INET);
+
+} DP_END_TEST;
+
+/*
+ * The SPD leaves IPv6 packets with extension headers to NPF, which
+ * looks through them for the final protocol and ports.
+ */
+DP_START_TEST(spd_classify, spd_ipv6_ext_hdr)
+{
+	struct dp_test_crypto_policy policies[] = {
+		spd_policy(WEST_PREFIX6, EAST_PREFIX6, AF_INET6,
+			   IPPROTO_UDP, 0, 2000, 10, 11),
+		spd_policy(WEST_PREFIX6, EAST_PREFIX6, AF_INET6,
+			   0, 0, 0, 40, 14),
+	};
+	struct rte_mbuf *m;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(policies); i++)
+		dp_test_crypto_create_policy(&policies[i]);
+
+	/* The policies are acked once the SPD and NPF rules are built */
+	dp_test_crypto_check_xfrm_acks();
+
+	m = spd_test_pak(false, IPPROTO_UDP, SOURCE_ADDRESS6,
+			 DESTINATION_ADDRESS6, 1000, 2000);
+	spd_check_match(m, false, 11, "UDP 1000 -> 2000");
+
+	m = spd_test_pak(false, IPPROTO_UDP, SOURCE_ADDRESS6,
+			 DESTINATION_ADDRESS6, 1000, 3000);
+	spd_check_match(m, false, 14, "UDP 1000 -> 3000");
+
+	m = spd_test_pak(false, IPPROTO_UDP, SOURCE_ADDRESS6,
+			 DESTINATION_ADDRESS6, 1000, 2000);
+	dp_test_fail_unless(
+		dp_test_ipv6_append_non_frag_ext_hdr(m, IPPROTO_DSTOPTS, 8),
+		"Failed to add destination options header");
+
+	dp_test_fail_unless(crypto_policy_match_reqid(m, false, true) ==
+			    CRYPTO_SPD_NOT_CLASSIFIED,
+			    "SPD classified a packet with extension headers");
+	dp_test_fail_unless(crypto_policy_match_reqid(m, false, false) == 11,
+			    "NPF did not match through the extension header");
+	rte_pktmbuf_free(m);
+
+	for (i = 0; i < ARRAY_SIZE(policies); i++)
+		dp_test_crypto_delete_policy_verify(&policies[i], false);
+	dp_test_crypto_check_policy_count(VRF_DEFAULT_ID, 0, AF_INET6);
+
+} DP_END_TEST;
+
+/*
+ * The flow cache holds the result for a policy with ports.  Packets
+ * between the same addresses but to another port must not be given
+ * the cached result.
+ */
+DP_START_TEST(spd_classify, spd_port_policy_cached)
+{
+	struct dp_test_crypto_policy policy =
+		spd_policy(WEST_PREFIX, EAST_PREFIX, AF_INET,
+			   IPPROTO_UDP, 0, 2000, 10, 1);
+	struct dp_test_pkt_desc_t desc = {
+		.text       = "UDP",
+		.len        = 20,
+		.ether_type = RTE_ETHER_TYPE_IPV4,
+		.l3_src     = SOURCE_ADDRESS,
+		.l2_src     = SOURCE_MAC_ADDRESS,
+		.l3_dst     = DESTINATION_ADDRESS,
+		.l2_dst     = PEER_MAC_ADDRESS,
+		.proto      = IPPROTO_UDP,
+		.l4         = {
+			.udp = {
+				.sport = 1000,
+				.dport = 2000,
+			}
+		},
+		.rx_intf    = "dp1T1",
+		.tx_intf    = "dp2T2"
+	};
+	struct dp_test_expected *exp;
+	struct rte_mbuf *m;
+	int hits;
+	int i;
+
+	policy.action = XFRM_POLICY_BLOCK;
+	dp_test_crypto_create_policy(&policy);
+	dp_test_crypto_check_xfrm_acks();
+
+	hits = spd_flow_cache_hits();
+
+	for (i = 0; i < 2; i++) {
+		/* Blocked by the policy */
+		desc.l4.udp.dport = 2000;
+		m = dp_test_v4_pkt_from_desc(&desc);
+		exp = generate_exp_unreachable(m, desc.len,
+					       LOCAL_ADDRESS_WEST,
+					       SOURCE_ADDRESS, "dp1T1",
+					       SOURCE_MAC_ADDRESS);
+		dp_test_pak_receive(m, "dp1T1", exp);
+
+		/* Matches no policy, so is forwarded in the clear */
+		desc.l4.udp.dport = 3000;
+		m = dp_test_v4_pkt_from_desc(&desc);
+		exp = dp_test_exp_from_desc(m, &desc);
+		dp_test_pak_receive(m, "dp1T1", exp);
+	}
+
+	/* The second packet of each flow is found in the cache */
+	dp_test_fail_unless(spd_flow_cache_hits() == hits + 2,
+			    "Expected 2 flow cache hits, got %d",
+			    spd_flow_cache_hits() - hits);
+
+	dp_test_crypto_delete_policy(&policy);
+
+} DP_END_TEST;
@@ -344,27 +344,32 @@ dp_test_create_esp_ipv6_pak(const char *saddr, const char *daddr,
  * build_xfrm_selector()
  *
  * This function populates the supplied struct xfrm_selector
- * with the destination and source prefix passed to it in
- * string form.
+ * with the destination and source prefix of the policy, which
+ * are in string form, and its protocol and ports.
  */
 static void build_xfrm_selector(struct xfrm_selector *sel,
-				const char *d_prefix,
-				const char *s_prefix,
-				uint8_t proto,
-				int family)
+				const struct dp_test_crypto_policy *policy)
 {
 	memset(sel, 0, sizeof(*sel));
 
-	if (dp_test_prefix_str_to_xfrm_addr(d_prefix, &sel->daddr,
-					    &sel->prefixlen_d, family))
+	if (dp_test_prefix_str_to_xfrm_addr(policy->d_prefix, &sel->daddr,
+					    &sel->prefixlen_d, policy->family))
 		dp_test_assert_internal(0);
 
-	if (dp_test_prefix_str_to_xfrm_addr(s_prefix, &sel->saddr,
-					    &sel->prefixlen_s, family))
+	if (dp_test_prefix_str_to_xfrm_addr(policy->s_prefix, &sel->saddr,
+					    &sel->prefixlen_s, policy->family))
 		dp_test_assert_internal(0);
 
-	sel->family = family;
-	sel->proto = proto;
+	sel->family = policy->family;
+	sel->proto = policy->proto;
+	if (policy->sport) {
+		sel->sport = htons(policy->sport);
+		sel->sport_mask = UINT16_MAX;
+	}
+	if (policy->dport) {
+		sel->dport = htons(policy->dport);
+		sel->dport_mask = UINT16_MAX;
+	}
 }
 
 static void wait_for_npf_policy(const struct dp_test_crypto_policy *policy,
@@ -374,6 +379,8 @@ static void wait_for_npf_policy(const struct dp_test_crypto_policy *policy,
 	json_object *expected_json;
 	char proto_str[100];
 	char vrf_str[100];
+	char src_str[100];
+	char dst_str[100];
 	static const char template[] =
 	  "{"
 	      "\"config\": [{"
@@ -399,6 +406,18 @@ static void wait_for_npf_policy(const struct dp_test_crypto_policy *policy,
 	if (policy->proto)
 		snprintf(proto_str, 100, "proto-final %d ", policy->proto);
 
+	if (policy->sport)
+		snprintf(src_str, 100, "%s port %u", policy->s_prefix,
+			 policy->sport);
+	else
+		snprintf(src_str, 100, "%s", policy->s_prefix);
+
+	if (policy->dport)
+		snprintf(dst_str, 100, "%s port %u", policy->d_prefix,
+			 policy->dport);
+	else
+		snprintf(dst_str, 100, "%s", policy->d_prefix);
+
 	snprintf(vrf_str, 100, "out-%d", vrf_id);
 
 	char const *npf_action =
@@ -408,8 +427,8 @@ static void wait_for_npf_policy(const struct dp_test_crypto_policy *policy,
 					    vrf_str,
 					    npf_action,
 					    policy->proto ? proto_str : "",
-					    policy->s_prefix,
-					    policy->d_prefix);
+					    src_str,
+					    dst_str);
 
 	_dp_test_check_json_state("npf-op show all: ipsec",
 				  expected_json, NULL,
@@ -548,8 +567,7 @@ void _dp_test_crypto_create_policy(const char *file, int line,
 	struct xfrm_selector sel;
 	xfrm_address_t dst;
 
-	build_xfrm_selector(&sel, policy->d_prefix, policy->s_prefix,
-			    policy->proto, policy->family);
+	build_xfrm_selector(&sel, policy);
 
 	if (dp_test_prefix_str_to_xfrm_addr(policy->dst, &dst,
 					    NULL, policy->dst_family))
@@ -584,8 +602,7 @@ void _dp_test_crypto_delete_policy(const char *file, int line,
 	struct xfrm_selector sel;
 	xfrm_address_t dst;
 
-	build_xfrm_selector(&sel, policy->d_prefix, policy->s_prefix,
-			    policy->proto, policy->family);
+	build_xfrm_selector(&sel, policy);
 
 	if (dp_test_prefix_str_to_xfrm_addr(policy->dst, &dst,
 					    NULL, policy->dst_family))
@@ -37,6 +37,8 @@ struct dp_test_crypto_policy {
 	const char *d_prefix;
 	const char *s_prefix;
 	int proto;
+	uint16_t sport;		/* 0 for any */
+	uint16_t dport;		/* 0 for any */
 	const char *dst;
 	int family;
 	int dst_family;
@@ -23,6 +23,33 @@ struct esp_header {
 
 DP_DECL_TEST_SUITE(esp_replay_suite);
 
+static void
+esp_test_sa_init(struct sadb_sa *sa, uint32_t window, bool esn)
+{
+	memset(sa, 0, sizeof(*sa));
+	sa->replay_window = window;
+	sa->esn = esn;
+	sa->replay = esp_replay_create(window);
+	dp_test_fail_unless(sa->replay, "failed to create replay window");
+}
+
+static int
+esp_test_check(struct sadb_sa *sa, uint32_t seq, uint32_t *seq_hi)
+{
+	struct esp_header hdr = { .spi = 0, .seq = htonl(seq) };
+	uint32_t hi;
+
+	return esp_replay_check((uint8_t *) &hdr, sa, seq_hi ? : &hi);
+}
+
+static int
+esp_test_advance(struct sadb_sa *sa, uint32_t seq, uint32_t seq_hi)
+{
+	struct esp_header hdr = { .spi = 0, .seq = htonl(seq) };
+
+	return esp_replay_advance((uint8_t *) &hdr, sa, seq_hi);
+}
+
 DP_DECL_TEST_CASE(esp_replay_suite, sequence_number_check, NULL, NULL);
 
 /*
@@ -32,76 +59,54 @@ DP_DECL_TEST_CASE(esp_replay_suite, sequence_number_check, NULL, NULL);
 DP_START_TEST(sequence_number_check, sequence_number_check)
 {
 	struct sadb_sa sa;
-	struct esp_header hdr;
 	unsigned int i;
 
-	sa.replay_window = 0;
-	sa.replay_bitmap = 0;
-	sa.seq = 0;
-	sa.spi = 0;
-	hdr.spi = 0;
-	hdr.seq = 1;
+	memset(&sa, 0, sizeof(sa));
 
-	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == 0),
+	dp_test_fail_unless((esp_test_check(&sa, 1, NULL) == 0),
 			    "check defaults if no replay window is set");
 
-	hdr.seq = 0;
-	sa.replay_window = 32;
+	esp_test_sa_init(&sa, 32, false);
 
-	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == -1),
+	dp_test_fail_unless((esp_test_check(&sa, 0, NULL) == -1),
 			    "check should fail if sequence number is zero");
 
-	sa.seq = 10;
-	hdr.seq = htonl(11);
+	esp_test_advance(&sa, 10, 0);
 
-	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == 0),
+	dp_test_fail_unless((esp_test_check(&sa, 11, NULL) == 0),
 			    "check should pass if sequence number "
 			    "is to the right of the window");
 
-	sa.seq = 43;
-	hdr.seq = htonl(sa.seq - (sa.replay_window + 1));
+	esp_test_advance(&sa, 43, 0);
 
-	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == -2),
+	dp_test_fail_unless((esp_test_check(&sa, 43 - 33, NULL) == -2),
 			    "check should fail if sequence number "
 			    "is to the left of the window");
-	sa.seq = 43;
-	hdr.seq = htonl(sa.seq - (sa.replay_window));
-
-	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == -2),
+	dp_test_fail_unless((esp_test_check(&sa, 43 - 32, NULL) == -2),
 			    "check should fail if sequence number "
 			    "is to the left of the window");
 
-	sa.replay_bitmap = 0;
-	sa.seq = 128;
-	hdr.seq = htonl(sa.seq - 31);
+	esp_test_advance(&sa, 128, 0);
 
-	for (i = 0; i < 32; i++) {
-		dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr,
-						      &sa) == 0),
+	for (i = 128 - 31; i < 128; i++)
+		dp_test_fail_unless((esp_test_check(&sa, i, NULL) == 0),
 				    "check should pass if sequence number (%d) "
-				    "is new and within window", ntohl(hdr.seq));
-		hdr.seq = htonl(ntohl(hdr.seq) + 1);
-	}
-
-	sa.replay_bitmap = 5;
-	hdr.seq = htonl(1);
-	sa.seq = 3;
+				    "is new and within window", i);
 
-	dp_test_fail_unless(esp_replay_check((uint8_t *) &hdr, &sa) == -3,
+	dp_test_fail_unless(esp_test_check(&sa, 128, NULL) == -3,
 			    "check should fail if sequence number (%d) "
-			    "is _not_ new and within window", i);
+			    "is _not_ new and within window", 128);
 
-	hdr.seq = htonl(2);
+	esp_test_advance(&sa, 100, 0);
 
-	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == 0),
+	dp_test_fail_unless(esp_test_check(&sa, 100, NULL) == -3,
+			    "check should fail if sequence number (%d) "
+			    "is _not_ new and within window", 100);
+	dp_test_fail_unless((esp_test_check(&sa, 101, NULL) == 0),
 			    "check should pass if sequence number (%d) "
-			    "is new and within window", i);
-
-	hdr.seq = htonl(3);
+			    "is new and within window", 101);
 
-	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == -3),
-			    "check should fail if sequence number (%d) "
-			    "Is _not_ new and within window", i);
+	esp_replay_destroy(sa.replay);
 } DP_END_TEST;
 
 DP_DECL_TEST_CASE(esp_replay_suite, sequence_number_advance, NULL, NULL);
@@ -113,46 +118,139 @@ DP_DECL_TEST_CASE(esp_replay_suite, sequence_number_advance, NULL, NULL);
 DP_START_TEST(sequence_number_advance, sequence_number_advance)
 {
 	struct sadb_sa sa;
-	struct esp_header hdr;
 
-	sa.replay_window = 3;
-	sa.replay_bitmap = 0;
-	sa.seq = 0;
-	hdr.spi = 0;
-	hdr.seq = htonl(1);
+	esp_test_sa_init(&sa, 3, false);
 
-	esp_replay_advance((uint8_t *) &hdr, &sa);
-	dp_test_fail_unless((sa.seq == 1),
+	dp_test_fail_unless(esp_test_advance(&sa, 1, 0) == 0,
+			    "advance to 1 should pass");
+	dp_test_fail_unless((sa.replay->top == 1),
 			    "sequence number failed to advance to 1");
-	dp_test_fail_unless((sa.replay_bitmap == 1), "bitmap should be 1");
 
-	hdr.seq = htonl(2);
-	esp_replay_advance((uint8_t *) &hdr, &sa);
-	dp_test_fail_unless((sa.seq == 2),
+	dp_test_fail_unless(esp_test_advance(&sa, 2, 0) == 0,
+			    "advance to 2 should pass");
+	dp_test_fail_unless((sa.replay->top == 2),
 			    "sequence number failed to advance to 2");
-	dp_test_fail_unless((sa.replay_bitmap == 3), "bitmap should be 3");
 
-	hdr.seq = htonl(4);
-	esp_replay_advance((uint8_t *) &hdr, &sa);
-	dp_test_fail_unless((sa.seq == 4),
+	dp_test_fail_unless(esp_test_advance(&sa, 4, 0) == 0,
+			    "advance to 4 should pass");
+	dp_test_fail_unless((sa.replay->top == 4),
 			    "sequence number failed to advance to 4");
-	dp_test_fail_unless((sa.replay_bitmap == 13), "bitmap should be 13");
 
-	hdr.seq = htonl(3);
-	esp_replay_advance((uint8_t *) &hdr, &sa);
-	dp_test_fail_unless((sa.seq == 4),
+	dp_test_fail_unless(esp_test_advance(&sa, 3, 0) == 0,
+			    "advance with 3 should pass");
+	dp_test_fail_unless((sa.replay->top == 4),
 			    "sequence number should still be 4");
-	dp_test_fail_unless((sa.replay_bitmap == 15), "bitmap should be 15");
 
-	hdr.seq = htonl(5);
-	esp_replay_advance((uint8_t *) &hdr, &sa);
-	dp_test_fail_unless((sa.seq == 5),
-			    "sequence number failed to advance to 5");
-	dp_test_fail_unless((sa.replay_bitmap == 31), "bitmap should be 31");
+	dp_test_fail_unless(esp_test_advance(&sa, 3, 0) == -3,
+			    "advance with 3 again should fail");
 
-	hdr.seq = htonl(7);
-	esp_replay_advance((uint8_t *) &hdr, &sa);
-	dp_test_fail_unless((sa.seq == 7),
+	dp_test_fail_unless(esp_test_advance(&sa, 7, 0) == 0,
+			    "advance to 7 should pass");
+	dp_test_fail_unless((sa.replay->top == 7),
 			    "sequence number failed to advance to 7");
-	dp_test_fail_unless((sa.replay_bitmap == 125), "bitmap should be 125");
+
+	dp_test_fail_unless(esp_test_advance(&sa, 4, 0) == -2,
+			    "advance with 4 should fail, left of window");
+	dp_test_fail_unless(esp_test_advance(&sa, 5, 0) == 0,
+			    "advance with 5 should pass");
+
+	esp_replay_destroy(sa.replay);
+} DP_END_TEST;
+
+DP_DECL_TEST_CASE(esp_replay_suite, large_window, NULL, NULL);
+
+/*
+ * Does a window of thousands of packets, spanning many slots, catch
+ * replays across the whole of it as it moves?
+ */
+DP_START_TEST(large_window, large_window)
+{
+	struct sadb_sa sa;
+	uint32_t i;
+
+	esp_test_sa_init(&sa, ESP_REPLAY_WINDOW_MAX, false);
+
+	/* Every other packet, in reverse, to leave gaps in each slot */
+	for (i = 5000; i > 5000 - ESP_REPLAY_WINDOW_MAX; i -= 2)
+		dp_test_fail_unless(esp_test_advance(&sa, i, 0) == 0,
+				    "advance with %u should pass", i);
+
+	for (i = 5000; i > 5000 - ESP_REPLAY_WINDOW_MAX; i--)
+		dp_test_fail_unless(esp_test_check(&sa, i, NULL) ==
+				    ((i & 1) ? 0 : -3),
+				    "check of %u failed", i);
+
+	dp_test_fail_unless(esp_test_check(&sa, 5000 - ESP_REPLAY_WINDOW_MAX,
+					   NULL) == -2,
+			    "check should fail left of window");
+
+	/* Move the window on by most of its size */
+	dp_test_fail_unless(esp_test_advance(&sa, 8000, 0) == 0,
+			    "advance to 8000 should pass");
+
+	for (i = 8000 - ESP_REPLAY_WINDOW_MAX + 1; i <= 5000; i++)
+		dp_test_fail_unless(esp_test_check(&sa, i, NULL) ==
+				    ((i & 1) ? 0 : -3),
+				    "check of %u failed after move", i);
+
+	for (i = 5001; i < 8000; i++)
+		dp_test_fail_unless(esp_test_check(&sa, i, NULL) == 0,
+				    "check of %u should pass", i);
+
+	/* And past it, so that no old state is left */
+	dp_test_fail_unless(esp_test_advance(&sa, 20000, 0) == 0,
+			    "advance to 20000 should pass");
+
+	for (i = 20000 - ESP_REPLAY_WINDOW_MAX + 1; i < 20000; i++)
+		dp_test_fail_unless(esp_test_check(&sa, i, NULL) == 0,
+				    "check of %u should pass", i);
+
+	esp_replay_destroy(sa.replay);
+} DP_END_TEST;
+
+DP_DECL_TEST_CASE(esp_replay_suite, extended_sequence_number, NULL, NULL);
+
+/*
+ * Are the high order bits of the sequence number inferred correctly
+ * as the low order bits wrap?
+ */
+DP_START_TEST(extended_sequence_number, extended_sequence_number)
+{
+	struct sadb_sa sa;
+	uint32_t seq_hi;
+
+	esp_test_sa_init(&sa, 64, true);
+
+	dp_test_fail_unless(esp_test_advance(&sa, 0xfffffff0, 0) == 0,
+			    "advance to 0xfffffff0 should pass");
+
+	dp_test_fail_unless(esp_test_check(&sa, 5, &seq_hi) == 0,
+			    "check after low order wrap should pass");
+	dp_test_fail_unless(seq_hi == 1, "seq_hi should be 1, is %u",
+			    seq_hi);
+
+	dp_test_fail_unless(esp_test_advance(&sa, 5, seq_hi) == 0,
+			    "advance after low order wrap should pass");
+	dp_test_fail_unless(sa.replay->top == 0x100000005ul,
+			    "top should be 0x100000005");
+
+	/* The window now spans the two subspaces */
+	dp_test_fail_unless(esp_test_check(&sa, 0xfffffff8, &seq_hi) == 0,
+			    "check before the wrap should pass");
+	dp_test_fail_unless(seq_hi == 0, "seq_hi should be 0, is %u",
+			    seq_hi);
+
+	dp_test_fail_unless(esp_test_check(&sa, 0xfffffff0, &seq_hi) == -3,
+			    "check of replay before the wrap should fail");
+
+	dp_test_fail_unless(esp_test_check(&sa, 0, &seq_hi) == 0,
+			    "check of low order zero after the wrap "
+			    "should pass");
+	dp_test_fail_unless(seq_hi == 1, "seq_hi should be 1, is %u",
+			    seq_hi);
+
+	dp_test_fail_unless(esp_test_check(&sa, 5, &seq_hi) == -3,
+			    "check of replay after the wrap should fail");
+
+	esp_replay_destroy(sa.replay);
 } DP_END_TEST;
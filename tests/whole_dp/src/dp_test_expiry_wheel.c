@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Expiry wheel tests
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "expiry_wheel.h"
+#include "util.h"
+
+#include "dp_test.h"
+
+DP_DECL_TEST_SUITE(expiry_wheel);
+
+struct ew_test_entry {
+	struct ew_entry	te_ew;
+	uint64_t	te_expiry;	/* UINT64_MAX when idle */
+	uint64_t	te_fired;	/* tick last expired at */
+	bool		te_released;
+};
+
+static void ew_test_expire(struct expiry_wheel *w __unused,
+			   struct ew_entry *e, uint64_t now)
+{
+	struct ew_test_entry *te =
+		caa_container_of(e, struct ew_test_entry, te_ew);
+
+	te->te_fired = now;
+	te->te_expiry = UINT64_MAX;
+}
+
+static void ew_test_release(struct expiry_wheel *w __unused,
+			    struct ew_entry *e)
+{
+	struct ew_test_entry *te =
+		caa_container_of(e, struct ew_test_entry, te_ew);
+
+	te->te_released = true;
+}
+
+/*
+ * Entries are expired at the first run at or after their expiry, at
+ * every level of the wheel and beyond its span.
+ */
+DP_DECL_TEST_CASE(expiry_wheel, expiry_wheel_expire, NULL, NULL);
+DP_START_TEST(expiry_wheel_expire, expiry_wheel_expire)
+{
+	static const uint64_t deltas[] = {
+		0, 1, 2, 63, 64, 65, 4095, 4096, 4097, 262143, 262144,
+		EW_SPAN - 1, EW_SPAN, EW_SPAN + 12345,
+	};
+	struct ew_test_entry te[ARRAY_SIZE(deltas)];
+	struct expiry_wheel w;
+	uint64_t now = 1000;
+	unsigned int i;
+
+	ew_init(&w, now, ew_test_expire, ew_test_release);
+	for (i = 0; i < ARRAY_SIZE(deltas); i++) {
+		ew_entry_init(&te[i].te_ew);
+		te[i].te_expiry = now + deltas[i];
+		te[i].te_fired = 0;
+		te[i].te_released = false;
+		ew_schedule(&w, &te[i].te_ew, te[i].te_expiry);
+	}
+
+	/* Step in uneven strides to cross every cascade boundary */
+	while (now < 1000 + EW_SPAN + 20000) {
+		now += (now & 1) ? 7 : 1;
+		ew_run(&w, now, UINT_MAX);
+
+		for (i = 0; i < ARRAY_SIZE(deltas); i++) {
+			if (te[i].te_expiry == UINT64_MAX)
+				continue;
+			dp_test_fail_unless(te[i].te_expiry > now,
+					    "delta %lu not expired at %lu\n",
+					    deltas[i], now);
+		}
+	}
+
+	for (i = 0; i < ARRAY_SIZE(deltas); i++) {
+		dp_test_fail_unless(te[i].te_fired >= 1000 + deltas[i],
+				    "delta %lu expired early at %lu\n",
+				    deltas[i], te[i].te_fired);
+		dp_test_fail_unless(te[i].te_fired < 1000 + deltas[i] + 8,
+				    "delta %lu expired late at %lu\n",
+				    deltas[i], te[i].te_fired);
+	}
+	dp_test_fail_unless(w.ew_count == 0, "%lu entries left on wheel\n",
+			    w.ew_count);
+} DP_END_TEST;
+
+/*
+ * Kicked entries expire on the next run, released entries are passed
+ * back once and never expired, and the budget bounds each run.
+ */
+DP_DECL_TEST_CASE(expiry_wheel, expiry_wheel_kick_release, NULL, NULL);
+DP_START_TEST(expiry_wheel_kick_release, expiry_wheel_kick_release)
+{
+	struct ew_test_entry te[8];
+	struct expiry_wheel w;
+	unsigned int i;
+
+	ew_init(&w, 0, ew_test_expire, ew_test_release);
+	for (i = 0; i < ARRAY_SIZE(te); i++) {
+		ew_entry_init(&te[i].te_ew);
+		te[i].te_expiry = 100000;
+		te[i].te_fired = 0;
+		te[i].te_released = false;
+		ew_schedule(&w, &te[i].te_ew, te[i].te_expiry);
+	}
+
+	/* Kick all, release some of them, one both before and after */
+	for (i = 0; i < ARRAY_SIZE(te); i++)
+		ew_kick(&w, &te[i].te_ew);
+	ew_release(&w, &te[0].te_ew);
+	ew_release(&w, &te[1].te_ew);
+	ew_kick(&w, &te[1].te_ew);
+	ew_release(&w, &te[1].te_ew);
+
+	/* Six kicked entries, budget of four */
+	dp_test_fail_unless(ew_run(&w, 10, 4), "expected more work\n");
+	dp_test_fail_unless(!ew_run(&w, 11, 4), "expected no more work\n");
+
+	for (i = 0; i < ARRAY_SIZE(te); i++) {
+		if (i < 2) {
+			dp_test_fail_unless(te[i].te_released,
+					    "entry %u not released\n", i);
+			dp_test_fail_unless(te[i].te_fired == 0,
+					    "released entry %u expired\n", i);
+		} else {
+			dp_test_fail_unless(!te[i].te_released,
+					    "entry %u released\n", i);
+			dp_test_fail_unless(te[i].te_fired == 10 ||
+					    te[i].te_fired == 11,
+					    "entry %u expired at %lu\n", i,
+					    te[i].te_fired);
+		}
+	}
+	dp_test_fail_unless(w.ew_count == 0, "%lu entries left on wheel\n",
+			    w.ew_count);
+} DP_END_TEST;
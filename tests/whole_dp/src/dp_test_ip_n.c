@@ -15,6 +15,7 @@
 #include "dp_test_lib_intf_internal.h"
 #include "dp_test/dp_test_macros.h"
 #include "dp_test_netlink_state_internal.h"
+#include "util.h"
 
 DP_DECL_TEST_SUITE(ip_suite_n);
 
@@ -123,3 +124,102 @@ DP_START_TEST(ip_fwd_n, if_fwd_n)
 	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
 	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
 } DP_END_TEST;
+
+/*
+ * Packets forwarded out of two interfaces, mixed with packets dropped
+ * part way through the graph.  The next hop MAC is NULL for a drop.
+ */
+static const struct {
+	const char *dst;
+	const char *oif;
+	const char *nh_mac;
+} ip_fwd_burst_paks[] = {
+	{ "10.73.2.1", "dp2T1", "aa:bb:cc:dd:ee:ff" },
+	{ "10.73.3.1", "dp3T3", "aa:bb:cc:dd:ee:fe" },
+	{ "1.1.1.255", NULL, NULL },
+	{ "10.73.2.2", "dp2T1", "aa:bb:cc:dd:ee:ff" },
+	{ "1.1.1.255", NULL, NULL },
+	{ "10.73.3.2", "dp3T3", "aa:bb:cc:dd:ee:fe" },
+	{ "10.73.3.3", "dp3T3", "aa:bb:cc:dd:ee:fe" },
+	{ "10.73.2.3", "dp2T1", "aa:bb:cc:dd:ee:ff" },
+};
+
+static struct rte_mbuf *ip_fwd_burst_pak(unsigned int i)
+{
+	struct rte_mbuf *m;
+	int len = 22;
+
+	m = dp_test_create_ipv4_pak("10.73.1.1", ip_fwd_burst_paks[i].dst,
+				    1, &len);
+	dp_test_pktmbuf_eth_init(m, dp_test_intf_name2mac_str("dp1T0"),
+				 DP_TEST_INTF_DEF_SRC_MAC,
+				 RTE_ETHER_TYPE_IPV4);
+	return m;
+}
+
+static void ip_fwd_burst_exp(struct dp_test_expected *exp, int pak,
+			     unsigned int i)
+{
+	if (!ip_fwd_burst_paks[i].oif) {
+		dp_test_exp_set_fwd_status_m(exp, pak, DP_TEST_FWD_DROPPED);
+		return;
+	}
+
+	dp_test_pktmbuf_eth_init(
+		dp_test_exp_get_pak_m(exp, pak), ip_fwd_burst_paks[i].nh_mac,
+		dp_test_intf_name2mac_str(ip_fwd_burst_paks[i].oif),
+		RTE_ETHER_TYPE_IPV4);
+	dp_test_ipv4_decrement_ttl(dp_test_exp_get_pak_m(exp, pak));
+	dp_test_exp_set_oif_name_m(exp, pak, ip_fwd_burst_paks[i].oif);
+}
+
+/*
+ * A burst walked through the graph a node at a time gives each packet
+ * the same result as when it is received on its own.
+ */
+DP_DECL_TEST_CASE(ip_suite_n, ip_fwd_burst, NULL, NULL);
+DP_START_TEST(ip_fwd_burst, if_fwd_burst)
+{
+	struct rte_mbuf *rx_pak_n[ARRAY_SIZE(ip_fwd_burst_paks)];
+	struct dp_test_expected *exp = NULL;
+	unsigned int i;
+
+	/* Set up the interface addresses */
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_nl_add_ip_addr_and_connected("dp3T3", "3.3.3.3/24");
+
+	dp_test_netlink_add_route("10.73.2.0/24 nh 2.2.2.1 int:dp2T1");
+	dp_test_netlink_add_route("10.73.3.0/24 nh 3.3.3.1 int:dp3T3");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:ee:ff");
+	dp_test_netlink_add_neigh("dp3T3", "3.3.3.1", "aa:bb:cc:dd:ee:fe");
+
+	/* The whole burst at once */
+	for (i = 0; i < ARRAY_SIZE(ip_fwd_burst_paks); i++) {
+		rx_pak_n[i] = ip_fwd_burst_pak(i);
+		if (i == 0)
+			exp = dp_test_exp_create_m(rx_pak_n[i], 1);
+		else
+			dp_test_exp_append_m(exp, rx_pak_n[i], 1);
+		ip_fwd_burst_exp(exp, i, i);
+	}
+	dp_test_pak_receive_n(rx_pak_n, ARRAY_SIZE(ip_fwd_burst_paks),
+			      "dp1T0", exp);
+
+	/* And a packet at a time */
+	for (i = 0; i < ARRAY_SIZE(ip_fwd_burst_paks); i++) {
+		rx_pak_n[0] = ip_fwd_burst_pak(i);
+		exp = dp_test_exp_create_m(rx_pak_n[0], 1);
+		ip_fwd_burst_exp(exp, 0, i);
+		dp_test_pak_receive(rx_pak_n[0], "dp1T0", exp);
+	}
+
+	/* Clean Up */
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:ee:ff");
+	dp_test_netlink_del_neigh("dp3T3", "3.3.3.1", "aa:bb:cc:dd:ee:fe");
+	dp_test_netlink_del_route("10.73.2.0/24 nh 2.2.2.1 int:dp2T1");
+	dp_test_netlink_del_route("10.73.3.0/24 nh 3.3.3.1 int:dp3T3");
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_nl_del_ip_addr_and_connected("dp3T3", "3.3.3.3/24");
+} DP_END_TEST;
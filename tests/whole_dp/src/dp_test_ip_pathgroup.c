@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * dataplane UT IP path group tests
+ */
+
+#include <libmnl/libmnl.h>
+
+#include "ip_funcs.h"
+#include "if_var.h"
+#include "main.h"
+
+#include "dp_test.h"
+#include "dp_test_controller.h"
+#include "dp_test_netlink_state_internal.h"
+#include "dp_test_lib_internal.h"
+#include "dp_test_lib_intf_internal.h"
+#include "dp_test_lib_exp.h"
+#include "dp_test_pktmbuf_lib_internal.h"
+
+DP_DECL_TEST_SUITE(ip_pathgroup_suite);
+
+struct nh_info {
+	const char *nh_mac_str;
+	const char *nh_int;
+	int nh_int_tci;
+};
+
+static void _build_and_send_pak(const char *src_addr, const char *dest_addr,
+				struct nh_info nh, const char *func, int line)
+{
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+	int len = 22;
+
+	test_pak = dp_test_create_ipv4_pak(src_addr, dest_addr, 1, &len);
+	dp_test_pktmbuf_eth_init(test_pak,
+				 dp_test_intf_name2mac_str("dp1T0"),
+				 DP_TEST_INTF_DEF_SRC_MAC,
+				 RTE_ETHER_TYPE_IPV4);
+
+	exp = dp_test_exp_create(test_pak);
+	dp_test_exp_set_oif_name(exp, nh.nh_int);
+	if (nh.nh_int_tci)
+		dp_test_exp_set_vlan_tci(exp, nh.nh_int_tci);
+	(void)dp_test_pktmbuf_eth_init(dp_test_exp_get_pak(exp),
+				       nh.nh_mac_str,
+				       dp_test_intf_name2mac_str(nh.nh_int),
+				       RTE_ETHER_TYPE_IPV4);
+	dp_test_ipv4_decrement_ttl(dp_test_exp_get_pak(exp));
+
+	_dp_test_pak_receive(test_pak, "dp1T0", exp, __FILE__, func, line);
+}
+
+#define build_and_send_pak(src_addr, dest_addr, nh) \
+	_build_and_send_pak(src_addr, dest_addr, nh, __func__, __LINE__)
+
+/*
+ * Routes using a path group follow every update to the group, so
+ * moving the group to another path moves all of its routes at once.
+ * Deleting the group leaves the routes with its last paths.
+ */
+DP_DECL_TEST_CASE(ip_pathgroup_suite, ip_pathgroup_update, NULL, NULL);
+DP_START_TEST(ip_pathgroup_update, ip_pathgroup_update)
+{
+	struct nh_info nh2 = {
+		.nh_mac_str = "aa:bb:cc:dd:ee:2",
+		.nh_int = "dp2T1",
+	};
+	struct nh_info nh3 = {
+		.nh_mac_str = "aa:bb:cc:dd:ee:3",
+		.nh_int = "dp3T1",
+	};
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_nl_add_ip_addr_and_connected("dp3T1", "3.3.3.3/24");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", nh2.nh_mac_str);
+	dp_test_netlink_add_neigh("dp3T1", "3.3.3.1", nh3.nh_mac_str);
+
+	dp_test_netlink_add_pathgroup(1, "0.0.0.0/0 nh 2.2.2.1 int:dp2T1");
+	dp_test_netlink_add_pathgroup_route("10.73.1.0/24", 1);
+	dp_test_netlink_add_pathgroup_route("10.73.2.0/24", 1);
+	dp_test_verify_add_route("10.73.1.0/24 nh 2.2.2.1 int:dp2T1", true);
+	dp_test_verify_add_route("10.73.2.0/24 nh 2.2.2.1 int:dp2T1", true);
+
+	build_and_send_pak("1.1.1.2", "10.73.1.1", nh2);
+	build_and_send_pak("1.1.1.2", "10.73.2.1", nh2);
+
+	/* Switch the group over, which moves both routes */
+	dp_test_netlink_add_pathgroup(1, "0.0.0.0/0 nh 3.3.3.1 int:dp3T1");
+	dp_test_verify_add_route("10.73.1.0/24 nh 3.3.3.1 int:dp3T1", true);
+	dp_test_verify_add_route("10.73.2.0/24 nh 3.3.3.1 int:dp3T1", true);
+
+	build_and_send_pak("1.1.1.2", "10.73.1.1", nh3);
+	build_and_send_pak("1.1.1.2", "10.73.2.1", nh3);
+
+	/* Routes keep the last paths of a deleted group */
+	dp_test_netlink_del_pathgroup(1, "0.0.0.0/0 nh 3.3.3.1 int:dp3T1");
+	build_and_send_pak("1.1.1.2", "10.73.1.1", nh3);
+
+	dp_test_netlink_del_pathgroup_route("10.73.1.0/24", 1);
+	dp_test_netlink_del_pathgroup_route("10.73.2.0/24", 1);
+	dp_test_verify_del_route("10.73.1.0/24 nh 3.3.3.1 int:dp3T1", false);
+	dp_test_verify_del_route("10.73.2.0/24 nh 3.3.3.1 int:dp3T1", false);
+
+	/* Clean Up */
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", nh2.nh_mac_str);
+	dp_test_netlink_del_neigh("dp3T1", "3.3.3.1", nh3.nh_mac_str);
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_nl_del_ip_addr_and_connected("dp3T1", "3.3.3.3/24");
+} DP_END_TEST;
+
+/*
+ * A route that comes down before its path group is kept as incomplete
+ * and installed once the group is created.
+ */
+DP_DECL_TEST_CASE(ip_pathgroup_suite, ip_pathgroup_route_first, NULL, NULL);
+DP_START_TEST(ip_pathgroup_route_first, ip_pathgroup_route_first)
+{
+	struct nh_info nh2 = {
+		.nh_mac_str = "aa:bb:cc:dd:ee:2",
+		.nh_int = "dp2T1",
+	};
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", nh2.nh_mac_str);
+
+	dp_test_netlink_add_pathgroup_route("10.73.1.0/24", 2);
+	dp_test_check_state_show("incomplete", "\"incomplete\":1", false);
+	dp_test_verify_del_route("10.73.1.0/24 nh 2.2.2.1 int:dp2T1", false);
+
+	dp_test_netlink_add_pathgroup(2, "0.0.0.0/0 nh 2.2.2.1 int:dp2T1");
+	dp_test_verify_add_route("10.73.1.0/24 nh 2.2.2.1 int:dp2T1", true);
+	dp_test_check_state_show("incomplete", "\"incomplete\":0", false);
+
+	build_and_send_pak("1.1.1.2", "10.73.1.1", nh2);
+
+	/* A route deleted while waiting for its group is never added */
+	dp_test_netlink_add_pathgroup_route("10.73.3.0/24", 3);
+	dp_test_netlink_del_pathgroup_route("10.73.3.0/24", 3);
+	dp_test_check_state_show("incomplete", "\"incomplete\":0", false);
+	dp_test_netlink_add_pathgroup(3, "0.0.0.0/0 nh 2.2.2.1 int:dp2T1");
+	dp_test_verify_del_route("10.73.3.0/24 nh 2.2.2.1 int:dp2T1", false);
+
+	/* Clean Up */
+	dp_test_netlink_del_pathgroup_route("10.73.1.0/24", 2);
+	dp_test_verify_del_route("10.73.1.0/24 nh 2.2.2.1 int:dp2T1", false);
+	dp_test_netlink_del_pathgroup(2, "0.0.0.0/0 nh 2.2.2.1 int:dp2T1");
+	dp_test_netlink_del_pathgroup(3, "0.0.0.0/0 nh 2.2.2.1 int:dp2T1");
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", nh2.nh_mac_str);
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+} DP_END_TEST;
+
+/*
+ * A path group with a path over an interface that has not arrived yet
+ * is installed, with its routes, and the path is filled in when the
+ * interface arrives.
+ */
+DP_DECL_TEST_CASE(ip_pathgroup_suite, ip_pathgroup_incomplete_intf, NULL,
+		  NULL);
+DP_START_TEST(ip_pathgroup_incomplete_intf, ip_pathgroup_incomplete_intf)
+{
+	struct nh_info nh3 = {
+		.nh_mac_str = "aa:bb:cc:dd:ee:31",
+		.nh_int = "dp3T1",
+		.nh_int_tci = 100,
+	};
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+
+	dp_test_intf_vif_create_incmpl("dp3T1.100", "dp3T1", 100);
+	dp_test_netlink_add_pathgroup(4,
+				      "0.0.0.0/0 nh 3.3.1.2 int:dp3T1.100");
+	dp_test_netlink_add_pathgroup_route("10.73.1.0/24", 4);
+	dp_test_check_state_show("incomplete", "\"incomplete\":1", false);
+
+	dp_test_intf_vif_create_incmpl_fin("dp3T1.100", "dp3T1", 100);
+	dp_test_nl_add_ip_addr_and_connected("dp3T1.100", "3.3.1.1/24");
+	dp_test_verify_add_route("10.73.1.0/24 nh 3.3.1.2 int:dp3T1.100",
+				 true);
+	dp_test_check_state_show("incomplete", "\"incomplete\":0", false);
+	dp_test_netlink_add_neigh("dp3T1.100", "3.3.1.2", nh3.nh_mac_str);
+
+	build_and_send_pak("1.1.1.2", "10.73.1.1", nh3);
+
+	/* Clean Up */
+	dp_test_netlink_del_pathgroup_route("10.73.1.0/24", 4);
+	dp_test_verify_del_route("10.73.1.0/24 nh 3.3.1.2 int:dp3T1.100",
+				 false);
+	dp_test_netlink_del_pathgroup(4,
+				      "0.0.0.0/0 nh 3.3.1.2 int:dp3T1.100");
+	dp_test_netlink_del_neigh("dp3T1.100", "3.3.1.2", nh3.nh_mac_str);
+	dp_test_nl_del_ip_addr_and_connected("dp3T1.100", "3.3.1.1/24");
+	dp_test_intf_vif_del("dp3T1.100", 100);
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+} DP_END_TEST;
+
+/*
+ * A /32 over a connected path of a group gets its own copy of the
+ * paths, so the neighbour is linked to the /32 and not to the other
+ * routes of the group.
+ */
+DP_DECL_TEST_CASE(ip_pathgroup_suite, ip_pathgroup_32_connected, NULL, NULL);
+DP_START_TEST(ip_pathgroup_32_connected, ip_pathgroup_32_connected)
+{
+	const char *nh_mac_str = "aa:bb:cc:dd:ee:ff";
+	struct nh_info nh2 = {
+		.nh_mac_str = nh_mac_str,
+		.nh_int = "dp2T1",
+	};
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+
+	dp_test_netlink_add_pathgroup(5, "0.0.0.0/0 nh int:dp2T1");
+	dp_test_netlink_add_pathgroup_route("10.73.1.0/24", 5);
+	dp_test_netlink_add_pathgroup_route("2.2.2.7/32", 5);
+	dp_test_verify_add_route("2.2.2.7/32 nh int:dp2T1", true);
+
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.7", nh_mac_str);
+	dp_test_verify_route_neigh_present("2.2.2.7", "dp2T1", true);
+	dp_test_verify_route_no_neigh_present("10.73.1.1");
+
+	build_and_send_pak("1.1.1.2", "2.2.2.7", nh2);
+
+	/* Clean Up */
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.7", nh_mac_str);
+	dp_test_netlink_del_pathgroup_route("2.2.2.7/32", 5);
+	dp_test_netlink_del_pathgroup_route("10.73.1.0/24", 5);
+	dp_test_verify_del_route("2.2.2.7/32 nh int:dp2T1", false);
+	dp_test_verify_del_route("10.73.1.0/24 nh int:dp2T1", false);
+	dp_test_netlink_del_pathgroup(5, "0.0.0.0/0 nh int:dp2T1");
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+} DP_END_TEST;
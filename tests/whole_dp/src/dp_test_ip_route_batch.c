@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * dataplane UT IP route batch tests
+ */
+
+#include "ip_funcs.h"
+#include "if_var.h"
+#include "main.h"
+
+#include "dp_test.h"
+#include "dp_test_controller.h"
+#include "dp_test_netlink_state_internal.h"
+#include "dp_test_lib_internal.h"
+#include "dp_test_lib_intf_internal.h"
+#include "dp_test_lib_exp.h"
+#include "dp_test_pktmbuf_lib_internal.h"
+
+DP_DECL_TEST_SUITE(ip_route_batch_suite);
+
+struct nh_info {
+	const char *nh_mac_str;
+	const char *nh_int;
+};
+
+static const struct nh_info nh2 = {
+	.nh_mac_str = "aa:bb:cc:dd:ee:2",
+	.nh_int = "dp2T1",
+};
+
+static const struct nh_info nh3 = {
+	.nh_mac_str = "aa:bb:cc:dd:ee:3",
+	.nh_int = "dp3T1",
+};
+
+static void _build_and_send_pak(const char *src_addr, const char *dest_addr,
+				const struct nh_info *nh, const char *func,
+				int line)
+{
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+	int len = 22;
+
+	test_pak = dp_test_create_ipv4_pak(src_addr, dest_addr, 1, &len);
+	dp_test_pktmbuf_eth_init(test_pak,
+				 dp_test_intf_name2mac_str("dp1T0"),
+				 DP_TEST_INTF_DEF_SRC_MAC,
+				 RTE_ETHER_TYPE_IPV4);
+
+	exp = dp_test_exp_create(test_pak);
+	dp_test_exp_set_oif_name(exp, nh->nh_int);
+	(void)dp_test_pktmbuf_eth_init(dp_test_exp_get_pak(exp),
+				       nh->nh_mac_str,
+				       dp_test_intf_name2mac_str(nh->nh_int),
+				       RTE_ETHER_TYPE_IPV4);
+	dp_test_ipv4_decrement_ttl(dp_test_exp_get_pak(exp));
+
+	_dp_test_pak_receive(test_pak, "dp1T0", exp, __FILE__, func, line);
+}
+
+#define build_and_send_pak(src_addr, dest_addr, nh) \
+	_build_and_send_pak(src_addr, dest_addr, nh, __func__, __LINE__)
+
+static void setup(void)
+{
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_nl_add_ip_addr_and_connected("dp3T1", "3.3.3.3/24");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", nh2.nh_mac_str);
+	dp_test_netlink_add_neigh("dp3T1", "3.3.3.1", nh3.nh_mac_str);
+}
+
+static void teardown(void)
+{
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", nh2.nh_mac_str);
+	dp_test_netlink_del_neigh("dp3T1", "3.3.3.1", nh3.nh_mac_str);
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_nl_del_ip_addr_and_connected("dp3T1", "3.3.3.3/24");
+}
+
+/*
+ * A route added and then deleted in the same batch is never
+ * installed, while the rest of the batch is applied.  Deleting a
+ * route and adding it back in one batch leaves it with the new paths.
+ */
+DP_DECL_TEST_CASE(ip_route_batch_suite, ip_route_batch_add_del, setup,
+		  teardown);
+DP_START_TEST(ip_route_batch_add_del, ip_route_batch_add_del)
+{
+	const struct dp_test_route_update add_del[] = {
+		{ "10.73.1.0/24 nh 2.2.2.1 int:dp2T1", false },
+		{ "10.73.2.0/24 nh 2.2.2.1 int:dp2T1", false },
+		{ "10.73.1.0/24 nh 2.2.2.1 int:dp2T1", true },
+	};
+	const struct dp_test_route_update del_add[] = {
+		{ "10.73.2.0/24 nh 2.2.2.1 int:dp2T1", true },
+		{ "10.73.2.0/24 nh 3.3.3.1 int:dp3T1", false },
+	};
+	const struct dp_test_route_update del[] = {
+		{ "10.73.2.0/24 nh 3.3.3.1 int:dp3T1", true },
+	};
+
+	dp_test_netlink_route_batch(add_del);
+	dp_test_verify_add_route("10.73.2.0/24 nh 2.2.2.1 int:dp2T1", true);
+	dp_test_verify_del_route("10.73.1.0/24 nh 2.2.2.1 int:dp2T1", false);
+
+	build_and_send_pak("1.1.1.2", "10.73.2.1", &nh2);
+
+	dp_test_netlink_route_batch(del_add);
+	dp_test_verify_add_route("10.73.2.0/24 nh 3.3.3.1 int:dp3T1", true);
+
+	build_and_send_pak("1.1.1.2", "10.73.2.1", &nh3);
+
+	/* Clean Up */
+	dp_test_netlink_route_batch(del);
+	dp_test_verify_del_route("10.73.2.0/24 nh 3.3.3.1 int:dp3T1", false);
+} DP_END_TEST;
+
+/*
+ * A later add for a route replaces an earlier one in the same batch,
+ * whether the route is new or already installed.
+ */
+DP_DECL_TEST_CASE(ip_route_batch_suite, ip_route_batch_replace, setup,
+		  teardown);
+DP_START_TEST(ip_route_batch_replace, ip_route_batch_replace)
+{
+	const struct dp_test_route_update add_replace[] = {
+		{ "10.73.1.0/24 nh 2.2.2.1 int:dp2T1", false },
+		{ "10.73.1.0/24 nh 3.3.3.1 int:dp3T1", false },
+	};
+	const struct dp_test_route_update replace_back[] = {
+		{ "10.73.1.0/24 nh 3.3.3.1 int:dp3T1", false },
+		{ "10.73.1.0/24 nh 2.2.2.1 int:dp2T1", false },
+	};
+	const struct dp_test_route_update del[] = {
+		{ "10.73.1.0/24 nh 2.2.2.1 int:dp2T1", true },
+	};
+
+	dp_test_netlink_route_batch(add_replace);
+	dp_test_verify_add_route("10.73.1.0/24 nh 3.3.3.1 int:dp3T1", true);
+
+	build_and_send_pak("1.1.1.2", "10.73.1.1", &nh3);
+
+	dp_test_netlink_route_batch(replace_back);
+	dp_test_verify_add_route("10.73.1.0/24 nh 2.2.2.1 int:dp2T1", true);
+
+	build_and_send_pak("1.1.1.2", "10.73.1.1", &nh2);
+
+	/* Clean Up */
+	dp_test_netlink_route_batch(del);
+	dp_test_verify_del_route("10.73.1.0/24 nh 2.2.2.1 int:dp2T1", false);
+} DP_END_TEST;
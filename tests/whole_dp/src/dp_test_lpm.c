@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Test LPM bulk lookup functionality
+ */
+
+#include <arpa/inet.h>
+#include <linux/rtnetlink.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dp_test_controller.h"
+#include "dp_test/dp_test_macros.h"
+
+#include "lpm/lpm.h"
+#include "lpm/lpm6.h"
+#include "util.h"
+
+DP_DECL_TEST_SUITE(lpm);
+
+#define LPM_TEST_ADDRS 37
+
+static void
+lpm_test_add(struct lpm *lpm, uint32_t ip, uint8_t depth, uint32_t nh)
+{
+	struct pd_obj_state_and_flags *pd_state;
+	struct pd_obj_state_and_flags *old_pd_state;
+	uint32_t old_nh;
+	int ret;
+
+	ret = lpm_add(lpm, ip, depth, nh, RT_SCOPE_UNIVERSE, &pd_state,
+		      &old_nh, &old_pd_state);
+	dp_test_fail_unless(ret == LPM_SUCCESS,
+			    "lpm_add 0x%08x/%u failed: %d\n", ip, depth, ret);
+}
+
+DP_DECL_TEST_CASE(lpm, bulk_lookup, NULL, NULL);
+DP_START_TEST(bulk_lookup, bulk_lookup)
+{
+	uint32_t ips[LPM_TEST_ADDRS];
+	uint32_t bulk_nh[LPM_TEST_ADDRS];
+	uint32_t nh;
+	unsigned int hits, exp_hits = 0;
+	unsigned int i;
+	struct lpm *lpm;
+
+	lpm = lpm_create(RT_TABLE_MAIN);
+	dp_test_fail_unless(lpm != NULL, "lpm_create failed\n");
+
+	/* A mix of tbl24 only and tbl8 extended routes */
+	lpm_test_add(lpm, 0x0a000000, 8, 1);
+	lpm_test_add(lpm, 0x0a010000, 16, 2);
+	lpm_test_add(lpm, 0x0a010100, 24, 3);
+	lpm_test_add(lpm, 0x0a010180, 25, 4);
+	lpm_test_add(lpm, 0x0a0101c1, 32, 5);
+
+	for (i = 0; i < LPM_TEST_ADDRS; i++)
+		ips[i] = 0x0a0101b0 + i * 3 - (i % 4 == 0 ? 0x01000000 : 0);
+
+	hits = lpm_lookup_bulk(lpm, ips, bulk_nh, LPM_TEST_ADDRS);
+
+	for (i = 0; i < LPM_TEST_ADDRS; i++) {
+		if (lpm_lookup(lpm, ips[i], &nh) != 0)
+			nh = LPM_LOOKUP_MISS;
+		else
+			exp_hits++;
+		dp_test_fail_unless(bulk_nh[i] == nh,
+				    "bulk lookup of 0x%08x got %u expected %u\n",
+				    ips[i], bulk_nh[i], nh);
+	}
+	dp_test_fail_unless(hits == exp_hits,
+			    "bulk lookup hits %u expected %u\n",
+			    hits, exp_hits);
+
+	lpm_delete_all(lpm, NULL, NULL);
+	lpm_free(lpm);
+} DP_END_TEST;
+
+DP_DECL_TEST_CASE(lpm, bulk_lookup6, NULL, NULL);
+DP_START_TEST(bulk_lookup6, bulk_lookup6)
+{
+	static const char * const prefixes[] = {
+		"2001:db8::/32", "2001:db8:1::/48", "2001:db8:1:2::/64",
+		"2001:db8:1:2::1/128", "2001:db8:1:2:3::/80",
+	};
+	struct in6_addr addrs[LPM_TEST_ADDRS];
+	const uint8_t *ips[LPM_TEST_ADDRS];
+	uint32_t bulk_nh[LPM_TEST_ADDRS];
+	struct pd_obj_state_and_flags *pd_state;
+	struct pd_obj_state_and_flags *old_pd_state;
+	struct in6_addr pfx;
+	unsigned int hits, exp_hits = 0;
+	unsigned int i;
+	uint32_t nh, old_nh;
+	struct lpm6 *lpm;
+	char str[INET6_ADDRSTRLEN + 4];
+	char *slash;
+	int ret;
+
+	lpm = lpm6_create(RT_TABLE_MAIN);
+	dp_test_fail_unless(lpm != NULL, "lpm6_create failed\n");
+
+	for (i = 0; i < ARRAY_SIZE(prefixes); i++) {
+		snprintf(str, sizeof(str), "%s", prefixes[i]);
+		slash = strchr(str, '/');
+		*slash = '\0';
+		inet_pton(AF_INET6, str, &pfx);
+		ret = lpm6_add(lpm, pfx.s6_addr, atoi(slash + 1), i + 1,
+			       RT_SCOPE_UNIVERSE, &pd_state, &old_nh,
+			       &old_pd_state);
+		dp_test_fail_unless(ret == LPM_SUCCESS,
+				    "lpm6_add %s failed: %d\n",
+				    prefixes[i], ret);
+	}
+
+	for (i = 0; i < LPM_TEST_ADDRS; i++) {
+		inet_pton(AF_INET6, "2001:db8:1:2::", &addrs[i]);
+		addrs[i].s6_addr[5] = i % 3;
+		addrs[i].s6_addr[9] = i % 5 == 0 ? 3 : 0;
+		addrs[i].s6_addr[15] = i % 2;
+		if (i % 7 == 0)
+			addrs[i].s6_addr[0] = 0x30;
+		ips[i] = addrs[i].s6_addr;
+	}
+
+	hits = lpm6_lookup_bulk(lpm, ips, bulk_nh, LPM_TEST_ADDRS);
+
+	for (i = 0; i < LPM_TEST_ADDRS; i++) {
+		if (lpm6_lookup(lpm, ips[i], &nh) != 0)
+			nh = LPM_LOOKUP_MISS;
+		else
+			exp_hits++;
+		dp_test_fail_unless(bulk_nh[i] == nh,
+				    "bulk lookup %u got %u expected %u\n",
+				    i, bulk_nh[i], nh);
+	}
+	dp_test_fail_unless(hits == exp_hits,
+			    "bulk lookup hits %u expected %u\n",
+			    hits, exp_hits);
+
+	lpm6_delete_all(lpm, NULL, NULL);
+	lpm6_free(lpm);
+} DP_END_TEST;
@@ -1680,54 +1680,183 @@ dp_test_netlink_route_nl(struct dp_test_route *route, uint16_t nl_type,
 	}
 }
 
-static void
-dp_test_netlink_route_pb(struct dp_test_route *route, uint16_t nl_type)
+/* Build the protobuf paths for the nexthops of a unicast route */
+static Path **
+dp_test_netlink_pb_paths(struct dp_test_route *route)
 {
-	IPAddressOrLabel prefix = IPADDRESS_OR_LABEL__INIT;
-	RibUpdate rtupdate = RIB_UPDATE__INIT;
-	uint32_t tableid = route->tableid;
-	Route pbroute = ROUTE__INIT;
 	struct dp_test_nh *nh;
 	IPAddress *gateway;
 	Path **paths;
 	Path *path;
 	uint32_t i;
-	size_t len;
+
+	paths = calloc(route->nh_cnt, sizeof(*paths));
+	dp_test_assert_internal(paths);
+
+	for (i = 0; i < route->nh_cnt; i++) {
+		path = calloc(1, sizeof(*path) + sizeof(*gateway));
+		paths[i] = path;
+		gateway = (IPAddress *)(path + 1);
+		nh = &route->nh[i];
+		dp_test_assert_internal(path);
+
+		path__init(path);
+		ipaddress__init(gateway);
+
+		if (route->tableid == RT_TABLE_LOCAL) {
+			path->has_type = true;
+			path->type = PATH__PATH_TYPE__LOCAL;
+		}
+
+		path->has_ifindex = true;
+		path->ifindex = dp_test_intf_name2index(nh->nh_int);
+
+		path->has_backup = true;
+		path->backup = nh->backup;
+
+		switch (nh->nh_addr.family) {
+		case AF_INET:
+			path->nexthop = gateway;
+			gateway->address_oneof_case =
+				IPADDRESS__ADDRESS_ONEOF_IPV4_ADDR;
+			gateway->ipv4_addr = nh->nh_addr.addr.ipv4;
+			break;
+		case AF_INET6:
+			path->nexthop = gateway;
+			gateway->address_oneof_case =
+				IPADDRESS__ADDRESS_ONEOF_IPV6_ADDR;
+			gateway->ipv6_addr.data =
+				(uint8_t *)&nh->nh_addr.addr.ipv6;
+			gateway->ipv6_addr.len =
+				sizeof(nh->nh_addr.addr.ipv6);
+			break;
+		case AF_UNSPEC:
+			break;
+		}
+
+		if (nh->num_labels == 1 &&
+		    nh->labels[0] == MPLS_LABEL_IMPLNULL) {
+			/* Nothing to do */
+		} else if (nh->num_labels > 0) {
+			path->mpls_labels = nh->labels;
+			path->n_mpls_labels = nh->num_labels;
+		} else if (route->prefix.addr.family == AF_MPLS) {
+			path->has_mpls_bos_only = true;
+			path->mpls_bos_only = true;
+		}
+	}
+
+	return paths;
+}
+
+static void
+dp_test_netlink_pb_paths_free(Path **paths, uint32_t n_paths)
+{
+	uint32_t i;
+
+	for (i = 0; i < n_paths; i++)
+		free(paths[i]);
+	free(paths);
+}
+
+/*
+ * Send updates to the dataplane as the route broker would: as one
+ * RibUpdateBatch, or one RibUpdate message each if the broker isn't
+ * using batches.
+ */
+static void
+dp_test_netlink_rib_updates_send(RibUpdate **updates, size_t n)
+{
+	RibUpdateBatch rtbatch = RIB_UPDATE_BATCH__INIT;
+	size_t i, len;
+	void *buf;
+
+	if (!dp_test_route_broker_batch) {
+		for (i = 0; i < n; i++) {
+			len = rib_update__get_packed_size(updates[i]);
+			buf = malloc(len);
+			dp_test_assert_internal(buf);
+
+			rib_update__pack(updates[i], buf);
+
+			nl_propagate_broker(NULL, buf, len);
+		}
+		return;
+	}
+
+	rtbatch.updates = updates;
+	rtbatch.n_updates = n;
+
+	len = rib_update_batch__get_packed_size(&rtbatch);
+	buf = malloc(len);
+	dp_test_assert_internal(buf);
+
+	rib_update_batch__pack(&rtbatch, buf);
+
+	nl_propagate_broker(NULL, buf, len);
+}
+
+/* A route as a protobuf RibUpdate, and the messages it points to */
+struct dp_test_route_pb {
+	RibUpdate rtupdate;
+	Route route;
+	IPAddressOrLabel prefix;
+};
+
+/*
+ * Build a route as a protobuf RibUpdate. If pathgroup is non-zero then
+ * the route uses the paths of that path group rather than its own.
+ */
+static void
+dp_test_netlink_route_pb_init(struct dp_test_route_pb *pb,
+			      struct dp_test_route *route, uint16_t nl_type,
+			      uint32_t pathgroup)
+{
+	IPAddressOrLabel *prefix = &pb->prefix;
+	RibUpdate *rtupdate = &pb->rtupdate;
+	Route *pbroute = &pb->route;
+	uint32_t tableid = route->tableid;
+	Path **paths = NULL;
+	Path *path;
+
+	rib_update__init(rtupdate);
+	route__init(pbroute);
+	ipaddress_or_label__init(prefix);
 
 	switch (nl_type) {
 	case RTM_NEWROUTE:
 		/* leave as default */
 		break;
 	case RTM_DELROUTE:
-		rtupdate.action = RIB_UPDATE__ACTION__DELETE;
-		rtupdate.has_action = true;
+		rtupdate->action = RIB_UPDATE__ACTION__DELETE;
+		rtupdate->has_action = true;
 		break;
 	default:
 		dp_test_assert_internal(false);
 		break;
 	}
 
-	rtupdate.route = &pbroute;
+	rtupdate->route = pbroute;
 
-	pbroute.prefix = &prefix;
+	pbroute->prefix = prefix;
 
 	switch (route->prefix.addr.family) {
 	case AF_INET:
-		prefix.address_oneof_case =
+		prefix->address_oneof_case =
 			IPADDRESS_OR_LABEL__ADDRESS_ONEOF_IPV4_ADDR;
-		prefix.ipv4_addr = route->prefix.addr.addr.ipv4;
+		prefix->ipv4_addr = route->prefix.addr.addr.ipv4;
 		break;
 	case AF_INET6:
-		prefix.address_oneof_case =
+		prefix->address_oneof_case =
 			IPADDRESS_OR_LABEL__ADDRESS_ONEOF_IPV6_ADDR;
-		prefix.ipv6_addr.data =
+		prefix->ipv6_addr.data =
 			(uint8_t *)&route->prefix.addr.addr.ipv6;
-		prefix.ipv6_addr.len = sizeof(route->prefix.addr.addr.ipv6);
+		prefix->ipv6_addr.len = sizeof(route->prefix.addr.addr.ipv6);
 		break;
 	case AF_MPLS:
-		prefix.address_oneof_case =
+		prefix->address_oneof_case =
 			IPADDRESS_OR_LABEL__ADDRESS_ONEOF_MPLS_LABEL;
-		prefix.mpls_label = ntohl(route->prefix.addr.addr.mpls) >>
+		prefix->mpls_label = ntohl(route->prefix.addr.addr.mpls) >>
 			MPLS_LS_LABEL_SHIFT;
 		break;
 	default:
@@ -1735,8 +1864,8 @@ dp_test_netlink_route_pb(struct dp_test_route *route, uint16_t nl_type)
 		break;
 	}
 
-	pbroute.has_prefix_length = true;
-	pbroute.prefix_length = route->prefix.len;
+	pbroute->has_prefix_length = true;
+	pbroute->prefix_length = route->prefix.len;
 
 	if (route->vrf_id != VRF_DEFAULT_ID &&
 	    route->vrf_id != VRF_UPLINK_ID &&
@@ -1750,38 +1879,41 @@ dp_test_netlink_route_pb(struct dp_test_route *route, uint16_t nl_type)
 	}
 
 	if (tableid != RT_TABLE_MAIN) {
-		pbroute.has_table_id = true;
-		pbroute.table_id = tableid;
+		pbroute->has_table_id = true;
+		pbroute->table_id = tableid;
 	}
 
-	pbroute.has_scope = true;
-	pbroute.scope = route->scope;
+	pbroute->has_scope = true;
+	pbroute->scope = route->scope;
 
 	switch (route->mpls_payload_type) {
 	case RTMPT_IP:
 		/* default, so leave as-is */
 		break;
 	case RTMPT_IPV4:
-		pbroute.has_payload_type = true;
-		pbroute.payload_type = ROUTE__PAYLOAD_TYPE__IPV4;
+		pbroute->has_payload_type = true;
+		pbroute->payload_type = ROUTE__PAYLOAD_TYPE__IPV4;
 		break;
 	case RTMPT_IPV6:
-		pbroute.has_payload_type = true;
-		pbroute.payload_type = ROUTE__PAYLOAD_TYPE__IPV6;
+		pbroute->has_payload_type = true;
+		pbroute->payload_type = ROUTE__PAYLOAD_TYPE__IPV6;
 		break;
 	default:
 		dp_test_assert_internal(false);
 		break;
 	}
 
-	if (route->type == RTN_BLACKHOLE ||
-	    route->type == RTN_UNREACHABLE ||
-	    route->type == RTN_LOCAL) {
+	if (pathgroup) {
+		pbroute->has_pathgroup_id = true;
+		pbroute->pathgroup_id = pathgroup;
+	} else if (route->type == RTN_BLACKHOLE ||
+		   route->type == RTN_UNREACHABLE ||
+		   route->type == RTN_LOCAL) {
 		paths = calloc(1, sizeof(*paths));
 		dp_test_assert_internal(paths);
 
-		pbroute.paths = paths;
-		pbroute.n_paths = 1;
+		pbroute->paths = paths;
+		pbroute->n_paths = 1;
 
 		path = calloc(1, sizeof(*path));
 		paths[0] = path;
@@ -1801,83 +1933,114 @@ dp_test_netlink_route_pb(struct dp_test_route *route, uint16_t nl_type)
 			break;
 		}
 	} else {
-		paths = calloc(route->nh_cnt, sizeof(*paths));
-		dp_test_assert_internal(paths);
+		paths = dp_test_netlink_pb_paths(route);
+		pbroute->paths = paths;
+		pbroute->n_paths = route->nh_cnt;
+	}
+}
 
-		pbroute.paths = paths;
-		pbroute.n_paths = route->nh_cnt;
+static void
+dp_test_netlink_route_pb_free(struct dp_test_route_pb *pb)
+{
+	dp_test_netlink_pb_paths_free(pb->route.paths, pb->route.n_paths);
+}
 
-		for (i = 0; i < route->nh_cnt; i++) {
-			path = calloc(1, sizeof(*path) + sizeof(*gateway));
-			paths[i] = path;
-			gateway = (IPAddress *)(path + 1);
-			nh = &route->nh[i];
-			dp_test_assert_internal(path);
+/* Send a route as a protobuf RibUpdate */
+static void
+dp_test_netlink_route_pb(struct dp_test_route *route, uint16_t nl_type,
+			 uint32_t pathgroup)
+{
+	struct dp_test_route_pb pb;
+	RibUpdate *rtupdate = &pb.rtupdate;
 
-			path__init(path);
-			ipaddress__init(gateway);
+	dp_test_netlink_route_pb_init(&pb, route, nl_type, pathgroup);
+	dp_test_netlink_rib_updates_send(&rtupdate, 1);
+	dp_test_netlink_route_pb_free(&pb);
+}
 
-			if (route->tableid == RT_TABLE_LOCAL) {
-				path->has_type = true;
-				path->type = PATH__PATH_TYPE__LOCAL;
-			}
+void
+_dp_test_netlink_route_batch(const struct dp_test_route_update *updates,
+			     unsigned int n, const char *file,
+			     const char *func, int line)
+{
+	struct dp_test_route *routes[n];
+	struct dp_test_route_pb pb[n];
+	RibUpdate *rtupdates[n];
+	unsigned int i;
 
-			path->has_ifindex = true;
-			path->ifindex = dp_test_intf_name2index(nh->nh_int);
-
-			path->has_backup = true;
-			path->backup = nh->backup;
-
-			switch (nh->nh_addr.family) {
-			case AF_INET:
-				path->nexthop = gateway;
-				gateway->address_oneof_case =
-					IPADDRESS__ADDRESS_ONEOF_IPV4_ADDR;
-				gateway->ipv4_addr = nh->nh_addr.addr.ipv4;
-				break;
-			case AF_INET6:
-				path->nexthop = gateway;
-				gateway->address_oneof_case =
-					IPADDRESS__ADDRESS_ONEOF_IPV6_ADDR;
-				gateway->ipv6_addr.data =
-					(uint8_t *)&nh->nh_addr.addr.ipv6;
-				gateway->ipv6_addr.len =
-					sizeof(nh->nh_addr.addr.ipv6);
-				break;
-			case AF_UNSPEC:
-				break;
-			}
+	_dp_test_fail_unless(dp_test_route_broker_protobuf &&
+			     dp_test_route_broker_batch, file, line,
+			     "route batches need the protobuf route broker");
 
-			if (nh->num_labels == 1 &&
-			    nh->labels[0] == MPLS_LABEL_IMPLNULL) {
-				/* Nothing to do */
-			} else if (nh->num_labels > 0) {
-				path->mpls_labels = nh->labels;
-				path->n_mpls_labels = nh->num_labels;
-			} else if (route->prefix.addr.family == AF_MPLS) {
-				path->has_mpls_bos_only = true;
-				path->mpls_bos_only = true;
-			}
-		}
+	for (i = 0; i < n; i++) {
+		routes[i] = dp_test_parse_route(updates[i].route);
+		dp_test_netlink_route_pb_init(&pb[i], routes[i],
+					      updates[i].del ? RTM_DELROUTE :
+					      RTM_NEWROUTE, 0);
+		rtupdates[i] = &pb[i].rtupdate;
 	}
 
-	len = rib_update__get_packed_size(&rtupdate);
-	void *buf = malloc(len);
-	dp_test_assert_internal(buf);
+	dp_test_netlink_rib_updates_send(rtupdates, n);
+
+	for (i = 0; i < n; i++) {
+		dp_test_netlink_route_pb_free(&pb[i]);
+		dp_test_free_route(routes[i]);
+	}
+}
+
+void
+_dp_test_netlink_pathgroup(uint32_t id, const char *route_string, bool del,
+			   const char *file, const char *func, int line)
+{
+	struct dp_test_route *route = dp_test_parse_route(route_string);
+	RibUpdate rtupdate = RIB_UPDATE__INIT;
+	RibUpdate *rtupdates = &rtupdate;
+	PathGroup pg = PATH_GROUP__INIT;
 
-	rib_update__pack(&rtupdate, buf);
+	_dp_test_fail_unless(dp_test_route_broker_protobuf, file, line,
+			     "path groups need the protobuf route broker");
 
-	nl_propagate_broker(NULL, buf, len);
+	rtupdate.pathgroup = &pg;
+	if (del) {
+		rtupdate.action = RIB_UPDATE__ACTION__DELETE;
+		rtupdate.has_action = true;
+	}
 
-	if (route->type == RTN_BLACKHOLE ||
-	    route->type == RTN_UNREACHABLE ||
-	    route->type == RTN_LOCAL)
-		free(paths[0]);
-	else {
-		for (i = 0; i < route->nh_cnt; i++)
-			free(paths[i]);
+	pg.has_id = true;
+	pg.id = id;
+	if (route->prefix.addr.family == AF_INET6) {
+		pg.has_family = true;
+		pg.family = PATH_GROUP__ADDRESS_FAMILY__IPV6;
 	}
-	free(paths);
+	if (!del) {
+		pg.paths = dp_test_netlink_pb_paths(route);
+		pg.n_paths = route->nh_cnt;
+	}
+
+	dp_test_netlink_rib_updates_send(&rtupdates, 1);
+
+	dp_test_netlink_pb_paths_free(pg.paths, pg.n_paths);
+	dp_test_free_route(route);
+}
+
+void
+_dp_test_netlink_pathgroup_route(const char *prefix, uint32_t id, bool del,
+				 const char *file, const char *func, int line)
+{
+	char route_string[DP_TEST_TMP_BUF];
+	struct dp_test_route *route;
+
+	_dp_test_fail_unless(dp_test_route_broker_protobuf, file, line,
+			     "path groups need the protobuf route broker");
+
+	/* The paths come from the group, so parse the prefix alone */
+	snprintf(route_string, sizeof(route_string), "%s blackhole", prefix);
+	route = dp_test_parse_route(route_string);
+
+	dp_test_netlink_route_pb(route, del ? RTM_DELROUTE : RTM_NEWROUTE,
+				 del ? 0 : id);
+
+	dp_test_free_route(route);
 }
 
 /*
@@ -1911,7 +2074,7 @@ dp_test_netlink_route(const char *route_string, uint16_t nl_type,
 
 	if (dp_test_cont_src_get() == CONT_SRC_MAIN &&
 	    dp_test_route_broker_protobuf)
-		dp_test_netlink_route_pb(route, nl_type);
+		dp_test_netlink_route_pb(route, nl_type, 0);
 	else
 		dp_test_netlink_route_nl(route, nl_type, replace);
 
@@ -183,6 +183,50 @@ _dp_test_netlink_set_mpls_forwarding(const char *ifname, bool enable,
 				   __FILE__, __func__, __LINE__)
 
 
+/*
+ * Add/update or delete path group 'id', with the paths of the route
+ * string, e.g. "0.0.0.0/0 nh 1.1.1.2 int:dp1T0", whose prefix only
+ * gives the address family.  Needs the protobuf route broker.
+ */
+void
+_dp_test_netlink_pathgroup(uint32_t id, const char *route_string, bool del,
+			   const char *file, const char *func, int line);
+#define dp_test_netlink_add_pathgroup(id, route_string)			\
+	_dp_test_netlink_pathgroup(id, route_string, false,		\
+				   __FILE__, __func__, __LINE__)
+#define dp_test_netlink_del_pathgroup(id, route_string)			\
+	_dp_test_netlink_pathgroup(id, route_string, true,		\
+				   __FILE__, __func__, __LINE__)
+
+/* Add or delete a route to prefix using the paths of path group 'id' */
+void
+_dp_test_netlink_pathgroup_route(const char *prefix, uint32_t id, bool del,
+				 const char *file, const char *func,
+				 int line);
+#define dp_test_netlink_add_pathgroup_route(prefix, id)			\
+	_dp_test_netlink_pathgroup_route(prefix, id, false,		\
+					 __FILE__, __func__, __LINE__)
+#define dp_test_netlink_del_pathgroup_route(prefix, id)			\
+	_dp_test_netlink_pathgroup_route(prefix, id, true,		\
+					 __FILE__, __func__, __LINE__)
+
+/*
+ * Send a number of route updates in one RibUpdateBatch, which the
+ * dataplane applies in order.  Needs the protobuf route broker.
+ */
+struct dp_test_route_update {
+	const char *route;
+	bool del;
+};
+
+void
+_dp_test_netlink_route_batch(const struct dp_test_route_update *updates,
+			     unsigned int n, const char *file,
+			     const char *func, int line);
+#define dp_test_netlink_route_batch(updates)				\
+	_dp_test_netlink_route_batch(updates, ARRAY_SIZE(updates),	\
+				     __FILE__, __func__, __LINE__)
+
 void
 _dp_test_netlink_add_route_fmt(bool verify, bool incomplete,
 			       const char *file, const char *func,
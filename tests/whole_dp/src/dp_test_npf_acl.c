@@ -19,6 +19,10 @@
 #include "in_cksum.h"
 #include "if_var.h"
 #include "main.h"
+#include "npf/npf_cache.h"
+#include "npf/npf_if.h"
+#include "npf/npf_ruleset.h"
+#include "npf/config/npf_config.h"
 
 #include "dp_test.h"
 #include "dp_test_controller.h"
@@ -1405,3 +1409,90 @@ DP_START_TEST(acl15, test)
 
 	dp_test_gre6_teardown_tunnel(VRF_DEFAULT_ID, "1:1:2::1", "1:1:2::2");
 } DP_END_TEST;
+
+/*
+ * acl16 - Burst inspection of an ACL gives every packet the same rule
+ * as inspecting the packets one at a time
+ */
+DP_DECL_TEST_CASE(npf_acl, acl16, acl_setup, acl_teardown);
+DP_START_TEST(acl16, test)
+{
+	struct {
+		const char *saddr;
+		const char *daddr;
+		uint16_t dport;
+	} pkts[] = {
+		{ "10.0.1.2", "20.0.2.2", 20000 },	/* rule 20 */
+		{ "10.0.1.2", "20.0.2.3", 20000 },	/* no match */
+		{ "10.0.1.3", "20.0.2.2", 20000 },	/* rule 30 */
+		{ "10.0.1.2", "20.0.2.2", 20001 },	/* rule 10 */
+		{ "10.0.1.4", "20.0.2.3", 53 },		/* no match */
+	};
+	npf_cache_t npcs[RTE_DIM(pkts)];
+	npf_cache_t *npc[RTE_DIM(pkts)];
+	struct rte_mbuf *m[RTE_DIM(pkts)];
+	npf_rule_t *rl[RTE_DIM(pkts)];
+	const npf_ruleset_t *rs;
+	char real_ifname[IFNAMSIZ];
+	struct ifnet *ifp;
+	unsigned int i;
+	int len = 20;
+
+	dp_test_npf_cmd("npf-ut add acl:v4test 0 family=inet", false);
+	dp_test_npf_cmd("npf-ut add acl:v4test 10 "
+			"src-addr=10.0.1.2 dst-addr=20.0.2.2 "
+			"proto-base=17 dst-port=20001 "
+			"action=drop", false);
+	dp_test_npf_cmd("npf-ut add acl:v4test 20 "
+			"src-addr=10.0.1.2 dst-addr=20.0.2.2 "
+			"proto-base=17 "
+			"action=accept", false);
+	dp_test_npf_cmd("npf-ut add acl:v4test 30 "
+			"dst-addr=20.0.2.2 "
+			"action=drop", false);
+	dp_test_npf_cmd("npf-ut attach interface:dpT10 acl-in acl:v4test",
+			false);
+	dp_test_npf_cmd("npf-ut commit", false);
+
+	dp_test_intf_real("dp1T0", real_ifname);
+	ifp = dp_ifnet_byifname(real_ifname);
+	dp_test_fail_unless(ifp, "ifp for %s", real_ifname);
+	rs = npf_get_ruleset(npf_if_conf(ifp->if_npf), NPF_RS_ACL_IN);
+	dp_test_fail_unless(rs, "No acl-in ruleset on %s", real_ifname);
+
+	for (i = 0; i < RTE_DIM(pkts); i++) {
+		m[i] = dp_test_create_udp_ipv4_pak(pkts[i].saddr,
+						   pkts[i].daddr, 1001,
+						   pkts[i].dport, 1, &len);
+		dp_test_fail_unless(m[i], "Failed to create packet %u", i);
+		(void)dp_test_pktmbuf_eth_init(m[i], "aa:bb:cc:dd:ee:ff",
+					       "aa:bb:cc:dd:1:a1",
+					       RTE_ETHER_TYPE_IPV4);
+		npc[i] = &npcs[i];
+		npf_cache_init(npc[i]);
+		dp_test_fail_unless(npf_cache_all(npc[i], m[i],
+						  htons(RTE_ETHER_TYPE_IPV4))
+				    == 0, "Failed to cache packet %u", i);
+	}
+
+	npf_ruleset_inspect_burst(npc, m, rs, ifp, PFIL_IN, rl,
+				  RTE_DIM(pkts));
+
+	for (i = 0; i < RTE_DIM(pkts); i++) {
+		npf_rule_t *exp = npf_ruleset_inspect(npc[i], m[i], rs, NULL,
+						      ifp, PFIL_IN);
+
+		dp_test_fail_unless(rl[i] == exp,
+				    "Packet %u burst rule %u, expected %u", i,
+				    rl[i] ? npf_rule_get_num(rl[i]) : 0,
+				    exp ? npf_rule_get_num(exp) : 0);
+		rte_pktmbuf_free(m[i]);
+	}
+	dp_test_fail_unless(rl[0] && rl[2] && rl[3] && !rl[1] && !rl[4],
+			    "Unexpected burst matches");
+
+	dp_test_npf_cmd("npf-ut detach interface:dpT10 acl-in acl:v4test",
+			false);
+	dp_test_npf_cmd("npf-ut delete acl:v4test", false);
+	dp_test_npf_cmd("npf-ut commit", false);
+} DP_END_TEST;
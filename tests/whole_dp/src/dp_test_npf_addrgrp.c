@@ -1747,3 +1747,86 @@ DP_START_TEST(npf_addrgrp11, test1)
 	dp_test_addrgrp_destroy("ADDRGRP11");
 
 } DP_END_TEST;
+
+
+/*
+ * npf_addrgrp12 - Test compiled address-groups, and bulk loading an
+ * address-group.
+ */
+DP_DECL_TEST_CASE(npf_addrgrp, npf_addrgrp12, NULL, NULL);
+DP_START_TEST(npf_addrgrp12, test1)
+{
+	char *reply;
+	bool err;
+
+	dp_test_addrgrp_create("ADDRGRP12");
+	dp_test_npf_cmd("npf-ut fw table compile ADDRGRP12 enable", false);
+
+	dp_test_addrgrp_prefix_add("ADDRGRP12", "10.0.0.0/24", true);
+
+	/*
+	 * Bulk load.  The entries are only added at the end of the load, and
+	 * the range overlapping 10.0.0.0/24 is refused.
+	 */
+	dp_test_npf_cmd("npf-ut fw table bulk start ADDRGRP12", false);
+	dp_test_npf_cmd("npf-ut fw table add ADDRGRP12 10.0.2.0/24", false);
+	dp_test_npf_cmd("npf-ut fw table add ADDRGRP12 10.0.2.0/25", false);
+	dp_test_npf_cmd("npf-ut fw table add ADDRGRP12 10.0.1.0/24", false);
+	dp_test_npf_cmd("npf-ut fw table add ADDRGRP12 "
+			"10.0.3.10 10.0.3.20", false);
+	dp_test_npf_cmd("npf-ut fw table add ADDRGRP12 "
+			"10.0.0.250 10.0.0.255", false);
+	dp_test_npf_cmd("npf-ut fw table add ADDRGRP12 2001:db8::/64", false);
+
+	dp_test_fail_unless(!dp_test_addrgrp_tree_lookup("ADDRGRP12",
+							 "10.0.2.1"),
+			    "10.0.2.1 found during bulk load");
+
+	reply = dp_test_console_request_w_err(
+		"npf-ut fw table bulk end ADDRGRP12", &err, false);
+	free(reply);
+	dp_test_fail_unless(err, "Overlapping range not refused");
+
+	dp_test_fail_unless(dp_test_addrgrp_tree_lookup("ADDRGRP12",
+							"10.0.0.255"),
+			    "10.0.0.255 not found");
+	dp_test_fail_unless(dp_test_addrgrp_tree_lookup("ADDRGRP12",
+							"10.0.1.1"),
+			    "10.0.1.1 not found");
+	dp_test_fail_unless(dp_test_addrgrp_tree_lookup("ADDRGRP12",
+							"10.0.2.200"),
+			    "10.0.2.200 not found");
+	dp_test_fail_unless(dp_test_addrgrp_tree_lookup("ADDRGRP12",
+							"10.0.3.20"),
+			    "10.0.3.20 not found");
+	dp_test_fail_unless(!dp_test_addrgrp_tree_lookup("ADDRGRP12",
+							 "10.0.3.21"),
+			    "10.0.3.21 found");
+	dp_test_fail_unless(dp_test_addrgrp_tree_lookup("ADDRGRP12",
+							"2001:db8::1"),
+			    "2001:db8::1 not found");
+	dp_test_fail_unless(!dp_test_addrgrp_tree_lookup("ADDRGRP12",
+							 "2001:db8:0:1::1"),
+			    "2001:db8:0:1::1 found");
+
+	/* The compiled tables follow single changes */
+	dp_test_addrgrp_prefix_remove("ADDRGRP12", "10.0.1.0/24", true, false);
+	dp_test_fail_unless(!dp_test_addrgrp_tree_lookup("ADDRGRP12",
+							 "10.0.1.1"),
+			    "10.0.1.1 found after remove");
+
+	dp_test_addrgrp_range_remove("ADDRGRP12", "10.0.3.10", "10.0.3.20",
+				     true, false);
+	dp_test_fail_unless(!dp_test_addrgrp_tree_lookup("ADDRGRP12",
+							 "10.0.3.15"),
+			    "10.0.3.15 found after remove");
+
+	/* Lookups use the ptree once the address-group is not compiled */
+	dp_test_npf_cmd("npf-ut fw table compile ADDRGRP12 disable", false);
+	dp_test_fail_unless(dp_test_addrgrp_tree_lookup("ADDRGRP12",
+							"10.0.2.1"),
+			    "10.0.2.1 not found");
+
+	dp_test_addrgrp_destroy("ADDRGRP12");
+
+} DP_END_TEST;
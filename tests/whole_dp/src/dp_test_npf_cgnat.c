@@ -8,6 +8,8 @@
 #include <time.h>
 #include <values.h>
 #include <string.h>
+#include <unistd.h>
+#include <czmq.h>
 
 #include <linux/if_ether.h>
 #include <netinet/ip_icmp.h>
@@ -45,6 +47,9 @@
 #include "npf/cgnat/cgn_sess2.h"
 #include "npf/cgnat/cgn_mbuf.h"
 #include "npf/cgnat/cgn_log.h"
+#include "npf/cgnat/cgn_log_ipfix.h"
+#include "npf/cgnat/cgn_log_protobuf_zmq.h"
+#include "protobuf/CgnatLogging.pb-c.h"
 #include "npf/cgnat/cgn_if.h"
 
 DP_DECL_TEST_SUITE(npf_cgnat);
@@ -6192,6 +6197,299 @@ DP_START_TEST(cgnat_log_methods, test)
 } DP_END_TEST;
 
 
+/*
+ * cgnat_log_ipfix -- Tests that each ipfix data message in the file is
+ * preceded by a template message of the same observation domain.
+ */
+#define DPT_IPFIX_FILE	"/tmp/dpt_cgnat.ipfix"
+#define DPT_IPFIX_MAX_DOMAINS	8
+
+DP_DECL_TEST_CASE(npf_cgnat, cgnat_log_ipfix, cgnat_setup, cgnat_teardown);
+DP_START_TEST(cgnat_log_ipfix, test)
+{
+	uint32_t domains[DPT_IPFIX_MAX_DOMAINS];
+	uint32_t ndomains = 0, ndata = 0;
+	uint8_t buf[64 << 10];
+	size_t len, off;
+	uint32_t domain, i;
+	uint16_t mlen, set_id;
+	FILE *f;
+	int rc;
+
+	rc = cl_ipfix_set_file(DPT_IPFIX_FILE, 0, 0);
+	dp_test_fail_unless(rc == 0, "ipfix set file");
+
+	rc = cgn_log_enable_handler(CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION,
+				    "ipfix");
+	dp_test_fail_unless(rc == 0, "enable ipfix cgnat log handler");
+
+	dpt_cgn_cmd_fmt(false, true,
+			"nat-ut pool add POOL1 "
+			"type=cgnat "
+			"address-range=RANGE1/1.1.1.11-1.1.1.20 "
+			"log-pba=yes "
+			"");
+
+	cgnat_policy_add("POLICY1", 10, "100.64.0.0/24", "POOL1",
+			 "dp2T1", CGN_MAP_EIM, CGN_FLTR_EIF, CGN_3TUPLE, true);
+
+	/* Two subscribers, so two port block allocations */
+	cgnat_udp("dp1T0", "aa:bb:cc:dd:1:a1", 0,
+		  "100.64.0.1", 1234, "1.1.1.1", 80,
+		  "1.1.1.11", 1024, "1.1.1.1", 80,
+		  "aa:bb:cc:dd:2:b1", 0, "dp2T1",
+		  DP_TEST_FWD_FORWARDED);
+
+	cgnat_udp("dp1T0", "aa:bb:cc:dd:1:a1", 0,
+		  "100.64.0.2", 1234, "1.1.1.1", 80,
+		  "1.1.1.12", 1024, "1.1.1.1", 80,
+		  "aa:bb:cc:dd:2:b1", 0, "dp2T1",
+		  DP_TEST_FWD_FORWARDED);
+
+	/* Disabling the last log type flushes and closes the file */
+	rc = cgn_log_disable_handler(CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION,
+				     "ipfix");
+	dp_test_fail_unless(rc == 0, "disable ipfix cgnat log handler");
+
+	f = fopen(DPT_IPFIX_FILE, "r");
+	dp_test_fail_unless(f, "open %s", DPT_IPFIX_FILE);
+	len = fread(buf, 1, sizeof(buf), f);
+	fclose(f);
+	unlink(DPT_IPFIX_FILE);
+
+	for (off = 0; off + 20 <= len; off += mlen) {
+		mlen = ntohs(*(uint16_t *)(buf + off + 2));
+		domain = ntohl(*(uint32_t *)(buf + off + 12));
+		set_id = ntohs(*(uint16_t *)(buf + off + 16));
+
+		dp_test_fail_unless(ntohs(*(uint16_t *)(buf + off)) == 10,
+				    "ipfix version at offset %zu", off);
+		dp_test_fail_unless(mlen > 20 && off + mlen <= len,
+				    "ipfix length %u at offset %zu", mlen, off);
+
+		for (i = 0; i < ndomains; i++)
+			if (domains[i] == domain)
+				break;
+
+		if (set_id == 2) {
+			dp_test_fail_unless(i == ndomains,
+					    "second template for domain %u",
+					    domain);
+			dp_test_fail_unless(ndomains < DPT_IPFIX_MAX_DOMAINS,
+					    "too many ipfix domains");
+			domains[ndomains++] = domain;
+			continue;
+		}
+
+		dp_test_fail_unless(set_id >= 256,
+				    "ipfix set id %u at offset %zu",
+				    set_id, off);
+		dp_test_fail_unless(i < ndomains,
+				    "no template for ipfix domain %u", domain);
+		ndata++;
+	}
+
+	dp_test_fail_unless(off == len, "trailing ipfix data");
+	dp_test_fail_unless(ndata > 0, "no ipfix data messages");
+
+	cgnat_policy_del("POLICY1", 10, "dp2T1");
+	dp_test_npf_cmd_fmt(false, "nat-ut pool delete POOL1");
+
+} DP_END_TEST;
+
+
+/*
+ * cgnat_log_protobuf -- Tests that a port block allocation logged to
+ * the protobuf handler arrives as one zmq message holding one record.
+ */
+#define DPT_PROTOBUF_ENDPOINT	"ipc:///tmp/dpt_cgnat_pba"
+
+DP_DECL_TEST_CASE(npf_cgnat, cgnat_log_protobuf, cgnat_setup,
+		  cgnat_teardown);
+DP_START_TEST(cgnat_log_protobuf, test)
+{
+	PortAllocationLog *pba;
+	zsock_t *sock;
+	zframe_t *frame;
+	int rc;
+
+	rc = cl_zmq_set_endpoint(CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION,
+				 DPT_PROTOBUF_ENDPOINT);
+	dp_test_fail_unless(rc == 0, "set protobuf endpoint");
+
+	rc = cgn_log_enable_handler(CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION,
+				    "protobuf");
+	dp_test_fail_unless(rc == 0, "enable protobuf cgnat log handler");
+
+	/* Cannot move the endpoint while it is bound */
+	rc = cl_zmq_set_endpoint(CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION, NULL);
+	dp_test_fail_unless(rc == -EBUSY, "reset protobuf endpoint when "
+			    "enabled, rc %d", rc);
+
+	sock = zsock_new_pull(DPT_PROTOBUF_ENDPOINT);
+	dp_test_fail_unless(sock, "connect to %s", DPT_PROTOBUF_ENDPOINT);
+	zsock_set_rcvtimeo(sock, 2000);
+
+	dpt_cgn_cmd_fmt(false, true,
+			"nat-ut pool add POOL1 "
+			"type=cgnat "
+			"address-range=RANGE1/1.1.1.11-1.1.1.20 "
+			"log-pba=yes "
+			"");
+
+	cgnat_policy_add("POLICY1", 10, "100.64.0.0/24", "POOL1",
+			 "dp2T1", CGN_MAP_EIM, CGN_FLTR_EIF, CGN_3TUPLE, true);
+
+	cgnat_udp("dp1T0", "aa:bb:cc:dd:1:a1", 0,
+		  "100.64.0.1", 1234, "1.1.1.1", 80,
+		  "1.1.1.11", 1024, "1.1.1.1", 80,
+		  "aa:bb:cc:dd:2:b1", 0, "dp2T1",
+		  DP_TEST_FWD_FORWARDED);
+
+	frame = zframe_recv(sock);
+	dp_test_fail_unless(frame, "no protobuf log message");
+	dp_test_fail_unless(!zframe_more(frame),
+			    "protobuf log message has more than one frame");
+
+	pba = port_allocation_log__unpack(NULL, zframe_size(frame),
+					  zframe_data(frame));
+	zframe_destroy(&frame);
+	dp_test_fail_unless(pba, "unpack protobuf log message");
+
+	dp_test_fail_unless(pba->has_eventtype && pba->eventtype ==
+			    PORT_ALLOCATION_EVENT_TYPE__PB_EVENT_ALLOCATED,
+			    "event type %d", pba->eventtype);
+	dp_test_fail_unless(pba->has_subscriberaddress &&
+			    pba->subscriberaddress == 0x64400001,
+			    "subscriber address 0x%08x",
+			    pba->subscriberaddress);
+	dp_test_fail_unless(pba->has_natallocatedaddress &&
+			    pba->natallocatedaddress == 0x0101010b,
+			    "nat allocated address 0x%08x",
+			    pba->natallocatedaddress);
+	dp_test_fail_unless(pba->policyname &&
+			    !strcmp(pba->policyname, "POLICY1"),
+			    "policy name %s", pba->policyname);
+	dp_test_fail_unless(pba->poolname &&
+			    !strcmp(pba->poolname, "POOL1"),
+			    "pool name %s", pba->poolname);
+	dp_test_fail_unless(pba->has_startportnumber &&
+			    pba->has_endportnumber &&
+			    pba->startportnumber == 1024 &&
+			    pba->endportnumber > pba->startportnumber,
+			    "port block %u-%u", pba->startportnumber,
+			    pba->endportnumber);
+
+	port_allocation_log__free_unpacked(pba, NULL);
+
+	cgnat_policy_del("POLICY1", 10, "dp2T1");
+	dp_test_npf_cmd_fmt(false, "nat-ut pool delete POOL1");
+
+	zsock_destroy(&sock);
+
+	rc = cgn_log_disable_handler(CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION,
+				     "protobuf");
+	dp_test_fail_unless(rc == 0, "disable protobuf cgnat log handler");
+
+	rc = cl_zmq_set_endpoint(CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION, NULL);
+	dp_test_fail_unless(rc == 0, "reset protobuf endpoint");
+
+} DP_END_TEST;
+
+/*
+ * cgnat_log_protobuf_batch -- Tests that with batching configured, the
+ * port block allocations of two subscribers arrive one record per
+ * frame, whether or not the logger puts them in one zmq message.
+ */
+DP_DECL_TEST_CASE(npf_cgnat, cgnat_log_protobuf_batch, cgnat_setup,
+		  cgnat_teardown);
+DP_START_TEST(cgnat_log_protobuf_batch, test)
+{
+	PortAllocationLog *pba;
+	uint32_t subs = 0;
+	zsock_t *sock;
+	zframe_t *frame;
+	int i, rc;
+
+	rc = cl_zmq_set_batch(CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION, 65);
+	dp_test_fail_unless(rc == -EINVAL, "set protobuf batch of 65, rc %d",
+			    rc);
+
+	rc = cl_zmq_set_batch(CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION, 4);
+	dp_test_fail_unless(rc == 0, "set protobuf batch");
+
+	rc = cl_zmq_set_endpoint(CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION,
+				 DPT_PROTOBUF_ENDPOINT);
+	dp_test_fail_unless(rc == 0, "set protobuf endpoint");
+
+	rc = cgn_log_enable_handler(CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION,
+				    "protobuf");
+	dp_test_fail_unless(rc == 0, "enable protobuf cgnat log handler");
+
+	sock = zsock_new_pull(DPT_PROTOBUF_ENDPOINT);
+	dp_test_fail_unless(sock, "connect to %s", DPT_PROTOBUF_ENDPOINT);
+	zsock_set_rcvtimeo(sock, 2000);
+
+	dpt_cgn_cmd_fmt(false, true,
+			"nat-ut pool add POOL1 "
+			"type=cgnat "
+			"address-range=RANGE1/1.1.1.11-1.1.1.20 "
+			"log-pba=yes "
+			"");
+
+	cgnat_policy_add("POLICY1", 10, "100.64.0.0/24", "POOL1",
+			 "dp2T1", CGN_MAP_EIM, CGN_FLTR_EIF, CGN_3TUPLE, true);
+
+	/* Two subscribers, so two port block allocations */
+	cgnat_udp("dp1T0", "aa:bb:cc:dd:1:a1", 0,
+		  "100.64.0.1", 1234, "1.1.1.1", 80,
+		  "1.1.1.11", 1024, "1.1.1.1", 80,
+		  "aa:bb:cc:dd:2:b1", 0, "dp2T1",
+		  DP_TEST_FWD_FORWARDED);
+
+	cgnat_udp("dp1T0", "aa:bb:cc:dd:1:a1", 0,
+		  "100.64.0.2", 1234, "1.1.1.1", 80,
+		  "1.1.1.12", 1024, "1.1.1.1", 80,
+		  "aa:bb:cc:dd:2:b1", 0, "dp2T1",
+		  DP_TEST_FWD_FORWARDED);
+
+	for (i = 0; i < 2; i++) {
+		frame = zframe_recv(sock);
+		dp_test_fail_unless(frame, "no protobuf log record %d", i);
+
+		pba = port_allocation_log__unpack(NULL, zframe_size(frame),
+						  zframe_data(frame));
+		zframe_destroy(&frame);
+		dp_test_fail_unless(pba, "unpack protobuf log record %d", i);
+		dp_test_fail_unless(pba->has_subscriberaddress &&
+				    (pba->subscriberaddress == 0x64400001 ||
+				     pba->subscriberaddress == 0x64400002),
+				    "subscriber address 0x%08x in record %d",
+				    pba->subscriberaddress, i);
+
+		subs |= 1 << (pba->subscriberaddress - 0x64400001);
+		port_allocation_log__free_unpacked(pba, NULL);
+	}
+	dp_test_fail_unless(subs == 0x3, "subscribers logged 0x%x", subs);
+
+	cgnat_policy_del("POLICY1", 10, "dp2T1");
+	dp_test_npf_cmd_fmt(false, "nat-ut pool delete POOL1");
+
+	zsock_destroy(&sock);
+
+	rc = cgn_log_disable_handler(CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION,
+				     "protobuf");
+	dp_test_fail_unless(rc == 0, "disable protobuf cgnat log handler");
+
+	rc = cl_zmq_set_endpoint(CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION, NULL);
+	dp_test_fail_unless(rc == 0, "reset protobuf endpoint");
+
+	rc = cl_zmq_set_batch(CGN_LOG_TYPE_PORT_BLOCK_ALLOCATION, 0);
+	dp_test_fail_unless(rc == 0, "reset protobuf batch");
+
+} DP_END_TEST;
+
+
 /*
  * npf_cgnat_50 - Tests policy address-group prefix matching
  *
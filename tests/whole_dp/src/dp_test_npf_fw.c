@@ -1481,6 +1481,156 @@ DP_START_TEST(fw_ipv4, large_ruleset)
 
 } DP_END_TEST;
 
+/*
+ * Test with more than 256 rules in a group, so that the grouper ANDs its
+ * bit maps with the widest vector instructions the cpu has.  The same
+ * packets are then run against the ruleset built with the scalar AND, and
+ * must hit the same rules.
+ */
+#define LARGE_NRULES 300
+#define LARGE_SPORT_RULE 280
+
+DP_START_TEST(fw_ipv4, simd_ruleset)
+{
+	struct dp_test_pkt_desc_t *pkt;
+	struct dp_test_expected *test_exp;
+	struct rte_mbuf *test_pak;
+	char rule_num[LARGE_NRULES][8];
+	char rule_npf[LARGE_NRULES][48];
+	struct dp_test_npf_rule_t rules[LARGE_NRULES + 1];
+	uint hits[] = { 1, 63, 64, 65, 128, 255, 256, 257, 279 };
+	uint i, phase;
+
+	struct dp_test_pkt_desc_t v4_pkt = {
+		.text       = "IPv4 UDP",
+		.len        = 20,
+		.ether_type = RTE_ETHER_TYPE_IPV4,
+		.l3_src     = "1.1.1.2",
+		.l2_src     = "aa:bb:cc:dd:1:a1",
+		.l3_dst     = "2.2.2.1",
+		.l2_dst     = "aa:bb:cc:dd:2:b1",
+		.proto      = IPPROTO_UDP,
+		.l4         = {
+			.udp = {
+				.sport = 41000,
+				.dport = 1000,
+			}
+		},
+		.rx_intf    = "dp1T0",
+		.tx_intf    = "dp2T1"
+	};
+	pkt = &v4_pkt;
+
+	/*
+	 * Rule n passes dst-port 1000+n, except for rule 280 which passes
+	 * src-port 41000.  The last rule blocks everything else.
+	 */
+	for (i = 0; i < LARGE_NRULES; i++) {
+		uint n = i + 1;
+
+		snprintf(rule_num[i], sizeof(rule_num[i]), "%u", n);
+		if (n == LARGE_NRULES)
+			rule_npf[i][0] = '\0';
+		else if (n == LARGE_SPORT_RULE)
+			snprintf(rule_npf[i], sizeof(rule_npf[i]),
+				 "proto-final=17 src-port=41000");
+		else
+			snprintf(rule_npf[i], sizeof(rule_npf[i]),
+				 "proto-final=17 dst-port=%u", 1000 + n);
+
+		rules[i].rule = rule_num[i];
+		rules[i].pass = n == LARGE_NRULES ? BLOCK : PASS;
+		rules[i].stateful = STATELESS;
+		rules[i].npf = rule_npf[i];
+	}
+	rules[LARGE_NRULES] = (struct dp_test_npf_rule_t) NULL_RULE;
+
+	struct dp_test_npf_ruleset_t fw = {
+		.rstype = "fw-in",
+		.name = "FW1_IN", .enable = 1,
+		.attach_point = "dp1T0", .fwd = FWD, .dir = "in",
+		.rules = rules
+	};
+
+	/*
+	 * Setup interfaces and neighbours
+	 */
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+
+	dp_test_netlink_add_neigh("dp1T0", "1.1.1.2", "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:2:b1");
+
+	/* Phase 0 uses the vector AND, phase 1 the scalar AND */
+	for (phase = 0; phase < 2; phase++) {
+		dp_test_npf_cmd(phase == 0 ?
+				"npf-ut fw global grouper-simd enable" :
+				"npf-ut fw global grouper-simd disable", false);
+		dp_test_npf_fw_add(&fw, npf_fw_debug);
+
+		for (i = 0; i < ARRAY_SIZE(hits); i++) {
+			pkt->l4.udp.sport = 41001;
+			pkt->l4.udp.dport = 1000 + hits[i];
+
+			test_pak = dp_test_v4_pkt_from_desc(pkt);
+			test_exp = dp_test_exp_from_desc(test_pak, pkt);
+			spush(test_exp->description,
+			      sizeof(test_exp->description),
+			      "Phase %u dst-port %u", phase, 1000 + hits[i]);
+
+			dp_test_pak_receive(test_pak, pkt->rx_intf, test_exp);
+
+			dp_test_npf_verify_rule_pkt_count(
+				test_exp->description, &fw,
+				rule_num[hits[i] - 1], 1);
+		}
+
+		/* Only the src-port rule matches */
+		pkt->l4.udp.sport = 41000;
+		pkt->l4.udp.dport = 1290;
+
+		test_pak = dp_test_v4_pkt_from_desc(pkt);
+		test_exp = dp_test_exp_from_desc(test_pak, pkt);
+		spush(test_exp->description, sizeof(test_exp->description),
+		      "Phase %u src-port 41000", phase);
+
+		dp_test_pak_receive(test_pak, pkt->rx_intf, test_exp);
+
+		dp_test_npf_verify_rule_pkt_count(
+			test_exp->description, &fw,
+			rule_num[LARGE_SPORT_RULE - 1], 1);
+
+		/* No pass rule matches */
+		pkt->l4.udp.sport = 41001;
+		pkt->l4.udp.dport = 2000;
+
+		test_pak = dp_test_v4_pkt_from_desc(pkt);
+		test_exp = dp_test_exp_from_desc(test_pak, pkt);
+		dp_test_exp_set_fwd_status(test_exp, DP_TEST_FWD_DROPPED);
+		spush(test_exp->description, sizeof(test_exp->description),
+		      "Phase %u dst-port 2000", phase);
+
+		dp_test_pak_receive(test_pak, pkt->rx_intf, test_exp);
+
+		dp_test_npf_verify_rule_pkt_count(
+			test_exp->description, &fw,
+			rule_num[LARGE_NRULES - 1], 1);
+
+		dp_test_npf_fw_del(&fw, npf_fw_debug);
+	}
+	dp_test_npf_cmd("npf-ut fw global grouper-simd enable", false);
+
+	/* Cleanup */
+	dp_test_npf_clear_sessions();
+
+	dp_test_netlink_del_neigh("dp1T0", "1.1.1.2", "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:2:b1");
+
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+
+} DP_END_TEST;
+
 
 /*
  * Tests a port range that spans the one byte boundary.
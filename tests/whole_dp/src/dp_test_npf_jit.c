@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Differential tests of the npf ncode JIT against the interpreter
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <rte_config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "npf/npf.h"
+#include "npf/npf_addr.h"
+#include "npf/npf_cache.h"
+#include "npf/npf_jit.h"
+#include "npf/npf_ncgen.h"
+#include "npf/npf_ncode.h"
+#include "util.h"
+
+#include "dp_test.h"
+#include "dp_test_npf_lib.h"
+
+DP_DECL_TEST_SUITE(npf_jit);
+
+enum jit_test_prog {
+	JIT_PROG_V4_TCP,
+	JIT_PROG_INVERTED,
+	JIT_PROG_OR_GROUP,
+	JIT_PROG_V6_TTL,
+	JIT_PROG_COUNT
+};
+
+static void *
+jit_test_gen(enum jit_test_prog prog, uint32_t *size)
+{
+	nc_ctx_t *ctx = npf_ncgen_create();
+	npf_addr_t addr;
+
+	dp_test_fail_unless(ctx != NULL, "npf_ncgen_create failed\n");
+	memset(&addr, 0, sizeof(addr));
+
+	switch (prog) {
+	case JIT_PROG_V4_TCP:
+		npf_gennc_addrfamily(ctx, AF_INET);
+		npf_gennc_proto_final(ctx, IPPROTO_TCP);
+		inet_pton(AF_INET, "10.0.0.0", &addr);
+		npf_gennc_v4cidr(ctx, NC_MATCH_SRC, &addr, 8);
+		npf_gennc_ports(ctx, 0, 80, 443);
+		break;
+	case JIT_PROG_INVERTED:
+		inet_pton(AF_INET, "192.168.1.0", &addr);
+		npf_gennc_v4cidr(ctx, NC_MATCH_INVERT, &addr, 24);
+		npf_gennc_ports(ctx, NC_MATCH_SRC | NC_MATCH_INVERT,
+				1024, 65535);
+		break;
+	case JIT_PROG_OR_GROUP:
+		npf_ncgen_group(ctx);
+		npf_gennc_ports(ctx, 0, 22, 22);
+		npf_gennc_ports(ctx, 0, 443, 443);
+		npf_gennc_ip_frag(ctx);
+		npf_ncgen_endgroup(ctx);
+		npf_gennc_proto_final(ctx, IPPROTO_TCP);
+		break;
+	case JIT_PROG_V6_TTL:
+		npf_gennc_addrfamily(ctx, AF_INET6);
+		npf_gennc_proto_base(ctx, IPPROTO_UDP);
+		npf_gennc_ttl(ctx, 1);
+		break;
+	case JIT_PROG_COUNT:
+		break;
+	}
+
+	return npf_ncgen_complete(ctx, size);
+}
+
+/*
+ * Run every program over a spread of cached packet states, and
+ * check the compiled code agrees with the interpreter for each.
+ */
+DP_DECL_TEST_CASE(npf_jit, jit_differential, NULL, NULL);
+DP_START_TEST(jit_differential, jit_differential)
+{
+	static const uint32_t infos[] = {
+		0,
+		NPC_IP4,
+		NPC_IP4 | NPC_L4PORTS,
+		NPC_IP4 | NPC_L4PORTS | NPC_IPFRAG,
+		NPC_IP6,
+		NPC_IP6 | NPC_L4PORTS,
+	};
+	static const uint8_t protos[] = { IPPROTO_TCP, IPPROTO_UDP };
+	static const char * const srcs[] = { "10.1.2.3", "11.0.0.1" };
+	static const char * const dsts[] = { "192.168.1.5", "192.168.2.5" };
+	static const uint16_t ports[][2] = {
+		{ 1000, 80 }, { 40000, 443 }, { 5000, 444 }, { 2000, 22 },
+	};
+	static const uint8_t ttls[] = { 1, 64 };
+	struct npf_jit_prog progs[JIT_PROG_COUNT];
+	struct npf_jit_image *img;
+	struct in_addr srcdst[2];
+	unsigned int p, a, b, c, d, e, f;
+	npf_cache_t npc;
+
+	for (p = 0; p < JIT_PROG_COUNT; p++)
+		progs[p].jp_ncode = jit_test_gen(p, &progs[p].jp_nc_size);
+
+	img = npf_jit_compile(progs, JIT_PROG_COUNT);
+
+#if defined RTE_ARCH_X86_64
+	dp_test_fail_unless(img != NULL, "npf_jit_compile failed\n");
+	for (p = 0; p < JIT_PROG_COUNT; p++)
+		dp_test_fail_unless(progs[p].jp_func != NULL,
+				    "program %u not compiled\n", p);
+#endif
+
+	for (p = 0; p < JIT_PROG_COUNT; p++) {
+		if (!progs[p].jp_func)
+			continue;
+
+		for (a = 0; a < ARRAY_SIZE(infos); a++)
+		for (b = 0; b < ARRAY_SIZE(protos); b++)
+		for (c = 0; c < ARRAY_SIZE(srcs); c++)
+		for (d = 0; d < ARRAY_SIZE(dsts); d++)
+		for (e = 0; e < ARRAY_SIZE(ports); e++)
+		for (f = 0; f < ARRAY_SIZE(ttls); f++) {
+			int exp, ret;
+
+			memset(&npc, 0, sizeof(npc));
+			inet_pton(AF_INET, srcs[c], &srcdst[0]);
+			inet_pton(AF_INET, dsts[d], &srcdst[1]);
+			npc.npc_srcdst = (npf_srcdst_t *)srcdst;
+			npc.npc_info = infos[a];
+			npc.npc_proto_final = protos[b];
+			if (infos[a] & NPC_IP4) {
+				npc.npc_ip.v4.ip_p = protos[b];
+				npc.npc_ip.v4.ip_ttl = ttls[f];
+			} else {
+				npc.npc_ip.v6.ip6_nxt = protos[b];
+				npc.npc_ip.v6.ip6_hlim = ttls[f];
+			}
+			npc.npc_l4.ports.s_port = htons(ports[e][0]);
+			npc.npc_l4.ports.d_port = htons(ports[e][1]);
+
+			exp = npf_ncode_run(progs[p].jp_ncode, &npc, NULL,
+					    NULL, 0, NULL, NULL);
+			ret = progs[p].jp_func(&npc, NULL, NULL, 0,
+					       NULL, NULL);
+			dp_test_fail_unless(ret == exp,
+					    "prog %u info 0x%x proto %u "
+					    "%s -> %s ports %u -> %u ttl %u: "
+					    "jit %d, interpreter %d\n",
+					    p, infos[a], protos[b], srcs[c],
+					    dsts[d], ports[e][0], ports[e][1],
+					    ttls[f], ret, exp);
+		}
+	}
+
+	npf_jit_image_put(img);
+	for (p = 0; p < JIT_PROG_COUNT; p++)
+		free((void *)progs[p].jp_ncode);
+} DP_END_TEST;
+
+/*
+ * The JIT can be turned off by config, and back on again where there
+ * is a code generator.
+ */
+DP_DECL_TEST_CASE(npf_jit, jit_config, NULL, NULL);
+DP_START_TEST(jit_config, jit_config)
+{
+	dp_test_npf_cmd("npf-ut fw global jit disable", false);
+	dp_test_fail_unless(!npf_jit_enabled, "jit not disabled\n");
+
+	dp_test_npf_cmd("npf-ut fw global jit enable", false);
+#if defined RTE_ARCH_X86_64
+	dp_test_fail_unless(npf_jit_enabled, "jit not enabled\n");
+#else
+	dp_test_fail_unless(!npf_jit_enabled, "jit enabled\n");
+#endif
+} DP_END_TEST;
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2020, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Whole dataplane tests of the npf rte_acl match contexts
+ */
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <rte_ether.h>
+#include <rte_mbuf.h>
+
+#include "npf/npf_cache.h"
+#include "npf/npf_match.h"
+#include "npf/npf_rte_acl.h"
+
+#include "dp_test_controller.h"
+#include "dp_test_pktmbuf_lib_internal.h"
+#include "dp_test/dp_test_macros.h"
+
+/* Rule numbers either side of the first band boundary */
+#define ACL_BAND0_RULE1	1
+#define ACL_BAND0_RULE2	2
+#define ACL_BAND1_RULE	10000
+
+/* Rules in this many bands of the narrowest width */
+#define ACL_WIDE_RULES	16
+#define ACL_WIDE_GAP	8192
+
+DP_DECL_TEST_SUITE(npf_rte_acl);
+
+/*
+ * Add an IPv4 rule matching any protocol, source and ports, and
+ * exactly the destination address.
+ */
+static void acl_add_rule(npf_match_ctx_t *ctx, uint32_t rule_no,
+			 const char *dst)
+{
+	uint8_t match[NPC_GPR_SIZE_v4] = { 0 };
+	uint8_t mask[NPC_GPR_SIZE_v4] = { 0 };
+	int rc;
+
+	/* Protocol range 0 to 255 */
+	mask[NPC_GPR_PROTO_OFF_v4] = 0xff;
+
+	/* Wildcard masks, so all ones is any source */
+	memset(&mask[NPC_GPR_SADDR_OFF_v4], 0xff, NPC_GPR_SADDR_LEN_v4);
+	dp_test_fail_unless(inet_pton(AF_INET, dst,
+				      &match[NPC_GPR_DADDR_OFF_v4]) == 1,
+			    "Bad address %s", dst);
+
+	/* Port ranges 0 to 65535 */
+	memset(&mask[NPC_GPR_SPORT_OFF_v4], 0xff, NPC_GPR_SPORT_LEN_v4);
+	memset(&mask[NPC_GPR_DPORT_OFF_v4], 0xff, NPC_GPR_DPORT_LEN_v4);
+
+	rc = npf_rte_acl_add_rule(AF_INET, ctx, rule_no, match, mask, NULL);
+	dp_test_fail_unless(rc == 0, "Failed to add rule %u: %d",
+			    rule_no, rc);
+}
+
+static npf_match_ctx_t *acl_build(const char *name, const uint32_t *rules,
+				  const char * const *dsts, unsigned int num)
+{
+	npf_match_ctx_t *ctx = NULL;
+	unsigned int i;
+	int rc;
+
+	rc = npf_rte_acl_init(AF_INET, name, 16, &ctx);
+	dp_test_fail_unless(rc == 0 && ctx, "Failed to init %s: %d",
+			    name, rc);
+
+	for (i = 0; i < num; i++)
+		acl_add_rule(ctx, rules[i], dsts[i]);
+
+	rc = npf_rte_acl_build(AF_INET, &ctx);
+	dp_test_fail_unless(rc == 0, "Failed to build %s: %d", name, rc);
+
+	return ctx;
+}
+
+/* Classify a UDP packet to dst, expecting rule_no, or 0 for no match */
+static void acl_check_match(npf_match_ctx_t *ctx, const char *dst,
+			    uint32_t exp_rule_no)
+{
+	struct npf_match_cb_data data = { 0 };
+	uint32_t rule_no = 0;
+	struct rte_mbuf *m;
+	int len = 20;
+	int rc;
+
+	m = dp_test_create_udp_ipv4_pak("10.0.9.1", dst, 1001, 1002, 1, &len);
+	dp_test_fail_unless(m, "Failed to create packet");
+	(void)dp_test_pktmbuf_eth_init(m, "aa:bb:cc:dd:ee:ff",
+				       "aa:bb:cc:dd:ee:01",
+				       RTE_ETHER_TYPE_IPV4);
+	data.mbuf = m;
+
+	rc = npf_rte_acl_match(AF_INET, ctx, NULL, &data, &rule_no);
+	if (exp_rule_no)
+		dp_test_fail_unless(rc == 1 && rule_no == exp_rule_no,
+				    "Packet to %s matched %d rule %u, "
+				    "expected rule %u", dst, rc, rule_no,
+				    exp_rule_no);
+	else
+		dp_test_fail_unless(rc == 0, "Packet to %s matched rule %u",
+				    dst, rule_no);
+
+	rte_pktmbuf_free(m);
+}
+
+DP_DECL_TEST_CASE(npf_rte_acl, bands, NULL, NULL);
+
+/*
+ * A rebuild with one band changed shares the unchanged band with the
+ * old context, whatever order its rules were added in, and builds a
+ * new context for the changed band.
+ */
+DP_START_TEST(bands, share)
+{
+	const uint32_t old_rules[] = {
+		ACL_BAND0_RULE1, ACL_BAND0_RULE2, ACL_BAND1_RULE
+	};
+	const char * const old_dsts[] = {
+		"10.0.0.1", "10.0.0.2", "10.0.1.1"
+	};
+	const uint32_t new_rules[] = {
+		ACL_BAND1_RULE, ACL_BAND0_RULE2, ACL_BAND0_RULE1
+	};
+	const char * const new_dsts[] = {
+		"10.0.2.1", "10.0.0.2", "10.0.0.1"
+	};
+	npf_match_ctx_t *old, *new;
+
+	old = acl_build("dpt-old", old_rules, old_dsts, RTE_DIM(old_rules));
+	new = acl_build("dpt-new", new_rules, new_dsts, RTE_DIM(new_rules));
+
+	dp_test_fail_unless(npf_rte_acl_rule_ctx(old, ACL_BAND0_RULE1) &&
+			    npf_rte_acl_rule_ctx(old, ACL_BAND0_RULE1) ==
+			    npf_rte_acl_rule_ctx(new, ACL_BAND0_RULE1),
+			    "Unchanged band not shared");
+	dp_test_fail_unless(npf_rte_acl_rule_ctx(old, ACL_BAND0_RULE1) ==
+			    npf_rte_acl_rule_ctx(old, ACL_BAND0_RULE2),
+			    "Rules of one band in different contexts");
+	dp_test_fail_unless(npf_rte_acl_rule_ctx(old, ACL_BAND1_RULE) &&
+			    npf_rte_acl_rule_ctx(new, ACL_BAND1_RULE) &&
+			    npf_rte_acl_rule_ctx(old, ACL_BAND1_RULE) !=
+			    npf_rte_acl_rule_ctx(new, ACL_BAND1_RULE),
+			    "Changed band shared");
+
+	acl_check_match(old, "10.0.1.1", ACL_BAND1_RULE);
+	acl_check_match(new, "10.0.1.1", 0);
+	acl_check_match(new, "10.0.2.1", ACL_BAND1_RULE);
+
+	/* The shared band outlives the context that built it */
+	npf_rte_acl_destroy(AF_INET, &old);
+	acl_check_match(new, "10.0.0.1", ACL_BAND0_RULE1);
+	acl_check_match(new, "10.0.0.2", ACL_BAND0_RULE2);
+
+	npf_rte_acl_destroy(AF_INET, &new);
+} DP_END_TEST;
+
+/*
+ * A packet matching rules in two bands gets the same rule as one
+ * context holding both would give, both before and after the band
+ * of the other rule is rebuilt.
+ */
+DP_START_TEST(bands, rebuild)
+{
+	const uint32_t rules[] = { ACL_BAND0_RULE1, ACL_BAND1_RULE };
+	const char * const dsts[] = { "10.0.0.1", "10.0.0.1" };
+	const char * const new_dsts[] = { "10.0.0.1", "10.0.1.1" };
+	npf_match_ctx_t *old, *new;
+
+	old = acl_build("dpt-old", rules, dsts, RTE_DIM(rules));
+	acl_check_match(old, "10.0.0.1", ACL_BAND1_RULE);
+
+	new = acl_build("dpt-new", rules, new_dsts, RTE_DIM(rules));
+	npf_rte_acl_destroy(AF_INET, &old);
+
+	acl_check_match(new, "10.0.0.1", ACL_BAND0_RULE1);
+	acl_check_match(new, "10.0.1.1", ACL_BAND1_RULE);
+	acl_check_match(new, "10.0.3.1", 0);
+
+	npf_rte_acl_destroy(AF_INET, &new);
+} DP_END_TEST;
+
+/*
+ * Rules spread over more bands than the cap get wider bands, holding
+ * two rules each here, and still match and map to their contexts.
+ */
+DP_START_TEST(bands, cap)
+{
+	uint32_t rules[ACL_WIDE_RULES];
+	char dsts[ACL_WIDE_RULES][INET_ADDRSTRLEN];
+	const char *dst_ptrs[ACL_WIDE_RULES];
+	npf_match_ctx_t *ctx;
+	unsigned int i;
+
+	for (i = 0; i < ACL_WIDE_RULES; i++) {
+		rules[i] = 1 + i * ACL_WIDE_GAP;
+		snprintf(dsts[i], sizeof(dsts[i]), "10.0.%u.1", i);
+		dst_ptrs[i] = dsts[i];
+	}
+
+	ctx = acl_build("dpt-cap", rules, dst_ptrs, ACL_WIDE_RULES);
+
+	for (i = 0; i < ACL_WIDE_RULES; i += 2) {
+		dp_test_fail_unless(npf_rte_acl_rule_ctx(ctx, rules[i]) &&
+				    npf_rte_acl_rule_ctx(ctx, rules[i]) ==
+				    npf_rte_acl_rule_ctx(ctx, rules[i + 1]),
+				    "Rules %u and %u not in one band",
+				    rules[i], rules[i + 1]);
+		if (i)
+			dp_test_fail_unless(
+				npf_rte_acl_rule_ctx(ctx, rules[i]) !=
+				npf_rte_acl_rule_ctx(ctx, rules[i - 1]),
+				"Rules %u and %u in one band",
+				rules[i - 1], rules[i]);
+	}
+	dp_test_fail_unless(!npf_rte_acl_rule_ctx(ctx, 2),
+			    "Context for a rule not added");
+
+	for (i = 0; i < ACL_WIDE_RULES; i++)
+		acl_check_match(ctx, dsts[i], rules[i]);
+	acl_check_match(ctx, "10.0.200.1", 0);
+
+	npf_rte_acl_destroy(AF_INET, &ctx);
+} DP_END_TEST;
@@ -13,6 +13,7 @@
 #include <string.h>
 
 #include <linux/if_ether.h>
+#include <linux/if_tunnel.h>
 #include <netinet/ip_icmp.h>
 #include "ip_funcs.h"
 #include "in_cksum.h"
@@ -20,6 +21,7 @@
 #include "main.h"
 #include "if/gre.h"
 #include "iptun_common.h"
+#include "portmonitor/portmonitor.h"
 
 #include "dp_test.h"
 #include "dp_test_controller.h"
@@ -552,6 +554,169 @@ DP_START_TEST(mirroring, erspan_vlan_source)
 	dp_test_portmonitor_teardown_erspan(VRF_DEFAULT_ID);
 } DP_END_TEST;
 
+/* For checking mirrors cut short by a session snap length */
+#define ERSPAN_SNAPLEN		48
+#define ERSPAN_SNAP_PAYLOAD	200
+
+struct erspan_snap_ctx {
+	validate_cb	saved_cb;
+	char		dst_ifname[IFNAMSIZ];
+	uint8_t		hdr_type;
+	uint16_t	gre_prot;
+	uint8_t		orig[ERSPAN_SNAPLEN];
+	const char	*file;
+	int		line;
+};
+
+static void
+erspan_snap_check(struct rte_mbuf *m, const struct erspan_snap_ctx *ctx)
+{
+	const struct erspan_v2_hdr *v2_hdr;
+	const struct erspan_v3_hdr *v3_hdr;
+	const uint8_t *p, *gre, *data;
+	uint8_t buf[256];
+	uint16_t flags, hdr;
+	uint32_t off, len;
+
+	len = rte_pktmbuf_pkt_len(m);
+	_dp_test_fail_unless(len <= sizeof(buf), ctx->file, ctx->line,
+			     "Mirror of %u bytes not cut short", len);
+	p = rte_pktmbuf_read(m, 0, len, buf);
+	_dp_test_fail_unless(p && len > RTE_ETHER_HDR_LEN +
+			     sizeof(struct iphdr), ctx->file, ctx->line,
+			     "Mirror too short");
+
+	off = RTE_ETHER_HDR_LEN;
+	_dp_test_fail_unless(p[off + 9] == IPPROTO_GRE, ctx->file, ctx->line,
+			     "Mirror not GRE");
+	off += (p[off] & 0xf) * 4;
+
+	gre = p + off;
+	flags = *(const uint16_t *)gre;	/* GRE_* are network order */
+	_dp_test_fail_unless(ntohs(*(const uint16_t *)(gre + 2)) ==
+			     ctx->gre_prot, ctx->file, ctx->line,
+			     "GRE protocol %#x, expected %#x",
+			     ntohs(*(const uint16_t *)(gre + 2)), ctx->gre_prot);
+	off += 4;
+	if (flags & GRE_CSUM)
+		off += 4;
+	if (flags & GRE_KEY)
+		off += 4;
+	if (flags & GRE_SEQ)
+		off += 4;
+
+	if (ctx->hdr_type == ERSPAN_TYPE_II) {
+		v2_hdr = (const struct erspan_v2_hdr *)(p + off);
+		hdr = ntohs(v2_hdr->cos_en_t_id);
+		off += sizeof(*v2_hdr);
+	} else {
+		v3_hdr = (const struct erspan_v3_hdr *)(p + off);
+		hdr = ntohs(v3_hdr->cos_bso_t_id);
+		off += sizeof(*v3_hdr);
+
+		/* Frame size class of the original, not of the mirror */
+		_dp_test_fail_unless(((hdr >> 11) & 0x3) ==
+				     ERSPAN_ORIG_FRAME_NO_ERR,
+				     ctx->file, ctx->line,
+				     "ERSPAN frame size class %u, expected %u",
+				     (hdr >> 11) & 0x3,
+				     ERSPAN_ORIG_FRAME_NO_ERR);
+	}
+
+	_dp_test_fail_unless(hdr & ERSPAN_ORIG_FRAME_TRUNCATED,
+			     ctx->file, ctx->line,
+			     "ERSPAN truncated bit not set");
+	_dp_test_fail_unless(len - off == ERSPAN_SNAPLEN,
+			     ctx->file, ctx->line,
+			     "Mirrored %u bytes, expected %u", len - off,
+			     ERSPAN_SNAPLEN);
+	data = p + off;
+	_dp_test_fail_unless(!memcmp(data, ctx->orig, ERSPAN_SNAPLEN),
+			     ctx->file, ctx->line,
+			     "Mirror differs from the original");
+}
+
+static void
+erspan_snap_validate_cb(struct rte_mbuf *m, struct ifnet *ifp,
+			struct dp_test_expected *exp,
+			enum dp_test_fwd_result_e fwd_result)
+{
+	struct erspan_snap_ctx *ctx = dp_test_exp_get_validate_ctx(exp);
+
+	if (fwd_result != DP_TEST_FWD_FORWARDED ||
+	    strcmp(ifp->if_name, ctx->dst_ifname)) {
+		ctx->saved_cb(m, ifp, exp, fwd_result);
+		return;
+	}
+
+	erspan_snap_check(m, ctx);
+	dp_test_exp_validate_cb_pak_done(exp, true);
+}
+
+/*
+ * Receive a frame longer than the session snap length, and check that
+ * the mirror carries only the first snaplen bytes, with the truncated
+ * bit set and, for type III, the size class of the original frame.
+ */
+static void
+erspan_snaplen_test(uint8_t hdr_type, uint16_t gre_prot,
+		    const char *file, int line)
+{
+	struct erspan_snap_ctx ctx = {
+		.hdr_type = hdr_type,
+		.gre_prot = gre_prot,
+		.file = file,
+		.line = line,
+	};
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+	int len = ERSPAN_SNAP_PAYLOAD;
+
+	dp_test_portmonitor_setup_erspan(VRF_DEFAULT_ID);
+
+	dp_test_portmonitor_create_erspansrc(1, "dp1T1", "erspan1",
+						20, hdr_type, NULL, NULL);
+	dp_test_portmonitor_request("portmonitor set session 1 snaplen "
+				    RTE_STR(ERSPAN_SNAPLEN) " 0 0",
+				    false);
+
+	test_pak = dp_test_create_ipv4_pak("1.1.1.1", "2.2.2.2",
+					   1, &len);
+	(void)dp_test_pktmbuf_eth_init(test_pak,
+				       dp_test_intf_name2mac_str("dp1T1"),
+				       DP_TEST_INTF_DEF_SRC_MAC,
+				       RTE_ETHER_TYPE_IPV4);
+	memcpy(ctx.orig, rte_pktmbuf_mtod(test_pak, void *), ERSPAN_SNAPLEN);
+	dp_test_intf_real("dp2T2", ctx.dst_ifname);
+
+	/* We expect 2 packets, one local and one mirrored */
+	exp = dp_test_exp_create_m(test_pak, 2);
+	dp_test_exp_set_fwd_status_m(exp, 0, DP_TEST_FWD_LOCAL);
+	dp_test_exp_set_fwd_status_m(exp, 1, DP_TEST_FWD_FORWARDED);
+	dp_test_exp_set_oif_name_m(exp, 1, "dp2T2");
+
+	ctx.saved_cb = dp_test_exp_get_validate_cb(exp);
+	dp_test_exp_set_validate_ctx(exp, &ctx, false);
+	dp_test_exp_set_validate_cb(exp, erspan_snap_validate_cb);
+
+	dp_test_pak_receive(test_pak, "dp1T1", exp);
+
+	dp_test_portmonitor_delete_session(1);
+	dp_test_portmonitor_teardown_erspan(VRF_DEFAULT_ID);
+}
+
+DP_START_TEST(mirroring, erspan_snaplen_ii)
+{
+	erspan_snaplen_test(ERSPAN_TYPE_II, ETH_P_ERSPAN_TYPEII,
+			    __FILE__, __LINE__);
+} DP_END_TEST;
+
+DP_START_TEST(mirroring, erspan_snaplen_iii)
+{
+	erspan_snaplen_test(ERSPAN_TYPE_III, ETH_P_ERSPAN_TYPEIII,
+			    __FILE__, __LINE__);
+} DP_END_TEST;
+
 DP_DECL_TEST_CASE(portmonitor_suite, pmcleanup, NULL, NULL);
 
 DP_START_TEST(pmcleanup, erspan_destif_del)
@@ -71,6 +71,37 @@ static const struct dp_test_command_t portmonitor_cmd[] = {
 		"Invalid direction ZZZ\n",
 		false,
 		false,
+	},
+	{
+		"portmonitor set session 1 snaplen ZZZ 0 0",
+		"Invalid snap length ZZZ\n",
+		false,
+		false,
+	},
+	{
+		"portmonitor set session 1 snaplen 8 0 0",
+		"Invalid snap length 8\n",
+		false,
+		false,
+	},
+	{
+		"portmonitor set session 1 snaplen 128 0 0",
+		"",
+		true,
+		false,
+	},
+	{
+		"portmonitor show session 1",
+		"{ \"portmonitor_information\":"
+		"  [ { \"session\": 1, \"snaplen\": 128 } ] }",
+		true,
+		true,
+	},
+	{
+		"portmonitor del session 1 snaplen 0 0 0",
+		"",
+		true,
+		false,
 	},
 	 /* portmonitor del session negative tests */
 	{
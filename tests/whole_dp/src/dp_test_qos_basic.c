@@ -16,6 +16,8 @@
 #include "in_cksum.h"
 #include "if_var.h"
 #include "main.h"
+#include "flow_cache.h"
+#include "qos.h"
 
 #include "dp_test.h"
 #include "dp_test_str.h"
@@ -506,6 +508,163 @@ DP_START_TEST(qos_basic_ipv4, basic_pkt_classify)
 
 } DP_END_TEST;
 
+/*
+ * basic_class_cache_flush checks that the cached class of a flow is
+ * forgotten when the config it came from changes: the entries of an
+ * address-group matched by a rule, a commit of the rules, and the
+ * subport a vlan maps to.  Each time the same flow is sent before and
+ * after the change, so a stale cached class would put it in the old pipe.
+ */
+const char *basic_class_cache_flush_cmds[] = {
+	"port subports 2 pipes 3 profiles 1 overhead 24 ql_packets",
+	"subport 0 rate 1250000000 size 5000000 period 40",
+	"subport 0 queue 0 rate 1250000000 size 5000000",
+	"subport 0 queue 1 rate 1250000000 size 5000000",
+	"subport 0 queue 2 rate 1250000000 size 5000000",
+	"subport 0 queue 3 rate 1250000000 size 5000000",
+	"vlan 0 0",
+	"profile 0 rate 1250000 size 5000 period 10",
+	"profile 0 queue 0 rate 1250000 size 5000",
+	"profile 0 queue 1 rate 1250000 size 5000",
+	"profile 0 queue 2 rate 1250000 size 5000",
+	"profile 0 queue 3 rate 1250000 size 5000",
+	"pipe 0 0 0",
+	"pipe 0 1 0",
+	"pipe 0 2 0",
+	"match 0 1 action=accept src-addr-group=QOS_AG handle=tag(1)",
+	"subport 1 rate 1250000000 size 5000000 period 40",
+	"subport 1 queue 0 rate 1250000000 size 5000000",
+	"subport 1 queue 1 rate 1250000000 size 5000000",
+	"subport 1 queue 2 rate 1250000000 size 5000000",
+	"subport 1 queue 3 rate 1250000000 size 5000000",
+	"vlan 10 1",
+	"pipe 1 0 0",
+	"pipe 1 1 0",
+	"match 1 1 action=accept src-addr=1.1.1.0/24 handle=tag(1)",
+	"enable"
+};
+
+DP_START_TEST(qos_basic_ipv4, basic_class_cache_flush)
+{
+	bool debug = (dp_test_debug_get() == 2 ? true : false);
+
+	qos_lib_test_setup();
+
+	dp_test_qos_debug(debug);
+
+	dp_test_intf_vif_create("dp2T1.10", "dp2T1", 10);
+	dp_test_nl_add_ip_addr_and_connected("dp2T1.10", "3.3.3.3/24");
+	dp_test_netlink_add_neigh("dp2T1.10", "3.3.3.11", "aa:bb:cc:dd:2:b1");
+
+	dp_test_npf_fw_addr_group_add("QOS_AG");
+	dp_test_npf_fw_addr_group_addr_add("QOS_AG", "1.1.1.0/24");
+
+	dp_test_qos_attach_config_to_if("dp2T1", basic_class_cache_flush_cmds,
+					debug);
+
+	dp_test_qos_check_for_zero_counters("dp2T1", debug);
+
+	/* The first packet is classified by NPF, the second from the cache */
+	dp_test_qos_pkt_forw_test("dp2T1", 0, "1.1.1.11", "2.2.2.11",
+				  0, 0, 1, 3, 0, debug);
+	dp_test_qos_clear_counters("dp2T1", debug);
+	dp_test_qos_pkt_forw_test("dp2T1", 0, "1.1.1.11", "2.2.2.11",
+				  0, 0, 1, 3, 0, debug);
+	dp_test_qos_clear_counters("dp2T1", debug);
+
+	/* The flow no longer matches the address-group, so goes to pipe 0 */
+	dp_test_npf_fw_addr_group_addr_del("QOS_AG", "1.1.1.0/24");
+	dp_test_qos_pkt_forw_test("dp2T1", 0, "1.1.1.11", "2.2.2.11",
+				  0, 0, 0, 3, 0, debug);
+	dp_test_qos_clear_counters("dp2T1", debug);
+
+	/* A newly committed rule puts the flow in pipe 2 */
+	dp_test_qos_send_if_cmd("dp2T1",
+				"match 0 2 action=accept src-addr=1.1.1.0/24 "
+				"handle=tag(2)", NULL, NULL, debug);
+	dp_test_send_config_src(dp_test_cont_src_get(), "npf-cfg commit");
+	dp_test_qos_pkt_forw_test("dp2T1", 0, "1.1.1.11", "2.2.2.11",
+				  0, 0, 2, 3, 0, debug);
+	dp_test_qos_clear_counters("dp2T1", debug);
+
+	/*
+	 * Cache the class of the flow on vlan 10 from the rules of
+	 * subport 1, then move vlan 10 to subport 0 and its rules.
+	 */
+	dp_test_qos_pkt_forw_test("dp2T1", 10, "1.1.1.11", "3.3.3.11",
+				  0, 1, 1, 3, 0, debug);
+	dp_test_qos_clear_counters("dp2T1", debug);
+	dp_test_qos_pkt_forw_test("dp2T1", 10, "1.1.1.11", "3.3.3.11",
+				  0, 1, 1, 3, 0, debug);
+	dp_test_qos_clear_counters("dp2T1", debug);
+
+	dp_test_qos_send_if_cmd("dp2T1", "vlan 10 0", NULL, NULL, debug);
+	dp_test_qos_pkt_forw_test("dp2T1", 10, "1.1.1.11", "3.3.3.11",
+				  0, 0, 2, 3, 0, debug);
+	dp_test_qos_clear_counters("dp2T1", debug);
+
+	/* Cleanup */
+	dp_test_qos_delete_config_from_if("dp2T1", debug);
+	dp_test_qos_debug(false);
+
+	dp_test_npf_fw_addr_group_del("QOS_AG");
+
+	dp_test_nl_del_ip_addr_and_connected("dp2T1.10", "3.3.3.3/24");
+	dp_test_netlink_del_neigh("dp2T1.10", "3.3.3.11", "aa:bb:cc:dd:2:b1");
+	dp_test_intf_vif_del("dp2T1.10", 10);
+
+	qos_lib_test_teardown();
+
+} DP_END_TEST;
+
+/*
+ * basic_class_cache_gen checks that a class cached by an lcore that
+ * classified before a lazy flush, but added the entry after it, is
+ * not used.
+ */
+DP_START_TEST(qos_basic_ipv4, basic_class_cache_gen)
+{
+	struct flow_cache_entry *entry;
+	struct flow_cache *cache;
+	struct rte_mbuf *m;
+	int rule = 1;
+	int len = 20;
+
+	cache = flow_cache_init_ext(16, FLOW_CACHE_F_CLASSIFY, NULL);
+	dp_test_fail_unless(cache, "Failed to create flow cache");
+	dp_test_fail_unless(flow_cache_init_lcore(cache, dp_lcore_id()) == 0,
+			    "Failed to init flow cache lcore");
+
+	m = dp_test_create_udp_ipv4_pak("1.1.1.11", "2.2.2.11", 1001, 1002,
+					1, &len);
+	dp_test_fail_unless(m, "Failed to create packet");
+	(void)dp_test_pktmbuf_eth_init(m, "aa:bb:cc:dd:ee:ff",
+				       "aa:bb:cc:dd:1:a1",
+				       RTE_ETHER_TYPE_IPV4);
+
+	/* Classified before the flush, added after it */
+	flow_cache_check_lcore(cache);
+	flow_cache_invalidate_lazy(cache);
+	dp_test_fail_unless(flow_cache_add(cache, &rule, 0, m,
+					   FLOW_CACHE_IPV4) == 0,
+			    "Failed to add stale entry");
+	dp_test_fail_unless(flow_cache_lookup(cache, m, FLOW_CACHE_IPV4,
+					      &entry) == -ENOENT,
+			    "Stale entry used after lazy flush");
+
+	/* Classified after the flush */
+	flow_cache_check_lcore(cache);
+	dp_test_fail_unless(flow_cache_add(cache, &rule, 0, m,
+					   FLOW_CACHE_IPV4) == 0,
+			    "Failed to add entry");
+	dp_test_fail_unless(flow_cache_lookup(cache, m, FLOW_CACHE_IPV4,
+					      &entry) == 0,
+			    "Entry not found");
+
+	rte_pktmbuf_free(m);
+	flow_cache_destroy(cache);
+} DP_END_TEST;
+
 /*
  * basic_dscp_map uses a non-default DSCP to TC/queue mapping so that all
  * 32 queues within the pipe get the opportunity to process packets.
@@ -944,6 +1103,112 @@ DP_START_TEST(qos_basic_ipv4, basic_vlan_pkt_fwd)
 
 } DP_END_TEST;
 
+/*
+ * basic_shard_pkt_fwd spreads three subports over two scheduler shards,
+ * so shard 0 has subports 0 and 2, and shard 1 has subport 1.  The test
+ * port has a single transmit queue, so shard 1 has no transmit lcore
+ * of its own and is scheduled by that of ring 0.
+ */
+const char *basic_shard_pkt_fwd_cmds[] = {
+	"port subports 3 pipes 1 profiles 3 overhead 24 shards 2 ql_packets",
+	"subport 0 rate 1250000000 size 5000000 period 40",
+	"subport 0 queue 0 rate 1250000000 size 5000000",
+	"subport 0 queue 1 rate 1250000000 size 5000000",
+	"subport 0 queue 2 rate 1250000000 size 5000000",
+	"subport 0 queue 3 rate 1250000000 size 5000000",
+	"vlan 0 0",
+	"profile 0 rate 12500000 size 50000 period 10",
+	"profile 0 queue 0 rate 12500000 size 50000",
+	"profile 0 queue 1 rate 12500000 size 50000",
+	"profile 0 queue 2 rate 12500000 size 50000",
+	"profile 0 queue 3 rate 12500000 size 50000",
+	"pipe 0 0 0",
+	"subport 1 rate 1250000000 size 5000000 period 40",
+	"subport 1 queue 0 rate 1250000000 size 5000000",
+	"subport 1 queue 1 rate 1250000000 size 5000000",
+	"subport 1 queue 2 rate 1250000000 size 5000000",
+	"subport 1 queue 3 rate 1250000000 size 5000000",
+	"vlan 10 1",
+	"profile 0 rate 12500000 size 50000 period 10",
+	"profile 0 queue 0 rate 12500000 size 50000",
+	"profile 0 queue 1 rate 12500000 size 50000",
+	"profile 0 queue 2 rate 12500000 size 50000",
+	"profile 0 queue 3 rate 12500000 size 50000",
+	"pipe 1 0 0",
+	"subport 2 rate 1250000000 size 5000000 period 40",
+	"subport 2 queue 0 rate 1250000000 size 5000000",
+	"subport 2 queue 1 rate 1250000000 size 5000000",
+	"subport 2 queue 2 rate 1250000000 size 5000000",
+	"subport 2 queue 3 rate 1250000000 size 5000000",
+	"vlan 20 2",
+	"profile 0 rate 12500000 size 50000 period 10",
+	"profile 0 queue 0 rate 12500000 size 50000",
+	"profile 0 queue 1 rate 12500000 size 50000",
+	"profile 0 queue 2 rate 12500000 size 50000",
+	"profile 0 queue 3 rate 12500000 size 50000",
+	"pipe 2 0 0",
+	"enable"
+};
+
+DP_START_TEST(qos_basic_ipv4, basic_shard_pkt_fwd)
+{
+	bool debug = (dp_test_debug_get() == 2 ? true : false);
+	char real_if_name[IFNAMSIZ];
+	struct ifnet *ifp;
+
+	qos_lib_test_setup();
+
+	dp_test_qos_debug(debug);
+
+	/* Set up the VIFs and their interface addresses */
+	dp_test_intf_vif_create("dp2T1.10", "dp2T1", 10);
+	dp_test_nl_add_ip_addr_and_connected("dp2T1.10", "3.3.3.3/24");
+	dp_test_netlink_add_neigh("dp2T1.10", "3.3.3.11", "aa:bb:cc:dd:2:b1");
+	dp_test_intf_vif_create("dp2T1.20", "dp2T1", 20);
+	dp_test_nl_add_ip_addr_and_connected("dp2T1.20", "4.4.4.4/24");
+	dp_test_netlink_add_neigh("dp2T1.20", "4.4.4.11", "aa:bb:cc:dd:2:b1");
+
+	/* Set up QoS config on dp2T1 */
+	dp_test_qos_attach_config_to_if("dp2T1", basic_shard_pkt_fwd_cmds,
+					debug);
+
+	dp_test_intf_real("dp2T1", real_if_name);
+	ifp = dp_ifnet_byifname(real_if_name);
+	dp_test_fail_unless(ifp && ifp->if_qos, "no QoS on dp2T1");
+	dp_test_fail_unless(qos_shard_count(ifp->if_qos) == 2,
+			    "expected 2 shards, have %u",
+			    qos_shard_count(ifp->if_qos));
+
+	dp_test_qos_check_for_zero_counters("dp2T1", debug);
+
+	/* Subport 0, on shard 0 */
+	dp_test_qos_pkt_forw_test("dp2T1", 0, "1.1.1.11", "2.2.2.11",
+				  48, 0, 0, 0, 0, debug);
+
+	/* Subport 1, on shard 1 */
+	dp_test_qos_pkt_forw_test("dp2T1", 10, "1.1.1.11", "3.3.3.11",
+				  32, 1, 0, 1, 0, debug);
+
+	/* Subport 2, back on shard 0 */
+	dp_test_qos_pkt_forw_test("dp2T1", 20, "1.1.1.11", "4.4.4.11",
+				  16, 2, 0, 2, 0, debug);
+
+	/* Cleanup */
+	dp_test_qos_delete_config_from_if("dp2T1", debug);
+	dp_test_qos_debug(false);
+
+	/* Cleanup the VIFs and their addresses */
+	dp_test_nl_del_ip_addr_and_connected("dp2T1.20", "4.4.4.4/24");
+	dp_test_netlink_del_neigh("dp2T1.20", "4.4.4.11", "aa:bb:cc:dd:2:b1");
+	dp_test_intf_vif_del("dp2T1.20", 20);
+	dp_test_nl_del_ip_addr_and_connected("dp2T1.10", "3.3.3.3/24");
+	dp_test_netlink_del_neigh("dp2T1.10", "3.3.3.11", "aa:bb:cc:dd:2:b1");
+	dp_test_intf_vif_del("dp2T1.10", 10);
+
+	qos_lib_test_teardown();
+
+} DP_END_TEST;
+
 /*
  * basic_pkt_remark uses classification to remark the DSCP value of some
  * packets so that they don't end up in the default queues.
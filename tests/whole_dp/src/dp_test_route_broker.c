@@ -19,6 +19,8 @@
 
 zsock_t *broker_data_sock;
 bool dp_test_route_broker_protobuf = true;
+/* Send protobuf updates as RibUpdateBatch messages */
+bool dp_test_route_broker_batch = true;
 
 static int process_actor_message(zsock_t *sock)
 {
@@ -103,7 +105,9 @@ static void process_ctrl_message(zsock_t *sock)
 	free(url);
 	assert(rc >= 0);
 
-	rc = zmsg_addu32(msg, dp_test_route_broker_protobuf ? 0x1 : 0x0);
+	/* netlink, protobuf or protobuf batch format */
+	rc = zmsg_addu32(msg, !dp_test_route_broker_protobuf ? 0x0 :
+			 dp_test_route_broker_batch ? 0x2 : 0x1);
 	assert(rc >= 0);
 
 	rc = zmsg_prepend(msg, &envelope);
@@ -14,5 +14,6 @@
 
 extern zsock_t *broker_data_sock;
 extern bool dp_test_route_broker_protobuf;
+extern bool dp_test_route_broker_batch;
 
 void dp_test_broker_thread_run(zsock_t *pipe, void *args);
@@ -444,6 +444,210 @@ DP_START_TEST(session_sentry, test7)
 	dp_test_netlink_del_vrf(69, 0);
 } DP_END_TEST;
 
+/*
+ * Test lookups through the per-lcore sentry shards, and that deleted
+ * sentries are removed from them.
+ */
+DP_DECL_TEST_CASE(session_suite, session_shard_lookup, NULL, NULL);
+DP_START_TEST(session_shard_lookup, test7a)
+{
+	struct session_counts sc = { 0 };
+	struct sentry_packet sp_f;
+	struct sentry_packet sp_r;
+	const struct ifnet *ifp;
+	struct rte_mbuf *f;
+	struct rte_mbuf *r;
+	struct rte_mbuf *g;
+	struct session *s1;
+	struct session *s2;
+	char realname[IFNAMSIZ];
+	uint32_t used, max;
+	int len = 22;
+	bool created;
+	bool forw;
+	int i, rc;
+
+	dp_test_netlink_add_vrf(69, 1);
+
+	dp_test_nl_add_ip_addr_and_connected_vrf(IF_NAME, "1.1.1.1/24", 69);
+	dp_test_intf_real(IF_NAME, realname);
+	ifp = dp_ifnet_byifname(realname);
+
+	rc = session_set_shard_mode(true);
+	dp_test_fail_unless(rc == 0, "session shard enable: %d\n", rc);
+
+	f = dp_test_create_udp_ipv4_pak("10.73.0.0", "10.73.2.0",
+			1001, 1003, 1, &len);
+	r = dp_test_create_udp_ipv4_pak("10.73.2.0", "10.73.0.0",
+			1003, 1001, 1, &len);
+
+	dp_test_session_establish(f, ifp, 10, &s1, &created);
+	dp_test_fail_unless(created == true, "session udp not created\n");
+
+	sentry_packet_from_mbuf(f, ifp->if_index, &sp_f);
+	sentry_packet_from_mbuf(r, ifp->if_index, &sp_r);
+
+	/* First lookup of each fills the shard, the second hits it */
+	for (i = 0; i < 2; i++) {
+		rc = session_lookup_by_sentry_packet(&sp_f, &s2, &forw);
+		dp_test_fail_unless(rc == 0 && s2 == s1 && forw,
+				    "session shard forward lookup: %d\n", rc);
+		rc = session_lookup_by_sentry_packet(&sp_r, &s2, &forw);
+		dp_test_fail_unless(rc == 0 && s2 == s1 && !forw,
+				    "session shard reverse lookup: %d\n", rc);
+	}
+
+	session_counts(&used, &max, &sc);
+	if (rte_lcore_id() != LCORE_ID_ANY)
+		dp_test_fail_unless(sc.sc_shard_hits >= 2,
+				    "session shard hits: %lu\n",
+				    (unsigned long)sc.sc_shard_hits);
+
+	/*
+	 * Deleted sentries must not be found in the shard.  Keep another
+	 * session so that the lookup is not short-circuited.
+	 */
+	dp_test_session_reset();
+
+	g = dp_test_create_udp_ipv4_pak("10.73.0.0", "10.73.2.0",
+			1002, 1003, 1, &len);
+	dp_test_session_establish(g, ifp, 10, &s1, &created);
+	dp_test_fail_unless(created == true, "session udp not created\n");
+
+	rc = session_lookup_by_sentry_packet(&sp_f, &s2, &forw);
+	dp_test_fail_unless(rc == -ENOENT,
+			    "session shard lookup after delete: %d\n", rc);
+
+	dp_test_session_reset();
+	session_set_shard_mode(false);
+
+	rte_pktmbuf_free(f);
+	rte_pktmbuf_free(r);
+	rte_pktmbuf_free(g);
+
+	dp_test_nl_del_ip_addr_and_connected_vrf(IF_NAME, "1.1.1.1/24", 69);
+
+	dp_test_netlink_del_vrf(69, 0);
+} DP_END_TEST;
+
+/* For dirty session tracking */
+struct dirty_walk_data {
+	struct session	*last;
+	unsigned int	count;
+};
+
+static int dirty_walk_cb(struct session *s, void *data)
+{
+	struct dirty_walk_data *dw = data;
+
+	dw->last = s;
+	dw->count++;
+	return 0;
+}
+
+/* Match only the session of the previous callback */
+static bool dirty_walk_match(struct session *s, void *data)
+{
+	struct dirty_walk_data *dw = data;
+
+	return s == dw->last;
+}
+
+/*
+ * Test that a dirty walk visits only the sessions changed since the
+ * previous walk.
+ */
+DP_DECL_TEST_CASE(session_suite, session_dirty, NULL, NULL);
+DP_START_TEST(session_dirty, test7b)
+{
+	struct dirty_walk_data dw = { 0 };
+	const struct ifnet *ifp;
+	struct rte_mbuf *f;
+	struct rte_mbuf *g;
+	struct session *s1;
+	struct session *s2;
+	char realname[IFNAMSIZ];
+	int len = 22;
+	bool created;
+	int rc;
+
+	dp_test_netlink_add_vrf(69, 1);
+
+	dp_test_nl_add_ip_addr_and_connected_vrf(IF_NAME, "1.1.1.1/24", 69);
+	dp_test_intf_real(IF_NAME, realname);
+	ifp = dp_ifnet_byifname(realname);
+
+	rc = session_set_dirty_tracking(true);
+	dp_test_fail_unless(rc == 0, "session dirty enable: %d\n", rc);
+
+	f = dp_test_create_udp_ipv4_pak("10.73.0.0", "10.73.2.0",
+			1001, 1003, 1, &len);
+	g = dp_test_create_udp_ipv4_pak("10.73.0.0", "10.73.2.0",
+			1002, 1003, 1, &len);
+
+	dp_test_session_establish(f, ifp, 10, &s1, &created);
+	dp_test_fail_unless(created == true, "session udp not created\n");
+	dp_test_session_establish(g, ifp, 10, &s2, &created);
+	dp_test_fail_unless(created == true, "session udp not created\n");
+
+	/* Nothing has changed yet */
+	session_dirty_walk(NULL, dirty_walk_cb, &dw);
+	dp_test_fail_unless(dw.count == 0, "dirty walk count %u, expected 0\n",
+			    dw.count);
+
+	/* Counters */
+	se_save_stats(s1, true, 100);
+	se_save_stats(s1, false, 100);
+	dw.count = 0;
+	session_dirty_walk(NULL, dirty_walk_cb, &dw);
+	dp_test_fail_unless(dw.count == 1 && dw.last == s1,
+			    "dirty walk after stats count %u\n", dw.count);
+
+	/* Only once */
+	dw.count = 0;
+	session_dirty_walk(NULL, dirty_walk_cb, &dw);
+	dp_test_fail_unless(dw.count == 0, "dirty walk count %u, expected 0\n",
+			    dw.count);
+
+	/* State */
+	session_set_protocol_state_timeout(s2, SESSION_STATE_ESTABLISHED,
+					   SESSION_STATE_ESTABLISHED, 60);
+	dw.count = 0;
+	session_dirty_walk(NULL, dirty_walk_cb, &dw);
+	dp_test_fail_unless(dw.count == 1 && dw.last == s2,
+			    "dirty walk after state count %u\n", dw.count);
+
+	/* A walk for s2 clears s1 as well */
+	se_save_stats(s1, true, 100);
+	se_save_stats(s2, true, 100);
+	dw.count = 0;
+	session_dirty_walk(dirty_walk_match, dirty_walk_cb, &dw);
+	dp_test_fail_unless(dw.count == 1 && dw.last == s2,
+			    "filtered dirty walk count %u\n", dw.count);
+	dw.count = 0;
+	session_dirty_walk(NULL, dirty_walk_cb, &dw);
+	dp_test_fail_unless(dw.count == 0,
+			    "dirty walk after filtered walk count %u\n",
+			    dw.count);
+
+	/* Disabled */
+	session_set_dirty_tracking(false);
+	se_save_stats(s2, true, 100);
+	dw.count = 0;
+	session_dirty_walk(NULL, dirty_walk_cb, &dw);
+	dp_test_fail_unless(dw.count == 0, "dirty walk count %u, expected 0\n",
+			    dw.count);
+
+	dp_test_session_reset();
+
+	rte_pktmbuf_free(f);
+	rte_pktmbuf_free(g);
+
+	dp_test_nl_del_ip_addr_and_connected_vrf(IF_NAME, "1.1.1.1/24", 69);
+
+	dp_test_netlink_del_vrf(69, 0);
+} DP_END_TEST;
+
 /* For session feature testing */
 struct feature_data {
 	int	destroy;
@@ -874,6 +1078,77 @@ DP_START_TEST(session_timeout, test12)
 	dp_test_netlink_del_vrf(69, 0);
 } DP_END_TEST;
 
+/*
+ * Test that a session whose timeout shrinks is looked at by the GC
+ * before its new timeout, rather than at the time due for the old one.
+ */
+DP_DECL_TEST_CASE(session_suite, session_timeout_shrink, NULL, NULL);
+DP_START_TEST(session_timeout_shrink, test12a)
+{
+	struct rte_mbuf *f;
+	struct session *s;
+	const struct ifnet *ifp;
+	char realname[IFNAMSIZ];
+	uint64_t uptime;
+	int len = 22;
+	bool created;
+
+	dp_test_netlink_add_vrf(69, 1);
+
+	dp_test_nl_add_ip_addr_and_connected_vrf(IF_NAME, "1.1.1.1/24", 69);
+	dp_test_intf_real(IF_NAME, realname);
+	ifp = dp_ifnet_byifname(realname);
+
+	f = dp_test_create_udp_ipv4_pak("10.73.0.0", "10.73.2.0",
+			1001, 1003, 1, &len);
+
+	/* An established session with a long timeout */
+	dp_test_session_establish(f, ifp, 7200, &s, &created);
+	session_set_protocol_state_timeout(s, SESSION_STATE_ESTABLISHED,
+					   SESSION_STATE_ESTABLISHED, 7200);
+
+	uptime = get_dp_uptime();
+	session_gc_run();
+
+	dp_test_fail_unless(s->se_etime >= uptime + 7200,
+			    "session timeout shrink: etime %lu, uptime %lu",
+			    s->se_etime, uptime);
+	dp_test_fail_unless(s->se_ew.ew_expiry > uptime + 10,
+			    "session timeout shrink: due %lu, uptime %lu",
+			    s->se_ew.ew_expiry, uptime);
+
+	/* Shrink the timeout, as when a TCP session starts closing */
+	session_set_protocol_state_timeout(s, SESSION_STATE_TERMINATING,
+					   SESSION_STATE_TERMINATING, 5);
+
+	uptime = get_dp_uptime();
+	session_gc_run();
+
+	dp_test_fail_unless(s->se_etime <= uptime + 1 + 5,
+			    "session timeout shrink: etime %lu, uptime %lu",
+			    s->se_etime, uptime);
+	dp_test_fail_unless(s->se_ew.ew_expiry <= uptime + 1 + 5 + 1,
+			    "session timeout shrink: due %lu, uptime %lu",
+			    s->se_ew.ew_expiry, uptime);
+
+	/* A custom timeout that shrinks it further */
+	session_set_custom_timeout(s, 2);
+
+	uptime = get_dp_uptime();
+	session_gc_run();
+
+	dp_test_fail_unless(s->se_etime <= uptime + 1 + 2,
+			    "session timeout shrink: etime %lu, uptime %lu",
+			    s->se_etime, uptime);
+
+	dp_test_session_reset();
+
+	rte_pktmbuf_free(f);
+	dp_test_nl_del_ip_addr_and_connected_vrf(IF_NAME, "1.1.1.1/24", 69);
+
+	dp_test_netlink_del_vrf(69, 0);
+} DP_END_TEST;
+
 /*
  * Test various IPv4 ICMP scenarios.
  */
@@ -1625,3 +1900,397 @@ DP_START_TEST(ssync2, test20)
 				  "aa:bb:cc:dd:2:11");
 
 } DP_END_TEST;
+
+/*
+ * Test bulk session sync for UDP firewall sessions
+ *
+ * Creates two firewall sessions, packs both into one bulk message,
+ * clears the sessions, then restores them from the bulk message.
+ */
+DP_DECL_TEST_CASE(session_suite, ssync3, NULL, NULL);
+DP_START_TEST(ssync3, test21)
+{
+	/* Setup interfaces and neighbours */
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "192.0.2.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "203.0.113.1/24");
+
+	dp_test_netlink_add_neigh("dp1T0", "192.0.2.103",
+				  "aa:bb:cc:16:0:20");
+	dp_test_netlink_add_neigh("dp2T1", "203.0.113.203",
+				  "aa:bb:cc:18:0:1");
+
+	struct dp_test_npf_rule_t rules[] = {
+		{
+			.rule = "10",
+			.pass = PASS,
+			.stateful = STATEFUL,
+			.npf = "to=any"
+		},
+		RULE_DEF_BLOCK,
+		NULL_RULE
+	};
+
+	struct dp_test_npf_ruleset_t rset = {
+		.rstype = "fw-out",
+		.name	= "FW1",
+		.enable = 1,
+		.attach_point = "dp2T1",
+		.fwd	= FWD,
+		.dir	= "out",
+		.rules	= rules
+	};
+
+	dp_test_npf_fw_add(&rset, false);
+
+	/* Two UDP flows, differing in source port */
+	dpt_udp("dp1T0", "aa:bb:cc:16:0:20",
+		"192.0.2.103", 10000, "203.0.113.203", 60000,
+		"192.0.2.103", 10000, "203.0.113.203", 60000,
+		"aa:bb:cc:18:0:1", "dp2T1",
+		DP_TEST_FWD_FORWARDED);
+	dpt_udp("dp1T0", "aa:bb:cc:16:0:20",
+		"192.0.2.103", 10001, "203.0.113.203", 60000,
+		"192.0.2.103", 10001, "203.0.113.203", 60000,
+		"aa:bb:cc:18:0:1", "dp2T1",
+		DP_TEST_FWD_FORWARDED);
+
+	uint32_t saddr;
+	uint32_t daddr;
+	const struct ifnet *ifp;
+	char realname[IFNAMSIZ];
+	struct sentry_packet sp_forw;
+	struct session *s[2];
+	bool forw;
+	uint16_t sport;
+	int rc;
+	int i;
+
+	dp_test_intf_real("dpT21", realname);
+	ifp = dp_ifnet_byifname(realname);
+
+	inet_pton(AF_INET, "192.0.2.103", &saddr);
+	inet_pton(AF_INET, "203.0.113.203", &daddr);
+
+	for (i = 0; i < 2; i++) {
+		sport = 10000 + i;
+		rc = dp_test_session_init_sentry_packet(
+			&sp_forw, ifp->if_index, SENTRY_IPv4,
+			(uint8_t) IPPROTO_UDP, 1, htons(sport),
+			&saddr, htons(60000), &daddr);
+		dp_test_fail_unless(rc == 0,
+				    "session init sentry_packet: %d\n", rc);
+
+		rc = session_lookup_by_sentry_packet(&sp_forw, &s[i], &forw);
+		dp_test_fail_unless(rc == 0 && s[i] != NULL,
+				    "session_lookup_by_sentry_packet failed\n");
+	}
+
+	/*
+	 * Pack both sessions into one buffer, which should be much
+	 * smaller than two single session messages.
+	 */
+	char buf[2 * NPF_PACK_MESSAGE_MAX_SIZE];
+	uint32_t consumed = 0;
+	uint32_t restored = 0;
+	int len;
+
+	len = dp_session_pack_bulk(s, 2, buf, sizeof(buf), SESSION_PACK_FULL,
+				   &consumed);
+	dp_test_fail_unless(len > 0 && consumed == 2,
+			    "dp_session_pack_bulk failed %d, consumed %u\n",
+			    len, consumed);
+	dp_test_fail_unless((uint32_t)len < 2 * NPF_PACK_NEW_FW_SESSION_SIZE,
+			    "bulk message length %d, expected < %lu\n", len,
+			    2 * NPF_PACK_NEW_FW_SESSION_SIZE);
+
+	dp_test_npf_clear_sessions();
+
+	enum session_pack_type spt = SESSION_PACK_NONE;
+
+	rc = dp_session_restore_bulk(buf, len, &spt, &restored);
+	dp_test_fail_unless(rc == 0 && spt == SESSION_PACK_FULL &&
+			    restored == 2,
+			    "dp_session_restore_bulk failed %d, restored %u\n",
+			    rc, restored);
+
+	/* Both sessions should exist again, with their counters */
+	for (i = 0; i < 2; i++) {
+		char filter[200];
+		uint32_t pkts_in = 0, pkts_out = 0;
+		uint32_t bytes_in = 0, bytes_out = 0;
+		uint32_t sess_id = 0;
+
+		snprintf(filter, sizeof(filter),
+			 "start 0 count 1 "
+			 "src-addr 192.0.2.103 src-port %u "
+			 "dst-addr 203.0.113.203 dst-port 60000 "
+			 "proto 17 dir out intf dpT21", 10000 + i);
+		dp_test_session_counters(filter, &pkts_in, &pkts_out,
+					 &bytes_in, &bytes_out, &sess_id);
+		dp_test_fail_unless(pkts_out == 1,
+				    "Session %d packets out %u, expected 1",
+				    i, pkts_out);
+	}
+
+	/* And an update of both should apply */
+	for (i = 0; i < 2; i++) {
+		sport = 10000 + i;
+		dp_test_session_init_sentry_packet(
+			&sp_forw, ifp->if_index, SENTRY_IPv4,
+			(uint8_t) IPPROTO_UDP, 1, htons(sport),
+			&saddr, htons(60000), &daddr);
+		rc = session_lookup_by_sentry_packet(&sp_forw, &s[i], &forw);
+		dp_test_fail_unless(rc == 0 && s[i] != NULL,
+				    "restored session lookup failed\n");
+	}
+
+	len = dp_session_pack_bulk(s, 2, buf, sizeof(buf),
+				   SESSION_PACK_UPDATE, &consumed);
+	dp_test_fail_unless(len > 0 && consumed == 2,
+			    "dp_session_pack_bulk update failed %d\n", len);
+
+	rc = dp_session_restore_bulk(buf, len, &spt, &restored);
+	dp_test_fail_unless(rc == 0 && spt == SESSION_PACK_UPDATE &&
+			    restored == 2,
+			    "dp_session_restore_bulk update failed %d\n", rc);
+
+	/*
+	 * Cleanup
+	 */
+	dp_test_npf_fw_del(&rset, false);
+	dp_test_npf_clear_sessions();
+
+	dp_test_netlink_del_neigh("dp1T0", "192.0.2.103",
+				  "aa:bb:cc:16:0:20");
+	dp_test_netlink_del_neigh("dp2T1", "203.0.113.203",
+				  "aa:bb:cc:18:0:1");
+
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "192.0.2.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "203.0.113.1/24");
+
+} DP_END_TEST;
+
+/*
+ * Session sync performance, single session messages against bulk.
+ */
+#define SSYNC_PERF_SESSIONS	100000
+#define SSYNC_PERF_BULK_SIZE	(64 * 1024)
+
+struct ssync_perf_walk {
+	struct session	**s;
+	uint32_t	count;
+};
+
+static int ssync_perf_walk_cb(struct session *s, void *data)
+{
+	struct ssync_perf_walk *w = data;
+
+	if (w->count < SSYNC_PERF_SESSIONS)
+		w->s[w->count++] = s;
+	return 0;
+}
+
+static void ssync_perf_rate(const char *what, uint32_t count,
+			    struct timespec *start, struct timespec *end)
+{
+	uint64_t us = timespec_diff_us(start, end);
+
+	printf("%s %u sessions: %lu us, %lu sessions/s\n", what, count, us,
+	       us ? (uint64_t)count * 1000000 / us : 0);
+}
+
+DP_DECL_TEST_CASE(session_suite, ssync_perf, NULL, NULL);
+
+/*
+ * Measures the rate at which sessions are packed and restored, both
+ * one at a time and in bulk.  It is not run as part of the build, as
+ * the numbers only mean anything compared with another run on the
+ * same machine.
+ */
+DP_START_TEST_DONT_RUN(ssync_perf, test22)
+{
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "192.0.2.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "203.0.113.1/24");
+
+	dp_test_netlink_add_neigh("dp1T0", "192.0.2.103",
+				  "aa:bb:cc:16:0:20");
+	dp_test_netlink_add_neigh("dp2T1", "203.0.113.203",
+				  "aa:bb:cc:18:0:1");
+
+	struct dp_test_npf_rule_t rules[] = {
+		{
+			.rule = "10",
+			.pass = PASS,
+			.stateful = STATEFUL,
+			.npf = "to=any"
+		},
+		RULE_DEF_BLOCK,
+		NULL_RULE
+	};
+
+	struct dp_test_npf_ruleset_t rset = {
+		.rstype = "fw-out",
+		.name	= "FW1",
+		.enable = 1,
+		.attach_point = "dp2T1",
+		.fwd	= FWD,
+		.dir	= "out",
+		.rules	= rules
+	};
+
+	dp_test_npf_fw_add(&rset, false);
+
+	dpt_udp("dp1T0", "aa:bb:cc:16:0:20",
+		"192.0.2.103", 10000, "203.0.113.203", 60000,
+		"192.0.2.103", 10000, "203.0.113.203", 60000,
+		"aa:bb:cc:18:0:1", "dp2T1",
+		DP_TEST_FWD_FORWARDED);
+
+	/* Pack the one session as a template */
+	uint32_t saddr;
+	uint32_t daddr;
+	const struct ifnet *ifp;
+	char realname[IFNAMSIZ];
+	struct sentry_packet sp_forw;
+	struct session *s = NULL;
+	struct session *peer;
+	struct npf_pack_message tmpl, msg;
+	enum session_pack_type spt;
+	bool forw;
+	uint32_t i;
+	int rc;
+
+	dp_test_intf_real("dpT21", realname);
+	ifp = dp_ifnet_byifname(realname);
+
+	inet_pton(AF_INET, "192.0.2.103", &saddr);
+	inet_pton(AF_INET, "203.0.113.203", &daddr);
+
+	dp_test_session_init_sentry_packet(&sp_forw, ifp->if_index,
+			SENTRY_IPv4, (uint8_t) IPPROTO_UDP, 1, htons(10000),
+			&saddr, htons(60000), &daddr);
+	rc = session_lookup_by_sentry_packet(&sp_forw, &s, &forw);
+	dp_test_fail_unless(rc == 0 && s != NULL,
+			    "session_lookup_by_sentry_packet failed\n");
+
+	rc = dp_session_pack(s, &tmpl, sizeof(tmpl), SESSION_PACK_FULL,
+			     &peer);
+	dp_test_fail_unless(rc > 0, "dp_session_pack failed\n");
+	dp_test_npf_clear_sessions();
+
+	/*
+	 * Restore the template once per session, with a new source
+	 * address and port each time: the single session restore rate.
+	 */
+	struct npf_pack_session_fw *cs = (struct npf_pack_session_fw *)
+		&((struct npf_pack_session_new *)&msg.data.cs_new)->cs;
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < SSYNC_PERF_SESSIONS; i++) {
+		memcpy(&msg, &tmpl, tmpl.hdr.pmh_len);
+		sp_forw = cs->psp.psp_forw;
+		sp_forw.sp_addrids[0] =
+			(uint32_t)htons(1024 + (i & 0x3fff)) << 16 |
+			htons(60000);
+		sp_forw.sp_addrids[1] = htonl(ntohl(saddr) + (i >> 14));
+		cs->psp.psp_forw = sp_forw;
+		memset(&sp_forw, 0, sizeof(sp_forw));
+		sentry_packet_reverse(&cs->psp.psp_forw, &sp_forw);
+		cs->psp.psp_back = sp_forw;
+
+		rc = dp_session_restore(&msg, msg.hdr.pmh_len, &spt);
+		dp_test_fail_unless(rc == 0, "dp_session_restore failed %d\n",
+				    rc);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ssync_perf_rate("Single restore", SSYNC_PERF_SESSIONS, &start, &end);
+
+	struct ssync_perf_walk w = {
+		.s = calloc(SSYNC_PERF_SESSIONS, sizeof(struct session *)),
+	};
+
+	dp_test_fail_unless(w.s, "session array alloc failed\n");
+	dp_session_table_walk(ssync_perf_walk_cb, &w, SESSION_TYPE_FW);
+	dp_test_fail_unless(w.count == SSYNC_PERF_SESSIONS,
+			    "walked %u sessions, expected %u\n", w.count,
+			    SSYNC_PERF_SESSIONS);
+
+	/* Single session pack */
+	uint64_t single_bytes = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < w.count; i++) {
+		rc = dp_session_pack(w.s[i], &msg, sizeof(msg),
+				     SESSION_PACK_FULL, &peer);
+		dp_test_fail_unless(rc > 0, "dp_session_pack failed\n");
+		single_bytes += rc;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ssync_perf_rate("Single pack", w.count, &start, &end);
+
+	/* Bulk pack, into as many buffers as it takes */
+	uint32_t nbufs = 0, max_bufs = w.count / 64 + 1;
+	char **bufs = calloc(max_bufs, sizeof(char *));
+	int *lens = calloc(max_bufs, sizeof(int));
+	uint64_t bulk_bytes = 0;
+	uint32_t consumed;
+
+	dp_test_fail_unless(bufs && lens, "buffer alloc failed\n");
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < w.count; i += consumed) {
+		dp_test_fail_unless(nbufs < max_bufs, "too many buffers\n");
+		bufs[nbufs] = malloc(SSYNC_PERF_BULK_SIZE);
+		dp_test_fail_unless(bufs[nbufs], "buffer alloc failed\n");
+		lens[nbufs] = dp_session_pack_bulk(&w.s[i], w.count - i,
+						   bufs[nbufs],
+						   SSYNC_PERF_BULK_SIZE,
+						   SESSION_PACK_FULL,
+						   &consumed);
+		dp_test_fail_unless(lens[nbufs] > 0,
+				    "dp_session_pack_bulk failed %d\n",
+				    lens[nbufs]);
+		bulk_bytes += lens[nbufs++];
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ssync_perf_rate("Bulk pack", w.count, &start, &end);
+	printf("Packed %lu bytes single, %lu bytes in %u bulk messages\n",
+	       single_bytes, bulk_bytes, nbufs);
+
+	dp_test_npf_clear_sessions();
+
+	/* Bulk restore */
+	uint32_t restored, total = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nbufs; i++) {
+		rc = dp_session_restore_bulk(bufs[i], lens[i], &spt,
+					     &restored);
+		dp_test_fail_unless(rc == 0,
+				    "dp_session_restore_bulk failed %d\n", rc);
+		total += restored;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ssync_perf_rate("Bulk restore", total, &start, &end);
+	dp_test_fail_unless(total == w.count, "restored %u, expected %u\n",
+			    total, w.count);
+
+	for (i = 0; i < nbufs; i++)
+		free(bufs[i]);
+	free(bufs);
+	free(lens);
+	free(w.s);
+
+	dp_test_npf_fw_del(&rset, false);
+	dp_test_npf_clear_sessions();
+
+	dp_test_netlink_del_neigh("dp1T0", "192.0.2.103",
+				  "aa:bb:cc:16:0:20");
+	dp_test_netlink_del_neigh("dp2T1", "203.0.113.203",
+				  "aa:bb:cc:18:0:1");
+
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "192.0.2.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "203.0.113.1/24");
+
+} DP_END_TEST;